@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/integer.hpp>
+
+/* Counts the heap allocations of each thread, to check that the core does not allocate while it runs.
+ * Only compiled in with NBA_ALLOCATION_TRACKER, which replaces the global operator new and delete of the process.
+ *
+ * NBA_ALLOCATION_CHECK(name, enabled) logs an error if the enclosing block allocated on the calling thread
+ * while 'enabled' was true. The expression is not evaluated unless the tracker is compiled in.
+ */
+#if defined(NBA_ALLOCATION_TRACKER)
+
+#include <nba/log.hpp>
+
+namespace nba::alloc {
+
+// Number of calls to operator new that the calling thread made so far.
+auto GetThreadAllocationCount() -> u64;
+
+struct Check {
+  Check(char const* name, bool enabled) : name(name), enabled(enabled), begin(GetThreadAllocationCount()) {}
+
+ ~Check() {
+    if (enabled) {
+      auto count = GetThreadAllocationCount() - begin;
+
+      if (count != 0) {
+        Log<Error>("{}: made {} heap allocations after warm-up.", name, count);
+      }
+    }
+  }
+
+  char const* name;
+  bool enabled;
+  u64 begin;
+};
+
+} // namespace nba::alloc
+
+#define NBA_ALLOCATION_CHECK(name, enabled) nba::alloc::Check allocation_check{name, enabled}
+
+#else
+
+#define NBA_ALLOCATION_CHECK(name, enabled)
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <nba/core.hpp>
+#include <vector>
+
+namespace nba {
+
+/* Runs many cores side-by-side on a fixed number of threads.
+ * The work is split into slices of one frame per core. Every thread owns a queue of slices
+ * and steals from the other queues once its own runs dry, so that all threads
+ * stay busy even if some cores are much slower to emulate than others.
+ * Use a shared ROM::Image to avoid holding one copy of the ROM per core.
+ */
+struct BatchRunner {
+  // Called on a worker thread after each frame. Return false to stop the job early.
+  using FrameCallback = std::function<bool(CoreBase& core, int frame)>;
+
+  // A thread count of zero uses one thread per hardware thread.
+  BatchRunner(int thread_count = 0);
+ ~BatchRunner();
+
+  // Returns the ID of the job, which is its index into the list of jobs.
+  auto Add(
+    std::unique_ptr<CoreBase> core,
+    int frames,
+    FrameCallback callback = {}
+  ) -> int;
+
+  // Runs all jobs to completion and blocks until they are done.
+  void Run();
+
+  auto GetThreadCount() const -> int;
+  auto GetJobCount() const -> int;
+  auto GetCore(int job_id) -> CoreBase&;
+  auto GetFramesRun(int job_id) const -> int;
+
+private:
+  struct Job;
+  struct Worker;
+
+  void RunWorker(int worker_id);
+  bool RunSlice(int job_id);
+  bool PopJob(int worker_id, int& job_id);
+
+  int thread_count;
+  std::vector<std::unique_ptr<Job>> jobs;
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::atomic_int jobs_pending = 0;
+};
+
+} // namespace nba
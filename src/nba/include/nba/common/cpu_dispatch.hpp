@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <initializer_list>
+#include <vector>
+
+namespace nba {
+
+// Instruction set extensions that SIMD kernels are built for. On x86 each level includes the ones before it.
+enum class SIMDLevel {
+  Scalar,
+  SSE2,
+  SSE41,
+  AVX2,
+  AVX512, // F and BW
+  NEON
+};
+
+auto GetSIMDLevelName(SIMDLevel level) -> char const*;
+
+// Features of the host CPU, detected on first use.
+struct CPUFeatures {
+  bool sse2 = false;
+  bool sse41 = false;
+  bool pclmul = false;
+  bool avx2 = false;
+  bool avx512 = false;
+  bool neon = false;
+
+  bool Supports(SIMDLevel level) const;
+};
+
+auto GetCPUFeatures() -> CPUFeatures const&;
+
+// A SIMD kernel and the variant of it that was selected for the host, see SelectKernel().
+struct SIMDKernel {
+  char const* name;
+  SIMDLevel level;
+};
+
+// Returns every kernel that was selected so far, i.e. to report it next to benchmark results.
+auto GetSIMDKernels() -> std::vector<SIMDKernel>;
+
+namespace detail {
+
+void RegisterSIMDKernel(char const* name, SIMDLevel level);
+
+} // namespace nba::detail
+
+template<typename T>
+struct KernelVariant {
+  SIMDLevel level;
+  T implementation;
+  // Cleared if the variant needs more than its level, i.e. PCLMUL, and the host lacks it.
+  bool usable = true;
+};
+
+/* Returns the first variant that the host CPU can run, so variants are listed from the widest to the scalar one,
+ * which must come last. The variants are compiled with target attributes next to the baseline code,
+ * so that one binary makes use of wide vector units where they exist and still runs everywhere else.
+ * Meant to be called once, to initialize a function pointer (or a table of them) at startup.
+ */
+template<typename T>
+auto SelectKernel(char const* name, std::initializer_list<KernelVariant<T>> variants) -> T {
+  auto const& features = GetCPUFeatures();
+
+  for (auto const& variant : variants) {
+    if (variant.usable && features.Supports(variant.level)) {
+      detail::RegisterSIMDKernel(name, variant.level);
+      return variant.implementation;
+    }
+  }
+
+  detail::RegisterSIMDKernel(name, SIMDLevel::Scalar);
+  return (variants.end() - 1)->implementation;
+}
+
+} // namespace nba
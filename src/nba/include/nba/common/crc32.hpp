@@ -5,28 +5,116 @@
  * Refer to the included LICENSE file.
  */
 
+#pragma once
+
+#include <array>
+#include <cstddef>
 #include <nba/integer.hpp>
 
 namespace nba {
 
-inline u32 crc32(u8 const* data, int length) {
-  u32 crc32 = 0xFFFFFFFF;
+namespace detail {
+
+constexpr auto kCRC32Table = []() {
+  std::array<u32, 256> table{};
 
-  while (length-- != 0) {
-    u8 byte = *data++;
+  for (u32 i = 0; i < 256; i++) {
+    u32 crc32 = i;
 
-    // TODO: speed this up using a lookup table.
-    for (int i = 0; i < 8; i++) {
-      if ((crc32 ^ byte) & 1) {
+    for (int j = 0; j < 8; j++) {
+      if (crc32 & 1) {
         crc32 = (crc32 >> 1) ^ 0xEDB88320;
       } else {
         crc32 >>= 1;
       }
-      byte >>= 1;
     }
+    table[i] = crc32;
   }
 
-  return ~crc32;
+  return table;
+}();
+
+constexpr u32 CRC32Update(u32 crc32, u8 byte) {
+  return kCRC32Table[(crc32 ^ byte) & 0xFF] ^ (crc32 >> 8);
+}
+
+/* Advances a raw CRC32 register (without the initial and final inversion) over the data.
+ * Uses carry-less multiplication (PCLMULQDQ) on x86-64 CPUs that support it, the CRC32 instructions
+ * on ARMv8 builds that target them, and a slicing-by-8 table lookup otherwise.
+ */
+auto CRC32UpdateBlock(u32 crc32, u8 const* data, size_t length) -> u32;
+
+} // namespace nba::detail
+
+inline u32 crc32(u8 const* data, size_t length) {
+  return ~detail::CRC32UpdateBlock(0xFFFFFFFF, data, length);
 }
 
+// Computes the CRC32 of data that arrives in pieces, i.e. while a file is read.
+struct CRC32 {
+  void Update(u8 const* data, size_t length) {
+    crc32 = detail::CRC32UpdateBlock(crc32, data, length);
+  }
+
+  auto Get() const -> u32 {
+    return ~crc32;
+  }
+
+private:
+  u32 crc32 = 0xFFFFFFFF;
+};
+
+/* Computes the CRC32 of a fixed-length window, which slides over a buffer one byte at a time.
+ * Since CRC32 is linear, the contribution of the byte that leaves the window
+ * can be removed with a lookup table, so each step costs the same as one byte of crc32().
+ */
+struct RollingCRC32 {
+  explicit RollingCRC32(int length) : length(length) {
+    // Contribution of a byte followed by (length) zeroes, without the initial value.
+    for (int i = 0; i < 256; i++) {
+      u32 crc32 = detail::CRC32Update(0, u8(i));
+
+      for (int j = 0; j < length; j++) {
+        crc32 = detail::CRC32Update(crc32, 0);
+      }
+      lut_remove[i] = crc32;
+    }
+
+    // Appending a byte also advances the initial value by one zero byte, which must be undone.
+    u32 init_n = 0xFFFFFFFF;
+
+    for (int j = 0; j < length; j++) {
+      init_n = detail::CRC32Update(init_n, 0);
+    }
+
+    u32 init_correction = init_n ^ detail::CRC32Update(init_n, 0);
+
+    for (auto& entry : lut_remove) {
+      entry ^= init_correction;
+    }
+  }
+
+  // Starts the window at the given data, which must contain at least (length) bytes.
+  void Reset(u8 const* data) {
+    crc32 = 0xFFFFFFFF;
+    for (int i = 0; i < length; i++) {
+      crc32 = detail::CRC32Update(crc32, data[i]);
+    }
+  }
+
+  // Slides the window by one byte: byte_out is the first byte of the old window and byte_in the new last byte.
+  void Roll(u8 byte_out, u8 byte_in) {
+    crc32 = detail::CRC32Update(crc32, byte_in) ^ lut_remove[byte_out];
+  }
+
+  auto Get() const -> u32 {
+    return ~crc32;
+  }
+
+private:
+  int length;
+  u32 crc32 = 0xFFFFFFFF;
+  std::array<u32, 256> lut_remove;
+};
+
 } // namespace nba
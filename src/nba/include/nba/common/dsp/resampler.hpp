@@ -9,6 +9,7 @@
 
 #include <cmath>
 #include <memory>
+#include <nba/common/compiler.hpp>
 #include <nba/common/dsp/stereo.hpp>
 #include <nba/common/dsp/stream.hpp>
 
@@ -23,13 +24,42 @@ struct Resampler : WriteStream<T> {
   Resampler(std::shared_ptr<WriteStream<T>> output) : output(output) {}
   
   virtual void SetSampleRates(float samplerate_in, float samplerate_out) {
-    resample_phase_shift = samplerate_in / samplerate_out;
+    resample_phase_shift = samplerate_in / (samplerate_out * output_rate_scale);
+  }
+
+  /* Fine-tunes the output sample rate by a factor close to one (i.e. for dynamic rate control).
+   * Unlike SetSampleRates() this does not redesign any filters, so it is cheap enough to call often.
+   */
+  void SetOutputRateScale(float scale) {
+    resample_phase_shift *= output_rate_scale / scale;
+    output_rate_scale = scale;
   }
 
 protected:
+  static constexpr int kOutputBlockSize = 64;
+
+  // The output is collected and passed on in blocks. Write() must call FlushOutput() before it returns.
+  void ALWAYS_INLINE Emit(T const& value) {
+    output_block[output_count++] = value;
+
+    if (output_count == kOutputBlockSize) {
+      FlushOutput();
+    }
+  }
+
+  void FlushOutput() {
+    if (output_count != 0) {
+      output->Write(output_block, output_count);
+      output_count = 0;
+    }
+  }
+
   std::shared_ptr<WriteStream<T>> output;
+  T output_block[kOutputBlockSize];
+  int output_count = 0;
   
   float resample_phase_shift = 1;
+  float output_rate_scale = 1;
 };
 
 template <typename T>
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <array>
 #include <nba/common/dsp/resampler.hpp>
 
 namespace nba {
@@ -14,42 +15,31 @@ namespace nba {
 template<typename T>
 struct BlepResampler : Resampler<T> {
   BlepResampler(std::shared_ptr<WriteStream<T>> output)
-      : Resampler<T>(output) {
-    static constexpr int kTaylorPolyMaxIter = 5;
-    static constexpr int kHalfedLUTSize = kLUTsize / 2;
-    
-    double scale;
-
-    for (int i = 0; i < kLUTsize; i++) {
-      double sign = -1;
-      double factorial = 1;
-      double x = (i - kHalfedLUTSize) / double(kHalfedLUTSize) * M_PI;
-      double x_squared = x * x;
-      double result = x;
-
-      for (int j = 3; j < (2 * kTaylorPolyMaxIter + 1); j += 2) {
-        x *= x_squared;
-        factorial *= (j - 1) * j;
-        result += sign * x / (factorial * j);
-        sign = -sign;
-      }
+      : Resampler<T>(output)
+      , lut(GetLUT()) {
+  }
 
-      // Normalize interpolation kernel to [0, 1] range.
-      if (i == 0) {
-        scale = result;
-      }
-      lut[i] = result * 0.5 / scale + 0.5;
+  void Write(T const& input) final {
+    Process(input);
+    this->FlushOutput();
+  }
+
+  void Write(T const* input, int count) final {
+    for (int i = 0; i < count; i++) {
+      Process(input[i]);
     }
+    this->FlushOutput();
   }
 
-  void Write(T const& input) final {
+private:
+  void ALWAYS_INLINE Process(T const& input) {
     while (resample_phase < 1.0) {
       auto index = resample_phase * kLUTsize;
       float a0 = lut[int(index) + 0];
       float a1 = lut[int(index) + 1];
       float a = a0 + (a1 - a0) * (index - int(index));
 
-      this->output->Write(previous * a + input * (1.0 - a));
+      this->Emit(previous * a + input * (1.0 - a));
 
       resample_phase += this->resample_phase_shift;
     }
@@ -59,12 +49,47 @@ struct BlepResampler : Resampler<T> {
     previous = input;
   }
 
-private:
   static constexpr int kLUTsize = 512;
 
+  // The kernel is the same for every instance, so it is only generated once.
+  static auto GetLUT() -> float const* {
+    static auto const table = []() {
+      static constexpr int kTaylorPolyMaxIter = 5;
+      static constexpr int kHalfedLUTSize = kLUTsize / 2;
+
+      std::array<float, kLUTsize> lut;
+      double scale;
+
+      for (int i = 0; i < kLUTsize; i++) {
+        double sign = -1;
+        double factorial = 1;
+        double x = (i - kHalfedLUTSize) / double(kHalfedLUTSize) * M_PI;
+        double x_squared = x * x;
+        double result = x;
+
+        for (int j = 3; j < (2 * kTaylorPolyMaxIter + 1); j += 2) {
+          x *= x_squared;
+          factorial *= (j - 1) * j;
+          result += sign * x / (factorial * j);
+          sign = -sign;
+        }
+
+        // Normalize interpolation kernel to [0, 1] range.
+        if (i == 0) {
+          scale = result;
+        }
+        lut[i] = result * 0.5 / scale + 0.5;
+      }
+
+      return lut;
+    }();
+
+    return table.data();
+  }
+
   T previous = {};
   float resample_phase = 0;
-  float lut[kLUTsize];
+  float const* lut;
 };
 
 template <typename T>
@@ -21,13 +21,26 @@ struct CosineResampler : Resampler<T> {
   }
   
   void Write(T const& input) final {
+    Process(input);
+    this->FlushOutput();
+  }
+
+  void Write(T const* input, int count) final {
+    for (int i = 0; i < count; i++) {
+      Process(input[i]);
+    }
+    this->FlushOutput();
+  }
+
+private:
+  void ALWAYS_INLINE Process(T const& input) {
     while (resample_phase < 1.0) {
       auto index = resample_phase * kLUTsize;
       float a0 = lut[int(index) + 0];
       float a1 = lut[int(index) + 1];
       float a = a0 + (a1 - a0) * (index - int(index));
 
-      this->output->Write(previous * a + input * (1.0 - a));
+      this->Emit(previous * a + input * (1.0 - a));
       
       resample_phase += this->resample_phase_shift;
     }
@@ -37,7 +50,6 @@ struct CosineResampler : Resampler<T> {
     previous = input;
   }
   
-private:
   static constexpr int kLUTsize = 512;
   
   T previous = {};
@@ -18,6 +18,19 @@ struct CubicResampler : Resampler<T> {
   }
   
   void Write(T const& input) final {
+    Process(input);
+    this->FlushOutput();
+  }
+
+  void Write(T const* input, int count) final {
+    for (int i = 0; i < count; i++) {
+      Process(input[i]);
+    }
+    this->FlushOutput();
+  }
+
+private:
+  void ALWAYS_INLINE Process(T const& input) {
     while (resample_phase < 1.0) {
       // http://paulbourke.net/miscellaneous/interpolation/
       T a0, a1, a2, a3;
@@ -30,7 +43,7 @@ struct CubicResampler : Resampler<T> {
       a2 = previous[0] - previous[2];
       a3 = previous[1];
       
-      this->output->Write(a0*mu*mu2 + a1*mu2 + a2*mu + a3);
+      this->Emit(a0*mu*mu2 + a1*mu2 + a2*mu + a3);
       
       resample_phase += this->resample_phase_shift;
     }
@@ -42,7 +55,6 @@ struct CubicResampler : Resampler<T> {
     previous[0] = input;
   }
   
-private:
   T previous[3] = {{},{},{}};
   float resample_phase = 0;
 };
@@ -18,15 +18,27 @@ struct NearestResampler : Resampler<T> {
   }
   
   void Write(T const& input) final {
+    Process(input);
+    this->FlushOutput();
+  }
+
+  void Write(T const* input, int count) final {
+    for (int i = 0; i < count; i++) {
+      Process(input[i]);
+    }
+    this->FlushOutput();
+  }
+
+private:
+  void ALWAYS_INLINE Process(T const& input) {
     while (resample_phase < 1.0) {
-      this->output->Write(input);
+      this->Emit(input);
       resample_phase += this->resample_phase_shift;
     }
     
     resample_phase = resample_phase - 1.0;
   }
   
-private:
   float resample_phase = 0;
 };
 
@@ -7,8 +7,20 @@
 
 #pragma once
 
+#include <array>
+#include <map>
+#include <mutex>
 #include <nba/common/dsp/resampler.hpp>
-#include <nba/common/dsp/ring_buffer.hpp>
+#include <type_traits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+  #include <emmintrin.h>
+  #define NBA_SINC_SSE2
+#elif defined(__ARM_NEON)
+  #include <arm_neon.h>
+  #define NBA_SINC_NEON
+#endif
 
 namespace nba {
 
@@ -19,75 +31,182 @@ struct SincResampler : Resampler<T> {
   SincResampler(std::shared_ptr<WriteStream<T>> output) 
       : Resampler<T>(output) {
     SetSampleRates(1, 1);
-
-    for (int i = 0; i < points - 1; i++) {
-      taps.Write({});
-    }
   }
   
   void SetSampleRates(float samplerate_in, float samplerate_out) final {
     Resampler<T>::SetSampleRates(samplerate_in, samplerate_out);
-    
-    float kernelSum = 0.0;
-    float cutoff = 0.9;
-    
+
+    /* When downsampling, the cutoff is lowered by the ratio of the rates. The ratio is rounded up
+     * to a fixed step, so that only a few distinct kernels exist and a changed rate usually keeps the kernel.
+     */
+    int cutoff_step = 0;
+
     if (this->resample_phase_shift > 1.0) {
-      cutoff /= this->resample_phase_shift;
+      cutoff_step = int(std::ceil(this->resample_phase_shift * kCutoffSteps));
     }
 
-    for (int n = 0; n < points; n++) {
-      for (int m = 0; m < s_lut_resolution; m++) {
-        double t  = m/double(s_lut_resolution);
-        double x1 = M_PI * (t - n + points/2) + 1e-6;
-        double x2 = 2 * M_PI * (n + t)/points; 
-        double sinc = std::sin(cutoff * x1)/x1;
-        double blackman = 0.42 - 0.49 * std::cos(x2) + 0.076 * std::cos(2 * x2);
-        
-        lut[n * s_lut_resolution + m] = sinc * blackman;
-        kernelSum += sinc * blackman;
-      }
-    }
-    
-    kernelSum /= s_lut_resolution;
-    
-    for (int i = 0; i < points * s_lut_resolution; i++) {
-      lut[i] /= kernelSum;
+    if (!lut || cutoff_step != lut_cutoff_step) {
+      lut = GetLUT(cutoff_step)->data();
+      lut_cutoff_step = cutoff_step;
     }
   }
 
   void Write(T const& input) final {
-    taps.Write(input);
+    Process(input);
+    this->FlushOutput();
+  }
 
-    while (resample_phase < 1.0) { 
-      T sample = {};
+  void Write(T const* input, int count) final {
+    for (int i = 0; i < count; i++) {
+      Process(input[i]);
+    }
+    this->FlushOutput();
+  }
 
-      int x = int(std::round(resample_phase * s_lut_resolution));
-      
-      for (int n = 0; n < points; n += 4) {        
-        sample += taps.Peek(n + 0) * lut[x + 0 * s_lut_resolution];
-        sample += taps.Peek(n + 1) * lut[x + 1 * s_lut_resolution]; 
-        sample += taps.Peek(n + 2) * lut[x + 2 * s_lut_resolution]; 
-        sample += taps.Peek(n + 3) * lut[x + 3 * s_lut_resolution];
-        
-        x += 4 * s_lut_resolution;
-      }
+private:
+  void ALWAYS_INLINE Process(T const& input) {
+    /* Every input is stored twice, points samples apart, so that the last
+     * `points` inputs are always available as one contiguous window (oldest first).
+     */
+    history[history_head] = input;
+    history[history_head + points] = input;
+
+    if (++history_head == points) {
+      history_head = 0;
+    }
 
-      this->output->Write(sample);
+    auto window = &history[history_head];
+
+    while (resample_phase < 1.0) { 
+      int phase = int(std::round(resample_phase * s_lut_resolution));
+
+      this->Emit(DotProduct(window, &lut[phase * points]));
 
       resample_phase += this->resample_phase_shift;
     }
 
-    taps.Read();
-
     resample_phase = resample_phase - 1.0;
   }
   
-private:
   static constexpr int s_lut_resolution = 512;
 
-  double lut[points * s_lut_resolution];
+  // Resolution of the rate ratio that the cutoff of the kernel is derived from.
+  static constexpr int kCutoffSteps = 64;
+
+  /* Polyphase layout: the coefficients of all taps for one phase are contiguous.
+   * The phase is rounded to the nearest table row, which can be s_lut_resolution itself.
+   */
+  using LUT = std::array<float, (s_lut_resolution + 1) * points>;
+
+  static auto DotProduct(T const* window, float const* coeffs) -> T {
+#if defined(NBA_SINC_SSE2) || defined(NBA_SINC_NEON)
+    if constexpr (std::is_same_v<T, StereoSample<float>>) {
+      static_assert(sizeof(T) == 2 * sizeof(float));
+
+      auto samples = (float const*)window;
+
+  #if defined(NBA_SINC_SSE2)
+      auto acc0 = _mm_setzero_ps();
+      auto acc1 = _mm_setzero_ps();
+
+      // Each vector holds two stereo samples, so every coefficient is used for a pair of lanes.
+      for (int n = 0; n < points; n += 4) {
+        auto c = _mm_loadu_ps(&coeffs[n]);
+
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(&samples[n * 2 + 0]), _mm_unpacklo_ps(c, c)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(&samples[n * 2 + 4]), _mm_unpackhi_ps(c, c)));
+      }
+
+      auto acc = _mm_add_ps(acc0, acc1);
+      acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+
+      float result[4];
+      _mm_storeu_ps(result, acc);
+      return { result[0], result[1] };
+  #else
+      auto acc0 = vdupq_n_f32(0);
+      auto acc1 = vdupq_n_f32(0);
+
+      for (int n = 0; n < points; n += 4) {
+        auto c = vld1q_f32(&coeffs[n]);
+        auto c_pairs = vzipq_f32(c, c);
+
+        acc0 = vmlaq_f32(acc0, vld1q_f32(&samples[n * 2 + 0]), c_pairs.val[0]);
+        acc1 = vmlaq_f32(acc1, vld1q_f32(&samples[n * 2 + 4]), c_pairs.val[1]);
+      }
+
+      auto acc = vaddq_f32(acc0, acc1);
+      auto sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+      return { vget_lane_f32(sum, 0), vget_lane_f32(sum, 1) };
+  #endif
+    }
+#endif
+
+    T sample = {};
+
+    for (int n = 0; n < points; n++) {
+      sample += window[n] * coeffs[n];
+    }
+    return sample;
+  }
+
+  /* The kernel only depends on the cutoff frequency, so each one is computed once and then shared
+   * by all instances for the lifetime of the process. Since the cutoff is quantized, there are only a few of them.
+   * A step of zero is the cutoff that is used when the rate is not lowered.
+   */
+  static auto GetLUT(int cutoff_step) -> LUT const* {
+    static std::mutex mutex;
+    static std::map<int, std::unique_ptr<LUT const>> cache;
+
+    std::lock_guard guard{mutex};
+
+    auto& table = cache[cutoff_step];
+
+    if (!table) {
+      double cutoff = 0.9;
+
+      if (cutoff_step != 0) {
+        cutoff = cutoff * kCutoffSteps / cutoff_step;
+      }
+
+      auto lut = std::make_unique<LUT>();
+      double kernelSum = 0.0;
+
+      std::vector<double> kernel((s_lut_resolution + 1) * points);
+
+      for (int n = 0; n < points; n++) {
+        for (int m = 0; m <= s_lut_resolution; m++) {
+          double t  = m/double(s_lut_resolution);
+          double x1 = M_PI * (t - n + points/2) + 1e-6;
+          double x2 = 2 * M_PI * (n + t)/points; 
+          double sinc = std::sin(cutoff * x1)/x1;
+          double blackman = 0.42 - 0.49 * std::cos(x2) + 0.076 * std::cos(2 * x2);
+          
+          kernel[m * points + n] = sinc * blackman;
+
+          if (m != s_lut_resolution) {
+            kernelSum += sinc * blackman;
+          }
+        }
+      }
+      
+      kernelSum /= s_lut_resolution;
+      
+      for (size_t i = 0; i < kernel.size(); i++) {
+        (*lut)[i] = float(kernel[i] / kernelSum);
+      }
+
+      table = std::move(lut);
+    }
+
+    return table.get();
+  }
+
+  float const* lut = nullptr;
+  int lut_cutoff_step = 0;
   float resample_phase = 0;
-  RingBuffer<T> taps { points };
+  T history[points * 2] {};
+  int history_head = 0;
 };
 
 template <typename T, int points>
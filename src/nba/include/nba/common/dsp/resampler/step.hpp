@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <array>
+#include <nba/common/dsp/resampler.hpp>
+
+namespace nba {
+
+/* Resamples a piecewise constant signal (i.e. the output of a DAC) with band-limited steps.
+ * The input is given as levels and the number of input samples (ticks) that passed before each level change,
+ * so the input sample rate can be as high as the clock that drives the signal without any cost per tick.
+ * Each level change adds a windowed sinc step to the next kTaps output samples. The residual of the step
+ * is stored rather than the impulse, so that the output settles on the exact input level and cannot drift.
+ */
+template<typename T>
+struct StepResampler : Resampler<T> {
+  StepResampler(std::shared_ptr<WriteStream<T>> output)
+      : Resampler<T>(output)
+      , lut(GetLUT()) {
+  }
+
+  void Write(T const& input) final {
+    Process(input, 1);
+    this->FlushOutput();
+  }
+
+  void Write(T const* input, int count) final {
+    for (int i = 0; i < count; i++) {
+      Process(input[i], 1);
+    }
+    this->FlushOutput();
+  }
+
+  // Holds the current level for the given number of ticks, then changes it to the given level.
+  void Write(T const& level, int ticks) {
+    Process(level, ticks);
+    this->FlushOutput();
+  }
+
+  void Write(T const* levels, int const* ticks, int count) {
+    for (int i = 0; i < count; i++) {
+      Process(levels[i], ticks[i]);
+    }
+    this->FlushOutput();
+  }
+
+private:
+  static constexpr int kTaps = 16;
+  static constexpr int kLUTResolution = 256;
+
+  void ALWAYS_INLINE Process(T const& input, int ticks) {
+    position += ticks / this->resample_phase_shift;
+
+    while (position >= 1.0) {
+      this->Emit(level + residual[head]);
+      residual[head] = {};
+      head = (head + 1) % kTaps;
+      position -= 1.0;
+    }
+
+    if (input != level) {
+      auto delta = input - level;
+      auto step = &lut[int(std::round(position * kLUTResolution)) * kTaps];
+
+      for (int i = 0; i < kTaps; i++) {
+        residual[(head + i) % kTaps] += delta * step[i];
+      }
+
+      level = input;
+    }
+  }
+
+  // Holds the step residuals (step - 1) of one phase per row, with one extra row for a phase of exactly one.
+  static auto GetLUT() -> float const* {
+    static auto const table = []() {
+      std::array<float, (kLUTResolution + 1) * kTaps> lut;
+
+      for (int m = 0; m <= kLUTResolution; m++) {
+        double impulse[kTaps];
+        double sum = 0;
+
+        for (int n = 0; n < kTaps; n++) {
+          double x  = M_PI * (n - kTaps / 2 + 1 - m / double(kLUTResolution)) + 1e-6;
+          double x2 = 2 * M_PI * (n + 1 - m / double(kLUTResolution)) / kTaps;
+          double sinc = std::sin(0.9 * x) / x;
+          double blackman = 0.42 - 0.5 * std::cos(x2) + 0.08 * std::cos(2 * x2);
+
+          impulse[n] = sinc * blackman;
+          sum += impulse[n];
+        }
+
+        // Normalize the step to end on one, the last tap has no residual.
+        double step = 0;
+
+        for (int n = 0; n < kTaps; n++) {
+          step += impulse[n] / sum;
+          lut[m * kTaps + n] = n == kTaps - 1 ? 0.0f : float(step - 1.0);
+        }
+      }
+
+      return lut;
+    }();
+
+    return table.data();
+  }
+
+  float const* lut;
+  float position = 0;
+  T level = {};
+  T residual[kTaps] {};
+  int head = 0;
+};
+
+template <typename T>
+using StepStereoResampler = StepResampler<StereoSample<T>>;
+
+} // namespace nba
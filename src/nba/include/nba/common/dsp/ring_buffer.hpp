@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <memory>
 #include <nba/common/dsp/stereo.hpp>
 #include <nba/common/dsp/stream.hpp>
@@ -46,6 +47,19 @@ struct RingBuffer : Stream<T> {
     return value;
   }
 
+  // Reads up to count values and returns the number of values that were read.
+  auto Read(T* values, int count) -> int {
+    count = std::min(count, this->count);
+
+    for (int i = 0; i < count; i++) {
+      values[i] = data[rd_ptr];
+      rd_ptr = (rd_ptr + 1) % length;
+    }
+
+    this->count -= count;
+    return count;
+  }
+
   void Write(T const& value) {
     if (blocking && count == length) {
       return;
@@ -55,6 +69,12 @@ struct RingBuffer : Stream<T> {
     count++;
   }
 
+  void Write(T const* values, int count) {
+    for (int i = 0; i < count; i++) {
+      Write(values[i]);
+    }
+  }
+
 private:
   std::unique_ptr<T[]> data;
 
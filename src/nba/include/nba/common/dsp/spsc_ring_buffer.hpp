@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <nba/common/dsp/stereo.hpp>
+#include <nba/common/dsp/stream.hpp>
+#include <nba/integer.hpp>
+
+namespace nba {
+
+/* Ring buffer for exactly one producer thread (Write) and one consumer thread (Read, Peek, Available).
+ * Neither side ever blocks: samples written while the buffer is full are dropped.
+ * The read and write counters run freely and are only masked on access,
+ * which is why the capacity is rounded up to a power of two.
+ */
+template<typename T>
+struct SPSCRingBuffer : Stream<T> {
+  SPSCRingBuffer(int min_capacity) {
+    capacity = 1;
+    while (capacity < u32(min_capacity)) {
+      capacity <<= 1;
+    }
+    mask = capacity - 1;
+    data = std::make_unique<T[]>(capacity);
+  }
+
+  auto Capacity() const -> int { return int(capacity); }
+
+  // Consumer: the number of values that can be read.
+  auto Available() const -> int {
+    return int(wr_ptr.load(std::memory_order_acquire) - rd_ptr.load(std::memory_order_relaxed));
+  }
+
+  // Producer: the number of values that were written but not read yet.
+  auto Pending() const -> int {
+    return int(wr_ptr.load(std::memory_order_relaxed) - rd_ptr.load(std::memory_order_acquire));
+  }
+
+  // Consumer: returns a value without consuming it, offset must be less than Available().
+  auto Peek(int offset) const -> T {
+    return data[(rd_ptr.load(std::memory_order_relaxed) + offset) & mask];
+  }
+
+  // Consumer: returns the oldest value or a default value if the buffer is empty.
+  auto Read() -> T final {
+    auto rd = rd_ptr.load(std::memory_order_relaxed);
+
+    if (rd == wr_ptr.load(std::memory_order_acquire)) {
+      return {};
+    }
+
+    T value = data[rd & mask];
+    rd_ptr.store(rd + 1, std::memory_order_release);
+    return value;
+  }
+
+  // Consumer: reads up to count values and returns the number of values that were read.
+  auto Read(T* values, int count) -> int final {
+    auto rd = rd_ptr.load(std::memory_order_relaxed);
+    int available = int(wr_ptr.load(std::memory_order_acquire) - rd);
+
+    count = std::min(count, available);
+
+    for (int i = 0; i < count; i++) {
+      values[i] = data[(rd + i) & mask];
+    }
+
+    rd_ptr.store(rd + count, std::memory_order_release);
+    return count;
+  }
+
+  // Producer
+  void Write(T const& value) final {
+    auto wr = wr_ptr.load(std::memory_order_relaxed);
+
+    if (wr - rd_ptr.load(std::memory_order_acquire) == capacity) {
+      return;
+    }
+
+    data[wr & mask] = value;
+    wr_ptr.store(wr + 1, std::memory_order_release);
+  }
+
+  // Producer: the values that do not fit are dropped.
+  void Write(T const* values, int count) final {
+    auto wr = wr_ptr.load(std::memory_order_relaxed);
+    int free = int(capacity - (wr - rd_ptr.load(std::memory_order_acquire)));
+
+    count = std::min(count, free);
+
+    for (int i = 0; i < count; i++) {
+      data[(wr + i) & mask] = values[i];
+    }
+
+    wr_ptr.store(wr + count, std::memory_order_release);
+  }
+
+private:
+  std::unique_ptr<T[]> data;
+  u32 capacity;
+  u32 mask;
+
+  // Each counter lives on its own cache line, so that the two threads do not contend for it.
+  alignas(64) std::atomic<u32> rd_ptr{0};
+  alignas(64) std::atomic<u32> wr_ptr{0};
+};
+
+template <typename T>
+using StereoSPSCRingBuffer = SPSCRingBuffer<StereoSample<T>>;
+
+} // namespace nba
@@ -89,6 +89,14 @@ struct StereoSample {
     right *= other.right;
     return *this;
   }
+
+  bool operator==(StereoSample<T> const& other) const {
+    return left == other.left && right == other.right;
+  }
+
+  bool operator!=(StereoSample<T> const& other) const {
+    return !(*this == other);
+  }
 };
   
 } // namespace nba
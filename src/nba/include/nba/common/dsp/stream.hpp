@@ -9,11 +9,22 @@
 
 namespace nba {
 
+/* Besides single values, streams pass on blocks of values, which saves a virtual call per value.
+ * The block methods fall back to the single value methods, streams that can do better override them.
+ */
 template<typename T>
 struct ReadStream {
   virtual ~ReadStream() = default;
 
   virtual auto Read() -> T = 0;
+
+  // Reads up to count values and returns the number of values that were read.
+  virtual auto Read(T* values, int count) -> int {
+    for (int i = 0; i < count; i++) {
+      values[i] = Read();
+    }
+    return count;
+  }
 };
 
 template<typename T>
@@ -21,6 +32,12 @@ struct WriteStream {
   virtual ~WriteStream() = default;
   
   virtual void Write(T const& value) = 0;
+
+  virtual void Write(T const* values, int count) {
+    for (int i = 0; i < count; i++) {
+      Write(values[i]);
+    }
+  }
 };
 
 template<typename T>
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <nba/common/punning.hpp>
+#include <nba/integer.hpp>
+
+namespace nba {
+
+namespace detail {
+
+constexpr u64 kHashPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr u64 kHashPrime2 = 0xC2B2AE3D27D4EB4FULL;
+
+constexpr u64 HashRound(u64 hash, u64 word) {
+  hash ^= word * kHashPrime1;
+  return ((hash << 31) | (hash >> 33)) * kHashPrime2;
+}
+
+} // namespace detail
+
+/* Fast, non-cryptographic 64-bit hash for fingerprinting memory (i.e. the emulated state).
+ * Consumes eight bytes per round and mixes the result once at the end (the SplitMix64 finalizer).
+ * Pass a previous result as the seed to hash several pieces of memory in sequence.
+ */
+inline auto hash64(void const* data, size_t size, u64 seed = 0) -> u64 {
+  auto bytes = (u8 const*)data;
+  auto hash = seed ^ (u64(size) * detail::kHashPrime2);
+  size_t i = 0;
+
+  for (; i + sizeof(u64) <= size; i += sizeof(u64)) {
+    hash = detail::HashRound(hash, read<u64>(bytes, i));
+  }
+
+  if (i < size) {
+    u64 tail = 0;
+
+    std::memcpy(&tail, bytes + i, size - i);
+    hash = detail::HashRound(hash, tail);
+  }
+
+  hash ^= hash >> 30;
+  hash *= 0xBF58476D1CE4E5B9ULL;
+  hash ^= hash >> 27;
+  hash *= 0x94D049BB133111EBULL;
+  hash ^= hash >> 31;
+  return hash;
+}
+
+} // namespace nba
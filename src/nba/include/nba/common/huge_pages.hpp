@@ -0,0 +1,24 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace nba {
+
+/* Allocates zeroed, page-aligned memory straight from the OS.
+ * With 'huge_pages', the memory is backed by 2 MiB pages (or the large page size on Windows) if the host allows it,
+ * so that a buffer that is accessed all over needs fewer TLB entries. Otherwise it silently falls back to normal pages.
+ * Returns nullptr if no memory could be allocated at all.
+ */
+auto AllocatePages(size_t size, bool huge_pages) -> void*;
+
+// Frees memory from AllocatePages(). 'size' must be the size that was passed to it.
+void FreePages(void* pointer, size_t size);
+
+} // namespace nba
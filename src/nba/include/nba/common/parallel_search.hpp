@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <nba/integer.hpp>
+#include <thread>
+#include <vector>
+
+namespace nba {
+
+/* Finds the first match in [0, size), with the range split into chunks that are searched on separate threads.
+ * 'search(begin, end)' returns the offset of the first match that starts in [begin, end), or -1 if there is none.
+ * It may read past 'end' as far as a match needs. Small ranges are searched on the calling thread only.
+ * For ROMs that are memory-mapped this also spreads the page faults, i.e. the file I/O, across the threads.
+ */
+template<typename Search>
+auto ParallelSearch(size_t size, Search&& search, size_t min_chunk_size = 4 * 1024 * 1024) -> s64 {
+  size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t chunk_count = std::clamp<size_t>(size / min_chunk_size, 1, max_threads);
+
+  if (chunk_count == 1) {
+    return search(size_t{0}, size);
+  }
+
+  // Chunk boundaries are kept 4-byte aligned, for searches that step in words.
+  size_t chunk_size = ((size + chunk_count - 1) / chunk_count + 3) & ~size_t{3};
+  std::vector<s64> results(chunk_count, -1);
+  std::vector<std::thread> threads;
+
+  for (size_t i = 1; i < chunk_count; i++) {
+    threads.emplace_back([&, i]() {
+      auto begin = std::min(i * chunk_size, size);
+      results[i] = search(begin, std::min(begin + chunk_size, size));
+    });
+  }
+
+  results[0] = search(size_t{0}, std::min(chunk_size, size));
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (auto result : results) {
+    if (result != -1) {
+      return result;
+    }
+  }
+  return -1;
+}
+
+} // namespace nba
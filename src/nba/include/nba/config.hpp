@@ -7,18 +7,94 @@
 
 #pragma once
 
+#include <array>
+#include <functional>
 #include <memory>
 #include <nba/device/audio_device.hpp>
+#include <nba/device/audio_sink.hpp>
 #include <nba/device/input_device.hpp>
 #include <nba/device/video_device.hpp>
 #include <nba/integer.hpp>
+#include <nba/latency_probe.hpp>
 #include <string>
 
 namespace nba {
 
+// Maps every BGR555 color to the ARGB8888 color that is output for it.
+using ColorLUT = std::array<u32, 32768>;
+
 struct Config {
   bool skip_bios = false;
 
+  struct CPU {
+    /* Interpreter: decodes every fetched opcode, this is the reference implementation.
+     * CachedInterpreter: runs from pre-decoded blocks of code.
+     */
+    enum class Backend {
+      Interpreter,
+      CachedInterpreter
+    } backend = Backend::Interpreter;
+
+    /* Fast-forward to the next event when the CPU is stuck in a loop that
+     * only polls memory. This is a speed hack, turbo mode enables it regardless.
+     */
+    bool idle_loop_skip = false;
+
+    /* Run the BIOS math, memory copy and decompression functions natively.
+     * The results are the same, but the time spent in the BIOS is only approximated.
+     */
+    bool hle_bios = false;
+
+    /* Accurate: emulates the Game Pak prefetch buffer opcode by opcode.
+     * Fast: leaves the prefetch buffer model out of the bus. While prefetching is enabled, a sequential opcode fetch
+     * from the ROM is shortened by the cycles since the previous one, as if the buffer held a single opcode.
+     * Latched when the core is reset.
+     */
+    enum class AccuracyProfile {
+      Accurate,
+      Fast
+    } accuracy_profile = AccuracyProfile::Accurate;
+  } cpu;
+
+  /* Number of frames to skip after every rendered frame.
+   * Skipped frames are emulated as usual, but no pixels are rendered or presented.
+   */
+  int frame_skip = 0;
+
+  /* Optional color correction which is applied to every output pixel.
+   * Leave empty to output the plain BGR555 to ARGB8888 expansion.
+   */
+  std::shared_ptr<ColorLUT const> color_lut;
+
+  /* Render the PPU output on a separate thread.
+   * The emulation thread then only runs the PPU timing, the output is identical.
+   */
+  bool threaded_rendering = false;
+
+  /* Render each frame at V-blank, with its lines split across a pool of worker threads.
+   * The registers of each line and the writes to PRAM, VRAM and OAM are recorded during the frame.
+   * Takes precedence over threaded_rendering and skip_unchanged_lines, the output is identical.
+   */
+  bool parallel_rendering = false;
+
+  /* Render a line only if its registers, windows, OBJs or the memory that it reads changed
+   * since it was last rendered, and keep the previous output otherwise.
+   * Video devices are told which lines changed (see VideoDevice::SetDirtyLines()).
+   */
+  bool skip_unchanged_lines = false;
+
+  /* Poll the input device whenever the game reads KEYINPUT, instead of using the key state
+   * that the device last reported. Together with a delayed start of each frame (see FrameLimiter)
+   * this cuts input lag without the cost of run-ahead. Ignored while a movie is recorded or played back.
+   */
+  bool late_input_latching = false;
+
+  /* Back the emulator state (work RAM, VRAM and the page tables) and the ROM image with huge pages where the host allows it,
+   * which cuts TLB misses when many cores run at once. Falls back to normal pages with a warning otherwise.
+   * Latched when the core is created (for the state) and when a ROM is attached.
+   */
+  bool huge_pages = false;
+
   enum class BackupType {
     Detect,
     None,
@@ -40,13 +116,66 @@ struct Config {
     } interpolation = Interpolation::Cosine;
 
     bool interpolate_fifo = true;
+
+    /* Resample the mixer output only once, directly from the emulated sample timing to the output sample rate,
+     * instead of interpolating the FIFOs to the BIAS sample rate and resampling the mix from there.
+     * This also applies the amplitude resolution of the BIAS sample rate. Overrides the two options above.
+     */
+    bool single_stage_mixing = false;
     bool mp2k_hle_enable = false;
     bool mp2k_hle_cubic = false;
+
+    /* Render the MP2K HLE output on a separate thread, one frame ahead of when it is played.
+     * Changes to the music reach the output a frame later, otherwise it is the same.
+     */
+    bool mp2k_hle_threaded = false;
+
+    /* Mix audio in batches instead of scheduling an event for every output sample.
+     * The mixer catches up whenever the sound state changes, so the output is the same.
+     */
+    bool batch_mixing = false;
+
+    /* Mix audio on a separate thread: the emulation thread only records the writes to the sound registers
+     * and the FIFO samples, which the audio thread replays a few milliseconds later to produce the same output
+     * as batch mixing. The MP2K HLE mixer runs on that thread, too.
+     */
+    bool threaded_mixing = false;
+
+    /* Let the audio device pace emulation (see CoreBase::GetAudioBufferLevel()), with a smaller audio buffer.
+     * The output sample rate is nudged by up to 0.5% to keep the buffer half-full,
+     * which makes up for the drift between the host and audio device clocks.
+     * Frontends that pace emulation by the display should enable this for the rate control, too.
+     */
+    bool sync_to_audio = false;
   } audio;
 
+  struct RTC {
+    /* Host: the local time of the host, which is read once (on the first access after a reset or loading a state)
+     *   and from then on advanced by the emulated time, so it runs ahead while fast-forwarding.
+     * Fixed: 'epoch' at reset, advanced by the emulated time. Reproducible, i.e. for replays, netplay and tests.
+     */
+    enum class Source {
+      Host,
+      Fixed
+    } source = Source::Host;
+
+    s64 epoch = 946684800; // seconds since 1970-01-01 00:00:00, default is 2000-01-01 00:00:00
+  } rtc;
+
   std::shared_ptr<AudioDevice> audio_dev = std::make_shared<NullAudioDevice>();
   std::shared_ptr<InputDevice> input_dev = std::make_shared<NullInputDevice>();
   std::shared_ptr<VideoDevice> video_dev = std::make_shared<NullVideoDevice>();
+
+  // Optional, receives a copy of the audio output (latched on reset).
+  std::shared_ptr<AudioSink> audio_sink;
+
+  // Optional, measures the time from key presses to the frames that show the response.
+  std::shared_ptr<LatencyProbe> latency_probe;
+
+  /* Optional, called at the start of every thread that the core spawns (i.e. the PPU render thread and frame workers)
+   * with the name of the thread, so that the host can apply its scheduling policy to it.
+   */
+  std::function<void(char const* name)> on_thread_start;
 };
 
 } // namespace nba
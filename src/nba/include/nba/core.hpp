@@ -7,16 +7,29 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <nba/config.hpp>
+#include <nba/dirty_pages.hpp>
+#include <nba/game_hints.hpp>
+#include <nba/hotspot.hpp>
+#include <nba/input_movie.hpp>
+#include <nba/instruction_trace.hpp>
 #include <nba/integer.hpp>
+#include <nba/link_cable.hpp>
+#include <nba/profile.hpp>
 #include <nba/rom/rom.hpp>
+#include <nba/save_state.hpp>
+#include <nba/watchpoint.hpp>
+#include <string>
 #include <vector>
 
 namespace nba {
 
 struct CoreBase {
   static constexpr int kCyclesPerFrame = 280896;
+  static constexpr int kDeadlineCheckInterval = 1232; // one scanline
 
   virtual ~CoreBase() = default;
 
@@ -24,11 +37,228 @@ struct CoreBase {
   virtual void Attach(std::vector<u8> const& bios) = 0;
   virtual void Attach(ROM&& rom) = 0;
   virtual auto CreateRTC() -> std::unique_ptr<GPIO> = 0;
+
+  // Hints for the attached ROM, which take effect on the next Reset(). Attaching a ROM clears them.
+  virtual void SetGameHints(GameHints const& hints) = 0;
   virtual void Run(int cycles) = 0;
 
+  struct RunLimits {
+    int max_cycles = kCyclesPerFrame;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    bool stop_at_frame_end = false;
+  };
+
+  struct RunResult {
+    enum class Stop {
+      Cycles,     // max_cycles were run
+      Deadline,   // the host clock passed the deadline
+      FrameEnd,   // V-blank started, see RunLimits::stop_at_frame_end and RequestStop()
+      Watchpoint, // a watchpoint callback stopped the core
+      Breakpoint  // the CPU is about to execute an instruction that has a breakpoint, see AddBreakpoint()
+    } stop;
+
+    u64 cycles;      // the emulated cycles that were run, which may exceed max_cycles by a few
+    u64 idle_cycles; // how many of those the CPU was halted or skipped in an idle loop
+  };
+
+  /* Runs the core cooperatively, for hosts that interleave many cores on a few threads.
+   * Returns once any of the limits is reached. The host clock is only read once per
+   * scanline (see kDeadlineCheckInterval), so the deadline may pass by up to a scanline.
+   * Like Run(), the input device is sampled once per call.
+   */
+  virtual auto RunSlice(RunLimits const& limits) -> RunResult = 0;
+
+  /* Makes the current or next call to RunSlice() return at the start of the next V-blank.
+   * May be called from any thread. Takes effect within a scanline.
+   */
+  void RequestStop() {
+    stop_requested = true;
+  }
+
+  enum class Activity {
+    Running,
+    Halted,         // waiting for an interrupt in HALT or STOP
+    IdleLoop,       // spinning in a loop that waits for an interrupt, see Config::CPU::idle_loop_skip
+    WaitingForInput // halted or stopped, and only the keypad (or the cartridge) can raise an interrupt that wakes it
+  };
+
+  // What the CPU was doing when Run() or RunSlice() returned.
+  virtual auto GetActivity() -> Activity = 0;
+
+  /* Blocks until the input device reports a change, CancelWaitForInput() is called or the deadline passes.
+   * Returns true if the input changed. While the activity is Activity::WaitingForInput, every emulated frame
+   * looks the same until then, so the host may sleep here instead of emulating them.
+   */
+  virtual bool WaitForInput(std::chrono::steady_clock::time_point deadline) = 0;
+
+  // Makes the current or next call to WaitForInput() return right away. May be called from any thread.
+  virtual void CancelWaitForInput() = 0;
+
+  /* Restore the system from a snapshot taken with CopyState().
+   * Returns false if the snapshot was created by an incompatible version or contains out-of-range fields.
+   * The state is checked before anything is changed, so the system is left as it was in that case.
+   */
+  virtual bool LoadState(SaveState const& state) = 0;
+  virtual void CopyState(SaveState& state) = 0;
+
+  /* Sets the pages of guest RAM that were written since 'token' was returned and returns the token for the next call.
+   * Each client (i.e. rewind or netplay) keeps its own token, pass zero on the first call to get every page.
+   * Reset() and LoadState() dirty all pages.
+   */
+  virtual auto GetDirtyPages(u64 token, DirtyPages& pages) -> u64 = 0;
+
+  /* Fingerprint of the emulated state for detecting desyncs (i.e. between netplay peers), cheap enough for every frame:
+   * the CPU, the IO state, the APU FIFOs, the prefetch buffer and the pending scheduler events are hashed in full,
+   * guest RAM only where it was written since the last call. The audio mixer and the save memory are not covered.
+   * Must be called from the emulation thread.
+   */
+  virtual auto GetStateHash() -> u64 = 0;
+
+  /* Returns an independent core that continues from the current state, i.e. for tree search.
+   * The ROM image is shared, the save memory is copied and only kept in memory.
+   * The clone gets the null devices of a default Config, so it is best driven by an input movie.
+   * It has no audio sink and no latency probe, but calls the same Config::on_thread_start.
+   * Watchpoints, breakpoints, movies, traces and the link cable are not carried over.
+   * To branch off many times, LoadState() into existing clones, which only copies the memory that differs.
+   * Must be called from the emulation thread.
+   */
+  virtual auto Clone() -> std::unique_ptr<CoreBase> = 0;
+
+  /* Suppress presenting frames and writing samples to the audio device,
+   * without affecting the emulation itself. Useful for frames that are
+   * only emulated speculatively, such as for run-ahead.
+   */
+  virtual void SetVideoOutputEnabled(bool enabled) = 0;
+  virtual void SetAudioOutputEnabled(bool enabled) = 0;
+
+  // How full the audio buffer is, from 0 (empty) to 1 (full).
+  virtual auto GetAudioBufferLevel() -> float = 0;
+
+  struct AudioStats {
+    float buffer_level;    // see GetAudioBufferLevel()
+    u64 underruns;         // times the audio device found the buffer empty, since the core was created
+    float rate_adjustment; // current nudge of the output sample rate by the dynamic rate control (see Config::Audio::sync_to_audio), i.e. -0.002 is 0.2% slower
+    float latency;         // seconds from producing a sample until it is heard, with the latency that the audio device reports
+  };
+
+  // Must be called from the emulation thread.
+  virtual auto GetAudioStats() -> AudioStats = 0;
+
+  /* How fast the frontend runs the core relative to real time (i.e. to match the display refresh rate).
+   * The audio output rate is scaled by the inverse, so that the audio device is still fed at its own rate.
+   */
+  virtual void SetEmulationSpeed(float speed) = 0;
+
+  /* Trades accuracy for speed where it does not change the emulated state, e.g. while fast-forwarding:
+   * uses the cached interpreter, idle loop skipping and batch mixing regardless of the Config.
+   * Turning it off restores the Config settings. Can be toggled between frames and persists across Reset().
+   * Frame skip is left to the caller, see SetFrameSkip().
+   */
+  virtual void SetTurbo(bool enabled) = 0;
+
+  /* Per-section cycle and wall time totals of the last complete frame.
+   * Empty unless the core was built with NBA_PROFILER. May be called from any thread.
+   */
+  virtual auto GetProfileStats() -> ProfileStats = 0;
+
+  struct MemoryUsage {
+    size_t core;   // the Core object itself, including all emulated memories and page tables
+    size_t heap;   // frame and audio buffers, the block cache and the render thread
+    size_t shared; // the ROM image, which cores that load the same ROM::Image share
+  };
+
+  // Returns how much memory this core uses, in bytes. Must be called from the emulation thread.
+  virtual auto GetMemoryUsage() -> MemoryUsage = 0;
+
+  /* Sample the guest program counter after every interval-th scheduler event, zero stops sampling.
+   * Samples are kept in a lock-free ring until they are read and dropped while the ring is full.
+   * Both do nothing unless the core was built with NBA_HOTSPOT_SAMPLER.
+   * May be called from any thread, but only one thread may read the samples.
+   */
+  virtual void SetHotspotSampling(int interval) = 0;
+  virtual void ReadHotspotSamples(std::vector<HotspotSample>& samples) = 0;
+
+  /* Watch a range of memory for reads, writes and/or opcode fetches (see Watchpoint::Kind).
+   * Only the pages that contain a watchpoint leave the fast path, so the rest of the
+   * system runs at full speed. Execute watchpoints fire when the opcode is fetched,
+   * which is two instructions before it is executed (or never, if a branch is taken before).
+   * Mirrors of the watched range are watched too. Must not be called while Run() is running.
+   */
+  virtual auto AddWatchpoint(u32 address, u32 size, int kinds) -> int = 0;
+  virtual void RemoveWatchpoint(int id) = 0;
+  virtual void SetWatchpointCallback(Watchpoint::Callback callback) = 0;
+
+  /* Stop in front of the instruction at the given address (ARM or Thumb), for debuggers.
+   * While any breakpoint is set the CPU runs on the cached interpreter, whose blocks carry a trap in place of
+   * the handler of each instruction that has a breakpoint, so no other instruction checks for them.
+   * The stop is reported as RunResult::Stop::Breakpoint, the next Run(), RunSlice() or StepInstruction() executes the instruction first.
+   * ARM instructions whose condition fails do not stop. Mirrors of the address stop too.
+   * Must not be called while Run() is running.
+   */
+  virtual void AddBreakpoint(u32 address) = 0;
+  virtual void RemoveBreakpoint(u32 address) = 0;
+
+  /* Runs a single instruction, or until the next event while the CPU is halted. On the cached interpreter,
+   * a Thumb compare and the conditional branch after it run as one. Breakpoints do not stop the stepped instruction.
+   */
+  virtual void StepInstruction() = 0;
+
+  struct CPURegisters {
+    u32 reg[16]; // of the current mode, reg[15] is the address of the instruction that is executed next
+    u32 cpsr;
+  };
+
+  /* Changing reg[15] or the Thumb bit refills the pipeline from the new address without taking any time.
+   * Must not be called while Run() is running.
+   */
+  virtual auto GetCPURegisters() -> CPURegisters = 0;
+  virtual void SetCPURegisters(CPURegisters const& registers) = 0;
+
+  /* Memory access for debuggers, which takes no time and does not trigger watchpoints.
+   * The IO registers are read and written like the CPU does. Writes to the BIOS, the ROM and the save memory are ignored.
+   */
+  virtual auto DebugRead(u32 address) -> u8 = 0;
+  virtual void DebugWrite(u32 address, u8 value) = 0;
+
+  /* Record the last (at least) 'capacity' executed instructions into a ring, zero stops recording.
+   * Does nothing unless the core was built with NBA_INSTRUCTION_TRACE.
+   * DumpInstructionTrace() writes the ring to a file (see InstructionTrace for the format)
+   * and returns false if there is no trace or the file cannot be written.
+   */
+  virtual void SetInstructionTrace(int capacity) = 0;
+  virtual bool DumpInstructionTrace(std::string const& path) = 0;
+
+  /* Plug the serial port into a link cable that is shared with other cores, as the given player (0 is the parent).
+   * The cores may run on different threads, see LinkCable for how they are kept in sync.
+   * Returns false if another core is already connected as that player. Must not be called while Run() is running.
+   */
+  virtual bool ConnectLinkCable(std::shared_ptr<LinkCable> cable, int player) = 0;
+  virtual void DisconnectLinkCable() = 0;
+
+  /* Identifies the state in which the BIOS hands off to the ROM, which depends on
+   * the BIOS image and the ROM header only. Used for caching that state, see BootCache.
+   */
+  virtual auto GetBootID() -> u64 = 0;
+
+  // Overrides Config::frame_skip until the next Reset().
+  virtual auto GetFrameSkip() const -> int = 0;
+  virtual void SetFrameSkip(int frames) = 0;
+
+  /* Record or replay keypad input, starting at the current point in time.
+   * While recording, the input device is sampled once per call to Run() or RunSlice().
+   * While playing back, the input device is not used at all.
+   * Recording and playback restart when the core is reset.
+   */
+  virtual void StartMovieRecording(std::shared_ptr<InputMovie> movie) = 0;
+  virtual void StartMoviePlayback(std::shared_ptr<InputMovie const> movie) = 0;
+  virtual void StopMovie() = 0;
+
   void RunForOneFrame() {
     Run(kCyclesPerFrame);
   }
+
+protected:
+  std::atomic_bool stop_requested{false};
 };
 
 auto CreateCore(
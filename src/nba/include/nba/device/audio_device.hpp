@@ -17,7 +17,15 @@ struct AudioDevice {
   typedef void (*Callback)(void* userdata, s16* stream, int byte_len);
 
   virtual auto GetSampleRate() -> int = 0;
+
+  // The number of sample frames that the device asks for per callback (its period), once it was opened.
   virtual auto GetBlockSize() -> int = 0;
+
+  /* The time in sample frames from the callback returning the samples until they are heard, as reported by the device.
+   * Devices that cannot tell assume two periods.
+   */
+  virtual auto GetLatency() -> int { return GetBlockSize() * 2; }
+
   virtual bool Open(void* userdata, Callback callback) = 0;
   virtual void SetPause(bool value) = 0;
   virtual void Close() = 0;
@@ -25,7 +33,7 @@ struct AudioDevice {
 
 struct NullAudioDevice : AudioDevice {
   auto GetSampleRate() -> int final { return 32768; }
-  auto GetBlockSize() -> int final { return 4096; }
+  auto GetBlockSize() -> int final { return 512; }
   bool Open(void* userdata, Callback callback) final { return true; }
   void SetPause(bool value) final { }
   void Close() { }
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/common/dsp/stereo.hpp>
+
+namespace nba {
+
+/* Receives the audio of the emulated system on the emulation thread, in blocks of samples,
+ * independent of the audio device (i.e. for recording or hashing the audio in headless mode).
+ * Samples are not clamped, full scale is [-1, 1]. A block never mixes two sample rates.
+ */
+struct AudioSink {
+  enum Stream {
+    // The mixed output, after resampling to the sample rate of the audio device.
+    Mix = 1,
+
+    // The PSG channels and the Direct Sound FIFOs before mixing, at the rate of the mixer.
+    PSG = 2,
+    FIFO_A = 4,
+    FIFO_B = 8
+  };
+
+  virtual ~AudioSink() = default;
+
+  // Returns the streams that the sink wants to receive (a combination of Stream flags).
+  virtual auto GetStreams() -> int { return Mix; }
+
+  virtual void Write(Stream stream, int sample_rate, StereoSample<float> const* samples, int count) = 0;
+};
+
+} // namespace nba
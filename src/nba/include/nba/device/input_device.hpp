@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <atomic>
 #include <functional>
+#include <nba/integer.hpp>
 
 namespace nba {
 
@@ -41,14 +43,27 @@ struct NullInputDevice : InputDevice {
   void SetOnChangeCallback(std::function<void(void)> callback) final {}
 };
 
+/* The key state is a single atomic word, so that it may be set on the host's input thread(s)
+ * and polled on the emulation thread. The callback only runs when the state actually changes.
+ */
 struct BasicInputDevice : InputDevice {
   void SetKeyStatus(Key key, bool pressed) {
-    key_status[static_cast<int>(key)] = pressed;
-    keypress_callback();
+    u16 bit = 1 << static_cast<int>(key);
+    u16 old_status;
+
+    if (pressed) {
+      old_status = key_status.fetch_or(bit, std::memory_order_acq_rel);
+    } else {
+      old_status = key_status.fetch_and(~bit, std::memory_order_acq_rel);
+    }
+
+    if (((old_status & bit) != 0) != pressed && keypress_callback) {
+      keypress_callback();
+    }
   }
 
   auto Poll(Key key) -> bool final {
-    return key_status[static_cast<int>(key)];
+    return key_status.load(std::memory_order_acquire) & (1 << static_cast<int>(key));
   }
 
   void SetOnChangeCallback(std::function<void(void)> callback) final {
@@ -56,7 +71,7 @@ struct BasicInputDevice : InputDevice {
   }
 private:
   std::function<void(void)> keypress_callback;
-  bool key_status[kKeyCount];
+  std::atomic<u16> key_status = 0;
 };
 
 } // namespace nba
@@ -7,14 +7,106 @@
 
 #pragma once
 
+#include <bitset>
 #include <nba/integer.hpp>
 
 namespace nba {
 
+enum class PixelFormat {
+  ARGB8888, // 32-bit 0xAARRGGBB, passed to Draw(u32*)
+  RGB565,   // 16-bit, red in the upper bits, passed to Draw(u16*)
+  BGR555    // 16-bit native GBA color, red in the lower bits, passed to Draw(u16*)
+};
+
+/* The state that the PPU renders a line from, for video devices that render frames themselves.
+ * Registers use the hardware encoding, except where noted.
+ */
+struct PPULine {
+  u16 dispcnt; // the BG enable bits are the latched ones that apply to this line
+  u16 bgcnt[4];
+  u16 bghofs[4];
+  u16 bgvofs[4];
+  s32 bgx[2];  // internal reference points of BG2 and BG3 for this line
+  s32 bgy[2];
+  s16 bgpa[2];
+  s16 bgpb[2];
+  s16 bgpc[2];
+  s16 bgpd[2];
+  u16 winh[2];
+  u8  win_active; // bit n is set if WINn covers this line
+  u16 winin;
+  u16 winout;
+  u8  mosaic_bg[2];  // horizontal size and vertical counter
+  u8  mosaic_obj[2]; // horizontal size and vertical counter, as of the line before
+  u16 bldcnt;
+  u8  eva;
+  u8  evb;
+  u8  evy;
+};
+
+/* A frame that has not been rendered yet: the registers and palette of every line,
+ * and VRAM and OAM as of the first line. Writes to VRAM and OAM during the visible lines
+ * therefore only show up in the next frame.
+ */
+struct PPUFrame {
+  static constexpr int kLineCount = 160;
+
+  PPULine lines[kLineCount];
+  u16 pram[kLineCount][0x200];
+  u8  vram[0x18000];
+  u8  oam[0x400];
+};
+
 struct VideoDevice {
+  static constexpr int kFrameWidth = 240;
+  static constexpr int kFrameHeight = 160;
+  static constexpr int kMaxFrameScale = 4;
+
   virtual ~VideoDevice() = default;
 
+  // The format that frames are rendered in. This is queried when the emulator is reset.
+  virtual auto GetPixelFormat() -> PixelFormat {
+    return PixelFormat::ARGB8888;
+  }
+
+  /* Frames are (kFrameWidth * scale) x (kFrameHeight * scale) pixels, with scale in [1, kMaxFrameScale].
+   * Affine BGs and OBJs are rendered at that resolution, all other layers are scaled up.
+   * This is queried when the emulator is reset.
+   */
+  virtual auto GetFrameScale() -> int {
+    return 1;
+  }
+
+  /* Returns a buffer of one frame (see GetFrameScale()) in the device's pixel format,
+   * which the next frame is rendered into directly, or nullptr to have the emulator
+   * render into its own buffer. It is called right before the first line of a frame
+   * and the buffer is handed back through Draw() once the frame is complete.
+   * Until then the buffer must stay valid and must not be read by the device.
+   */
+  virtual auto AcquireFrame() -> void* {
+    return nullptr;
+  }
+
+  /* Marks the lines of the frame passed to the next Draw(u32*) or Draw(u16*) call that may differ
+   * from the frame passed to the call before, e.g. so that only those lines are uploaded.
+   * It is called right before each of these calls. All lines are marked unless Config::skip_unchanged_lines is set.
+   */
+  virtual void SetDirtyLines(std::bitset<kFrameHeight> const& lines) { }
+
   virtual void Draw(u32* buffer) = 0;
+
+  virtual void Draw(u16* buffer) { }
+
+  /* Returns a PPUFrame that the next frame is captured into, or nullptr to have the emulator
+   * render the frame. The emulator then does not render the frame at all and hands the captured
+   * frame to Draw(PPUFrame const&) at the start of V-blank, where the device renders it (e.g. on the GPU).
+   * It is called right before the first line of a frame, AcquireFrame() is only called if it returns nullptr.
+   */
+  virtual auto AcquirePPUFrame() -> PPUFrame* {
+    return nullptr;
+  }
+
+  virtual void Draw(PPUFrame const& frame) { }
 };
 
 struct NullVideoDevice : VideoDevice {
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <bitset>
+#include <nba/integer.hpp>
+
+namespace nba {
+
+/* The pages of guest RAM that were written during some span of emulation, see CoreBase::GetDirtyPages().
+ * Lets delta states, rewind, state hashing and netplay only look at the memory that changed.
+ * The regions are in the layout of SaveState (EWRAM and IWRAM in SaveState::bus, the rest in SaveState::ppu).
+ */
+struct DirtyPages {
+  enum class Region {
+    EWRAM,
+    IWRAM,
+    PRAM,
+    VRAM,
+    OAM,
+    Count
+  };
+
+  static constexpr int kPageShift = 8;
+  static constexpr u32 kPageSize = 1 << kPageShift;
+  static constexpr int kRegionCount = (int)Region::Count;
+  static constexpr u32 kRegionSize[kRegionCount] { 0x40000, 0x8000, 0x400, 0x18000, 0x400 };
+
+  // Index of the first page of each region, the pages of all regions are numbered consecutively.
+  static constexpr int kFirstPage[kRegionCount + 1] { 0x000, 0x400, 0x480, 0x484, 0x604, 0x608 };
+  static constexpr int kPageCount = kFirstPage[kRegionCount];
+
+  // Whether the page that holds the given offset into the region was written.
+  bool Test(Region region, u32 offset) const {
+    return pages[kFirstPage[(int)region] + (offset >> kPageShift)];
+  }
+
+  std::bitset<kPageCount> pages;
+};
+
+} // namespace nba
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/config.hpp>
+#include <nba/integer.hpp>
+#include <optional>
+
+namespace nba {
+
+/* Per-game knowledge that makes a game run faster without changing how it runs,
+ * e.g. found with the hot spot sampler. Frontends get these from the game database.
+ */
+struct GameHints {
+  static constexpr int kMaxIdleLoops = 4;
+
+  // Branch targets of the loops that wait for an interrupt. If any are given, idle loop detection only checks these.
+  u32 idle_loops[kMaxIdleLoops] {};
+
+  // Address of the MP2K SoundMainRAM function in IWRAM, which saves searching the ROM for it. Zero if unknown.
+  u32 mp2k_sound_main_ram = 0;
+
+  // The BIOS functions that may run natively with Config::CPU::hle_bios, one bit per SWI number. Zero allows all.
+  u64 hle_bios_functions = 0;
+
+  // Overrides Config::CPU::backend, the backends only differ in speed.
+  std::optional<Config::CPU::Backend> cpu_backend;
+};
+
+} // namespace nba
@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/integer.hpp>
+
+namespace nba {
+
+/* A sample of where the guest was executing, see CoreBase::SetHotspotSampling().
+ * Only collected when the core is compiled with NBA_HOTSPOT_SAMPLER defined.
+ */
+struct HotspotSample {
+  // Address of the instruction in the execute stage of the pipeline.
+  u32 address = 0;
+
+  // CPSR mode bits (i.e. 0x1F for system mode).
+  u8 mode = 0;
+
+  bool thumb = false;
+
+  // The CPU was halted (waiting for an IRQ) and address is the instruction after the halt.
+  bool halted = false;
+};
+
+} // namespace nba
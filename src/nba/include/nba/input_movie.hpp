@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/integer.hpp>
+#include <string>
+#include <vector>
+
+namespace nba {
+
+/* Recording of the keypad input of a session.
+ * Every event holds the set of pressed keys from that point on,
+ * where bit N corresponds to bit N of KEYINPUT (but set means pressed).
+ * Timestamps are in cycles, relative to the start of the recording.
+ */
+struct InputMovie {
+  static constexpr u32 kMagicNumber = 0x4D49424E; // 'NBIM'
+  static constexpr u32 kCurrentVersion = 1;
+
+  struct Event {
+    u64 timestamp;
+    u32 frame;
+    u16 keys;
+  };
+
+  std::vector<Event> events;
+
+  bool Load(std::string const& path);
+  bool Save(std::string const& path) const;
+};
+
+} // namespace nba
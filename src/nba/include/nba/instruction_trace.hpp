@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/integer.hpp>
+
+namespace nba {
+
+/* Binary trace of the most recently executed instructions, see CoreBase::SetInstructionTrace().
+ * Only recorded when the core is compiled with NBA_INSTRUCTION_TRACE defined.
+ *
+ * A trace file (little-endian) holds a Header, then 'record_count' records (oldest first),
+ * then 'value_count' register values (oldest first). The registers that an instruction
+ * changed are flagged in its 'written' mask (bits 0 to 14 are r0 to r14, bit 15 is the CPSR),
+ * their new values are stored in the value stream in ascending order, starting at 'value_index'.
+ * The value stream is indexed from 'first_value_index' on, the values of the oldest records
+ * may have been overwritten already (their index then lies before 'first_value_index').
+ */
+struct InstructionTrace {
+  static constexpr char kMagic[8] = {'N', 'B', 'A', 'T', 'R', 'A', 'C', 'E'};
+  static constexpr u32 kVersion = 1;
+
+  struct Header {
+    char magic[8];
+    u32 version;
+    u32 record_count;
+    u32 value_count;
+    u32 first_value_index;
+  };
+
+  struct Record {
+    // Address of the instruction, bit 0 is set for Thumb instructions.
+    u32 pc;
+    u32 opcode;
+    u32 value_index;
+    u16 written;
+
+    // Cycles until the next instruction started, including any events in between (saturates).
+    u16 cycles;
+  };
+
+  static_assert(sizeof(Header) == 24 && sizeof(Record) == 16);
+};
+
+} // namespace nba
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <nba/integer.hpp>
+#include <string>
+#include <vector>
+
+namespace nba {
+
+/* Measures the time from a key press to each stage of the pipeline that shows the response of the game,
+ * so that features like late input latching, run-ahead or threaded rendering can be judged in milliseconds.
+ *
+ * The response is detected as the first frame that differs from the one that was output when the key was pressed.
+ * So it only makes sense with a test ROM that shows a static screen until a key is pressed,
+ * and flashes the screen on every press (or toggles it on every change of the keys).
+ * Frames rendered on the GPU (see VideoDevice::Draw(PPUFrame const&)) are not in host memory and cannot be compared.
+ *
+ * A single press is tracked at a time, presses while one is tracked are ignored.
+ * All methods may be called from any thread.
+ */
+struct LatencyProbe {
+  using Clock = std::chrono::steady_clock;
+
+  // Each stage is measured from the time that the host reported the press (OnInput()).
+  enum class Stage {
+    Latched,   // the key state reached KEYINPUT
+    Rendered,  // the first frame that shows the response was complete
+    Drawn,     // that frame was handed to the video device, i.e. VideoDevice::Draw() returned
+    Presented, // the host finished presenting that frame, i.e. the buffer swap completed
+    Count
+  };
+
+  static constexpr auto GetName(Stage stage) -> char const* {
+    constexpr char const* names[(int)Stage::Count] { "latched", "rendered", "drawn", "presented" };
+
+    return names[(int)stage];
+  }
+
+  // Latency distribution of one stage, in milliseconds.
+  struct Distribution {
+    int count = 0;
+    double min = 0;
+    double mean = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double max = 0;
+  };
+
+  struct Stats {
+    Distribution stages[(int)Stage::Count];
+    int completed = 0;
+    int timed_out = 0; // presses whose response was never seen, i.e. because the screen did not change
+  };
+
+  /* With 'presents' set, the host reports presented frames (OnPresented()) and a press is complete once its frame is presented.
+   * Otherwise (i.e. in headless mode) it is complete once the frame is drawn.
+   */
+  explicit LatencyProbe(bool presents = true);
+
+  // Host: a key was pressed and handed to the input device.
+  void OnInput();
+
+  // Core: the emulated key state changed.
+  void OnKeysLatched();
+
+  // Core: a frame is complete, 'size' bytes of it are at 'frame'.
+  void OnFrameRendered(void const* frame, size_t size);
+
+  // Core: the frame passed to OnFrameRendered() was handed to the video device.
+  void OnFrameDrawn();
+
+  /* Host: a frame was presented, which includes every frame that was drawn before 'render_start'.
+   * A frame that is drawn while the host is about to present counts for the next presentation,
+   * so this stage may be up to one refresh too late, but never too early.
+   */
+  void OnPresented(Clock::time_point render_start);
+
+  auto GetStats() -> Stats;
+
+  // Returns the stats as a table, one line per stage.
+  auto FormatStats() -> std::string;
+
+  void Reset();
+
+private:
+  // Only the most recent presses are kept, so that a long session does not grow without bound.
+  static constexpr int kMaxSamples = 4096;
+
+  // A press whose response has not been presented within this time is given up on.
+  static constexpr auto kTimeout = std::chrono::seconds{2};
+
+  void Complete();
+
+  std::mutex mutex;
+  bool presents;
+
+  bool active = false;
+  int next_stage = 0;
+  Clock::time_point input_time;
+  Clock::time_point stage_time[(int)Stage::Count];
+  u32 baseline = 0;
+
+  u32 last_frame = 0;
+  bool have_frame = false;
+
+  std::array<std::vector<float>, (int)Stage::Count> samples;
+  int sample_index = 0;
+  int completed = 0;
+  int timed_out = 0;
+};
+
+} // namespace nba
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <nba/common/dsp/spsc_ring_buffer.hpp>
+#include <nba/integer.hpp>
+
+namespace nba {
+
+/* Connects the serial ports of up to four cores in one process (see CoreBase::ConnectLinkCable()),
+ * each of which may run on its own thread. The cores do not run in lockstep: each one may run up to
+ * 'quantum' cycles ahead of the slowest connected core before it waits, and transfers are passed
+ * between them through lock-free mailboxes (one per pair of players and direction).
+ * Smaller quanta make transfers complete closer to the time they would on hardware,
+ * larger quanta let the cores run with fewer synchronization points.
+ *
+ * Player 0 is the parent in multiplayer mode. Call Close() before the threads that run
+ * the cores stop running them, so that no core waits for a peer that will never catch up.
+ */
+struct LinkCable {
+  static constexpr int kMaxPlayers = 4;
+
+  struct Message {
+    enum class Type : u8 {
+      // Parent to child: transfer started, data[0] holds the data of the parent.
+      Request,
+      // Child to parent: data[0] holds the data of the child.
+      Response,
+      // Parent to child (multiplayer only): transfer done, data[] holds the data of all players.
+      Complete
+    } type;
+
+    // Which kind of transfer (SIO::Mode), only transfers of the same kind connect.
+    u8 mode;
+    u32 data[kMaxPlayers];
+  };
+
+  explicit LinkCable(int quantum = 4096) : quantum(quantum) {
+    for (int i = 0; i < kMaxPlayers; i++) {
+      connected[i] = false;
+      times[i] = 0;
+
+      for (int j = 0; j < kMaxPlayers; j++) {
+        if (i != j) {
+          mailboxes[i][j] = std::make_unique<SPSCRingBuffer<Message>>(kMailboxSize);
+        }
+      }
+    }
+  }
+
+  auto GetQuantum() const -> int {
+    return quantum;
+  }
+
+  void Close() {
+    closed = true;
+  }
+
+  bool IsClosed() const {
+    return closed;
+  }
+
+  // Returns false if the player is already connected.
+  bool Connect(int player) {
+    return !connected[player].exchange(true);
+  }
+
+  void Disconnect(int player) {
+    connected[player] = false;
+  }
+
+  bool IsConnected(int player) const {
+    return connected[player];
+  }
+
+  auto GetConnectedCount() const -> int {
+    int count = 0;
+    for (auto& value : connected) {
+      count += value ? 1 : 0;
+    }
+    return count;
+  }
+
+  /* The link time is the number of cycles since the cable was first used.
+   * A core that connects later joins at the time of the core that is furthest ahead.
+   */
+  auto GetLatestTime() const -> u64 {
+    u64 time = 0;
+    for (int i = 0; i < kMaxPlayers; i++) {
+      if (connected[i]) {
+        time = std::max(time, times[i].load(std::memory_order_acquire));
+      }
+    }
+    return time;
+  }
+
+  void Publish(int player, u64 time) {
+    times[player].store(time, std::memory_order_release);
+  }
+
+  // True if the player is within the quantum of every other connected player.
+  bool MayRunAhead(int player, u64 time) const {
+    for (int i = 0; i < kMaxPlayers; i++) {
+      if (i != player && connected[i] && time > times[i].load(std::memory_order_acquire) + quantum) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Only the 'from' player may send and only the 'to' player may receive on a mailbox.
+  void Send(int from, int to, Message const& message) {
+    mailboxes[from][to]->Write(message);
+  }
+
+  bool Receive(int from, int to, Message& message) {
+    auto& mailbox = *mailboxes[from][to];
+
+    if (mailbox.Available() == 0) {
+      return false;
+    }
+    message = mailbox.Read();
+    return true;
+  }
+
+private:
+  // At most a request and a completion are in flight per pair.
+  static constexpr int kMailboxSize = 16;
+
+  int quantum;
+  std::atomic_bool closed = false;
+  std::array<std::atomic_bool, kMaxPlayers> connected;
+  std::array<std::atomic<u64>, kMaxPlayers> times;
+  std::unique_ptr<SPSCRingBuffer<Message>> mailboxes[kMaxPlayers][kMaxPlayers];
+};
+
+} // namespace nba
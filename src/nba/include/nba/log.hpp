@@ -9,6 +9,7 @@
 
 #include <array>
 #include <fmt/format.h>
+#include <nba/common/compiler.hpp>
 #include <string_view>
 #include <utility>
 
@@ -33,27 +34,39 @@ namespace detail {
   static constexpr int kLogMask = All;
 #endif
 
+// Whether a message of the level passes the runtime filter of its subsystem (see SetLogMask()).
+bool IsLogEnabled(Level level, std::string_view format);
+
+void PushLog(Level level, std::string_view format, fmt::format_args args);
+
 } // namespace nba::detail
 
-template<Level level, typename... Args>
-inline void Log(std::string_view format, Args... args) {
-  if constexpr((detail::kLogMask & level) != 0) {
-    char const* prefix = "[?]";
+/* Messages are formatted on the calling thread into a queue of that thread, which a background thread
+ * writes to stdout in the order they were logged. Fatal messages are written before the call returns.
+ * Messages from the same call site are limited to a burst per second, the rest are counted and reported.
+ */
 
-    if constexpr(level == Trace) prefix = "\e[36m[T]";
-    if constexpr(level == Debug) prefix = "\e[34m[D]";
-    if constexpr(level ==  Info) prefix = "\e[37m[I]";
-    if constexpr(level ==  Warn) prefix = "\e[33m[W]";
-    if constexpr(level == Error) prefix = "\e[35m[E]";
-    if constexpr(level == Fatal) prefix = "\e[31m[F]";
+// Sets the levels that are logged, for all subsystems that do not have their own mask.
+void SetLogMask(int mask);
 
-    fmt::print("{} {}\n", prefix, fmt::format(format, args...));
+// Sets the levels that are logged for a subsystem, i.e. the messages starting with "<subsystem>:".
+void SetLogMask(std::string_view subsystem, int mask);
+
+// Blocks until all messages that were logged up to now have been written.
+void FlushLog();
+
+template<Level level, typename... Args>
+inline void Log(std::string_view format, Args const&... args) {
+  if constexpr((detail::kLogMask & level) != 0) {
+    if (detail::IsLogEnabled(level, format)) {
+      detail::PushLog(level, format, fmt::make_format_args(args...));
+    }
   }
 }
 
 template<typename... Args>
-inline void Assert(bool condition, Args... args) {
-  if (!condition) {
+inline void Assert(bool condition, Args const&... args) {
+  if (unlikely(!condition)) {
     Log<Fatal>(args...);
     std::exit(-1);
   }
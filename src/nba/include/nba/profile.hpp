@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/integer.hpp>
+
+namespace nba {
+
+/* Where the emulator spent its time during the last complete frame.
+ * Only collected when the core is compiled with NBA_PROFILER defined,
+ * otherwise all fields stay zero and 'enabled' is false.
+ * Time is exclusive: an event that fires while the CPU runs counts towards
+ * its own section and not towards the CPU.
+ */
+struct ProfileStats {
+  enum class Section {
+    CPU,
+    Halted,
+    DMA,
+    PPU,
+    PPURender,
+    APU,
+    APUMix,
+    Timer,
+    IRQ,
+    Other,
+    Count
+  };
+
+  struct Entry {
+    u64 cycles = 0;
+    u64 nanoseconds = 0;
+    u64 calls = 0;
+  };
+
+  auto operator[](Section section) const -> Entry const& {
+    return sections[(int)section];
+  }
+
+  static constexpr char const* GetName(Section section) {
+    constexpr char const* names[(int)Section::Count] {
+      "CPU", "Halted", "DMA", "PPU", "PPU render", "APU", "APU mix", "Timer", "IRQ", "Other"
+    };
+
+    return names[(int)section];
+  }
+
+  /* Scheduler events, indexed like core::EventClass.
+   * 'cycles_late' adds up how far the emulation had run past each event when it was dispatched.
+   */
+  static constexpr int kEventClassCount = 13;
+
+  struct EventEntry {
+    u64 count = 0;
+    u64 cycles_late = 0;
+  };
+
+  static constexpr char const* GetEventName(int event_class) {
+    constexpr char const* names[kEventClassCount] {
+      "End of queue",
+      "PPU scanline", "PPU H-blank", "PPU V-blank scanline", "PPU V-blank H-blank",
+      "APU mixer",
+      "IRQ line update",
+      "DMA start",
+      "Timer overflow",
+      "LDM user mode conflict",
+      "Keypad movie input",
+      "SIO transfer done", "SIO link sync"
+    };
+
+    return names[event_class];
+  }
+
+  // Bucket 0 counts events dispatched on time, bucket n > 0 those late by [2^(n-1), 2^n) cycles.
+  static constexpr int kLateBucketCount = 16;
+
+  bool enabled = false;
+  u64 frame = 0;
+  Entry sections[(int)Section::Count];
+  EventEntry events[kEventClassCount];
+  u64 events_late[kLateBucketCount] {};
+  int event_queue_peak = 0;
+  int event_queue_capacity = 0;
+};
+
+} // namespace nba
@@ -7,16 +7,27 @@
 
 #pragma once
 
+#include <memory>
 #include <nba/integer.hpp>
+#include <nba/save_state.hpp>
 
 namespace nba { 
 
 struct Backup {
   virtual ~Backup() = default;
 
+  /* Resets the state of the chip only. The save data is loaded once when the chip is created,
+   * that is when a ROM is attached, and kept in memory across resets.
+   */
   virtual void Reset() = 0;
   virtual auto Read (u32 address) -> u8 = 0;
   virtual void Write(u32 address, u8 value) = 0;
+
+  virtual void LoadState(SaveState const& state) = 0;
+  virtual void CopyState(SaveState& state) = 0;
+
+  // Returns a copy of the chip, whose save data is only kept in memory (see BackupFile::Clone()).
+  virtual auto Clone() -> std::unique_ptr<Backup> = 0;
 };
 
 } // namespace nba
@@ -8,18 +8,33 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <memory>
+#include <mutex>
 #include <nba/integer.hpp>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
+#if defined(_WIN32)
+  #include <fcntl.h>
+  #include <io.h>
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
 namespace nba {
 
 struct BackupFile {
+  /* The file is memory-mapped if possible, so that writes are plain stores and the OS writes them back.
+   * Otherwise it is kept in a buffer and writes are written back to the file on a background thread.
+   */
   static auto OpenOrCreate(std::string const& save_path,
                            std::vector<size_t> const& valid_sizes,
                            int& default_size) -> std::unique_ptr<BackupFile> {
@@ -37,34 +52,57 @@ struct BackupFile {
       auto end = valid_sizes.end();
 
       if (std::find(begin, end, size) != end) {
-        file->stream.open(save_path, flags);
-        if (file->stream.fail()) {
-          throw std::runtime_error("BackupFile: unable to open file: " + save_path);
-        }
         default_size = size;
-        file->memory.reset(new u8[size]);
-        file->stream.read((char*)file->memory.get(), size);
         create = false;
       }
     }
 
     file->file_size = default_size;
+    file->path = save_path;
 
     /* A new save file is created either when no file exists yet,
      * or when the existing file has an invalid size.
      */
     if (create) {
-      file->stream.open(save_path, flags | std::ios::trunc);
-      if (file->stream.fail()) {
+      std::vector<u8> blank(default_size, 0xFF);
+      std::ofstream stream{save_path, std::ios::binary | std::ios::trunc};
+      stream.write((char*)blank.data(), blank.size());
+      if (stream.fail()) {
         throw std::runtime_error("BackupFile: unable to create file: " + save_path);
       }
-      file->memory.reset(new u8[default_size]);
-      file->MemorySet(0, default_size, 0xFF);
     }
 
+    if (file->Map()) {
+      return file;
+    }
+
+    file->stream.open(save_path, flags);
+    if (file->stream.fail()) {
+      throw std::runtime_error("BackupFile: unable to open file: " + save_path);
+    }
+    file->buffer.reset(new u8[default_size]);
+    file->memory = file->buffer.get();
+    file->stream.read((char*)file->memory, default_size);
     return file;
   }
 
+  /* File updates are written back on a background thread. Writes only mark a range of the file as dirty,
+   * which is flushed once no further writes happened for kQuietInterval, or at the latest after kMaxDelay.
+   * That way a FLASH sector erase or an EEPROM burst ends up as a single write to the file.
+   */
+ ~BackupFile() {
+    if (writer.joinable()) {
+      {
+        std::lock_guard lock{mutex};
+        stop = true;
+      }
+      condition.notify_one();
+      writer.join();
+    }
+    Flush();
+    Unmap();
+  }
+
   auto Read(unsigned index) -> u8 {
     if (index >= file_size) {
       throw std::runtime_error("BackupFile: out-of-bounds index while reading.");
@@ -76,9 +114,14 @@ struct BackupFile {
     if (index >= file_size) {
       throw std::runtime_error("BackupFile: out-of-bounds index while writing.");
     }
+    if (mapped) {
+      memory[index] = value;
+      return;
+    }
+    std::lock_guard lock{mutex};
     memory[index] = value;
     if (auto_update) {
-      Update(index, 1);
+      MarkDirty(index, 1);
     }
   }
 
@@ -86,28 +129,210 @@ struct BackupFile {
     if ((index + length) > file_size) {
       throw std::runtime_error("BackupFile: out-of-bounds index while setting memory.");
     }
+    if (mapped) {
+      std::memset(&memory[index], value, length);
+      return;
+    }
+    std::lock_guard lock{mutex};
     std::memset(&memory[index], value, length);
     if (auto_update) {
-      Update(index, length);
+      MarkDirty(index, length);
     }
   }
 
+  void MemoryCopy(unsigned index, u8 const* data, size_t length) {
+    if ((index + length) > file_size) {
+      throw std::runtime_error("BackupFile: out-of-bounds index while copying memory.");
+    }
+    // Skip the file update if nothing has changed, which often is the case when loading a save state.
+    if (std::memcmp(&memory[index], data, length) != 0) {
+      if (mapped) {
+        std::memcpy(&memory[index], data, length);
+        return;
+      }
+      std::lock_guard lock{mutex};
+      std::memcpy(&memory[index], data, length);
+      if (auto_update) {
+        MarkDirty(index, length);
+      }
+    }
+  }
+
+  // Schedules a range of the file to be written back.
   void Update(unsigned index, size_t length) {
     if ((index + length) > file_size) {
       throw std::runtime_error("BackupFile: out-of-bounds index while updating file.");
     }
-    stream.seekg(index);
-    stream.write((char*)&memory[index], length);
+    if (mapped) {
+      return;
+    }
+    std::lock_guard lock{mutex};
+    MarkDirty(index, length);
+  }
+
+  /* Writes all pending updates to the file and waits for it to complete.
+   * A mapped file is in the OS page cache already, which survives the emulator crashing,
+   * so this only matters for making sure that the data has reached the storage device.
+   */
+  void Flush() {
+    if (mapped) {
+      SyncMapping();
+      return;
+    }
+
+    std::lock_guard file_lock{file_mutex};
+    std::vector<u8> data;
+    size_t begin;
+    bool sync;
+
+    {
+      std::lock_guard lock{mutex};
+      if (dirty_begin >= dirty_end) {
+        return;
+      }
+      begin = dirty_begin;
+      data.assign(&memory[dirty_begin], &memory[dirty_end]);
+      dirty_begin = file_size;
+      dirty_end = 0;
+      sync = sync_to_disk;
+    }
+
+    stream.seekp(begin);
+    stream.write((char*)data.data(), data.size());
+    stream.flush();
+
+    if (sync) {
+      SyncToDisk();
+    }
+  }
+
+  /* Returns a copy of the data that is only kept in memory, for a core that branches off another one
+   * (see CoreBase::Clone()). Writes to the copy never reach the file.
+   */
+  auto Clone() -> std::unique_ptr<BackupFile> {
+    std::unique_ptr<BackupFile> file { new BackupFile() };
+
+    file->file_size = file_size;
+    file->auto_update = false;
+    file->buffer.reset(new u8[file_size]);
+    file->memory = file->buffer.get();
+
+    std::lock_guard lock{mutex};
+    std::memcpy(file->memory, memory, file_size);
+    return file;
+  }
+
+  auto Buffer() -> u8* {
+    return memory;
+  }
+
+  bool IsMapped() const {
+    return mapped;
+  }
+
+  auto Size() const -> size_t {
+    return file_size;
   }
 
   bool auto_update = true;
 
+  // If set, the file is also synced to the storage device after each write-back (ignored for mapped files).
+  bool sync_to_disk = false;
+
 private:
+  static constexpr auto kQuietInterval = std::chrono::milliseconds{100};
+  static constexpr auto kMaxDelay = std::chrono::milliseconds{1000};
+
   BackupFile() { }
 
+  // Must be called with the mutex held.
+  void MarkDirty(size_t index, size_t length) {
+    if (dirty_begin >= dirty_end) {
+      dirty_begin = index;
+      dirty_end = index + length;
+      if (!writer.joinable()) {
+        writer = std::thread{&BackupFile::RunWriter, this};
+      } else {
+        condition.notify_one();
+      }
+    } else {
+      dirty_begin = std::min(dirty_begin, index);
+      dirty_end = std::max(dirty_end, index + length);
+    }
+    write_count++;
+  }
+
+  void RunWriter() {
+    std::unique_lock lock{mutex};
+
+    while (true) {
+      condition.wait(lock, [this]() { return stop || dirty_begin < dirty_end; });
+
+      if (stop) {
+        break;
+      }
+
+      // Wait for the writes to settle down, so that a burst of writes is flushed at once.
+      auto deadline = std::chrono::steady_clock::now() + kMaxDelay;
+
+      while (!stop && std::chrono::steady_clock::now() < deadline) {
+        auto count = write_count;
+        condition.wait_for(lock, kQuietInterval);
+        if (write_count == count) {
+          break;
+        }
+      }
+
+      lock.unlock();
+      Flush();
+      lock.lock();
+    }
+  }
+
+  // Implemented in backup_file.cpp, so that this header does not pull in the OS headers.
+  bool Map();
+  void Unmap();
+  void SyncMapping();
+
+  void SyncToDisk() {
+#if defined(_WIN32)
+    int fd = _open(path.c_str(), _O_RDWR | _O_BINARY);
+    if (fd != -1) {
+      _commit(fd);
+      _close(fd);
+    }
+#else
+    // Syncing any descriptor of a file flushes all of its data that is still cached by the OS.
+    int fd = open(path.c_str(), O_RDWR);
+    if (fd != -1) {
+      ::fsync(fd);
+      close(fd);
+    }
+#endif
+  }
+
   size_t file_size;
+  std::string path;
+  u8* memory = nullptr;
+
+  // Only used if the file could not be mapped.
   std::fstream stream;
-  std::unique_ptr<u8[]> memory;
+  std::unique_ptr<u8[]> buffer;
+
+  bool mapped = false;
+#if defined(_WIN32)
+  void* file_handle = nullptr;
+#endif
+
+  // Protects the memory and the dirty range, which are shared with the writer thread.
+  std::mutex mutex;
+  std::mutex file_mutex;
+  std::condition_variable condition;
+  std::thread writer;
+  bool stop = false;
+  size_t dirty_begin = 0;
+  size_t dirty_end = 0;
+  u64 write_count = 0;
 };
 
 } // namespace nba
@@ -24,8 +24,14 @@ struct EEPROM : Backup {
   void Reset() final;
   auto Read (u32 address) -> u8 final;
   void Write(u32 address, u8 value) final;
+
+  void LoadState(SaveState const& state) final;
+  void CopyState(SaveState& state) final;
+  auto Clone() -> std::unique_ptr<Backup> final;
   
 private:
+  EEPROM() = default;
+
   enum State {
     STATE_ACCEPT_COMMAND = 1 << 0,
     STATE_READ_MODE      = 1 << 1,
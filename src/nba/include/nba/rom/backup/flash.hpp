@@ -25,8 +25,13 @@ struct FLASH : Backup {
   auto Read (u32 address) -> u8 final;
   void Write(u32 address, u8 value) final;
 
+  void LoadState(SaveState const& state) final;
+  void CopyState(SaveState& state) final;
+  auto Clone() -> std::unique_ptr<Backup> final;
+
 private:
-  
+  FLASH() = default;
+
   enum Command {
     READ_CHIP_ID = 0x90,
     FINISH_CHIP_ID = 0xF0,
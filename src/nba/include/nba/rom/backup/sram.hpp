@@ -19,8 +19,14 @@ struct SRAM : Backup {
   void Reset() final;  
   auto Read (u32 address) -> u8 final;
   void Write(u32 address, u8 value) final;
+
+  void LoadState(SaveState const& state) final;
+  void CopyState(SaveState& state) final;
+  auto Clone() -> std::unique_ptr<Backup> final;
   
 private:
+  SRAM() = default;
+
   std::string save_path;
   std::unique_ptr<BackupFile> file;
 };
@@ -9,6 +9,7 @@
 
 #include <cassert>
 #include <nba/integer.hpp>
+#include <nba/save_state.hpp>
 
 namespace nba {
 
@@ -38,6 +39,9 @@ struct GPIO {
   auto Read (u32 address) -> u8;
   void Write(u32 address, u8 value);
 
+  virtual void LoadState(SaveState const& state);
+  virtual void CopyState(SaveState& state);
+
 protected:
   virtual auto ReadPort() -> u8 = 0;
   virtual void WritePort(u8 value) = 0;
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <functional>
+#include <nba/integer.hpp>
+#include <vector>
+
+namespace nba {
+
+/* Read-only ROM data, which either lives in a buffer owned by the image
+ * or in memory owned elsewhere (i.e. a memory-mapped file).
+ * For the latter, the release function is called once the image is destroyed.
+ */
+struct ROMImage {
+  ROMImage() = default;
+
+  ROMImage(std::vector<u8>&& buffer)
+      : buffer(std::move(buffer)) {
+    base = this->buffer.data();
+    length = this->buffer.size();
+  }
+
+  ROMImage(u8 const* base, size_t length, std::function<void()> release)
+      : base(base)
+      , length(length)
+      , release(std::move(release)) {
+  }
+
+ ~ROMImage() {
+    if (release) {
+      release();
+    }
+  }
+
+  ROMImage(ROMImage const&) = delete;
+  auto operator=(ROMImage const&) -> ROMImage& = delete;
+
+  auto data() const -> u8 const* {
+    return base;
+  }
+
+  auto size() const -> size_t {
+    return length;
+  }
+
+  auto operator[](size_t index) const -> u8 const& {
+    return base[index];
+  }
+
+private:
+  std::vector<u8> buffer;
+  u8 const* base = nullptr;
+  size_t length = 0;
+  std::function<void()> release;
+};
+
+} // namespace nba
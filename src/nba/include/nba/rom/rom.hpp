@@ -11,6 +11,7 @@
 #include <memory>
 #include <nba/integer.hpp>
 #include <nba/rom/backup/eeprom.hpp>
+#include <nba/rom/image.hpp>
 #include <nba/rom/gpio/gpio.hpp>
 #include <nba/common/compiler.hpp>
 #include <nba/common/punning.hpp>
@@ -19,16 +20,33 @@
 namespace nba {
 
 // TODO: handle Nseq access resets EEPROM chip?
-// TODO: optimize EEPROM check away for lower-half ROM address space
 
 struct ROM {
-  ROM() {}
+  /* The ROM image is never written to, so any number of cores
+   * can share a single copy of it, for example when running tests in batch.
+   */
+  using Image = std::shared_ptr<ROMImage const>;
+
+  ROM() : rom(std::make_shared<ROMImage const>()) {}
 
   ROM(
     std::vector<u8>&& rom,
     std::unique_ptr<Backup>&& backup,
     std::unique_ptr<GPIO>&& gpio,
     u32 rom_mask = 0x01FF'FFFF
+  )   : ROM(
+          std::make_shared<ROMImage const>(std::move(rom)),
+          std::move(backup),
+          std::move(gpio),
+          rom_mask
+        ) {
+  }
+
+  ROM(
+    Image rom,
+    std::unique_ptr<Backup>&& backup,
+    std::unique_ptr<GPIO>&& gpio,
+    u32 rom_mask = 0x01FF'FFFF
   )   : rom(std::move(rom))
       , gpio(std::move(gpio))
       , rom_mask(rom_mask) {
@@ -36,7 +54,7 @@ struct ROM {
       if (typeid(*backup.get()) == typeid(EEPROM)) {
         backup_eeprom = std::move(backup);
 
-        if (this->rom.size() >= 0x0100'0001) {
+        if (this->rom->size() >= 0x0100'0001) {
           eeprom_mask = 0x01FF'FF00;
         } else {
           eeprom_mask = 0x0100'0000;
@@ -65,10 +83,90 @@ struct ROM {
     return *this;
   }
 
-  auto GetRawROM() -> std::vector<u8>& {
+  auto GetRawROM() const -> ROMImage const& {
+    return *rom;
+  }
+
+  auto GetImage() const -> Image const& {
     return rom;
   }
 
+  // Replaces the image with one of the same contents, i.e. a copy in different memory.
+  void SetImage(Image image) {
+    rom = std::move(image);
+  }
+
+  /* Returns a ROM that shares the image and has a copy of the save memory, which is only kept in memory.
+   * A GPIO device is bound to the core that created it, so the clone takes a new one.
+   */
+  auto Clone(std::unique_ptr<GPIO>&& gpio) const -> ROM {
+    auto backup = backup_eeprom ? backup_eeprom->Clone() : backup_sram ? backup_sram->Clone() : nullptr;
+
+    return ROM{rom, std::move(backup), std::move(gpio), rom_mask};
+  }
+
+  bool HasGPIO() const {
+    return (bool)gpio;
+  }
+
+  void Reset() {
+    if (backup_sram) backup_sram->Reset();
+    if (backup_eeprom) backup_eeprom->Reset();
+  }
+
+  void LoadState(SaveState const& state) {
+    if (backup_sram) backup_sram->LoadState(state);
+    if (backup_eeprom) backup_eeprom->LoadState(state);
+    if (gpio) gpio->LoadState(state);
+  }
+
+  void CopyState(SaveState& state) {
+    if (backup_sram) backup_sram->CopyState(state);
+    if (backup_eeprom) backup_eeprom->CopyState(state);
+    if (gpio) gpio->CopyState(state);
+  }
+
+  // Returns true if reads from [offset, offset + size) always yield plain ROM data.
+  bool IsPlainROM(u32 offset, u32 size) const {
+    auto last = offset + size - 1;
+
+    if (last >= rom->size()) {
+      return false;
+    }
+
+    if (gpio && offset <= 0xC8 && last >= 0xC4) {
+      return false;
+    }
+
+    if (backup_eeprom && (last & eeprom_mask) == eeprom_mask) {
+      return false;
+    }
+
+    return true;
+  }
+
+  /* Returns the data that reads from [offset, offset + size) yield, if that is always plain ROM data.
+   * Unlike IsPlainROM() this follows the mirroring of small ROMs, so the data may be at a lower offset.
+   */
+  auto GetPlainROM(u32 offset, u32 size) const -> u8 const* {
+    auto last = offset + size - 1;
+
+    if (gpio && offset <= 0xC8 && last >= 0xC4) {
+      return nullptr;
+    }
+
+    if (backup_eeprom && (last & eeprom_mask) == eeprom_mask) {
+      return nullptr;
+    }
+
+    // The range must not wrap around within the mirror.
+    if ((offset & ~rom_mask) != (last & ~rom_mask) || (last & rom_mask) >= rom->size()) {
+      return nullptr;
+    }
+
+    return rom->data() + (offset & rom_mask);
+  }
+
   auto ALWAYS_INLINE ReadROM16(u32 address) -> u16 {
     address &= 0x01FF'FFFE;
 
@@ -82,11 +180,11 @@ struct ROM {
 
     address &= rom_mask;
 
-    if (unlikely(address >= rom.size())) {
+    if (unlikely(address >= rom->size())) {
       return u16(address >> 1);
     }
 
-    return read<u16>(rom.data(), address);
+    return read<u16>(rom->data(), address);
   }
 
   auto ALWAYS_INLINE ReadROM32(u32 address) -> u32 {
@@ -106,13 +204,13 @@ struct ROM {
 
     address &= rom_mask;
 
-    if (unlikely(address >= rom.size())) {
+    if (unlikely(address >= rom->size())) {
       auto lsw = u16(address >> 1);
       auto msw = u16(lsw + 1);
       return (msw << 16) | lsw;
     }
 
-    return read<u32>(rom.data(), address);
+    return read<u32>(rom->data(), address);
   }
 
   void ALWAYS_INLINE WriteROM(u32 address, u16 value) {
@@ -149,7 +247,7 @@ private:
     return backup_eeprom && (address & eeprom_mask) == eeprom_mask;
   }
 
-  std::vector<u8> rom;
+  Image rom;
   std::unique_ptr<Backup> backup_sram;
   std::unique_ptr<Backup> backup_eeprom;
   std::unique_ptr<GPIO> gpio;
@@ -0,0 +1,383 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/integer.hpp>
+#include <type_traits>
+
+namespace nba {
+
+/* Snapshot of the emulated system.
+ * The layout only consists of fixed-size plain data, so that a state can be
+ * created, copied and written to disk as a single block of memory.
+ * All timestamps are relative to SaveState::timestamp.
+ * Bump kCurrentVersion whenever the layout or the meaning of a field changes.
+ */
+struct SaveState {
+  static constexpr u32 kMagicNumber = 0x5353424E; // 'NBSS'
+  static constexpr u32 kCurrentVersion = 3;
+
+  u32 magic;
+  u32 version;
+  u64 timestamp;
+
+  struct ARM {
+    struct RegisterFile {
+      u32 reg[16];
+      u32 bank[6][7];
+      u32 cpsr;
+      u32 spsr[6];
+    } regs;
+
+    struct Pipeline {
+      u8 access;
+      u32 opcode[2];
+    } pipe;
+
+    bool irq_line;
+    bool ldm_usermode_conflict;
+  } arm;
+
+  struct Bus {
+    struct Memory {
+      u8 wram[0x40000];
+      u8 iram[0x8000];
+
+      struct Latch {
+        u32 bios;
+      } latch;
+    } memory;
+
+    struct IO {
+      struct WaitstateControl {
+        u8 sram;
+        u8 ws0[2];
+        u8 ws1[2];
+        u8 ws2[2];
+        u8 phi;
+        bool prefetch;
+        bool cgb;
+      } waitcnt;
+
+      u8 haltcnt;
+      u8 postflg;
+    } io;
+
+    struct Prefetch {
+      bool active;
+      u32 head_address;
+      u32 last_address;
+      u8 count;
+      u8 capacity;
+      u8 opcode_width;
+      u32 countdown;
+      u32 duty;
+    } prefetch;
+
+    struct DMA {
+      bool active;
+      bool openbus;
+    } dma;
+  } bus;
+
+  struct IRQ {
+    u8 reg_ime;
+    u16 reg_ie;
+    u16 reg_if;
+    bool irq_line;
+  } irq;
+
+  struct PPU {
+    struct IO {
+      u16 dispcnt;
+      u16 dispstat;
+      u8 vcount;
+      u16 bgcnt[4];
+      u16 bghofs[4];
+      u16 bgvofs[4];
+
+      struct ReferencePoint {
+        s32 initial;
+        s32 current;
+      } bgx[2], bgy[2];
+
+      s16 bgpa[2];
+      s16 bgpb[2];
+      s16 bgpc[2];
+      s16 bgpd[2];
+
+      struct WindowRange {
+        u8 min;
+        u8 max;
+        bool changed;
+      } winh[2], winv[2];
+
+      u16 winin;
+      u16 winout;
+
+      struct Mosaic {
+        struct {
+          u8 size_x;
+          u8 size_y;
+          u8 counter_y;
+        } bg, obj;
+      } mosaic;
+
+      u16 bldcnt;
+      u8 eva;
+      u8 evb;
+      u8 evy;
+    } io;
+
+    u8 pram[0x00400];
+    u8 oam [0x00400];
+    u8 vram[0x18000];
+
+    bool enable_bg[2][4];
+
+    // OBJs and windows are rendered ahead of time.
+    struct ObjectPixel {
+      u16 color;
+      u8 priority;
+      bool alpha;
+      bool window;
+    } buffer_obj[240];
+
+    bool line_contains_alpha_obj;
+    bool buffer_win[2][240];
+    bool window_scanline_enable[2];
+  } ppu;
+
+  struct APU {
+    struct IO {
+      struct PSG {
+        bool enabled;
+        u8 step;
+        s8 sample;
+
+        // Channels are updated lazily, so the state records when their next steps are due.
+        bool stepping;
+        u32 step_delay;
+        u32 tick_delay;
+
+        struct LengthCounter {
+          bool enabled;
+          u16 length;
+        } length;
+
+        struct Envelope {
+          bool active;
+          bool enabled;
+          bool direction;
+          u8 initial_volume;
+          u8 current_volume;
+          u8 divider;
+          u8 step;
+        } envelope;
+
+        struct Sweep {
+          bool active;
+          bool enabled;
+          bool direction;
+          u16 initial_freq;
+          u16 current_freq;
+          u16 shadow_freq;
+          u8 divider;
+          u8 shift;
+          u8 step;
+        } sweep;
+      };
+
+      struct QuadChannel : PSG {
+        u8 phase;
+        u8 wave_duty;
+        bool dac_enable;
+      } psg1, psg2;
+
+      struct WaveChannel : PSG {
+        bool playing;
+        bool force_volume;
+        u8 volume;
+        u16 frequency;
+        u8 dimension;
+        u8 wave_bank;
+        u8 wave_ram[2][16];
+        u8 phase;
+      } psg3;
+
+      struct NoiseChannel : PSG {
+        u16 lfsr;
+        u8 frequency_shift;
+        u8 frequency_ratio;
+        u8 width;
+        bool dac_enable;
+      } psg4;
+
+      struct SoundControl {
+        bool master_enable;
+
+        struct PSG {
+          u8 volume;
+          u8 master[2];
+          bool enable[2][4];
+        } psg;
+
+        struct DMA {
+          u8 volume;
+          bool enable[2];
+          u8 timer_id;
+        } dma[2];
+      } soundcnt;
+
+      struct BIAS {
+        u16 level;
+        u8 resolution;
+      } bias;
+    } io;
+
+    struct FIFO {
+      s8 data[32];
+      u8 rd_ptr;
+      u8 wr_ptr;
+      u8 count;
+    } fifo[2];
+
+    s8 latch[2];
+  } apu;
+
+  struct DMA {
+    struct Channel {
+      bool enable;
+      bool repeat;
+      bool interrupt;
+      bool gamepak;
+      u16 length;
+      u32 dst_addr;
+      u32 src_addr;
+      u8 dst_cntl;
+      u8 src_cntl;
+      u8 time;
+      u8 size;
+
+      struct Latch {
+        u32 length;
+        u32 dst_addr;
+        u32 src_addr;
+        u32 bus;
+      } latch;
+
+      bool is_fifo_dma;
+    } channels[4];
+
+    s8 active_dma_id;
+    bool early_exit_trigger;
+    u8 hblank_set;
+    u8 vblank_set;
+    u8 video_set;
+    u8 runnable_set;
+    u32 latch;
+  } dma;
+
+  struct Timer {
+    u16 reload;
+    u32 counter;
+
+    struct Control {
+      u8 frequency;
+      bool cascade;
+      bool interrupt;
+      bool enable;
+    } control;
+
+    bool running;
+    u32 samplerate;
+    u64 timestamp_started;
+  } timer[4];
+
+  struct KeyPad {
+    u16 input;
+
+    struct Control {
+      u16 mask;
+      bool interrupt;
+      u8 mode;
+    } control;
+  } keypad;
+
+  struct SIO {
+    u16 siocnt;
+    u16 data[4];
+    u16 send;
+    u16 rcnt;
+  } sio;
+
+  struct Backup {
+    u8 data[0x20000];
+
+    struct FLASH {
+      u8 current_bank;
+      u8 phase;
+      bool enable_chip_id;
+      bool enable_erase;
+      bool enable_write;
+      bool enable_select;
+    } flash;
+
+    struct EEPROM {
+      u8 state;
+      u16 address;
+      u64 serial_buffer;
+      u8 transmitted_bits;
+    } eeprom;
+  } backup;
+
+  struct GPIO {
+    bool allow_reads;
+    u8 rd_mask;
+    u8 port_data;
+
+    struct RTC {
+      u8 current_bit;
+      u8 current_byte;
+      u8 reg;
+      u8 data;
+      u8 buffer[7];
+
+      struct PortData {
+        u8 sck;
+        u8 sio;
+        u8 cs;
+      } port;
+
+      u8 state;
+
+      struct Control {
+        bool unknown;
+        bool per_minute_irq;
+        bool mode_24h;
+        bool poweroff;
+      } control;
+    } rtc;
+  } gpio;
+
+  struct Scheduler {
+    static constexpr int kMaxEvents = 64;
+
+    struct Event {
+      u64 delay;
+      u64 user_data;
+      u16 event_class;
+    } events[kMaxEvents];
+
+    u8 event_count;
+  } scheduler;
+};
+
+static_assert(std::is_trivially_copyable_v<SaveState>);
+
+} // namespace nba
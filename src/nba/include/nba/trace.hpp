@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/integer.hpp>
+
+/* Instrumentation zones that are written to a Chrome trace file (chrome://tracing, Perfetto).
+ * Only compiled in with NBA_TRACE, otherwise the macros expand to nothing.
+ * The trace goes to the file named by the NBA_TRACE_FILE environment variable,
+ * or to nba_trace.json in the working directory.
+ *
+ * NBA_TRACE_ZONE(name) times everything until the end of the enclosing block.
+ * NBA_TRACE_THREAD(name) names the calling thread in the trace viewer.
+ * Both take a string literal, since the pointer is kept until the zone is written.
+ */
+#if defined(NBA_TRACE)
+
+namespace nba::trace {
+
+auto Now() -> u64;
+void WriteZone(char const* name, u64 begin, u64 end);
+void SetThreadName(char const* name);
+
+struct Zone {
+  explicit Zone(char const* name) : name(name), begin(Now()) {}
+
+ ~Zone() {
+    WriteZone(name, begin, Now());
+  }
+
+  char const* name;
+  u64 begin;
+};
+
+} // namespace nba::trace
+
+#define NBA_TRACE_ZONE(name) nba::trace::Zone trace_zone{name}
+#define NBA_TRACE_THREAD(name) nba::trace::SetThreadName(name)
+
+#else
+
+#define NBA_TRACE_ZONE(name)
+#define NBA_TRACE_THREAD(name)
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <nba/core.hpp>
+#include <thread>
+#include <vector>
+
+namespace nba {
+
+/* Steps a batch of cores in lockstep on a pool of threads, i.e. the environments of a reinforcement learner.
+ * Every step applies one action per environment and runs each core up to the start of its next V-blank,
+ * so that the observation is always a complete frame. The frames are written straight into a caller-provided
+ * array of observations, one after the other. In the ARGB8888 format the PPU renders into that array directly,
+ * the other formats are converted from the native BGR555 frame as it is handed to the video device.
+ * Audio is discarded.
+ */
+struct VectorEnv {
+  enum class Observation {
+    ARGB8888,   // 240x160, four bytes per pixel
+    Gray8,      // 240x160, one byte per pixel
+    Gray8Half   // 120x80, one byte per pixel (each pixel averages 2x2 pixels)
+  };
+
+  /* Creates the core of an environment from its config. The video, audio and input devices of the config
+   * belong to the environment and must not be replaced, everything else may be changed before creating the core.
+   * The core must be ready to run, i.e. with the BIOS and ROM attached and reset.
+   */
+  using CoreFactory = std::function<std::unique_ptr<CoreBase>(std::shared_ptr<Config> config)>;
+
+  // A thread count of zero uses one thread per hardware thread, but no more than there are environments.
+  VectorEnv(int env_count, Observation observation, CoreFactory const& factory, int thread_count = 0);
+ ~VectorEnv();
+
+  /* Presses the keys in actions[i] on environment i, emulates 'frames' frames on each environment
+   * and writes the last frame of environment i to observations + i * GetObservationSize().
+   * The keys are a bitmask in the order of KEYINPUT (A, B, Select, Start, Right, Left, Up, Down, R, L),
+   * with a set bit for a pressed key. Blocks until all environments are done.
+   */
+  void Step(u16 const* actions, void* observations, int frames = 1);
+
+  auto GetEnvCount() const -> int;
+  auto GetThreadCount() const -> int;
+  auto GetCore(int env) -> CoreBase&;
+
+  auto GetObservationWidth() const -> int;
+  auto GetObservationHeight() const -> int;
+  auto GetObservationSize() const -> size_t; // in bytes
+
+private:
+  struct Env;
+
+  void RunWorker();
+  void RunEnvs();
+  void StepEnv(int env);
+
+  Observation observation;
+  std::vector<std::unique_ptr<Env>> envs;
+  std::vector<std::thread> threads;
+
+  // Parameters of the current step.
+  u16 const* actions = nullptr;
+  u8* observations = nullptr;
+  int frames = 1;
+
+  std::mutex mutex;
+  std::condition_variable step_started;
+  std::condition_variable step_done;
+  u64 step = 0;
+  int workers_busy = 0;
+  std::atomic_int next_env = 0;
+  bool quit = false;
+};
+
+} // namespace nba
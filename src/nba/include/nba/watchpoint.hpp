@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <functional>
+#include <nba/integer.hpp>
+
+namespace nba {
+
+struct Watchpoint {
+  // May be combined, i.e. Read | Write.
+  enum Kind {
+    Read = 1,
+    Write = 2,
+    Execute = 4
+  };
+
+  struct Hit {
+    int id;
+    Kind kind;
+    u32 address;
+    int size;
+
+    // The value that is being written, zero for reads and opcode fetches.
+    u32 value;
+
+    // Address of the instruction in the execute stage when the access happened.
+    u32 pc;
+  };
+
+  /* Called for every access that hits a watchpoint, before the access is carried out.
+   * Return true to stop CoreBase::Run() at the next instruction boundary.
+   */
+  using Callback = std::function<bool(Hit const&)>;
+};
+
+} // namespace nba
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#if defined(NBA_ALLOCATION_TRACKER)
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <nba/allocation_tracker.hpp>
+
+#if defined(_WIN32)
+  #include <malloc.h>
+#endif
+
+namespace nba::alloc {
+
+namespace {
+
+// Trivially initialized, so that it can be used by allocations during static initialization.
+thread_local u64 t_allocation_count = 0;
+
+auto Allocate(std::size_t size) -> void* {
+  t_allocation_count++;
+  return std::malloc(size != 0 ? size : 1);
+}
+
+auto AllocateAligned(std::size_t size, std::size_t alignment) -> void* {
+  t_allocation_count++;
+
+  // aligned_alloc() wants the size to be a multiple of the alignment.
+  size = (std::max<std::size_t>(size, 1) + alignment - 1) & ~(alignment - 1);
+
+#if defined(_WIN32)
+  return _aligned_malloc(size, alignment);
+#else
+  return std::aligned_alloc(alignment, size);
+#endif
+}
+
+void FreeAligned(void* pointer) {
+#if defined(_WIN32)
+  _aligned_free(pointer);
+#else
+  std::free(pointer);
+#endif
+}
+
+} // namespace
+
+auto GetThreadAllocationCount() -> u64 {
+  return t_allocation_count;
+}
+
+} // namespace nba::alloc
+
+using nba::alloc::Allocate;
+using nba::alloc::AllocateAligned;
+using nba::alloc::FreeAligned;
+
+void* operator new(std::size_t size) {
+  if (auto pointer = Allocate(size)) return pointer;
+  throw std::bad_alloc{};
+}
+
+void* operator new[](std::size_t size) {
+  if (auto pointer = Allocate(size)) return pointer;
+  throw std::bad_alloc{};
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept {
+  return Allocate(size);
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept {
+  return Allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  if (auto pointer = AllocateAligned(size, (std::size_t)alignment)) return pointer;
+  throw std::bad_alloc{};
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+  if (auto pointer = AllocateAligned(size, (std::size_t)alignment)) return pointer;
+  throw std::bad_alloc{};
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept {
+  return AllocateAligned(size, (std::size_t)alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept {
+  return AllocateAligned(size, (std::size_t)alignment);
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::nothrow_t const&) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::nothrow_t const&) noexcept { std::free(pointer); }
+
+void operator delete(void* pointer, std::align_val_t) noexcept { FreeAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { FreeAligned(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { FreeAligned(pointer); }
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept { FreeAligned(pointer); }
+void operator delete(void* pointer, std::align_val_t, std::nothrow_t const&) noexcept { FreeAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t, std::nothrow_t const&) noexcept { FreeAligned(pointer); }
+
+#endif
@@ -7,38 +7,177 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <nba/common/compiler.hpp>
 #include <nba/log.hpp>
+#include <nba/save_state.hpp>
 #include <scheduler.hpp>
 
 #include "bus/bus.hpp"
+#include "arm/bios_hle.hpp"
+#include "arm/block_cache.hpp"
 #include "arm/state.hpp"
 
+#if defined(NBA_INSTRUCTION_TRACE)
+  #include "arm/instruction_trace.hpp"
+#endif
+
 namespace nba::core::arm {
 
 struct ARM7TDMI {
   using Access = Bus::Access;
 
   ARM7TDMI(Scheduler& scheduler, Bus& bus)
-      : scheduler(scheduler)
+      : block_cache(bus, s_opcode_lut_16.data(), s_opcode_lut_32.data(), &ARM7TDMI::GetFusedHandler16, &ARM7TDMI::OnBreakpoint16, &ARM7TDMI::OnBreakpoint32)
+      , bios_hle(bus)
+      , scheduler(scheduler)
       , bus(bus) {
+    scheduler.Register<&ARM7TDMI::OnLDMUserModeConflictEnd>(EventClass::ARM_ldm_usermode_conflict, this);
     Reset();
   }
 
   auto IRQLine() -> bool& { return irq_line; }
 
+  void LoadState(SaveState const& state);
+  void CopyState(SaveState& state);
+
   void Reset() {
     state.Reset();
     SwitchMode(state.cpsr.f.mode);
 
     pipe.opcode[0] = 0xF0000000;
     pipe.opcode[1] = 0xF0000000;
+    pipe.handler[0].arm = DecodeARM(0xF0000000);
+    pipe.handler[1].arm = DecodeARM(0xF0000000);
     pipe.fetch_type = Access::Nonsequential;
     irq_line = false;
     ldm_usermode_conflict = false;
     cpu_mode_is_invalid = false;
+    debug_stop.active = false;
+    UpdateOpcodeLUT();
+#if defined(NBA_LAZY_FLAGS)
+    nz_pending = false;
+#endif
+    idle_loop.target = 0xFFFFFFFF;
+    idle_loop.dirty = true;
+    idle_loop.detected = false;
+  }
+
+  void SetIdleLoopDetection(bool enable) {
+    idle_loop.enable = enable;
+  }
+
+  // Limits idle loop detection to loops that branch to one of the given addresses. Zero entries are unused, any loop is checked if all are zero.
+  void SetIdleLoopTargets(u32 const* targets, int count) {
+    count = std::min(count, kMaxIdleLoopTargets);
+    std::fill(std::begin(idle_loop.targets), std::end(idle_loop.targets), 0);
+    std::copy_n(targets, count, idle_loop.targets);
+    idle_loop.any_target = std::all_of(targets, targets + count, [](u32 target) { return target == 0; });
+  }
+
+  /* Switches between the plain and the cached interpreter at an instruction boundary.
+   * The cached interpreter takes the handlers from the pipeline, so they are decoded here.
+   */
+  void SetCachedInterpreter(bool enable) {
+    if (enable != block_cache.IsEnabled()) {
+      block_cache.SetEnabled(enable);
+      DecodePipeline();
+    }
+  }
+
+  /* Returns true if the CPU has been found spinning in a loop, whose iterations
+   * do not have any effect until an event changes the state of the system.
+   * The flag is cleared by reading it.
+   */
+  bool ConsumeIdleLoop() {
+    bool detected = idle_loop.detected;
+    idle_loop.detected = false;
+    return detected;
+  }
+
+  /* Invokes a method of an object whenever execution branches to the given address.
+   * Only pipeline reloads check the address, so it must be the target of a branch
+   * (i.e. the entry point of a function), but the other instructions pay nothing for it.
+   * Breakpoints persist across Reset().
+   */
+  template<auto method, class T>
+  void SetBreakpoint(u32 address, T* object) {
+    breakpoint.address = address;
+    breakpoint.object = object;
+    breakpoint.invoke = [](void* object) {
+      (((T*)object)->*method)();
+    };
+  }
+
+  void ClearBreakpoint() {
+    breakpoint.address = 0xFFFFFFFF;
+  }
+
+  /* Breakpoints for debuggers, see CoreBase::AddBreakpoint(). They only work with the cached interpreter,
+   * which runs a trap in place of the handler of each instruction that has one.
+   */
+  void SetDebugBreakpoints(std::vector<u32> addresses) {
+    block_cache.SetBreakpoints(std::move(addresses));
+    DecodePipeline();
+  }
+
+  // Returns true if a debugger breakpoint stopped the CPU in front of an instruction.
+  bool IsStoppedAtBreakpoint() const {
+    return debug_stop.active;
+  }
+
+  /* Runs the instruction that a debugger breakpoint stopped in front of, as if Run() had not returned in between.
+   * Returns false if the CPU is not stopped at a breakpoint.
+   */
+  bool ResumeBreakpoint() {
+    if (!debug_stop.active) {
+      return false;
+    }
+
+    auto instruction = debug_stop.opcode;
+
+    debug_stop.active = false;
+
+    if (state.cpsr.f.thumb) {
+      (this->*s_opcode_lut_16[(instruction & 0xFFFF) >> 6])(u16(instruction));
+    } else if (CheckCondition(static_cast<Condition>(instruction >> 28))) {
+      (this->*opcode_lut_32[GetARMHash(instruction)])(instruction);
+    } else {
+      // The condition held when it stopped, but the debugger may have changed the flags since.
+      pipe.fetch_type = Access::Sequential;
+      state.r15 += 4;
+    }
+    return true;
+  }
+
+  // The registers as a debugger sees them, see CoreBase::GetCPURegisters().
+  void GetDebugRegisters(u32 (&reg)[16], u32& cpsr);
+  void SetDebugRegisters(u32 const (&reg)[16], u32 cpsr);
+
+  // The scheduler timestamp at which Run() must return to the caller.
+  auto GetRunLimit() const -> u64 {
+    return run_limit;
+  }
+
+  void SetRunLimit(u64 timestamp) {
+    run_limit = timestamp;
+  }
+
+#if defined(NBA_INSTRUCTION_TRACE)
+  // Keeps the last (at least) 'capacity' instructions, zero stops tracing.
+  void SetInstructionTrace(int capacity) {
+    if (capacity > 0) {
+      instruction_trace = std::make_unique<InstructionTraceBuffer>(capacity);
+    } else {
+      instruction_trace.reset();
+    }
+  }
+
+  bool DumpInstructionTrace(std::string const& path) {
+    return instruction_trace && instruction_trace->Dump(path);
   }
+#endif
 
   auto GetFetchedOpcode(int slot) -> u32 {
     return pipe.opcode[slot];
@@ -47,24 +186,65 @@ struct ARM7TDMI {
   void Run() {
     if (IRQLine()) SignalIRQ();
 
+#if defined(NBA_INSTRUCTION_TRACE)
+    if (unlikely(instruction_trace != nullptr)) {
+      TraceInstruction(pipe.opcode[0]);
+    }
+#endif
+
+    if (block_cache.IsEnabled()) {
+      RunCached();
+      return;
+    }
+
     auto instruction = pipe.opcode[0];
 
     if (state.cpsr.f.thumb) {
       state.r15 &= ~1;
 
       pipe.opcode[0] = pipe.opcode[1];
-      pipe.opcode[1] = ReadHalf(state.r15, pipe.fetch_type);
+      pipe.opcode[1] = bus.FetchCode<u16>(state.r15, pipe.fetch_type);
       (this->*s_opcode_lut_16[instruction >> 6])(instruction);
     } else {
       state.r15 &= ~3;
 
       pipe.opcode[0] = pipe.opcode[1];
-      pipe.opcode[1] = ReadWord(state.r15, pipe.fetch_type);
+      pipe.opcode[1] = bus.FetchCode<u32>(state.r15, pipe.fetch_type);
+
+      if (CheckCondition(static_cast<Condition>(instruction >> 28))) {
+        (this->*opcode_lut_32[GetARMHash(instruction)])(instruction);
+      } else {
+        pipe.fetch_type = Access::Sequential;
+        state.r15 += 4;
+      }
+    }
+  }
+
+  /* Same as Run(), but opcodes and their handlers are taken from pre-decoded blocks.
+   * Each pipeline slot carries the handler of its opcode, so the instruction
+   * is only decoded once when its block is compiled.
+   */
+  void RunCached() {
+    auto instruction = pipe.opcode[0];
+    auto handler = pipe.handler[0];
+
+    pipe.opcode[0] = pipe.opcode[1];
+    pipe.handler[0] = pipe.handler[1];
+
+    if (state.cpsr.f.thumb) {
+      state.r15 &= ~1;
+      pipe.opcode[1] = FetchCached<true>(state.r15, pipe.fetch_type, pipe.handler[1]);
+      (this->*handler.thumb)(instruction);
+    } else {
+      state.r15 &= ~3;
+      pipe.opcode[1] = FetchCached<false>(state.r15, pipe.fetch_type, pipe.handler[1]);
 
       if (CheckCondition(static_cast<Condition>(instruction >> 28))) {
-        int hash = ((instruction >> 16) & 0xFF0) |
-                   ((instruction >>  4) & 0x00F);
-        (this->*s_opcode_lut_32[hash])(instruction);
+        // Blocks are decoded with the fast table, which must not be used while register accesses need checking.
+        if (unlikely(opcode_lut_32 != s_opcode_lut_32.data()) && handler.arm != &ARM7TDMI::OnBreakpoint32) {
+          handler.arm = opcode_lut_32[GetARMHash(instruction)];
+        }
+        (this->*handler.arm)(instruction);
       } else {
         pipe.fetch_type = Access::Sequential;
         state.r15 += 4;
@@ -72,6 +252,15 @@ struct ARM7TDMI {
     }
   }
 
+#if defined(NBA_INSTRUCTION_TRACE)
+  void TraceInstruction(u32 opcode) {
+    bool thumb = state.cpsr.f.thumb;
+
+    SyncFlags();
+    instruction_trace->Add((state.r15 - (thumb ? 4 : 8)) | u32(thumb), opcode, state.reg, state.cpsr.v, scheduler.GetTimestampNow());
+  }
+#endif
+
   void SwitchMode(Mode new_mode) {
     auto old_bank = GetRegisterBankByMode(state.cpsr.f.mode);
     auto new_bank = GetRegisterBankByMode(new_mode);
@@ -109,9 +298,12 @@ struct ARM7TDMI {
     }
 
     cpu_mode_is_invalid = new_bank == BANK_INVALID;
+    UpdateOpcodeLUT();
   }
 
   RegisterFile state;
+  BlockCache block_cache;
+  BIOSHLE bios_hle;
 
   typedef void (ARM7TDMI::*Handler16)(u16);
   typedef void (ARM7TDMI::*Handler32)(u32);
@@ -119,7 +311,15 @@ struct ARM7TDMI {
 private:
   friend struct TableGen;
 
+  /* Register accesses only need to check for the user mode LDM conflict and for an invalid mode if either is in effect.
+   * ARM instructions are dispatched through a table whose handlers skip the checks while neither is (see UpdateOpcodeLUT()).
+   */
+  template<bool bank_checks = true>
   auto GetReg(int id) -> u32 {
+    if constexpr (!bank_checks) {
+      return state.reg[id];
+    }
+
     u32 result = 0;
     bool is_banked = id >= 8 && id != 15;
 
@@ -134,7 +334,13 @@ private:
     return result;
   }
 
+  template<bool bank_checks = true>
   void SetReg(int id, u32 value) {
+    if constexpr (!bank_checks) {
+      state.reg[id] = value;
+      return;
+    }
+
     bool is_banked = id >= 8 && id != 15;
 
     if (unlikely(ldm_usermode_conflict && is_banked)) {
@@ -149,6 +355,9 @@ private:
   auto GetSPSR() -> StatusRegister {
     u32 spsr = 0;
 
+    // In user and system mode, p_spsr points to the CPSR.
+    SyncFlags();
+
     if (unlikely(ldm_usermode_conflict)) {
       /* TODO: current theory is that the value gets OR'd with CPSR,
        * because in user and system mode SPSR reads return the CPSR value.
@@ -167,6 +376,81 @@ private:
     return StatusRegister{spsr};
   }
 
+  /* Idle loop detection:
+   * At each short backward branch we snapshot the registers and flags.
+   * If we take the same branch again with an identical snapshot and the iteration
+   * did neither write memory nor read from a register that changes without an event (i.e. timers),
+   * then every subsequent iteration will do the exact same until the next event occurs.
+   */
+  void ALWAYS_INLINE OnBranch(u32 address, u32 target) {
+    if (unlikely(idle_loop.enable) && target <= address && address - target <= kIdleLoopMaxLength) {
+      CheckIdleLoop(target);
+    }
+  }
+
+  void CheckIdleLoop(u32 target) {
+    auto& loop = idle_loop;
+
+    if (!loop.any_target && (target == 0 || std::find(std::begin(loop.targets), std::end(loop.targets), target) == std::end(loop.targets))) {
+      return;
+    }
+
+    SyncFlags();
+
+    if (!loop.dirty && loop.target == target && loop.cpsr == state.cpsr.v &&
+        std::equal(loop.reg, loop.reg + 15, state.reg)) {
+      loop.detected = true;
+    } else {
+      loop.target = target;
+      loop.cpsr = state.cpsr.v;
+      std::copy(state.reg, state.reg + 15, loop.reg);
+    }
+
+    loop.dirty = false;
+  }
+
+  /* Registers whose value changes without a scheduler event: the timers, SOUNDCNT_X (the PSG status is evaluated lazily),
+   * KEYINPUT (latched when it is read), the GPIO port and the EEPROM/FLASH status.
+   */
+  void ALWAYS_INLINE OnDataRead(u32 address) {
+    if ((address & ~0xF) == 0x0400'0100 || (address & ~3) == 0x0400'0084 || (address & ~3) == 0x0400'0130 ||
+        address >= 0x0D00'0000 || (address & ~0xF) == 0x0800'00C0) {
+      idle_loop.dirty = true;
+    }
+  }
+
+  void ALWAYS_INLINE OnDataWrite() {
+    idle_loop.dirty = true;
+  }
+
+  /* With NBA_LAZY_FLAGS, instructions only store the value that the N and Z flags are derived from.
+   * Most of the time it is overwritten before anything looks at the flags, so the flags are only
+   * packed into the CPSR once a condition is checked or the CPSR is read or written as a whole.
+   */
+  void ALWAYS_INLINE SyncFlags() {
+#if defined(NBA_LAZY_FLAGS)
+    if (nz_pending) {
+      state.cpsr.f.n = nz_value >> 31;
+      state.cpsr.f.z = nz_value == 0;
+      nz_pending = false;
+    }
+#endif
+  }
+
+  void OnLDMUserModeConflictEnd(int cycles_late) {
+    ldm_usermode_conflict = false;
+    UpdateOpcodeLUT();
+  }
+
+  // Must be called whenever ldm_usermode_conflict or cpu_mode_is_invalid changes.
+  void UpdateOpcodeLUT() {
+    if (unlikely(ldm_usermode_conflict || cpu_mode_is_invalid)) {
+      opcode_lut_32 = s_opcode_lut_32_checked.data();
+    } else {
+      opcode_lut_32 = s_opcode_lut_32.data();
+    }
+  }
+
   void SignalIRQ() {
     if (state.cpsr.f.mask_irq) {
       return;
@@ -176,12 +460,13 @@ private:
     // The result will be discarded because we flush the pipeline.
     // But this is important for timing nonetheless.
     if (state.cpsr.f.thumb) {
-      ReadHalf(state.r15 & ~1, pipe.fetch_type);
+      bus.FetchCode<u16>(state.r15, pipe.fetch_type);
     } else {
-      ReadWord(state.r15 & ~3, pipe.fetch_type);
+      bus.FetchCode<u32>(state.r15, pipe.fetch_type);
     }
 
     // Save current program status register.
+    SyncFlags();
     state.spsr[BANK_IRQ].v = state.cpsr.v;
 
     // Enter IRQ mode and disable IRQs.
@@ -204,23 +489,173 @@ private:
   bool CheckCondition(Condition condition) {
     if (condition == COND_AL)
       return true;
+    SyncFlags();
     return s_condition_lut[(static_cast<int>(condition) << 4) | (state.cpsr.v >> 28)];
   }
 
   void ReloadPipeline16() {
-    pipe.opcode[0] = bus.ReadHalf(state.r15 + 0, Access::Nonsequential);
-    pipe.opcode[1] = bus.ReadHalf(state.r15 + 2, Access::Sequential);
+    auto address = state.r15;
+
+    if (block_cache.IsEnabled()) {
+      pipe.opcode[0] = FetchCached<true>(address + 0, Access::Nonsequential, pipe.handler[0]);
+      pipe.opcode[1] = FetchCached<true>(address + 2, Access::Sequential, pipe.handler[1]);
+    } else {
+      pipe.opcode[0] = bus.FetchCode<u16>(address + 0, Access::Nonsequential);
+      pipe.opcode[1] = bus.FetchCode<u16>(address + 2, Access::Sequential);
+    }
     pipe.fetch_type = Access::Sequential;
     state.r15 += 4;
+
+    if (unlikely(address == breakpoint.address)) {
+      breakpoint.invoke(breakpoint.object);
+    }
   }
 
   void ReloadPipeline32() {
-    pipe.opcode[0] = bus.ReadWord(state.r15 + 0, Access::Nonsequential);
-    pipe.opcode[1] = bus.ReadWord(state.r15 + 4, Access::Sequential);
+    auto address = state.r15;
+
+    if (block_cache.IsEnabled()) {
+      pipe.opcode[0] = FetchCached<false>(address + 0, Access::Nonsequential, pipe.handler[0]);
+      pipe.opcode[1] = FetchCached<false>(address + 4, Access::Sequential, pipe.handler[1]);
+    } else {
+      pipe.opcode[0] = bus.FetchCode<u32>(address + 0, Access::Nonsequential);
+      pipe.opcode[1] = bus.FetchCode<u32>(address + 4, Access::Sequential);
+    }
     pipe.fetch_type = Access::Sequential;
     state.r15 += 8;
+
+    if (unlikely(address == breakpoint.address)) {
+      breakpoint.invoke(breakpoint.object);
+    }
+  }
+
+  static auto GetARMHash(u32 instruction) -> int {
+    return ((instruction >> 16) & 0xFF0) |
+           ((instruction >>  4) & 0x00F);
+  }
+
+  /* Returns the handler that runs a pair of Thumb instructions with a single dispatch,
+   * or nullptr if the pair cannot be fused. Currently these are the flag-setting
+   * data processing instructions followed by a conditional branch, i.e. loop conditions.
+   */
+  static auto GetFusedHandler16(u16 first, u16 second) -> Handler16 {
+    if ((second & 0xF000) != 0xD000 || (second & 0x0F00) == 0x0F00) {
+      return nullptr;
+    }
+
+    auto cond = (second >> 8) & 0xF;
+
+    if ((first & 0xE000) == 0x2000) {
+      return s_fused_lut_16[(first >> 8) & 0x1F][cond];
+    }
+
+    switch (first & 0xFFC0) {
+      case 0x4200: return s_fused_lut_16[32][cond];
+      case 0x4280: return s_fused_lut_16[33][cond];
+      case 0x42C0: return s_fused_lut_16[34][cond];
+    }
+
+    return nullptr;
+  }
+
+  void DecodePipeline() {
+    bool thumb = state.cpsr.f.thumb;
+
+    for (int i = 0; i < 2; i++) {
+      if (thumb) {
+        pipe.handler[i].thumb = s_opcode_lut_16[(pipe.opcode[i] & 0xFFFF) >> 6];
+      } else {
+        pipe.handler[i].arm = DecodeARM(pipe.opcode[i]);
+      }
+    }
+
+    if (unlikely(block_cache.HasBreakpoints())) {
+      // When stopped at a breakpoint, the pipeline already holds the two opcodes after it.
+      auto width = thumb ? 2 : 4;
+      auto address = state.r15 - (debug_stop.active ? 1 : 2) * width;
+
+      for (int i = 0; i < 2; i++) {
+        if (block_cache.IsBreakpoint(address + i * width)) {
+          if (thumb) {
+            pipe.handler[i].thumb = &ARM7TDMI::OnBreakpoint16;
+          } else {
+            pipe.handler[i].arm = &ARM7TDMI::OnBreakpoint32;
+          }
+        }
+      }
+    }
+  }
+
+  static auto DecodeARM(u32 instruction) -> Handler32 {
+    return s_opcode_lut_32[GetARMHash(instruction)];
+  }
+
+  template<bool thumb>
+  auto FetchCached(u32 address, Access access, BasicBlock::Handler& handler) -> u32 {
+    auto block = block_cache.Get<thumb>(address);
+
+    if (unlikely(block == nullptr)) {
+      u32 opcode;
+
+      if constexpr (thumb) {
+        opcode = bus.FetchCode<u16>(address, access);
+        handler.thumb = s_opcode_lut_16[opcode >> 6];
+      } else {
+        opcode = bus.FetchCode<u32>(address, access);
+        handler.arm = DecodeARM(opcode);
+      }
+
+      // Code that is never compiled into blocks (i.e. the BIOS) is checked for breakpoints here.
+      if (unlikely(block_cache.HasBreakpoints()) && block_cache.IsBreakpoint(address)) {
+        if constexpr (thumb) {
+          handler.thumb = &ARM7TDMI::OnBreakpoint16;
+        } else {
+          handler.arm = &ARM7TDMI::OnBreakpoint32;
+        }
+      }
+      return opcode;
+    }
+
+    if (block->rom) {
+      if ((address & 0x1'FFFF) == 0) {
+        access = Access::Nonsequential;
+      }
+      bus.Prefetch(address, true, block->cycles[int(access)]);
+    } else {
+      bus.Step(block->cycles[int(access)]);
+    }
+
+    /* DMA may run while the fetch is being timed and overwrite the block.
+     * In that case the block is recompiled from the updated memory.
+     */
+    block = block_cache.Get<thumb>(address);
+
+    auto& instruction = block->instructions[(address & (BasicBlock::kSize - 1)) >> (thumb ? 1 : 2)];
+    handler = instruction.handler;
+    return instruction.opcode;
+  }
+
+  /* Stands in for the handler of an instruction that has a debugger breakpoint.
+   * The opcode after it has been fetched already, so instead of undoing the fetch,
+   * the instruction is kept for ResumeBreakpoint() and Run() returns before it is executed.
+   */
+  void OnBreakpoint16(u16 instruction) {
+    StopAtBreakpoint(instruction);
+  }
+
+  void OnBreakpoint32(u32 instruction) {
+    StopAtBreakpoint(instruction);
   }
 
+  void StopAtBreakpoint(u32 instruction) {
+    debug_stop.active = true;
+    debug_stop.opcode = instruction;
+    run_limit = 0;
+  }
+
+  // Refills the pipeline from r15 without taking any time, for debuggers.
+  void RefillPipeline();
+
   auto GetRegisterBankByMode(Mode mode) -> Bank {
     switch (mode) {
       case MODE_USR:
@@ -251,17 +686,57 @@ private:
   StatusRegister* p_spsr;
   bool ldm_usermode_conflict;
   bool cpu_mode_is_invalid;
+  Handler32 const* opcode_lut_32;
+
+#if defined(NBA_LAZY_FLAGS)
+  u32 nz_value;
+  bool nz_pending;
+#endif
 
   struct Pipeline {
     Access fetch_type;
     u32 opcode[2];
+    BasicBlock::Handler handler[2];
   } pipe;
 
   bool irq_line;
+  u64 run_limit = ~0ULL;
+
+#if defined(NBA_INSTRUCTION_TRACE)
+  std::unique_ptr<InstructionTraceBuffer> instruction_trace;
+#endif
+
+  static constexpr u32 kIdleLoopMaxLength = 64;
+  static constexpr int kMaxIdleLoopTargets = 4;
+
+  struct IdleLoop {
+    bool enable = false;
+    bool any_target = true;
+    u32 targets[kMaxIdleLoopTargets] {};
+    bool detected;
+    bool dirty;
+    u32 target;
+    u32 cpsr;
+    u32 reg[15];
+  } idle_loop;
+
+  struct Breakpoint {
+    u32 address = 0xFFFFFFFF;
+    void* object;
+    void (*invoke)(void* object);
+  } breakpoint;
+
+  // The instruction that a debugger breakpoint stopped in front of, see StopAtBreakpoint().
+  struct DebugStop {
+    bool active = false;
+    u32 opcode;
+  } debug_stop;
 
   static std::array<bool, 256> s_condition_lut;
   static std::array<Handler16, 1024> s_opcode_lut_16;
+  static std::array<std::array<Handler16, 15>, 35> s_fused_lut_16;
   static std::array<Handler32, 4096> s_opcode_lut_32;
+  static std::array<Handler32, 4096> s_opcode_lut_32_checked;
 };
 
 } // namespace nba::core::arm
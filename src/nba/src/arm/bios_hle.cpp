@@ -0,0 +1,483 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <nba/common/punning.hpp>
+#include <type_traits>
+
+#include "arm/arm7tdmi.hpp"
+#include "arm/bios_hle.hpp"
+
+namespace nba::core::arm {
+
+/* Rough cycle counts of the BIOS code, including the SWI entry and return
+ * (except for refilling the pipeline, which the CPU does on its own).
+ * Memory accesses are charged separately where they make up most of the cost.
+ */
+static constexpr int kCallCycles = 24;
+static constexpr int kDivCycles = 48;
+static constexpr int kSqrtCycles = 64;
+static constexpr int kArcTanCycles = 36;
+static constexpr int kArcTan2Cycles = 80;
+static constexpr int kCpuSetCyclesPerUnit = 6;
+static constexpr int kCpuFastSetCyclesPerBlock = 6;
+static constexpr int kLZ77CyclesPerByte = 12;
+static constexpr int kHuffCyclesPerBit = 8;
+static constexpr int kRLCyclesPerByte = 8;
+
+// The BIOS opcode that can be read back (as open bus) after returning from a SWI.
+static constexpr u32 kLatchAfterSWI = 0xE3A02004;
+
+bool BIOSHLE::Call(int function, u32* reg) {
+  bool handled = false;
+
+  if (function >= 64 || (function_mask & (1ULL << function)) == 0) {
+    return false;
+  }
+
+  switch (function) {
+    case 0x06: handled = Div(reg[0], reg[1], reg); break;
+    case 0x07: handled = Div(reg[1], reg[0], reg); break;
+    case 0x08: Sqrt(reg); handled = true; break;
+    case 0x09: ArcTan(reg); handled = true; break;
+    case 0x0A: ArcTan2(reg); handled = true; break;
+    case 0x0B: handled = CpuSet(reg); break;
+    case 0x0C: handled = CpuFastSet(reg); break;
+    case 0x11: handled = LZ77UnComp(reg, false); break;
+    case 0x12: handled = LZ77UnComp(reg, true); break;
+    case 0x13: handled = HuffUnComp(reg); break;
+    case 0x14: handled = RLUnComp(reg, false); break;
+    case 0x15: handled = RLUnComp(reg, true); break;
+  }
+
+  if (handled) {
+    bus.memory.latch.bios = kLatchAfterSWI;
+    bus.Step(kCallCycles);
+  }
+
+  return handled;
+}
+
+bool BIOSHLE::Div(s32 numerator, s32 denominator, u32* reg) {
+  // The BIOS never returns from a division by zero.
+  if (denominator == 0 || (numerator == s32(0x8000'0000) && denominator == -1)) {
+    return false;
+  }
+
+  s32 quotient = numerator / denominator;
+
+  reg[0] = u32(quotient);
+  reg[1] = u32(numerator % denominator);
+  reg[3] = u32(quotient < 0 ? -quotient : quotient);
+  bus.Step(kDivCycles);
+  return true;
+}
+
+void BIOSHLE::Sqrt(u32* reg) {
+  u32 value = reg[0];
+  u32 result = 0;
+  u32 bit = 1U << 30;
+
+  while (bit > value) {
+    bit >>= 2;
+  }
+
+  while (bit != 0) {
+    if (value >= result + bit) {
+      value -= result + bit;
+      result = (result >> 1) + bit;
+    } else {
+      result >>= 1;
+    }
+    bit >>= 2;
+  }
+
+  reg[0] = result;
+  bus.Step(kSqrtCycles);
+}
+
+/* The polynomial approximation that the BIOS uses, the intermediate results
+ * are left in r1 and r3 by ArcTan, so they are returned here, too.
+ */
+static auto ArcTanImpl(s32 tan, s32& r1, s32& r3) -> s16 {
+  s32 a = -((tan * tan) >> 14);
+  s32 b = ((0xA9 * a) >> 14) + 0x390;
+
+  b = ((b * a) >> 14) + 0x091C;
+  b = ((b * a) >> 14) + 0x0FB6;
+  b = ((b * a) >> 14) + 0x16AA;
+  b = ((b * a) >> 14) + 0x2081;
+  b = ((b * a) >> 14) + 0x3651;
+  b = ((b * a) >> 14) + 0xA2F9;
+
+  r1 = a;
+  r3 = b;
+  return s16((tan * b) >> 16);
+}
+
+void BIOSHLE::ArcTan(u32* reg) {
+  s32 r1;
+  s32 r3;
+
+  reg[0] = u32(s32(ArcTanImpl(s32(reg[0]), r1, r3)));
+  reg[1] = u32(r1);
+  reg[3] = u32(r3);
+  bus.Step(kArcTanCycles);
+}
+
+void BIOSHLE::ArcTan2(u32* reg) {
+  s32 x = s32(reg[0]);
+  s32 y = s32(reg[1]);
+  s32 r1 = s32(reg[1]);
+  s32 r3;
+  u16 angle;
+
+  auto arctan = [&](s32 numerator, s32 denominator) {
+    return ArcTanImpl(s32(u32(numerator) << 14) / denominator, r1, r3);
+  };
+
+  if (y == 0) {
+    angle = x >= 0 ? 0x0000 : 0x8000;
+  } else if (x == 0) {
+    angle = y >= 0 ? 0x4000 : 0xC000;
+  } else if (y >= 0) {
+    if (x >= 0 && x >= y) {
+      angle = arctan(y, x);
+    } else if (x < 0 && -x >= y) {
+      angle = arctan(y, x) + 0x8000;
+    } else {
+      angle = 0x4000 - arctan(x, y);
+    }
+  } else {
+    if (x <= 0 && -x > -y) {
+      angle = arctan(y, x) + 0x8000;
+    } else if (x > 0 && x >= -y) {
+      angle = arctan(y, x) + 0x10000;
+    } else {
+      angle = 0xC000 - arctan(x, y);
+    }
+  }
+
+  reg[0] = angle;
+  reg[1] = u32(r1);
+  bus.Step(kArcTan2Cycles);
+}
+
+bool BIOSHLE::CpuSet(u32* reg) {
+  u32 src = reg[0];
+  u32 dst = reg[1];
+  u32 count = reg[2] & 0x1F'FFFF;
+  bool fill = reg[2] & (1 << 24);
+
+  // The BIOS refuses to copy from itself, let it deal with that.
+  if ((src & 0x0E00'0000) == 0) {
+    return false;
+  }
+
+  auto src_page = (src >> 24) & 15;
+  auto dst_page = (dst >> 24) & 15;
+
+  if (reg[2] & (1 << 26)) {
+    for (u32 i = 0; i < count; i++) {
+      Write<u32>(dst, Read<u32>(src));
+      dst += 4;
+      if (!fill) src += 4;
+    }
+    bus.Step(count * (kCpuSetCyclesPerUnit + bus.wait32[1][src_page] + bus.wait32[1][dst_page]));
+  } else {
+    for (u32 i = 0; i < count; i++) {
+      Write<u16>(dst, Read<u16>(src));
+      dst += 2;
+      if (!fill) src += 2;
+    }
+    bus.Step(count * (kCpuSetCyclesPerUnit + bus.wait16[1][src_page] + bus.wait16[1][dst_page]));
+  }
+
+  return true;
+}
+
+bool BIOSHLE::CpuFastSet(u32* reg) {
+  u32 src = reg[0];
+  u32 dst = reg[1];
+  // Always transfers a multiple of eight words.
+  u32 count = ((reg[2] & 0x1F'FFFF) + 7) & ~7;
+  bool fill = reg[2] & (1 << 24);
+
+  if ((src & 0x0E00'0000) == 0) {
+    return false;
+  }
+
+  auto src_page = (src >> 24) & 15;
+  auto dst_page = (dst >> 24) & 15;
+
+  for (u32 i = 0; i < count; i++) {
+    Write<u32>(dst, Read<u32>(src));
+    dst += 4;
+    if (!fill) src += 4;
+  }
+
+  bus.Step(count / 8 * kCpuFastSetCyclesPerBlock + count * (bus.wait32[1][src_page] + bus.wait32[1][dst_page]));
+  return true;
+}
+
+/* The WRAM functions write the decompressed data one byte at a time.
+ * The VRAM functions collect two bytes and write a halfword, since VRAM ignores byte writes.
+ */
+struct DecompressionOutput {
+  template<typename Write>
+  void Put(u8 value, Write&& write) {
+    if (!vram) {
+      write(address++, value, false);
+    } else if (address & 1) {
+      write(address++ & ~1, buffer | (value << 8), true);
+    } else {
+      buffer = value;
+      address++;
+    }
+  }
+
+  u32 address;
+  bool vram;
+  u16 buffer = 0;
+};
+
+bool BIOSHLE::LZ77UnComp(u32* reg, bool vram) {
+  u32 src = reg[0];
+
+  if ((src & 0x0E00'0000) == 0) {
+    return false;
+  }
+
+  u32 header = Read<u32>(src);
+  s32 remaining = header >> 8;
+
+  if (remaining == 0) {
+    return false;
+  }
+
+  auto output = DecompressionOutput{reg[1], vram};
+  auto size = remaining;
+  auto write = [this](u32 address, u16 value, bool halfword) {
+    if (halfword) {
+      Write<u16>(address, value);
+    } else {
+      Write<u8>(address, u8(value));
+    }
+  };
+
+  src += 4;
+
+  while (remaining > 0) {
+    u8 flags = Read<u8>(src++);
+
+    for (int i = 0; i < 8 && remaining > 0; i++) {
+      if (flags & 0x80) {
+        u16 block = (Read<u8>(src) << 8) | Read<u8>(src + 1);
+        int length = (block >> 12) + 3;
+        u32 disp = (block & 0xFFF) + 1;
+
+        src += 2;
+
+        // Reads back what has already been written, for VRAM this misses the byte that is still buffered.
+        while (length-- > 0 && remaining > 0) {
+          output.Put(Read<u8>(output.address - disp), write);
+          remaining--;
+        }
+      } else {
+        output.Put(Read<u8>(src++), write);
+        remaining--;
+      }
+
+      flags <<= 1;
+    }
+  }
+
+  bus.Step(size * kLZ77CyclesPerByte);
+  return true;
+}
+
+bool BIOSHLE::HuffUnComp(u32* reg) {
+  u32 src = reg[0];
+  u32 dst = reg[1];
+
+  if ((src & 0x0E00'0000) == 0) {
+    return false;
+  }
+
+  u32 header = Read<u32>(src);
+  s32 remaining = header >> 8;
+  int data_size = header & 15;
+
+  // Only 4-bit and 8-bit data is decoded correctly by the BIOS.
+  if (remaining == 0 || (data_size != 4 && data_size != 8)) {
+    return false;
+  }
+
+  u32 tree = src + 4;
+  u32 root = tree + 1;
+  u32 stream = tree + (Read<u8>(tree) + 1) * 2;
+
+  u32 node_address = root;
+  u8 node = Read<u8>(root);
+  u32 buffer = 0;
+  int buffer_bits = 0;
+  int bits = 0;
+
+  while (remaining > 0) {
+    u32 word = Read<u32>(stream);
+
+    stream += 4;
+
+    for (int i = 0; i < 32 && remaining > 0; i++) {
+      int bit = word >> 31;
+      u32 next = (node_address & ~1) + (node & 0x3F) * 2 + 2 + bit;
+
+      word <<= 1;
+      bits++;
+
+      if (node & (bit ? 0x40 : 0x80)) {
+        buffer |= (Read<u8>(next) & ((1 << data_size) - 1)) << buffer_bits;
+        buffer_bits += data_size;
+
+        if (buffer_bits == 32) {
+          Write<u32>(dst, buffer);
+          dst += 4;
+          remaining -= 4;
+          buffer = 0;
+          buffer_bits = 0;
+        }
+
+        node_address = root;
+        node = Read<u8>(root);
+      } else {
+        node_address = next;
+        node = Read<u8>(next);
+      }
+    }
+  }
+
+  bus.Step(bits * kHuffCyclesPerBit);
+  return true;
+}
+
+bool BIOSHLE::RLUnComp(u32* reg, bool vram) {
+  u32 src = reg[0];
+
+  if ((src & 0x0E00'0000) == 0) {
+    return false;
+  }
+
+  u32 header = Read<u32>(src);
+  s32 remaining = header >> 8;
+
+  if (remaining == 0) {
+    return false;
+  }
+
+  auto output = DecompressionOutput{reg[1], vram};
+  auto size = remaining;
+  auto write = [this](u32 address, u16 value, bool halfword) {
+    if (halfword) {
+      Write<u16>(address, value);
+    } else {
+      Write<u8>(address, u8(value));
+    }
+  };
+
+  src += 4;
+
+  while (remaining > 0) {
+    u8 flag = Read<u8>(src++);
+
+    if (flag & 0x80) {
+      int length = (flag & 0x7F) + 3;
+      u8 value = Read<u8>(src++);
+
+      while (length-- > 0 && remaining > 0) {
+        output.Put(value, write);
+        remaining--;
+      }
+    } else {
+      int length = (flag & 0x7F) + 1;
+
+      while (length-- > 0 && remaining > 0) {
+        output.Put(Read<u8>(src++), write);
+        remaining--;
+      }
+    }
+  }
+
+  bus.Step(size * kRLCyclesPerByte);
+  return true;
+}
+
+/* Memory that is backed by host memory is accessed directly and free of wait states,
+ * since the cost of the accesses is part of the estimate for each function.
+ * Anything else (i.e. MMIO) goes through the bus.
+ */
+template<typename T>
+auto BIOSHLE::Read(u32 address) -> T {
+  address &= ~(sizeof(T) - 1);
+
+  if (address < 0x1000'0000) {
+    auto& entry = bus.page_table.read[address >> Bus::kPageShift];
+
+    if (entry.data != nullptr) {
+      return read<T>(entry.data, address);
+    }
+
+    // PRAM and OAM are never in the page table (see Bus::Page).
+    if (!bus.watchpoints.enabled) {
+      switch (address >> 24) {
+        case 0x05: return bus.hw.ppu.ReadPRAM<T>(address);
+        case 0x07: return bus.hw.ppu.ReadOAM<T>(address);
+      }
+    }
+  }
+
+  if constexpr (std::is_same_v<T, u8>)  return bus.ReadByte<Bus::Access::Sequential>(address);
+  if constexpr (std::is_same_v<T, u16>) return bus.ReadHalf<Bus::Access::Sequential>(address);
+  if constexpr (std::is_same_v<T, u32>) return bus.ReadWord<Bus::Access::Sequential>(address);
+}
+
+template<typename T>
+void BIOSHLE::Write(u32 address, T value) {
+  address &= ~(sizeof(T) - 1);
+
+  auto page = address >> 24;
+
+  /* Pages with a watchpoint are not in the page table and must go through the bus.
+   * PRAM and OAM are never in the page table, so for those only the absence of watchpoints counts.
+   */
+  bool mapped = page < 0x10 && bus.page_table.read[address >> Bus::kPageShift].data != nullptr;
+
+  if (mapped || ((page == 0x05 || page == 0x07) && !bus.watchpoints.enabled)) {
+    switch (page) {
+      case 0x02: {
+        write<T>(bus.memory.wram.data(), address & 0x3FFFF, value);
+        bus.dirty_tracker.MarkWRAM(address);
+        bus.hw.cpu.block_cache.Invalidate(address);
+        return;
+      }
+      case 0x03: {
+        write<T>(bus.memory.iram.data(), address & 0x7FFF, value);
+        bus.dirty_tracker.MarkWRAM(address);
+        bus.hw.cpu.block_cache.Invalidate(address);
+        return;
+      }
+      // PRAM, VRAM and OAM keep caches of their contents, which must be updated.
+      case 0x05: bus.hw.ppu.WritePRAM<T>(address, value); return;
+      case 0x06: bus.hw.ppu.WriteVRAM<T>(address, value); return;
+      case 0x07: bus.hw.ppu.WriteOAM<T>(address, value); return;
+    }
+  }
+
+  if constexpr (std::is_same_v<T, u8>)  bus.WriteByte<Bus::Access::Sequential>(address, value);
+  if constexpr (std::is_same_v<T, u16>) bus.WriteHalf<Bus::Access::Sequential>(address, value);
+  if constexpr (std::is_same_v<T, u32>) bus.WriteWord<Bus::Access::Sequential>(address, value);
+}
+
+} // namespace nba::core::arm
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/integer.hpp>
+
+#include "bus/bus.hpp"
+
+namespace nba::core::arm {
+
+/* Native implementations of the BIOS functions that games call most often,
+ * which would otherwise run through the interpreter one instruction at a time.
+ * The results match the BIOS, the time spent in the BIOS is approximated.
+ * Calls that hit an edge case (i.e. a division by zero) still go through the BIOS.
+ */
+struct BIOSHLE {
+  explicit BIOSHLE(Bus& bus) : bus(bus) {}
+
+  bool IsEnabled() const {
+    return enabled;
+  }
+
+  void SetEnabled(bool value) {
+    enabled = value;
+  }
+
+  // One bit per SWI number, the functions whose bit is clear always go through the BIOS.
+  void SetFunctionMask(u64 mask) {
+    function_mask = mask;
+  }
+
+  /* Runs the SWI function with r0 to r3 as arguments and results.
+   * Returns false if the BIOS must run the function instead.
+   */
+  bool Call(int function, u32* reg);
+
+private:
+  bool Div(s32 numerator, s32 denominator, u32* reg);
+  void Sqrt(u32* reg);
+  void ArcTan(u32* reg);
+  void ArcTan2(u32* reg);
+  bool CpuSet(u32* reg);
+  bool CpuFastSet(u32* reg);
+  bool LZ77UnComp(u32* reg, bool vram);
+  bool HuffUnComp(u32* reg);
+  bool RLUnComp(u32* reg, bool vram);
+
+  template<typename T>
+  auto Read(u32 address) -> T;
+
+  template<typename T>
+  void Write(u32 address, T value);
+
+  Bus& bus;
+  bool enabled = false;
+  u64 function_mask = ~0ULL;
+};
+
+} // namespace nba::core::arm
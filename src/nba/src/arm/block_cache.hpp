@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <nba/common/compiler.hpp>
+#include <nba/common/punning.hpp>
+#include <nba/integer.hpp>
+#include <vector>
+
+#include "bus/bus.hpp"
+
+namespace nba::core::arm {
+
+struct ARM7TDMI;
+
+/* A run of pre-decoded instructions from an aligned chunk of code memory.
+ * Besides the opcode and interpreter handler of each instruction,
+ * the block also records the wait states of an opcode fetch from its region,
+ * so that the fetch does not have to go through Bus::Read.
+ */
+struct BasicBlock {
+  static constexpr int kSize = 64;
+
+  using Handler16 = void (ARM7TDMI::*)(u16);
+  using Handler32 = void (ARM7TDMI::*)(u32);
+
+  union Handler {
+    Handler16 thumb;
+    Handler32 arm;
+  };
+
+  struct Instruction {
+    u32 opcode;
+    Handler handler;
+  };
+
+  bool rom;
+  int cycles[2];
+  Instruction instructions[kSize / sizeof(u16)];
+};
+
+struct BlockCache {
+  using Handler16 = BasicBlock::Handler16;
+  using Handler32 = BasicBlock::Handler32;
+
+  using FuseHandler16 = Handler16 (*)(u16 first, u16 second);
+
+  BlockCache(Bus& bus, Handler16 const* lut_16, Handler32 const* lut_32, FuseHandler16 fuse_16, Handler16 trap_16, Handler32 trap_32)
+      : bus(bus)
+      , lut_16(lut_16)
+      , lut_32(lut_32)
+      , fuse_16(fuse_16)
+      , trap_16(trap_16)
+      , trap_32(trap_32) {
+  }
+
+  bool IsEnabled() const {
+    return enabled;
+  }
+
+  void SetEnabled(bool value) {
+    enabled = value;
+    Flush();
+  }
+
+  void Flush() {
+    auto rom_size = bus.memory.rom.GetRawROM().size();
+
+    for (int thumb = 0; thumb < 2; thumb++) {
+      auto& map = blocks[thumb];
+
+      map[int(Region::EWRAM)].clear();
+      map[int(Region::IWRAM)].clear();
+      map[int(Region::ROM)].clear();
+
+      if (enabled) {
+        map[int(Region::EWRAM)].resize(bus.memory.wram.size() / BasicBlock::kSize);
+        map[int(Region::IWRAM)].resize(bus.memory.iram.size() / BasicBlock::kSize);
+        map[int(Region::ROM)].resize(rom_size / BasicBlock::kSize);
+      }
+    }
+
+    free_blocks.clear();
+    last_block = nullptr;
+  }
+
+  /* Instructions at these addresses are compiled with the trap handler instead of their own (see CoreBase::AddBreakpoint()).
+   * The uncached fetch path asks IsBreakpoint() for the addresses that are never compiled. Blocks are recompiled on demand.
+   */
+  void SetBreakpoints(std::vector<u32> addresses) {
+    for (auto& address : addresses) {
+      address = Bus::GetCanonicalAddress(address);
+    }
+    std::sort(addresses.begin(), addresses.end());
+    breakpoints = std::move(addresses);
+    Flush();
+  }
+
+  bool HasBreakpoints() const {
+    return !breakpoints.empty();
+  }
+
+  bool IsBreakpoint(u32 address) const {
+    return std::binary_search(breakpoints.begin(), breakpoints.end(), Bus::GetCanonicalAddress(address));
+  }
+
+  // Returns the size of the block maps and the blocks that are compiled at the moment, in bytes.
+  auto GetMemoryUsage() const -> size_t {
+    size_t size = 0;
+
+    for (auto const& map : blocks) {
+      for (auto const& slots : map) {
+        size += slots.capacity() * sizeof(slots[0]);
+
+        for (auto const& block : slots) {
+          if (block) size += sizeof(BasicBlock);
+        }
+      }
+    }
+
+    size += free_blocks.capacity() * sizeof(free_blocks[0]);
+    size += free_blocks.size() * sizeof(BasicBlock);
+    return size;
+  }
+
+  // Evicts any block that holds code from the written EWRAM or IWRAM address.
+  void ALWAYS_INLINE Invalidate(u32 address) {
+    if (likely(!enabled)) {
+      return;
+    }
+
+    Region region;
+    u32 offset;
+
+    if (Locate(address, region, offset)) {
+      auto index = offset / BasicBlock::kSize;
+      auto& block_thumb = blocks[1][int(region)][index];
+      auto& block_arm = blocks[0][int(region)][index];
+
+      if (unlikely(block_thumb || block_arm)) {
+        Recycle(block_thumb);
+        Recycle(block_arm);
+        last_block = nullptr;
+      }
+    }
+  }
+
+  // Evicts any block that holds code from the written EWRAM or IWRAM address range.
+  void InvalidateRange(u32 address, u32 size) {
+    if (likely(!enabled) || size == 0) {
+      return;
+    }
+
+    auto last = address + size - 1;
+
+    for (u32 base = address & ~(BasicBlock::kSize - 1); base <= last; base += BasicBlock::kSize) {
+      Invalidate(base);
+    }
+  }
+
+  // Returns the block that holds the instruction at the given address,
+  // or nullptr if code at that address cannot be cached.
+  template<bool thumb>
+  auto ALWAYS_INLINE Get(u32 address) -> BasicBlock* {
+    auto base = address & ~(BasicBlock::kSize - 1);
+
+    if (likely(last_block != nullptr && last_base == base && last_thumb == thumb)) {
+      return last_block;
+    }
+
+    Region region;
+    u32 offset;
+
+    if (!Locate(address, region, offset)) {
+      return nullptr;
+    }
+
+    // Pages with a watchpoint must be fetched through the bus, see Bus::UnmapWatchedPages().
+    if (unlikely(bus.watchpoints.enabled && bus.page_table.read[address >> Bus::kPageShift].data == nullptr)) {
+      return nullptr;
+    }
+
+    auto& block = blocks[thumb][int(region)][offset / BasicBlock::kSize];
+
+    if (!block) {
+      block = Compile<thumb>(region, address, offset & ~(BasicBlock::kSize - 1));
+    }
+
+    last_base = base;
+    last_thumb = thumb;
+    last_block = block.get();
+    return last_block;
+  }
+
+private:
+  enum class Region {
+    EWRAM,
+    IWRAM,
+    ROM
+  };
+
+  bool ALWAYS_INLINE Locate(u32 address, Region& region, u32& offset) {
+    switch (address >> 24) {
+      case 0x02: {
+        region = Region::EWRAM;
+        offset = address & 0x3FFFF;
+        return true;
+      }
+      case 0x03: {
+        region = Region::IWRAM;
+        offset = address & 0x7FFF;
+        return true;
+      }
+      // Only WS0 is cached, since code is almost never run from the other mirrors.
+      case 0x08 ... 0x09: {
+        region = Region::ROM;
+        offset = address & 0x01FF'FFFF;
+
+        // Never cache chunks that may be decoded as GPIO or EEPROM or are outside of the ROM image.
+        return bus.memory.rom.IsPlainROM(offset & ~(BasicBlock::kSize - 1), BasicBlock::kSize);
+      }
+    }
+
+    return false;
+  }
+
+  /* Code in RAM is evicted and recompiled whenever a game copies new code over it.
+   * Evicted blocks are kept for reuse, so that this does not allocate once the cache is warm.
+   */
+  void Recycle(std::unique_ptr<BasicBlock>& block) {
+    if (block) {
+      free_blocks.push_back(std::move(block));
+    }
+  }
+
+  template<bool thumb>
+  auto Compile(Region region, u32 address, u32 offset) -> std::unique_ptr<BasicBlock> {
+    std::unique_ptr<BasicBlock> block;
+
+    if (free_blocks.empty()) {
+      block = std::make_unique<BasicBlock>();
+    } else {
+      block = std::move(free_blocks.back());
+      free_blocks.pop_back();
+    }
+    auto page = address >> 24;
+    auto base = address & ~(BasicBlock::kSize - 1);
+
+    u8 const* data;
+
+    switch (region) {
+      case Region::EWRAM: data = bus.memory.wram.data(); break;
+      case Region::IWRAM: data = bus.memory.iram.data(); break;
+      default: data = bus.memory.rom.GetRawROM().data(); break;
+    }
+
+    block->rom = region == Region::ROM;
+
+    for (int access = 0; access < 2; access++) {
+      if constexpr (thumb) {
+        block->cycles[access] = bus.wait16[access][page];
+      } else {
+        block->cycles[access] = bus.wait32[access][page];
+      }
+    }
+
+    if constexpr (thumb) {
+      for (int i = 0; i < BasicBlock::kSize / 2; i++) {
+        auto& instruction = block->instructions[i];
+        auto opcode = read<u16>(data, offset + i * sizeof(u16));
+
+        instruction.opcode = opcode;
+        instruction.handler.thumb = lut_16[opcode >> 6];
+      }
+
+      /* The first instruction of a fusable pair gets a handler that also runs the second one.
+       * The second instruction keeps its own handler, since it may still be branched to.
+       * Pairs that cross into the next block are left alone.
+       */
+      for (int i = 0; i < BasicBlock::kSize / 2 - 1; i++) {
+        auto& instruction = block->instructions[i];
+        auto fused = fuse_16(instruction.opcode, block->instructions[i + 1].opcode);
+
+        // A fused pair would run the second instruction without going through its trap.
+        if (fused != nullptr && !(HasBreakpoints() && IsBreakpoint(base + (i + 1) * 2))) {
+          instruction.handler.thumb = fused;
+        }
+      }
+    } else {
+      for (int i = 0; i < BasicBlock::kSize / 4; i++) {
+        auto& instruction = block->instructions[i];
+        auto opcode = read<u32>(data, offset + i * sizeof(u32));
+        auto hash = ((opcode >> 16) & 0xFF0) | ((opcode >> 4) & 0x00F);
+
+        instruction.opcode = opcode;
+        instruction.handler.arm = lut_32[hash];
+      }
+    }
+
+    if (unlikely(HasBreakpoints())) {
+      for (int i = 0; i < BasicBlock::kSize / (thumb ? 2 : 4); i++) {
+        if (IsBreakpoint(base + i * (thumb ? 2 : 4))) {
+          if constexpr (thumb) {
+            block->instructions[i].handler.thumb = trap_16;
+          } else {
+            block->instructions[i].handler.arm = trap_32;
+          }
+        }
+      }
+    }
+
+    return block;
+  }
+
+  Bus& bus;
+  Handler16 const* lut_16;
+  Handler32 const* lut_32;
+  FuseHandler16 fuse_16;
+  Handler16 trap_16;
+  Handler32 trap_32;
+
+  bool enabled = false;
+
+  // Sorted canonical addresses, see SetBreakpoints().
+  std::vector<u32> breakpoints;
+
+  // blocks[thumb][region][offset / BasicBlock::kSize]
+  std::vector<std::unique_ptr<BasicBlock>> blocks[2][3];
+
+  // Evicted blocks, see Recycle().
+  std::vector<std::unique_ptr<BasicBlock>> free_blocks;
+
+  u32 last_base;
+  bool last_thumb;
+  BasicBlock* last_block = nullptr;
+};
+
+} // namespace nba::core::arm
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include "arm/arm7tdmi.hpp"
+
+namespace nba::core::arm {
+
+void ARM7TDMI::GetDebugRegisters(u32 (&reg)[16], u32& cpsr) {
+  SyncFlags();
+
+  for (int i = 0; i < 15; i++) {
+    reg[i] = state.reg[i];
+  }
+
+  // r15 points two instructions ahead, also when stopped at a breakpoint (see StopAtBreakpoint()).
+  reg[15] = state.r15 - (state.cpsr.f.thumb ? 4 : 8);
+  cpsr = state.cpsr.v;
+}
+
+void ARM7TDMI::SetDebugRegisters(u32 const (&reg)[16], u32 cpsr) {
+  SyncFlags();
+
+  auto old_thumb = state.cpsr.f.thumb;
+  auto old_pc = state.r15 - (old_thumb ? 4 : 8);
+
+  // The registers are those of the old mode, so they are written before the mode changes.
+  for (int i = 0; i < 15; i++) {
+    state.reg[i] = reg[i];
+  }
+
+  SwitchMode(Mode(cpsr & 0x1F));
+  state.cpsr.v = cpsr;
+
+  if (reg[15] != old_pc || state.cpsr.f.thumb != old_thumb) {
+    debug_stop.active = false;
+    state.r15 = reg[15];
+    RefillPipeline();
+  }
+
+  idle_loop.dirty = true;
+}
+
+void ARM7TDMI::RefillPipeline() {
+  auto width = state.cpsr.f.thumb ? 2 : 4;
+
+  state.r15 &= ~(width - 1);
+
+  for (int i = 0; i < 2; i++) {
+    u32 opcode = 0;
+
+    for (int j = 0; j < width; j++) {
+      opcode |= bus.DebugRead(state.r15 + j) << (j * 8);
+    }
+    pipe.opcode[i] = opcode;
+    state.r15 += width;
+  }
+
+  pipe.fetch_type = Access::Sequential;
+  DecodePipeline();
+}
+
+} // namespace nba::core::arm
@@ -6,8 +6,13 @@
  */
 
 void SetZeroAndSignFlag(u32 value) {
+#if defined(NBA_LAZY_FLAGS)
+  nz_value = value;
+  nz_pending = true;
+#else
   state.cpsr.f.n = value >> 31;
   state.cpsr.f.z = (value == 0);
+#endif
 }
 
 template<bool is_signed = true>
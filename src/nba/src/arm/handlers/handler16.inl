@@ -36,8 +36,7 @@ void Thumb_MoveShiftedRegister(u16 instruction) {
   DoShift(op, result, imm, carry, true);
 
   state.cpsr.f.c = carry;
-  state.cpsr.f.z = (result == 0);
-  state.cpsr.f.n = result >> 31;
+  SetZeroAndSignFlag(result);
 
   state.reg[dst] = result;
   pipe.fetch_type = Access::Sequential;
@@ -69,8 +68,7 @@ void Thumb_Op3(u16 instruction) {
     case 0b00:
       // MOV rD, #imm 
       state.reg[dst] = imm;
-      state.cpsr.f.n = 0;
-      state.cpsr.f.z = imm == 0;
+      SetZeroAndSignFlag(imm);
       break;
     case 0b01:
       // CMP rD, #imm
@@ -258,7 +256,7 @@ void Thumb_LoadStoreRelativePC(u16 instruction) {
   pipe.fetch_type = Access::Nonsequential;
   state.r15 += 2;
 
-  state.reg[dst] = ReadWord(address, Access::Nonsequential);
+  state.reg[dst] = ReadWord<Access::Nonsequential>(address);
   bus.Idle();
 }
 
@@ -274,17 +272,17 @@ void Thumb_LoadStoreOffsetReg(u16 instruction) {
 
   switch (op) {
     case 0b00: // STR
-      WriteWord(address, state.reg[dst], Access::Nonsequential);
+      WriteWord<Access::Nonsequential>(address, state.reg[dst]);
       break;
     case 0b01: // STRB
-      WriteByte(address, (u8)state.reg[dst], Access::Nonsequential);
+      WriteByte<Access::Nonsequential>(address, (u8)state.reg[dst]);
       break;
     case 0b10: // LDR
-      state.reg[dst] = ReadWordRotate(address, Access::Nonsequential);
+      state.reg[dst] = ReadWordRotate<Access::Nonsequential>(address);
       bus.Idle();
       break;
     case 0b11: // LDRB
-      state.reg[dst] = ReadByte(address, Access::Nonsequential);
+      state.reg[dst] = ReadByte<Access::Nonsequential>(address);
       bus.Idle();
       break;
   }
@@ -303,21 +301,21 @@ void Thumb_LoadStoreSigned(u16 instruction) {
   switch (op) {
     case 0b00:
       // STRH rD, [rB, rO]
-      WriteHalf(address, state.reg[dst], Access::Nonsequential);
+      WriteHalf<Access::Nonsequential>(address, state.reg[dst]);
       break;
     case 0b01:
       // LDSB rD, [rB, rO]
-      state.reg[dst] = ReadByteSigned(address, Access::Nonsequential);
+      state.reg[dst] = ReadByteSigned<Access::Nonsequential>(address);
       bus.Idle();
       break;
     case 0b10:
       // LDRH rD, [rB, rO]
-      state.reg[dst] = ReadHalfRotate(address, Access::Nonsequential);
+      state.reg[dst] = ReadHalfRotate<Access::Nonsequential>(address);
       bus.Idle();
       break;
     case 0b11:
       // LDSH rD, [rB, rO]
-      state.reg[dst] = ReadHalfSigned(address, Access::Nonsequential);
+      state.reg[dst] = ReadHalfSigned<Access::Nonsequential>(address);
       bus.Idle();
       break;
   }
@@ -334,20 +332,20 @@ void Thumb_LoadStoreOffsetImm(u16 instruction) {
   switch (op) {
     case 0b00:
       // STR rD, [rB, #imm]
-      WriteWord(state.reg[base] + imm * 4, state.reg[dst], Access::Nonsequential);
+      WriteWord<Access::Nonsequential>(state.reg[base] + imm * 4, state.reg[dst]);
       break;
     case 0b01:
       // LDR rD, [rB, #imm]
-      state.reg[dst] = ReadWordRotate(state.reg[base] + imm * 4, Access::Nonsequential);
+      state.reg[dst] = ReadWordRotate<Access::Nonsequential>(state.reg[base] + imm * 4);
       bus.Idle();
       break;
     case 0b10:
       // STRB rD, [rB, #imm]
-      WriteByte(state.reg[base] + imm, state.reg[dst], Access::Nonsequential);
+      WriteByte<Access::Nonsequential>(state.reg[base] + imm, state.reg[dst]);
       break;
     case 0b11:
       // LDRB rD, [rB, #imm]
-      state.reg[dst] = ReadByte(state.reg[base] + imm, Access::Nonsequential);
+      state.reg[dst] = ReadByte<Access::Nonsequential>(state.reg[base] + imm);
       bus.Idle();
       break;
   }
@@ -364,10 +362,10 @@ void Thumb_LoadStoreHword(u16 instruction) {
   state.r15 += 2;
 
   if (load) {
-    state.reg[dst] = ReadHalfRotate(address, Access::Nonsequential);
+    state.reg[dst] = ReadHalfRotate<Access::Nonsequential>(address);
     bus.Idle();
   } else {
-    WriteHalf(address, state.reg[dst], Access::Nonsequential);
+    WriteHalf<Access::Nonsequential>(address, state.reg[dst]);
   }
 }
 
@@ -380,10 +378,10 @@ void Thumb_LoadStoreRelativeToSP(u16 instruction) {
   state.r15 += 2;
 
   if (load) {
-    state.reg[dst] = ReadWordRotate(address, Access::Nonsequential);
+    state.reg[dst] = ReadWordRotate<Access::Nonsequential>(address);
     bus.Idle();
   } else {
-    WriteWord(address, state.reg[dst], Access::Nonsequential);
+    WriteWord<Access::Nonsequential>(address, state.reg[dst]);
   }
 }
 
@@ -421,20 +419,55 @@ void Thumb_PushPop(u16 instruction) {
   // Handle special case for empty register lists.
   if (list == 0 && !rbit) {
     if (pop) {
-      state.r15 = ReadWord(state.r13, Access::Nonsequential);
+      state.r15 = ReadWord<Access::Nonsequential>(state.r13);
       ReloadPipeline16();
       state.r13 += 0x40;
     } else {
       state.r13 -= 0x40;
-      WriteWord(state.r13, state.r15, Access::Nonsequential);
+      WriteWord<Access::Nonsequential>(state.r13, state.r15);
     }
     return;
   }
 
   auto address = state.r13;
   auto access_type = Access::Nonsequential;
+  int count = rbit ? 1 : 0;
+
+  for (int reg = 0; reg <= 7; reg++) {
+    if (list & (1 << reg)) {
+      count++;
+    }
+  }
+
+  // The stack is usually in work RAM, then the registers are transferred on host memory (see Bus::GetBurstMemory()).
+  int cycles = 0;
 
   if (pop) {
+    u8* burst = bus.GetBurstMemory(address, count, false, cycles);
+
+    if (burst) {
+      for (int reg = 0; reg <= 7; reg++) {
+        if (list & (1 << reg)) {
+          state.reg[reg] = read<u32>(burst, address - state.r13);
+          address += 4;
+        }
+      }
+
+      if (rbit) {
+        state.reg[15] = read<u32>(burst, address - state.r13) & ~1;
+        address += 4;
+      }
+
+      FinishBurst(state.r13, count, false, cycles);
+      bus.Idle();
+      state.r13 = address;
+
+      if (rbit) {
+        ReloadPipeline16();
+      }
+      return;
+    }
+
     for (int reg = 0; reg <= 7; reg++) {
       if (list & (1 << reg)) {
         state.reg[reg] = ReadWord(address, access_type);
@@ -455,16 +488,29 @@ void Thumb_PushPop(u16 instruction) {
     state.r13 = address;
   } else {
     // Calculate internal start address (final r13 value)
-    for (int reg = 0; reg <= 7; reg++) {
-      if (list & (1 << reg))
-        address -= 4;
-    }
-
-    if (rbit) address -= 4;
+    address -= count * 4;
 
     // Store address in r13 before we mess with it.
     state.r13 = address;
 
+    u8* burst = bus.GetBurstMemory(address, count, true, cycles);
+
+    if (burst) {
+      for (int reg = 0; reg <= 7; reg++) {
+        if (list & (1 << reg)) {
+          write<u32>(burst, address - state.r13, state.reg[reg]);
+          address += 4;
+        }
+      }
+
+      if (rbit) {
+        write<u32>(burst, address - state.r13, state.r14);
+      }
+
+      FinishBurst(state.r13, count, true, cycles);
+      return;
+    }
+
     for (int reg = 0; reg <= 7; reg++) {
       if (list & (1 << reg)) {
         WriteWord(address, state.reg[reg], access_type);
@@ -489,10 +535,10 @@ void Thumb_LoadStoreMultiple(u16 instruction) {
   // Handle special case for empty register lists.
   if (list == 0) {
     if (load) {
-      state.r15 = ReadWord(state.reg[base], Access::Nonsequential);
+      state.r15 = ReadWord<Access::Nonsequential>(state.reg[base]);
       ReloadPipeline16();
     } else {
-      WriteWord(state.reg[base], state.r15, Access::Nonsequential);
+      WriteWord<Access::Nonsequential>(state.reg[base], state.r15);
     }
     state.reg[base] += 0x40;
     return;
@@ -501,14 +547,30 @@ void Thumb_LoadStoreMultiple(u16 instruction) {
   if (load) {
     u32 address = state.reg[base];
     auto access_type = Access::Nonsequential;
+    int count = 0;
+    int cycles = 0;
+
+    for (int i = 0; i <= 7; i++) {
+      if (list & (1 << i)) {
+        count++;
+      }
+    }
+
+    // See Thumb_PushPop(): transfers within work RAM are done on host memory.
+    u32 address_first = address;
+    u8* burst = bus.GetBurstMemory(address, count, false, cycles);
 
     for (int i = 0; i <= 7; i++) {
       if (list & (1 << i)) {
-        state.reg[i] = ReadWord(address, access_type);
+        state.reg[i] = burst ? read<u32>(burst, address - address_first) : ReadWord(address, access_type);
         access_type = Access::Sequential;
         address += 4;
       }
     }
+
+    if (burst) {
+      FinishBurst(address_first, count, false, cycles);
+    }
     bus.Idle();
     if (~list & (1 << base)) {
       state.reg[base] = address;
@@ -527,16 +589,33 @@ void Thumb_LoadStoreMultiple(u16 instruction) {
 
     u32 address = state.reg[base];
     u32 base_new = address + count * 4;
+    int cycles = 0;
+    u8* burst = bus.GetBurstMemory(address, count, true, cycles);
+
+    if (burst) {
+      write<u32>(burst, 0, state.reg[first]);
+      state.reg[base] = base_new;
+
+      for (int reg = first + 1, offset = 4; reg <= 7; reg++) {
+        if (list & (1 << reg)) {
+          write<u32>(burst, offset, state.reg[reg]);
+          offset += 4;
+        }
+      }
+
+      FinishBurst(address, count, true, cycles);
+      return;
+    }
 
     // Transfer first register (non-sequential access)
-    WriteWord(address, state.reg[first], Access::Nonsequential);
+    WriteWord<Access::Nonsequential>(address, state.reg[first]);
     state.reg[base] = base_new;
     address += 4;
 
     // Run until end (sequential accesses)
     for (int reg = first + 1; reg <= 7; reg++) {
       if (list & (1 << reg)) {
-        WriteWord(address, state.reg[reg], Access::Sequential);
+        WriteWord<Access::Sequential>(address, state.reg[reg]);
         address += 4;
       }
     }
@@ -553,6 +632,8 @@ void Thumb_ConditionalBranch(u16 instruction) {
       imm |= 0xFFFFFF00;
     }
 
+    OnBranch(state.r15 - 4, state.r15 + imm * 2);
+
     state.r15 += imm * 2;
     ReloadPipeline16();
   } else {
@@ -561,8 +642,46 @@ void Thumb_ConditionalBranch(u16 instruction) {
   }
 }
 
+/* A flag-setting instruction fused with the conditional branch that follows it.
+ * Only the block cache hands these out, see GetFusedHandler16().
+ * The branch runs exactly like it would after its own dispatch from RunCached(),
+ * so we fall back to a regular dispatch whenever anything may happen in between.
+ * The branch skips Run(), so it is added to the instruction trace here, or traces would lose every fused branch.
+ */
+template <Handler16 first, int cond>
+void Thumb_FusedConditionalBranch(u16 instruction) {
+  (this->*first)(instruction);
+
+  if (unlikely(IRQLine() ||
+               scheduler.GetTimestampNow() >= run_limit ||
+               pipe.handler[0].thumb != &ARM7TDMI::Thumb_ConditionalBranch<cond>)) {
+    return;
+  }
+
+  instruction = pipe.opcode[0];
+
+#if defined(NBA_INSTRUCTION_TRACE)
+  if (unlikely(instruction_trace != nullptr)) {
+    TraceInstruction(instruction);
+  }
+#endif
+
+  pipe.opcode[0] = pipe.opcode[1];
+  pipe.handler[0] = pipe.handler[1];
+  pipe.opcode[1] = FetchCached<true>(state.r15, pipe.fetch_type, pipe.handler[1]);
+  Thumb_ConditionalBranch<cond>(instruction);
+}
+
 void Thumb_SWI(u16 instruction) {
+  if (bios_hle.IsEnabled() && bios_hle.Call(instruction & 0xFF, state.reg)) {
+    // Return to the instruction after the SWI, like the BIOS would.
+    state.r15 -= 2;
+    ReloadPipeline16();
+    return;
+  }
+
   // Save current program status register.
+  SyncFlags();
   state.spsr[BANK_SVC].v = state.cpsr.v;
 
   // Enter SVC mode and disable IRQs.
@@ -584,6 +703,8 @@ void Thumb_UnconditionalBranch(u16 instruction) {
     imm |= 0xFFFFF800;
   }
 
+  OnBranch(state.r15 - 4, state.r15 + imm);
+
   state.r15 += imm;
   ReloadPipeline16();
 }
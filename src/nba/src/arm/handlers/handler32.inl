@@ -24,7 +24,7 @@ enum class DataOp {
   MVN = 15
 };
 
-template <bool immediate, DataOp opcode, bool set_flags, int field4>
+template <bool bank_checks, bool immediate, DataOp opcode, bool set_flags, int field4>
 void ARM_DataProcessing(u32 instruction) {  
   constexpr int  shift_type = ( field4 >> 1) & 3;
   constexpr bool shift_imm  = (~field4 >> 0) & 1;
@@ -50,20 +50,20 @@ void ARM_DataProcessing(u32 instruction) {
       op2 = value;
     }
 
-    op1 = GetReg(reg_op1);
+    op1 = GetReg<bank_checks>(reg_op1);
   } else {
     u32 shift;
 
     if constexpr (shift_imm) {
       shift = (instruction >> 7) & 0x1F;
     } else {
-      shift = GetReg((instruction >> 8) & 0xF);
+      shift = GetReg<bank_checks>((instruction >> 8) & 0xF);
       state.r15 += 4;
       bus.Idle();
     }
 
-    op1 = GetReg(reg_op1);
-    op2 = GetReg(reg_op2);
+    op1 = GetReg<bank_checks>(reg_op1);
+    op2 = GetReg<bank_checks>(reg_op2);
 
     DoShift(shift_type, op2, shift, carry, shift_imm);
   }
@@ -78,7 +78,7 @@ void ARM_DataProcessing(u32 instruction) {
         SetZeroAndSignFlag(result);
         cpsr.f.c = carry;
       }
-      SetReg(reg_dst, result);
+      SetReg<bank_checks>(reg_dst, result);
       break;
     case DataOp::EOR:
       result = op1 ^ op2;
@@ -86,25 +86,25 @@ void ARM_DataProcessing(u32 instruction) {
         SetZeroAndSignFlag(result);
         cpsr.f.c = carry;
       }
-      SetReg(reg_dst, result);
+      SetReg<bank_checks>(reg_dst, result);
       break;
     case DataOp::SUB:
-      SetReg(reg_dst, SUB(op1, op2, set_flags));
+      SetReg<bank_checks>(reg_dst, SUB(op1, op2, set_flags));
       break;
     case DataOp::RSB:
-      SetReg(reg_dst, SUB(op2, op1, set_flags));
+      SetReg<bank_checks>(reg_dst, SUB(op2, op1, set_flags));
       break;
     case DataOp::ADD:
-      SetReg(reg_dst, ADD(op1, op2, set_flags));
+      SetReg<bank_checks>(reg_dst, ADD(op1, op2, set_flags));
       break;
     case DataOp::ADC:
-      SetReg(reg_dst, ADC(op1, op2, set_flags));
+      SetReg<bank_checks>(reg_dst, ADC(op1, op2, set_flags));
       break;
     case DataOp::SBC:
-      SetReg(reg_dst, SBC(op1, op2, set_flags));
+      SetReg<bank_checks>(reg_dst, SBC(op1, op2, set_flags));
       break;
     case DataOp::RSC:
-      SetReg(reg_dst, SBC(op2, op1, set_flags));
+      SetReg<bank_checks>(reg_dst, SBC(op2, op1, set_flags));
       break;
     case DataOp::TST:
       SetZeroAndSignFlag(op1 & op2);
@@ -126,14 +126,14 @@ void ARM_DataProcessing(u32 instruction) {
         SetZeroAndSignFlag(result);
         cpsr.f.c = carry;
       }
-      SetReg(reg_dst, result);
+      SetReg<bank_checks>(reg_dst, result);
       break;
     case DataOp::MOV:
       if constexpr (set_flags) {
         SetZeroAndSignFlag(op2);
         cpsr.f.c = carry;
       }
-      SetReg(reg_dst, op2);
+      SetReg<bank_checks>(reg_dst, op2);
       break;
     case DataOp::BIC:
       result = op1 & ~op2;
@@ -141,7 +141,7 @@ void ARM_DataProcessing(u32 instruction) {
         SetZeroAndSignFlag(result);
         cpsr.f.c = carry;
       }
-      SetReg(reg_dst, result);
+      SetReg<bank_checks>(reg_dst, result);
       break;
     case DataOp::MVN:
       result = ~op2;
@@ -149,7 +149,7 @@ void ARM_DataProcessing(u32 instruction) {
         SetZeroAndSignFlag(result);
         cpsr.f.c = carry;
       }
-      SetReg(reg_dst, result);
+      SetReg<bank_checks>(reg_dst, result);
       break;
   }
 
@@ -178,8 +178,10 @@ void ARM_DataProcessing(u32 instruction) {
   }
 }
 
-template <bool immediate, bool use_spsr, bool to_status>
+template <bool bank_checks, bool immediate, bool use_spsr, bool to_status>
 void ARM_StatusTransfer(u32 instruction) {
+  SyncFlags();
+
   if (to_status) {
     u32 op;
     u32 mask = 0;
@@ -197,7 +199,7 @@ void ARM_StatusTransfer(u32 instruction) {
 
       op = (value >> shift) | (value << (32 - shift));
     } else {
-      op = GetReg(instruction & 0xF);
+      op = GetReg<bank_checks>(instruction & 0xF);
     }
 
     // Apply masked replace to SPSR or CPSR.
@@ -218,9 +220,9 @@ void ARM_StatusTransfer(u32 instruction) {
     int dst = (instruction >> 12) & 0xF;
 
     if (use_spsr) {
-      SetReg(dst, GetSPSR().v);
+      SetReg<bank_checks>(dst, GetSPSR().v);
     } else {
-      SetReg(dst, state.cpsr.v);
+      SetReg<bank_checks>(dst, state.cpsr.v);
     }
   }
 
@@ -228,7 +230,7 @@ void ARM_StatusTransfer(u32 instruction) {
   state.r15 += 4;
 }
 
-template <bool accumulate, bool set_flags>
+template <bool bank_checks, bool accumulate, bool set_flags>
 void ARM_Multiply(u32 instruction) {
   int op1 = (instruction >>  0) & 0xF;
   int op2 = (instruction >>  8) & 0xF;
@@ -238,14 +240,14 @@ void ARM_Multiply(u32 instruction) {
   pipe.fetch_type = Access::Nonsequential;
   state.r15 += 4;
 
-  auto lhs = GetReg(op1);
-  auto rhs = GetReg(op2);
+  auto lhs = GetReg<bank_checks>(op1);
+  auto rhs = GetReg<bank_checks>(op2);
   auto result = lhs * rhs;
 
   TickMultiply(rhs);
 
   if (accumulate) {
-    result += GetReg(op3);
+    result += GetReg<bank_checks>(op3);
     bus.Idle();
   }
 
@@ -253,14 +255,14 @@ void ARM_Multiply(u32 instruction) {
     SetZeroAndSignFlag(result);
   }
 
-  SetReg(dst, result);
+  SetReg<bank_checks>(dst, result);
 
   if (dst == 15) {
     ReloadPipeline32();
   }
 }
 
-template <bool sign_extend, bool accumulate, bool set_flags>
+template <bool bank_checks, bool sign_extend, bool accumulate, bool set_flags>
 void ARM_MultiplyLong(u32 instruction) {
   int op1 = (instruction >> 0) & 0xF;
   int op2 = (instruction >> 8) & 0xF;
@@ -273,8 +275,8 @@ void ARM_MultiplyLong(u32 instruction) {
   pipe.fetch_type = Access::Nonsequential;
   state.r15 += 4;
 
-  auto lhs = GetReg(op1);
-  auto rhs = GetReg(op2);
+  auto lhs = GetReg<bank_checks>(op1);
+  auto rhs = GetReg<bank_checks>(op2);
 
   if (sign_extend) {
     result = s64(s32(lhs)) * s64(s32(rhs));
@@ -286,11 +288,11 @@ void ARM_MultiplyLong(u32 instruction) {
   bus.Idle();
 
   if (accumulate) {
-    s64 value = GetReg(dst_hi);
+    s64 value = GetReg<bank_checks>(dst_hi);
 
     value <<= 16;
     value <<= 16;
-    value  |= GetReg(dst_lo);
+    value  |= GetReg<bank_checks>(dst_lo);
 
     result += value;
     bus.Idle();
@@ -299,19 +301,19 @@ void ARM_MultiplyLong(u32 instruction) {
   u32 result_hi = result >> 32;
 
   if (set_flags) {
-    state.cpsr.f.n = result_hi >> 31;
-    state.cpsr.f.z = result == 0;
+    // Zero only if all 64 bits are, negative if bit 63 is set.
+    SetZeroAndSignFlag((result_hi & 0x8000'0000) | u32(result != 0));
   }
 
-  SetReg(dst_lo, result & 0xFFFFFFFF);
-  SetReg(dst_hi, result_hi);
+  SetReg<bank_checks>(dst_lo, result & 0xFFFFFFFF);
+  SetReg<bank_checks>(dst_hi, result_hi);
 
   if (dst_lo == 15 || dst_hi == 15) {
     ReloadPipeline32();
   }
 }
 
-template <bool byte>
+template <bool bank_checks, bool byte>
 void ARM_SingleDataSwap(u32 instruction) {
   int src  = (instruction >>  0) & 0xF;
   int dst  = (instruction >> 12) & 0xF;
@@ -323,24 +325,25 @@ void ARM_SingleDataSwap(u32 instruction) {
   state.r15 += 4;
 
   if (byte) {
-    tmp = ReadByte(GetReg(base), Access::Nonsequential);
-    WriteByte(GetReg(base), (u8)GetReg(src), Access::Nonsequential);
+    tmp = ReadByte<Access::Nonsequential>(GetReg<bank_checks>(base));
+    WriteByte<Access::Nonsequential>(GetReg<bank_checks>(base), (u8)GetReg<bank_checks>(src));
   } else {
-    tmp = ReadWordRotate(GetReg(base), Access::Nonsequential);
-    WriteWord(GetReg(base), GetReg(src), Access::Nonsequential);
+    tmp = ReadWordRotate<Access::Nonsequential>(GetReg<bank_checks>(base));
+    WriteWord<Access::Nonsequential>(GetReg<bank_checks>(base), GetReg<bank_checks>(src));
   }
 
   bus.Idle();
   
-  SetReg(dst, tmp);
+  SetReg<bank_checks>(dst, tmp);
 
   if (dst == 15) {
     ReloadPipeline32();
   }
 }
 
+template <bool bank_checks>
 void ARM_BranchAndExchange(u32 instruction) {
-  u32 address = GetReg(instruction & 0xF);
+  u32 address = GetReg<bank_checks>(instruction & 0xF);
 
   if (address & 1) {
     state.r15 = address & ~1;
@@ -352,18 +355,18 @@ void ARM_BranchAndExchange(u32 instruction) {
   }
 }
 
-template <bool pre, bool add, bool immediate, bool writeback, bool load, int opcode>
+template <bool bank_checks, bool pre, bool add, bool immediate, bool writeback, bool load, int opcode>
 void ARM_HalfwordSignedTransfer(u32 instruction) {
   int dst  = (instruction >> 12) & 0xF;
   int base = (instruction >> 16) & 0xF;
 
   u32 offset;
-  u32 address = GetReg(base);
+  u32 address = GetReg<bank_checks>(base);
 
   if constexpr (immediate) {
     offset = (instruction & 0xF) | ((instruction >> 4) & 0xF0);
   } else {
-    offset = GetReg(instruction & 0xF);
+    offset = GetReg<bank_checks>(instruction & 0xF);
   }
 
   pipe.fetch_type = Access::Nonsequential;
@@ -381,53 +384,53 @@ void ARM_HalfwordSignedTransfer(u32 instruction) {
     case 0: break;
     case 1:
       if (load) {
-        auto value = ReadHalfRotate(address, Access::Nonsequential);
+        auto value = ReadHalfRotate<Access::Nonsequential>(address);
         if constexpr (writeback || !pre) {
-          SetReg(base, GetReg(base) + offset);
+          SetReg<bank_checks>(base, GetReg<bank_checks>(base) + offset);
         }
         bus.Idle();
-        SetReg(dst, value);
+        SetReg<bank_checks>(dst, value);
       } else {
-        WriteHalf(address, GetReg(dst), Access::Nonsequential);
+        WriteHalf<Access::Nonsequential>(address, GetReg<bank_checks>(dst));
         if constexpr (writeback || !pre) {
-          SetReg(base, GetReg(base) + offset);
+          SetReg<bank_checks>(base, GetReg<bank_checks>(base) + offset);
         }
       }
       break;
     case 2:
       if (load) {
-        auto value = ReadByteSigned(address, Access::Nonsequential);
+        auto value = ReadByteSigned<Access::Nonsequential>(address);
         if constexpr (writeback || !pre) {
-          SetReg(base, GetReg(base) + offset);
+          SetReg<bank_checks>(base, GetReg<bank_checks>(base) + offset);
         }
         bus.Idle();
-        SetReg(dst, value);
+        SetReg<bank_checks>(dst, value);
       } else {
         // ARMv5 LDRD: this opcode is unpredictable on ARMv4T.
         // On ARM7TDMI-S it doesn't seem to perform any memory access,
         // so the load/store cycle probably is internal in this case.
         bus.Idle();
         if constexpr (writeback || !pre) {
-          SetReg(base, GetReg(base) + offset);
+          SetReg<bank_checks>(base, GetReg<bank_checks>(base) + offset);
         }
         bus.Idle();
       }
       break;
     case 3:
       if (load) {
-        auto value = ReadHalfSigned(address, Access::Nonsequential);
+        auto value = ReadHalfSigned<Access::Nonsequential>(address);
         if constexpr (writeback || !pre) {
-          SetReg(base, GetReg(base) + offset);
+          SetReg<bank_checks>(base, GetReg<bank_checks>(base) + offset);
         }
         bus.Idle();
-        SetReg(dst, value);
+        SetReg<bank_checks>(dst, value);
       } else {
         // ARMv5 STRD: this opcode is unpredictable on ARMv4T.
         // On ARM7TDMI-S it doesn't seem to perform any memory access,
         // so the load/store cycle probably is internal in this case.
         bus.Idle();
         if constexpr (writeback || !pre) {
-          SetReg(base, GetReg(base) + offset);
+          SetReg<bank_checks>(base, GetReg<bank_checks>(base) + offset);
         }
       }
       break;
@@ -438,7 +441,7 @@ void ARM_HalfwordSignedTransfer(u32 instruction) {
   }
 }
 
-template <bool link>
+template <bool bank_checks, bool link>
 void ARM_BranchAndLink(u32 instruction) {
   u32 offset = instruction & 0xFFFFFF;
 
@@ -447,20 +450,24 @@ void ARM_BranchAndLink(u32 instruction) {
   }
 
   if (link) {
-    SetReg(14, state.r15 - 4);
+    SetReg<bank_checks>(14, state.r15 - 4);
+  }
+
+  if constexpr (!link) {
+    OnBranch(state.r15 - 8, state.r15 + offset * 4);
   }
 
   state.r15 += offset * 4;
   ReloadPipeline32();
 }
 
-template <bool immediate, bool pre, bool add, bool byte, bool writeback, bool load>
+template <bool bank_checks, bool immediate, bool pre, bool add, bool byte, bool writeback, bool load>
 void ARM_SingleDataTransfer(u32 instruction) {
   u32 offset;
 
   int dst  = (instruction >> 12) & 0xF;
   int base = (instruction >> 16) & 0xF;
-  u32 address = GetReg(base);
+  u32 address = GetReg<bank_checks>(base);
 
   // Calculate offset relative to base register.
   if constexpr (immediate) {
@@ -470,7 +477,7 @@ void ARM_SingleDataTransfer(u32 instruction) {
     int opcode = (instruction >> 5) & 3;
     int amount = (instruction >> 7) & 0x1F;
 
-    offset = GetReg(instruction & 0xF);
+    offset = GetReg<bank_checks>(instruction & 0xF);
     DoShift(opcode, offset, amount, carry, true);
   }
 
@@ -489,27 +496,27 @@ void ARM_SingleDataTransfer(u32 instruction) {
     u32 value;
 
     if constexpr (byte) {
-      value = ReadByte(address, Access::Nonsequential);
+      value = ReadByte<Access::Nonsequential>(address);
     } else {
-      value = ReadWordRotate(address, Access::Nonsequential);
+      value = ReadWordRotate<Access::Nonsequential>(address);
     }
 
     if constexpr (writeback || !pre) {
-      SetReg(base, GetReg(base) + offset);
+      SetReg<bank_checks>(base, GetReg<bank_checks>(base) + offset);
     }
 
     bus.Idle();
 
-    SetReg(dst, value);
+    SetReg<bank_checks>(dst, value);
   } else {
     if constexpr (byte) {
-      WriteByte(address, (u8)GetReg(dst), Access::Nonsequential);
+      WriteByte<Access::Nonsequential>(address, (u8)GetReg<bank_checks>(dst));
     } else {
-      WriteWord(address, GetReg(dst), Access::Nonsequential);
+      WriteWord<Access::Nonsequential>(address, GetReg<bank_checks>(dst));
     }
 
     if constexpr (writeback || !pre) {
-      SetReg(base, GetReg(base) + offset);
+      SetReg<bank_checks>(base, GetReg<bank_checks>(base) + offset);
     }
   }
 
@@ -518,7 +525,7 @@ void ARM_SingleDataTransfer(u32 instruction) {
   }
 }
 
-template <bool _pre, bool add, bool user_mode, bool writeback, bool load>
+template <bool bank_checks, bool _pre, bool add, bool user_mode, bool writeback, bool load>
 void ARM_BlockDataTransfer(u32 instruction) {
   // TODO: test special case with usermode registers and a banked base register.
   int base = (instruction >> 16) & 0xF;
@@ -527,10 +534,11 @@ void ARM_BlockDataTransfer(u32 instruction) {
   Mode mode;
   bool transfer_pc = list & (1 << 15);
   int  first = 0;
+  int  count = 0;
   int  bytes = 0;
   bool pre = _pre;
 
-  u32 address = GetReg(base);
+  u32 address = GetReg<bank_checks>(base);
 
   if (list != 0) {
     // Determine number of bytes to transfer and the first register in the list.
@@ -539,6 +547,7 @@ void ARM_BlockDataTransfer(u32 instruction) {
         continue;
       }
       first = i;
+      count++;
       bytes += 4;
     }
   } else {
@@ -548,6 +557,7 @@ void ARM_BlockDataTransfer(u32 instruction) {
     list  = 1 << 15;
     first = 15;
     transfer_pc = true;
+    count = 1;
     bytes = 64;
   }
 
@@ -580,6 +590,11 @@ void ARM_BlockDataTransfer(u32 instruction) {
   pipe.fetch_type = Access::Nonsequential;
   state.r15 += 4;
 
+  // Transfers within work RAM (i.e. the stack) are done on host memory, with the bus stepped once.
+  u32 address_first = pre ? address + 4 : address;
+  int cycles = 0;
+  u8* burst = bus.GetBurstMemory(address_first, count, !load, cycles);
+
   for (int i = first; i < 16; i++) {
     if (~list & (1 << i)) {
       continue;
@@ -590,15 +605,19 @@ void ARM_BlockDataTransfer(u32 instruction) {
     }
 
     if constexpr (load) {
-      auto value = ReadWord(address, access_type);
+      auto value = burst ? read<u32>(burst, address - address_first) : ReadWord(address, access_type);
       if (writeback && i == first) {
-        SetReg(base, base_new);
+        SetReg<bank_checks>(base, base_new);
       }
-      SetReg(i, value);
+      SetReg<bank_checks>(i, value);
     } else {
-      WriteWord(address, GetReg(i), access_type);
+      if (burst) {
+        write<u32>(burst, address - address_first, GetReg<bank_checks>(i));
+      } else {
+        WriteWord(address, GetReg<bank_checks>(i), access_type);
+      }
       if (writeback && i == first) {
-        SetReg(base, base_new);
+        SetReg<bank_checks>(base, base_new);
       }
     }
 
@@ -609,6 +628,10 @@ void ARM_BlockDataTransfer(u32 instruction) {
     access_type = Access::Sequential;
   }
 
+  if (burst) {
+    FinishBurst(address_first, count, !load, cycles);
+  }
+
   if constexpr (load) {
     bus.Idle();
 
@@ -617,9 +640,8 @@ void ARM_BlockDataTransfer(u32 instruction) {
        * register accesses will go to both the user bank and original bank.
        */
       ldm_usermode_conflict = true;
-      scheduler.Add(2, [this](int late) {
-        ldm_usermode_conflict = false;
-      });
+      UpdateOpcodeLUT();
+      scheduler.Add(2, EventClass::ARM_ldm_usermode_conflict);
     }
 
     if (transfer_pc) {
@@ -644,6 +666,7 @@ void ARM_BlockDataTransfer(u32 instruction) {
 
 void ARM_Undefined(u32 instruction) {
   // Save current program status register.
+  SyncFlags();
   state.spsr[BANK_UND].v = state.cpsr.v;
 
   // Enter UND mode and disable IRQs.
@@ -657,7 +680,15 @@ void ARM_Undefined(u32 instruction) {
 }
 
 void ARM_SWI(u32 instruction) {
+  if (bios_hle.IsEnabled() && bios_hle.Call((instruction >> 16) & 0xFF, state.reg)) {
+    // Return to the instruction after the SWI, like the BIOS would.
+    state.r15 -= 4;
+    ReloadPipeline32();
+    return;
+  }
+
   // Save current program status register.
+  SyncFlags();
   state.spsr[BANK_SVC].v = state.cpsr.v;
 
   // Enter SVC mode and disable IRQs.
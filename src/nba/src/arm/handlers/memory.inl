@@ -5,20 +5,35 @@
  * Refer to the included LICENSE file.
  */
 
-u32 ReadByte(u32 address, Access access) {
-  return bus.ReadByte(address, access);
+template<Access access>
+u32 ReadByte(u32 address) {
+  OnDataRead(address);
+  return bus.ReadByte<access>(address);
 }
 
-u32 ReadHalf(u32 address, Access access) {
-  return bus.ReadHalf(address, access);
+template<Access access>
+u32 ReadHalf(u32 address) {
+  OnDataRead(address);
+  return bus.ReadHalf<access>(address);
 }
 
+template<Access access>
+u32 ReadWord(u32 address) {
+  OnDataRead(address);
+  return bus.ReadWord<access>(address);
+}
+
+// Block transfers switch from non-sequential to sequential accesses at run time.
 u32 ReadWord(u32 address, Access access) {
+  OnDataRead(address);
   return bus.ReadWord(address, access);
 }
 
-u32 ReadByteSigned(u32 address, Access access) {
-  u32 value = bus.ReadByte(address, access);
+template<Access access>
+u32 ReadByteSigned(u32 address) {
+  OnDataRead(address);
+
+  u32 value = bus.ReadByte<access>(address);
 
   if (value & 0x80) {
     value |= 0xFFFFFF00;
@@ -27,8 +42,11 @@ u32 ReadByteSigned(u32 address, Access access) {
   return value;
 }
 
-u32 ReadHalfRotate(u32 address, Access access) {
-  u32 value = bus.ReadHalf(address, access);
+template<Access access>
+u32 ReadHalfRotate(u32 address) {
+  OnDataRead(address);
+
+  u32 value = bus.ReadHalf<access>(address);
 
   if (address & 1) {
     value = (value >> 8) | (value << 24);
@@ -37,16 +55,19 @@ u32 ReadHalfRotate(u32 address, Access access) {
   return value;
 }
 
-u32 ReadHalfSigned(u32 address, Access access) {
+template<Access access>
+u32 ReadHalfSigned(u32 address) {
+  OnDataRead(address);
+
   u32 value;
 
   if (address & 1) {
-    value = bus.ReadByte(address, access);
+    value = bus.ReadByte<access>(address);
     if (value & 0x80) {
       value |= 0xFFFFFF00;
     }
   } else {
-    value = bus.ReadHalf(address, access);
+    value = bus.ReadHalf<access>(address);
     if (value & 0x8000) {
       value |= 0xFFFF0000;
     }
@@ -55,21 +76,46 @@ u32 ReadHalfSigned(u32 address, Access access) {
   return value;
 }
 
-u32 ReadWordRotate(u32 address, Access access) {
-  auto value = bus.ReadWord(address, access);
+template<Access access>
+u32 ReadWordRotate(u32 address) {
+  OnDataRead(address);
+
+  auto value = bus.ReadWord<access>(address);
   auto shift = (address & 3) * 8;
 
   return (value >> shift) | (value << (32 - shift));
 }
 
-void WriteByte(u32 address, u8  value, Access access) {
-  bus.WriteByte(address, value, access);
+template<Access access>
+void WriteByte(u32 address, u8  value) {
+  OnDataWrite();
+  bus.WriteByte<access>(address, value);
 }
 
-void WriteHalf(u32 address, u16 value, Access access) {
-  bus.WriteHalf(address, value, access);
+template<Access access>
+void WriteHalf(u32 address, u16 value) {
+  OnDataWrite();
+  bus.WriteHalf<access>(address, value);
+}
+
+template<Access access>
+void WriteWord(u32 address, u32 value) {
+  OnDataWrite();
+  bus.WriteWord<access>(address, value);
 }
 
 void WriteWord(u32 address, u32 value, Access access) {
+  OnDataWrite();
   bus.WriteWord(address, value, access);
 }
+
+// Completes a block transfer that was done on host memory (see Bus::GetBurstMemory()).
+void FinishBurst(u32 address, int count, bool write, int cycles) {
+  bus.Step(cycles);
+
+  if (write) {
+    OnDataWrite();
+    bus.dirty_tracker.MarkWRAM(address & ~3, count * 4);
+    block_cache.InvalidateRange(address & ~3, count * 4);
+  }
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <nba/common/compiler.hpp>
+#include <nba/instruction_trace.hpp>
+#include <string>
+
+namespace nba::core::arm {
+
+/* Fixed-size rings of trace records and register values, nothing is allocated while recording.
+ * A record is completed (registers written and cycles taken) once the next instruction starts.
+ * Only compiled in with NBA_INSTRUCTION_TRACE, see ARM7TDMI::TraceInstruction().
+ */
+struct InstructionTraceBuffer {
+  using Record = InstructionTrace::Record;
+
+  InstructionTraceBuffer(int min_capacity) {
+    record_capacity = 1;
+    while (record_capacity < u64(min_capacity)) {
+      record_capacity <<= 1;
+    }
+
+    // Most instructions change one register and maybe the flags.
+    value_capacity = record_capacity * 2;
+
+    records = std::make_unique<Record[]>(record_capacity);
+    values = std::make_unique<u32[]>(value_capacity);
+  }
+
+  void ALWAYS_INLINE Add(u32 pc, u32 opcode, u32 const* reg, u32 cpsr, u64 timestamp) {
+    if (likely(record_head != 0)) {
+      auto& last = records[(record_head - 1) & (record_capacity - 1)];
+      u16 written = 0;
+
+      last.value_index = u32(value_head);
+
+      for (int i = 0; i < 15; i++) {
+        if (reg[i] != shadow[i]) {
+          shadow[i] = reg[i];
+          values[value_head++ & (value_capacity - 1)] = reg[i];
+          written |= 1 << i;
+        }
+      }
+
+      if (cpsr != shadow[15]) {
+        shadow[15] = cpsr;
+        values[value_head++ & (value_capacity - 1)] = cpsr;
+        written |= 1 << 15;
+      }
+
+      last.written = written;
+      last.cycles = u16(std::min<u64>(timestamp - last_timestamp, 0xFFFF));
+    } else {
+      std::copy(reg, reg + 15, shadow);
+      shadow[15] = cpsr;
+    }
+
+    records[record_head++ & (record_capacity - 1)] = {pc, opcode, u32(value_head), 0, 0};
+    last_timestamp = timestamp;
+  }
+
+  bool Dump(std::string const& path) const {
+    auto record_first = record_head - std::min(record_head, record_capacity);
+    auto value_first = value_head - std::min(value_head, value_capacity);
+
+    InstructionTrace::Header header;
+
+    std::memcpy(header.magic, InstructionTrace::kMagic, sizeof(header.magic));
+    header.version = InstructionTrace::kVersion;
+    header.record_count = u32(record_head - record_first);
+    header.value_count = u32(value_head - value_first);
+    header.first_value_index = u32(value_first);
+
+    auto file = std::fopen(path.c_str(), "wb");
+
+    if (file == nullptr) {
+      return false;
+    }
+
+    bool success = std::fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (auto i = record_first; success && i < record_head; i++) {
+      success = std::fwrite(&records[i & (record_capacity - 1)], sizeof(Record), 1, file) == 1;
+    }
+
+    for (auto i = value_first; success && i < value_head; i++) {
+      success = std::fwrite(&values[i & (value_capacity - 1)], sizeof(u32), 1, file) == 1;
+    }
+
+    return std::fclose(file) == 0 && success;
+  }
+
+private:
+  std::unique_ptr<Record[]> records;
+  std::unique_ptr<u32[]> values;
+  u64 record_capacity;
+  u64 value_capacity;
+  u64 record_head = 0;
+  u64 value_head = 0;
+  u64 last_timestamp = 0;
+  u32 shadow[16];
+};
+
+} // namespace nba::core::arm
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include "arm/arm7tdmi.hpp"
+
+namespace nba::core::arm {
+
+void ARM7TDMI::LoadState(SaveState const& state) {
+  auto& regs = state.arm.regs;
+
+  for (int i = 0; i < 16; i++) {
+    this->state.reg[i] = regs.reg[i];
+  }
+
+  for (int i = 0; i < BANK_COUNT; i++) {
+    for (int j = 0; j < 7; j++) {
+      this->state.bank[i][j] = regs.bank[i][j];
+    }
+    this->state.spsr[i].v = regs.spsr[i];
+  }
+
+  this->state.cpsr.v = regs.cpsr;
+
+  auto bank = GetRegisterBankByMode(this->state.cpsr.f.mode);
+
+  if (bank != BANK_NONE && bank != BANK_INVALID) {
+    p_spsr = &this->state.spsr[bank];
+  } else {
+    p_spsr = &this->state.cpsr;
+  }
+  cpu_mode_is_invalid = bank == BANK_INVALID;
+
+  pipe.fetch_type = (Access)state.arm.pipe.access;
+
+  pipe.opcode[0] = state.arm.pipe.opcode[0];
+  pipe.opcode[1] = state.arm.pipe.opcode[1];
+  debug_stop.active = false;
+  DecodePipeline();
+
+  irq_line = state.arm.irq_line;
+  ldm_usermode_conflict = state.arm.ldm_usermode_conflict;
+  UpdateOpcodeLUT();
+
+#if defined(NBA_LAZY_FLAGS)
+  nz_pending = false;
+#endif
+
+  idle_loop.target = 0xFFFFFFFF;
+  idle_loop.dirty = true;
+  idle_loop.detected = false;
+}
+
+void ARM7TDMI::CopyState(SaveState& state) {
+  auto& regs = state.arm.regs;
+
+  for (int i = 0; i < 16; i++) {
+    regs.reg[i] = this->state.reg[i];
+  }
+
+  for (int i = 0; i < BANK_COUNT; i++) {
+    for (int j = 0; j < 7; j++) {
+      regs.bank[i][j] = this->state.bank[i][j];
+    }
+    regs.spsr[i] = this->state.spsr[i].v;
+  }
+
+  SyncFlags();
+  regs.cpsr = this->state.cpsr.v;
+
+  state.arm.pipe.access = (u8)pipe.fetch_type;
+
+  /* When stopped at a debugger breakpoint, the next opcode has been fetched already.
+   * The state is stored as if it had not been, so the fetch is repeated (and timed again) after loading it.
+   */
+  if (debug_stop.active) {
+    state.arm.pipe.opcode[0] = debug_stop.opcode;
+    state.arm.pipe.opcode[1] = pipe.opcode[0];
+  } else {
+    state.arm.pipe.opcode[0] = pipe.opcode[0];
+    state.arm.pipe.opcode[1] = pipe.opcode[1];
+  }
+  state.arm.irq_line = irq_line;
+  state.arm.ldm_usermode_conflict = ldm_usermode_conflict;
+}
+
+} // namespace nba::core::arm
@@ -41,13 +41,32 @@ struct TableGen {
     return lut;
   }
 
+  // See ARM7TDMI::GetFusedHandler16() for how the first instruction is indexed.
+  static constexpr auto GenerateTableThumbFused() -> std::array<std::array<Handler16, 15>, 35> {
+    std::array<std::array<Handler16, 15>, 35> lut{};
+
+    static_for<std::size_t, 0, 15>([&](auto cond) {
+      // THUMB.3 MOV/CMP/ADD/SUB with an immediate
+      static_for<std::size_t, 0, 32>([&](auto i) {
+        lut[i][cond] = &ARM7TDMI::Thumb_FusedConditionalBranch<GenerateHandlerThumb<0x2000 | (i << 8)>(), cond>;
+      });
+
+      // THUMB.4 TST, CMP and CMN
+      lut[32][cond] = &ARM7TDMI::Thumb_FusedConditionalBranch<GenerateHandlerThumb<0x4200>(), cond>;
+      lut[33][cond] = &ARM7TDMI::Thumb_FusedConditionalBranch<GenerateHandlerThumb<0x4280>(), cond>;
+      lut[34][cond] = &ARM7TDMI::Thumb_FusedConditionalBranch<GenerateHandlerThumb<0x42C0>(), cond>;
+    });
+    return lut;
+  }
+
+  template<bool bank_checks>
   static constexpr auto GenerateTableARM() -> std::array<Handler32, 4096> {
     std::array<Handler32, 4096> lut{};
 
     static_for<std::size_t, 0, 4096>([&](auto i) {
       lut[i] = GenerateHandlerARM<
         ((i & 0xFF0) << 16) |
-        ((i & 0xF) << 4)>();
+        ((i & 0xF) << 4), bank_checks>();
     });
     return lut;
   }
@@ -84,7 +103,9 @@ struct TableGen {
 };
 
 std::array<Handler16, 1024> ARM7TDMI::s_opcode_lut_16 = TableGen::GenerateTableThumb();
-std::array<Handler32, 4096> ARM7TDMI::s_opcode_lut_32 = TableGen::GenerateTableARM();
+std::array<std::array<Handler16, 15>, 35> ARM7TDMI::s_fused_lut_16 = TableGen::GenerateTableThumbFused();
+std::array<Handler32, 4096> ARM7TDMI::s_opcode_lut_32 = TableGen::GenerateTableARM<false>();
+std::array<Handler32, 4096> ARM7TDMI::s_opcode_lut_32_checked = TableGen::GenerateTableARM<true>();
 std::array<bool, 256> ARM7TDMI::s_condition_lut = TableGen::GenerateConditionTable();
 
 } // namespace nba::core::arm
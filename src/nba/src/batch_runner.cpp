@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <nba/batch_runner.hpp>
+#include <thread>
+
+namespace nba {
+
+struct BatchRunner::Job {
+  std::unique_ptr<CoreBase> core;
+  int frames;
+  int frames_run = 0;
+  FrameCallback callback;
+};
+
+struct BatchRunner::Worker {
+  std::mutex mutex;
+  std::deque<int> queue;
+};
+
+BatchRunner::BatchRunner(int thread_count) {
+  if (thread_count <= 0) {
+    thread_count = std::max(int(std::thread::hardware_concurrency()), 1);
+  }
+
+  this->thread_count = thread_count;
+
+  for (int i = 0; i < thread_count; i++) {
+    workers.push_back(std::make_unique<Worker>());
+  }
+}
+
+BatchRunner::~BatchRunner() = default;
+
+auto BatchRunner::Add(
+  std::unique_ptr<CoreBase> core,
+  int frames,
+  FrameCallback callback
+) -> int {
+  auto job = std::make_unique<Job>();
+
+  job->core = std::move(core);
+  job->frames = frames;
+  job->callback = std::move(callback);
+  jobs.push_back(std::move(job));
+  return int(jobs.size() - 1);
+}
+
+auto BatchRunner::GetThreadCount() const -> int {
+  return thread_count;
+}
+
+auto BatchRunner::GetJobCount() const -> int {
+  return int(jobs.size());
+}
+
+auto BatchRunner::GetCore(int job_id) -> CoreBase& {
+  return *jobs.at(job_id)->core;
+}
+
+auto BatchRunner::GetFramesRun(int job_id) const -> int {
+  return jobs.at(job_id)->frames_run;
+}
+
+void BatchRunner::Run() {
+  std::vector<std::thread> threads;
+
+  // Hand out the jobs round-robin to get a roughly even starting point.
+  int pending = 0;
+
+  for (int job_id = 0; job_id < GetJobCount(); job_id++) {
+    if (jobs[job_id]->frames_run < jobs[job_id]->frames) {
+      workers[job_id % thread_count]->queue.push_back(job_id);
+      pending++;
+    }
+  }
+
+  jobs_pending = pending;
+
+  for (int i = 0; i < thread_count; i++) {
+    threads.emplace_back(&BatchRunner::RunWorker, this, i);
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+void BatchRunner::RunWorker(int worker_id) {
+  int job_id;
+
+  while (jobs_pending > 0) {
+    if (!PopJob(worker_id, job_id)) {
+      // Every remaining slice is in progress on another thread.
+      std::this_thread::yield();
+      continue;
+    }
+
+    if (RunSlice(job_id)) {
+      // Keep the job on this thread while possible, since its state is in our caches.
+      auto& worker = *workers[worker_id];
+      std::lock_guard guard{worker.mutex};
+      worker.queue.push_back(job_id);
+    } else {
+      jobs_pending--;
+    }
+  }
+}
+
+bool BatchRunner::RunSlice(int job_id) {
+  auto& job = *jobs[job_id];
+
+  job.core->RunForOneFrame();
+
+  if (job.callback && !job.callback(*job.core, job.frames_run)) {
+    job.frames_run++;
+    return false;
+  }
+
+  return ++job.frames_run < job.frames;
+}
+
+bool BatchRunner::PopJob(int worker_id, int& job_id) {
+  // Take the most recent slice from our own queue...
+  {
+    auto& worker = *workers[worker_id];
+    std::lock_guard guard{worker.mutex};
+
+    if (!worker.queue.empty()) {
+      job_id = worker.queue.back();
+      worker.queue.pop_back();
+      return true;
+    }
+  }
+
+  // ...or steal the oldest slice of another thread.
+  for (int i = 1; i < thread_count; i++) {
+    auto& victim = *workers[(worker_id + i) % thread_count];
+    std::lock_guard guard{victim.mutex};
+
+    if (!victim.queue.empty()) {
+      job_id = victim.queue.front();
+      victim.queue.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+} // namespace nba
@@ -14,10 +14,12 @@
 
 namespace nba::core {
 
-Bus::Bus(Scheduler& scheduler, Hardware&& hw)
+Bus::Bus(Scheduler& scheduler, DirtyTracker& dirty_tracker, Hardware&& hw)
     : scheduler(scheduler)
+    , dirty_tracker(dirty_tracker)
     , hw(hw) {
   this->hw.bus = this;
+  SetAccuracyProfile(Config::CPU::AccuracyProfile::Accurate);
   memory.bios.fill(0);
   Reset();
 }
@@ -26,14 +28,14 @@ void Bus::Reset() {
   memory.wram.fill(0);
   memory.iram.fill(0);
   memory.latch = {};
+  memory.rom.Reset();
   hw.waitcnt = {};
   hw.haltcnt = Hardware::HaltControl::Run;
-  hw.rcnt[0] = 0;
-  hw.rcnt[1] = 0;
   hw.postflg = 0;
   prefetch = {};
   dma = {};
   UpdateWaitStateTable();
+  UpdatePageTable();
 }
 
 void Bus::Attach(std::vector<u8> const& bios) {
@@ -46,37 +48,161 @@ void Bus::Attach(std::vector<u8> const& bios) {
 
 void Bus::Attach(ROM&& rom) {
   memory.rom = std::move(rom);
+  UpdatePageTable();
+}
+
+void Bus::UpdatePageTable() {
+  auto& rom = memory.rom;
+
+  for (int i = 0; i < kPageCount; i++) {
+    auto address = u32(i << kPageShift);
+    auto& read = page_table.read[i];
+    auto& write = page_table.write[i];
+
+    u8* host = nullptr;
+    bool writable = false;
+
+    switch (address >> 24) {
+      // EWRAM (external work RAM)
+      case 0x02: {
+        host = memory.wram.data() + (address & 0x3FFFF);
+        writable = true;
+        break;
+      }
+      // IWRAM (internal work RAM)
+      case 0x03: {
+        host = memory.iram.data() + (address & 0x7FFF);
+        writable = true;
+        break;
+      }
+      // VRAM (video RAM)
+      case 0x06: {
+        auto offset = address & 0x1FFFF;
+        if (offset >= 0x18000) {
+          offset &= ~0x8000;
+        }
+        host = hw.ppu.vram + offset;
+        break;
+      }
+      // ROM (WS0, WS1, WS2)
+      case 0x08 ... 0x0D: {
+        // Only mapped for reading, and pages with GPIO, EEPROM or open bus go through ROM::ReadROM16/32.
+        host = const_cast<u8*>(rom.GetPlainROM(address & 0x01FF'FFFF, kPageSize));
+        break;
+      }
+    }
+
+    // The bias is applied to the integer, since the biased pointer itself may point far outside of the memory.
+    read = { host ? (u8*)(uintptr_t(host) - address) : nullptr };
+    write = writable ? read : Page{};
+  }
+
+  if (watchpoints.enabled) {
+    UnmapWatchedPages();
+  }
+
+  code = {};
+}
+
+void Bus::SetAccuracyProfile(Config::CPU::AccuracyProfile profile) {
+  prefetch_buffer = profile != Config::CPU::AccuracyProfile::Fast;
 }
 
 auto Bus::ReadByte(u32 address, Access access) ->  u8 {
-  return Read<u8>(address, access);
+  if (access == Access::Sequential) {
+    return ReadImpl<u8, Access::Sequential>(address);
+  }
+  return ReadImpl<u8, Access::Nonsequential>(address);
 }
 
 auto Bus::ReadHalf(u32 address, Access access) -> u16 {
-  return Read<u16>(address, access);
+  if (access == Access::Sequential) {
+    return ReadImpl<u16, Access::Sequential>(address);
+  }
+  return ReadImpl<u16, Access::Nonsequential>(address);
 }
 
 auto Bus::ReadWord(u32 address, Access access) -> u32 {
-  return Read<u32>(address, access);
+  if (access == Access::Sequential) {
+    return ReadImpl<u32, Access::Sequential>(address);
+  }
+  return ReadImpl<u32, Access::Nonsequential>(address);
 }
 
 void Bus::WriteByte(u32 address, u8  value, Access access) {
-  Write<u8>(address, access, value);
+  if (access == Access::Sequential) {
+    WriteImpl<u8, Access::Sequential>(address, value);
+  } else {
+    WriteImpl<u8, Access::Nonsequential>(address, value);
+  }
 }
 
 void Bus::WriteHalf(u32 address, u16 value, Access access) {
-  Write<u16>(address, access, value);
+  if (access == Access::Sequential) {
+    WriteImpl<u16, Access::Sequential>(address, value);
+  } else {
+    WriteImpl<u16, Access::Nonsequential>(address, value);
+  }
 }
 
 void Bus::WriteWord(u32 address, u32 value, Access access) {
-  Write<u32>(address, access, value);
+  if (access == Access::Sequential) {
+    WriteImpl<u32, Access::Sequential>(address, value);
+  } else {
+    WriteImpl<u32, Access::Nonsequential>(address, value);
+  }
 }
 
-template<typename T>
-auto Bus::Read(u32 address, Access access) -> T {
+auto Bus::GetBurstMemory(u32 address, int count, bool write, int& cycles) -> u8* {
+  auto page = address >> 24;
+
+  address &= ~3;
+
+  if ((page != 0x02 && page != 0x03) || hw.dma.IsRunning()) {
+    return nullptr;
+  }
+
+  // Watched pages are not mapped (see Watchpoints), and the words must not cross into another page.
+  auto& entry = write ? page_table.write[address >> kPageShift] : page_table.read[address >> kPageShift];
+
+  if (entry.data == nullptr || (address & (kPageSize - 1)) + count * 4 > kPageSize) {
+    return nullptr;
+  }
+
+  cycles = wait32[int(Access::Nonsequential)][page] + (count - 1) * wait32[int(Access::Sequential)][page];
+
+  if (cycles >= scheduler.GetRemainingCycleCount()) {
+    return nullptr;
+  }
+  return entry.data + address;
+}
+
+template<typename T, Bus::Access access, bool code_fetch>
+auto Bus::ReadImpl(u32 address) -> T {
   auto page = address >> 24;
   auto is_u32 = std::is_same_v<T, u32>;
 
+  if (likely(page < 0x10)) {
+    auto& entry = page_table.read[address >> kPageShift];
+
+    if (likely(entry.data != nullptr)) {
+      auto data = entry.data + Align<T>(address);
+      auto& wait = is_u32 ? wait32 : wait16;
+
+      if (page >= 0x08) {
+        Prefetch(Align<T>(address), code_fetch, GetROMWait<T, access>(address, page));
+      } else {
+        Step(wait[int(access)][page]);
+      }
+
+      return read<T>(data, 0);
+    }
+  }
+
+  if (unlikely(watchpoints.enabled)) {
+    CheckWatchpoints(Align<T>(address), sizeof(T), code_fetch ? Watchpoint::Execute : Watchpoint::Read, 0);
+  }
+
   switch (page) {
     // BIOS
     case 0x00: {
@@ -121,23 +247,18 @@ auto Bus::Read(u32 address, Access access) -> T {
     case 0x08 ... 0x0D: {
       address = Align<T>(address);
 
-      if ((address & 0x1'FFFF) == 0) {
-        access = Access::Nonsequential;
-      }
+      Prefetch(address, code_fetch, GetROMWait<T, access>(address, page));
 
       if constexpr(std::is_same_v<T,  u8>) {
         auto shift = ((address & 1) << 3);
-        Prefetch(address, wait16[int(access)][page]);
         return memory.rom.ReadROM16(address) >> shift;
       }
 
       if constexpr(std::is_same_v<T, u16>) {
-        Prefetch(address, wait16[int(access)][page]);
         return memory.rom.ReadROM16(address);
       }
 
       if constexpr(std::is_same_v<T, u32>) {
-        Prefetch(address, wait32[int(access)][page]);
         return memory.rom.ReadROM32(address);  
       }
 
@@ -166,21 +287,75 @@ auto Bus::Read(u32 address, Access access) -> T {
 }
 
 template<typename T>
-void Bus::Write(u32 address, Access access, T value) {
+auto Bus::FetchCodeSlow(u32 address, Access access) -> T {
+  if (access == Access::Sequential) {
+    return ReadImpl<T, Access::Sequential, true>(address);
+  }
+  return ReadImpl<T, Access::Nonsequential, true>(address);
+}
+
+template auto Bus::FetchCodeSlow<u16>(u32 address, Access access) -> u16;
+template auto Bus::FetchCodeSlow<u32>(u32 address, Access access) -> u32;
+
+void Bus::UpdateCodePage(u32 address) {
+  auto page = address >> 24;
+
+  code = {};
+
+  if (page < 0x10) {
+    auto& entry = page_table.read[address >> kPageShift];
+
+    if (entry.data != nullptr) {
+      code.page = address >> kPageShift;
+      code.data = entry.data;
+      code.rom = page >= 0x08;
+      for (int access = 0; access < 2; access++) {
+        code.wait16[access] = wait16[access][page];
+        code.wait32[access] = wait32[access][page];
+      }
+    }
+  }
+}
+
+template<typename T, Bus::Access access>
+void Bus::WriteImpl(u32 address, T value) {
   auto page = address >> 24;
   auto is_u32 = std::is_same_v<T, u32>;
 
+  if (likely(page < 0x10)) {
+    auto& entry = page_table.write[address >> kPageShift];
+
+    if (likely(entry.data != nullptr)) {
+      auto data = entry.data + Align<T>(address);
+      auto& wait = is_u32 ? wait32 : wait16;
+
+      Step(wait[int(access)][page]);
+      write<T>(data, 0, value);
+      dirty_tracker.MarkWRAM(address);
+      hw.cpu.block_cache.Invalidate(address);
+      return;
+    }
+  }
+
+  if (unlikely(watchpoints.enabled)) {
+    CheckWatchpoints(Align<T>(address), sizeof(T), Watchpoint::Write, value);
+  }
+
   switch (page) {
     // EWRAM (external work RAM)
     case 0x02: {
       Step(is_u32 ? 6 : 3);
       write<T>(memory.wram.data(), Align<T>(address) & 0x3FFFF, value);
+      dirty_tracker.MarkWRAM(address);
+      hw.cpu.block_cache.Invalidate(address);
       break;
     }
     // IWRAM (internal work RAM)
     case 0x03: {
       Step(1);
       write<T>(memory.iram.data(), Align<T>(address) & 0x7FFF,  value);
+      dirty_tracker.MarkWRAM(address);
+      hw.cpu.block_cache.Invalidate(address);
       break;
     }
     // MMIO
@@ -214,25 +389,21 @@ void Bus::Write(u32 address, Access access, T value) {
     case 0x08 ... 0x0D: {
       address = Align<T>(address);
 
-      if ((address & 0x1'FFFF) == 0) {
-        access = Access::Nonsequential;
-      }
-
       StopPrefetch();
 
       // TODO: figure out how 8-bit and 32-bit accesses actually work.
       if constexpr(std::is_same_v<T, u8>) {
-        Step(wait16[int(access)][page]);
+        Step(GetROMWait<T, access>(address, page));
         memory.rom.WriteROM(address, value * 0x0101);
       }
 
       if constexpr(std::is_same_v<T, u16>) {
-        Step(wait16[int(access)][page]);
+        Step(GetROMWait<T, access>(address, page));
         memory.rom.WriteROM(address, value);
       }
 
       if constexpr(std::is_same_v<T, u32>) {
-        Step(wait32[int(access)][page]);
+        Step(GetROMWait<T, access>(address, page));
         memory.rom.WriteROM(address|0, value & 0xFFFF);
         memory.rom.WriteROM(address|2, value >> 16);
       }
@@ -257,6 +428,20 @@ void Bus::Write(u32 address, Access access, T value) {
   }
 }
 
+// The paths of each access type, for the entry points that take it as a template argument (see bus.hpp).
+template auto Bus::ReadImpl<u8,  Bus::Access::Nonsequential>(u32 address) ->  u8;
+template auto Bus::ReadImpl<u8,  Bus::Access::Sequential>(u32 address) ->  u8;
+template auto Bus::ReadImpl<u16, Bus::Access::Nonsequential>(u32 address) -> u16;
+template auto Bus::ReadImpl<u16, Bus::Access::Sequential>(u32 address) -> u16;
+template auto Bus::ReadImpl<u32, Bus::Access::Nonsequential>(u32 address) -> u32;
+template auto Bus::ReadImpl<u32, Bus::Access::Sequential>(u32 address) -> u32;
+template void Bus::WriteImpl<u8,  Bus::Access::Nonsequential>(u32 address, u8  value);
+template void Bus::WriteImpl<u8,  Bus::Access::Sequential>(u32 address, u8  value);
+template void Bus::WriteImpl<u16, Bus::Access::Nonsequential>(u32 address, u16 value);
+template void Bus::WriteImpl<u16, Bus::Access::Sequential>(u32 address, u16 value);
+template void Bus::WriteImpl<u32, Bus::Access::Nonsequential>(u32 address, u32 value);
+template void Bus::WriteImpl<u32, Bus::Access::Sequential>(u32 address, u32 value);
+
 auto Bus::ReadBIOS(u32 address) -> u32 {
   if (address >= 0x4000) {
     return ReadOpenBus(address);
@@ -365,7 +550,8 @@ auto Bus::GetHostAddress(u32 address, size_t size) -> u8* {
     case 0x08 ... 0x0D: {
       auto offset = address & 0x01FF'FFFF;
       if (offset + size <= rom.size()) {
-        return rom.data() + offset;
+        // The ROM image may be shared with other cores and must not be written to.
+        return const_cast<u8*>(rom.data()) + offset;
       }
       break;
     }
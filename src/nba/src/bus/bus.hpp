@@ -9,7 +9,13 @@
 
 #include <array>
 #include <nba/rom/rom.hpp>
+#include <nba/common/compiler.hpp>
+#include <nba/common/punning.hpp>
+#include <nba/config.hpp>
 #include <nba/integer.hpp>
+#include <nba/save_state.hpp>
+#include <nba/watchpoint.hpp>
+#include <type_traits>
 #include <vector>
 
 #include "hw/apu/apu.hpp"
@@ -17,7 +23,9 @@
 #include "hw/dma/dma.hpp"
 #include "hw/irq/irq.hpp"
 #include "hw/keypad/keypad.hpp"
+#include "hw/sio/sio.hpp"
 #include "hw/timer/timer.hpp"
+#include "dirty_tracker.hpp"
 
 namespace nba::core {
 
@@ -35,6 +43,15 @@ struct Bus {
   void Attach(std::vector<u8> const& bios);
   void Attach(ROM&& rom);
 
+  void LoadState(SaveState const& state);
+  void CopyState(SaveState& state);
+
+  // Only copies the IO registers, the BIOS latch, the prefetch buffer and the DMA bus state, i.e. without the memory.
+  void CopyIOState(SaveState& state);
+
+  // Selects whether the Game Pak prefetch buffer is emulated opcode by opcode (see Config::CPU::AccuracyProfile).
+  void SetAccuracyProfile(Config::CPU::AccuracyProfile profile);
+
   auto ReadByte(u32 address, Access access) ->  u8;
   auto ReadHalf(u32 address, Access access) -> u16;
   auto ReadWord(u32 address, Access access) -> u32;
@@ -43,10 +60,58 @@ struct Bus {
   void WriteHalf(u32 address, u16 value, Access access);
   void WriteWord(u32 address, u32 value, Access access);
 
+  /* The same with the access type known at compile time, which selects the path that has
+   * the wait states and the ROM sequential access checks of that access type resolved.
+   */
+  template<Access access> auto ReadByte(u32 address) ->  u8 { return ReadImpl<u8,  access>(address); }
+  template<Access access> auto ReadHalf(u32 address) -> u16 { return ReadImpl<u16, access>(address); }
+  template<Access access> auto ReadWord(u32 address) -> u32 { return ReadImpl<u32, access>(address); }
+
+  template<Access access> void WriteByte(u32 address, u8  value) { WriteImpl<u8,  access>(address, value); }
+  template<Access access> void WriteHalf(u32 address, u16 value) { WriteImpl<u16, access>(address, value); }
+  template<Access access> void WriteWord(u32 address, u32 value) { WriteImpl<u32, access>(address, value); }
+
   void Idle();
 
+  /* Returns the host memory of 'count' consecutive words in work RAM, if accessing them one after another
+   * (the first one non-sequentially) is indistinguishable from accessing them without the bus:
+   * no DMA may be running and the accesses must finish before the next event.
+   * Then 'cycles' is set to the wait states of all accesses, to be passed to Step() at once. Returns nullptr otherwise.
+   */
+  auto GetBurstMemory(u32 address, int count, bool write, int& cycles) -> u8*;
+
+  /* Opcode fetch from the CPU.
+   * Unlike Read() this knows that the access is a code fetch, which matters for the prefetch buffer.
+   */
+  template<typename T>
+  auto ALWAYS_INLINE FetchCode(u32 address, Access access) -> T {
+    address = Align<T>(address);
+
+    if (unlikely(code.page != (address >> kPageShift))) {
+      UpdateCodePage(address);
+
+      if (code.data == nullptr) {
+        return FetchCodeSlow<T>(address, access);
+      }
+    }
+
+    auto& wait = std::is_same_v<T, u32> ? code.wait32 : code.wait16;
+
+    if (code.rom) {
+      if ((address & 0x1'FFFF) == 0) {
+        access = Access::Nonsequential;
+      }
+      Prefetch(address, true, wait[int(access)]);
+    } else {
+      Step(wait[int(access)]);
+    }
+
+    return read<T>(code.data, address);
+  }
+
 //private:
   Scheduler& scheduler;
+  DirtyTracker& dirty_tracker;
 
   struct Memory {
     std::array<u8, 0x04000> bios;
@@ -66,6 +131,7 @@ struct Bus {
     PPU& ppu;
     Timer& timer;
     KeyPad& keypad;
+    SIO& sio;
     Bus* bus = nullptr;
 
     struct WaitstateControl {
@@ -84,7 +150,6 @@ struct Bus {
       Halt
     } haltcnt = HaltControl::Run;
 
-    u8 rcnt[2] { 0, 0 };
     u8 postflg = 0;
 
     auto ReadByte(u32 address) ->  u8;
@@ -94,8 +159,15 @@ struct Bus {
     void WriteByte(u32 address,  u8 value);
     void WriteHalf(u32 address, u16 value);
     void WriteWord(u32 address, u32 value);
+
+    // Per-register switches, only used to generate the MMIO dispatch tables in io.cpp.
+    auto ReadByteImpl(u32 address) ->  u8;
+    void WriteByteImpl(u32 address,  u8 value);
   } hw;
 
+  /* While active, the prefetch unit fetches an opcode every 'duty' cycles, until the buffer is full.
+   * 'timestamp' is when the fetch of the opcode at 'last_address' started.
+   */
   struct Prefetch {
     bool active = false;
     u32 head_address;
@@ -103,8 +175,8 @@ struct Bus {
     int count = 0;
     int capacity = 8;
     int opcode_width = 4;
-    int countdown;
     int duty;
+    u64 timestamp;
   } prefetch;
 
   struct DMA {
@@ -112,11 +184,27 @@ struct Bus {
     bool openbus = false;
   } dma;
 
-  template<typename T>
-  auto Read(u32 address, Access access) -> T;
+  template<typename T, Access access, bool code_fetch = false>
+  auto ReadImpl(u32 address) -> T;
   
-  template<typename T>
-  void Write(u32 address, Access access, T value);
+  template<typename T, Access access>
+  void WriteImpl(u32 address, T value);
+
+  // False with the Fast accuracy profile, which models the prefetch buffer as if it held a single opcode.
+  bool prefetch_buffer = true;
+
+  // The ROM wait states of an access, which is non-sequential at the start of every 128 KiB block.
+  template<typename T, Access access>
+  auto ALWAYS_INLINE GetROMWait(u32 address, int page) -> int {
+    auto& wait = std::is_same_v<T, u32> ? wait32 : wait16;
+
+    if constexpr (access == Access::Sequential) {
+      if ((address & 0x1'FFFF) == 0) {
+        return wait[int(Access::Nonsequential)][page];
+      }
+    }
+    return wait[int(access)][page];
+  }
 
   template<typename T>
   auto Align(u32 address) -> u32 {
@@ -126,10 +214,95 @@ struct Bus {
   auto ReadBIOS(u32 address) -> u32;
   auto ReadOpenBus(u32 address) -> u32;
 
-  void Prefetch(u32 address, int cycles);
+  /* Page table for direct (fastmem) access to memory that has no side effects.
+   * A page that is not backed by host memory (data == nullptr) is handled by the Read/Write slow path.
+   */
+  static constexpr int kPageShift = 14;
+  static constexpr int kPageCount = 0x1000'0000 >> kPageShift;
+  static constexpr u32 kPageSize = 1 << kPageShift;
+
+  /* 'data' is biased by the guest address of the page, so that the host address of any byte in the page
+   * is data + address, without masking. That only works for memory that is mirrored in steps of at least a page,
+   * which is why PRAM and OAM (mirrored every KiB) are never mapped and always take the slow path.
+   */
+  struct Page {
+    u8* data = nullptr;
+  };
+
+  struct PageTable {
+    Page read[kPageCount];
+    Page write[kPageCount];
+  } page_table;
+
+  void UpdatePageTable();
+
+  /* Pages that contain a watchpoint are taken off the page table,
+   * so that all of their accesses go through the slow path, which checks the watchpoints.
+   * Watchpoints are stored with canonical addresses (the first mirror).
+   */
+  struct Watchpoints {
+    struct Entry {
+      int id;
+      u32 address;
+      u32 size;
+      int kinds;
+    };
+
+    bool enabled = false;
+    int next_id = 0;
+    std::vector<Entry> entries;
+    Watchpoint::Callback callback;
+  } watchpoints;
+
+  // Maps an address to the first mirror of the memory that it refers to.
+  static auto GetCanonicalAddress(u32 address) -> u32;
+
+  auto AddWatchpoint(u32 address, u32 size, int kinds) -> int;
+  void RemoveWatchpoint(int id);
+  void UnmapWatchedPages();
+  void CheckWatchpoints(u32 address, int size, Watchpoint::Kind kind, u32 value);
+
+  // See CoreBase::DebugRead() and CoreBase::DebugWrite().
+  auto DebugRead(u32 address) -> u8;
+  void DebugWrite(u32 address, u8 value);
+
+  // Host memory (biased like Page::data) and wait states of the page that code is currently fetched from.
+  struct CodePage {
+    u32 page = 0xFFFF'FFFF;
+    u8* data = nullptr;
+    bool rom = false;
+    int wait16[2];
+    int wait32[2];
+  } code;
+
+  void UpdateCodePage(u32 address);
+
+  template<typename T>
+  auto FetchCodeSlow(u32 address, Access access) -> T;
+
+  void Prefetch(u32 address, bool code_fetch, int cycles);
   void StopPrefetch();
-  void Step(int cycles);
+
+  // Stops the prefetch unit like a data access to the Game Pak does, for DMA transfers that bypass Prefetch().
+  void CancelPrefetch();
+
+  void SyncPrefetch();
+
+  /* The prefetch buffer is brought up to date only when it is looked at (see SyncPrefetch()).
+   * So unless DMA is pending, only the scheduler needs to advance, which only leaves the inline path once an event is due.
+   */
+  void ALWAYS_INLINE Step(int cycles) {
+    if (likely(!hw.dma.IsRunning())) {
+      dma.openbus = false;
+      scheduler.AddCycles(cycles);
+    } else {
+      StepSlow(cycles);
+    }
+  }
+
+  void StepSlow(int cycles);
   void UpdateWaitStateTable();
+  void LoadMemoryState(u8* dst, u8 const* src, size_t size, u32 base);
  
   int wait16[2][16] {
     { 1, 1, 3, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 1 },
@@ -142,7 +315,7 @@ struct Bus {
   };
 
 public:
-  Bus(Scheduler& scheduler, Hardware&& hw);
+  Bus(Scheduler& scheduler, DirtyTracker& dirty_tracker, Hardware&& hw);
 
   auto GetHostAddress(u32 address, size_t size) -> u8*;
 
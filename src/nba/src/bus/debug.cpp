@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include "arm/arm7tdmi.hpp"
+#include "bus/bus.hpp"
+
+namespace nba::core {
+
+auto Bus::DebugRead(u32 address) -> u8 {
+  switch (address >> 24) {
+    case 0x00: {
+      return address < memory.bios.size() ? memory.bios[address] : 0;
+    }
+    case 0x02: return memory.wram[address & 0x3FFFF];
+    case 0x03: return memory.iram[address & 0x7FFF];
+    case 0x04: return hw.ReadByte(address);
+    case 0x05: return hw.ppu.ReadPRAM<u8>(address);
+    case 0x06: return hw.ppu.ReadVRAM<u8>(address);
+    case 0x07: return hw.ppu.ReadOAM<u8>(address);
+    case 0x08 ... 0x0D: {
+      // GPIO and EEPROM are left alone, since reading them changes their state.
+      auto& rom = memory.rom.GetRawROM();
+      auto offset = address & 0x01FF'FFFF;
+
+      return offset < rom.size() ? rom.data()[offset] : 0;
+    }
+  }
+
+  return 0;
+}
+
+void Bus::DebugWrite(u32 address, u8 value) {
+  // Byte writes to PRAM, VRAM and OAM would be mirrored to both bytes of the halfword, so the halfword is patched instead.
+  auto patch = [&](u16 half) -> u16 {
+    auto shift = (address & 1) << 3;
+
+    return (half & ~(0xFF << shift)) | (value << shift);
+  };
+
+  switch (address >> 24) {
+    case 0x02: {
+      memory.wram[address & 0x3FFFF] = value;
+      dirty_tracker.MarkWRAM(address);
+      hw.cpu.block_cache.Invalidate(address);
+      break;
+    }
+    case 0x03: {
+      memory.iram[address & 0x7FFF] = value;
+      dirty_tracker.MarkWRAM(address);
+      hw.cpu.block_cache.Invalidate(address);
+      break;
+    }
+    case 0x04: {
+      hw.WriteByte(address, value);
+      break;
+    }
+    case 0x05: {
+      hw.ppu.WritePRAM<u16>(address & ~1, patch(hw.ppu.ReadPRAM<u16>(address & ~1)));
+      break;
+    }
+    case 0x06: {
+      hw.ppu.WriteVRAM<u16>(address & ~1, patch(hw.ppu.ReadVRAM<u16>(address & ~1)));
+      break;
+    }
+    case 0x07: {
+      hw.ppu.WriteOAM<u16>(address & ~1, patch(hw.ppu.ReadOAM<u16>(address & ~1)));
+      break;
+    }
+  }
+}
+
+} // namespace nba::core
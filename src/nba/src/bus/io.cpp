@@ -5,13 +5,17 @@
  * Refer to the included LICENSE file.
  */
 
+#include <array>
+#include <nba/common/compiler.hpp>
+#include <nba/common/meta.hpp>
+
 #include "arm/arm7tdmi.hpp"
 #include "bus/bus.hpp"
 #include "bus/io.hpp"
 
 namespace nba::core {
 
-auto Bus::Hardware::ReadByte(u32 address) ->  u8 {
+ALWAYS_INLINE auto Bus::Hardware::ReadByteImpl(u32 address) ->  u8 {
   auto& apu_io = apu.mmio;
   auto& ppu_io = ppu.mmio;
 
@@ -139,8 +143,20 @@ auto Bus::Hardware::ReadByte(u32 address) ->  u8 {
     case TM3CNT_H+1: return 0;
 
     // Serial communication
-    case RCNT+0: return rcnt[0];
-    case RCNT+1: return rcnt[1];
+    case SIODATA32_L+0: return sio.Read(0);
+    case SIODATA32_L+1: return sio.Read(1);
+    case SIODATA32_H+0: return sio.Read(2);
+    case SIODATA32_H+1: return sio.Read(3);
+    case SIOMULTI2+0:   return sio.Read(4);
+    case SIOMULTI2+1:   return sio.Read(5);
+    case SIOMULTI3+0:   return sio.Read(6);
+    case SIOMULTI3+1:   return sio.Read(7);
+    case SIOCNT+0:      return sio.Read(8);
+    case SIOCNT+1:      return sio.Read(9);
+    case SIODATA8+0:    return sio.Read(10);
+    case SIODATA8+1:    return sio.Read(11);
+    case RCNT+0:        return sio.Read(20);
+    case RCNT+1:        return sio.Read(21);
 
     // Keypad
     case KEYINPUT+0: return keypad.input.ReadByte(0);
@@ -181,18 +197,7 @@ auto Bus::Hardware::ReadByte(u32 address) ->  u8 {
   return bus->ReadOpenBus(address);
 }
 
-auto Bus::Hardware::ReadHalf(u32 address) -> u16 {
-  return ReadByte(address) | (ReadByte(address + 1) << 8);
-}
-
-auto Bus::Hardware::ReadWord(u32 address) -> u32 {
-  return ReadByte(address) |
-        (ReadByte(address + 1) <<  8) |
-        (ReadByte(address + 2) << 16) |
-        (ReadByte(address + 3) << 24);
-}
-
-void Bus::Hardware::WriteByte(u32 address,  u8 value) {
+ALWAYS_INLINE void Bus::Hardware::WriteByteImpl(u32 address,  u8 value) {
   auto& apu_io = apu.mmio;
   auto& ppu_io = ppu.mmio;
 
@@ -443,7 +448,13 @@ void Bus::Hardware::WriteByte(u32 address,  u8 value) {
     case SOUNDCNT_L:   apu_io.soundcnt.Write(0, value); break;
     case SOUNDCNT_L+1: apu_io.soundcnt.Write(1, value); break;
     case SOUNDCNT_H:   apu_io.soundcnt.Write(2, value); break;
-    case SOUNDCNT_H+1: apu_io.soundcnt.Write(3, value); break;
+    case SOUNDCNT_H+1: {
+      // The FIFO timer selection decides which timer overflows must not be batched.
+      timer.Sync();
+      apu_io.soundcnt.Write(3, value);
+      timer.Reschedule();
+      break;
+    }
     case SOUNDCNT_X:   apu_io.soundcnt.Write(4, value); break;
     case SOUNDBIAS:    apu_io.bias.Write(0, value); break;
     case SOUNDBIAS+1:  apu_io.bias.Write(1, value); break;
@@ -463,14 +474,20 @@ void Bus::Hardware::WriteByte(u32 address,  u8 value) {
     case TM3CNT_H:   timer.Write(3, 2, value); break;
 
     // Serial communication
-    case SIOCNT: {
-      if (value & 0x80) {
-        irq.Raise(IRQ::Source::Serial);
-      }
-      break;
-    }
-    case RCNT+0: rcnt[0] = value; break;
-    case RCNT+1: rcnt[1] = value; break;
+    case SIODATA32_L+0: sio.Write(0, value); break;
+    case SIODATA32_L+1: sio.Write(1, value); break;
+    case SIODATA32_H+0: sio.Write(2, value); break;
+    case SIODATA32_H+1: sio.Write(3, value); break;
+    case SIOMULTI2+0:   sio.Write(4, value); break;
+    case SIOMULTI2+1:   sio.Write(5, value); break;
+    case SIOMULTI3+0:   sio.Write(6, value); break;
+    case SIOMULTI3+1:   sio.Write(7, value); break;
+    case SIOCNT+0:      sio.Write(8, value); break;
+    case SIOCNT+1:      sio.Write(9, value); break;
+    case SIODATA8+0:    sio.Write(10, value); break;
+    case SIODATA8+1:    sio.Write(11, value); break;
+    case RCNT+0:        sio.Write(20, value); break;
+    case RCNT+1:        sio.Write(21, value); break;
 
     // Keypad
     case KEYCNT:   keypad.control.WriteByte(0, value); break;
@@ -520,20 +537,140 @@ void Bus::Hardware::WriteByte(u32 address,  u8 value) {
   }
 }
 
-void Bus::Hardware::WriteHalf(u32 address, u16 value) {
-  switch (address) {
+/* The handlers below are the register switches above specialized for a constant address.
+ * Since the switch folds away, every handler only contains the code of its own register,
+ * and an 8-bit or 16-bit access is dispatched with one indirect call (a 32-bit access with two)
+ * instead of walking the switch for each byte.
+ */
+namespace {
+
+using ReadHandler8  =  u8 (*)(Bus::Hardware& hw);
+using ReadHandler16 = u16 (*)(Bus::Hardware& hw);
+using WriteHandler8 = void (*)(Bus::Hardware& hw,  u8 value);
+using WriteHandler16 = void (*)(Bus::Hardware& hw, u16 value);
+
+constexpr u32 kIOBase = 0x0400'0000;
+constexpr u32 kIOSize = 0x400;
+
+template<u32 address>
+auto ReadByteHandler(Bus::Hardware& hw) -> u8 {
+  // Reading the PSG state catches the channels up, so the pending audio must be mixed first.
+  if constexpr (address >= SOUND1CNT_L && address < FIFO_A) {
+    hw.apu.Sync();
+  }
+  return hw.ReadByteImpl(address);
+}
+
+template<u32 address>
+auto ReadHalfHandler(Bus::Hardware& hw) -> u16 {
+  // Reading the PSG state catches the channels up, so the pending audio must be mixed first.
+  if constexpr (address >= SOUND1CNT_L && address < FIFO_A) {
+    hw.apu.Sync();
+  }
+  return hw.ReadByteImpl(address) | (hw.ReadByteImpl(address + 1) << 8);
+}
+
+template<u32 address>
+void WriteByteHandler(Bus::Hardware& hw, u8 value) {
+  // Mix the pending audio before the sound registers change (see APU::Sync()).
+  if constexpr (address >= SOUND1CNT_L && address < FIFO_A) {
+    hw.apu.Sync();
+    hw.apu.LogRegisterWrite(address, value);
+  }
+  hw.WriteByteImpl(address, value);
+}
+
+template<u32 address>
+void WriteHalfHandler(Bus::Hardware& hw, u16 value) {
+  if constexpr (address == KEYCNT) {
     /* Do not invoke Keypad::UpdateIRQ() twice for a single 16-bit write.
      * See https://github.com/fleroviux/NanoBoyAdvance/issues/152 for details.
      */
-    case KEYCNT: {
-      keypad.control.WriteHalf(value);
-      break;
-    }
-    default: {
-      WriteByte(address + 0, u8(value >> 0));
-      WriteByte(address + 1, u8(value >> 8));
-      break;
+    hw.keypad.control.WriteHalf(value);
+  } else {
+    if constexpr (address >= SOUND1CNT_L && address < FIFO_A) {
+      hw.apu.Sync();
+      hw.apu.LogRegisterWrite(address + 0, u8(value >> 0));
+      hw.apu.LogRegisterWrite(address + 1, u8(value >> 8));
     }
+    hw.WriteByteImpl(address + 0, u8(value >> 0));
+    hw.WriteByteImpl(address + 1, u8(value >> 8));
+  }
+}
+
+// Indexed by address & 0x3FF
+constexpr auto kReadTable8 = []() {
+  std::array<ReadHandler8, kIOSize> table{};
+  static_for<u32, 0, kIOSize>([&](auto i) {
+    table[i] = &ReadByteHandler<kIOBase + i>;
+  });
+  return table;
+}();
+
+// Indexed by (address & 0x3FF) >> 1
+constexpr auto kReadTable16 = []() {
+  std::array<ReadHandler16, kIOSize / 2> table{};
+  static_for<u32, 0, kIOSize / 2>([&](auto i) {
+    table[i] = &ReadHalfHandler<kIOBase + i * 2>;
+  });
+  return table;
+}();
+
+// Indexed by address & 0x3FF
+constexpr auto kWriteTable8 = []() {
+  std::array<WriteHandler8, kIOSize> table{};
+  static_for<u32, 0, kIOSize>([&](auto i) {
+    table[i] = &WriteByteHandler<kIOBase + i>;
+  });
+  return table;
+}();
+
+// Indexed by (address & 0x3FF) >> 1
+constexpr auto kWriteTable16 = []() {
+  std::array<WriteHandler16, kIOSize / 2> table{};
+  static_for<u32, 0, kIOSize / 2>([&](auto i) {
+    table[i] = &WriteHalfHandler<kIOBase + i * 2>;
+  });
+  return table;
+}();
+
+} // namespace
+
+auto Bus::Hardware::ReadByte(u32 address) ->  u8 {
+  auto offset = address - kIOBase;
+
+  if (unlikely(offset >= kIOSize)) {
+    return bus->ReadOpenBus(address);
+  }
+  return kReadTable8[offset](*this);
+}
+
+auto Bus::Hardware::ReadHalf(u32 address) -> u16 {
+  auto offset = address - kIOBase;
+
+  if (unlikely(offset >= kIOSize)) {
+    return u8(bus->ReadOpenBus(address)) | (u8(bus->ReadOpenBus(address + 1)) << 8);
+  }
+  return kReadTable16[offset >> 1](*this);
+}
+
+auto Bus::Hardware::ReadWord(u32 address) -> u32 {
+  return ReadHalf(address) | (ReadHalf(address + 2) << 16);
+}
+
+void Bus::Hardware::WriteByte(u32 address,  u8 value) {
+  auto offset = address - kIOBase;
+
+  if (likely(offset < kIOSize)) {
+    kWriteTable8[offset](*this, value);
+  }
+}
+
+void Bus::Hardware::WriteHalf(u32 address, u16 value) {
+  auto offset = address - kIOBase;
+
+  if (likely(offset < kIOSize)) {
+    kWriteTable16[offset >> 1](*this, value);
   }
 }
 
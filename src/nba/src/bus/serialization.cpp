@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "arm/arm7tdmi.hpp"
+#include "bus/bus.hpp"
+
+namespace nba::core {
+
+void Bus::LoadState(SaveState const& state) {
+  auto& waitcnt = state.bus.io.waitcnt;
+
+  LoadMemoryState(memory.wram.data(), state.bus.memory.wram, memory.wram.size(), 0x0200'0000);
+  LoadMemoryState(memory.iram.data(), state.bus.memory.iram, memory.iram.size(), 0x0300'0000);
+  memory.latch.bios = state.bus.memory.latch.bios;
+  memory.rom.LoadState(state);
+
+  bool waitcnt_changed = hw.waitcnt.sram != waitcnt.sram ||
+                         hw.waitcnt.phi != waitcnt.phi ||
+                         hw.waitcnt.prefetch != waitcnt.prefetch ||
+                         hw.waitcnt.cgb != waitcnt.cgb;
+
+  for (int i = 0; i < 2; i++) {
+    waitcnt_changed |= hw.waitcnt.ws0[i] != waitcnt.ws0[i] ||
+                       hw.waitcnt.ws1[i] != waitcnt.ws1[i] ||
+                       hw.waitcnt.ws2[i] != waitcnt.ws2[i];
+  }
+
+  hw.waitcnt.sram = waitcnt.sram;
+  for (int i = 0; i < 2; i++) {
+    hw.waitcnt.ws0[i] = waitcnt.ws0[i];
+    hw.waitcnt.ws1[i] = waitcnt.ws1[i];
+    hw.waitcnt.ws2[i] = waitcnt.ws2[i];
+  }
+  hw.waitcnt.phi = waitcnt.phi;
+  hw.waitcnt.prefetch = waitcnt.prefetch;
+  hw.waitcnt.cgb = waitcnt.cgb;
+
+  hw.haltcnt = (Hardware::HaltControl)state.bus.io.haltcnt;
+  hw.postflg = state.bus.io.postflg;
+
+  prefetch.active = state.bus.prefetch.active;
+  prefetch.head_address = state.bus.prefetch.head_address;
+  prefetch.last_address = state.bus.prefetch.last_address;
+  prefetch.count = state.bus.prefetch.count;
+  prefetch.capacity = state.bus.prefetch.capacity;
+  prefetch.opcode_width = state.bus.prefetch.opcode_width;
+  prefetch.duty = state.bus.prefetch.duty;
+  prefetch.timestamp = scheduler.GetTimestampNow() + state.bus.prefetch.countdown - state.bus.prefetch.duty;
+
+  dma.active = state.bus.dma.active;
+  dma.openbus = state.bus.dma.openbus;
+
+  // This also flushes the block cache, so skip it if possible.
+  if (waitcnt_changed) {
+    UpdateWaitStateTable();
+  }
+}
+
+/* Loading states back-to-back (e.g. for rewind or run-ahead) usually only changes
+ * a small part of the work RAM. Only evict compiled code from the chunks that did change,
+ * instead of flushing the whole block cache.
+ */
+void Bus::LoadMemoryState(u8* dst, u8 const* src, size_t size, u32 base) {
+  constexpr size_t kChunkSize = arm::BasicBlock::kSize;
+
+  for (size_t offset = 0; offset < size; offset += kChunkSize) {
+    if (std::memcmp(&dst[offset], &src[offset], kChunkSize) != 0) {
+      std::memcpy(&dst[offset], &src[offset], kChunkSize);
+      hw.cpu.block_cache.Invalidate(base + offset);
+    }
+  }
+}
+
+void Bus::CopyState(SaveState& state) {
+  std::copy(memory.wram.begin(), memory.wram.end(), state.bus.memory.wram);
+  std::copy(memory.iram.begin(), memory.iram.end(), state.bus.memory.iram);
+  memory.rom.CopyState(state);
+
+  CopyIOState(state);
+}
+
+void Bus::CopyIOState(SaveState& state) {
+  auto& waitcnt = state.bus.io.waitcnt;
+
+  state.bus.memory.latch.bios = memory.latch.bios;
+
+  waitcnt.sram = hw.waitcnt.sram;
+  for (int i = 0; i < 2; i++) {
+    waitcnt.ws0[i] = hw.waitcnt.ws0[i];
+    waitcnt.ws1[i] = hw.waitcnt.ws1[i];
+    waitcnt.ws2[i] = hw.waitcnt.ws2[i];
+  }
+  waitcnt.phi = hw.waitcnt.phi;
+  waitcnt.prefetch = hw.waitcnt.prefetch;
+  waitcnt.cgb = hw.waitcnt.cgb;
+
+  state.bus.io.haltcnt = (u8)hw.haltcnt;
+  state.bus.io.postflg = hw.postflg;
+
+  SyncPrefetch();
+
+  state.bus.prefetch.active = prefetch.active;
+  state.bus.prefetch.head_address = prefetch.head_address;
+  state.bus.prefetch.last_address = prefetch.last_address;
+  state.bus.prefetch.count = prefetch.count;
+  state.bus.prefetch.capacity = prefetch.capacity;
+  state.bus.prefetch.opcode_width = prefetch.opcode_width;
+  state.bus.prefetch.countdown = u32(prefetch.timestamp + prefetch.duty - scheduler.GetTimestampNow());
+  state.bus.prefetch.duty = prefetch.duty;
+
+  state.bus.dma.active = dma.active;
+  state.bus.dma.openbus = dma.openbus;
+}
+
+} // namespace nba::core
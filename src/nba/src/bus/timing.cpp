@@ -5,6 +5,8 @@
  * Refer to the included LICENSE file.
  */
 
+#include <algorithm>
+
 #include "arm/arm7tdmi.hpp"
 #include "bus/bus.hpp"
 
@@ -14,16 +16,33 @@ void Bus::Idle() {
   Step(1);
 }
 
-void Bus::Prefetch(u32 address, int cycles) {
+void Bus::Prefetch(u32 address, bool code_fetch, int cycles) {
+  if (!prefetch_buffer) {
+    /* A buffer of a single opcode: the next sequential opcode was fetched during the cycles since the last opcode fetch,
+     * it takes at least one cycle though. Data accesses stop the prefetch unit, which head_address tracks
+     * by pointing to an address that no opcode is fetched from.
+     */
+    if (code_fetch && hw.waitcnt.prefetch && address == prefetch.head_address) {
+      auto elapsed = scheduler.GetTimestampNow() - prefetch.timestamp;
+
+      cycles = elapsed < u64(cycles) ? std::max(1, cycles - int(elapsed)) : 1;
+    }
+    Step(cycles);
+    prefetch.head_address = code_fetch ? address + (hw.cpu.state.cpsr.f.thumb ? 2 : 4) : 1;
+    prefetch.timestamp = scheduler.GetTimestampNow();
+    return;
+  }
+
   if (hw.waitcnt.prefetch) {
-    // TODO: distinguish code and data accesses instead of comparing against R15.
-    if (address != hw.cpu.state.r15) {
+    if (!code_fetch) {
       prefetch.active = false;
       prefetch.count = 0;
       Step(cycles);
       return;
     }
 
+    SyncPrefetch();
+
     // Case #1: requested address is the first entry in the prefetch buffer.
     if (prefetch.count != 0 && address == prefetch.head_address) {
       prefetch.count--;
@@ -34,7 +53,8 @@ void Bus::Prefetch(u32 address, int cycles) {
 
     // Case #2: requested address is currently being prefetched.
     if (prefetch.active && address == prefetch.last_address) {
-      Step(prefetch.countdown);
+      Step(int(prefetch.timestamp + prefetch.duty - scheduler.GetTimestampNow()));
+      SyncPrefetch();
       prefetch.head_address = prefetch.last_address;
       prefetch.count = 0;
       return;
@@ -54,7 +74,7 @@ void Bus::Prefetch(u32 address, int cycles) {
       prefetch.capacity = 4;
       prefetch.duty = wait32[int(Access::Sequential)][address >> 24];
     }
-    prefetch.countdown = prefetch.duty;
+    prefetch.timestamp = scheduler.GetTimestampNow();
     prefetch.last_address = address + prefetch.opcode_width;
     prefetch.head_address = prefetch.last_address;
   } else {
@@ -63,6 +83,13 @@ void Bus::Prefetch(u32 address, int cycles) {
 }
 
 void Bus::StopPrefetch() {
+  if (!prefetch_buffer) {
+    prefetch.head_address = 1;
+    return;
+  }
+
+  SyncPrefetch();
+
   if (prefetch.active) {
     // TODO: do more testing on the timing.
     Step(1);
@@ -71,10 +98,50 @@ void Bus::StopPrefetch() {
   }
 }
 
-void Bus::Step(int cycles) {
+void Bus::CancelPrefetch() {
+  if (!prefetch_buffer) {
+    prefetch.head_address = 1;
+    prefetch.timestamp = scheduler.GetTimestampNow();
+  } else if (hw.waitcnt.prefetch) {
+    prefetch.active = false;
+    prefetch.count = 0;
+  }
+}
+
+/* Adds the opcodes that were fetched since the last call to the buffer.
+ * The buffer only drains when it is looked at, so it is full at the same time as if it was updated every cycle.
+ */
+void Bus::SyncPrefetch() {
+  if (!prefetch.active) {
+    return;
+  }
+
+  auto elapsed = scheduler.GetTimestampNow() - prefetch.timestamp;
+
+  if (elapsed < u64(prefetch.duty)) {
+    return;
+  }
+
+  auto fetched = elapsed / prefetch.duty;
+  auto room = prefetch.capacity - prefetch.count;
+
+  if (fetched >= u64(room)) {
+    // The unit stops once the buffer is full.
+    prefetch.active = false;
+    prefetch.count = prefetch.capacity;
+    prefetch.last_address += (room - 1) * prefetch.opcode_width;
+  } else {
+    prefetch.count += int(fetched);
+    prefetch.last_address += u32(fetched) * prefetch.opcode_width;
+    prefetch.timestamp += fetched * prefetch.duty;
+  }
+}
+
+void Bus::StepSlow(int cycles) {
   dma.openbus = false;
 
-  if (hw.dma.IsRunning() && !dma.active) {
+  if (!dma.active) {
+    NBA_PROFILE_SCOPE(scheduler, DMA);
     dma.active = true;
     hw.dma.Run();
     dma.active = false;
@@ -82,21 +149,6 @@ void Bus::Step(int cycles) {
   }
 
   scheduler.AddCycles(cycles);
-
-  if (prefetch.active) {
-    prefetch.countdown -= cycles;
-
-    if (prefetch.countdown <= 0) {
-      prefetch.count++;
-
-      if (prefetch.count < prefetch.capacity) {
-        prefetch.last_address += prefetch.opcode_width;
-        prefetch.countdown += prefetch.duty;
-      } else {
-        prefetch.active = false;
-      }
-    }
-  }
 }
 
 void Bus::UpdateWaitStateTable() {
@@ -137,6 +189,10 @@ void Bus::UpdateWaitStateTable() {
     wait16[s][0xE + i] = sram;
     wait32[s][0xE + i] = sram;
   }
+
+  // Cached blocks and the code page have the old wait states baked in.
+  hw.cpu.block_cache.Flush();
+  code = {};
 }
 
 } // namespace nba::core
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+
+#include "arm/arm7tdmi.hpp"
+#include "bus/bus.hpp"
+
+namespace nba::core {
+
+auto Bus::GetCanonicalAddress(u32 address) -> u32 {
+  switch (address >> 24) {
+    case 0x02: return 0x0200'0000 | (address & 0x3FFFF);
+    case 0x03: return 0x0300'0000 | (address & 0x7FFF);
+    case 0x05: return 0x0500'0000 | (address & 0x3FF);
+    case 0x06: {
+      auto offset = address & 0x1FFFF;
+      if (offset >= 0x18000) {
+        offset &= ~0x8000;
+      }
+      return 0x0600'0000 | offset;
+    }
+    case 0x07: return 0x0700'0000 | (address & 0x3FF);
+    case 0x08 ... 0x0D: return 0x0800'0000 | (address & 0x01FF'FFFF);
+  }
+
+  return address;
+}
+
+auto Bus::AddWatchpoint(u32 address, u32 size, int kinds) -> int {
+  auto id = watchpoints.next_id++;
+
+  watchpoints.entries.push_back({id, GetCanonicalAddress(address), std::max(size, 1U), kinds});
+  watchpoints.enabled = true;
+
+  UpdatePageTable();
+  hw.cpu.block_cache.Flush();
+  return id;
+}
+
+void Bus::RemoveWatchpoint(int id) {
+  auto& entries = watchpoints.entries;
+
+  entries.erase(std::remove_if(entries.begin(), entries.end(), [&](auto const& entry) {
+    return entry.id == id;
+  }), entries.end());
+  watchpoints.enabled = !entries.empty();
+
+  UpdatePageTable();
+  hw.cpu.block_cache.Flush();
+}
+
+void Bus::UnmapWatchedPages() {
+  for (int i = 0; i < kPageCount; i++) {
+    auto& read = page_table.read[i];
+    auto& write = page_table.write[i];
+
+    if (read.data == nullptr && write.data == nullptr) {
+      continue;
+    }
+
+    auto begin = GetCanonicalAddress(u32(i << kPageShift));
+
+    for (auto const& entry : watchpoints.entries) {
+      if (begin < entry.address + entry.size && begin + kPageSize > entry.address) {
+        read = {};
+        write = {};
+        break;
+      }
+    }
+  }
+}
+
+void Bus::CheckWatchpoints(u32 address, int size, Watchpoint::Kind kind, u32 value) {
+  auto canonical = GetCanonicalAddress(address);
+  auto& state = hw.cpu.state;
+
+  // Indexed, since the callback could add or remove watchpoints (which is not supported, but should not crash).
+  for (size_t i = 0; i < watchpoints.entries.size(); i++) {
+    auto entry = watchpoints.entries[i];
+
+    if ((entry.kinds & kind) == 0 || canonical >= entry.address + entry.size || canonical + size <= entry.address) {
+      continue;
+    }
+
+    auto pc = state.r15 - (state.cpsr.f.thumb ? 4 : 8);
+
+    if (watchpoints.callback && watchpoints.callback({entry.id, kind, address, size, value, pc})) {
+      hw.cpu.SetRunLimit(0);
+    }
+  }
+}
+
+} // namespace nba::core
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+#include <mutex>
+#include <string_view>
+#include <nba/common/cpu_dispatch.hpp>
+
+namespace nba {
+
+namespace {
+
+auto DetectCPUFeatures() -> CPUFeatures {
+  auto features = CPUFeatures{};
+
+#if defined(__x86_64__) || defined(__i386__)
+  #if defined(__GNUC__) || defined(__clang__)
+    // Also checks that the OS saves the AVX and AVX-512 registers.
+    __builtin_cpu_init();
+    features.sse2 = __builtin_cpu_supports("sse2");
+    features.sse41 = __builtin_cpu_supports("sse4.1");
+    features.pclmul = __builtin_cpu_supports("pclmul");
+    features.avx2 = __builtin_cpu_supports("avx2");
+    features.avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+  #endif
+#elif defined(_M_X64)
+  // Only the baseline is used with MSVC, which cannot compile the wider variants next to it.
+  features.sse2 = true;
+#elif defined(__ARM_NEON)
+  features.neon = true;
+#endif
+
+  return features;
+}
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<SIMDKernel> kernels;
+};
+
+// Kernels are selected during static initialization, so the registry must be constructed on first use.
+auto GetRegistry() -> Registry& {
+  static Registry registry;
+
+  return registry;
+}
+
+} // namespace
+
+auto GetSIMDLevelName(SIMDLevel level) -> char const* {
+  switch (level) {
+    case SIMDLevel::SSE2: return "SSE2";
+    case SIMDLevel::SSE41: return "SSE4.1";
+    case SIMDLevel::AVX2: return "AVX2";
+    case SIMDLevel::AVX512: return "AVX-512";
+    case SIMDLevel::NEON: return "NEON";
+    default: return "scalar";
+  }
+}
+
+bool CPUFeatures::Supports(SIMDLevel level) const {
+  switch (level) {
+    case SIMDLevel::SSE2: return sse2;
+    case SIMDLevel::SSE41: return sse41;
+    case SIMDLevel::AVX2: return avx2;
+    case SIMDLevel::AVX512: return avx512;
+    case SIMDLevel::NEON: return neon;
+    default: return true;
+  }
+}
+
+auto GetCPUFeatures() -> CPUFeatures const& {
+  static auto const features = DetectCPUFeatures();
+
+  return features;
+}
+
+auto GetSIMDKernels() -> std::vector<SIMDKernel> {
+  auto& registry = GetRegistry();
+  std::lock_guard lock{registry.mutex};
+
+  return registry.kernels;
+}
+
+namespace detail {
+
+void RegisterSIMDKernel(char const* name, SIMDLevel level) {
+  auto& registry = GetRegistry();
+  std::lock_guard lock{registry.mutex};
+
+  auto& kernels = registry.kernels;
+  auto match = std::find_if(kernels.begin(), kernels.end(), [&](SIMDKernel const& kernel) {
+    return std::string_view{kernel.name} == name;
+  });
+
+  if (match != kernels.end()) {
+    match->level = level;
+  } else {
+    kernels.push_back({name, level});
+  }
+}
+
+} // namespace nba::detail
+
+} // namespace nba
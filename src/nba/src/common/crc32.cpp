@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <nba/common/cpu_dispatch.hpp>
+#include <nba/common/crc32.hpp>
+#include <nba/common/punning.hpp>
+
+#if defined(__x86_64__) || defined(_M_X64)
+  #if defined(__GNUC__) || defined(__clang__)
+    #define NBA_CRC32_PCLMUL
+    #include <immintrin.h>
+  #endif
+#elif defined(__ARM_FEATURE_CRC32)
+  #define NBA_CRC32_ARM
+  #include <arm_acle.h>
+#endif
+
+namespace nba::detail {
+
+namespace {
+
+// kSlicingTables[n][i] is the CRC32 of byte i followed by n zero bytes.
+constexpr auto kSlicingTables = []() {
+  std::array<std::array<u32, 256>, 8> tables{};
+
+  tables[0] = kCRC32Table;
+
+  for (int n = 1; n < 8; n++) {
+    for (int i = 0; i < 256; i++) {
+      tables[n][i] = (tables[n - 1][i] >> 8) ^ kCRC32Table[tables[n - 1][i] & 0xFF];
+    }
+  }
+
+  return tables;
+}();
+
+// Consumes eight bytes per round, with one lookup per byte into independent tables.
+auto UpdateSlicingBy8(u32 crc32, u8 const* data, size_t length) -> u32 {
+  auto& t = kSlicingTables;
+
+  while (length >= 8) {
+    u32 lo = read<u32>(data, 0) ^ crc32;
+    u32 hi = read<u32>(data, 4);
+
+    crc32 = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+            t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    data += 8;
+    length -= 8;
+  }
+
+  while (length-- != 0) {
+    crc32 = CRC32Update(crc32, *data++);
+  }
+
+  return crc32;
+}
+
+#if defined(NBA_CRC32_PCLMUL)
+
+__attribute__((target("sse4.1,pclmul")))
+auto Fold128(__m128i x, __m128i k, __m128i y) -> __m128i {
+  return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)), y);
+}
+
+__attribute__((target("sse4.1,pclmul")))
+auto Load128(u8 const* address) -> __m128i {
+  return _mm_loadu_si128((__m128i const*)address);
+}
+
+/* Folds 64 bytes per round with carry-less multiplication, then reduces the result to 32 bits
+ * with a Barrett reduction. The constants are the bit-reflected ones from Intel's paper
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+ * Needs at least 64 bytes and a multiple of 16 bytes.
+ */
+__attribute__((target("sse4.1,pclmul")))
+auto FoldPCLMUL(u32 crc32, u8 const* data, size_t length) -> u32 {
+  alignas(16) static constexpr u64 k1k2[] { 0x0154442BD4, 0x01C6E41596 };
+  alignas(16) static constexpr u64 k3k4[] { 0x01751997D0, 0x00CCAA009E };
+  alignas(16) static constexpr u64 k5k0[] { 0x0163CD6124, 0x0000000000 };
+  alignas(16) static constexpr u64 poly[] { 0x01DB710641, 0x01F7011641 };
+
+  __m128i x1 = _mm_xor_si128(Load128(data + 0x00), _mm_cvtsi32_si128((int)crc32));
+  __m128i x2 = Load128(data + 0x10);
+  __m128i x3 = Load128(data + 0x20);
+  __m128i x4 = Load128(data + 0x30);
+  __m128i k = _mm_load_si128((__m128i const*)k1k2);
+
+  data += 64;
+  length -= 64;
+
+  // Fold four streams of 16 bytes in parallel.
+  while (length >= 64) {
+    x1 = Fold128(x1, k, Load128(data + 0x00));
+    x2 = Fold128(x2, k, Load128(data + 0x10));
+    x3 = Fold128(x3, k, Load128(data + 0x20));
+    x4 = Fold128(x4, k, Load128(data + 0x30));
+    data += 64;
+    length -= 64;
+  }
+
+  // Fold the four streams into one, and that over the remaining blocks of 16 bytes.
+  k = _mm_load_si128((__m128i const*)k3k4);
+  x1 = Fold128(x1, k, x2);
+  x1 = Fold128(x1, k, x3);
+  x1 = Fold128(x1, k, x4);
+
+  while (length >= 16) {
+    x1 = Fold128(x1, k, Load128(data));
+    data += 16;
+    length -= 16;
+  }
+
+  // Fold 128 bits to 64 bits.
+  __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+
+  x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+  k = _mm_loadl_epi64((__m128i const*)k5k0);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x00), x2);
+
+  // Barrett reduction to 32 bits.
+  k = _mm_load_si128((__m128i const*)poly);
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x10);
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), k, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return (u32)_mm_extract_epi32(x1, 1);
+}
+
+auto UpdatePCLMUL(u32 crc32, u8 const* data, size_t length) -> u32 {
+  if (length >= 64) {
+    size_t folded = length & ~size_t(15);
+
+    crc32 = FoldPCLMUL(crc32, data, folded);
+    data += folded;
+    length -= folded;
+  }
+
+  return UpdateSlicingBy8(crc32, data, length);
+}
+
+#elif defined(NBA_CRC32_ARM)
+
+auto UpdateARM(u32 crc32, u8 const* data, size_t length) -> u32 {
+  while (length >= 8) {
+    crc32 = __crc32d(crc32, read<u64>(data, 0));
+    data += 8;
+    length -= 8;
+  }
+
+  while (length-- != 0) {
+    crc32 = __crc32b(crc32, *data++);
+  }
+
+  return crc32;
+}
+
+#endif
+
+auto SelectCRC32Update() -> u32 (*)(u32, u8 const*, size_t) {
+  return SelectKernel<u32 (*)(u32, u8 const*, size_t)>("CRC32", {
+#if defined(NBA_CRC32_PCLMUL)
+    { SIMDLevel::SSE41, UpdatePCLMUL, GetCPUFeatures().pclmul },
+#elif defined(NBA_CRC32_ARM)
+    { SIMDLevel::NEON, UpdateARM },
+#endif
+    { SIMDLevel::Scalar, UpdateSlicingBy8 }
+  });
+}
+
+} // namespace
+
+auto CRC32UpdateBlock(u32 crc32, u8 const* data, size_t length) -> u32 {
+  // Selected on first use, since the CRC32 may already be needed during static initialization.
+  static auto const update = SelectCRC32Update();
+
+  return update(crc32, data, length);
+}
+
+} // namespace nba::detail
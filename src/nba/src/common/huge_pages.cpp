@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <nba/common/huge_pages.hpp>
+#include <nba/integer.hpp>
+#include <nba/log.hpp>
+
+#if defined(_WIN32)
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX
+  #include <windows.h>
+#else
+  #include <sys/mman.h>
+#endif
+
+namespace nba {
+
+namespace {
+
+std::atomic_bool g_warned_unavailable{false};
+
+void WarnUnavailable(char const* reason) {
+  if (!g_warned_unavailable.exchange(true)) {
+    Log<Warn>("AllocatePages: huge pages are not available, using normal pages instead ({}).", reason);
+  }
+}
+
+#if defined(_WIN32)
+
+// Large pages can only be allocated with SeLockMemoryPrivilege, which the process must be granted by policy and then enable.
+bool EnableLockMemoryPrivilege() {
+  static const bool enabled = []() {
+    HANDLE token;
+
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+      return false;
+    }
+
+    TOKEN_PRIVILEGES privileges{};
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+    bool success = LookupPrivilegeValueW(nullptr, L"SeLockMemoryPrivilege", &privileges.Privileges[0].Luid) &&
+                   AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) &&
+                   GetLastError() == ERROR_SUCCESS;
+
+    CloseHandle(token);
+    return success;
+  }();
+
+  return enabled;
+}
+
+#else
+
+// Rounding to the huge page size either way means that FreePages() does not need to know how the memory was mapped.
+constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+auto GetMappingSize(size_t size) -> size_t {
+  return (size + kHugePageSize - 1) & ~(kHugePageSize - 1);
+}
+
+auto Map(size_t size, int flags = 0) -> u8* {
+  void* pointer = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+
+  return pointer != MAP_FAILED ? (u8*)pointer : nullptr;
+}
+
+#endif
+
+} // namespace
+
+auto AllocatePages(size_t size, bool huge_pages) -> void* {
+#if defined(_WIN32)
+  if (huge_pages) {
+    size_t large_page_size = GetLargePageMinimum();
+
+    if (large_page_size != 0 && EnableLockMemoryPrivilege()) {
+      size_t large_size = (size + large_page_size - 1) & ~(large_page_size - 1);
+      void* pointer = VirtualAlloc(nullptr, large_size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+
+      if (pointer != nullptr) {
+        return pointer;
+      }
+      WarnUnavailable("VirtualAlloc with MEM_LARGE_PAGES failed");
+    } else {
+      WarnUnavailable("SeLockMemoryPrivilege is not held");
+    }
+  }
+
+  return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+  size = GetMappingSize(size);
+
+  if (!huge_pages) {
+    return Map(size);
+  }
+
+#if defined(__linux__)
+  // Pages from the hugetlbfs pool are guaranteed, but the pool is empty unless the administrator reserved it.
+  #if defined(MAP_HUGETLB) && defined(MAP_HUGE_2MB)
+    if (auto pointer = Map(size, MAP_HUGETLB | MAP_HUGE_2MB)) {
+      return pointer;
+    }
+  #endif
+
+  // Otherwise ask for transparent huge pages, which need a mapping that is aligned to the huge page size.
+  auto pointer = Map(size + kHugePageSize);
+  if (pointer == nullptr) {
+    return nullptr;
+  }
+
+  auto aligned = (u8*)(((uintptr_t)pointer + kHugePageSize - 1) & ~(uintptr_t)(kHugePageSize - 1));
+  auto head = (size_t)(aligned - pointer);
+
+  if (head != 0) {
+    munmap(pointer, head);
+  }
+  munmap(aligned + size, kHugePageSize - head);
+
+  if (madvise(aligned, size, MADV_HUGEPAGE) != 0) {
+    WarnUnavailable("transparent huge pages are disabled");
+  }
+  return aligned;
+#else
+  WarnUnavailable("not supported on this platform");
+  return Map(size);
+#endif
+#endif
+}
+
+void FreePages(void* pointer, size_t size) {
+  if (pointer == nullptr) {
+    return;
+  }
+
+#if defined(_WIN32)
+  VirtualFree(pointer, 0, MEM_RELEASE);
+#else
+  munmap(pointer, GetMappingSize(size));
+#endif
+}
+
+} // namespace nba
@@ -5,7 +5,15 @@
  * Refer to the included LICENSE file.
  */
 
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <nba/allocation_tracker.hpp>
 #include <nba/common/crc32.hpp>
+#include <nba/common/hash.hpp>
+#include <nba/common/huge_pages.hpp>
+#include <nba/common/parallel_search.hpp>
+#include <nba/trace.hpp>
 
 #include "hw/rom/gpio/rtc.hpp"
 #include "core.hpp"
@@ -14,22 +22,85 @@ namespace nba {
 
 namespace core {
 
+namespace {
+
+/* Returns a copy of the ROM image in huge pages. Cores that attach the same image (i.e. the cores of a batch,
+ * or a core and its clones) share one copy for as long as any of them holds it.
+ */
+auto GetHugePageImage(ROM::Image const& image) -> ROM::Image {
+  struct Entry {
+    std::weak_ptr<ROMImage const> source;
+    std::weak_ptr<ROMImage const> copy;
+  };
+
+  static std::mutex mutex;
+  static std::vector<Entry> entries;
+
+  std::lock_guard lock{mutex};
+
+  entries.erase(std::remove_if(entries.begin(), entries.end(), [](Entry const& entry) {
+    return entry.copy.expired();
+  }), entries.end());
+
+  for (auto const& entry : entries) {
+    auto copy = entry.copy.lock();
+
+    if (copy == image || entry.source.lock() == image) {
+      return copy;
+    }
+  }
+
+  auto size = image->size();
+  auto base = (u8*)AllocatePages(size, true);
+
+  if (base == nullptr) {
+    return image;
+  }
+
+  std::copy_n(image->data(), size, base);
+
+  auto copy = std::make_shared<ROMImage const>(base, size, [base, size]() {
+    FreePages(base, size);
+  });
+
+  entries.push_back({image, copy});
+  return copy;
+}
+
+} // namespace
+
 Core::Core(std::shared_ptr<Config> config)
     : config(config)
     , cpu(scheduler, bus)
     , irq(cpu, scheduler)
     , dma(bus, irq, scheduler)
     , apu(scheduler, dma, bus, config)
-    , ppu(scheduler, irq, dma, config)
+    , ppu(scheduler, irq, dma, dirty_tracker, config)
     , timer(scheduler, irq, apu)
-    , keypad(irq, config)
-    , bus(scheduler, {cpu, irq, dma, apu, ppu, timer, keypad}) {
+    , keypad(scheduler, irq, config)
+    , sio(scheduler, irq)
+    , bus(scheduler, dirty_tracker, {cpu, irq, dma, apu, ppu, timer, keypad, sio}) {
+#if defined(NBA_HOTSPOT_SAMPLER)
+  scheduler.RegisterSampler<&Core::OnHotspotSample>(this);
+#endif
   Reset();
 }
 
+Core::~Core() {
+  // The audio threads may still read from the ROM, which is destroyed before the APU.
+  apu.WaitForThreads();
+}
+
 void Core::Reset() {
+  using Backend = Config::CPU::Backend;
+
+  cpu.block_cache.SetEnabled(turbo || GetCPUBackend() == Backend::CachedInterpreter);
   scheduler.Reset();
   cpu.Reset();
+  cpu.SetIdleLoopTargets(hints.idle_loops, GameHints::kMaxIdleLoops);
+  cpu.bios_hle.SetEnabled(config->cpu.hle_bios);
+  cpu.bios_hle.SetFunctionMask(hints.hle_bios_functions != 0 ? hints.hle_bios_functions : ~0ULL);
+  bus.SetAccuracyProfile(config->cpu.accuracy_profile);
   irq.Reset();
   dma.Reset();
   timer.Reset();
@@ -37,6 +108,10 @@ void Core::Reset() {
   ppu.Reset();
   bus.Reset();
   keypad.Reset();
+  sio.Reset();
+  dirty_tracker.MarkAll();
+  idle_loop = false;
+  SetTurbo(turbo);
 
   if (config->skip_bios) {
     SkipBootScreen();
@@ -44,51 +119,575 @@ void Core::Reset() {
 
   if (config->audio.mp2k_hle_enable) {
     apu.GetMP2K().UseCubicFilter() = config->audio.mp2k_hle_cubic;
-    hle_audio_hook = SearchSoundMainRAM();
+    // The ROM only changes on Attach(), so the search result is kept across resets.
+    if (!sound_main_ram_searched) {
+      sound_main_ram = hints.mp2k_sound_main_ram != 0 ? hints.mp2k_sound_main_ram : SearchSoundMainRAM();
+      sound_main_ram_searched = true;
+    }
+    hle_audio_hook = sound_main_ram;
     if (hle_audio_hook != 0xFFFFFFFF) {
       Log<Info>("Core: detected MP2K audio mixer @ 0x{:08X}", hle_audio_hook);
     }
   } else {
     hle_audio_hook = 0xFFFFFFFF;
   }
+
+  if (hle_audio_hook != 0xFFFFFFFF) {
+    cpu.SetBreakpoint<&Core::OnSoundMainRAM>(hle_audio_hook, this);
+  } else {
+    cpu.ClearBreakpoint();
+  }
+
+  sound_info_pointer = bus.GetHostAddress<u32>(0x0300'7FF0);
+  sound_info_address = 0xFFFFFFFF;
+  sound_info = nullptr;
+
+#if defined(NBA_ALLOCATION_TRACKER)
+  allocation_check_frame = ppu.GetFrameCount() + kAllocationWarmUpFrames;
+#endif
 }
 
 void Core::Attach(std::vector<u8> const& bios) {
   bus.Attach(bios);
 }
 
+auto Core::operator new(size_t size) -> void* {
+  return operator new(size, false);
+}
+
+auto Core::operator new(size_t size, bool huge_pages) -> void* {
+  if (auto pointer = AllocatePages(size, huge_pages)) {
+    return pointer;
+  }
+  throw std::bad_alloc{};
+}
+
+void Core::operator delete(void* pointer, size_t size) {
+  FreePages(pointer, size);
+}
+
+void Core::operator delete(void* pointer, bool huge_pages) {
+  FreePages(pointer, sizeof(Core));
+}
+
 void Core::Attach(ROM&& rom) {
+  if (config->huge_pages) {
+    rom.SetImage(GetHugePageImage(rom.GetImage()));
+  }
+
+  apu.WaitForThreads();
   bus.Attach(std::move(rom));
+  cpu.block_cache.Flush();
+  sound_main_ram_searched = false;
+  hints = {};
+}
+
+void Core::SetGameHints(GameHints const& hints) {
+  this->hints = hints;
+  sound_main_ram_searched = false;
+}
+
+auto Core::GetCPUBackend() const -> Config::CPU::Backend {
+  // Breakpoints are compiled into the blocks of the cached interpreter.
+  if (!breakpoints.empty()) {
+    return Config::CPU::Backend::CachedInterpreter;
+  }
+  return hints.cpu_backend.value_or(config->cpu.backend);
 }
 
 auto Core::CreateRTC() -> std::unique_ptr<GPIO> {
-  return std::make_unique<RTC>(irq);
+  return std::make_unique<RTC>(irq, scheduler, config);
 }
 
 void Core::Run(int cycles) {
+  NBA_TRACE_ZONE("Core::Run");
+  NBA_ALLOCATION_CHECK("Core::Run", ppu.GetFrameCount() >= allocation_check_frame);
+
+  keypad.ProcessInput();
+  keypad.PollMovieInput();
+  RunUntil(scheduler.GetTimestampNow() + cycles, false);
+}
+
+auto Core::RunSlice(RunLimits const& limits) -> RunResult {
+  NBA_TRACE_ZONE("Core::RunSlice");
+  NBA_ALLOCATION_CHECK("Core::RunSlice", ppu.GetFrameCount() >= allocation_check_frame);
+
+  auto start = scheduler.GetTimestampNow();
+  auto end = start + std::max(limits.max_cycles, 0);
+  auto idle_start = idle_cycles;
+  auto stop = RunResult::Stop::Cycles;
+
+  keypad.ProcessInput();
+  keypad.PollMovieInput();
+
+  while (scheduler.GetTimestampNow() < end) {
+    auto limit = std::min(end, scheduler.GetTimestampNow() + kDeadlineCheckInterval);
+
+    if (RunUntil(limit, limits.stop_at_frame_end || stop_requested)) {
+      stop_requested = false;
+      stop = RunResult::Stop::FrameEnd;
+      break;
+    }
+
+    if (cpu.GetRunLimit() != limit) {
+      stop = cpu.IsStoppedAtBreakpoint() ? RunResult::Stop::Breakpoint : RunResult::Stop::Watchpoint;
+      break;
+    }
+
+    if (std::chrono::steady_clock::now() >= limits.deadline) {
+      stop = RunResult::Stop::Deadline;
+      break;
+    }
+  }
+
+  return {stop, scheduler.GetTimestampNow() - start, idle_cycles - idle_start};
+}
+
+auto Core::GetActivity() -> Activity {
+  if (bus.hw.haltcnt != Bus::Hardware::HaltControl::Run) {
+    return IsWaitingForInput() ? Activity::WaitingForInput : Activity::Halted;
+  }
+  return idle_loop ? Activity::IdleLoop : Activity::Running;
+}
+
+/* STOP is only left by an external interrupt. In HALT, the CPU may also only be waiting for the keypad,
+ * i.e. on a sleep or pause screen. Interrupts from a movie are scheduled like any other event, so those do not count.
+ */
+bool Core::IsWaitingForInput() const {
   using HaltControl = Bus::Hardware::HaltControl;
 
-  auto limit = scheduler.GetTimestampNow() + cycles;
+  if (keypad.IsPlayingMovie()) {
+    return false;
+  }
+
+  if (bus.hw.haltcnt == HaltControl::Stop) {
+    return !irq.HasServableIRQ(IRQ::kMaskSerial | IRQ::kMaskKeypad | IRQ::kMaskROM);
+  }
+
+  return !irq.HasServableIRQ() && (irq.GetEnabledIRQs() & ~(IRQ::kMaskKeypad | IRQ::kMaskROM)) == 0;
+}
 
-  while (scheduler.GetTimestampNow() < limit) {
+bool Core::WaitForInput(std::chrono::steady_clock::time_point deadline) {
+  return keypad.WaitForInput(deadline);
+}
+
+void Core::CancelWaitForInput() {
+  keypad.CancelWaitForInput();
+}
+
+/* Returns true if it stopped because V-blank started. A watchpoint may lower the limit to stop at the next instruction boundary,
+ * a breakpoint to stop in front of the instruction that has it.
+ */
+bool Core::RunUntil(u64 limit, bool stop_at_frame_end) {
+  using HaltControl = Bus::Hardware::HaltControl;
+
+  auto frame = ppu.GetFrameCount();
+
+  cpu.SetRunLimit(limit);
+
+  // Finish the instruction that a breakpoint stopped in front of.
+  cpu.ResumeBreakpoint();
+
+  while (scheduler.GetTimestampNow() < cpu.GetRunLimit()) {
     if (bus.hw.haltcnt == HaltControl::Halt && irq.HasServableIRQ()) {
       bus.hw.haltcnt = HaltControl::Run;
     }
 
+    // Only the serial port, the keypad and the cartridge can wake the system from STOP.
+    if (bus.hw.haltcnt == HaltControl::Stop && irq.HasServableIRQ(IRQ::kMaskSerial | IRQ::kMaskKeypad | IRQ::kMaskROM)) {
+      bus.hw.haltcnt = HaltControl::Run;
+    }
+
     if (bus.hw.haltcnt == HaltControl::Run) {
-      if (cpu.state.r15 == hle_audio_hook) {
-        // TODO: cache the SoundInfo pointer once we have it?
-        apu.GetMP2K().SoundMainRAM(
-          *bus.GetHostAddress<MP2K::SoundInfo>(
-            *bus.GetHostAddress<u32>(0x0300'7FF0)
-          )
-        );
+      {
+        NBA_PROFILE_SCOPE(scheduler, CPU);
+        cpu.Run();
+      }
+
+      idle_loop = cpu.ConsumeIdleLoop();
+
+      if (unlikely(idle_loop)) {
+        NBA_PROFILE_SCOPE(scheduler, Halted);
+        auto cycles = scheduler.GetRemainingCycleCount();
+        idle_cycles += cycles;
+        bus.Step(cycles);
       }
-      cpu.Run();
     } else {
-      bus.Step(scheduler.GetRemainingCycleCount());
+      NBA_PROFILE_SCOPE(scheduler, Halted);
+      auto cycles = scheduler.GetRemainingCycleCount();
+      idle_cycles += cycles;
+      bus.Step(cycles);
+    }
+
+#if defined(NBA_PROFILER)
+    scheduler.GetProfiler().Update(scheduler.GetTimestampNow());
+#endif
+
+    if (stop_at_frame_end && ppu.GetFrameCount() != frame) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool Core::LoadState(SaveState const& state) {
+  if (state.magic != SaveState::kMagicNumber || state.version != SaveState::kCurrentVersion) {
+    Log<Error>("Core: save state has an unsupported format (version {}).", state.version);
+    return false;
+  }
+
+  if (!scheduler.ValidateState(state) ||
+      !DMA::ValidateState(state) ||
+      !Timer::ValidateState(state) ||
+      !APU::ValidateState(state)) {
+    Log<Error>("Core: save state contains out-of-range fields.");
+    return false;
+  }
+
+  // The scheduler goes first, since the other components look up their pending events.
+  scheduler.LoadState(state);
+  cpu.LoadState(state);
+  irq.LoadState(state);
+  dma.LoadState(state);
+  timer.LoadState(state);
+  apu.LoadState(state);
+  ppu.LoadState(state);
+  bus.LoadState(state);
+  keypad.LoadState(state);
+  sio.LoadState(state);
+  dirty_tracker.MarkAll();
+  return true;
+}
+
+void Core::CopyState(SaveState& state) {
+  state.magic = SaveState::kMagicNumber;
+  state.version = SaveState::kCurrentVersion;
+
+  scheduler.CopyState(state);
+  cpu.CopyState(state);
+  irq.CopyState(state);
+  dma.CopyState(state);
+  timer.CopyState(state);
+  apu.CopyState(state);
+  ppu.CopyState(state);
+  bus.CopyState(state);
+  keypad.CopyState(state);
+  sio.CopyState(state);
+}
+
+auto Core::GetDirtyPages(u64 token, DirtyPages& pages) -> u64 {
+  return dirty_tracker.Collect(token, pages);
+}
+
+auto Core::GetStateHash() -> u64 {
+  using Region = DirtyPages::Region;
+
+  u8 const* regions[DirtyPages::kRegionCount] {
+    bus.memory.wram.data(), bus.memory.iram.data(), ppu.GetPRAM(), ppu.GetVRAM(), ppu.GetOAM()
+  };
+
+  // Guest RAM is hashed in place, and only the pages that were written since the last call.
+  state_hash_token = dirty_tracker.Collect(state_hash_token, state_hash_pages);
+
+  for (int i = 0; i < DirtyPages::kRegionCount; i++) {
+    auto first_page = DirtyPages::kFirstPage[i];
+    auto page_count = DirtyPages::kFirstPage[i + 1] - first_page;
+
+    for (int page = 0; page < page_count; page++) {
+      if (state_hash_pages.Test((Region)i, page * DirtyPages::kPageSize)) {
+        page_hashes[first_page + page] = hash64(regions[i] + page * DirtyPages::kPageSize, DirtyPages::kPageSize);
+      }
     }
   }
+
+  /* The rest of the state is spread over all components, so it is hashed from a snapshot that leaves out the memory.
+   * Each part is zeroed before it is copied, so that the padding always hashes the same.
+   */
+  if (!state_hash_state) {
+    state_hash_state = std::make_unique<SaveState>();
+  }
+
+  auto& state = *state_hash_state;
+  auto hash = hash64(page_hashes, sizeof(page_hashes));
+
+  auto clear = [](auto& part) {
+    std::memset(&part, 0, sizeof(part));
+  };
+
+  auto combine = [&](auto const& part) {
+    hash = hash64(&part, sizeof(part), hash);
+  };
+
+  clear(state.arm);
+  clear(state.bus.memory.latch);
+  clear(state.bus.io);
+  clear(state.bus.prefetch);
+  clear(state.bus.dma);
+  clear(state.irq);
+  clear(state.ppu.io);
+  clear(state.apu);
+  clear(state.dma);
+  clear(state.timer);
+  clear(state.keypad);
+  clear(state.sio);
+  clear(state.scheduler);
+
+  scheduler.CopyState(state);
+  cpu.CopyState(state);
+  irq.CopyState(state);
+  dma.CopyState(state);
+  timer.CopyState(state);
+  apu.CopyState(state);
+  ppu.CopyIOState(state);
+  bus.CopyIOState(state);
+  keypad.CopyState(state);
+  sio.CopyState(state);
+
+  combine(state.timestamp);
+  combine(state.arm);
+  combine(state.bus.memory.latch);
+  combine(state.bus.io);
+  combine(state.bus.prefetch);
+  combine(state.bus.dma);
+  combine(state.irq);
+  combine(state.ppu.io);
+  combine(state.apu);
+  combine(state.dma);
+  combine(state.timer);
+  combine(state.keypad);
+  combine(state.sio);
+  combine(state.scheduler);
+  return hash;
+}
+
+auto Core::Clone() -> std::unique_ptr<CoreBase> {
+  /* The clone must not take over the devices (i.e. the audio device is opened on reset),
+   * nor feed the audio sink or the latency probe of this core, which each expect a single producer.
+   * on_thread_start is kept on purpose, so that the threads of the clone get the same scheduling policy.
+   */
+  auto clone_config = std::make_shared<Config>(*config);
+  auto defaults = Config{};
+
+  clone_config->audio_dev = defaults.audio_dev;
+  clone_config->input_dev = defaults.input_dev;
+  clone_config->video_dev = defaults.video_dev;
+  clone_config->audio_sink = nullptr;
+  clone_config->latency_probe = nullptr;
+
+  auto clone = std::unique_ptr<Core>{new (config->huge_pages) Core(clone_config)};
+  auto gpio = bus.memory.rom.HasGPIO() ? clone->CreateRTC() : nullptr;
+
+  clone->bus.memory.bios = bus.memory.bios;
+  clone->Attach(bus.memory.rom.Clone(std::move(gpio)));
+
+  clone->hints = hints;
+  // Skip searching the ROM for the MP2K mixer again.
+  clone->sound_main_ram = sound_main_ram;
+  clone->sound_main_ram_searched = sound_main_ram_searched;
+  clone->turbo = turbo;
+  clone->Reset();
+  clone->SetFrameSkip(GetFrameSkip());
+
+  auto state = std::make_unique<SaveState>();
+
+  CopyState(*state);
+  clone->LoadState(*state);
+  return clone;
+}
+
+void Core::SetVideoOutputEnabled(bool enabled) {
+  ppu.SetVideoOutputEnabled(enabled);
+}
+
+void Core::SetAudioOutputEnabled(bool enabled) {
+  apu.SetAudioOutputEnabled(enabled);
+}
+
+auto Core::GetAudioBufferLevel() -> float {
+  return apu.GetBufferLevel();
+}
+
+auto Core::GetAudioStats() -> AudioStats {
+  return {
+    apu.GetBufferLevel(),
+    apu.callback_underruns.load(std::memory_order_relaxed),
+    apu.GetRateAdjustment(),
+    apu.GetOutputLatency()
+  };
+}
+
+void Core::SetEmulationSpeed(float speed) {
+  apu.SetEmulationSpeed(speed);
+}
+
+void Core::SetTurbo(bool enabled) {
+  using Backend = Config::CPU::Backend;
+
+  turbo = enabled;
+  cpu.SetCachedInterpreter(enabled || GetCPUBackend() == Backend::CachedInterpreter);
+  cpu.SetIdleLoopDetection(enabled || config->cpu.idle_loop_skip);
+  apu.SetBatchMixing(enabled || config->audio.batch_mixing);
+}
+
+auto Core::GetProfileStats() -> ProfileStats {
+#if defined(NBA_PROFILER)
+  return scheduler.GetProfiler().GetStats();
+#else
+  return {};
+#endif
+}
+
+auto Core::GetMemoryUsage() -> MemoryUsage {
+  return {
+    sizeof(Core),
+    ppu.GetOutputMemoryUsage() + apu.GetBufferMemoryUsage() + cpu.block_cache.GetMemoryUsage(),
+    bus.memory.rom.GetRawROM().size()
+  };
+}
+
+void Core::SetHotspotSampling(int interval) {
+#if defined(NBA_HOTSPOT_SAMPLER)
+  scheduler.SetSampleInterval(interval);
+#endif
+}
+
+void Core::ReadHotspotSamples(std::vector<HotspotSample>& samples) {
+#if defined(NBA_HOTSPOT_SAMPLER)
+  for (int i = hotspot_samples.Available(); i > 0; i--) {
+    samples.push_back(hotspot_samples.Read());
+  }
+#endif
+}
+
+#if defined(NBA_HOTSPOT_SAMPLER)
+void Core::OnHotspotSample() {
+  using HaltControl = Bus::Hardware::HaltControl;
+
+  auto& state = cpu.state;
+  bool thumb = state.cpsr.f.thumb;
+
+  hotspot_samples.Write({
+    state.r15 - (thumb ? 4 : 8),
+    u8(state.cpsr.f.mode),
+    thumb,
+    bus.hw.haltcnt != HaltControl::Run
+  });
+}
+#endif
+
+auto Core::AddWatchpoint(u32 address, u32 size, int kinds) -> int {
+  return bus.AddWatchpoint(address, size, kinds);
+}
+
+void Core::RemoveWatchpoint(int id) {
+  bus.RemoveWatchpoint(id);
+}
+
+void Core::SetWatchpointCallback(Watchpoint::Callback callback) {
+  bus.watchpoints.callback = callback;
+}
+
+void Core::AddBreakpoint(u32 address) {
+  if (std::find(breakpoints.begin(), breakpoints.end(), address) == breakpoints.end()) {
+    breakpoints.push_back(address);
+    cpu.SetDebugBreakpoints(breakpoints);
+    SetTurbo(turbo);
+  }
+}
+
+void Core::RemoveBreakpoint(u32 address) {
+  auto match = std::find(breakpoints.begin(), breakpoints.end(), address);
+
+  if (match != breakpoints.end()) {
+    breakpoints.erase(match);
+    cpu.SetDebugBreakpoints(breakpoints);
+    SetTurbo(turbo);
+  }
+}
+
+void Core::StepInstruction() {
+  if (!cpu.ResumeBreakpoint()) {
+    RunUntil(scheduler.GetTimestampNow() + 1, false);
+
+    // A breakpoint on the stepped instruction stops it before it is executed.
+    cpu.ResumeBreakpoint();
+  }
+}
+
+auto Core::GetCPURegisters() -> CPURegisters {
+  CPURegisters registers;
+
+  cpu.GetDebugRegisters(registers.reg, registers.cpsr);
+  return registers;
+}
+
+void Core::SetCPURegisters(CPURegisters const& registers) {
+  cpu.SetDebugRegisters(registers.reg, registers.cpsr);
+}
+
+auto Core::DebugRead(u32 address) -> u8 {
+  return bus.DebugRead(address);
+}
+
+void Core::DebugWrite(u32 address, u8 value) {
+  bus.DebugWrite(address, value);
+}
+
+void Core::SetInstructionTrace(int capacity) {
+#if defined(NBA_INSTRUCTION_TRACE)
+  cpu.SetInstructionTrace(capacity);
+#endif
+}
+
+bool Core::DumpInstructionTrace(std::string const& path) {
+#if defined(NBA_INSTRUCTION_TRACE)
+  return cpu.DumpInstructionTrace(path);
+#else
+  return false;
+#endif
+}
+
+bool Core::ConnectLinkCable(std::shared_ptr<LinkCable> cable, int player) {
+  return sio.Connect(cable, player);
+}
+
+void Core::DisconnectLinkCable() {
+  sio.Disconnect();
+}
+
+auto Core::GetBootID() -> u64 {
+  static constexpr int kHeaderSize = 0xC0;
+
+  auto& bios = bus.memory.bios;
+  auto& rom = bus.memory.rom.GetRawROM();
+  u32 header_crc32 = 0;
+
+  if (rom.size() >= kHeaderSize) {
+    header_crc32 = crc32(rom.data(), kHeaderSize);
+  }
+
+  return (u64(crc32(bios.data(), bios.size())) << 32) | header_crc32;
+}
+
+auto Core::GetFrameSkip() const -> int {
+  return ppu.GetFrameSkip();
+}
+
+void Core::SetFrameSkip(int frames) {
+  ppu.SetFrameSkip(frames);
+}
+
+void Core::StartMovieRecording(std::shared_ptr<InputMovie> movie) {
+  keypad.StartMovieRecording(movie);
+}
+
+void Core::StartMoviePlayback(std::shared_ptr<InputMovie const> movie) {
+  keypad.StartMoviePlayback(movie);
+}
+
+void Core::StopMovie() {
+  keypad.StopMovie();
 }
 
 void Core::SkipBootScreen() {
@@ -111,26 +710,56 @@ auto Core::SearchSoundMainRAM() -> u32 {
 
   u32 address_max = rom.size() - kSoundMainLength;
 
-  for (u32 address = 0; address <= address_max; address += sizeof(u16)) {
-    auto crc = crc32(&rom[address], kSoundMainLength);
-
-    if (crc == kSoundMainCRC32) {
-      /* We have found SoundMain().
-       * The pointer to SoundMainRAM() is stored at offset 0x74.
-       */
-      address = read<u32>(rom.data(), address + 0x74);
-      if (address & 1) {
-        address &= ~1;
-        address += sizeof(u16) * 2;
-      } else {
-        address &= ~3;
-        address += sizeof(u32) * 2;
+  /* Slide a rolling CRC32 over the ROM, so that each offset costs one table lookup
+   * instead of a CRC32 over the whole window. A match is confirmed with a regular CRC32.
+   * The ROM is split into chunks which are searched on separate threads.
+   */
+  auto match = ParallelSearch(address_max + 1, [&](size_t begin, size_t end) -> s64 {
+    RollingCRC32 rolling_crc{kSoundMainLength};
+
+    rolling_crc.Reset(&rom[begin]);
+
+    for (size_t address = begin; address < end; address++) {
+      if (address != begin) {
+        rolling_crc.Roll(rom[address - 1], rom[address + kSoundMainLength - 1]);
+      }
+
+      if ((address & 1) == 0 && rolling_crc.Get() == kSoundMainCRC32 &&
+          crc32(&rom[address], kSoundMainLength) == kSoundMainCRC32) {
+        return address;
       }
-      return address;
     }
+    return -1;
+  });
+
+  if (match == -1) {
+    return 0xFFFFFFFF;
   }
 
-  return 0xFFFFFFFF;
+  /* We have found SoundMain().
+   * The pointer to SoundMainRAM() is stored at offset 0x74.
+   */
+  u32 address = read<u32>(rom.data(), match + 0x74);
+  if (address & 1) {
+    address &= ~1;
+  } else {
+    address &= ~3;
+  }
+  return address;
+}
+
+void Core::OnSoundMainRAM() {
+  auto address = *sound_info_pointer;
+
+  // The pointer only changes when the game writes it, so it rarely needs to be resolved again.
+  if (address != sound_info_address) {
+    sound_info_address = address;
+    sound_info = bus.GetHostAddress<MP2K::SoundInfo>(address);
+  }
+
+  if (sound_info) {
+    apu.SoundMainRAM(*sound_info);
+  }
 }
 
 } // namespace nba::core
@@ -138,7 +767,7 @@ auto Core::SearchSoundMainRAM() -> u32 {
 auto CreateCore(
   std::shared_ptr<Config> config
 ) -> std::unique_ptr<CoreBase> {
-  return std::make_unique<core::Core>(config);
+  return std::unique_ptr<core::Core>{new (config->huge_pages) core::Core(config)};
 }
 
 } // namespace nba
@@ -5,15 +5,18 @@
  * Refer to the included LICENSE file.
  */
 
+#include <nba/common/dsp/spsc_ring_buffer.hpp>
 #include <nba/core.hpp>
 
 #include "arm/arm7tdmi.hpp"
 #include "bus/bus.hpp"
+#include "dirty_tracker.hpp"
 #include "hw/apu/apu.hpp"
 #include "hw/ppu/ppu.hpp"
 #include "hw/dma/dma.hpp"
 #include "hw/irq/irq.hpp"
 #include "hw/keypad/keypad.hpp"
+#include "hw/sio/sio.hpp"
 #include "hw/timer/timer.hpp"
 #include "scheduler.hpp"
 
@@ -21,21 +24,115 @@ namespace nba::core {
 
 struct Core final : CoreBase {
   Core(std::shared_ptr<Config> config);
+ ~Core() override;
+
+  /* The core is over a megabyte, most of which is guest memory and the page tables.
+   * It gets its own pages from the OS, so that it can be backed by huge pages (see Config::huge_pages).
+   */
+  static auto operator new(size_t size) -> void*;
+  static auto operator new(size_t size, bool huge_pages) -> void*;
+  static void operator delete(void* pointer, size_t size);
+  static void operator delete(void* pointer, bool huge_pages);
 
   void Reset() override;
   void Attach(std::vector<u8> const& bios) override;
   void Attach(ROM&& rom) override;
   auto CreateRTC() -> std::unique_ptr<GPIO> override;
+  void SetGameHints(GameHints const& hints) override;
   void Run(int cycles) override;
+  auto RunSlice(RunLimits const& limits) -> RunResult override;
+  auto GetActivity() -> Activity override;
+  bool WaitForInput(std::chrono::steady_clock::time_point deadline) override;
+  void CancelWaitForInput() override;
+  bool LoadState(SaveState const& state) override;
+  void CopyState(SaveState& state) override;
+  auto GetDirtyPages(u64 token, DirtyPages& pages) -> u64 override;
+  auto GetStateHash() -> u64 override;
+  auto Clone() -> std::unique_ptr<CoreBase> override;
+  void SetVideoOutputEnabled(bool enabled) override;
+  void SetAudioOutputEnabled(bool enabled) override;
+  auto GetAudioBufferLevel() -> float override;
+  auto GetAudioStats() -> AudioStats override;
+  void SetEmulationSpeed(float speed) override;
+  void SetTurbo(bool enabled) override;
+  auto GetProfileStats() -> ProfileStats override;
+  auto GetMemoryUsage() -> MemoryUsage override;
+  void SetHotspotSampling(int interval) override;
+  void ReadHotspotSamples(std::vector<HotspotSample>& samples) override;
+  auto AddWatchpoint(u32 address, u32 size, int kinds) -> int override;
+  void RemoveWatchpoint(int id) override;
+  void SetWatchpointCallback(Watchpoint::Callback callback) override;
+  void AddBreakpoint(u32 address) override;
+  void RemoveBreakpoint(u32 address) override;
+  void StepInstruction() override;
+  auto GetCPURegisters() -> CPURegisters override;
+  void SetCPURegisters(CPURegisters const& registers) override;
+  auto DebugRead(u32 address) -> u8 override;
+  void DebugWrite(u32 address, u8 value) override;
+  void SetInstructionTrace(int capacity) override;
+  bool DumpInstructionTrace(std::string const& path) override;
+  bool ConnectLinkCable(std::shared_ptr<LinkCable> cable, int player) override;
+  void DisconnectLinkCable() override;
+  auto GetBootID() -> u64 override;
+  auto GetFrameSkip() const -> int override;
+  void SetFrameSkip(int frames) override;
+  void StartMovieRecording(std::shared_ptr<InputMovie> movie) override;
+  void StartMoviePlayback(std::shared_ptr<InputMovie const> movie) override;
+  void StopMovie() override;
 
 private:
+  bool RunUntil(u64 limit, bool stop_at_frame_end);
+  bool IsWaitingForInput() const;
+  auto GetCPUBackend() const -> Config::CPU::Backend;
   void SkipBootScreen();
   auto SearchSoundMainRAM() -> u32;
+  void OnSoundMainRAM();
+
+#if defined(NBA_HOTSPOT_SAMPLER)
+  void OnHotspotSample();
+
+  SPSCRingBuffer<HotspotSample> hotspot_samples{65536};
+#endif
+
+#if defined(NBA_ALLOCATION_TRACKER)
+  /* Buffers that are reused from frame to frame grow to their working size during the first frames after a reset.
+   * Any heap allocation by Run() or RunSlice() after that is reported.
+   */
+  static constexpr u64 kAllocationWarmUpFrames = 60;
+
+  u64 allocation_check_frame = 0;
+#endif
+
+  // Cycles that the CPU spent halted or in an idle loop, and whether it was in one at the last step.
+  u64 idle_cycles = 0;
+  bool idle_loop = false;
+
+  // Hash of every page of guest RAM as of the last call to GetStateHash(), see DirtyTracker.
+  u64 state_hash_token = 0;
+  u64 page_hashes[DirtyPages::kPageCount];
+  DirtyPages state_hash_pages;
+
+  // Only the parts without guest memory are written, see GetStateHash().
+  std::unique_ptr<SaveState> state_hash_state;
+
+  bool turbo = false;
+  GameHints hints;
+
+  // Addresses of the debugger breakpoints, see AddBreakpoint().
+  std::vector<u32> breakpoints;
 
   u32 hle_audio_hook;
+  u32 sound_main_ram;
+  bool sound_main_ram_searched = false;
+
+  // The SoundInfo pointer at 0x03007FF0 and the host address that it was last resolved to.
+  u32* sound_info_pointer;
+  u32 sound_info_address;
+  MP2K::SoundInfo* sound_info;
   std::shared_ptr<Config> config;
 
   Scheduler scheduler;
+  DirtyTracker dirty_tracker;
 
   arm::ARM7TDMI cpu;
   IRQ irq;
@@ -44,6 +141,7 @@ private:
   PPU ppu;
   Timer timer;
   KeyPad keypad;
+  SIO sio;
   Bus bus;
 };
 
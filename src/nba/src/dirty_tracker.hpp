@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <nba/common/compiler.hpp>
+#include <nba/dirty_pages.hpp>
+#include <nba/integer.hpp>
+
+namespace nba::core {
+
+/* Tracks writes to guest RAM at the granularity of DirtyPages.
+ * A write only stores the current epoch to its page, and collecting the dirty pages starts a new epoch.
+ * A page is then dirty for a client if it was written in an epoch after the one that the client last collected,
+ * so that any number of clients (i.e. rewind and netplay) can collect at their own pace.
+ */
+struct DirtyTracker {
+  using Region = DirtyPages::Region;
+
+  // Marks a write to EWRAM or IWRAM, the only RAM that is mapped for writing (see Bus::UpdatePageTable()).
+  void ALWAYS_INLINE MarkWRAM(u32 address) {
+    if ((address >> 24) == 0x02) {
+      stamps[kFirstPageEWRAM + ((address & 0x3FFFF) >> DirtyPages::kPageShift)] = epoch;
+    } else {
+      stamps[kFirstPageIWRAM + ((address & 0x7FFF) >> DirtyPages::kPageShift)] = epoch;
+    }
+  }
+
+  void MarkWRAM(u32 address, u32 size) {
+    if (size == 0) {
+      return;
+    }
+
+    auto last = address + size - 1;
+
+    for (u32 base = address & ~(DirtyPages::kPageSize - 1); base <= last; base += DirtyPages::kPageSize) {
+      MarkWRAM(base);
+    }
+  }
+
+  // Marks a write to PRAM, VRAM or OAM, where 'offset' is already reduced to the size of the region.
+  void ALWAYS_INLINE Mark(Region region, u32 offset) {
+    stamps[DirtyPages::kFirstPage[(int)region] + (offset >> DirtyPages::kPageShift)] = epoch;
+  }
+
+  // Used when the whole memory is replaced, i.e. on reset or when loading a state.
+  void MarkAll() {
+    std::fill(std::begin(stamps), std::end(stamps), epoch);
+  }
+
+  /* Sets the pages that were written since 'token' was returned, and returns the token for the next call.
+   * Zero marks every page dirty.
+   */
+  auto Collect(u64 token, DirtyPages& pages) -> u64 {
+    for (int i = 0; i < DirtyPages::kPageCount; i++) {
+      pages.pages[i] = token == 0 || stamps[i] > token;
+    }
+    return epoch++;
+  }
+
+private:
+  static constexpr int kFirstPageEWRAM = DirtyPages::kFirstPage[(int)Region::EWRAM];
+  static constexpr int kFirstPageIWRAM = DirtyPages::kFirstPage[(int)Region::IWRAM];
+
+  u64 epoch = 1;
+  u64 stamps[DirtyPages::kPageCount] {};
+};
+
+} // namespace nba::core
@@ -11,6 +11,9 @@
 #include <nba/common/dsp/resampler/cubic.hpp>
 #include <nba/common/dsp/resampler/nearest.hpp>
 #include <nba/common/dsp/resampler/sinc.hpp>
+#include <nba/common/dsp/resampler/step.hpp>
+#include <nba/core.hpp>
+#include <nba/trace.hpp>
 
 #include "apu.hpp"
 
@@ -27,12 +30,15 @@ APU::APU(
 )   : mmio(scheduler)
     , scheduler(scheduler)
     , dma(dma)
-    , mp2k(bus)
+    , bus(bus)
+    , mp2k(bus, config)
     , config(config) {
+  scheduler.Register<&APU::StepMixer>(EventClass::APU_mixer, this);
 }
 
 APU::~APU() {
   config->audio_dev->Close();
+  StopAudioThread();
 }
 
 void APU::Reset() {
@@ -45,43 +51,149 @@ void APU::Reset() {
   mmio.soundcnt.Reset();
   mmio.bias.Reset();
 
-  resolution_old = 0;
-  scheduler.Add(mmio.bias.GetSampleInterval(), this, &APU::StepMixer);
-  scheduler.Add(BaseChannel::s_cycles_per_step, this, &APU::StepSequencer);
+  if (config->audio.threaded_mixing) {
+    StartAudioThread();
+    WaitForAudioThread();
+  } else {
+    StopAudioThread();
+  }
+
+  batch_mixing = config->audio.batch_mixing && !audio_thread;
+  mixer_timestamp = scheduler.GetTimestampNow() + mmio.bias.GetSampleInterval();
+  output_timestamp = scheduler.GetTimestampNow();
+
+  if (audio_thread) {
+    scheduler.Add(kAudioJobInterval, EventClass::APU_mixer);
+  } else if (batch_mixing) {
+    scheduler.Add(kMixerBatchInterval, EventClass::APU_mixer);
+  } else {
+    scheduler.Add(mmio.bias.GetSampleInterval(), EventClass::APU_mixer);
+  }
 
   mp2k.Reset();
   mp2k_read_index = {};
 
   auto audio_dev = config->audio_dev;
   audio_dev->Close();
+
+  /* The callback does not run while the device is closed. It may start right after it was opened,
+   * so the buffer is only handed to it once it was recreated for the new block size.
+   */
+  callback_buffer.store(nullptr, std::memory_order_release);
+  callback_last_sample = {};
+  callback_fade_in = 0;
   audio_dev->Open(this, (AudioDevice::Callback)AudioCallback);
 
+  /* The buffer is sized from the period that the device reports, but holds no less than the samples of a few frames,
+   * since those are produced a frame at a time. When the audio device paces emulation, it only needs to bridge
+   * the time between two frames.
+   */
+  auto periods = config->audio.sync_to_audio ? 2 : 4;
+  auto frame_samples = int(s64(audio_dev->GetSampleRate()) * CoreBase::kCyclesPerFrame / kCyclesPerSecond) + 1;
+
+  buffer = std::make_shared<StereoSPSCRingBuffer<float>>(
+    std::max(audio_dev->GetBlockSize(), frame_samples) * periods);
+  ResetOutput();
+
+  if (audio_thread) {
+    auto& apu = *audio_thread->apu;
+
+    SyncAudioThread();
+    apu.buffer = buffer;
+    apu.ResetOutput();
+  }
+
+  callback_buffer.store(buffer.get(), std::memory_order_release);
+}
+
+/* Creates the resamplers and the audio sink taps, which pass the mixed samples on to the buffer.
+ * With threaded mixing, they belong to the APU of the audio thread instead.
+ */
+void APU::ResetOutput() {
   using Interpolation = Config::Audio::Interpolation;
 
-  buffer = std::make_shared<StereoRingBuffer<float>>(audio_dev->GetBlockSize() * 4, true);
-
-  switch (config->audio.interpolation) {
-    case Interpolation::Cosine:
-      resampler = std::make_unique<CosineStereoResampler<float>>(buffer);
-      break;
-    case Interpolation::Cubic:
-      resampler = std::make_unique<CubicStereoResampler<float>>(buffer);
-      break;
-    case Interpolation::Sinc_32:
-      resampler = std::make_unique<SincStereoResampler<float, 32>>(buffer);
-      break;
-    case Interpolation::Sinc_64:
-      resampler = std::make_unique<SincStereoResampler<float, 64>>(buffer);
-      break;
-    case Interpolation::Sinc_128:
-      resampler = std::make_unique<SincStereoResampler<float, 128>>(buffer);
-      break;
-    case Interpolation::Sinc_256:
-      resampler = std::make_unique<SincStereoResampler<float, 256>>(buffer);
-      break;
-  }
-
-  if (config->audio.interpolate_fifo) {
+  auto const& audio_dev = config->audio_dev;
+
+  resolution_old = 0;
+  rate_control_countdown = kRateControlInterval;
+  rate_adjustment = 0;
+  mix_count = 0;
+
+  // The samples that are still held by the old taps are passed on when they are destroyed.
+  sink_mix.reset();
+  sink_psg.reset();
+  sink_fifo[0].reset();
+  sink_fifo[1].reset();
+  sink_channels = false;
+
+  resampler.reset();
+  step_resampler = nullptr;
+  interpolate_fifo = false;
+
+  if (audio_thread) {
+    return;
+  }
+
+  std::shared_ptr<WriteStream<StereoSample<float>>> output = buffer;
+
+  if (auto const& sink = config->audio_sink) {
+    int streams = sink->GetStreams();
+    int samplerate = mmio.bias.GetSampleRate();
+
+    if (streams & AudioSink::Mix) {
+      sink_mix = std::make_shared<SinkTap>(sink, AudioSink::Mix, audio_dev->GetSampleRate(), buffer);
+      output = sink_mix;
+    }
+
+    if (streams & AudioSink::PSG) {
+      sink_psg = std::make_unique<SinkTap>(sink, AudioSink::PSG, samplerate);
+    }
+
+    if (streams & AudioSink::FIFO_A) {
+      sink_fifo[0] = std::make_unique<SinkTap>(sink, AudioSink::FIFO_A, samplerate);
+    }
+
+    if (streams & AudioSink::FIFO_B) {
+      sink_fifo[1] = std::make_unique<SinkTap>(sink, AudioSink::FIFO_B, samplerate);
+    }
+
+    sink_channels = sink_psg || sink_fifo[0] || sink_fifo[1];
+  }
+
+  /* Single-stage mixing feeds the DAC levels at their exact timestamps into a band-limited step resampler,
+   * so that the input sample rate is the system clock and does not depend on the BIAS setting.
+   */
+  if (config->audio.single_stage_mixing) {
+    auto step = std::make_unique<StepStereoResampler<float>>(output);
+
+    step_resampler = step.get();
+    resampler = std::move(step);
+  } else {
+    switch (config->audio.interpolation) {
+      case Interpolation::Cosine:
+        resampler = std::make_unique<CosineStereoResampler<float>>(output);
+        break;
+      case Interpolation::Cubic:
+        resampler = std::make_unique<CubicStereoResampler<float>>(output);
+        break;
+      case Interpolation::Sinc_32:
+        resampler = std::make_unique<SincStereoResampler<float, 32>>(output);
+        break;
+      case Interpolation::Sinc_64:
+        resampler = std::make_unique<SincStereoResampler<float, 64>>(output);
+        break;
+      case Interpolation::Sinc_128:
+        resampler = std::make_unique<SincStereoResampler<float, 128>>(output);
+        break;
+      case Interpolation::Sinc_256:
+        resampler = std::make_unique<SincStereoResampler<float, 256>>(output);
+        break;
+    }
+  }
+
+  interpolate_fifo = config->audio.interpolate_fifo && !step_resampler;
+
+  if (interpolate_fifo) {
     for (int fifo = 0; fifo < 2; fifo++) {
       fifo_buffer[fifo] = std::make_shared<RingBuffer<float>>(16, true);
       fifo_resampler[fifo] = std::make_unique<BlepResampler<float>>(fifo_buffer[fifo]);
@@ -89,7 +201,12 @@ void APU::Reset() {
     }
   }
 
-  resampler->SetSampleRates(mmio.bias.GetSampleRate(), audio_dev->GetSampleRate());
+  if (step_resampler) {
+    resampler->SetSampleRates(kCyclesPerSecond, audio_dev->GetSampleRate());
+  } else {
+    resampler->SetSampleRates(mmio.bias.GetSampleRate(), audio_dev->GetSampleRate());
+  }
+  resampler->SetOutputRateScale(1.0f / emulation_speed);
 }
 
 void APU::OnTimerOverflow(int timer_id, int times, int samplerate) {
@@ -99,6 +216,8 @@ void APU::OnTimerOverflow(int timer_id, int times, int samplerate) {
     return;
   }
 
+  Sync();
+
   constexpr DMA::Occasion occasion[2] = { DMA::Occasion::FIFO0, DMA::Occasion::FIFO1 };
 
   for (int fifo_id = 0; fifo_id < 2; fifo_id++) {
@@ -107,15 +226,15 @@ void APU::OnTimerOverflow(int timer_id, int times, int samplerate) {
       for (int time = 0; time < times - 1; time++) {
         fifo.Read();
       }
-      if (config->audio.interpolate_fifo) {
-        if (samplerate != fifo_samplerate[fifo_id]) {
-          fifo_resampler[fifo_id]->SetSampleRates(samplerate, mmio.bias.GetSampleRate());
-          fifo_samplerate[fifo_id] = samplerate;
-        }
-        fifo_resampler[fifo_id]->Write(fifo.Read() / 128.0);
-      } else {
-        latch[fifo_id] = fifo.Read();
+
+      auto sample = fifo.Read();
+
+      if (event_log) {
+        event_log->events.push_back({
+          AudioEvent::Type::FIFOSample, scheduler.GetTimestampNow(), u32(fifo_id), sample, samplerate});
       }
+      LatchFIFO(fifo_id, sample, samplerate);
+
       if (fifo.Count() <= 16) {
         dma.Request(occasion[fifo_id]);
       }
@@ -123,108 +242,256 @@ void APU::OnTimerOverflow(int timer_id, int times, int samplerate) {
   }
 }
 
+void APU::LatchFIFO(int fifo_id, s8 sample, int samplerate) {
+  // The interpolation is skipped while the FIFO cannot be heard.
+  if (interpolate_fifo && mmio.soundcnt.active_fifo[fifo_id]) {
+    if (samplerate != fifo_samplerate[fifo_id]) {
+      fifo_resampler[fifo_id]->SetSampleRates(samplerate, mmio.bias.GetSampleRate());
+      fifo_samplerate[fifo_id] = samplerate;
+    }
+    fifo_resampler[fifo_id]->Write(sample / 128.0);
+  } else {
+    latch[fifo_id] = sample;
+  }
+}
+
+void APU::SoundMainRAM(MP2K::SoundInfo const& sound_info) {
+  Sync();
+
+  if (event_log) {
+    event_log->sound_infos.push_back(sound_info);
+    event_log->events.push_back({
+      AudioEvent::Type::SoundMainRAM,
+      scheduler.GetTimestampNow(),
+      u32(event_log->sound_infos.size() - 1),
+      mp2k.UseCubicFilter()
+    });
+  } else {
+    mp2k.SoundMainRAM(sound_info);
+  }
+}
+
 void APU::StepMixer(int cycles_late) {
+  NBA_TRACE_ZONE("APU::StepMixer");
+
+  if (audio_thread) {
+    SubmitAudioJob(scheduler.GetTimestampNow());
+    scheduler.Add(kAudioJobInterval - cycles_late, EventClass::APU_mixer);
+  } else if (batch_mixing) {
+    Sync();
+    scheduler.Add(kMixerBatchInterval - cycles_late, EventClass::APU_mixer);
+  } else {
+    NBA_PROFILE_SCOPE(scheduler, APUMix);
+    scheduler.Add(MixSample(scheduler.GetTimestampNow()) - cycles_late, EventClass::APU_mixer);
+  }
+}
+
+void APU::MixUntil(u64 timestamp) {
+  NBA_PROFILE_SCOPE(scheduler, APUMix);
+
+  while (mixer_timestamp < timestamp) {
+    mixer_timestamp += MixSample(mixer_timestamp);
+  }
+
+  FlushSamples();
+}
+
+// Mixes the sample at the given timestamp and returns the number of cycles until the next sample.
+auto APU::MixSample(u64 timestamp) -> int {
   constexpr int psg_volume_tab[4] = { 1, 2, 4, 0 };
   constexpr int dma_volume_tab[2] = { 2, 4 };
 
-  auto& psg = mmio.soundcnt.psg;
-  auto& dma = mmio.soundcnt.dma;
+  auto& soundcnt = mmio.soundcnt;
+  auto& psg = soundcnt.psg;
+  auto& dma = soundcnt.dma;
 
   auto psg_volume = psg_volume_tab[psg.volume];
 
+  // Only the PSG channels that can be heard are caught up and mixed.
+  s16 psg_sum[2] { 0, 0 };
+
+  if (soundcnt.active_psg != 0) {
+    BaseChannel* channels[4] { &mmio.psg1, &mmio.psg2, &mmio.psg3, &mmio.psg4 };
+
+    for (int i = 0; i < 4; i++) {
+      if (soundcnt.active_psg & (1 << i)) {
+        channels[i]->Update(timestamp);
+
+        auto sample = channels[i]->GetSample();
+
+        if (psg.enable[SIDE_LEFT ][i]) psg_sum[SIDE_LEFT ] += sample;
+        if (psg.enable[SIDE_RIGHT][i]) psg_sum[SIDE_RIGHT] += sample;
+      }
+    }
+  }
+
+  // Number of cycles since the previous sample, for single-stage mixing.
+  int ticks = int(timestamp - output_timestamp);
+
+  output_timestamp = timestamp;
+
   if (mp2k.IsEngaged()) {
     StereoSample<float> sample { 0, 0 };
 
     if (resolution_old != 1) {
-      resampler->SetSampleRates(65536, config->audio_dev->GetSampleRate());
+      if (!step_resampler) {
+        FlushSamples();
+        resampler->SetSampleRates(65536, config->audio_dev->GetSampleRate());
+      }
       resolution_old = 1;
     }
 
+    StereoSample<float> psg_sample_out;
+    StereoSample<float> fifo_sample_out[2];
+
     auto mp2k_sample = mp2k.ReadSample();
 
     for (int channel = 0; channel < 2; channel++) {
-      s16 psg_sample = 0;
-
-      if (psg.enable[channel][0]) psg_sample += mmio.psg1.GetSample();
-      if (psg.enable[channel][1]) psg_sample += mmio.psg2.GetSample();
-      if (psg.enable[channel][2]) psg_sample += mmio.psg3.GetSample();
-      if (psg.enable[channel][3]) psg_sample += mmio.psg4.GetSample();
-
-      sample[channel] += psg_sample * psg_volume * psg.master[channel] / (28.0 * 0x200);
+      psg_sample_out[channel] = psg_sum[channel] * psg_volume * psg.master[channel] / (28.0 * 0x200);
+      sample[channel] += psg_sample_out[channel];
 
       /* TODO: we assume that MP2K sends right channel to FIFO A and left channel to FIFO B,
        * but we haven't verified that this is actually correct.
        */
       for (int fifo = 0; fifo < 2; fifo++) {
-        if (dma[fifo].enable[channel]) {
-          sample[channel] += mp2k_sample[fifo] * dma_volume_tab[dma[fifo].volume] * 0.25;
+        if (soundcnt.active_fifo[fifo] && dma[fifo].enable[channel]) {
+          fifo_sample_out[fifo][channel] = mp2k_sample[fifo] * dma_volume_tab[dma[fifo].volume] * 0.25;
+          sample[channel] += fifo_sample_out[fifo][channel];
         }
       }
     }
 
-    buffer_mutex.lock();
-    resampler->Write(sample);
-    buffer_mutex.unlock();
+    if (audio_output_enabled) {
+      OutputSample(sample, ticks);
+
+      if (sink_channels) {
+        OutputChannels(psg_sample_out, fifo_sample_out, 65536);
+      }
+    }
 
-    scheduler.Add(256 - (scheduler.GetTimestampNow() & 255), this, &APU::StepMixer);
+    return int(256 - (timestamp & 255));
   } else {
     StereoSample<s16> sample { 0, 0 };
 
     auto& bias = mmio.bias;
 
     if (bias.resolution != resolution_old) {
-      resampler->SetSampleRates(bias.GetSampleRate(),
-        config->audio_dev->GetSampleRate());
+      if (!step_resampler) {
+        FlushSamples();
+        resampler->SetSampleRates(bias.GetSampleRate(),
+          config->audio_dev->GetSampleRate());
+      }
       resolution_old = mmio.bias.resolution;
-      if (config->audio.interpolate_fifo) {
+      if (interpolate_fifo) {
         for (int fifo = 0; fifo < 2; fifo++) {
           fifo_resampler[fifo]->SetSampleRates(fifo_samplerate[fifo], mmio.bias.GetSampleRate());
         }
       }
     }
 
-    if (config->audio.interpolate_fifo) {
+    if (interpolate_fifo) {
       for (int fifo = 0; fifo < 2; fifo++) {
-        latch[fifo] = s8(fifo_buffer[fifo]->Read() * 127.0);
+        if (soundcnt.active_fifo[fifo]) {
+          latch[fifo] = s8(fifo_buffer[fifo]->Read() * 127.0);
+        }
       }
     }
 
-    for (int channel = 0; channel < 2; channel++) {
-      s16 psg_sample = 0;
-
-      if (psg.enable[channel][0]) psg_sample += mmio.psg1.GetSample();
-      if (psg.enable[channel][1]) psg_sample += mmio.psg2.GetSample();
-      if (psg.enable[channel][2]) psg_sample += mmio.psg3.GetSample();
-      if (psg.enable[channel][3]) psg_sample += mmio.psg4.GetSample();
+    StereoSample<s16> psg_sample_out;
+    StereoSample<s16> fifo_sample_out[2];
 
-      sample[channel] += psg_sample * psg_volume * psg.master[channel] / 28;
+    for (int channel = 0; channel < 2; channel++) {
+      psg_sample_out[channel] = psg_sum[channel] * psg_volume * psg.master[channel] / 28;
+      sample[channel] += psg_sample_out[channel];
 
       for (int fifo = 0; fifo < 2; fifo++) {
-        if (dma[fifo].enable[channel]) {
-          sample[channel] += latch[fifo] * dma_volume_tab[dma[fifo].volume];
+        if (soundcnt.active_fifo[fifo] && dma[fifo].enable[channel]) {
+          fifo_sample_out[fifo][channel] = latch[fifo] * dma_volume_tab[dma[fifo].volume];
+          sample[channel] += fifo_sample_out[fifo][channel];
         }
       }
 
       sample[channel] += mmio.bias.level;
       sample[channel]  = std::clamp(sample[channel], s16(0), s16(0x3FF));
+
+      // The PWM output drops the low bits: 9-bit at 32768 Hz, down to 6-bit at 262144 Hz.
+      if (step_resampler) {
+        sample[channel] &= ~((2 << bias.resolution) - 1);
+      }
+
       sample[channel] -= 0x200;
     }
 
-    buffer_mutex.lock();
-    resampler->Write({ sample[0] / float(0x200), sample[1] / float(0x200) });
-    buffer_mutex.unlock();
+    if (audio_output_enabled) {
+      OutputSample({ sample[0] / float(0x200), sample[1] / float(0x200) }, ticks);
+
+      if (sink_channels) {
+        auto normalize = [](StereoSample<s16> const& sample) -> StereoSample<float> {
+          return { sample.left / float(0x200), sample.right / float(0x200) };
+        };
+
+        StereoSample<float> fifo[2] { normalize(fifo_sample_out[0]), normalize(fifo_sample_out[1]) };
+
+        OutputChannels(normalize(psg_sample_out), fifo, bias.GetSampleRate());
+      }
+    }
+
+    return mmio.bias.GetSampleInterval();
+  }
+}
+
+void APU::OutputSample(StereoSample<float> const& sample, int ticks) {
+  mix_block[mix_count] = sample;
+  mix_ticks[mix_count] = ticks;
+  mix_count++;
+
+  if (mix_count == kMixBlockSize) {
+    FlushSamples();
+  }
+}
+
+// Passes the collected samples to the resampler. Must be called before the resampler settings change.
+void APU::FlushSamples() {
+  if (mix_count == 0) {
+    return;
+  }
+
+  if (step_resampler) {
+    step_resampler->Write(mix_block, mix_ticks, mix_count);
+  } else {
+    resampler->Write(mix_block, mix_count);
+  }
+
+  /* Dynamic rate control: produce slightly fewer samples while the buffer is more than half-full,
+   * and slightly more while it is less than half-full, so that it neither overflows nor runs dry.
+   */
+  if (config->audio.sync_to_audio) {
+    rate_control_countdown -= mix_count;
+
+    if (rate_control_countdown <= 0) {
+      auto level = std::clamp(GetBufferLevel() * 2.0f - 1.0f, -1.0f, 1.0f);
 
-    scheduler.Add(mmio.bias.GetSampleInterval() - cycles_late, this, &APU::StepMixer);
+      rate_adjustment = -level * kRateControlMaxDelta;
+      resampler->SetOutputRateScale((1.0f + rate_adjustment) / emulation_speed);
+      rate_control_countdown = kRateControlInterval;
+    }
   }
+
+  mix_count = 0;
 }
 
-void APU::StepSequencer(int cycles_late) {
-  mmio.psg1.Tick();
-  mmio.psg2.Tick();
-  mmio.psg3.Tick();
-  mmio.psg4.Tick();
+void APU::OutputChannels(StereoSample<float> const& psg, StereoSample<float> const* fifo, int sample_rate) {
+  if (sink_psg) {
+    sink_psg->SetSampleRate(sample_rate);
+    sink_psg->Write(psg);
+  }
 
-  scheduler.Add(BaseChannel::s_cycles_per_step - cycles_late, this, &APU::StepSequencer);
+  for (int i = 0; i < 2; i++) {
+    if (sink_fifo[i]) {
+      sink_fifo[i]->SetSampleRate(sample_rate);
+      sink_fifo[i]->Write(fifo[i]);
+    }
+  }
 }
 
 } // namespace nba::core
@@ -8,9 +8,16 @@
 #pragma once
 
 #include <nba/common/dsp/resampler.hpp>
+#include <nba/common/dsp/resampler/step.hpp>
 #include <nba/common/dsp/ring_buffer.hpp>
+#include <nba/common/dsp/spsc_ring_buffer.hpp>
+#include <nba/common/compiler.hpp>
 #include <nba/config.hpp>
+#include <atomic>
+#include <condition_variable>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 #include "hw/apu/channel/quad_channel.hpp"
 #include "hw/apu/channel/wave_channel.hpp"
@@ -36,13 +43,94 @@ struct APU {
   void Reset();
   auto GetMP2K() -> MP2K& { return mp2k; }
   void OnTimerOverflow(int timer_id, int times, int samplerate);
+  void SoundMainRAM(MP2K::SoundInfo const& sound_info);
+
+  // Waits until the threads that read the MP2K wave data from the ROM are idle, i.e. before it is replaced or freed.
+  void WaitForThreads();
+
+  static bool ValidateState(SaveState const& state);
+  void LoadState(SaveState const& state);
+  void CopyState(SaveState& state);
+
+  void SetAudioOutputEnabled(bool enabled) {
+    audio_output_enabled = enabled;
+    if (event_log) {
+      event_log->events.push_back({AudioEvent::Type::AudioOutput, scheduler.GetTimestampNow(), 0, enabled});
+    }
+  }
+
+  /* Switches between batch and per-sample mixing. The pending mixer event switches to the new interval.
+   * The samples between the last batch and that event are lost when batch mixing is turned off.
+   */
+  void SetBatchMixing(bool enabled) {
+    // The audio thread always mixes in batches.
+    if (enabled == batch_mixing || audio_thread) {
+      return;
+    }
+
+    if (enabled) {
+      mixer_timestamp = scheduler.GetTimestampNow();
+    } else {
+      Sync();
+    }
+    batch_mixing = enabled;
+  }
+
+  auto GetBufferLevel() const -> float {
+    return float(buffer->Pending()) / buffer->Capacity();
+  }
+
+  // Seconds from writing a sample into the buffer until it is heard: the samples ahead of it and the latency of the device.
+  auto GetOutputLatency() const -> float {
+    auto const& audio_dev = config->audio_dev;
+
+    return float(buffer->Pending() + audio_dev->GetLatency()) / audio_dev->GetSampleRate();
+  }
+
+  auto GetRateAdjustment() const -> float {
+    if (audio_thread) {
+      return audio_thread->rate_adjustment.load(std::memory_order_relaxed);
+    }
+    return rate_adjustment;
+  }
+
+  auto GetBufferMemoryUsage() const -> size_t {
+    return buffer->Capacity() * sizeof(StereoSample<float>);
+  }
+
+  void SetEmulationSpeed(float speed) {
+    emulation_speed = speed;
+    if (event_log) {
+      event_log->events.push_back({AudioEvent::Type::EmulationSpeed, scheduler.GetTimestampNow(), 0, 0, 0, speed});
+    } else if (resampler) {
+      FlushSamples();
+      resampler->SetOutputRateScale(1.0f / speed);
+      rate_adjustment = 0;
+    }
+  }
+
+  /* With batch mixing, mixes all samples that are due before the current timestamp.
+   * Must be called before the sound state is read or changed.
+   */
+  void ALWAYS_INLINE Sync() {
+    if (batch_mixing && mixer_timestamp < scheduler.GetTimestampNow()) {
+      MixUntil(scheduler.GetTimestampNow());
+    }
+  }
+
+  // Must be called for each write to the sound registers, after Sync(). Records the write for the audio thread.
+  void ALWAYS_INLINE LogRegisterWrite(u32 address, u8 value) {
+    if (event_log) {
+      event_log->events.push_back({AudioEvent::Type::RegisterWrite, scheduler.GetTimestampNow(), address, value});
+    }
+  }
 
   struct MMIO {
     MMIO(Scheduler& scheduler)
         : psg1(scheduler)
         , psg2(scheduler)
         , psg3(scheduler)
-        , psg4(scheduler, bias) {
+        , psg4(scheduler) {
     }
 
     FIFO fifo[2];
@@ -56,25 +144,210 @@ struct APU {
     BIAS bias;
   } mmio;
 
-  std::mutex buffer_mutex;
-  std::shared_ptr<StereoRingBuffer<float>> buffer;
+  // Written by the emulation thread and read by the audio callback (through callback_buffer).
+  std::shared_ptr<StereoSPSCRingBuffer<float>> buffer;
+  std::atomic<StereoSPSCRingBuffer<float>*> callback_buffer{nullptr};
+
+  // Owned by the audio callback, for fading out on buffer underruns and back in afterwards.
+  StereoSample<float> callback_last_sample;
+  int callback_fade_in = 0;
+  std::atomic<u64> callback_underruns{0};
   std::unique_ptr<StereoResampler<float>> resampler;
 
 private:
+  static constexpr int kSinkBlockSize = 512;
+
+  // Collects the samples of one stream for the audio sink and passes them on in blocks.
+  struct SinkTap final : WriteStream<StereoSample<float>> {
+    SinkTap(
+      std::shared_ptr<AudioSink> sink,
+      AudioSink::Stream stream,
+      int sample_rate,
+      std::shared_ptr<WriteStream<StereoSample<float>>> output = {}
+    )   : sink(sink), stream(stream), sample_rate(sample_rate), output(output) {
+    }
+
+   ~SinkTap() {
+      Flush();
+    }
+
+    void SetSampleRate(int rate) {
+      if (rate != sample_rate) {
+        Flush();
+        sample_rate = rate;
+      }
+    }
+
+    void Write(StereoSample<float> const& sample) override {
+      if (output) {
+        output->Write(sample);
+      }
+
+      block[count++] = sample;
+
+      if (count == kSinkBlockSize) {
+        Flush();
+      }
+    }
+
+    void Write(StereoSample<float> const* samples, int length) override {
+      if (output) {
+        output->Write(samples, length);
+      }
+
+      while (length > 0) {
+        int chunk = std::min(length, kSinkBlockSize - count);
+
+        std::copy_n(samples, chunk, &block[count]);
+        count += chunk;
+        samples += chunk;
+        length -= chunk;
+
+        if (count == kSinkBlockSize) {
+          Flush();
+        }
+      }
+    }
+
+    void Flush() {
+      if (count != 0) {
+        sink->Write(stream, sample_rate, block, count);
+        count = 0;
+      }
+    }
+
+    std::shared_ptr<AudioSink> sink;
+    AudioSink::Stream stream;
+    int sample_rate;
+    std::shared_ptr<WriteStream<StereoSample<float>>> output;
+    StereoSample<float> block[kSinkBlockSize];
+    int count = 0;
+  };
+
+  // Interval between mixer events when mixing audio in batches.
+  static constexpr int kMixerBatchInterval = 4096;
+
+  static constexpr int kCyclesPerSecond = 16777216;
+
+  // Mixed samples are passed to the resampler in blocks, which lets it run its kernel in a tight loop.
+  static constexpr int kMixBlockSize = 64;
+
+  // Output samples between updates of the dynamic rate control and the largest adjustment it makes.
+  static constexpr int kRateControlInterval = 256;
+  static constexpr float kRateControlMaxDelta = 0.005;
+
+  /* Threaded mixing (see Config::Audio::threaded_mixing): the emulation thread records everything that
+   * the mixer depends on as timestamped events, and submits them as one job at each mixer event.
+   * The audio thread applies them to its own APU, which mixes the samples before each event first,
+   * so the output is the same as with batch mixing, only a few milliseconds later.
+   */
+  struct AudioEvent {
+    enum class Type : u8 {
+      RegisterWrite,  // 'value' was written to the sound register at 'address'
+      FIFOSample,     // FIFO 'address' latched the sample 'value' at 'sample_rate'
+      SoundMainRAM,   // MP2K SoundMainRAM() with AudioJob::sound_infos['address'] and the cubic filter if 'value' is set
+      EmulationSpeed, // SetEmulationSpeed('speed')
+      AudioOutput     // SetAudioOutputEnabled('value')
+    } type;
+
+    u64 timestamp;
+    u32 address;
+    int value;
+    int sample_rate = 0;
+    float speed = 0;
+  };
+
+  struct AudioJob {
+    u64 timestamp; // the job mixes the samples up to here
+    std::vector<AudioEvent> events;
+    std::vector<MP2K::SoundInfo> sound_infos;
+  };
+
+  struct AudioThread {
+    static constexpr int kQueueSize = 16;
+
+    // The clock of the APU below, which never has any events.
+    Scheduler scheduler;
+    std::unique_ptr<APU> apu;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv_submit;
+    std::condition_variable cv_done;
+    bool quit = false;
+    std::atomic<float> rate_adjustment{0};
+
+    // Jobs [tail, head) are queued. The job at head is being recorded by the emulation thread.
+    AudioJob jobs[kQueueSize];
+    int head = 0;
+    int tail = 0;
+
+    // Used to copy the state to the APU of the audio thread.
+    SaveState state;
+  };
+
+  struct AudioThreadTag {};
+
+  // Interval between two jobs for the audio thread, about four milliseconds.
+  static constexpr int kAudioJobInterval = 65536;
+
+  // Creates the APU that mixes on behalf of the given APU.
+  APU(AudioThreadTag, APU& emulated_apu, Scheduler& scheduler);
+
+  void StartAudioThread();
+  void StopAudioThread();
+  void SyncAudioThread();
+  void WaitForAudioThread();
+  void FlushAudioEvents();
+  void SubmitAudioJob(u64 timestamp);
+  void AudioThreadLoop();
+  void RunAudioJob(AudioJob const& job);
+  void ReplayRegisterWrite(u32 address, u8 value);
+
+  void ResetOutput();
+  void LatchFIFO(int fifo_id, s8 sample, int samplerate);
   void StepMixer(int cycles_late);
-  void StepSequencer(int cycles_late);
+  void MixUntil(u64 timestamp);
+  auto MixSample(u64 timestamp) -> int;
+  void OutputSample(StereoSample<float> const& sample, int ticks);
+  void FlushSamples();
+  void OutputChannels(StereoSample<float> const& psg, StereoSample<float> const* fifo, int sample_rate);
 
   s8 latch[2];
   std::shared_ptr<RingBuffer<float>> fifo_buffer[2];
   std::unique_ptr<Resampler<float>> fifo_resampler[2];
   int fifo_samplerate[2];
+  bool interpolate_fifo = false;
+
+  // Set with single-stage mixing, then it is the same object as resampler.
+  StepStereoResampler<float>* step_resampler = nullptr;
 
   Scheduler& scheduler;
   DMA& dma;
+  Bus& bus;
   MP2K mp2k;
   int mp2k_read_index;
   std::shared_ptr<Config> config;
   int resolution_old = 0;
+  bool audio_output_enabled = true;
+  bool batch_mixing = false;
+  u64 mixer_timestamp;
+  u64 output_timestamp;
+  int rate_control_countdown = kRateControlInterval;
+  float rate_adjustment = 0;
+  float emulation_speed = 1;
+
+  StereoSample<float> mix_block[kMixBlockSize];
+  int mix_ticks[kMixBlockSize];
+  int mix_count = 0;
+
+  // Audio sink taps, only created for the streams that the sink wants.
+  std::shared_ptr<SinkTap> sink_mix;
+  std::unique_ptr<SinkTap> sink_psg;
+  std::unique_ptr<SinkTap> sink_fifo[2];
+  bool sink_channels = false;
+
+  std::unique_ptr<AudioThread> audio_thread;
+  AudioJob* event_log = nullptr;
 };
 
 } // namespace nba::core
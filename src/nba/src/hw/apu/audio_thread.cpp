@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <nba/trace.hpp>
+
+#include "bus/io.hpp"
+#include "hw/apu/apu.hpp"
+
+namespace nba::core {
+
+APU::APU(AudioThreadTag, APU& emulated_apu, Scheduler& scheduler)
+    : mmio(scheduler)
+    , scheduler(scheduler)
+    , dma(emulated_apu.dma)
+    , bus(emulated_apu.bus)
+    , mp2k(emulated_apu.bus, emulated_apu.config)
+    , config(emulated_apu.config) {
+  // Never registered with the scheduler, this APU only mixes up to the events that it is given.
+}
+
+void APU::StartAudioThread() {
+  if (audio_thread) {
+    return;
+  }
+
+  audio_thread = std::make_unique<AudioThread>();
+  audio_thread->apu = std::unique_ptr<APU>{new APU{AudioThreadTag{}, *this, audio_thread->scheduler}};
+  audio_thread->thread = std::thread{&APU::AudioThreadLoop, this};
+  event_log = &audio_thread->jobs[audio_thread->head];
+}
+
+void APU::StopAudioThread() {
+  if (!audio_thread) {
+    return;
+  }
+
+  {
+    std::lock_guard lock{audio_thread->mutex};
+    audio_thread->quit = true;
+  }
+
+  audio_thread->cv_submit.notify_one();
+  audio_thread->thread.join();
+  audio_thread.reset();
+  event_log = nullptr;
+}
+
+void APU::SyncAudioThread() {
+  auto& at = *audio_thread;
+  auto& apu = *at.apu;
+  auto& state = at.state;
+
+  WaitForAudioThread();
+
+  // Events that were not submitted yet are covered by copying the state.
+  at.jobs[at.head].events.clear();
+  at.jobs[at.head].sound_infos.clear();
+
+  CopyState(state);
+  state.timestamp = scheduler.GetTimestampNow();
+  state.scheduler.event_count = 0;
+  at.scheduler.LoadState(state);
+  apu.LoadState(state);
+
+  // Mixing continues where this APU would have continued it.
+  apu.mixer_timestamp = mixer_timestamp;
+  apu.output_timestamp = output_timestamp;
+  apu.mp2k.UseCubicFilter() = mp2k.UseCubicFilter();
+  apu.audio_output_enabled = audio_output_enabled;
+  if (apu.emulation_speed != emulation_speed) {
+    apu.SetEmulationSpeed(emulation_speed);
+  }
+}
+
+/* Submits the events that were recorded since the last job, i.e. before a save state is loaded.
+ * Run-ahead loads a state after each frame, which must not cut off the audio of the frame that was kept.
+ */
+void APU::FlushAudioEvents() {
+  auto& pending = audio_thread->jobs[audio_thread->head];
+
+  if (!pending.events.empty()) {
+    SubmitAudioJob(pending.events.back().timestamp);
+  }
+}
+
+void APU::WaitForAudioThread() {
+  std::unique_lock lock{audio_thread->mutex};
+
+  audio_thread->cv_done.wait(lock, [this] {
+    return audio_thread->tail == audio_thread->head;
+  });
+}
+
+void APU::WaitForThreads() {
+  if (audio_thread) {
+    WaitForAudioThread();
+    audio_thread->apu->mp2k.Sync();
+  }
+  mp2k.Sync();
+}
+
+void APU::SubmitAudioJob(u64 timestamp) {
+  auto& at = *audio_thread;
+  int next = (at.head + 1) % AudioThread::kQueueSize;
+
+  at.jobs[at.head].timestamp = timestamp;
+
+  {
+    std::unique_lock lock{at.mutex};
+
+    // The next job slot is only free to record into once the audio thread is done with it.
+    at.cv_done.wait(lock, [&] { return next != at.tail; });
+    at.head = next;
+  }
+
+  at.cv_submit.notify_one();
+  at.jobs[next].events.clear();
+  at.jobs[next].sound_infos.clear();
+  event_log = &at.jobs[next];
+}
+
+void APU::AudioThreadLoop() {
+  auto& at = *audio_thread;
+  auto& apu = *at.apu;
+
+  NBA_TRACE_THREAD("Audio thread");
+
+  if (config->on_thread_start) {
+    config->on_thread_start("Audio thread");
+  }
+
+  while (true) {
+    std::unique_lock lock{at.mutex};
+
+    at.cv_submit.wait(lock, [&] { return at.quit || at.tail != at.head; });
+
+    if (at.tail == at.head) {
+      break;
+    }
+
+    auto& job = at.jobs[at.tail];
+
+    lock.unlock();
+
+    apu.RunAudioJob(job);
+    at.rate_adjustment.store(apu.rate_adjustment, std::memory_order_relaxed);
+
+    lock.lock();
+    at.tail = (at.tail + 1) % AudioThread::kQueueSize;
+    lock.unlock();
+    at.cv_done.notify_all();
+  }
+}
+
+// Runs on the APU of the audio thread, with the events in the same order as the emulation thread saw them.
+void APU::RunAudioJob(AudioJob const& job) {
+  NBA_TRACE_ZONE("APU::RunAudioJob");
+
+  auto advance = [this](u64 timestamp) {
+    if (mixer_timestamp < timestamp) {
+      MixUntil(timestamp);
+    }
+    scheduler.AddCycles(int(timestamp - scheduler.GetTimestampNow()));
+  };
+
+  for (auto const& event : job.events) {
+    advance(event.timestamp);
+
+    switch (event.type) {
+      case AudioEvent::Type::RegisterWrite: {
+        ReplayRegisterWrite(event.address, u8(event.value));
+        break;
+      }
+      case AudioEvent::Type::FIFOSample: {
+        LatchFIFO(int(event.address), s8(event.value), event.sample_rate);
+        break;
+      }
+      case AudioEvent::Type::SoundMainRAM: {
+        mp2k.UseCubicFilter() = event.value != 0;
+        mp2k.SoundMainRAM(job.sound_infos[event.address]);
+        break;
+      }
+      case AudioEvent::Type::EmulationSpeed: {
+        SetEmulationSpeed(event.speed);
+        break;
+      }
+      case AudioEvent::Type::AudioOutput: {
+        audio_output_enabled = event.value != 0;
+        break;
+      }
+    }
+  }
+
+  advance(job.timestamp);
+}
+
+// The sound registers of Bus::Hardware::WriteByteImpl(), applied to the APU of the audio thread.
+void APU::ReplayRegisterWrite(u32 address, u8 value) {
+  switch (address) {
+    case SOUND1CNT_L:   mmio.psg1.Write(0, value); break;
+    case SOUND1CNT_L+1: mmio.psg1.Write(1, value); break;
+    case SOUND1CNT_H:   mmio.psg1.Write(2, value); break;
+    case SOUND1CNT_H+1: mmio.psg1.Write(3, value); break;
+    case SOUND1CNT_X:   mmio.psg1.Write(4, value); break;
+    case SOUND1CNT_X+1: mmio.psg1.Write(5, value); break;
+    case SOUND2CNT_L:   mmio.psg2.Write(2, value); break;
+    case SOUND2CNT_L+1: mmio.psg2.Write(3, value); break;
+    case SOUND2CNT_H:   mmio.psg2.Write(4, value); break;
+    case SOUND2CNT_H+1: mmio.psg2.Write(5, value); break;
+    case SOUND3CNT_L:   mmio.psg3.Write(0, value); break;
+    case SOUND3CNT_L+1: mmio.psg3.Write(1, value); break;
+    case SOUND3CNT_H:   mmio.psg3.Write(2, value); break;
+    case SOUND3CNT_H+1: mmio.psg3.Write(3, value); break;
+    case SOUND3CNT_X:   mmio.psg3.Write(4, value); break;
+    case SOUND3CNT_X+1: mmio.psg3.Write(5, value); break;
+    case SOUND4CNT_L:   mmio.psg4.Write(0, value); break;
+    case SOUND4CNT_L+1: mmio.psg4.Write(1, value); break;
+    case SOUND4CNT_H:   mmio.psg4.Write(4, value); break;
+    case SOUND4CNT_H+1: mmio.psg4.Write(5, value); break;
+    case SOUNDCNT_L:    mmio.soundcnt.Write(0, value); break;
+    case SOUNDCNT_L+1:  mmio.soundcnt.Write(1, value); break;
+    case SOUNDCNT_H:    mmio.soundcnt.Write(2, value); break;
+    case SOUNDCNT_H+1:  mmio.soundcnt.Write(3, value); break;
+    case SOUNDCNT_X:    mmio.soundcnt.Write(4, value); break;
+    case SOUNDBIAS:     mmio.bias.Write(0, value); break;
+    case SOUNDBIAS+1:   mmio.bias.Write(1, value); break;
+    default: {
+      if (address >= WAVE_RAM && address < WAVE_RAM + 16) {
+        mmio.psg3.WriteSample(address & 0xF, value);
+      }
+      break;
+    }
+  }
+}
+
+} // namespace nba::core
@@ -7,48 +7,111 @@
 
 #include <algorithm>
 #include <cmath>
+#include <nba/trace.hpp>
 
 #include "hw/apu/apu.hpp"
 
+#if defined(__SSE2__) || defined(_M_X64)
+  #include <emmintrin.h>
+  #define NBA_CALLBACK_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  #include <arm_neon.h>
+  #define NBA_CALLBACK_NEON
+#endif
+
 namespace nba::core {
 
+namespace {
+
+// Samples over which the output fades out on a buffer underrun and fades back in afterwards.
+constexpr int kFadeLength = 64;
+
+constexpr int kChunkSize = 256;
+
+/* Converts interleaved samples from [-1, 1] to s16, with rounding to nearest
+ * and saturation of the values outside of that range.
+ */
+void ConvertSamples(float const* src, s16* dst, int count) {
+  int i = 0;
+
+#if defined(NBA_CALLBACK_SSE2)
+  auto scale = _mm_set1_ps(32767.0f);
+  auto min = _mm_set1_ps(-32768.0f);
+  auto max = _mm_set1_ps( 32767.0f);
+
+  // Clamped before the conversion, which would turn large values into INT_MIN.
+  for (; i + 8 <= count; i += 8) {
+    auto a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&src[i + 0]), scale), min), max);
+    auto b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&src[i + 4]), scale), min), max);
+
+    _mm_storeu_si128((__m128i*)&dst[i], _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+  }
+#elif defined(NBA_CALLBACK_NEON)
+  for (; i + 8 <= count; i += 8) {
+    auto a = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(&src[i + 0]), 32767.0f));
+    auto b = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(&src[i + 4]), 32767.0f));
+
+    vst1q_s16(&dst[i], vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+  }
+#endif
+
+  for (; i < count; i++) {
+    dst[i] = s16(std::lrint(std::clamp(src[i] * 32767.0f, -32768.0f, 32767.0f)));
+  }
+}
+
+} // namespace nba::core::(anonymous)
+
 void AudioCallback(APU* apu, s16* stream, int byte_len) {
-  std::lock_guard<std::mutex> guard(apu->buffer_mutex);
+  NBA_TRACE_ZONE("AudioCallback");
+
+  auto buffer = apu->callback_buffer.load(std::memory_order_acquire);
 
   // Do not try to access the buffer if it wasn't setup yet.
-  if (!apu->buffer) {
+  if (buffer == nullptr) {
     return;
   }
 
   int samples = byte_len/sizeof(s16)/2;
-  int available = apu->buffer->Available();
+  int x = 0;
 
-  static constexpr float kMaxAmplitude = 0.999;
+  StereoSample<float> chunk[kChunkSize];
 
-  if (available >= samples) {
-    for (int x = 0; x < samples; x++) {
-      auto sample = apu->buffer->Read();
-      sample[0] = std::clamp(sample[0], -kMaxAmplitude, kMaxAmplitude);
-      sample[1] = std::clamp(sample[1], -kMaxAmplitude, kMaxAmplitude);
-      sample *= 32767.0;
+  while (x < samples) {
+    int count = buffer->Read(chunk, std::min(samples - x, kChunkSize));
 
-      stream[x*2+0] = s16(std::round(sample.left));
-      stream[x*2+1] = s16(std::round(sample.right));
+    if (count == 0) {
+      break;
     }
-  } else {
-    int y = 0;
 
-    for (int x = 0; x < samples; x++) {
-      auto sample = apu->buffer->Peek(y);
-      sample[0] = std::clamp(sample[0], -kMaxAmplitude, kMaxAmplitude);
-      sample[1] = std::clamp(sample[1], -kMaxAmplitude, kMaxAmplitude);
-      sample *= 32767.0;
+    for (int i = 0; i < count && apu->callback_fade_in > 0; i++) {
+      chunk[i] *= 1.0f - float(apu->callback_fade_in--) / kFadeLength;
+    }
 
-      if (++y >= available) y = 0;
+    apu->callback_last_sample = chunk[count - 1];
+    ConvertSamples((float const*)chunk, &stream[x * 2], count * 2);
+    x += count;
+  }
+
+  // Underrun: fade out from the last sample instead of cutting it off, and fade back in once samples arrive.
+  if (x < samples) {
+    auto last = apu->callback_last_sample;
+
+    while (x < samples) {
+      int count = std::min(samples - x, kChunkSize);
 
-      stream[x*2+0] = s16(std::round(sample.left));
-      stream[x*2+1] = s16(std::round(sample.right));
+      for (int i = 0; i < count; i++) {
+        chunk[i] = last * std::max(0.0f, 1.0f - float(i + 1) / kFadeLength);
+      }
+
+      ConvertSamples((float const*)chunk, &stream[x * 2], count * 2);
+      x += count;
+      last = {};
     }
+
+    apu->callback_last_sample = {};
+    apu->callback_fade_in = kFadeLength;
+    apu->callback_underruns.fetch_add(1, std::memory_order_relaxed);
   }
 }
 
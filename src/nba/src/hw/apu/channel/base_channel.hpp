@@ -7,28 +7,39 @@
 
 #pragma once
 
+#include <algorithm>
+#include <nba/save_state.hpp>
+
 #include "hw/apu/channel/length_counter.hpp"
 #include "hw/apu/channel/envelope.hpp"
 #include "hw/apu/channel/sweep.hpp"
+#include "scheduler.hpp"
 
 namespace nba::core {
 
+/* PSG channels are evaluated lazily, instead of stepping through scheduler events.
+ * Update() catches a channel up to a timestamp. It interleaves the frame sequencer ticks
+ * with runs of waveform steps, which the channel advances in bulk with Generate().
+ * Anything that reads or writes channel state must update the channel first.
+ */
 class BaseChannel {
 public:
   static constexpr int s_cycles_per_step = 16777216 / 512;
 
   BaseChannel(
+    Scheduler& scheduler,
     bool enable_envelope,
     bool enable_sweep,
     int default_length = 64
-  )   : length(default_length) {
+  )   : scheduler(scheduler)
+      , length(default_length) {
     envelope.enabled = enable_envelope;
     sweep.enabled = enable_sweep;
     Reset();
   }
 
   virtual bool IsEnabled() { return enabled; }
-  virtual auto GetSample() -> s8 = 0;
+  auto GetSample() -> s8 { return sample; }
 
   void Reset() {
     length.Reset();
@@ -36,6 +47,35 @@ public:
     sweep.Reset();
     enabled = false;
     step = 0;
+    sample = 0;
+    stepping = false;
+    timestamp_tick = scheduler.GetTimestampNow() + s_cycles_per_step;
+  }
+
+  void Update() {
+    Update(scheduler.GetTimestampNow());
+  }
+
+  void Update(u64 timestamp) {
+    while (true) {
+      bool step_due = stepping && timestamp_step <= timestamp;
+      bool tick_due = timestamp_tick <= timestamp;
+
+      if (tick_due && (!step_due || timestamp_tick <= timestamp_step)) {
+        Tick();
+        timestamp_tick += s_cycles_per_step;
+      } else if (step_due) {
+        // Frequency and volume may only change on the next tick, so all steps until then use the same parameters.
+        auto interval = GetStepInterval();
+        auto until = std::min(timestamp, timestamp_tick - 1);
+        auto steps = int((until - timestamp_step) / interval) + 1;
+
+        stepping = Generate(steps);
+        timestamp_step += u64(steps) * interval;
+      } else {
+        break;
+      }
+    }
   }
 
   void Tick() {
@@ -49,25 +89,47 @@ public:
   }
 
 protected:
+  // Returns the number of cycles between two waveform steps.
+  virtual auto GetStepInterval() -> int = 0;
+
+  /* Advances the waveform by the given number of steps and updates the output sample.
+   * Returns false if the channel stops stepping until it is restarted.
+   */
+  virtual bool Generate(int steps) = 0;
+
   void Restart() {
     length.Restart();
     sweep.Restart();
     envelope.Restart();
     enabled = true;
     step = 0;
+
+    // TODO: properly align the first step to the system clock.
+    if (!stepping) {
+      stepping = true;
+      timestamp_step = scheduler.GetTimestampNow() + GetStepInterval();
+    }
   }
 
   void Disable() {
     enabled = false;
   }
 
+  void LoadState(SaveState::APU::IO::PSG const& state);
+  void CopyState(SaveState::APU::IO::PSG& state);
+
+  Scheduler& scheduler;
   LengthCounter length;
   Envelope envelope;
   Sweep sweep;
+  s8 sample;
 
 private:
   bool enabled;
   int step;
+  bool stepping;
+  u64 timestamp_step;
+  u64 timestamp_tick;
 };
 
 } // namespace nba::core
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <nba/integer.hpp>
+#include <nba/save_state.hpp>
 
 namespace nba::core {
 
@@ -42,6 +43,9 @@ public:
     return value;
   }
 
+  void LoadState(SaveState::APU::FIFO const& state);
+  void CopyState(SaveState::APU::FIFO& state);
+
 private:
   static constexpr int s_fifo_len = 32;
   
@@ -9,10 +9,8 @@
 
 namespace nba::core {
 
-NoiseChannel::NoiseChannel(Scheduler& scheduler, BIAS& bias)
-    : BaseChannel(true, false)
-    , scheduler(scheduler)
-    , bias(bias) {
+NoiseChannel::NoiseChannel(Scheduler& scheduler)
+    : BaseChannel(scheduler, true, false) {
   Reset();
 }
 
@@ -26,33 +24,27 @@ void NoiseChannel::Reset() {
 
   lfsr = 0;
   sample = 0;
-  skip_count = 0;
 }
 
-void NoiseChannel::Generate(int cycles_late) {
+bool NoiseChannel::Generate(int steps) {
   if (!IsEnabled()) {
     sample = 0;
-    return;
+    return false;
   }
 
   constexpr u16 lfsr_xor[2] = { 0x6000, 0x60 };
+  constexpr int lfsr_period[2] = { 32767, 127 };
 
-  int carry = lfsr & 1;
-
-  lfsr >>= 1;
-  if (carry) {
-    lfsr ^= lfsr_xor[width];
-    sample = +8;
-  } else {
-    sample = -8;
+  /* The LFSR repeats itself after each period, so whole periods can be skipped.
+   * The first 16 steps always run, since they shift out any bits above the 7-bit LFSR.
+   */
+  if (steps > 16 + lfsr_period[width]) {
+    steps = 16 + (steps - 16) % lfsr_period[width];
   }
 
-  sample *= envelope.current_volume;
+  int carry = 0;
 
-  if (!dac_enable) sample = 0;
-
-  // Skip samples that will never be sampled by the audio mixer.
-  for (int i = 0; i < skip_count; i++) {
+  for (int i = 0; i < steps; i++) {
     carry = lfsr & 1;
     lfsr >>= 1;
     if (carry) {
@@ -60,23 +52,13 @@ void NoiseChannel::Generate(int cycles_late) {
     }
   }
 
-  int noise_interval = GetSynthesisInterval(frequency_ratio, frequency_shift);
-  int mixer_interval = bias.GetSampleInterval();
-
-  /* If a channel generates at a higher rate than
-   * the audio mixer samples it, then it will generate samples
-   * that will be skipped anyways.
-   * In that case we can sample the channel at the same rate
-   * as the mixer rate and only output the sample that will be used.
-   */
-  if (noise_interval < mixer_interval) {
-    skip_count = mixer_interval/noise_interval - 1;
-    noise_interval = mixer_interval;
+  if (dac_enable) {
+    sample = s8((carry ? +8 : -8) * envelope.current_volume);
   } else {
-    skip_count = 0;
+    sample = 0;
   }
 
-  scheduler.Add(noise_interval - cycles_late, event_cb);
+  return true;
 }
 
 auto NoiseChannel::Read(int offset) -> u8 {
@@ -106,6 +88,8 @@ auto NoiseChannel::Read(int offset) -> u8 {
 }
 
 void NoiseChannel::Write(int offset, u8 value) {
+  Update();
+
   switch (offset) {
     // Length / Envelope
     case 0: {
@@ -151,12 +135,6 @@ void NoiseChannel::Write(int offset, u8 value) {
       length.enabled = value & 0x40;
 
       if (dac_enable && (value & 0x80)) {
-        if (!IsEnabled()) {
-          // TODO: properly handle skip count and properly align event to system clock.
-          skip_count = 0;
-          scheduler.Add(GetSynthesisInterval(frequency_ratio, frequency_shift), event_cb);
-        }
-
         constexpr u16 lfsr_init[] = { 0x4000, 0x0040 };
         lfsr = lfsr_init[width];
         Restart();
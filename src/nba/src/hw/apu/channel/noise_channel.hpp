@@ -10,21 +10,28 @@
 #include <nba/integer.hpp>
 
 #include "hw/apu/channel/base_channel.hpp"
-#include "hw/apu/registers.hpp"
 #include "scheduler.hpp"
 
 namespace nba::core {
 
 class NoiseChannel : public BaseChannel {
 public:
-  NoiseChannel(Scheduler& scheduler, BIAS& bias);
+  NoiseChannel(Scheduler& scheduler);
 
   void Reset();
-  auto GetSample() -> s8 override { return sample; }
-  void Generate(int cycles_late);
   auto Read (int offset) -> u8;
   void Write(int offset, u8 value);
 
+  void LoadState(SaveState::APU::IO::NoiseChannel const& state);
+  void CopyState(SaveState::APU::IO::NoiseChannel& state);
+
+protected:
+  auto GetStepInterval() -> int override {
+    return GetSynthesisInterval(frequency_ratio, frequency_shift);
+  }
+
+  bool Generate(int steps) override;
+
 private:
   constexpr int GetSynthesisInterval(int ratio, int shift) {
     int interval = 64 << shift;
@@ -39,20 +46,10 @@ private:
   }
 
   u16 lfsr;
-  s8 sample = 0;
-
-  Scheduler& scheduler;
-  std::function<void(int)> event_cb = [this](int cycles_late) {
-    this->Generate(cycles_late);
-  };
-
   int frequency_shift;
   int frequency_ratio;
   int width;
   bool dac_enable;
-
-  BIAS& bias;
-  int skip_count;
 };
 
 } // namespace nba::core
@@ -10,8 +10,7 @@
 namespace nba::core {
 
 QuadChannel::QuadChannel(Scheduler& scheduler)
-    : BaseChannel(true, true)
-    , scheduler(scheduler) {
+    : BaseChannel(scheduler, true, true) {
   Reset();
 }
 
@@ -23,10 +22,10 @@ void QuadChannel::Reset() {
   dac_enable = false;
 }
 
-void QuadChannel::Generate(int cycles_late) {
+bool QuadChannel::Generate(int steps) {
   if (!IsEnabled()) {
     sample = 0;
-    return;
+    return false;
   }
 
   constexpr s16 pattern[4][8] = {
@@ -36,14 +35,15 @@ void QuadChannel::Generate(int cycles_late) {
     { +8, +8, +8, +8, +8, +8, -8, -8 }
   };
 
+  // The output only depends on the position inside the duty cycle of the last step.
   if (dac_enable) {
-    sample = s8(pattern[wave_duty][phase] * envelope.current_volume);
+    sample = s8(pattern[wave_duty][(phase + steps - 1) % 8] * envelope.current_volume);
   } else {
     sample = 0;
   }
-  phase = (phase + 1) % 8;
+  phase = (phase + steps) % 8;
 
-  scheduler.Add(GetSynthesisIntervalFromFrequency(sweep.current_freq) - cycles_late, event_cb);
+  return true;
 }
 
 auto QuadChannel::Read(int offset) -> u8 {
@@ -77,6 +77,8 @@ auto QuadChannel::Read(int offset) -> u8 {
 }
 
 void QuadChannel::Write(int offset, u8 value) {
+  Update();
+
   switch (offset) {
     // Sweep Register
     case 0: {
@@ -133,10 +135,6 @@ void QuadChannel::Write(int offset, u8 value) {
       length.enabled = value & 0x40;
 
       if (dac_enable && (value & 0x80)) {
-        if (!IsEnabled()) {
-          // TODO: properly align event to system clock.
-          scheduler.Add(GetSynthesisIntervalFromFrequency(sweep.current_freq), event_cb);
-        }
         phase = 0;
         Restart();
       }
@@ -19,11 +19,19 @@ public:
   QuadChannel(Scheduler& scheduler);
 
   void Reset();
-  auto GetSample() -> s8 override { return sample; }
-  void Generate(int cycles_late);
   auto Read (int offset) -> u8;
   void Write(int offset, u8 value);
 
+  void LoadState(SaveState::APU::IO::QuadChannel const& state);
+  void CopyState(SaveState::APU::IO::QuadChannel& state);
+
+protected:
+  auto GetStepInterval() -> int override {
+    return GetSynthesisIntervalFromFrequency(sweep.current_freq);
+  }
+
+  bool Generate(int steps) override;
+
 private:
   constexpr int GetSynthesisIntervalFromFrequency(int frequency) {
     // 128 cycles equals 131072 Hz, the highest possible frequency.
@@ -32,12 +40,6 @@ private:
     return 128 * (2048 - frequency) / 8;
   }
 
-  Scheduler& scheduler;
-  std::function<void(int)> event_cb = [this](int cycles_late) {
-    this->Generate(cycles_late);
-  };
-
-  s8 sample = 0;
   int phase;
   int wave_duty;
   bool dac_enable;
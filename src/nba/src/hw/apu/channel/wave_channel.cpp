@@ -10,8 +10,7 @@
 namespace nba::core {
 
 WaveChannel::WaveChannel(Scheduler& scheduler)
-    : BaseChannel(false, false, 256)
-    , scheduler(scheduler) {
+    : BaseChannel(scheduler, false, false, 256) {
   Reset();
 }
 
@@ -35,18 +34,22 @@ void WaveChannel::Reset() {
   }
 }
 
-void WaveChannel::Generate(int cycles_late) {
+bool WaveChannel::Generate(int steps) {
   if (!IsEnabled()) {
     sample = 0;
-    if (BaseChannel::IsEnabled()) {
-      scheduler.Add(GetSynthesisIntervalFromFrequency(frequency) - cycles_late, event_cb);
-    }
-    return;
+    return BaseChannel::IsEnabled();
   }
 
-  auto byte = wave_ram[wave_bank][phase / 2];
+  /* In two-dimensional mode the channel plays 64 samples from both banks in turn,
+   * so the bank is the next bit of the position.
+   */
+  int length = dimension ? 64 : 32;
+  int position = (phase + steps - 1) % length;
+  int bank = wave_bank ^ (position >> 5);
+  int index = position & 31;
+  auto byte = wave_ram[bank][index / 2];
 
-  if ((phase % 2) == 0) {
+  if ((index % 2) == 0) {
     sample = byte >> 4;
   } else {
     sample = byte & 15;
@@ -56,17 +59,18 @@ void WaveChannel::Generate(int cycles_late) {
 
   sample = (sample - 8) * 4 * (force_volume ? 3 : volume_table[volume]);
 
-  if (++phase == 32) {
-    phase = 0;
-    if (dimension) {
-      wave_bank ^= 1;
-    }
+  position = phase + steps;
+  phase = position % 32;
+  if (dimension) {
+    wave_bank ^= (position / 32) & 1;
   }
 
-  scheduler.Add(GetSynthesisIntervalFromFrequency(frequency) - cycles_late, event_cb);
+  return true;
 }
 
 auto WaveChannel::Read(int offset) -> u8 {
+  Update();
+
   switch (offset) {
     // Stop / Wave RAM select
     case 0: {
@@ -94,6 +98,8 @@ auto WaveChannel::Read(int offset) -> u8 {
 }
 
 void WaveChannel::Write(int offset, u8 value) {
+  Update();
+
   switch (offset) {
     // Stop / Wave RAM select
     case 0: {
@@ -125,10 +131,6 @@ void WaveChannel::Write(int offset, u8 value) {
       length.enabled = value & 0x40;
 
       if (playing && (value & 0x80)) {
-        if (!BaseChannel::IsEnabled()) {
-          // TODO: properly align event to system clock.
-          scheduler.Add(GetSynthesisIntervalFromFrequency(frequency), event_cb);
-        }
         phase = 0;
         if (dimension) {
           wave_bank = 0;
@@ -20,31 +20,35 @@ public:
 
   void Reset();
   bool IsEnabled() override { return playing && BaseChannel::IsEnabled(); }
-  auto GetSample() -> s8 override { return sample; }
-  void Generate(int cycles_late);
   auto Read (int offset) -> u8;
   void Write(int offset, u8 value);
 
+  void LoadState(SaveState::APU::IO::WaveChannel const& state);
+  void CopyState(SaveState::APU::IO::WaveChannel& state);
+
   auto ReadSample(int offset) -> u8 {
+    Update();
     return wave_ram[wave_bank ^ 1][offset];
   }
 
   void WriteSample(int offset, u8 value) {
+    Update();
     wave_ram[wave_bank ^ 1][offset] = value;
   }
 
+protected:
+  auto GetStepInterval() -> int override {
+    return GetSynthesisIntervalFromFrequency(frequency);
+  }
+
+  bool Generate(int steps) override;
+
 private:
   constexpr int GetSynthesisIntervalFromFrequency(int frequency) {
     // 8 cycles equals 2097152 Hz, the highest possible sample rate.
     return 8 * (2048 - frequency);
   }
 
-  Scheduler& scheduler;
-  std::function<void(int)> event_cb = [this](int cycles_late) {
-    this->Generate(cycles_late);
-  };
-
-  s8 sample = 0;
   bool playing;
   bool force_volume;
   int volume;
@@ -6,21 +6,47 @@
  */
 
 #include <nba/log.hpp>
+#include <nba/trace.hpp>
 
 #include "bus/bus.hpp"
 #include "hw/apu/hle/mp2k.hpp"
 
+#if defined(__SSE2__) || defined(_M_X64)
+  #include <emmintrin.h>
+  #define NBA_MP2K_SSE2
+#elif defined(__ARM_NEON)
+  #include <arm_neon.h>
+  #define NBA_MP2K_NEON
+#endif
+
 namespace nba::core {
 
+MP2K::~MP2K() {
+  StopMixerThread();
+}
+
 void MP2K::Reset() {
+  if (config->audio.mp2k_hle_threaded) {
+    StartMixerThread();
+    WaitForMixerThread();
+  } else {
+    StopMixerThread();
+  }
+
   engaged = false;
   use_cubic_filter = false;
   total_frame_count = 0;
   current_frame = 0;
   buffer_read_index = 0;
+  start_mask = 0;
+  job_submitted = false;
   for (auto& entry : samplers) {
     entry = {};
   }
+  for (int i = 0; i < kMaxSoundChannels; i++) {
+    start_wave_info[i] = {};
+    wave_data[i] = nullptr;
+  }
 }
 
 void MP2K::SoundMainRAM(SoundInfo const& sound_info) {
@@ -45,7 +71,6 @@ void MP2K::SoundMainRAM(SoundInfo const& sound_info) {
 
   for (int i = 0; i < max_channels; i++) {
     auto& channel = this->sound_info.channels[i];
-    auto& sampler = samplers[i];
     auto  envelope_volume = u32(channel.envelope_volume);
     auto  envelope_phase = channel.status & CHANNEL_ENV_MASK;
 
@@ -66,11 +91,15 @@ void MP2K::SoundMainRAM(SoundInfo const& sound_info) {
         channel.status = CHANNEL_ENV_ATTACK;
       }
 
-      sampler = {};
-      sampler.wave_info = *bus.GetHostAddress<Sampler::WaveInfo>(channel.wave_address);
-      if (sampler.wave_info.status & 0xC000) {
+      // The sampler belongs to the mixer thread, so it starts over with the next job.
+      auto& wave_info = start_wave_info[i];
+
+      wave_info = *bus.GetHostAddress<Sampler::WaveInfo>(channel.wave_address);
+      if (wave_info.status & 0xC000) {
         channel.status |= CHANNEL_LOOP;
       }
+      start_mask |= 1 << i;
+      wave_data[i] = nullptr;
     } else if (channel.status & CHANNEL_ECHO) {
       if (channel.echo_length-- == 0) {
         channel.status = 0;
@@ -117,25 +146,65 @@ void MP2K::SoundMainRAM(SoundInfo const& sound_info) {
   }
 }
 
-void MP2K::RenderFrame() {
-  static constexpr float kDifferentialLUT[] = {
-    S8ToFloat(0x00), S8ToFloat(0x01), S8ToFloat(0x04), S8ToFloat(0x09),
-    S8ToFloat(0x10), S8ToFloat(0x19), S8ToFloat(0x24), S8ToFloat(0x31),
-    S8ToFloat(0xC0), S8ToFloat(0xCF), S8ToFloat(0xDC), S8ToFloat(0xE7),
-    S8ToFloat(0xF0), S8ToFloat(0xF7), S8ToFloat(0xFC), S8ToFloat(0xFF)
-  };
+void MP2K::PrepareJob(Job& job, int frame) {
+  auto max_channels = std::min(sound_info.max_channels, kMaxSoundChannels);
 
-  current_frame = (current_frame + 1) % total_frame_count;
+  job.sound_info = sound_info;
+  job.start_mask = start_mask;
+  job.cubic = use_cubic_filter;
+  job.frame = frame;
 
+  for (int i = 0; i < max_channels; i++) {
+    auto const& channel = sound_info.channels[i];
+
+    if ((channel.status & CHANNEL_ON) == 0) {
+      continue;
+    }
+
+    if (start_mask & (1 << i)) {
+      job.wave_info[i] = start_wave_info[i];
+    }
+
+    bool compressed = (channel.type & 32) != 0;
+
+    if (wave_data[i] == nullptr || wave_compressed[i] != compressed) {
+      auto wave_size = start_wave_info[i].number_of_samples;
+      if (compressed) {
+        wave_size *= 33;
+        wave_size = (wave_size + 63) / 64;
+      }
+      wave_data[i] = bus.GetHostAddress<u8>(
+        channel.wave_address + sizeof(Sampler::WaveInfo), wave_size
+      );
+      wave_compressed[i] = compressed;
+    }
+
+    job.wave_data[i] = wave_data[i];
+  }
+
+  start_mask = 0;
+}
+
+void MP2K::RenderFrame(Job const& job) {
+  NBA_TRACE_ZONE("MP2K::RenderFrame");
+
+  auto const& sound_info = job.sound_info;
   auto reverb = sound_info.reverb;
   auto max_channels = std::min(sound_info.max_channels, kMaxSoundChannels);
-  auto destination = &buffer[current_frame * kSamplesPerFrame * 2];
+  auto destination = &buffer[job.frame * kSamplesPerFrame * 2];
+
+  for (int i = 0; i < kMaxSoundChannels; i++) {
+    if (job.start_mask & (1 << i)) {
+      samplers[i] = {};
+      samplers[i].wave_info = job.wave_info[i];
+    }
+  }
 
   if (reverb == 0) {
     std::memset(destination, 0, kSamplesPerFrame * 2 * sizeof(float));
   } else {
     auto factor = reverb / (128.0 * 4.0);
-    auto other_frame  = (current_frame + 1) % total_frame_count;
+    auto other_frame  = (job.frame + 1) % total_frame_count;
     auto other_buffer = &buffer[other_frame * kSamplesPerFrame * 2];
 
     for (int i = 0; i < kSamplesPerFrame; i++) {
@@ -169,107 +238,212 @@ void MP2K::RenderFrame() {
       angular_step = channel.frequency / float(kSampleRate);
     }
 
-    auto volume_l = channel.envelope_volume_l / 255.0;
-    auto volume_r = channel.envelope_volume_r / 255.0;
-    bool compressed = (channel.type & 32) != 0;
-    auto sample_history = sampler.sample_history;
-
-    auto const& wave_info = sampler.wave_info;
+    // The envelope only changes in SoundMainRAM(), so the volume is constant for the whole frame.
+    auto volume_l = channel.envelope_volume_l / 255.0f;
+    auto volume_r = channel.envelope_volume_r / 255.0f;
 
-    if (sampler.compressed != compressed || !sampler.wave_data) {
-      auto wave_size = wave_info.number_of_samples;
-      if (compressed) {
-        wave_size *= 33;
-        wave_size = (wave_size + 63) / 64;
-      }
-      sampler.wave_data = bus.GetHostAddress<u8>(
-        channel.wave_address + sizeof(Sampler::WaveInfo), wave_size
-      );
-      sampler.compressed = compressed;
-    }
-
-    auto wave_data = sampler.wave_data;
+    FetchSamples(channel, sampler, job.wave_data[i], job.cubic, angular_step);
+    MixSamples(destination, volume_r, volume_l, job.cubic);
+  }
+}
 
-    for (int j = 0; j < kSamplesPerFrame; j++) {
-      if (sampler.should_fetch_sample) {
-        float sample;
+void MP2K::FetchSamples(SoundChannel const& channel, Sampler& sampler, u8 const* wave_data, bool cubic, float angular_step) {
+  static constexpr float kDifferentialLUT[] = {
+    S8ToFloat(0x00), S8ToFloat(0x01), S8ToFloat(0x04), S8ToFloat(0x09),
+    S8ToFloat(0x10), S8ToFloat(0x19), S8ToFloat(0x24), S8ToFloat(0x31),
+    S8ToFloat(0xC0), S8ToFloat(0xCF), S8ToFloat(0xDC), S8ToFloat(0xE7),
+    S8ToFloat(0xF0), S8ToFloat(0xF7), S8ToFloat(0xFC), S8ToFloat(0xFF)
+  };
 
-        if (compressed) {
-          auto block_offset  = sampler.current_position & 63;
-          auto block_address = (sampler.current_position >> 6) * 33;
+  bool compressed = (channel.type & 32) != 0;
+  auto sample_history = sampler.sample_history;
 
-          if (block_offset == 0) {
-            sample = S8ToFloat(wave_data[block_address]);
-          } else {
-            sample = sample_history[0];
-          }
+  auto const& wave_info = sampler.wave_info;
 
-          auto address = block_address + (block_offset >> 1) + 1;
-          auto lut_index = wave_data[address];
+  for (int j = 0; j < kSamplesPerFrame; j++) {
+    if (sampler.should_fetch_sample) {
+      float sample;
 
-          if (block_offset & 1) {
-            lut_index &= 15;
-          } else {
-            lut_index >>= 4;
-          }
+      if (compressed) {
+        auto block_offset  = sampler.current_position & 63;
+        auto block_address = (sampler.current_position >> 6) * 33;
 
-          sample += kDifferentialLUT[lut_index];
+        if (block_offset == 0) {
+          sample = S8ToFloat(wave_data[block_address]);
         } else {
-          sample = S8ToFloat(wave_data[sampler.current_position]);
+          sample = sample_history[0];
         }
 
-        if (UseCubicFilter()) {
-          sample_history[3] = sample_history[2];
-          sample_history[2] = sample_history[1];
+        auto address = block_address + (block_offset >> 1) + 1;
+        auto lut_index = wave_data[address];
+
+        if (block_offset & 1) {
+          lut_index &= 15;
+        } else {
+          lut_index >>= 4;
         }
-        sample_history[1] = sample_history[0];
-        sample_history[0] = sample;
 
-        sampler.should_fetch_sample = false;
+        sample += kDifferentialLUT[lut_index];
+      } else {
+        sample = S8ToFloat(wave_data[sampler.current_position]);
       }
 
-      float sample;
-      float mu = sampler.resample_phase;
-
-      if (UseCubicFilter()) {
-        // http://paulbourke.net/miscellaneous/interpolation/
-        float mu2 = mu * mu;
-        float a0 = sample_history[0] - sample_history[1] - sample_history[3] + sample_history[2];
-        float a1 = sample_history[3] - sample_history[2] - a0;
-        float a2 = sample_history[1] - sample_history[3];
-        float a3 = sample_history[2]; 
-        sample = a0 * mu * mu2 + a1 * mu2 + a2 * mu + a3;
-      } else {
-        sample = sample_history[0] * mu + sample_history[1] * (1.0 - mu);
+      if (cubic) {
+        sample_history[3] = sample_history[2];
+        sample_history[2] = sample_history[1];
       }
+      sample_history[1] = sample_history[0];
+      sample_history[0] = sample;
 
-      destination[j * 2 + 0] += sample * volume_r;
-      destination[j * 2 + 1] += sample * volume_l;
+      sampler.should_fetch_sample = false;
+    }
+
+    voice_frame.mu[j] = sampler.resample_phase;
+    voice_frame.history[0][j] = sample_history[0];
+    voice_frame.history[1][j] = sample_history[1];
+    if (cubic) {
+      voice_frame.history[2][j] = sample_history[2];
+      voice_frame.history[3][j] = sample_history[3];
+    }
 
-      sampler.resample_phase += angular_step;
+    sampler.resample_phase += angular_step;
 
-      if (sampler.resample_phase >= 1) {
-        auto n = int(sampler.resample_phase);
-        sampler.resample_phase -= n;
-        sampler.current_position += n;
-        sampler.should_fetch_sample = true;
+    if (sampler.resample_phase >= 1) {
+      auto n = int(sampler.resample_phase);
+      sampler.resample_phase -= n;
+      sampler.current_position += n;
+      sampler.should_fetch_sample = true;
 
-        if (sampler.current_position >= wave_info.number_of_samples) {
-          if (channel.status & CHANNEL_LOOP) {
-            sampler.current_position = wave_info.loop_position + n - 1;
-          } else {
-            sampler.current_position = wave_info.number_of_samples;
-            sampler.should_fetch_sample = false;
-          }
+      if (sampler.current_position >= wave_info.number_of_samples) {
+        if (channel.status & CHANNEL_LOOP) {
+          sampler.current_position = wave_info.loop_position + n - 1;
+        } else {
+          sampler.current_position = wave_info.number_of_samples;
+          sampler.should_fetch_sample = false;
         }
       }
     }
   }
 }
 
+void MP2K::MixSamples(float* destination, float volume_r, float volume_l, bool cubic) {
+  auto mu = voice_frame.mu;
+  auto h0 = voice_frame.history[0];
+  auto h1 = voice_frame.history[1];
+  auto h2 = voice_frame.history[2];
+  auto h3 = voice_frame.history[3];
+  int j = 0;
+
+  /* Four output samples are interpolated at once and then interleaved with themselves,
+   * so that each half can be scaled by the stereo volume and added to two stereo frames.
+   */
+#if defined(NBA_MP2K_SSE2)
+  auto volume = _mm_setr_ps(volume_r, volume_l, volume_r, volume_l);
+
+  for (; j + 4 <= kSamplesPerFrame; j += 4) {
+    auto m  = _mm_load_ps(&mu[j]);
+    auto s0 = _mm_load_ps(&h0[j]);
+    auto s1 = _mm_load_ps(&h1[j]);
+    __m128 sample;
+
+    if (cubic) {
+      // http://paulbourke.net/miscellaneous/interpolation/
+      auto s2 = _mm_load_ps(&h2[j]);
+      auto s3 = _mm_load_ps(&h3[j]);
+      auto a0 = _mm_add_ps(_mm_sub_ps(_mm_sub_ps(s0, s1), s3), s2);
+      auto a1 = _mm_sub_ps(_mm_sub_ps(s3, s2), a0);
+      auto a2 = _mm_sub_ps(s1, s3);
+
+      sample = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(a0, m), a1), m), a2), m), s2);
+    } else {
+      sample = _mm_add_ps(s1, _mm_mul_ps(_mm_sub_ps(s0, s1), m));
+    }
+
+    auto out_lo = _mm_loadu_ps(&destination[j * 2 + 0]);
+    auto out_hi = _mm_loadu_ps(&destination[j * 2 + 4]);
+
+    _mm_storeu_ps(&destination[j * 2 + 0], _mm_add_ps(out_lo, _mm_mul_ps(_mm_unpacklo_ps(sample, sample), volume)));
+    _mm_storeu_ps(&destination[j * 2 + 4], _mm_add_ps(out_hi, _mm_mul_ps(_mm_unpackhi_ps(sample, sample), volume)));
+  }
+#elif defined(NBA_MP2K_NEON)
+  float volume_lanes[4] = { volume_r, volume_l, volume_r, volume_l };
+  auto volume = vld1q_f32(volume_lanes);
+
+  for (; j + 4 <= kSamplesPerFrame; j += 4) {
+    auto m  = vld1q_f32(&mu[j]);
+    auto s0 = vld1q_f32(&h0[j]);
+    auto s1 = vld1q_f32(&h1[j]);
+    float32x4_t sample;
+
+    if (cubic) {
+      auto s2 = vld1q_f32(&h2[j]);
+      auto s3 = vld1q_f32(&h3[j]);
+      auto a0 = vaddq_f32(vsubq_f32(vsubq_f32(s0, s1), s3), s2);
+      auto a1 = vsubq_f32(vsubq_f32(s3, s2), a0);
+      auto a2 = vsubq_f32(s1, s3);
+
+      sample = vmlaq_f32(s2, vmlaq_f32(a2, vmlaq_f32(a1, a0, m), m), m);
+    } else {
+      sample = vmlaq_f32(s1, vsubq_f32(s0, s1), m);
+    }
+
+    auto pairs = vzipq_f32(sample, sample);
+
+    vst1q_f32(&destination[j * 2 + 0], vmlaq_f32(vld1q_f32(&destination[j * 2 + 0]), pairs.val[0], volume));
+    vst1q_f32(&destination[j * 2 + 4], vmlaq_f32(vld1q_f32(&destination[j * 2 + 4]), pairs.val[1], volume));
+  }
+#endif
+
+  for (; j < kSamplesPerFrame; j++) {
+    float sample;
+    float m = mu[j];
+
+    if (cubic) {
+      // http://paulbourke.net/miscellaneous/interpolation/
+      float a0 = h0[j] - h1[j] - h3[j] + h2[j];
+      float a1 = h3[j] - h2[j] - a0;
+      float a2 = h1[j] - h3[j];
+      float a3 = h2[j];
+      sample = ((a0 * m + a1) * m + a2) * m + a3;
+    } else {
+      sample = h1[j] + (h0[j] - h1[j]) * m;
+    }
+
+    destination[j * 2 + 0] += sample * volume_r;
+    destination[j * 2 + 1] += sample * volume_l;
+  }
+}
+
 auto MP2K::ReadSample() -> float* {
   if (buffer_read_index == 0) {
-    RenderFrame();
+    int next_frame = (current_frame + 1) % total_frame_count;
+
+    /* The mixer thread renders into the slot after the one that is read and reverb reads the slot after that,
+     * so it needs at least two slots to never touch the one that is read.
+     */
+    if (mixer_thread && total_frame_count >= 2) {
+      if (job_submitted) {
+        WaitForMixerThread();
+      } else {
+        PrepareJob(job, next_frame);
+        RenderFrame(job);
+      }
+
+      current_frame = next_frame;
+
+      {
+        std::lock_guard lock{mixer_thread->mutex};
+        PrepareJob(mixer_thread->job, (current_frame + 1) % total_frame_count);
+        mixer_thread->busy = true;
+      }
+
+      mixer_thread->cv_submit.notify_one();
+      job_submitted = true;
+    } else {
+      PrepareJob(job, next_frame);
+      RenderFrame(job);
+      current_frame = next_frame;
+    }
   }
 
   auto sample = &buffer[(current_frame * kSamplesPerFrame + buffer_read_index) * 2];
@@ -281,4 +455,69 @@ auto MP2K::ReadSample() -> float* {
   return sample;
 }
 
+void MP2K::StartMixerThread() {
+  if (mixer_thread) {
+    return;
+  }
+
+  mixer_thread = std::make_unique<MixerThread>();
+  mixer_thread->thread = std::thread{&MP2K::MixerThreadLoop, this};
+}
+
+void MP2K::StopMixerThread() {
+  if (!mixer_thread) {
+    return;
+  }
+
+  {
+    std::lock_guard lock{mixer_thread->mutex};
+    mixer_thread->quit = true;
+  }
+
+  mixer_thread->cv_submit.notify_one();
+  mixer_thread->thread.join();
+  mixer_thread.reset();
+  job_submitted = false;
+}
+
+void MP2K::Sync() {
+  if (mixer_thread) {
+    WaitForMixerThread();
+  }
+}
+
+void MP2K::WaitForMixerThread() {
+  std::unique_lock lock{mixer_thread->mutex};
+
+  mixer_thread->cv_done.wait(lock, [this] { return !mixer_thread->busy; });
+}
+
+void MP2K::MixerThreadLoop() {
+  auto& mt = *mixer_thread;
+
+  NBA_TRACE_THREAD("MP2K mixer thread");
+
+  if (config->on_thread_start) {
+    config->on_thread_start("MP2K mixer thread");
+  }
+
+  while (true) {
+    std::unique_lock lock{mt.mutex};
+
+    mt.cv_submit.wait(lock, [&] { return mt.quit || mt.busy; });
+
+    // A submitted job is finished first, so that the emulation thread never waits for it in vain.
+    if (!mt.busy) {
+      break;
+    }
+
+    lock.unlock();
+    RenderFrame(mt.job);
+    lock.lock();
+
+    mt.busy = false;
+    mt.cv_done.notify_one();
+  }
+}
+
 } // namespace nba::core
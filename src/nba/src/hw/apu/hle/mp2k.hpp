@@ -7,7 +7,12 @@
 
 #pragma once
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <nba/config.hpp>
 #include <nba/integer.hpp>
+#include <thread>
 
 namespace nba::core {
 
@@ -65,10 +70,12 @@ struct MP2K {
     SoundChannel channels[kMaxSoundChannels];
   };
 
-  MP2K(Bus& bus) : bus(bus) {
+  MP2K(Bus& bus, std::shared_ptr<Config> config) : bus(bus), config(config) {
     Reset();
   }
 
+ ~MP2K();
+
   bool IsEngaged() const {
     return engaged;
   }
@@ -77,11 +84,14 @@ struct MP2K {
     return use_cubic_filter;
   }
 
-  void Reset();  
+  // Also starts or stops the mixer thread, see Config::Audio::mp2k_hle_threaded.
+  void Reset();
   void SoundMainRAM(SoundInfo const& sound_info);
-  void RenderFrame();
   auto ReadSample() -> float*;
 
+  // Waits for the frame that the mixer thread is rendering, which reads the wave data from the ROM.
+  void Sync();
+
 private:
   static constexpr int kDMABufferSize = 1582;
   static constexpr int kSampleRate = 65536;
@@ -92,7 +102,6 @@ private:
   }
 
   struct Sampler {
-    bool compressed = false;
     bool should_fetch_sample = true;
     u32 current_position = 0;
     float resample_phase = 0.0;
@@ -105,18 +114,75 @@ private:
       u32 loop_position;
       u32 number_of_samples;
     } wave_info;
-
-    u8* wave_data = nullptr;
   } samplers[kMaxSoundChannels];
 
+  /* Everything that is needed to render a frame, so that it can be rendered on the mixer thread
+   * while SoundMainRAM() updates the channels for the next one. The wave data is resolved in advance,
+   * since only the emulation thread may look up host addresses.
+   */
+  struct Job {
+    SoundInfo sound_info;
+    u16 start_mask; // channels whose sampler starts over at the beginning of the wave (in wave_info)
+    Sampler::WaveInfo wave_info[kMaxSoundChannels];
+    u8 const* wave_data[kMaxSoundChannels];
+    bool cubic;
+    int frame; // the slot of the buffer to render into
+  };
+
+  /* The input samples and resample phase of the current voice for each output sample of a frame.
+   * Fetching is serial, since it depends on the previous sample and the wave position,
+   * but the interpolation and mixing can then process several output samples at once.
+   */
+  struct VoiceFrame {
+    // Each row is padded to a multiple of four samples, so that every row stays 16-byte aligned for the SIMD loads.
+    static constexpr int kStride = (kSamplesPerFrame + 3) & ~3;
+
+    alignas(16) float mu[kStride];
+    alignas(16) float history[4][kStride];
+  } voice_frame;
+
+  /* Renders each frame on a separate thread, one frame ahead: the frame that is read next was submitted
+   * when reading of the current frame started, with the channels as they were at that time.
+   */
+  struct MixerThread {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv_submit;
+    std::condition_variable cv_done;
+    bool quit = false;
+    bool busy = false;
+    Job job;
+  };
+
+  void PrepareJob(Job& job, int frame);
+  void RenderFrame(Job const& job);
+  void FetchSamples(SoundChannel const& channel, Sampler& sampler, u8 const* wave_data, bool cubic, float angular_step);
+  void MixSamples(float* destination, float volume_r, float volume_l, bool cubic);
+
+  void StartMixerThread();
+  void StopMixerThread();
+  void WaitForMixerThread();
+  void MixerThreadLoop();
+
   bool engaged;
   bool use_cubic_filter;
   Bus& bus;
+  std::shared_ptr<Config> config;
   SoundInfo sound_info;
   std::unique_ptr<float[]> buffer;
   int total_frame_count;
   int current_frame;
   int buffer_read_index;
+
+  // Channels that were started since the last job, with the wave of each and the wave data that was last resolved.
+  u16 start_mask;
+  Sampler::WaveInfo start_wave_info[kMaxSoundChannels];
+  u8 const* wave_data[kMaxSoundChannels];
+  bool wave_compressed[kMaxSoundChannels];
+
+  Job job;
+  std::unique_ptr<MixerThread> mixer_thread;
+  bool job_submitted = false;
 };
 
 } // namespace nba::core
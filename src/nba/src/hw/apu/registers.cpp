@@ -30,6 +30,7 @@ void SoundControl::Reset() {
   dma[1].enable[0] = false;
   dma[1].enable[1] = false;
   dma[1].timer_id = 0;
+  UpdateActivity();
 }
 
 auto SoundControl::Read(int address) -> u8 {
@@ -58,7 +59,11 @@ auto SoundControl::Read(int address) -> u8 {
              (dma[DMA_B].enable[SIDE_LEFT ] ? 32 : 0) |
              (dma[DMA_B].timer_id       ? 64 : 0);
     case 4:
-      
+      psg1.Update();
+      psg2.Update();
+      psg3.Update();
+      psg4.Update();
+
       return (psg1.IsEnabled() ? 1 : 0) |
              (psg2.IsEnabled() ? 2 : 0) |
              (psg3.IsEnabled() ? 4 : 0) |
@@ -106,6 +111,35 @@ void SoundControl::Write(int address, u8 value) {
       master_enable = value & 128;
       break;
   }
+
+  UpdateActivity();
+}
+
+void SoundControl::UpdateActivity() {
+  active_psg = 0;
+
+  if (!master_enable) {
+    active_fifo[DMA_A] = false;
+    active_fifo[DMA_B] = false;
+    return;
+  }
+
+  // A PSG volume of three (and a master volume of zero for a side) mutes the PSG channels.
+  if (psg.volume != 3) {
+    for (int side = 0; side < 2; side++) {
+      if (psg.master[side] != 0) {
+        for (int channel = 0; channel < 4; channel++) {
+          if (psg.enable[side][channel]) {
+            active_psg |= 1 << channel;
+          }
+        }
+      }
+    }
+  }
+
+  for (int fifo = 0; fifo < 2; fifo++) {
+    active_fifo[fifo] = dma[fifo].enable[SIDE_LEFT] || dma[fifo].enable[SIDE_RIGHT];
+  }
 }
 
 void BIAS::Reset() {
@@ -52,9 +52,17 @@ struct SoundControl {
     int  timer_id;
   } dma[2];
 
+  /* The sources that can be heard, with one bit per PSG channel. Derived from the registers above.
+   * The mixer neither updates nor mixes the other sources. PSG channels catch up on their next
+   * register access or once they can be heard again, FIFOs keep being drained by their timer.
+   */
+  int active_psg;
+  bool active_fifo[2];
+
   void Reset();
   auto Read(int address) -> u8;
   void Write(int address, u8 value);
+  void UpdateActivity();
 
 private:
   FIFO* fifos;
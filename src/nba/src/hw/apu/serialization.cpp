@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <cstring>
+
+#include "apu.hpp"
+
+namespace nba::core {
+
+bool APU::ValidateState(SaveState const& state) {
+  auto& io = state.apu.io;
+
+  for (auto& fifo : state.apu.fifo) {
+    auto length = sizeof(fifo.data);
+
+    if (fifo.rd_ptr >= length || fifo.wr_ptr >= length || fifo.count > length) {
+      return false;
+    }
+  }
+
+  return io.psg1.wave_duty < 4 &&
+         io.psg2.wave_duty < 4 &&
+         io.psg3.wave_bank < 2 &&
+         io.psg4.width < 2;
+}
+
+void APU::LoadState(SaveState const& state) {
+  auto& io = state.apu.io;
+  auto& psg = mmio.soundcnt.psg;
+
+  mmio.fifo[0].LoadState(state.apu.fifo[0]);
+  mmio.fifo[1].LoadState(state.apu.fifo[1]);
+  mmio.psg1.LoadState(io.psg1);
+  mmio.psg2.LoadState(io.psg2);
+  mmio.psg3.LoadState(io.psg3);
+  mmio.psg4.LoadState(io.psg4);
+
+  mmio.soundcnt.master_enable = io.soundcnt.master_enable;
+  psg.volume = io.soundcnt.psg.volume;
+  for (int side = 0; side < 2; side++) {
+    psg.master[side] = io.soundcnt.psg.master[side];
+    for (int channel = 0; channel < 4; channel++) {
+      psg.enable[side][channel] = io.soundcnt.psg.enable[side][channel];
+    }
+  }
+
+  for (int fifo = 0; fifo < 2; fifo++) {
+    auto& dma = mmio.soundcnt.dma[fifo];
+
+    dma.volume = io.soundcnt.dma[fifo].volume;
+    dma.enable[0] = io.soundcnt.dma[fifo].enable[0];
+    dma.enable[1] = io.soundcnt.dma[fifo].enable[1];
+    dma.timer_id = io.soundcnt.dma[fifo].timer_id;
+    latch[fifo] = state.apu.latch[fifo];
+  }
+
+  mmio.soundcnt.UpdateActivity();
+
+  mmio.bias.level = io.bias.level;
+  mmio.bias.resolution = io.bias.resolution;
+
+  // The mixer output is not observable by the game, so batch mixing simply resumes at the current timestamp.
+  mixer_timestamp = scheduler.GetTimestampNow();
+  output_timestamp = scheduler.GetTimestampNow();
+
+  /* The HLE mixer is not part of the emulated system.
+   * It will be engaged again the next time that the game calls SoundMainRAM().
+   */
+  bool use_cubic_filter = mp2k.UseCubicFilter();
+  mp2k.Reset();
+  mp2k.UseCubicFilter() = use_cubic_filter;
+
+  if (audio_thread) {
+    FlushAudioEvents();
+    SyncAudioThread();
+  }
+}
+
+void APU::CopyState(SaveState& state) {
+  auto& io = state.apu.io;
+  auto& psg = mmio.soundcnt.psg;
+
+  Sync();
+
+  mmio.fifo[0].CopyState(state.apu.fifo[0]);
+  mmio.fifo[1].CopyState(state.apu.fifo[1]);
+  mmio.psg1.CopyState(io.psg1);
+  mmio.psg2.CopyState(io.psg2);
+  mmio.psg3.CopyState(io.psg3);
+  mmio.psg4.CopyState(io.psg4);
+
+  io.soundcnt.master_enable = mmio.soundcnt.master_enable;
+  io.soundcnt.psg.volume = u8(psg.volume);
+  for (int side = 0; side < 2; side++) {
+    io.soundcnt.psg.master[side] = u8(psg.master[side]);
+    for (int channel = 0; channel < 4; channel++) {
+      io.soundcnt.psg.enable[side][channel] = psg.enable[side][channel];
+    }
+  }
+
+  for (int fifo = 0; fifo < 2; fifo++) {
+    auto& dma = mmio.soundcnt.dma[fifo];
+
+    io.soundcnt.dma[fifo].volume = u8(dma.volume);
+    io.soundcnt.dma[fifo].enable[0] = dma.enable[0];
+    io.soundcnt.dma[fifo].enable[1] = dma.enable[1];
+    io.soundcnt.dma[fifo].timer_id = u8(dma.timer_id);
+    state.apu.latch[fifo] = latch[fifo];
+  }
+
+  io.bias.level = u16(mmio.bias.level);
+  io.bias.resolution = u8(mmio.bias.resolution);
+}
+
+void FIFO::LoadState(SaveState::APU::FIFO const& state) {
+  std::memcpy(data, state.data, sizeof(data));
+  rd_ptr = state.rd_ptr;
+  wr_ptr = state.wr_ptr;
+  count = state.count;
+}
+
+void FIFO::CopyState(SaveState::APU::FIFO& state) {
+  std::memcpy(state.data, data, sizeof(data));
+  state.rd_ptr = u8(rd_ptr);
+  state.wr_ptr = u8(wr_ptr);
+  state.count = u8(count);
+}
+
+void BaseChannel::LoadState(SaveState::APU::IO::PSG const& state) {
+  auto now = scheduler.GetTimestampNow();
+
+  enabled = state.enabled;
+  step = state.step;
+  sample = state.sample;
+  stepping = state.stepping;
+  timestamp_step = now + state.step_delay;
+  timestamp_tick = now + state.tick_delay;
+
+  length.enabled = state.length.enabled;
+  length.length = state.length.length;
+
+  envelope.active = state.envelope.active;
+  envelope.enabled = state.envelope.enabled;
+  envelope.direction = (Envelope::Direction)state.envelope.direction;
+  envelope.initial_volume = state.envelope.initial_volume;
+  envelope.current_volume = state.envelope.current_volume;
+  envelope.divider = state.envelope.divider;
+  envelope.step = state.envelope.step;
+
+  sweep.active = state.sweep.active;
+  sweep.enabled = state.sweep.enabled;
+  sweep.direction = (Sweep::Direction)state.sweep.direction;
+  sweep.initial_freq = state.sweep.initial_freq;
+  sweep.current_freq = state.sweep.current_freq;
+  sweep.shadow_freq = state.sweep.shadow_freq;
+  sweep.divider = state.sweep.divider;
+  sweep.shift = state.sweep.shift;
+  sweep.step = state.sweep.step;
+}
+
+void BaseChannel::CopyState(SaveState::APU::IO::PSG& state) {
+  auto now = scheduler.GetTimestampNow();
+
+  Update(now);
+
+  state.enabled = enabled;
+  state.step = u8(step);
+  state.sample = sample;
+  state.stepping = stepping;
+  state.step_delay = stepping ? u32(timestamp_step - now) : 0;
+  state.tick_delay = u32(timestamp_tick - now);
+
+  state.length.enabled = length.enabled;
+  state.length.length = u16(length.length);
+
+  state.envelope.active = envelope.active;
+  state.envelope.enabled = envelope.enabled;
+  state.envelope.direction = envelope.direction == Envelope::Direction::Increment;
+  state.envelope.initial_volume = u8(envelope.initial_volume);
+  state.envelope.current_volume = u8(envelope.current_volume);
+  state.envelope.divider = u8(envelope.divider);
+  state.envelope.step = u8(envelope.step);
+
+  state.sweep.active = sweep.active;
+  state.sweep.enabled = sweep.enabled;
+  state.sweep.direction = sweep.direction == Sweep::Direction::Decrement;
+  state.sweep.initial_freq = u16(sweep.initial_freq);
+  state.sweep.current_freq = u16(sweep.current_freq);
+  state.sweep.shadow_freq = u16(sweep.shadow_freq);
+  state.sweep.divider = u8(sweep.divider);
+  state.sweep.shift = u8(sweep.shift);
+  state.sweep.step = u8(sweep.step);
+}
+
+void QuadChannel::LoadState(SaveState::APU::IO::QuadChannel const& state) {
+  BaseChannel::LoadState(state);
+  phase = state.phase;
+  wave_duty = state.wave_duty;
+  dac_enable = state.dac_enable;
+}
+
+void QuadChannel::CopyState(SaveState::APU::IO::QuadChannel& state) {
+  BaseChannel::CopyState(state);
+  state.phase = u8(phase);
+  state.wave_duty = u8(wave_duty);
+  state.dac_enable = dac_enable;
+}
+
+void WaveChannel::LoadState(SaveState::APU::IO::WaveChannel const& state) {
+  BaseChannel::LoadState(state);
+  playing = state.playing;
+  force_volume = state.force_volume;
+  volume = state.volume;
+  frequency = state.frequency;
+  dimension = state.dimension;
+  wave_bank = state.wave_bank;
+  std::memcpy(wave_ram, state.wave_ram, sizeof(wave_ram));
+  phase = state.phase;
+}
+
+void WaveChannel::CopyState(SaveState::APU::IO::WaveChannel& state) {
+  BaseChannel::CopyState(state);
+  state.playing = playing;
+  state.force_volume = force_volume;
+  state.volume = u8(volume);
+  state.frequency = u16(frequency);
+  state.dimension = u8(dimension);
+  state.wave_bank = u8(wave_bank);
+  std::memcpy(state.wave_ram, wave_ram, sizeof(wave_ram));
+  state.phase = u8(phase);
+}
+
+void NoiseChannel::LoadState(SaveState::APU::IO::NoiseChannel const& state) {
+  BaseChannel::LoadState(state);
+  lfsr = state.lfsr;
+  frequency_shift = state.frequency_shift;
+  frequency_ratio = state.frequency_ratio;
+  width = state.width;
+  dac_enable = state.dac_enable;
+}
+
+void NoiseChannel::CopyState(SaveState::APU::IO::NoiseChannel& state) {
+  BaseChannel::CopyState(state);
+  state.lfsr = lfsr;
+  state.frequency_shift = u8(frequency_shift);
+  state.frequency_ratio = u8(frequency_ratio);
+  state.width = u8(width);
+  state.dac_enable = dac_enable;
+}
+
+} // namespace nba::core
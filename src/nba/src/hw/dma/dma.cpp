@@ -5,8 +5,13 @@
  * Refer to the included LICENSE file.
  */
 
+#include <algorithm>
+#include <cstring>
 #include <nba/common/compiler.hpp>
+#include <nba/common/punning.hpp>
+#include <type_traits>
 
+#include "arm/arm7tdmi.hpp"
 #include "bus/bus.hpp"
 #include "bus/io.hpp"
 #include "hw/dma/dma.hpp"
@@ -102,17 +107,21 @@ void DMA::ScheduleDMAs(unsigned int bitset) {
 
     bitset &= ~(1 << chan_id);
 
-    channel.startup_event = scheduler.Add(2, [this, chan_id](int cycles_late) {
-      channels[chan_id].startup_event = nullptr;
-      if (runnable_set.none()) {
-        active_dma_id = chan_id;
-      } else if (chan_id < active_dma_id) {
-        active_dma_id = chan_id;
-        early_exit_trigger = true;
-      }
-      runnable_set.set(chan_id, true);
-    });
+    channel.startup_event = scheduler.Add(2, EventClass::DMA_activated, chan_id);
+  }
+}
+
+void DMA::OnActivated(int cycles_late, u64 user_data) {
+  int chan_id = int(user_data);
+
+  channels[chan_id].startup_event = nullptr;
+  if (runnable_set.none()) {
+    active_dma_id = chan_id;
+  } else if (chan_id < active_dma_id) {
+    active_dma_id = chan_id;
+    early_exit_trigger = true;
   }
+  runnable_set.set(chan_id, true);
 }
 
 void DMA::SelectNextDMA() {
@@ -192,48 +201,30 @@ void DMA::RunChannel() {
       return;
     }
 
-    auto src_addr = channel.latch.src_addr;
-    auto dst_addr = channel.latch.dst_addr;
-
-    auto access_src = Bus::Access::Sequential;
-    auto access_dst = Bus::Access::Sequential;
-
-    if (!did_access_rom) {
-      if (src_addr >= 0x08000000) {
-        access_src = Bus::Access::Nonsequential;
-        did_access_rom = true;
-      } else if (dst_addr >= 0x08000000) {
-        access_dst = Bus::Access::Nonsequential;
-        did_access_rom = true;
-      }
+    if (!channel.is_fifo_dma && RunChannelBulk(channel, src_modify, dst_modify, did_access_rom)) {
+      continue;
     }
 
-    if (size == Channel::Half) {
-      u16 value;
+    bool did_run_chunk = size == Channel::Word ?
+      RunChannelChunk<u32>(channel, src_modify, dst_modify, did_access_rom) :
+      RunChannelChunk<u16>(channel, src_modify, dst_modify, did_access_rom);
 
-      if (likely(src_addr >= 0x02000000)) {
-        value = memory.ReadHalf(src_addr, access_src);
-        channel.latch.bus = (value << 16) | value;
-        latch = channel.latch.bus;
-      } else {
-        if (dst_addr & 2) {
-          value = channel.latch.bus >> 16;
-        } else {
-          value = channel.latch.bus;
-        }
-        memory.Idle();
-      }
+    if (did_run_chunk) {
+      continue;
+    }
 
-      memory.WriteHalf(dst_addr, value, access_dst);
-    } else {
-      if (likely(src_addr >= 0x02000000)) {
-        channel.latch.bus = memory.ReadWord(src_addr, access_src);
-        latch = channel.latch.bus;
-      } else {
-        memory.Idle();
-      }
+    auto src_addr = channel.latch.src_addr;
+    auto dst_addr = channel.latch.dst_addr;
 
-      memory.WriteWord(dst_addr, channel.latch.bus, access_dst);
+    // Only the first access to the ROM is non-sequential.
+    if (did_access_rom || (src_addr < 0x08000000 && dst_addr < 0x08000000)) {
+      RunChannelUnit<false, false>(channel, size);
+    } else if (src_addr >= 0x08000000) {
+      RunChannelUnit<true, false>(channel, size);
+      did_access_rom = true;
+    } else {
+      RunChannelUnit<false, true>(channel, size);
+      did_access_rom = true;
     }
 
     channel.latch.src_addr += src_modify;
@@ -271,6 +262,266 @@ void DMA::RunChannel() {
   SelectNextDMA();
 }
 
+template<bool src_nonsequential, bool dst_nonsequential>
+void DMA::RunChannelUnit(Channel& channel, Channel::Size size) {
+  constexpr auto access_src = src_nonsequential ? Bus::Access::Nonsequential : Bus::Access::Sequential;
+  constexpr auto access_dst = dst_nonsequential ? Bus::Access::Nonsequential : Bus::Access::Sequential;
+
+  auto src_addr = channel.latch.src_addr;
+  auto dst_addr = channel.latch.dst_addr;
+
+  if (size == Channel::Half) {
+    u16 value;
+
+    if (likely(src_addr >= 0x02000000)) {
+      value = memory.ReadHalf<access_src>(src_addr);
+      channel.latch.bus = (value << 16) | value;
+      latch = channel.latch.bus;
+    } else {
+      if (dst_addr & 2) {
+        value = channel.latch.bus >> 16;
+      } else {
+        value = channel.latch.bus;
+      }
+      memory.Idle();
+    }
+
+    memory.WriteHalf<access_dst>(dst_addr, value);
+  } else {
+    if (likely(src_addr >= 0x02000000)) {
+      channel.latch.bus = memory.ReadWord<access_src>(src_addr);
+      latch = channel.latch.bus;
+    } else {
+      memory.Idle();
+    }
+
+    memory.WriteWord<access_dst>(dst_addr, channel.latch.bus);
+  }
+}
+
+/* Transfers as many units as possible in one go, when doing so is indistinguishable from
+ * transferring them one by one: both the source and destination must be plain host memory
+ * (see Bus::PageTable) and the whole transfer must finish before the next scheduler event.
+ * The latter also rules out IRQs and higher priority DMAs, since those are started from events.
+ * Returns false if not even a single unit could be transferred this way.
+ */
+bool DMA::RunChannelBulk(Channel& channel, int src_modify, int dst_modify, bool& did_access_rom) {
+  auto unit = channel.size == Channel::Word ? 4U : 2U;
+  auto src_addr = channel.latch.src_addr & ~(unit - 1);
+  auto dst_addr = channel.latch.dst_addr & ~(unit - 1);
+  auto src_page = src_addr >> 24;
+  auto dst_page = dst_addr >> 24;
+  bool src_rom = src_page >= 0x08;
+
+  // Decrementing addresses are rare enough to not bother, and a fixed destination only keeps the last unit.
+  if (src_modify < 0 || dst_modify <= 0 || src_page < 0x02 || src_page >= 0x10 || dst_page >= 0x10) {
+    return false;
+  }
+
+  auto& src_entry = memory.page_table.read[src_addr >> Bus::kPageShift];
+  auto& dst_entry = memory.page_table.write[dst_addr >> Bus::kPageShift];
+
+  if (src_entry.data == nullptr || dst_entry.data == nullptr) {
+    return false;
+  }
+
+  // Limit the transfer to contiguous host memory.
+  auto src_offset = src_addr & (Bus::kPageSize - 1);
+  auto dst_offset = dst_addr & (Bus::kPageSize - 1);
+  auto count = channel.latch.length;
+
+  if (src_modify != 0) {
+    count = std::min(count, (Bus::kPageSize - src_offset) / unit);
+  }
+  count = std::min(count, (Bus::kPageSize - dst_offset) / unit);
+
+  // Same timing as in RunChannel(): only the first Game Pak access is non-sequential.
+  auto& wait = channel.size == Channel::Word ? memory.wait32 : memory.wait16;
+  auto access_src = Bus::Access::Sequential;
+
+  if ((!did_access_rom && src_rom) || (src_rom && (channel.latch.src_addr & 0x1'FFFF) == 0)) {
+    access_src = Bus::Access::Nonsequential;
+  }
+
+  int cycles_first = wait[int(access_src)][src_page] + wait[int(Bus::Access::Sequential)][dst_page];
+  int cycles_next = wait[int(Bus::Access::Sequential)][src_page] + wait[int(Bus::Access::Sequential)][dst_page];
+  int budget = scheduler.GetRemainingCycleCount() - 1;
+
+  if (count == 0 || cycles_first > budget) {
+    return false;
+  }
+
+  count = std::min(count, 1U + u32(budget - cycles_first) / u32(cycles_next));
+
+  auto src = src_entry.data + src_addr;
+  auto dst = dst_entry.data + dst_addr;
+  auto bytes = count * unit;
+
+  if (src_modify == 0) {
+    if (channel.size == Channel::Word) {
+      auto value = read<u32>(src, 0);
+      for (u32 i = 0; i < bytes; i += 4) {
+        write<u32>(dst, i, value);
+      }
+    } else {
+      auto value = read<u16>(src, 0);
+      for (u32 i = 0; i < bytes; i += 2) {
+        write<u16>(dst, i, value);
+      }
+    }
+  } else {
+    // A unit by unit copy to a slightly higher, overlapping address repeats the source data.
+    if (dst > src && dst < src + bytes) {
+      return false;
+    }
+    std::memmove(dst, src, bytes);
+    src += bytes - unit;
+  }
+
+  if (channel.size == Channel::Word) {
+    channel.latch.bus = read<u32>(src, 0);
+  } else {
+    auto value = read<u16>(src, 0);
+    channel.latch.bus = (value << 16) | value;
+  }
+  latch = channel.latch.bus;
+
+  memory.dirty_tracker.MarkWRAM(dst_addr, bytes);
+  memory.hw.cpu.block_cache.InvalidateRange(dst_addr, bytes);
+
+  channel.latch.src_addr += src_modify * int(count);
+  channel.latch.dst_addr += dst_modify * int(count);
+  channel.latch.length -= count;
+
+  memory.Step(cycles_first + int(count - 1) * cycles_next);
+
+  // Reading from the Game Pak stops the prefetch unit, just like the data accesses on the slow path do.
+  if (src_rom) {
+    did_access_rom = true;
+    memory.CancelPrefetch();
+  }
+  return true;
+}
+
+/* Like RunChannelBulk(), but goes unit by unit, so that it also handles any address control
+ * and writes to palette RAM, VRAM, OAM and the sound FIFOs (i.e. H-blank, video transfer and FIFO DMAs).
+ * Writes to the BG, window, mosaic and blend registers of the PPU (i.e. raster effects) are handled as well,
+ * since those registers only store the value and are read when the next line is rendered.
+ * The wait states are summed up and the bus is stepped once, right before the next event.
+ */
+template<typename T>
+bool DMA::RunChannelChunk(Channel& channel, int src_modify, int dst_modify, bool& did_access_rom) {
+  auto& wait = std::is_same_v<T, u32> ? memory.wait32 : memory.wait16;
+  auto sequential = int(Bus::Access::Sequential);
+  int budget = scheduler.GetRemainingCycleCount() - 1;
+  int cycles = 0;
+  u32 count = 0;
+  bool read_rom = false;
+
+  while (count < channel.latch.length) {
+    auto src_addr = channel.latch.src_addr & ~(sizeof(T) - 1);
+    auto dst_addr = channel.latch.dst_addr & ~(sizeof(T) - 1);
+    auto src_page = src_addr >> 24;
+    auto dst_page = dst_addr >> 24;
+    bool src_rom = src_page >= 0x08;
+
+    if (src_page < 0x02 || src_page >= 0x10 || dst_page >= 0x10) {
+      break;
+    }
+
+    auto& src_entry = memory.page_table.read[src_addr >> Bus::kPageShift];
+    auto& dst_entry = memory.page_table.write[dst_addr >> Bus::kPageShift];
+
+    int fifo_id = -1;
+
+    if (dst_addr == FIFO_A || dst_addr == FIFO_B) {
+      fifo_id = dst_addr == FIFO_A ? 0 : 1;
+    } else if (dst_page == 0x04) {
+      // I/O writes are checked against the watchpoints on the slow path only.
+      if (dst_addr < BG0CNT || dst_addr + sizeof(T) > BLDY + 2 || memory.watchpoints.enabled) {
+        break;
+      }
+    } else if (dst_entry.data == nullptr) {
+      // PPU memory is never mapped for writing, and watchpoints are only checked on the slow path.
+      if (dst_page < 0x05 || dst_page > 0x07 || memory.watchpoints.enabled) {
+        break;
+      }
+    }
+
+    if (src_entry.data == nullptr) {
+      break;
+    }
+
+    auto access_src = Bus::Access::Sequential;
+
+    if ((!did_access_rom && src_rom) || (src_rom && (channel.latch.src_addr & 0x1'FFFF) == 0)) {
+      access_src = Bus::Access::Nonsequential;
+    }
+
+    int unit_cycles = wait[int(access_src)][src_page] + wait[sequential][dst_page];
+
+    if (cycles + unit_cycles > budget) {
+      break;
+    }
+
+    auto value = read<T>(src_entry.data, src_addr);
+
+    if constexpr (std::is_same_v<T, u32>) {
+      channel.latch.bus = value;
+    } else {
+      channel.latch.bus = (value << 16) | value;
+    }
+    latch = channel.latch.bus;
+
+    if (fifo_id != -1) {
+      auto& fifo = memory.hw.apu.mmio.fifo[fifo_id];
+
+      for (int i = 0; i < int(sizeof(T)); i++) {
+        fifo.Write(s8(value >> (i * 8)));
+      }
+    } else if (dst_page == 0x04) {
+      if constexpr (std::is_same_v<T, u32>) {
+        memory.hw.WriteWord(dst_addr, value);
+      } else {
+        memory.hw.WriteHalf(dst_addr, value);
+      }
+    } else if (dst_entry.data != nullptr) {
+      write<T>(dst_entry.data, dst_addr, value);
+      memory.dirty_tracker.MarkWRAM(dst_addr);
+      memory.hw.cpu.block_cache.Invalidate(dst_addr);
+    } else if (dst_page == 0x05) {
+      memory.hw.ppu.WritePRAM<T>(dst_addr, value);
+    } else if (dst_page == 0x06) {
+      memory.hw.ppu.WriteVRAM<T>(dst_addr, value);
+    } else {
+      memory.hw.ppu.WriteOAM<T>(dst_addr, value);
+    }
+
+    if (src_rom) {
+      did_access_rom = true;
+      read_rom = true;
+    }
+
+    channel.latch.src_addr += src_modify;
+    channel.latch.dst_addr += dst_modify;
+    cycles += unit_cycles;
+    count++;
+  }
+
+  if (count == 0) {
+    return false;
+  }
+
+  channel.latch.length -= count;
+  memory.Step(cycles);
+
+  // See RunChannelBulk().
+  if (read_rom) {
+    memory.CancelPrefetch();
+  }
+  return true;
+}
+
 auto DMA::Read(int chan_id, int offset) -> u8 {
   auto const& channel = channels[chan_id];
 
@@ -9,6 +9,7 @@
 
 #include <bitset>
 #include <nba/integer.hpp>
+#include <nba/save_state.hpp>
 #include <hw/irq/irq.hpp>
 
 #include "scheduler.hpp"
@@ -22,6 +23,7 @@ struct DMA {
       : memory(memory)
       , irq(irq)
       , scheduler(scheduler) {
+    scheduler.Register<&DMA::OnActivated>(EventClass::DMA_activated, this);
     Reset();
   }
 
@@ -42,6 +44,10 @@ struct DMA {
   bool IsRunning() { return runnable_set.any(); }
   auto GetOpenBusValue() -> u32 { return latch; }
 
+  static bool ValidateState(SaveState const& state);
+  void LoadState(SaveState const& state);
+  void CopyState(SaveState& state);
+
 private:
   enum Registers {
     REG_DMAXSAD = 0,
@@ -106,9 +112,18 @@ private:
   }
 
   void ScheduleDMAs(unsigned int bitset);
+  void OnActivated(int cycles_late, u64 user_data);
   void SelectNextDMA();
   void OnChannelWritten(Channel& channel, bool enable_old);
   void RunChannel();
+  bool RunChannelBulk(Channel& channel, int src_modify, int dst_modify, bool& did_access_rom);
+
+  // Transfers one unit, with the access types known at compile time so that their wait states are resolved, too.
+  template<bool src_nonsequential, bool dst_nonsequential>
+  void RunChannelUnit(Channel& channel, Channel::Size size);
+
+  template<typename T>
+  bool RunChannelChunk(Channel& channel, int src_modify, int dst_modify, bool& did_access_rom);
 
   Bus& memory;
   IRQ& irq;
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include "hw/dma/dma.hpp"
+
+namespace nba::core {
+
+bool DMA::ValidateState(SaveState const& state) {
+  if (state.dma.active_dma_id < -1 || state.dma.active_dma_id >= 4) {
+    return false;
+  }
+
+  for (auto& channel_state : state.dma.channels) {
+    if (channel_state.dst_cntl > Channel::Reload ||
+        channel_state.src_cntl > Channel::Reload ||
+        channel_state.time > Channel::Special ||
+        channel_state.size > Channel::Word) {
+      return false;
+    }
+  }
+
+  // The user data of an activation event is the channel ID.
+  for (int i = 0; i < state.scheduler.event_count; i++) {
+    auto& event = state.scheduler.events[i];
+
+    if (event.event_class == (u16)EventClass::DMA_activated && event.user_data >= 4) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void DMA::LoadState(SaveState const& state) {
+  for (int id = 0; id < 4; id++) {
+    auto& channel = channels[id];
+    auto& channel_state = state.dma.channels[id];
+
+    channel.enable = channel_state.enable;
+    channel.repeat = channel_state.repeat;
+    channel.interrupt = channel_state.interrupt;
+    channel.gamepak = channel_state.gamepak;
+    channel.length = channel_state.length;
+    channel.dst_addr = channel_state.dst_addr;
+    channel.src_addr = channel_state.src_addr;
+    channel.dst_cntl = (Channel::Control)channel_state.dst_cntl;
+    channel.src_cntl = (Channel::Control)channel_state.src_cntl;
+    channel.time = (Channel::Timing)channel_state.time;
+    channel.size = (Channel::Size)channel_state.size;
+    channel.latch.length = channel_state.latch.length;
+    channel.latch.dst_addr = channel_state.latch.dst_addr;
+    channel.latch.src_addr = channel_state.latch.src_addr;
+    channel.latch.bus = channel_state.latch.bus;
+    channel.is_fifo_dma = channel_state.is_fifo_dma;
+    channel.startup_event = scheduler.FindEvent(EventClass::DMA_activated, id);
+  }
+
+  active_dma_id = state.dma.active_dma_id;
+  early_exit_trigger = state.dma.early_exit_trigger;
+  hblank_set = state.dma.hblank_set;
+  vblank_set = state.dma.vblank_set;
+  video_set = state.dma.video_set;
+  runnable_set = state.dma.runnable_set;
+  latch = state.dma.latch;
+}
+
+void DMA::CopyState(SaveState& state) {
+  for (int id = 0; id < 4; id++) {
+    auto& channel = channels[id];
+    auto& channel_state = state.dma.channels[id];
+
+    channel_state.enable = channel.enable;
+    channel_state.repeat = channel.repeat;
+    channel_state.interrupt = channel.interrupt;
+    channel_state.gamepak = channel.gamepak;
+    channel_state.length = channel.length;
+    channel_state.dst_addr = channel.dst_addr;
+    channel_state.src_addr = channel.src_addr;
+    channel_state.dst_cntl = (u8)channel.dst_cntl;
+    channel_state.src_cntl = (u8)channel.src_cntl;
+    channel_state.time = (u8)channel.time;
+    channel_state.size = (u8)channel.size;
+    channel_state.latch.length = channel.latch.length;
+    channel_state.latch.dst_addr = channel.latch.dst_addr;
+    channel_state.latch.src_addr = channel.latch.src_addr;
+    channel_state.latch.bus = channel.latch.bus;
+    channel_state.is_fifo_dma = channel.is_fifo_dma;
+  }
+
+  state.dma.active_dma_id = s8(active_dma_id);
+  state.dma.early_exit_trigger = early_exit_trigger;
+  state.dma.hblank_set = u8(hblank_set.to_ulong());
+  state.dma.vblank_set = u8(vblank_set.to_ulong());
+  state.dma.video_set = u8(video_set.to_ulong());
+  state.dma.runnable_set = u8(runnable_set.to_ulong());
+  state.dma.latch = latch;
+}
+
+} // namespace nba::core
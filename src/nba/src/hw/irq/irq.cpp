@@ -94,12 +94,14 @@ void IRQ::UpdateIRQLine() {
     if (event != nullptr) {
       scheduler.Cancel(event);
     }
-    event = scheduler.Add(2, [=](int late) {
-      cpu.IRQLine() = irq_line_new;
-      event = nullptr;
-    });
+    event = scheduler.Add(2, EventClass::IRQ_update_line, irq_line_new ? 1 : 0);
     irq_line = irq_line_new;
   }
 }
 
+void IRQ::OnUpdateIRQLine(int cycles_late, u64 irq_line_new) {
+  cpu.IRQLine() = irq_line_new != 0;
+  event = nullptr;
+}
+
 } // namespace nba::core
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <nba/integer.hpp>
+#include <nba/save_state.hpp>
 
 #include "scheduler.hpp"
 
@@ -32,6 +33,7 @@ struct IRQ {
   IRQ(arm::ARM7TDMI& cpu, Scheduler& scheduler)
       : cpu(cpu)
       , scheduler(scheduler) {
+    scheduler.Register<&IRQ::OnUpdateIRQLine>(EventClass::IRQ_update_line, this);
     Reset();
   }
 
@@ -40,14 +42,26 @@ struct IRQ {
   void Write(int offset, u8 value);
   void Raise(IRQ::Source source, int channel = 0);
 
+  void LoadState(SaveState const& state);
+  void CopyState(SaveState& state);
+
   bool MasterEnable() const {
     return reg_ime != 0;
   }
 
-  bool HasServableIRQ() const {
-    return (reg_ie & reg_if) != 0;
+  bool HasServableIRQ(u16 mask = 0xFFFF) const {
+    return (reg_ie & reg_if & mask) != 0;
+  }
+
+  auto GetEnabledIRQs() const -> u16 {
+    return reg_ie;
   }
 
+  // Bits in IE and IF of the interrupts that only external events raise.
+  static constexpr u16 kMaskSerial = 0x0080;
+  static constexpr u16 kMaskKeypad = 0x1000;
+  static constexpr u16 kMaskROM = 0x2000;
+
 private:
   enum Registers {
     REG_IE  = 0,
@@ -56,6 +70,7 @@ private:
   };
 
   void UpdateIRQLine();
+  void OnUpdateIRQLine(int cycles_late, u64 irq_line_new);
 
   int reg_ime;
   u16 reg_ie;
@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include "hw/irq/irq.hpp"
+
+namespace nba::core {
+
+void IRQ::LoadState(SaveState const& state) {
+  reg_ime = state.irq.reg_ime;
+  reg_ie = state.irq.reg_ie;
+  reg_if = state.irq.reg_if;
+  irq_line = state.irq.irq_line;
+
+  // A pending update always carries the most recent state of the IRQ line.
+  event = scheduler.FindEvent(EventClass::IRQ_update_line, irq_line ? 1 : 0);
+}
+
+void IRQ::CopyState(SaveState& state) {
+  state.irq.reg_ime = u8(reg_ime);
+  state.irq.reg_ie = reg_ie;
+  state.irq.reg_if = reg_if;
+  state.irq.irq_line = irq_line;
+}
+
+} // namespace nba::core
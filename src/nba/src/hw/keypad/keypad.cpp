@@ -6,43 +6,233 @@
  */
 
 #include <nba/common/compiler.hpp>
+#include <nba/core.hpp>
 
 #include "hw/keypad/keypad.hpp"
 
 namespace nba::core {
 
-KeyPad::KeyPad(IRQ& irq, std::shared_ptr<Config> config)
-    : irq(irq)
+KeyPad::KeyPad(Scheduler& scheduler, IRQ& irq, std::shared_ptr<Config> config)
+    : scheduler(scheduler)
+    , irq(irq)
     , config(config) {
+  scheduler.Register<&KeyPad::OnMovieInput>(EventClass::KeyPad_movie_input, this);
   Reset();
 }
 
 void KeyPad::Reset() {
   input = {};
+  input.keypad = this;
   control = {};
   control.keypad = this;
   config->input_dev->SetOnChangeCallback(std::bind(&KeyPad::UpdateInput, this));
+
+  // Changes from before the reset do not apply to the new session.
+  {
+    std::lock_guard guard{input_mutex};
+
+    while (input_queue.Available() > 0) {
+      input_queue.Read();
+    }
+    input_pending = false;
+    latest_keys = 0;
+  }
+
+  // The scheduler has been reset as well, so restart the movie from the beginning.
+  movie.event = nullptr;
+  if (movie.recording) {
+    StartMovieRecording(movie.recording);
+  } else if (movie.playback) {
+    StartMoviePlayback(movie.playback);
+  }
 }
 
+// Called by the input device, possibly on more than one other thread.
 void KeyPad::UpdateInput() {
+  {
+    std::lock_guard guard{input_mutex};
+
+    u16 keys = PollKeys();
+
+    if (keys == latest_keys) {
+      return;
+    }
+
+    // If the queue is full this drops the intermediate state, ProcessInput() still applies latest_keys.
+    input_queue.Write(keys);
+    latest_keys = keys;
+    input_pending = true;
+  }
+  input_cv.notify_all();
+}
+
+bool KeyPad::WaitForInput(std::chrono::steady_clock::time_point deadline) {
+  std::unique_lock lock{input_mutex};
+
+  input_cv.wait_until(lock, deadline, [this] {
+    return input_pending || wait_cancelled;
+  });
+  wait_cancelled = false;
+  return input_pending;
+}
+
+void KeyPad::CancelWaitForInput() {
+  {
+    std::lock_guard guard{input_mutex};
+    wait_cancelled = true;
+  }
+  input_cv.notify_all();
+}
+
+// Called on every read from KEYINPUT, see Config::late_input_latching.
+void KeyPad::LatchInput() {
+  if (config->late_input_latching && !movie.recording && !movie.playback) {
+    std::lock_guard guard{input_mutex};
+
+    /* The polled state is at least as new as anything queued so far, so queued states are dropped
+     * and later changes are queued relative to it.
+     */
+    latest_keys = PollKeys();
+    while (input_queue.Available() > 0) {
+      input_queue.Read();
+    }
+    input_pending = false;
+
+    SetKeys(latest_keys);
+  }
+}
+
+void KeyPad::ProcessInput() {
+  if (!input_pending.load(std::memory_order_acquire)) {
+    return;
+  }
+
+  std::lock_guard guard{input_mutex};
+
+  bool apply = !movie.recording && !movie.playback;
+
+  while (input_queue.Available() > 0) {
+    u16 keys = input_queue.Read();
+
+    if (apply) {
+      SetKeys(keys);
+    }
+  }
+
+  // Differs from the last queued state only if that overflowed the queue.
+  if (apply && input.value != (~latest_keys & 0x3FF)) {
+    SetKeys(latest_keys);
+  }
+  input_pending = false;
+}
+
+auto KeyPad::PollKeys() -> u16 {
   auto& input_device = config->input_dev;
 
-  input.value = 0;
+  u16 keys = 0;
 
-  if (!input_device->Poll(Key::A)) input.value |= 1;
-  if (!input_device->Poll(Key::B)) input.value |= 2;
-  if (!input_device->Poll(Key::Select)) input.value |= 4;
-  if (!input_device->Poll(Key::Start)) input.value |= 8;
-  if (!input_device->Poll(Key::Right)) input.value |= 16;
-  if (!input_device->Poll(Key::Left)) input.value |= 32;
-  if (!input_device->Poll(Key::Up)) input.value |= 64;
-  if (!input_device->Poll(Key::Down)) input.value |= 128;
-  if (!input_device->Poll(Key::R)) input.value |= 256;
-  if (!input_device->Poll(Key::L)) input.value |= 512;
+  if (input_device->Poll(Key::A)) keys |= 1;
+  if (input_device->Poll(Key::B)) keys |= 2;
+  if (input_device->Poll(Key::Select)) keys |= 4;
+  if (input_device->Poll(Key::Start)) keys |= 8;
+  if (input_device->Poll(Key::Right)) keys |= 16;
+  if (input_device->Poll(Key::Left)) keys |= 32;
+  if (input_device->Poll(Key::Up)) keys |= 64;
+  if (input_device->Poll(Key::Down)) keys |= 128;
+  if (input_device->Poll(Key::R)) keys |= 256;
+  if (input_device->Poll(Key::L)) keys |= 512;
 
+  return keys;
+}
+
+void KeyPad::SetKeys(u16 keys) {
+  u16 value = ~keys & 0x3FF;
+
+  if (value != input.value && config->latency_probe) {
+    config->latency_probe->OnKeysLatched();
+  }
+
+  input.value = value;
   UpdateIRQ();
 }
 
+void KeyPad::StartMovieRecording(std::shared_ptr<InputMovie> movie) {
+  // Enough for about 18 minutes of input that changes every frame, so that recording does not allocate while running.
+  static constexpr size_t kReservedEvents = 65536;
+
+  StopMovie();
+  movie->events.clear();
+  movie->events.reserve(kReservedEvents);
+  this->movie.recording = movie;
+  this->movie.timestamp_start = scheduler.GetTimestampNow();
+  PollMovieInput();
+}
+
+void KeyPad::StartMoviePlayback(std::shared_ptr<InputMovie const> movie) {
+  StopMovie();
+  this->movie.playback = movie;
+  this->movie.playback_index = 0;
+  this->movie.timestamp_start = scheduler.GetTimestampNow();
+  SetKeys(0);
+  ScheduleMovieInput();
+}
+
+void KeyPad::StopMovie() {
+  if (movie.event) {
+    scheduler.Cancel(movie.event);
+    movie.event = nullptr;
+  }
+  movie.recording.reset();
+  movie.playback.reset();
+}
+
+void KeyPad::PollMovieInput() {
+  if (!movie.recording) {
+    return;
+  }
+
+  auto& events = movie.recording->events;
+  auto keys = PollKeys();
+
+  if (events.empty() || events.back().keys != keys) {
+    auto timestamp = scheduler.GetTimestampNow() - movie.timestamp_start;
+
+    events.push_back({timestamp, u32(timestamp / CoreBase::kCyclesPerFrame), keys});
+  }
+
+  SetKeys(keys);
+}
+
+void KeyPad::ScheduleMovieInput() {
+  auto& events = movie.playback->events;
+
+  if (movie.playback_index < events.size()) {
+    auto timestamp = movie.timestamp_start + events[movie.playback_index].timestamp;
+    auto now = scheduler.GetTimestampNow();
+
+    movie.event = scheduler.Add(timestamp > now ? timestamp - now : 0, EventClass::KeyPad_movie_input);
+  } else {
+    movie.event = nullptr;
+  }
+}
+
+void KeyPad::OnMovieInput(int cycles_late) {
+  movie.event = nullptr;
+
+  if (!movie.playback) {
+    return;
+  }
+
+  auto& events = movie.playback->events;
+  auto now = scheduler.GetTimestampNow() - movie.timestamp_start;
+
+  while (movie.playback_index < events.size() && events[movie.playback_index].timestamp <= now) {
+    SetKeys(events[movie.playback_index++].keys);
+  }
+
+  ScheduleMovieInput();
+}
+
 void KeyPad::UpdateIRQ() {
   if (control.interrupt) {
     auto not_input = ~input.value & 0x3FF;
@@ -58,6 +248,9 @@ void KeyPad::UpdateIRQ() {
 }
 
 auto KeyPad::KeyInput::ReadByte(uint offset) -> u8 {
+  keypad->ProcessInput();
+  keypad->LatchInput();
+
   switch (offset) {
     case 0:
       return u8(value);
@@ -7,21 +7,58 @@
 
 #pragma once
 
+#include <nba/common/dsp/spsc_ring_buffer.hpp>
 #include <nba/config.hpp>
+#include <nba/input_movie.hpp>
+#include <nba/save_state.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 
 #include "hw/irq/irq.hpp"
+#include "scheduler.hpp"
 
 namespace nba::core {
 
 struct KeyPad {
-  KeyPad(IRQ& irq, std::shared_ptr<Config> config);
+  KeyPad(Scheduler& scheduler, IRQ& irq, std::shared_ptr<Config> config);
 
   void Reset();
 
+  /* The input device reports changes on the host's input thread(s). There the new key state is only
+   * queued, it is applied on the emulation thread at the start of each Run() and whenever KEYINPUT is read.
+   * If the queue overflows, intermediate states are dropped but the latest state is always applied.
+   */
+  void ProcessInput();
+
+  /* While a movie is recorded, the input device is polled once per call to
+   * PollMovieInput() instead of whenever the host reports a change,
+   * so that the recorded input only depends on the emulated time.
+   * While a movie is played back, the input device is ignored entirely.
+   */
+  void StartMovieRecording(std::shared_ptr<InputMovie> movie);
+  void StartMoviePlayback(std::shared_ptr<InputMovie const> movie);
+  void StopMovie();
+  void PollMovieInput();
+
+  bool IsPlayingMovie() const {
+    return (bool)movie.playback;
+  }
+
+  // See CoreBase::WaitForInput() and CoreBase::CancelWaitForInput().
+  bool WaitForInput(std::chrono::steady_clock::time_point deadline);
+  void CancelWaitForInput();
+
+  void LoadState(SaveState const& state);
+  void CopyState(SaveState& state);
+
   struct KeyInput {
     u16 value = 0x3FF;
 
+    KeyPad* keypad;
+
     auto ReadByte(uint offset) -> u8;
   } input;
 
@@ -45,10 +82,38 @@ private:
   using Key = InputDevice::Key;
 
   void UpdateInput();
+  void LatchInput();
   void UpdateIRQ();
+  auto PollKeys() -> u16;
+  void SetKeys(u16 keys);
+  void ScheduleMovieInput();
+  void OnMovieInput(int cycles_late);
 
+  Scheduler& scheduler;
   IRQ& irq;
   std::shared_ptr<Config> config;
+
+  // Key states (a set bit per pressed key) in the order that the input device reported them.
+  SPSCRingBuffer<u16> input_queue{64};
+
+  /* Guards the queue and the latest key state. Input may be reported by more than one host thread
+   * (e.g. keyboard and controller), so producers are serialized here. The emulation thread
+   * only takes the lock when input_pending is set. Also signalled when a change is queued,
+   * for hosts that sleep until input arrives.
+   */
+  std::mutex input_mutex;
+  std::condition_variable input_cv;
+  std::atomic_bool input_pending = false;
+  u16 latest_keys = 0;
+  bool wait_cancelled = false;
+
+  struct Movie {
+    std::shared_ptr<InputMovie> recording;
+    std::shared_ptr<InputMovie const> playback;
+    size_t playback_index;
+    u64 timestamp_start;
+    Scheduler::Event* event = nullptr;
+  } movie;
 };
 
 } // namespace nba::core
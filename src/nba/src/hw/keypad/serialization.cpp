@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include "hw/keypad/keypad.hpp"
+
+namespace nba::core {
+
+void KeyPad::LoadState(SaveState const& state) {
+  input.value = state.keypad.input;
+  control.mask = state.keypad.control.mask;
+  control.interrupt = state.keypad.control.interrupt;
+  control.mode = (KeyControl::Mode)state.keypad.control.mode;
+
+  // The movie is not part of the state, instead continue playback from the new point in time.
+  movie.event = scheduler.FindEvent(EventClass::KeyPad_movie_input);
+  if (movie.event) {
+    scheduler.Cancel(movie.event);
+    movie.event = nullptr;
+  }
+
+  if (movie.playback) {
+    auto& events = movie.playback->events;
+    auto now = scheduler.GetTimestampNow();
+
+    movie.playback_index = 0;
+    while (movie.playback_index < events.size() &&
+           movie.timestamp_start + events[movie.playback_index].timestamp <= now) {
+      movie.playback_index++;
+    }
+    ScheduleMovieInput();
+  }
+}
+
+void KeyPad::CopyState(SaveState& state) {
+  state.keypad.input = input.value;
+  state.keypad.control.mask = control.mask;
+  state.keypad.control.interrupt = control.interrupt;
+  state.keypad.control.mode = (u8)control.mode;
+}
+
+} // namespace nba::core
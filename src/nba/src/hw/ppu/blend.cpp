@@ -0,0 +1,607 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+
+#include <nba/common/compiler.hpp>
+#include <nba/common/cpu_dispatch.hpp>
+
+#include "hw/ppu/blend.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+  #define NBA_BLEND_X86
+  #include <immintrin.h>
+#elif defined(__ARM_NEON)
+  #define NBA_BLEND_NEON
+  #include <arm_neon.h>
+#endif
+
+namespace nba::core {
+
+namespace {
+
+constexpr int kLineWidth = LineBlender::kLineWidth;
+
+using ConvertFn = void (*)(u16 const*, u32*);
+using BlendFn = void (*)(u16*, u16 const*, u16 const*, LineBlender::Factors const&);
+using BlendAndConvertFn = void (*)(u16 const*, u16 const*, u16 const*, LineBlender::Factors const&, u32*);
+
+auto ALWAYS_INLINE ConvertPixel(u16 color) -> u32 {
+  return (color & 0x001F) << 19 |
+         (color & 0x03E0) <<  6 |
+         (color & 0x7C00) >>  7 |
+         0xFF000000;
+}
+
+void ConvertScalar(u16 const* src, u32* dst) {
+  for (int x = 0; x < kLineWidth; x++) {
+    dst[x] = ConvertPixel(src[x]);
+  }
+}
+
+auto ALWAYS_INLINE BlendPixel(u16 color1, u16 color2, u16 effect, LineBlender::Factors const& factors) -> u16 {
+  if (effect == LineBlender::None) {
+    return color1;
+  }
+
+  int r1 = (color1 >>  0) & 0x1F;
+  int g1 = (color1 >>  5) & 0x1F;
+  int b1 = (color1 >> 10) & 0x1F;
+
+  switch (effect) {
+    case LineBlender::Blend: {
+      r1 = factors.blend[r1][(color2 >>  0) & 0x1F];
+      g1 = factors.blend[g1][(color2 >>  5) & 0x1F];
+      b1 = factors.blend[b1][(color2 >> 10) & 0x1F];
+      break;
+    }
+    case LineBlender::Brighten: {
+      r1 = factors.brighten[r1];
+      g1 = factors.brighten[g1];
+      b1 = factors.brighten[b1];
+      break;
+    }
+    case LineBlender::Darken: {
+      r1 = factors.darken[r1];
+      g1 = factors.darken[g1];
+      b1 = factors.darken[b1];
+      break;
+    }
+  }
+
+  return r1 | (g1 << 5) | (b1 << 10);
+}
+
+void BlendScalar(
+  u16* target1,
+  u16 const* target2,
+  u16 const* effect,
+  LineBlender::Factors const& factors
+) {
+  for (int x = 0; x < kLineWidth; x++) {
+    target1[x] = BlendPixel(target1[x], target2[x], effect[x], factors);
+  }
+}
+
+void BlendAndConvertScalar(
+  u16 const* target1,
+  u16 const* target2,
+  u16 const* effect,
+  LineBlender::Factors const& factors,
+  u32* dst
+) {
+  for (int x = 0; x < kLineWidth; x++) {
+    dst[x] = ConvertPixel(BlendPixel(target1[x], target2[x], effect[x], factors));
+  }
+}
+
+/* The SIMD implementations all follow the same scheme:
+ * split the 5-bit channels of eight (or sixteen) pixels into 16-bit lanes,
+ * calculate the result of every effect and select the result per pixel.
+ * All intermediate values fit into 16 bits, since the factors are at most 16.
+ */
+#if defined(NBA_BLEND_X86)
+
+auto ALWAYS_INLINE BlendChannelSSE2(__m128i a, __m128i b, __m128i effect, __m128i eva, __m128i evb, __m128i evy) -> __m128i {
+  auto const k31 = _mm_set1_epi16(31);
+
+  auto blend = _mm_min_epi16(_mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(a, eva), _mm_mullo_epi16(b, evb)), 4), k31);
+  auto brighten = _mm_add_epi16(a, _mm_srli_epi16(_mm_mullo_epi16(_mm_sub_epi16(k31, a), evy), 4));
+  auto darken = _mm_sub_epi16(a, _mm_srli_epi16(_mm_mullo_epi16(a, evy), 4));
+
+  auto is_blend = _mm_cmpeq_epi16(effect, _mm_set1_epi16(LineBlender::Blend));
+  auto is_brighten = _mm_cmpeq_epi16(effect, _mm_set1_epi16(LineBlender::Brighten));
+  auto is_darken = _mm_cmpeq_epi16(effect, _mm_set1_epi16(LineBlender::Darken));
+
+  return _mm_or_si128(
+    _mm_and_si128(is_blend, blend),
+    _mm_or_si128(_mm_and_si128(is_brighten, brighten), _mm_and_si128(is_darken, darken))
+  );
+}
+
+void ALWAYS_INLINE StoreARGB8888SSE2(__m128i color, u32* dst) {
+  auto const zero = _mm_setzero_si128();
+  auto const alpha = _mm_set1_epi32(0xFF000000);
+
+  auto convert = [&](__m128i x) {
+    return _mm_or_si128(
+      _mm_or_si128(
+        _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x001F)), 19),
+        _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x03E0)), 6)
+      ),
+      _mm_or_si128(_mm_srli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x7C00)), 7), alpha)
+    );
+  };
+
+  _mm_storeu_si128((__m128i*)&dst[0], convert(_mm_unpacklo_epi16(color, zero)));
+  _mm_storeu_si128((__m128i*)&dst[4], convert(_mm_unpackhi_epi16(color, zero)));
+}
+
+auto ALWAYS_INLINE BlendPixelsSSE2(__m128i color1, __m128i color2, __m128i fx, __m128i eva, __m128i evb, __m128i evy) -> __m128i {
+  auto const mask = _mm_set1_epi16(0x1F);
+
+  auto r = BlendChannelSSE2(
+    _mm_and_si128(color1, mask), _mm_and_si128(color2, mask), fx, eva, evb, evy);
+  auto g = BlendChannelSSE2(
+    _mm_and_si128(_mm_srli_epi16(color1, 5), mask), _mm_and_si128(_mm_srli_epi16(color2, 5), mask), fx, eva, evb, evy);
+  auto b = BlendChannelSSE2(
+    _mm_and_si128(_mm_srli_epi16(color1, 10), mask), _mm_and_si128(_mm_srli_epi16(color2, 10), mask), fx, eva, evb, evy);
+
+  auto blended = _mm_or_si128(r, _mm_or_si128(_mm_slli_epi16(g, 5), _mm_slli_epi16(b, 10)));
+  auto is_none = _mm_cmpeq_epi16(fx, _mm_setzero_si128());
+  return _mm_or_si128(_mm_and_si128(is_none, color1), _mm_andnot_si128(is_none, blended));
+}
+
+void ConvertSSE2(u16 const* src, u32* dst) {
+  for (int x = 0; x < kLineWidth; x += 8) {
+    StoreARGB8888SSE2(_mm_loadu_si128((__m128i const*)&src[x]), &dst[x]);
+  }
+}
+
+void BlendSSE2(
+  u16* target1,
+  u16 const* target2,
+  u16 const* effect,
+  LineBlender::Factors const& factors
+) {
+  auto const eva = _mm_set1_epi16(factors.eva);
+  auto const evb = _mm_set1_epi16(factors.evb);
+  auto const evy = _mm_set1_epi16(factors.evy);
+
+  for (int x = 0; x < kLineWidth; x += 8) {
+    auto color = BlendPixelsSSE2(
+      _mm_loadu_si128((__m128i const*)&target1[x]),
+      _mm_loadu_si128((__m128i const*)&target2[x]),
+      _mm_loadu_si128((__m128i const*)&effect[x]), eva, evb, evy);
+
+    _mm_storeu_si128((__m128i*)&target1[x], color);
+  }
+}
+
+void BlendAndConvertSSE2(
+  u16 const* target1,
+  u16 const* target2,
+  u16 const* effect,
+  LineBlender::Factors const& factors,
+  u32* dst
+) {
+  auto const eva = _mm_set1_epi16(factors.eva);
+  auto const evb = _mm_set1_epi16(factors.evb);
+  auto const evy = _mm_set1_epi16(factors.evy);
+
+  for (int x = 0; x < kLineWidth; x += 8) {
+    auto color = BlendPixelsSSE2(
+      _mm_loadu_si128((__m128i const*)&target1[x]),
+      _mm_loadu_si128((__m128i const*)&target2[x]),
+      _mm_loadu_si128((__m128i const*)&effect[x]), eva, evb, evy);
+
+    StoreARGB8888SSE2(color, &dst[x]);
+  }
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 auto ALWAYS_INLINE BlendChannelAVX2(__m256i a, __m256i b, __m256i effect, __m256i eva, __m256i evb, __m256i evy) -> __m256i {
+  auto const k31 = _mm256_set1_epi16(31);
+
+  auto blend = _mm256_min_epi16(_mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(a, eva), _mm256_mullo_epi16(b, evb)), 4), k31);
+  auto brighten = _mm256_add_epi16(a, _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(k31, a), evy), 4));
+  auto darken = _mm256_sub_epi16(a, _mm256_srli_epi16(_mm256_mullo_epi16(a, evy), 4));
+
+  auto is_blend = _mm256_cmpeq_epi16(effect, _mm256_set1_epi16(LineBlender::Blend));
+  auto is_brighten = _mm256_cmpeq_epi16(effect, _mm256_set1_epi16(LineBlender::Brighten));
+  auto is_darken = _mm256_cmpeq_epi16(effect, _mm256_set1_epi16(LineBlender::Darken));
+
+  return _mm256_or_si256(
+    _mm256_and_si256(is_blend, blend),
+    _mm256_or_si256(_mm256_and_si256(is_brighten, brighten), _mm256_and_si256(is_darken, darken))
+  );
+}
+
+AVX2 void ALWAYS_INLINE StoreARGB8888AVX2(__m256i color, u32* dst) {
+  auto const alpha = _mm256_set1_epi32(0xFF000000);
+
+  auto convert = [&](__m128i half) AVX2 {
+    auto x = _mm256_cvtepu16_epi32(half);
+
+    return _mm256_or_si256(
+      _mm256_or_si256(
+        _mm256_slli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0x001F)), 19),
+        _mm256_slli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0x03E0)), 6)
+      ),
+      _mm256_or_si256(_mm256_srli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0x7C00)), 7), alpha)
+    );
+  };
+
+  _mm256_storeu_si256((__m256i*)&dst[0], convert(_mm256_castsi256_si128(color)));
+  _mm256_storeu_si256((__m256i*)&dst[8], convert(_mm256_extracti128_si256(color, 1)));
+}
+
+AVX2 auto ALWAYS_INLINE BlendPixelsAVX2(__m256i color1, __m256i color2, __m256i fx, __m256i eva, __m256i evb, __m256i evy) -> __m256i {
+  auto const mask = _mm256_set1_epi16(0x1F);
+
+  auto r = BlendChannelAVX2(
+    _mm256_and_si256(color1, mask), _mm256_and_si256(color2, mask), fx, eva, evb, evy);
+  auto g = BlendChannelAVX2(
+    _mm256_and_si256(_mm256_srli_epi16(color1, 5), mask), _mm256_and_si256(_mm256_srli_epi16(color2, 5), mask), fx, eva, evb, evy);
+  auto b = BlendChannelAVX2(
+    _mm256_and_si256(_mm256_srli_epi16(color1, 10), mask), _mm256_and_si256(_mm256_srli_epi16(color2, 10), mask), fx, eva, evb, evy);
+
+  auto blended = _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi16(g, 5), _mm256_slli_epi16(b, 10)));
+  auto is_none = _mm256_cmpeq_epi16(fx, _mm256_setzero_si256());
+  return _mm256_or_si256(_mm256_and_si256(is_none, color1), _mm256_andnot_si256(is_none, blended));
+}
+
+AVX2 void ConvertAVX2(u16 const* src, u32* dst) {
+  for (int x = 0; x < kLineWidth; x += 16) {
+    StoreARGB8888AVX2(_mm256_loadu_si256((__m256i const*)&src[x]), &dst[x]);
+  }
+}
+
+AVX2 void BlendAVX2(
+  u16* target1,
+  u16 const* target2,
+  u16 const* effect,
+  LineBlender::Factors const& factors
+) {
+  auto const eva = _mm256_set1_epi16(factors.eva);
+  auto const evb = _mm256_set1_epi16(factors.evb);
+  auto const evy = _mm256_set1_epi16(factors.evy);
+
+  for (int x = 0; x < kLineWidth; x += 16) {
+    auto color = BlendPixelsAVX2(
+      _mm256_loadu_si256((__m256i const*)&target1[x]),
+      _mm256_loadu_si256((__m256i const*)&target2[x]),
+      _mm256_loadu_si256((__m256i const*)&effect[x]), eva, evb, evy);
+
+    _mm256_storeu_si256((__m256i*)&target1[x], color);
+  }
+}
+
+AVX2 void BlendAndConvertAVX2(
+  u16 const* target1,
+  u16 const* target2,
+  u16 const* effect,
+  LineBlender::Factors const& factors,
+  u32* dst
+) {
+  auto const eva = _mm256_set1_epi16(factors.eva);
+  auto const evb = _mm256_set1_epi16(factors.evb);
+  auto const evy = _mm256_set1_epi16(factors.evy);
+
+  for (int x = 0; x < kLineWidth; x += 16) {
+    auto color = BlendPixelsAVX2(
+      _mm256_loadu_si256((__m256i const*)&target1[x]),
+      _mm256_loadu_si256((__m256i const*)&target2[x]),
+      _mm256_loadu_si256((__m256i const*)&effect[x]), eva, evb, evy);
+
+    StoreARGB8888AVX2(color, &dst[x]);
+  }
+}
+
+#undef AVX2
+
+#define NBA_BLEND_AVX
+
+/* AVX-512 (F and BW) handles 32 pixels at once. The line is not a multiple of 32 pixels long,
+ * so the last step masks off the lanes past its end, and the effects are selected with mask registers.
+ */
+#define AVX512 __attribute__((target("avx512f,avx512bw")))
+
+AVX512 auto ALWAYS_INLINE GetLaneMaskAVX512(int x) -> __mmask32 {
+  return x + 32 <= kLineWidth ? ~__mmask32(0) : (__mmask32(1) << (kLineWidth - x)) - 1;
+}
+
+AVX512 auto ALWAYS_INLINE BlendChannelAVX512(
+  __m512i a, __m512i b, __mmask32 is_blend, __mmask32 is_brighten, __mmask32 is_darken, __m512i eva, __m512i evb, __m512i evy
+) -> __m512i {
+  auto const k31 = _mm512_set1_epi16(31);
+
+  auto blend = _mm512_min_epi16(_mm512_srli_epi16(_mm512_add_epi16(_mm512_mullo_epi16(a, eva), _mm512_mullo_epi16(b, evb)), 4), k31);
+  auto brighten = _mm512_add_epi16(a, _mm512_srli_epi16(_mm512_mullo_epi16(_mm512_sub_epi16(k31, a), evy), 4));
+  auto darken = _mm512_sub_epi16(a, _mm512_srli_epi16(_mm512_mullo_epi16(a, evy), 4));
+
+  auto result = _mm512_maskz_mov_epi16(is_blend, blend);
+  result = _mm512_mask_mov_epi16(result, is_brighten, brighten);
+  return _mm512_mask_mov_epi16(result, is_darken, darken);
+}
+
+AVX512 void ALWAYS_INLINE StoreARGB8888AVX512(__m512i color, u32* dst, __mmask32 lanes) {
+  auto const alpha = _mm512_set1_epi32(0xFF000000);
+
+  auto convert = [&](__m256i half) AVX512 {
+    auto x = _mm512_cvtepu16_epi32(half);
+
+    return _mm512_or_si512(
+      _mm512_or_si512(
+        _mm512_slli_epi32(_mm512_and_si512(x, _mm512_set1_epi32(0x001F)), 19),
+        _mm512_slli_epi32(_mm512_and_si512(x, _mm512_set1_epi32(0x03E0)), 6)
+      ),
+      _mm512_or_si512(_mm512_srli_epi32(_mm512_and_si512(x, _mm512_set1_epi32(0x7C00)), 7), alpha)
+    );
+  };
+
+  _mm512_mask_storeu_epi32(&dst[0], __mmask16(lanes), convert(_mm512_castsi512_si256(color)));
+  _mm512_mask_storeu_epi32(&dst[16], __mmask16(lanes >> 16), convert(_mm512_extracti64x4_epi64(color, 1)));
+}
+
+AVX512 auto ALWAYS_INLINE BlendPixelsAVX512(__m512i color1, __m512i color2, __m512i fx, __m512i eva, __m512i evb, __m512i evy) -> __m512i {
+  auto const mask = _mm512_set1_epi16(0x1F);
+
+  auto is_blend = _mm512_cmpeq_epi16_mask(fx, _mm512_set1_epi16(LineBlender::Blend));
+  auto is_brighten = _mm512_cmpeq_epi16_mask(fx, _mm512_set1_epi16(LineBlender::Brighten));
+  auto is_darken = _mm512_cmpeq_epi16_mask(fx, _mm512_set1_epi16(LineBlender::Darken));
+
+  auto r = BlendChannelAVX512(
+    _mm512_and_si512(color1, mask), _mm512_and_si512(color2, mask), is_blend, is_brighten, is_darken, eva, evb, evy);
+  auto g = BlendChannelAVX512(
+    _mm512_and_si512(_mm512_srli_epi16(color1, 5), mask), _mm512_and_si512(_mm512_srli_epi16(color2, 5), mask),
+    is_blend, is_brighten, is_darken, eva, evb, evy);
+  auto b = BlendChannelAVX512(
+    _mm512_and_si512(_mm512_srli_epi16(color1, 10), mask), _mm512_and_si512(_mm512_srli_epi16(color2, 10), mask),
+    is_blend, is_brighten, is_darken, eva, evb, evy);
+
+  auto blended = _mm512_or_si512(r, _mm512_or_si512(_mm512_slli_epi16(g, 5), _mm512_slli_epi16(b, 10)));
+  auto is_none = _mm512_cmpeq_epi16_mask(fx, _mm512_setzero_si512());
+  return _mm512_mask_mov_epi16(blended, is_none, color1);
+}
+
+AVX512 void ConvertAVX512(u16 const* src, u32* dst) {
+  for (int x = 0; x < kLineWidth; x += 32) {
+    auto lanes = GetLaneMaskAVX512(x);
+
+    StoreARGB8888AVX512(_mm512_maskz_loadu_epi16(lanes, &src[x]), &dst[x], lanes);
+  }
+}
+
+AVX512 void BlendAVX512(
+  u16* target1,
+  u16 const* target2,
+  u16 const* effect,
+  LineBlender::Factors const& factors
+) {
+  auto const eva = _mm512_set1_epi16(factors.eva);
+  auto const evb = _mm512_set1_epi16(factors.evb);
+  auto const evy = _mm512_set1_epi16(factors.evy);
+
+  for (int x = 0; x < kLineWidth; x += 32) {
+    auto lanes = GetLaneMaskAVX512(x);
+    auto color = BlendPixelsAVX512(
+      _mm512_maskz_loadu_epi16(lanes, &target1[x]),
+      _mm512_maskz_loadu_epi16(lanes, &target2[x]),
+      _mm512_maskz_loadu_epi16(lanes, &effect[x]), eva, evb, evy);
+
+    _mm512_mask_storeu_epi16(&target1[x], lanes, color);
+  }
+}
+
+AVX512 void BlendAndConvertAVX512(
+  u16 const* target1,
+  u16 const* target2,
+  u16 const* effect,
+  LineBlender::Factors const& factors,
+  u32* dst
+) {
+  auto const eva = _mm512_set1_epi16(factors.eva);
+  auto const evb = _mm512_set1_epi16(factors.evb);
+  auto const evy = _mm512_set1_epi16(factors.evy);
+
+  for (int x = 0; x < kLineWidth; x += 32) {
+    auto lanes = GetLaneMaskAVX512(x);
+    auto color = BlendPixelsAVX512(
+      _mm512_maskz_loadu_epi16(lanes, &target1[x]),
+      _mm512_maskz_loadu_epi16(lanes, &target2[x]),
+      _mm512_maskz_loadu_epi16(lanes, &effect[x]), eva, evb, evy);
+
+    StoreARGB8888AVX512(color, &dst[x], lanes);
+  }
+}
+
+#undef AVX512
+
+#endif
+
+#elif defined(NBA_BLEND_NEON)
+
+auto ALWAYS_INLINE BlendChannelNEON(uint16x8_t a, uint16x8_t b, uint16x8_t effect, uint16x8_t eva, uint16x8_t evb, uint16x8_t evy) -> uint16x8_t {
+  auto const k31 = vdupq_n_u16(31);
+
+  auto blend = vminq_u16(vshrq_n_u16(vmlaq_u16(vmulq_u16(a, eva), b, evb), 4), k31);
+  auto brighten = vaddq_u16(a, vshrq_n_u16(vmulq_u16(vsubq_u16(k31, a), evy), 4));
+  auto darken = vsubq_u16(a, vshrq_n_u16(vmulq_u16(a, evy), 4));
+
+  auto result = vbslq_u16(vceqq_u16(effect, vdupq_n_u16(LineBlender::Blend)), blend, a);
+  result = vbslq_u16(vceqq_u16(effect, vdupq_n_u16(LineBlender::Brighten)), brighten, result);
+  return vbslq_u16(vceqq_u16(effect, vdupq_n_u16(LineBlender::Darken)), darken, result);
+}
+
+void ALWAYS_INLINE StoreARGB8888NEON(uint16x8_t color, u32* dst) {
+  auto convert = [](uint32x4_t x) {
+    return vorrq_u32(
+      vorrq_u32(
+        vshlq_n_u32(vandq_u32(x, vdupq_n_u32(0x001F)), 19),
+        vshlq_n_u32(vandq_u32(x, vdupq_n_u32(0x03E0)), 6)
+      ),
+      vorrq_u32(vshrq_n_u32(vandq_u32(x, vdupq_n_u32(0x7C00)), 7), vdupq_n_u32(0xFF000000))
+    );
+  };
+
+  vst1q_u32(&dst[0], convert(vmovl_u16(vget_low_u16(color))));
+  vst1q_u32(&dst[4], convert(vmovl_u16(vget_high_u16(color))));
+}
+
+auto ALWAYS_INLINE BlendPixelsNEON(uint16x8_t color1, uint16x8_t color2, uint16x8_t fx, uint16x8_t eva, uint16x8_t evb, uint16x8_t evy) -> uint16x8_t {
+  auto const mask = vdupq_n_u16(0x1F);
+
+  auto r = BlendChannelNEON(
+    vandq_u16(color1, mask), vandq_u16(color2, mask), fx, eva, evb, evy);
+  auto g = BlendChannelNEON(
+    vandq_u16(vshrq_n_u16(color1, 5), mask), vandq_u16(vshrq_n_u16(color2, 5), mask), fx, eva, evb, evy);
+  auto b = BlendChannelNEON(
+    vandq_u16(vshrq_n_u16(color1, 10), mask), vandq_u16(vshrq_n_u16(color2, 10), mask), fx, eva, evb, evy);
+
+  auto blended = vorrq_u16(r, vorrq_u16(vshlq_n_u16(g, 5), vshlq_n_u16(b, 10)));
+  return vbslq_u16(vceqq_u16(fx, vdupq_n_u16(LineBlender::None)), color1, blended);
+}
+
+void ConvertNEON(u16 const* src, u32* dst) {
+  for (int x = 0; x < kLineWidth; x += 8) {
+    StoreARGB8888NEON(vld1q_u16(&src[x]), &dst[x]);
+  }
+}
+
+void BlendNEON(
+  u16* target1,
+  u16 const* target2,
+  u16 const* effect,
+  LineBlender::Factors const& factors
+) {
+  auto const eva = vdupq_n_u16(factors.eva);
+  auto const evb = vdupq_n_u16(factors.evb);
+  auto const evy = vdupq_n_u16(factors.evy);
+
+  for (int x = 0; x < kLineWidth; x += 8) {
+    auto color = BlendPixelsNEON(vld1q_u16(&target1[x]), vld1q_u16(&target2[x]), vld1q_u16(&effect[x]), eva, evb, evy);
+
+    vst1q_u16(&target1[x], color);
+  }
+}
+
+void BlendAndConvertNEON(
+  u16 const* target1,
+  u16 const* target2,
+  u16 const* effect,
+  LineBlender::Factors const& factors,
+  u32* dst
+) {
+  auto const eva = vdupq_n_u16(factors.eva);
+  auto const evb = vdupq_n_u16(factors.evb);
+  auto const evy = vdupq_n_u16(factors.evy);
+
+  for (int x = 0; x < kLineWidth; x += 8) {
+    auto color = BlendPixelsNEON(vld1q_u16(&target1[x]), vld1q_u16(&target2[x]), vld1q_u16(&effect[x]), eva, evb, evy);
+
+    StoreARGB8888NEON(color, &dst[x]);
+  }
+}
+
+#endif
+
+struct Implementation {
+  ConvertFn convert;
+  BlendFn blend;
+  BlendAndConvertFn blend_and_convert;
+};
+
+auto SelectImplementation() -> Implementation {
+  return SelectKernel<Implementation>("PPU blend", {
+#if defined(NBA_BLEND_AVX)
+    { SIMDLevel::AVX512, { ConvertAVX512, BlendAVX512, BlendAndConvertAVX512 } },
+    { SIMDLevel::AVX2, { ConvertAVX2, BlendAVX2, BlendAndConvertAVX2 } },
+#endif
+#if defined(NBA_BLEND_X86)
+    { SIMDLevel::SSE2, { ConvertSSE2, BlendSSE2, BlendAndConvertSSE2 } },
+#elif defined(NBA_BLEND_NEON)
+    { SIMDLevel::NEON, { ConvertNEON, BlendNEON, BlendAndConvertNEON } },
+#endif
+    { SIMDLevel::Scalar, { ConvertScalar, BlendScalar, BlendAndConvertScalar } }
+  });
+}
+
+Implementation const g_implementation = SelectImplementation();
+
+static_assert(kLineWidth % 16 == 0);
+
+} // namespace
+
+void LineBlender::Factors::Set(int eva, int evb, int evy) {
+  eva = std::min(eva, 16);
+  evb = std::min(evb, 16);
+  evy = std::min(evy, 16);
+
+  if (eva != this->eva || evb != this->evb) {
+    for (int a = 0; a < 32; a++) {
+      for (int b = 0; b < 32; b++) {
+        blend[a][b] = u8(std::min((a * eva + b * evb) >> 4, 31));
+      }
+    }
+    this->eva = eva;
+    this->evb = evb;
+  }
+
+  if (evy != this->evy) {
+    for (int a = 0; a < 32; a++) {
+      brighten[a] = u8(a + (((31 - a) * evy) >> 4));
+      darken[a] = u8(a - ((a * evy) >> 4));
+    }
+    this->evy = evy;
+  }
+}
+
+void LineBlender::Convert(u16 const* src, u32* dst) {
+  g_implementation.convert(src, dst);
+}
+
+void LineBlender::Convert(u16 const* src, u32* dst, ColorLUT const& lut) {
+  for (int x = 0; x < kLineWidth; x++) {
+    dst[x] = lut[src[x] & 0x7FFF];
+  }
+}
+
+void LineBlender::ConvertRGB565(u16 const* src, u16* dst) {
+  for (int x = 0; x < kLineWidth; x++) {
+    u16 color = src[x];
+
+    dst[x] = (color & 0x001F) << 11 |
+             (color & 0x03E0) <<  1 |
+             (color & 0x0200) >>  4 |
+             (color & 0x7C00) >> 10;
+  }
+}
+
+void LineBlender::BlendInPlace(
+  u16* target1,
+  u16 const* target2,
+  u16 const* effect,
+  Factors const& factors
+) {
+  g_implementation.blend(target1, target2, effect, factors);
+}
+
+void LineBlender::BlendAndConvert(
+  u16 const* target1,
+  u16 const* target2,
+  u16 const* effect,
+  Factors const& factors,
+  u32* dst
+) {
+  g_implementation.blend_and_convert(target1, target2, effect, factors, dst);
+}
+
+} // namespace nba::core
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/config.hpp>
+#include <nba/integer.hpp>
+
+namespace nba::core {
+
+/* Final stage of the compositor, which operates on a full line of 240 pixels at once.
+ * The SIMD implementation (AVX2, SSE2 or NEON) is chosen once at startup,
+ * based on the features of the host CPU.
+ */
+struct LineBlender {
+  static constexpr int kLineWidth = 240;
+
+  // Per-pixel color effect, the values match BlendControl::Effect.
+  enum Effect : u16 {
+    None,
+    Blend,
+    Brighten,
+    Darken
+  };
+
+  /* Blend factors (clamped to 16) and the per-channel results for every 5-bit input.
+   * The tables are only rebuilt by Set() when BLDALPHA or BLDY changed, so that the scalar implementation
+   * needs one lookup per channel. The SIMD implementations use the factors, a multiply is cheaper than a gather.
+   */
+  struct Factors {
+    int eva = -1;
+    int evb = -1;
+    int evy = -1;
+
+    u8 blend[32][32]; // saturated (a * eva + b * evb) >> 4
+    u8 brighten[32];
+    u8 darken[32];
+
+    void Set(int eva, int evb, int evy);
+  };
+
+  // Converts BGR555 to ARGB8888.
+  static void Convert(u16 const* src, u32* dst);
+
+  // Converts BGR555 to ARGB8888 through a color correction table.
+  static void Convert(u16 const* src, u32* dst, ColorLUT const& lut);
+
+  // Converts BGR555 to RGB565.
+  static void ConvertRGB565(u16 const* src, u16* dst);
+
+  // Applies the color effect of every pixel to target1 (blending with target2) in place.
+  static void BlendInPlace(
+    u16* target1,
+    u16 const* target2,
+    u16 const* effect,
+    Factors const& factors
+  );
+
+  // Applies the color effect of every pixel to target1 (blending with target2) and converts the result to ARGB8888.
+  static void BlendAndConvert(
+    u16 const* target1,
+    u16 const* target2,
+    u16 const* effect,
+    Factors const& factors,
+    u32* dst
+  );
+};
+
+} // namespace nba::core
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <cstring>
+
+#include "hw/ppu/ppu.hpp"
+
+namespace nba::core {
+
+void PPU::CaptureLine(bool render_scanline, int obj_line) {
+  // OBJs are fetched on the line before they are displayed, with the mosaic counter of that line.
+  if (obj_line >= 0 && obj_line < PPUFrame::kLineCount) {
+    auto& mosaic_obj = ppu_frame->lines[obj_line].mosaic_obj;
+
+    mosaic_obj[0] = u8(mmio.mosaic.obj.size_x);
+    mosaic_obj[1] = u8(mmio.mosaic.obj._counter_y);
+  }
+
+  if (!render_scanline) {
+    return;
+  }
+
+  int vcount = mmio.vcount;
+  auto& line = ppu_frame->lines[vcount];
+
+  if (vcount == 0) {
+    std::memcpy(ppu_frame->vram, vram, sizeof(vram));
+    std::memcpy(ppu_frame->oam, oam, sizeof(oam));
+  }
+
+  std::memcpy(ppu_frame->pram[vcount], pram, sizeof(pram));
+
+  CaptureRegisters(line);
+}
+
+void PPU::CaptureRegisters(PPULine& line) {
+  line.dispcnt = mmio.dispcnt.Read(0) | (mmio.dispcnt.Read(1) << 8);
+
+  for (int i = 0; i < 4; i++) {
+    if (!enable_bg[0][i]) {
+      line.dispcnt &= ~(0x100 << i);
+    }
+
+    line.bgcnt[i] = mmio.bgcnt[i].Read(0) | (mmio.bgcnt[i].Read(1) << 8);
+    line.bghofs[i] = mmio.bghofs[i];
+    line.bgvofs[i] = mmio.bgvofs[i];
+  }
+
+  for (int i = 0; i < 2; i++) {
+    line.bgx[i] = mmio.bgx[i]._current;
+    line.bgy[i] = mmio.bgy[i]._current;
+    line.bgpa[i] = mmio.bgpa[i];
+    line.bgpb[i] = mmio.bgpb[i];
+    line.bgpc[i] = mmio.bgpc[i];
+    line.bgpd[i] = mmio.bgpd[i];
+    line.winh[i] = (mmio.winh[i].min << 8) | mmio.winh[i].max;
+  }
+
+  line.win_active = (window_scanline_enable[0] ? 1 : 0) | (window_scanline_enable[1] ? 2 : 0);
+  line.winin = mmio.winin.Read(0) | (mmio.winin.Read(1) << 8);
+  line.winout = mmio.winout.Read(0) | (mmio.winout.Read(1) << 8);
+  line.mosaic_bg[0] = u8(mmio.mosaic.bg.size_x);
+  line.mosaic_bg[1] = u8(mmio.mosaic.bg._counter_y);
+  line.bldcnt = mmio.bldcnt.Read(0) | (mmio.bldcnt.Read(1) << 8);
+  line.eva = u8(mmio.eva);
+  line.evb = u8(mmio.evb);
+  line.evy = u8(mmio.evy);
+}
+
+} // namespace nba::core
@@ -6,6 +6,7 @@
  */
 
 #include <algorithm>
+#include <nba/trace.hpp>
 
 #include "hw/ppu/ppu.hpp"
 
@@ -13,6 +14,13 @@ namespace nba::core {
 
 using BlendMode = BlendControl::Effect;
 
+static_assert(
+  (int)LineBlender::Blend == BlendMode::SFX_BLEND &&
+  (int)LineBlender::Brighten == BlendMode::SFX_BRIGHTEN &&
+  (int)LineBlender::Darken == BlendMode::SFX_DARKEN,
+  "PPU: line blender effects must match BLDCNT effect encoding"
+);
+
 auto PPU::ConvertColor(u16 color) -> u32 {
   int r = (color >>  0) & 0x1F;
   int g = (color >>  5) & 0x1F;
@@ -24,14 +32,154 @@ auto PPU::ConvertColor(u16 color) -> u32 {
          0xFF000000;
 }
 
+void PPU::OutputLine(u16 const* colors) {
+  switch (output_format) {
+    case PixelFormat::ARGB8888: {
+      auto line = GetOutputLine<u32>();
+
+      if (color_lut) {
+        LineBlender::Convert(colors, line, *color_lut);
+      } else {
+        LineBlender::Convert(colors, line);
+      }
+      break;
+    }
+    case PixelFormat::RGB565: {
+      LineBlender::ConvertRGB565(colors, GetOutputLine<u16>());
+      break;
+    }
+    case PixelFormat::BGR555: {
+      auto line = GetOutputLine<u16>();
+
+      for (int x = 0; x < 240; x++) {
+        line[x] = colors[x] & 0x7FFF;
+      }
+      break;
+    }
+  }
+}
+
+void PPU::FillLine(u16 color) {
+  u16 colors[240];
+
+  std::fill_n(colors, 240, color);
+  OutputLine(colors);
+
+  if (frame_scale != 1) {
+    ScaleLine();
+  }
+}
+
+template<typename T, int scale>
+static void RepeatPixels(T const* src, T* dst) {
+  for (int x = 0; x < 240; x++) {
+    for (int i = 0; i < scale; i++) {
+      dst[x * scale + i] = src[x];
+    }
+  }
+}
+
+// Scales the composed line up to all of its pixels in the frame.
+template<typename T>
+void PPU::ScaleLineTmpl() {
+  auto src = (T const*)scaled_line;
+  auto dst = GetScaledOutputLine<T>(0);
+
+  switch (frame_scale) {
+    case 2: RepeatPixels<T, 2>(src, dst); break;
+    case 3: RepeatPixels<T, 3>(src, dst); break;
+    case 4: RepeatPixels<T, 4>(src, dst); break;
+  }
+
+  for (int row = 1; row < frame_scale; row++) {
+    std::copy_n(dst, 240 * frame_scale, GetScaledOutputLine<T>(row));
+  }
+}
+
+void PPU::ScaleLine() {
+  if (output_format == PixelFormat::ARGB8888) {
+    ScaleLineTmpl<u32>();
+  } else {
+    ScaleLineTmpl<u16>();
+  }
+}
+
+// Stores the line composed at the current sub-pixel position into its pixels of the frame.
+template<typename T>
+void PPU::ScatterLineTmpl() {
+  auto src = (T const*)scaled_line;
+  auto dst = GetScaledOutputLine<T>(subpixel_y) + subpixel_x;
+
+  for (int x = 0; x < 240; x++) {
+    dst[x * frame_scale] = src[x];
+  }
+}
+
+void PPU::ScatterLine() {
+  if (output_format == PixelFormat::ARGB8888) {
+    ScatterLineTmpl<u32>();
+  } else {
+    ScatterLineTmpl<u16>();
+  }
+}
+
+// Whether the line contains an affine BG that looks different at each sub-pixel position.
+bool PPU::HasScaledBGs() {
+  int bg_max = mmio.dispcnt.mode == 2 ? 3 : 2;
+
+  if (mmio.dispcnt.mode == 0 || mmio.dispcnt.mode >= 6) {
+    return false;
+  }
+
+  for (int bg = 2; bg <= bg_max; bg++) {
+    if (enable_bg[0][bg] && mmio.dispcnt.enable[bg] && !mmio.bgcnt[bg].mosaic_enable) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Renders the affine BGs again at the current sub-pixel position. Mosaic BGs are left as they are.
+void PPU::RenderScaledBGs() {
+  auto scaled = [&](int bg) {
+    return mmio.dispcnt.enable[bg] && !mmio.bgcnt[bg].mosaic_enable;
+  };
+
+  switch (mmio.dispcnt.mode) {
+    case 1: {
+      if (scaled(2)) RenderLayerAffine(0);
+      break;
+    }
+    case 2: {
+      if (scaled(2)) RenderLayerAffine(0);
+      if (scaled(3)) RenderLayerAffine(1);
+      break;
+    }
+    case 3: {
+      if (scaled(2)) RenderLayerBitmap1();
+      break;
+    }
+    case 4: {
+      if (scaled(2)) RenderLayerBitmap2();
+      break;
+    }
+    case 5: {
+      if (scaled(2)) RenderLayerBitmap3();
+      break;
+    }
+  }
+}
+
 void PPU::RenderScanline() {
-  u16  vcount = mmio.vcount;
-  u32* line = &output[vcount * 240];
+  NBA_TRACE_ZONE("PPU::RenderScanline");
 
   if (mmio.dispcnt.forced_blank) {
-    for (int x = 0; x < 240; x++) {
-      line[x] = ConvertColor(0x7FFF);
-    }
+    FillLine(0x7FFF);
+    return;
+  }
+
+  if (mmio.dispcnt.mode >= 3 && mmio.dispcnt.mode <= 5 && RenderBitmapLineDirect()) {
     return;
   }
 
@@ -97,9 +245,14 @@ void PPU::RenderScanline() {
     case 6:
     case 7: {
       // TODO: do OBJs still work in this mode?
-      u32 backdrop = ConvertColor(ReadPalette(0, 0));
-      for (int x = 0; x < 240; x++) {
-        line[x] = backdrop;
+      if (output_format == PixelFormat::ARGB8888) {
+        std::fill_n(GetOutputLine<u32>(), 240, palette_argb[0]);
+
+        if (frame_scale != 1) {
+          ScaleLine();
+        }
+      } else {
+        FillLine(ReadPalette(0, 0));
       }
       break;
     }
@@ -108,7 +261,6 @@ void PPU::RenderScanline() {
 
 template<bool window, bool blending>
 void PPU::ComposeScanlineTmpl(int bg_min, int bg_max) {
-  u32* line = &output[mmio.vcount * 240];
   u16 backdrop = ReadPalette(0, 0);
 
   auto const& dispcnt = mmio.dispcnt;
@@ -132,32 +284,44 @@ void PPU::ComposeScanlineTmpl(int bg_min, int bg_max) {
   bool win1_active = false;
   bool win2_active = false;
 
-  const int* win_layer_enable;
-  
+  /* For each layer, the set of pixels where the layer is enabled by the window that covers the pixel.
+   * WIN0 takes priority over WIN1, which takes priority over the OBJ window.
+   */
+  LineMask layer_mask[6];
+
   if constexpr (window) {
     win0_active = dispcnt.enable[ENABLE_WIN0] && window_scanline_enable[0];
     win1_active = dispcnt.enable[ENABLE_WIN1] && window_scanline_enable[1];
     win2_active = dispcnt.enable[ENABLE_OBJWIN];
+
+    for (int i = 0; i < 4; i++) {
+      u64 mask_win0 = win0_active ? buffer_win[0][i] : 0;
+      u64 mask_win1 = win1_active ? buffer_win[1][i] & ~mask_win0 : 0;
+      u64 mask_winobj = win2_active ? buffer_obj.window[i] & ~(mask_win0 | mask_win1) : 0;
+      u64 mask_winout = ~(mask_win0 | mask_win1 | mask_winobj);
+
+      for (int layer = 0; layer < 6; layer++) {
+        layer_mask[layer][i] = (winin.enable[0][layer]  ? mask_win0   : 0) |
+                               (winin.enable[1][layer]  ? mask_win1   : 0) |
+                               (winout.enable[1][layer] ? mask_winobj : 0) |
+                               (winout.enable[0][layer] ? mask_winout : 0);
+      }
+    }
   }
 
   int prio[2];
   int layer[2];
   u16 pixel[2];
 
-  for (int x = 0; x < 240; x++) {
-    if constexpr (window) {
-      // Determine the window with the highest priority for this pixel.
-      if (win0_active && buffer_win[0][x]) {
-        win_layer_enable = winin.enable[0];
-      } else if (win1_active && buffer_win[1][x]) {
-        win_layer_enable = winin.enable[1];
-      } else if (win2_active && buffer_obj[x].window) {
-        win_layer_enable = winout.enable[1];
-      } else {
-        win_layer_enable = winout.enable[0];
-      }
-    }
+  /* Priority and window resolution is done per pixel.
+   * The color effects and the final color conversion are then applied
+   * to the whole line at once, which lets the blender use SIMD.
+   */
+  u16 line_target1[240];
+  u16 line_target2[240];
+  u16 line_effect[240];
 
+  for (int x = 0; x < 240; x++) {
     if constexpr (blending) {
       bool is_alpha_obj = false;
 
@@ -170,7 +334,7 @@ void PPU::ComposeScanlineTmpl(int bg_min, int bg_max) {
       for (int i = 0; i < bg_count; i++) {
         int bg = bg_list[i];
 
-        if (!window || win_layer_enable[bg]) {
+        if (!window || TestLineMask(layer_mask[bg], x)) {
           auto pixel_new = buffer_bg[bg][x];
           if (pixel_new != s_color_transparent) {
             layer[1] = layer[0];
@@ -184,15 +348,15 @@ void PPU::ComposeScanlineTmpl(int bg_min, int bg_max) {
       /* Check if a OBJ pixel takes priority over one of the two
        * top-most background pixels and insert it accordingly.
        */
-      if ((!window || win_layer_enable[LAYER_OBJ]) &&
+      if ((!window || TestLineMask(layer_mask[LAYER_OBJ], x)) &&
           dispcnt.enable[ENABLE_OBJ] &&
-          buffer_obj[x].color != s_color_transparent) {
-        int priority = buffer_obj[x].priority;
+          buffer_obj.color[x] != s_color_transparent) {
+        int priority = buffer_obj.priority[x];
 
         if (priority <= prio[0]) {
           layer[1] = layer[0];
           layer[0] = LAYER_OBJ;
-          is_alpha_obj = buffer_obj[x].alpha;
+          is_alpha_obj = TestLineMask(buffer_obj.alpha, x);
         } else if (priority <= prio[1]) {
           layer[1] = LAYER_OBJ;
         }
@@ -206,7 +370,7 @@ void PPU::ComposeScanlineTmpl(int bg_min, int bg_max) {
             pixel[i] = buffer_bg[_layer][x];
             break;
           case 4:
-            pixel[i] = buffer_obj[x].color;
+            pixel[i] = buffer_obj.color[x];
             break;
           case 5:
             pixel[i] = backdrop;
@@ -214,17 +378,22 @@ void PPU::ComposeScanlineTmpl(int bg_min, int bg_max) {
         }
       }
 
-      if (!window || win_layer_enable[LAYER_SFX] || is_alpha_obj) {
+      auto effect = BlendMode::SFX_NONE;
+
+      if (!window || TestLineMask(layer_mask[LAYER_SFX], x) || is_alpha_obj) {
         auto blend_mode = mmio.bldcnt.sfx;
         bool have_dst = mmio.bldcnt.targets[0][layer[0]];
         bool have_src = mmio.bldcnt.targets[1][layer[1]];
 
         if (is_alpha_obj && have_src) {
-          Blend(pixel[0], pixel[1], BlendMode::SFX_BLEND);
+          effect = BlendMode::SFX_BLEND;
         } else if (have_dst && blend_mode != BlendMode::SFX_NONE && (have_src || blend_mode != BlendMode::SFX_BLEND)) {
-          Blend(pixel[0], pixel[1], blend_mode);
+          effect = blend_mode;
         }
       }
+
+      line_target2[x] = pixel[1];
+      line_effect[x] = u16(effect);
     } else {
       pixel[0] = backdrop;
       prio[0] = 4;
@@ -234,7 +403,7 @@ void PPU::ComposeScanlineTmpl(int bg_min, int bg_max) {
         for (int i = bg_count - 1; i >= 0; i--) {
           int bg = bg_list[i];
 
-          if (!window || win_layer_enable[bg]) {
+          if (!window || TestLineMask(layer_mask[bg], x)) {
             u16 pixel_new = buffer_bg[bg][x];
             if (pixel_new != s_color_transparent) {
               pixel[0] = pixel_new;
@@ -246,19 +415,36 @@ void PPU::ComposeScanlineTmpl(int bg_min, int bg_max) {
       }
 
       // Check if a OBJ pixel takes priority over the top-most background pixel.
-      if ((!window || win_layer_enable[LAYER_OBJ]) &&
+      if ((!window || TestLineMask(layer_mask[LAYER_OBJ], x)) &&
           dispcnt.enable[ENABLE_OBJ] &&
-          buffer_obj[x].color != s_color_transparent &&
-          buffer_obj[x].priority <= prio[0]) {
-        pixel[0] = buffer_obj[x].color;
+          buffer_obj.color[x] != s_color_transparent &&
+          buffer_obj.priority[x] <= prio[0]) {
+        pixel[0] = buffer_obj.color[x];
       }
     }
 
-    line[x] = ConvertColor(pixel[0]);
+    line_target1[x] = pixel[0];
   }
+
+  if constexpr (blending) {
+    auto& factors = blend_factors;
+
+    factors.Set(mmio.eva, mmio.evb, mmio.evy);
+
+    if (output_format == PixelFormat::ARGB8888 && !color_lut) {
+      LineBlender::BlendAndConvert(line_target1, line_target2, line_effect, factors, GetOutputLine<u32>());
+      return;
+    }
+
+    LineBlender::BlendInPlace(line_target1, line_target2, line_effect, factors);
+  }
+
+  OutputLine(line_target1);
 }
 
 void PPU::ComposeScanline(int bg_min, int bg_max) {
+  NBA_TRACE_ZONE("PPU::ComposeScanline");
+
   auto const& dispcnt = mmio.dispcnt;
 
   int key = 0;
@@ -273,62 +459,62 @@ void PPU::ComposeScanline(int bg_min, int bg_max) {
     key |= 2;
   }
 
-  switch (key) {
-    case 0b00:
-      ComposeScanlineTmpl<false, false>(bg_min, bg_max);
-      break;
-    case 0b01:
-      ComposeScanlineTmpl<true, false>(bg_min, bg_max);
-      break;
-    case 0b10:
-      ComposeScanlineTmpl<false, true>(bg_min, bg_max);
-      break;
-    case 0b11:
-      ComposeScanlineTmpl<true, true>(bg_min, bg_max);
-      break;
+  auto compose = [&]() {
+    switch (key) {
+      case 0b00:
+        ComposeScanlineTmpl<false, false>(bg_min, bg_max);
+        break;
+      case 0b01:
+        ComposeScanlineTmpl<true, false>(bg_min, bg_max);
+        break;
+      case 0b10:
+        ComposeScanlineTmpl<false, true>(bg_min, bg_max);
+        break;
+      case 0b11:
+        ComposeScanlineTmpl<true, true>(bg_min, bg_max);
+        break;
+    }
+  };
+
+  if (frame_scale == 1) {
+    compose();
+    return;
   }
-}
 
-void PPU::Blend(u16& target1,
-                u16  target2,
-                BlendMode sfx) {
-  int r1 = (target1 >>  0) & 0x1F;
-  int g1 = (target1 >>  5) & 0x1F;
-  int b1 = (target1 >> 10) & 0x1F;
-
-  switch (sfx) {
-    case BlendMode::SFX_BLEND: {
-      int eva = std::min<int>(16, mmio.eva);
-      int evb = std::min<int>(16, mmio.evb);
-
-      int r2 = (target2 >>  0) & 0x1F;
-      int g2 = (target2 >>  5) & 0x1F;
-      int b2 = (target2 >> 10) & 0x1F;
-
-      r1 = std::min<u8>((r1 * eva + r2 * evb) >> 4, 31);
-      g1 = std::min<u8>((g1 * eva + g2 * evb) >> 4, 31);
-      b1 = std::min<u8>((b1 * eva + b2 * evb) >> 4, 31);
-      break;
-    }
-    case BlendMode::SFX_BRIGHTEN: {
-      int evy = std::min<int>(16, mmio.evy);
-      
-      r1 += ((31 - r1) * evy) >> 4;
-      g1 += ((31 - g1) * evy) >> 4;
-      b1 += ((31 - b1) * evy) >> 4;
-      break;
+  bool scaled_bgs = HasScaledBGs();
+  bool scaled_objs = obj_line_scaled && dispcnt.enable[ENABLE_OBJ];
+
+  if (!scaled_bgs && !scaled_objs) {
+    compose();
+    ScaleLine();
+    return;
+  }
+
+  int phases = frame_scale * frame_scale;
+
+  for (int phase = 0; phase < phases; phase++) {
+    subpixel_x = phase % frame_scale;
+    subpixel_y = phase / frame_scale;
+
+    // The layers of the first phase were rendered as usual.
+    if (scaled_bgs && phase != 0) {
+      RenderScaledBGs();
     }
-    case BlendMode::SFX_DARKEN: {
-      int evy = std::min<int>(16, mmio.evy);
-      
-      r1 -= (r1 * evy) >> 4;
-      g1 -= (g1 * evy) >> 4;
-      b1 -= (b1 * evy) >> 4;
-      break;
+
+    if (scaled_objs) {
+      buffer_obj = buffer_obj_scaled[phase];
     }
+
+    compose();
+    ScatterLine();
   }
 
-  target1 = r1 | (g1 << 5) | (b1 << 10);
+  subpixel_x = 0;
+  subpixel_y = 0;
+
+  if (scaled_objs) {
+    buffer_obj = buffer_obj_scaled[0];
+  }
 }
 
 } // namespace nba::core
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "hw/ppu/ppu.hpp"
+
+namespace nba::core {
+
+void PPU::InvalidateLines() {
+  for (auto& state : line_state) {
+    state.valid = false;
+  }
+
+  line_stamp = 1;
+  pram_stamp = 0;
+  std::fill(std::begin(vram_tile_stamp), std::end(vram_tile_stamp), 0);
+  std::fill(std::begin(vram_page_stamp), std::end(vram_page_stamp), 0);
+  dirty_lines.set();
+}
+
+void PPU::GetLineInputs(LineInputs& inputs) {
+  std::memset(&inputs, 0, sizeof(inputs));
+
+  CaptureRegisters(inputs.registers);
+
+  inputs.buffer_win[0] = buffer_win[0];
+  inputs.buffer_win[1] = buffer_win[1];
+
+  // FNV-1a over the OBJ line, a word at a time.
+  u64 hash = 0xCBF29CE484222325ULL;
+
+  auto combine = [&](u64 value) {
+    hash = (hash ^ value) * 0x100000001B3ULL;
+  };
+
+  auto combine_array = [&](void const* data, size_t size) {
+    for (size_t i = 0; i < size; i += sizeof(u64)) {
+      combine(read<u64>(data, i));
+    }
+  };
+
+  static_assert(sizeof(buffer_obj.color) % sizeof(u64) == 0 && sizeof(buffer_obj.priority) % sizeof(u64) == 0);
+
+  combine_array(buffer_obj.color, sizeof(buffer_obj.color));
+  combine_array(buffer_obj.priority, sizeof(buffer_obj.priority));
+
+  for (u64 word : buffer_obj.alpha) {
+    combine(word);
+  }
+
+  for (u64 word : buffer_obj.window) {
+    combine(word);
+  }
+
+  combine(line_contains_alpha_obj ? 1 : 0);
+
+  inputs.obj_hash = hash;
+}
+
+// Returns the newest stamp of the VRAM and BG palette entries that the current line reads.
+auto PPU::GetLineInputStamp() -> u64 {
+  auto const& dispcnt = mmio.dispcnt;
+
+  u64 stamp = pram_stamp;
+
+  auto stamp_pages = [&](u32 begin, u32 end) {
+    end = std::min(end, (u32)sizeof(vram));
+
+    for (u32 page = begin >> 10; page < (end + 1023) >> 10; page++) {
+      stamp = std::max(stamp, vram_page_stamp[page]);
+    }
+  };
+
+  auto stamp_tile = [&](u32 address) {
+    if (address < sizeof(vram)) {
+      stamp = std::max(stamp, vram_tile_stamp[address >> 5]);
+    }
+  };
+
+  // The map entries of the 31 tiles that intersect the line and the rows of those tiles.
+  auto stamp_text = [&](int id) {
+    auto const& bgcnt = mmio.bgcnt[id];
+
+    int line = mmio.bgvofs[id] + mmio.vcount;
+
+    if (bgcnt.mosaic_enable) {
+      line -= mmio.mosaic.bg._counter_y;
+    }
+
+    int grid_x = mmio.bghofs[id] / 8;
+    int grid_y = line / 8;
+    int tile_y = line % 8;
+
+    u32 tile_base = bgcnt.tile_block * 16384;
+    u32 map_base = (bgcnt.map_block * 2048) + ((grid_y % 32) * 64);
+
+    if (bgcnt.size & 2) {
+      map_base += ((grid_y / 32) % 2) * (bgcnt.size == 3 ? 4096 : 2048);
+    }
+
+    for (int i = 0; i < 31; i++) {
+      int x = (grid_x + i) % 64;
+      u32 offset = map_base + (x % 32) * 2;
+
+      if ((bgcnt.size & 1) && x >= 32) {
+        offset += 2048;
+      }
+
+      stamp_tile(offset);
+
+      u16 encoder = read<u16>(vram, offset);
+      int number = encoder & 0x3FF;
+      int _tile_y = (encoder & (1 << 11)) ? (tile_y ^ 7) : tile_y;
+
+      if (bgcnt.full_palette) {
+        stamp_tile(tile_base + number * 64 + _tile_y * 8);
+      } else {
+        stamp_tile(tile_base + number * 32 + _tile_y * 4);
+      }
+    }
+  };
+
+  auto stamp_affine = [&](int id) {
+    auto const& bgcnt = mmio.bgcnt[id];
+
+    u32 map_base = bgcnt.map_block * 2048;
+    u32 tile_base = bgcnt.tile_block * 16384;
+    u32 blocks = (128 << bgcnt.size) / 8;
+
+    stamp_pages(map_base, map_base + blocks * blocks);
+    stamp_pages(tile_base, tile_base + 256 * 64);
+  };
+
+  if (dispcnt.forced_blank) {
+    return stamp;
+  }
+
+  u32 frame = dispcnt.frame * 0xA000;
+
+  switch (dispcnt.mode) {
+    case 0:
+    case 1:
+    case 2: {
+      for (int id = 0; id < 4; id++) {
+        if (!dispcnt.enable[id]) {
+          continue;
+        }
+
+        if (dispcnt.mode == 0 || (dispcnt.mode == 1 && id < 2)) {
+          stamp_text(id);
+        } else if (id >= 2) {
+          stamp_affine(id);
+        }
+      }
+      break;
+    }
+    case 3: {
+      if (dispcnt.enable[ENABLE_BG2]) {
+        stamp_pages(0, 240 * 160 * 2);
+      }
+      break;
+    }
+    case 4: {
+      if (dispcnt.enable[ENABLE_BG2]) {
+        stamp_pages(frame, frame + 240 * 160);
+      }
+      break;
+    }
+    case 5: {
+      if (dispcnt.enable[ENABLE_BG2]) {
+        stamp_pages(frame, frame + 160 * 128 * 2);
+      }
+      break;
+    }
+  }
+
+  return stamp;
+}
+
+// Returns whether the current line has to be rendered again and records the inputs that it is rendered with.
+bool PPU::LineChanged() {
+  auto& state = line_state[mmio.vcount];
+
+  LineInputs inputs;
+
+  GetLineInputs(inputs);
+
+  // OBJ lines with sub-pixel positions are not covered by the OBJ hash.
+  bool changed = !state.valid || obj_line_scaled ||
+                 GetLineInputStamp() > state.stamp ||
+                 std::memcmp(&inputs, &state.inputs, sizeof(inputs)) != 0;
+
+  if (changed) {
+    std::memcpy(&state.inputs, &inputs, sizeof(inputs));
+    state.valid = true;
+  }
+
+  // Anything written from now on is newer than this line.
+  state.stamp = line_stamp++;
+  return changed;
+}
+
+} // namespace nba::core
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <cstring>
+#include <nba/trace.hpp>
+
+#include "hw/ppu/ppu.hpp"
+
+namespace nba::core {
+
+// Each worker has its own PPU instance, so there is little to gain from more workers than bands of a few lines.
+static constexpr int kMaxFrameWorkers = 16;
+
+void PPU::StartFrameRenderer() {
+  if (frame_renderer) {
+    return;
+  }
+
+  frame_renderer = std::make_unique<FrameRenderer>();
+
+  auto& fr = *frame_renderer;
+  int worker_count = std::clamp((int)std::thread::hardware_concurrency(), 1, kMaxFrameWorkers);
+
+  fr.workers.resize(worker_count);
+
+  for (int id = 0; id < worker_count; id++) {
+    fr.workers[id].ppu = std::unique_ptr<PPU>{new PPU{RenderThreadTag{}, *this}};
+
+    if (id != 0) {
+      fr.workers[id].thread = std::thread{&PPU::FrameWorkerLoop, this, id};
+    }
+  }
+}
+
+void PPU::StopFrameRenderer() {
+  if (!frame_renderer) {
+    return;
+  }
+
+  auto& fr = *frame_renderer;
+
+  {
+    std::lock_guard lock{fr.mutex};
+    fr.quit = true;
+  }
+
+  fr.cv_start.notify_all();
+
+  for (auto& worker : fr.workers) {
+    if (worker.thread.joinable()) {
+      worker.thread.join();
+    }
+  }
+
+  frame_renderer.reset();
+  write_log = nullptr;
+}
+
+void PPU::SyncFrameRenderer() {
+  auto& fr = *frame_renderer;
+
+  // Jobs that were recorded so far are dropped, the next job copies the memory again.
+  fr.recording = false;
+  write_log = nullptr;
+
+  fr.buffer_obj = buffer_obj;
+  fr.line_contains_alpha_obj = line_contains_alpha_obj;
+
+  for (auto& worker : fr.workers) {
+    auto& ppu = *worker.ppu;
+
+    ppu.output_format = output_format;
+    ppu.frame_scale = frame_scale;
+    ppu.color_lut = color_lut;
+    ppu.skip_unchanged_lines = false;
+    ppu.dirty_lines.reset();
+  }
+}
+
+void PPU::SubmitFrameJob(bool render_scanline, int obj_line) {
+  auto& fr = *frame_renderer;
+
+  if (!fr.recording) {
+    // All writes before the first job are covered by copying the memory.
+    std::memcpy(fr.pram, pram, sizeof(pram));
+    std::memcpy(fr.oam,  oam,  sizeof(oam));
+    std::memcpy(fr.vram, vram, sizeof(vram));
+
+    if (fr.jobs.empty()) {
+      fr.jobs.emplace_back();
+    }
+
+    fr.jobs[0].writes.clear();
+    fr.job_count = 0;
+    fr.recording = true;
+  }
+
+  auto& job = fr.jobs[fr.job_count++];
+
+  job.render_scanline = render_scanline;
+  job.obj_line = obj_line;
+  job.mmio = mmio;
+  job.frame_buffer = frame_buffer;
+  std::memcpy(job.enable_bg, enable_bg, sizeof(enable_bg));
+  std::memcpy(job.buffer_win, buffer_win, sizeof(buffer_win));
+  std::memcpy(job.window_scanline_enable, window_scanline_enable, sizeof(window_scanline_enable));
+
+  if (fr.job_count == (int)fr.jobs.size()) {
+    fr.jobs.emplace_back();
+  }
+
+  fr.jobs[fr.job_count].writes.clear();
+  write_log = &fr.jobs[fr.job_count].writes;
+}
+
+void PPU::RenderFrameJobs() {
+  auto& fr = *frame_renderer;
+
+  if (!fr.recording) {
+    return;
+  }
+
+  fr.recording = false;
+  write_log = nullptr;
+
+  int band_count = std::min((int)fr.workers.size(), fr.job_count);
+
+  {
+    std::lock_guard lock{fr.mutex};
+    fr.band_count = band_count;
+    fr.pending = (int)fr.workers.size() - 1;
+    fr.generation++;
+  }
+
+  fr.cv_start.notify_all();
+
+  RenderFrameBand(0);
+
+  {
+    std::unique_lock lock{fr.mutex};
+    fr.cv_done.wait(lock, [&] { return fr.pending == 0; });
+  }
+
+  // The OBJ line that was rendered last carries over to the next recorded jobs.
+  auto& last = *fr.workers[band_count - 1].ppu;
+
+  fr.buffer_obj = last.buffer_obj;
+  fr.line_contains_alpha_obj = last.line_contains_alpha_obj;
+
+  for (int id = 0; id < band_count; id++) {
+    auto& lines = fr.workers[id].ppu->dirty_lines;
+
+    dirty_lines |= lines;
+    lines.reset();
+  }
+}
+
+void PPU::FrameWorkerLoop(int id) {
+  auto& fr = *frame_renderer;
+  u64 generation = 0;
+
+  NBA_TRACE_THREAD("Frame render worker");
+
+  if (config->on_thread_start) {
+    config->on_thread_start("Frame render worker");
+  }
+
+  while (true) {
+    {
+      std::unique_lock lock{fr.mutex};
+
+      fr.cv_start.wait(lock, [&] { return fr.quit || fr.generation != generation; });
+
+      if (fr.quit) {
+        break;
+      }
+
+      generation = fr.generation;
+    }
+
+    RenderFrameBand(id);
+
+    {
+      std::lock_guard lock{fr.mutex};
+      fr.pending--;
+    }
+
+    fr.cv_done.notify_one();
+  }
+}
+
+void PPU::RenderFrameBand(int id) {
+  auto& fr = *frame_renderer;
+  auto& ppu = *fr.workers[id].ppu;
+
+  if (id >= fr.band_count) {
+    return;
+  }
+
+  int begin = fr.job_count * id / fr.band_count;
+  int end = fr.job_count * (id + 1) / fr.band_count;
+  void* buffer = output.data();
+
+  std::memcpy(ppu.pram, fr.pram, sizeof(pram));
+  std::memcpy(ppu.oam,  fr.oam,  sizeof(oam));
+  std::memcpy(ppu.vram, fr.vram, sizeof(vram));
+  ppu.buffer_obj = fr.buffer_obj;
+  ppu.line_contains_alpha_obj = fr.line_contains_alpha_obj;
+  ppu.obj_line_scaled = false;
+  ppu.RebuildPaletteCache();
+  ppu.InvalidateTileCache();
+  ppu.obj_cache_dirty = true;
+
+  // The first line of the band reads the OBJs that were rendered last before it.
+  int obj_job = begin - 1;
+
+  while (obj_job >= 0 && fr.jobs[obj_job].obj_line < 0) {
+    obj_job--;
+  }
+
+  for (int i = 0; i < end; i++) {
+    auto const& job = fr.jobs[i];
+
+    for (auto const& write : job.writes) {
+      ppu.ReplayMemoryWrite(write);
+    }
+
+    if (i >= begin || i == obj_job) {
+      ppu.LoadRenderJob(job);
+
+      if (!job.frame_buffer) {
+        ppu.frame_buffer = buffer;
+      }
+
+      if (i >= begin) {
+        ppu.DrawLine(job.render_scanline, job.obj_line);
+      } else {
+        ppu.DrawLine(false, job.obj_line);
+      }
+    }
+  }
+}
+
+} // namespace nba::core
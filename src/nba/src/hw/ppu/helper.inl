@@ -13,43 +13,83 @@ auto ReadPalette(int palette, int index) -> u16 {
            pram[cell + 0]) & 0x7FFF;
 }
 
-void DecodeTileLine4BPP(u16* buffer, u32 base, int palette, int number, int y, bool flip) {
-  u8* data = &vram[base + (number * 32) + (y * 4)];
+static auto ALWAYS_INLINE TestLineMask(LineMask const& mask, int x) -> bool {
+  return (mask[x >> 6] >> (x & 63)) & 1;
+}
+
+// Returns a mask with the bits of all pixels in [min, max) set.
+static auto GetRangeMask(int min, int max) -> LineMask {
+  LineMask mask;
 
-  if (flip) {
-    for (int x = 0; x < 4; x++) {
-      int d  = *data++;
-      int p1 = d & 15;
-      int p2 = d >> 4;
+  max = std::min(max, 240);
 
-      buffer[(x*2+0)^7] = p1 ? ReadPalette(palette, p1) : s_color_transparent;
-      buffer[(x*2+1)^7] = p2 ? ReadPalette(palette, p2) : s_color_transparent;
+  for (int i = 0; i < 4; i++) {
+    int lo = std::clamp(min - i * 64, 0, 64);
+    int hi = std::clamp(max - i * 64, 0, 64);
+
+    if (hi <= lo) {
+      mask[i] = 0;
+    } else if (hi - lo == 64) {
+      mask[i] = ~0ULL;
+    } else {
+      mask[i] = ((1ULL << (hi - lo)) - 1) << lo;
     }
-  } else {
-    for (int x = 0; x < 4; x++) {
-      int d  = *data++;
-      int p1 = d & 15;
-      int p2 = d >> 4;
+  }
+
+  return mask;
+}
+
+void ALWAYS_INLINE MarkTileDirty(u32 address) {
+  tile_dirty[address >> 11] |= 1ULL << ((address >> 5) & 63);
+}
+
+void ALWAYS_INLINE StampVRAMWrite(u32 address) {
+  vram_tile_stamp[address >> 5] = line_stamp;
+  vram_page_stamp[address >> 10] = line_stamp;
+}
+
+void InvalidateTileCache() {
+  std::fill(std::begin(tile_dirty), std::end(tile_dirty), ~0ULL);
+}
 
-      buffer[x*2+0] = p1 ? ReadPalette(palette, p1) : s_color_transparent;
-      buffer[x*2+1] = p2 ? ReadPalette(palette, p2) : s_color_transparent;
+// Returns the palette indices of the 4BPP tile at the given address, decoding it on first use after a write.
+auto ALWAYS_INLINE GetDecodedTile4BPP(u32 address) -> u8 const* {
+  auto& word = tile_dirty[address >> 11];
+  auto bit = 1ULL << ((address >> 5) & 63);
+  u8* decoded = &tile_cache[address * 2];
+
+  if (unlikely(word & bit)) {
+    for (int i = 0; i < 32; i++) {
+      int d = vram[address + i];
+
+      decoded[i * 2 + 0] = d & 15;
+      decoded[i * 2 + 1] = d >> 4;
     }
+    word &= ~bit;
+  }
+
+  return decoded;
+}
+
+void DecodeTileLine4BPP(u16* buffer, u32 base, int palette, int number, int y, bool flip) {
+  u8 const* data = GetDecodedTile4BPP(base + number * 32) + y * 8;
+  int flip_mask = flip ? 7 : 0;
+
+  for (int x = 0; x < 8; x++) {
+    int index = data[x ^ flip_mask];
+
+    buffer[x] = index ? ReadPalette(palette, index) : s_color_transparent;
   }
 }
 
 void DecodeTileLine8BPP(u16* buffer, u32 base, int number, int y, bool flip) {
-  u8* data = &vram[base + (number * 64) + (y * 8)];
+  u8 const* data = &vram[base + (number * 64) + (y * 8)];
+  int flip_mask = flip ? 7 : 0;
 
-  if (flip) {
-    for (int x = 7; x >= 0; x--) {
-      int pixel = *data++;
-      buffer[x] = pixel ? ReadPalette(0, pixel) : s_color_transparent;
-    }
-  } else {
-    for (int x = 0; x < 8; x++) {
-      int pixel = *data++;
-      buffer[x] = pixel ? ReadPalette(0, pixel) : s_color_transparent;
-    }
+  for (int x = 0; x < 8; x++) {
+    int index = data[x ^ flip_mask];
+
+    buffer[x] = index ? ReadPalette(0, index) : s_color_transparent;
   }
 }
 
@@ -78,11 +118,13 @@ auto DecodeTilePixel8BPP(u32 address, int x, int y, bool sprite = false) -> u16
   }
 }
 
-void AffineRenderLoop(int id,
-                      int width,
-                      int height,
-                      std::function<void(int, int, int)> render_func) {
-  auto const& bg = mmio.bgcnt[2 + id];
+// Offset of the sub-pixel position that is rendered (see frame_scale) along the given affine parameters, in 1/256 pixels.
+auto ALWAYS_INLINE GetAffineSubpixelOffset(s32 dx, s32 dy) -> s32 {
+  return (dx * subpixel_x + dy * subpixel_y) / frame_scale;
+}
+
+template<bool mosaic_enable, bool wraparound, typename F>
+void AffineRenderLoopTmpl(int id, int width, int height, F const& render_func) {
   auto const& mosaic = mmio.mosaic.bg;
   u16* buffer = buffer_bg[2 + id];
   
@@ -92,12 +134,18 @@ void AffineRenderLoop(int id,
   s16 pc = mmio.bgpc[id];
   
   int mosaic_x = 0;
+
+  // Mosaic BGs are rendered at whole pixels only.
+  if constexpr (!mosaic_enable) {
+    ref_x += GetAffineSubpixelOffset(pa, mmio.bgpb[id]);
+    ref_y += GetAffineSubpixelOffset(pc, mmio.bgpd[id]);
+  }
   
   for (int _x = 0; _x < 240; _x++) {
     s32 x = ref_x >> 8;
     s32 y = ref_y >> 8;
     
-    if (bg.mosaic_enable) {
+    if constexpr (mosaic_enable) {
       if (++mosaic_x == mosaic.size_x) {
         ref_x += mosaic.size_x * pa;
         ref_y += mosaic.size_x * pc;
@@ -108,7 +156,7 @@ void AffineRenderLoop(int id,
       ref_y += pc;
     }
     
-    if (bg.wraparound) {
+    if constexpr (wraparound) {
       if (x >= width) {
         x %= width;
       } else if (x < 0) {
@@ -128,3 +176,29 @@ void AffineRenderLoop(int id,
     render_func(_x, (int)x, (int)y);
   }
 }
+
+// Selects the loop specialized for the mosaic and wraparound settings of the BG once per line.
+template<typename F>
+void AffineRenderLoop(int id, int width, int height, F const& render_func) {
+  auto const& bg = mmio.bgcnt[2 + id];
+
+  int key = 0;
+
+  if (bg.mosaic_enable) key |= 1;
+  if (bg.wraparound) key |= 2;
+
+  switch (key) {
+    case 0b00:
+      AffineRenderLoopTmpl<false, false>(id, width, height, render_func);
+      break;
+    case 0b01:
+      AffineRenderLoopTmpl<true, false>(id, width, height, render_func);
+      break;
+    case 0b10:
+      AffineRenderLoopTmpl<false, true>(id, width, height, render_func);
+      break;
+    case 0b11:
+      AffineRenderLoopTmpl<true, true>(id, width, height, render_func);
+      break;
+  }
+}
@@ -15,20 +15,36 @@ PPU::PPU(
   Scheduler& scheduler,
   IRQ& irq,
   DMA& dma,
+  DirtyTracker& dirty_tracker,
   std::shared_ptr<Config> config
 )   : scheduler(scheduler)
     , irq(irq)
     , dma(dma)
-    , config(config) {
+    , config(config)
+    , dirty_tracker(&dirty_tracker) {
   mmio.dispcnt.ppu = this;
   mmio.dispstat.ppu = this;
+
+  scheduler.Register<&PPU::OnScanlineComplete>(EventClass::PPU_scanline_complete, this);
+  scheduler.Register<&PPU::OnHblankComplete>(EventClass::PPU_hblank_complete, this);
+  scheduler.Register<&PPU::OnVblankScanlineComplete>(EventClass::PPU_vblank_scanline_complete, this);
+  scheduler.Register<&PPU::OnVblankHblankComplete>(EventClass::PPU_vblank_hblank_complete, this);
+
   Reset();
 }
 
+PPU::~PPU() {
+  StopRenderThread();
+  StopFrameRenderer();
+}
+
 void PPU::Reset() {
   std::memset(pram, 0, 0x00400);
   std::memset(oam,  0, 0x00400);
   std::memset(vram, 0, 0x18000);
+  InvalidateTileCache();
+  obj_cache_dirty = true;
+  obj_line_scaled = false;
 
   mmio.dispcnt.Reset();
   mmio.dispstat.Reset();
@@ -65,11 +81,65 @@ void PPU::Reset() {
   mmio.evy = 0;
   mmio.bldcnt.Reset();
 
+  output_format = config->video_dev->GetPixelFormat();
+  frame_scale = std::clamp(config->video_dev->GetFrameScale(), 1, VideoDevice::kMaxFrameScale);
+  output = {};
+  frame_buffer = nullptr;
+  ppu_frame = nullptr;
+
+  color_lut = config->color_lut.get();
+  RebuildPaletteCache();
+
+  // Lines are rendered by different workers from frame to frame, which do not know how they were rendered before.
+  skip_unchanged_lines = config->skip_unchanged_lines && !config->parallel_rendering;
+  InvalidateLines();
+
+  frame_skip = std::max(config->frame_skip, 0);
+  frame_skip_counter = 0;
+  render_frame = true;
+
    // VCOUNT=225 DISPSTAT=3 was measured after reset on a 3DS in GBA mode (thanks Lady Starbreeze).
   mmio.vcount = 225;
   mmio.dispstat.vblank_flag = true;
   mmio.dispstat.hblank_flag = true;
-  scheduler.Add(226, this, &PPU::OnVblankHblankComplete);
+  scheduler.Add(226, EventClass::PPU_vblank_hblank_complete);
+
+  if (config->parallel_rendering) {
+    StopRenderThread();
+    StartFrameRenderer();
+    SyncFrameRenderer();
+  } else if (config->threaded_rendering) {
+    StopFrameRenderer();
+    StartRenderThread();
+    SyncRenderThread();
+  } else {
+    StopRenderThread();
+    StopFrameRenderer();
+  }
+}
+
+/* The internal output buffer is only allocated once a frame is rendered into it,
+ * which never happens if the video device provides the frame buffers.
+ */
+void PPU::AllocateOutput() {
+  size_t size = 240 * 160 * frame_scale * frame_scale;
+
+  if (render_thread) {
+    auto& buffer = render_thread->ppu->output;
+
+    if (buffer.size() != size) {
+      WaitForRenderThread();
+      buffer.resize(size);
+    }
+  } else if (output.size() != size) {
+    output.resize(size);
+  }
+}
+
+void PPU::RebuildPaletteCache() {
+  for (int i = 0; i < 0x200; i++) {
+    UpdatePaletteCache(i);
+  }
 }
 
 void PPU::LatchEnabledBGs() {
@@ -93,6 +163,31 @@ void PPU::CheckVerticalCounterIRQ() {
   dispstat.vcount_flag = vcount_flag_new;
 }
 
+void PPU::RenderLine(bool render_scanline, int obj_line) {
+  NBA_PROFILE_SCOPE(scheduler, PPURender);
+
+  if (ppu_frame) {
+    CaptureLine(render_scanline, obj_line);
+  } else if (render_thread) {
+    SubmitRenderJob(render_scanline, obj_line);
+  } else if (frame_renderer) {
+    SubmitFrameJob(render_scanline, obj_line);
+  } else {
+    DrawLine(render_scanline, obj_line);
+  }
+}
+
+void PPU::DrawLine(bool render_scanline, int obj_line) {
+  if (render_scanline && (!skip_unchanged_lines || LineChanged())) {
+    RenderScanline();
+    dirty_lines.set(mmio.vcount);
+  }
+
+  if (obj_line >= 0) {
+    RenderLayerOAM(mmio.dispcnt.mode >= 3, obj_line);
+  }
+}
+
 void PPU::OnScanlineComplete(int cycles_late) {
   auto& bgx = mmio.bgx;
   auto& bgy = mmio.bgy;
@@ -100,7 +195,7 @@ void PPU::OnScanlineComplete(int cycles_late) {
   auto& bgpd = mmio.bgpd;
   auto& mosaic = mmio.mosaic;
 
-  scheduler.Add(226 - cycles_late, this, &PPU::OnHblankComplete);
+  scheduler.Add(226 - cycles_late, EventClass::PPU_hblank_complete);
 
   mmio.dispstat.hblank_flag = 1;
 
@@ -176,9 +271,47 @@ void PPU::OnHblankComplete(int cycles_late) {
   }
 
   if (vcount == 160) {
-    config->video_dev->Draw(output);
+    if (frame_renderer) {
+      RenderFrameJobs();
+    }
+
+    if (render_frame && video_output_enabled) {
+      if (ppu_frame) {
+        config->video_dev->Draw(*ppu_frame);
+      } else {
+        if (render_thread) {
+          WaitForRenderThread();
+        }
+
+        auto& lines = GetDirtyLines();
+        auto& latency_probe = config->latency_probe;
+
+        if (latency_probe) {
+          auto pixel_size = output_format == PixelFormat::ARGB8888 ? sizeof(u32) : sizeof(u16);
+
+          latency_probe->OnFrameRendered(GetOutput(), 240 * 160 * frame_scale * frame_scale * pixel_size);
+        }
+
+        config->video_dev->SetDirtyLines(lines);
+
+        if (output_format == PixelFormat::ARGB8888) {
+          config->video_dev->Draw((u32*)GetOutput());
+        } else {
+          config->video_dev->Draw((u16*)GetOutput());
+        }
+
+        if (latency_probe) {
+          latency_probe->OnFrameDrawn();
+        }
 
-    scheduler.Add(1006 - cycles_late, this, &PPU::OnVblankScanlineComplete);
+        lines.reset();
+      }
+    }
+
+    ppu_frame = nullptr;
+    frame_count++;
+
+    scheduler.Add(1006 - cycles_late, EventClass::PPU_vblank_scanline_complete);
     dma.Request(DMA::Occasion::VBlank);
     dispstat.vblank_flag = 1;
 
@@ -196,11 +329,10 @@ void PPU::OnHblankComplete(int cycles_late) {
     bgx[1]._current = bgx[1].initial;
     bgy[1]._current = bgy[1].initial;
   } else {
-    scheduler.Add(1006 - cycles_late, this, &PPU::OnScanlineComplete);
-    RenderScanline();
-    // Render OBJs for the next scanline.
-    if (mmio.dispcnt.enable[ENABLE_OBJ]) {
-      RenderLayerOAM(mmio.dispcnt.mode >= 3, mmio.vcount + 1);
+    scheduler.Add(1006 - cycles_late, EventClass::PPU_scanline_complete);
+    if (render_frame) {
+      // Render this scanline and the OBJs for the next scanline.
+      RenderLine(true, mmio.dispcnt.enable[ENABLE_OBJ] ? mmio.vcount + 1 : -1);
     }
   }
 }
@@ -208,7 +340,7 @@ void PPU::OnHblankComplete(int cycles_late) {
 void PPU::OnVblankScanlineComplete(int cycles_late) {
   auto& dispstat = mmio.dispstat;
 
-  scheduler.Add(226 - cycles_late, this, &PPU::OnVblankHblankComplete);
+  scheduler.Add(226 - cycles_late, EventClass::PPU_vblank_hblank_complete);
 
   dispstat.hblank_flag = 1;
 
@@ -237,15 +369,34 @@ void PPU::OnVblankHblankComplete(int cycles_late) {
   dispstat.hblank_flag = 0;
 
   if (vcount == 227) {
-    scheduler.Add(1006 - cycles_late, this, &PPU::OnScanlineComplete);
+    scheduler.Add(1006 - cycles_late, EventClass::PPU_scanline_complete);
     vcount = 0;
   } else {
-    scheduler.Add(1006 - cycles_late, this, &PPU::OnVblankScanlineComplete);
+    scheduler.Add(1006 - cycles_late, EventClass::PPU_vblank_scanline_complete);
     if (++vcount == 227) {
       dispstat.vblank_flag = 0;
+
+      if (frame_skip_counter < frame_skip) {
+        frame_skip_counter++;
+        render_frame = false;
+      } else {
+        frame_skip_counter = 0;
+        render_frame = true;
+      }
+
+      if (render_frame) {
+        ppu_frame = video_output_enabled ? config->video_dev->AcquirePPUFrame() : nullptr;
+        // Skipped lines keep their previous output, which only the internal buffer holds.
+        frame_buffer = (video_output_enabled && !ppu_frame && !skip_unchanged_lines) ? config->video_dev->AcquireFrame() : nullptr;
+
+        if (!ppu_frame && !frame_buffer) {
+          AllocateOutput();
+        }
+      }
+
       // Render OBJs for the next scanline
-      if (mmio.dispcnt.enable[ENABLE_OBJ]) {
-        RenderLayerOAM(mmio.dispcnt.mode >= 3, 0);
+      if (render_frame && mmio.dispcnt.enable[ENABLE_OBJ]) {
+        RenderLine(false, 0);
       }
     }
   }
@@ -258,12 +409,9 @@ void PPU::OnVblankHblankComplete(int cycles_late) {
     RenderWindow(1);
   }
 
-  if (vcount == 0) {
-    RenderScanline();
-    // Render OBJs for the next scanline
-    if (mmio.dispcnt.enable[ENABLE_OBJ]) {
-      RenderLayerOAM(mmio.dispcnt.mode >= 3, 1);
-    }
+  if (vcount == 0 && render_frame) {
+    // Render the first scanline and the OBJs for the next scanline
+    RenderLine(true, mmio.dispcnt.enable[ENABLE_OBJ] ? 1 : -1);
   }
 
   CheckVerticalCounterIRQ();
@@ -7,16 +7,27 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <condition_variable>
 #include <functional>
+#include <iterator>
+#include <mutex>
 #include <nba/common/compiler.hpp>
 #include <nba/common/punning.hpp>
 #include <nba/config.hpp>
 #include <nba/integer.hpp>
+#include <nba/save_state.hpp>
+#include <thread>
 #include <type_traits>
+#include <vector>
 
+#include "hw/ppu/blend.hpp"
 #include "hw/ppu/registers.hpp"
 #include "hw/dma/dma.hpp"
 #include "hw/irq/irq.hpp"
+#include "dirty_tracker.hpp"
 #include "scheduler.hpp"
 
 namespace nba::core {
@@ -26,11 +37,56 @@ struct PPU {
     Scheduler& scheduler,
     IRQ& irq,
     DMA& dma,
+    DirtyTracker& dirty_tracker,
     std::shared_ptr<Config> config
   );
 
+ ~PPU();
+
   void Reset();
 
+  void LoadState(SaveState const& state);
+  void CopyState(SaveState& state);
+
+  // Only copies the MMIO registers, i.e. without the memory and the line buffers.
+  void CopyIOState(SaveState& state);
+
+  void SetVideoOutputEnabled(bool enabled) {
+    video_output_enabled = enabled;
+  }
+
+  // The internal output buffer and, if rendering is threaded, the render threads and their PPUs.
+  auto GetOutputMemoryUsage() const -> size_t {
+    size_t size = output.capacity() * sizeof(u32);
+
+    if (render_thread) {
+      size += sizeof(RenderThread) + sizeof(PPU) + render_thread->ppu->output.capacity() * sizeof(u32);
+    }
+
+    if (frame_renderer) {
+      size += sizeof(FrameRenderer) + frame_renderer->workers.size() * sizeof(PPU) +
+              frame_renderer->jobs.capacity() * sizeof(RenderJob);
+    }
+    return size;
+  }
+
+  // Counts the V-blanks since the PPU was created.
+  auto GetFrameCount() const -> u64 {
+    return frame_count;
+  }
+
+  auto GetFrameSkip() const -> int {
+    return frame_skip;
+  }
+
+  auto GetPRAM() const -> u8 const* { return pram; }
+  auto GetOAM()  const -> u8 const* { return oam;  }
+  auto GetVRAM() const -> u8 const* { return vram; }
+
+  void SetFrameSkip(int frames) {
+    frame_skip = std::max(frames, 0);
+  }
+
   template<typename T>
   auto ALWAYS_INLINE ReadPRAM(u32 address) noexcept -> T {
     return read<T>(pram, address & 0x3FF);
@@ -43,6 +99,29 @@ struct PPU {
     } else {
       write<T>(pram, address & 0x3FF, value);
     }
+
+    if (dirty_tracker != nullptr) {
+      dirty_tracker->Mark(DirtyTracker::Region::PRAM, address & 0x3FF);
+    }
+
+    UpdatePaletteCache((address & 0x3FF) >> 1);
+
+    // The OBJ palette is covered by the OBJ line (see LineInputs).
+    if ((address & 0x200) == 0) {
+      pram_stamp = line_stamp;
+    }
+
+    if constexpr (std::is_same_v<T, u32>) {
+      UpdatePaletteCache(((address & 0x3FF) >> 1) + 1);
+    }
+
+    if (unlikely(write_log != nullptr)) {
+      if constexpr (std::is_same_v<T, u8>) {
+        LogMemoryWrite<u16>(MemoryWrite::PRAM, address & 0x3FE, value * 0x0101);
+      } else {
+        LogMemoryWrite<T>(MemoryWrite::PRAM, address & 0x3FF, value);
+      }
+    }
   }
 
   template<typename T>
@@ -60,13 +139,27 @@ struct PPU {
     if (address >= 0x18000) {
       address &= ~0x8000;
     }
-    if (std::is_same_v<T, u8>) {
+    if constexpr (std::is_same_v<T, u8>) {
       auto limit = mmio.dispcnt.mode >= 3 ? 0x14000 : 0x10000;
       if (address < limit) {
         write<u16>(vram, address & ~1, value * 0x0101);
+
+        if (unlikely(write_log != nullptr)) {
+          LogMemoryWrite<u16>(MemoryWrite::VRAM, address & ~1, value * 0x0101);
+        }
       }
     } else {
       write<T>(vram, address, value);
+
+      if (unlikely(write_log != nullptr)) {
+        LogMemoryWrite<T>(MemoryWrite::VRAM, address, value);
+      }
+    }
+    MarkTileDirty(address);
+    StampVRAMWrite(address);
+
+    if (dirty_tracker != nullptr) {
+      dirty_tracker->Mark(DirtyTracker::Region::VRAM, address);
     }
   }
 
@@ -79,6 +172,19 @@ struct PPU {
   void ALWAYS_INLINE WriteOAM(u32 address, T value) noexcept {
     if constexpr (!std::is_same_v<T, u8>) {
       write<T>(oam, address & 0x3FF, value);
+
+      // The affine parameters are read from OAM directly and do not invalidate the OBJ cache.
+      if (std::is_same_v<T, u32> || (address & 6) != 6) {
+        obj_cache_dirty = true;
+      }
+
+      if (dirty_tracker != nullptr) {
+        dirty_tracker->Mark(DirtyTracker::Region::OAM, address & 0x3FF);
+      }
+
+      if (unlikely(write_log != nullptr)) {
+        LogMemoryWrite<T>(MemoryWrite::OAM, address & 0x3FF, value);
+      }
     }
   }
 
@@ -116,6 +222,7 @@ struct PPU {
 
 private:
   friend struct DisplayStatus;
+  friend struct Bus;
 
   enum ObjAttribute {
     OBJ_IS_ALPHA  = 1,
@@ -150,6 +257,164 @@ private:
     ENABLE_OBJWIN = 7
   };
 
+  // One bit per pixel of a scanline: bit (x & 63) of word (x >> 6).
+  using LineMask = std::array<u64, 4>;
+
+  /* The OBJ line, with one array per field so that it can be cleared, copied and hashed a word at a time.
+   * Semi-transparent pixels and the OBJ window are stored as one bit per pixel, like the other windows,
+   * so that they can be combined a word at a time.
+   */
+  struct ObjectLine {
+    u16 color[240];
+    u8  priority[240];
+    LineMask alpha;
+    LineMask window;
+  };
+
+  /* Everything besides VRAM and the BG palette that the output of a line depends on (see skip_unchanged_lines).
+   * It is cleared before it is filled in, so that it can be compared bytewise.
+   */
+  struct LineInputs {
+    PPULine registers;
+    LineMask buffer_win[2];
+    u64 obj_hash;
+  };
+
+  /* Threaded rendering: the emulated PPU only does timing, IRQs, DMA requests and windows.
+   * Each line that is due for rendering is queued to a render thread,
+   * together with the registers it reads and a log of all writes to PRAM, VRAM and OAM
+   * since the previous line. The render thread replays the log onto its own PPU instance
+   * and renders the line there, so the output is identical to direct rendering.
+   */
+  struct MemoryWrite {
+    enum Region : u8 {
+      PRAM,
+      VRAM,
+      OAM
+    } region;
+
+    u8 size;
+    u32 address;
+    u32 value;
+  };
+
+  struct RenderJob {
+    bool render_scanline;
+    int obj_line;
+    MMIO mmio;
+    void* frame_buffer;
+    bool enable_bg[2][4];
+    LineMask buffer_win[2];
+    bool window_scanline_enable[2];
+    std::vector<MemoryWrite> writes;
+  };
+
+  struct RenderThread {
+    static constexpr int kQueueSize = 64;
+    static constexpr size_t kMaxLogSize = 16384;
+
+    std::unique_ptr<PPU> ppu;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv_submit;
+    std::condition_variable cv_done;
+    bool quit = false;
+
+    // Jobs [tail, head) are queued. The job at head is being recorded by the emulation thread.
+    RenderJob jobs[kQueueSize];
+    int head = 0;
+    int tail = 0;
+  };
+
+  struct RenderThreadTag {};
+
+  // Creates the PPU that renders on behalf of the given PPU.
+  PPU(RenderThreadTag, PPU& emulated_ppu);
+
+  void StartRenderThread();
+  void StopRenderThread();
+  void SyncRenderThread();
+  void WaitForRenderThread();
+  void SubmitRenderJob(bool render_scanline, int obj_line);
+  void RenderThreadLoop();
+  void LoadRenderJob(RenderJob const& job);
+  void ReplayMemoryWrite(MemoryWrite const& write);
+
+  /* Parallel rendering: lines are recorded as render jobs like above, but they are only rendered at V-blank.
+   * The memory is copied when the first job of a frame is recorded, and the jobs are then split into
+   * one band of consecutive lines per worker. Each worker copies the memory, replays the writes of all
+   * jobs before its band and renders the OBJs of the line before, so that all bands render at the same time.
+   * Lines are not recorded outside of rendered frames, so no writes need to be logged there.
+   */
+  struct FrameRenderer {
+    struct Worker {
+      std::unique_ptr<PPU> ppu;
+      std::thread thread;
+    };
+
+    // The first worker renders on the emulation thread.
+    std::vector<Worker> workers;
+    std::mutex mutex;
+    std::condition_variable cv_start;
+    std::condition_variable cv_done;
+    u64 generation = 0;
+    int band_count = 0;
+    int pending = 0;
+    bool quit = false;
+
+    // The memory and OBJ line at the start of the recorded jobs.
+    u8 pram[0x00400];
+    u8 oam[0x00400];
+    u8 vram[0x18000];
+    ObjectLine buffer_obj;
+    bool line_contains_alpha_obj;
+
+    // Jobs [0, job_count) are recorded. The job at job_count collects the writes for the next job.
+    std::vector<RenderJob> jobs;
+    int job_count = 0;
+    bool recording = false;
+  };
+
+  void StartFrameRenderer();
+  void StopFrameRenderer();
+  void SyncFrameRenderer();
+  void SubmitFrameJob(bool render_scanline, int obj_line);
+  void RenderFrameJobs();
+  void FrameWorkerLoop(int id);
+  void RenderFrameBand(int id);
+
+  template<typename T>
+  void ALWAYS_INLINE LogMemoryWrite(MemoryWrite::Region region, u32 address, T value) {
+    write_log->push_back({region, u8(sizeof(T)), address, u32(value)});
+
+    // Keep the log bounded while no lines are rendered (i.e. during frame skip).
+    if (unlikely(write_log->size() >= RenderThread::kMaxLogSize) && render_thread) {
+      SubmitRenderJob(false, -1);
+    }
+  }
+
+  auto GetOutput() -> void* {
+    if (frame_buffer) {
+      return frame_buffer;
+    }
+    return render_thread ? render_thread->ppu->output.data() : output.data();
+  }
+
+  // Returns the lines that changed since the last frame was handed to the video device.
+  auto GetDirtyLines() -> std::bitset<160>& {
+    return render_thread ? render_thread->ppu->dirty_lines : dirty_lines;
+  }
+
+  // Renders the current scanline and/or the OBJs of obj_line (if not -1), possibly on the render thread.
+  void RenderLine(bool render_scanline, int obj_line);
+
+  // Does the actual rendering for RenderLine(), either on the emulation or on the render thread.
+  void DrawLine(bool render_scanline, int obj_line);
+
+  // Records the state for RenderLine() into the PPUFrame, for devices that render frames themselves.
+  void CaptureLine(bool render_scanline, int obj_line);
+  void CaptureRegisters(PPULine& line);
+
   void LatchEnabledBGs();
   void CheckVerticalCounterIRQ();
   void OnScanlineComplete(int cycles_late);
@@ -158,20 +423,72 @@ private:
   void OnVblankHblankComplete(int cycles_late);
 
   void RenderScanline();
+  void AllocateOutput();
+  void InvalidateLines();
+  void GetLineInputs(LineInputs& inputs);
+  auto GetLineInputStamp() -> u64;
+  bool LineChanged();
+  void OutputLine(u16 const* colors);
+
+  // The line that is composed into, which is a scratch buffer if the frame is scaled up (see frame_scale).
+  template<typename T>
+  auto ALWAYS_INLINE GetOutputLine() -> T* {
+    if (frame_scale != 1) {
+      return (T*)scaled_line;
+    }
+    return (T*)(frame_buffer ? frame_buffer : output.data()) + mmio.vcount * 240;
+  }
+
+  // Returns the given row of the current line in the scaled up frame.
+  template<typename T>
+  auto ALWAYS_INLINE GetScaledOutputLine(int row) -> T* {
+    int width = 240 * frame_scale;
+
+    return (T*)(frame_buffer ? frame_buffer : output.data()) + (mmio.vcount * frame_scale + row) * width;
+  }
+
+  void ScaleLine();
+  void ScatterLine();
+  template<typename T>
+  void ScaleLineTmpl();
+  template<typename T>
+  void ScatterLineTmpl();
+  bool HasScaledBGs();
+  void RenderScaledBGs();
+
+
+  void FillLine(u16 color);
   void RenderLayerText(int id);
+  template<bool full_palette>
+  void RenderLayerTextTmpl(int id);
   void RenderLayerAffine(int id);
   void RenderLayerBitmap1();
   void RenderLayerBitmap2();
   void RenderLayerBitmap3();
+  bool RenderBitmapLineDirect();
   void RenderLayerOAM(bool bitmap_mode, int line);
+  bool RenderObjects(bool bitmap_mode, int line);
+  void RebuildObjectCache();
   void RenderWindow(int id);
 
   static auto ConvertColor(u16 color) -> u32;
 
+  auto ALWAYS_INLINE MapColor(u16 color) -> u32 {
+    if (color_lut) {
+      return (*color_lut)[color & 0x7FFF];
+    }
+    return ConvertColor(color);
+  }
+
+  void ALWAYS_INLINE UpdatePaletteCache(int index) {
+    palette_argb[index] = MapColor(read<u16>(pram, index << 1));
+  }
+
+  void RebuildPaletteCache();
+
   template<bool window, bool blending>
   void ComposeScanlineTmpl(int bg_min, int bg_max);
   void ComposeScanline(int bg_min, int bg_max);
-  void Blend(u16& target1, u16 target2, BlendControl::Effect sfx);
 
   #include "helper.inl"
 
@@ -179,6 +496,46 @@ private:
   u8 oam [0x00400];
   u8 vram[0x18000];
 
+  /* Palette indices of every 4BPP tile in VRAM, one byte per pixel.
+   * A set bit in tile_dirty marks a tile that was written since it was last decoded.
+   */
+  u8  tile_cache[0x18000 * 2];
+  u64 tile_dirty[0x18000 / 32 / 64];
+
+  /* Decoded attributes of every OBJ and, for every line, the OBJs that intersect it in OAM order.
+   * The cache is rebuilt before the next OBJ line is rendered after OBJ attributes were written.
+   */
+  static constexpr int kObjLineCount = 256;
+
+  struct ObjectEntry {
+    s32 x;
+    s32 y;
+    int width;
+    int height;
+    int half_width;
+    int half_height;
+    int matrix;
+    u8 mode;
+    u8 prio;
+    u8 palette;
+    u16 number;
+    bool affine;
+    bool mosaic;
+    bool flip_h;
+    bool flip_v;
+    bool is_256;
+  } obj_entries[128];
+
+  u8 obj_line_list[kObjLineCount][128];
+  u8 obj_line_count[kObjLineCount];
+  bool obj_cache_dirty = true;
+
+  LineBlender::Factors blend_factors;
+
+  // Output color of every palette entry, kept in sync with PRAM.
+  u32 palette_argb[0x200];
+  ColorLUT const* color_lut = nullptr;
+
   Scheduler& scheduler;
   IRQ& irq;
   DMA& dma;
@@ -188,17 +545,74 @@ private:
 
   bool line_contains_alpha_obj;
 
-  struct ObjectPixel {
-    u16 color;
-    u8  priority;
-    unsigned alpha  : 1;
-    unsigned window : 1;
-  } buffer_obj[240];
+  ObjectLine buffer_obj;
+
+  // The OBJs of a line at every sub-pixel position, if the line contains affine OBJs and frames are scaled up.
+  ObjectLine buffer_obj_scaled[VideoDevice::kMaxFrameScale * VideoDevice::kMaxFrameScale];
 
-  bool buffer_win[2][240];
+  bool obj_line_scaled = false;
+  LineMask buffer_win[2];
   bool window_scanline_enable[2];
 
-  u32 output[240*160];
+  /* Frames are rendered into a buffer that is owned by the video device, if it provides one,
+   * and into the internal output buffer otherwise (see AllocateOutput()).
+   * The internal buffer is large enough for any format.
+   */
+  PixelFormat output_format;
+  void* frame_buffer = nullptr;
+  std::vector<u32> output;
+
+  /* Frames are frame_scale times the native resolution. Each line is composed once for every
+   * sub-pixel position (subpixel_x, subpixel_y) with the affine layers rendered at that position,
+   * and every result is scattered into its pixels of the scaled up line. This way, the cost grows
+   * linearly with the number of output pixels. Lines without affine layers are composed once and repeated.
+   */
+  int frame_scale = 1;
+  int subpixel_x = 0;
+  int subpixel_y = 0;
+  u32 scaled_line[240];
+
+  /* Skipping unchanged lines: writes to VRAM and to the BG palette are stamped with line_stamp,
+   * which counts the lines that were rendered (or skipped). A line is skipped if its LineInputs
+   * match those it was last rendered with, and if nothing that it reads was written after that.
+   * VRAM is tracked per tile for text BGs and per 1 KiB page for all other layers.
+   */
+  struct LineState {
+    LineInputs inputs;
+    u64 stamp;
+    bool valid;
+  } line_state[160];
+
+  bool skip_unchanged_lines = false;
+  u64 line_stamp;
+  u64 pram_stamp;
+  u64 vram_tile_stamp[0x18000 / 32];
+  u64 vram_page_stamp[0x18000 / 1024];
+
+  // The lines that were rendered since the last frame was handed to the video device.
+  std::bitset<160> dirty_lines;
+
+  // The frame that lines are captured into instead of being rendered, if the video device provides one.
+  PPUFrame* ppu_frame = nullptr;
+  bool video_output_enabled = true;
+
+  std::unique_ptr<RenderThread> render_thread;
+  std::unique_ptr<FrameRenderer> frame_renderer;
+
+  // The log that writes to PRAM, VRAM and OAM are recorded into for rendering on another thread, if any.
+  std::vector<MemoryWrite>* write_log = nullptr;
+
+  // Null for the PPUs that render on behalf of the emulated PPU, their writes are only replays.
+  DirtyTracker* dirty_tracker = nullptr;
+
+  /* Rendering only feeds the output buffer and has no effect on the emulated state,
+   * with the exception of windows, which are always evaluated.
+   * Whether a frame is rendered is decided right before its first line.
+   */
+  int frame_skip;
+  int frame_skip_counter;
+  bool render_frame;
+  u64 frame_count = 0;
 
   static constexpr u16 s_color_transparent = 0x8000;
   static const int s_obj_size[4][4][2];
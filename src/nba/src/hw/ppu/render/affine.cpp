@@ -5,10 +5,217 @@
  * Refer to the included LICENSE file.
  */
 
+#include <nba/common/cpu_dispatch.hpp>
+
 #include "hw/ppu/ppu.hpp"
 
+#if defined(__x86_64__) || defined(_M_X64)
+  #if defined(__GNUC__) || defined(__clang__)
+    #define NBA_AFFINE_AVX2
+    #include <immintrin.h>
+  #endif
+#elif defined(__ARM_NEON)
+  #define NBA_AFFINE_NEON
+  #include <arm_neon.h>
+#endif
+
 namespace nba::core {
 
+namespace {
+
+// Everything needed to render one line of a (non-mosaic) affine background.
+struct AffineLine {
+  u8 const* vram;
+  u8 const* pram;
+  u16* buffer;
+  s32 ref_x;
+  s32 ref_y;
+  s32 pa;
+  s32 pc;
+  int size;
+  int block_width;
+  u32 map_base;
+  u32 tile_base;
+  bool wraparound;
+};
+
+constexpr u16 kColorTransparent = 0x8000;
+
+/* Both paths compute the texture coordinates of eight pixels at once with integer adds
+ * and resolve wraparound and clipping with masks. The wraparound matches AffineRenderLoop exactly,
+ * which maps negative multiples of the size to the size itself rather than to zero.
+ */
+#if defined(NBA_AFFINE_AVX2)
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 auto ALWAYS_INLINE WrapAVX2(__m256i v, __m256i size_mask, __m256i size) -> __m256i {
+  auto wrapped = _mm256_and_si256(v, size_mask);
+  auto negative = _mm256_cmpgt_epi32(_mm256_setzero_si256(), v);
+  auto zero = _mm256_cmpeq_epi32(wrapped, _mm256_setzero_si256());
+
+  return _mm256_add_epi32(wrapped, _mm256_and_si256(_mm256_and_si256(negative, zero), size));
+}
+
+AVX2 void RenderAffineLineAVX2(AffineLine const& line) {
+  auto const lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  auto const size = _mm256_set1_epi32(line.size);
+  auto const size_mask = _mm256_set1_epi32(line.size - 1);
+  auto const block_width = _mm256_set1_epi32(line.block_width);
+  auto const map_base = _mm256_set1_epi32(line.map_base);
+  auto const tile_base = _mm256_set1_epi32(line.tile_base);
+  auto const mask_7 = _mm256_set1_epi32(7);
+  auto const mask_ff = _mm256_set1_epi32(0xFF);
+  auto const transparent = _mm256_set1_epi32(kColorTransparent);
+
+  auto ref_x = _mm256_add_epi32(_mm256_set1_epi32(line.ref_x), _mm256_mullo_epi32(lane, _mm256_set1_epi32(line.pa)));
+  auto ref_y = _mm256_add_epi32(_mm256_set1_epi32(line.ref_y), _mm256_mullo_epi32(lane, _mm256_set1_epi32(line.pc)));
+  auto step_x = _mm256_set1_epi32(line.pa * 8);
+  auto step_y = _mm256_set1_epi32(line.pc * 8);
+
+  auto vram = (int const*)line.vram;
+  auto pram = (int const*)line.pram;
+
+  for (int x = 0; x < 240; x += 8) {
+    auto tex_x = _mm256_srai_epi32(ref_x, 8);
+    auto tex_y = _mm256_srai_epi32(ref_y, 8);
+    auto visible = _mm256_set1_epi32(-1);
+
+    if (line.wraparound) {
+      tex_x = WrapAVX2(tex_x, size_mask, size);
+      tex_y = WrapAVX2(tex_y, size_mask, size);
+    } else {
+      // The size is a power of two, so any bit above the mask means that the coordinate is outside.
+      visible = _mm256_and_si256(
+        _mm256_cmpeq_epi32(_mm256_andnot_si256(size_mask, tex_x), _mm256_setzero_si256()),
+        _mm256_cmpeq_epi32(_mm256_andnot_si256(size_mask, tex_y), _mm256_setzero_si256())
+      );
+
+      // Keep the memory accesses of clipped pixels in bounds.
+      tex_x = _mm256_and_si256(tex_x, visible);
+      tex_y = _mm256_and_si256(tex_y, visible);
+    }
+
+    auto map_address = _mm256_add_epi32(
+      _mm256_add_epi32(map_base, _mm256_mullo_epi32(_mm256_srli_epi32(tex_y, 3), block_width)),
+      _mm256_srli_epi32(tex_x, 3)
+    );
+    auto tile_number = _mm256_and_si256(_mm256_i32gather_epi32(vram, map_address, 1), mask_ff);
+
+    auto tile_address = _mm256_add_epi32(
+      _mm256_add_epi32(tile_base, _mm256_slli_epi32(tile_number, 6)),
+      _mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(tex_y, mask_7), 3), _mm256_and_si256(tex_x, mask_7))
+    );
+    auto index = _mm256_and_si256(_mm256_i32gather_epi32(vram, tile_address, 1), mask_ff);
+
+    auto color = _mm256_and_si256(_mm256_i32gather_epi32(pram, _mm256_slli_epi32(index, 1), 1), _mm256_set1_epi32(0x7FFF));
+    auto opaque = _mm256_andnot_si256(_mm256_cmpeq_epi32(index, _mm256_setzero_si256()), visible);
+
+    color = _mm256_or_si256(_mm256_and_si256(opaque, color), _mm256_andnot_si256(opaque, transparent));
+
+    // Narrow to 16-bit, packus operates on each 128-bit half, so restore the order afterwards.
+    auto packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(color, color), 0b1000);
+    _mm_storeu_si128((__m128i*)&line.buffer[x], _mm256_castsi256_si128(packed));
+
+    ref_x = _mm256_add_epi32(ref_x, step_x);
+    ref_y = _mm256_add_epi32(ref_y, step_y);
+  }
+}
+
+#undef AVX2
+
+#elif defined(NBA_AFFINE_NEON)
+
+auto ALWAYS_INLINE WrapNEON(int32x4_t v, int32x4_t size_mask, int32x4_t size) -> int32x4_t {
+  auto const zero = vdupq_n_s32(0);
+  auto wrapped = vandq_s32(v, size_mask);
+  auto fix = vandq_u32(vcltq_s32(v, zero), vceqq_s32(wrapped, zero));
+
+  return vaddq_s32(wrapped, vandq_s32(vreinterpretq_s32_u32(fix), size));
+}
+
+void RenderAffineLineNEON(AffineLine const& line) {
+  s32 const lane_init[4] = { 0, 1, 2, 3 };
+
+  auto const lane = vld1q_s32(lane_init);
+  auto const size = vdupq_n_s32(line.size);
+  auto const size_mask = vdupq_n_s32(line.size - 1);
+  auto const outside_mask = vdupq_n_s32(~(line.size - 1));
+  auto const zero = vdupq_n_s32(0);
+
+  int32x4_t ref_x[2];
+  int32x4_t ref_y[2];
+
+  for (int i = 0; i < 2; i++) {
+    ref_x[i] = vaddq_s32(vdupq_n_s32(line.ref_x + line.pa * 4 * i), vmulq_n_s32(lane, line.pa));
+    ref_y[i] = vaddq_s32(vdupq_n_s32(line.ref_y + line.pc * 4 * i), vmulq_n_s32(lane, line.pc));
+  }
+
+  auto step_x = vdupq_n_s32(line.pa * 8);
+  auto step_y = vdupq_n_s32(line.pc * 8);
+
+  for (int x = 0; x < 240; x += 8) {
+    s32 tex_x[8];
+    s32 tex_y[8];
+    u32 visible[8];
+
+    for (int i = 0; i < 2; i++) {
+      auto vx = vshrq_n_s32(ref_x[i], 8);
+      auto vy = vshrq_n_s32(ref_y[i], 8);
+      auto mask = vdupq_n_u32(~0U);
+
+      if (line.wraparound) {
+        vx = WrapNEON(vx, size_mask, size);
+        vy = WrapNEON(vy, size_mask, size);
+      } else {
+        mask = vandq_u32(vceqq_s32(vandq_s32(vx, outside_mask), zero), vceqq_s32(vandq_s32(vy, outside_mask), zero));
+      }
+
+      vst1q_s32(&tex_x[i * 4], vx);
+      vst1q_s32(&tex_y[i * 4], vy);
+      vst1q_u32(&visible[i * 4], mask);
+
+      ref_x[i] = vaddq_s32(ref_x[i], step_x);
+      ref_y[i] = vaddq_s32(ref_y[i], step_y);
+    }
+
+    // NEON has no gather, so the memory lookups are done per pixel.
+    for (int i = 0; i < 8; i++) {
+      if (!visible[i]) {
+        line.buffer[x + i] = kColorTransparent;
+        continue;
+      }
+
+      int tile_number = line.vram[line.map_base + (tex_y[i] >> 3) * line.block_width + (tex_x[i] >> 3)];
+      int index = line.vram[line.tile_base + tile_number * 64 + (tex_y[i] & 7) * 8 + (tex_x[i] & 7)];
+
+      if (index == 0) {
+        line.buffer[x + i] = kColorTransparent;
+      } else {
+        line.buffer[x + i] = ((line.pram[index * 2 + 1] << 8) | line.pram[index * 2]) & 0x7FFF;
+      }
+    }
+  }
+}
+
+#endif
+
+// The scalar path is AffineRenderLoop, which also handles mosaic.
+auto SelectAffineLineRenderer() -> void (*)(AffineLine const&) {
+  return SelectKernel<void (*)(AffineLine const&)>("PPU affine background", {
+#if defined(NBA_AFFINE_AVX2)
+    { SIMDLevel::AVX2, RenderAffineLineAVX2 },
+#elif defined(NBA_AFFINE_NEON)
+    { SIMDLevel::NEON, RenderAffineLineNEON },
+#endif
+    { SIMDLevel::Scalar, nullptr }
+  });
+}
+
+auto const g_render_affine_line = SelectAffineLineRenderer();
+
+} // namespace
+
 void PPU::RenderLayerAffine(int id) {
   auto const& bg = mmio.bgcnt[2 + id];
   
@@ -25,6 +232,24 @@ void PPU::RenderLayerAffine(int id) {
     case 2: size = 512;  block_width = 64;  break;
     case 3: size = 1024; block_width = 128; break;
   }
+
+  if (g_render_affine_line != nullptr && !bg.mosaic_enable) {
+    g_render_affine_line({
+      vram,
+      pram,
+      buffer,
+      mmio.bgx[id]._current + GetAffineSubpixelOffset(mmio.bgpa[id], mmio.bgpb[id]),
+      mmio.bgy[id]._current + GetAffineSubpixelOffset(mmio.bgpc[id], mmio.bgpd[id]),
+      mmio.bgpa[id],
+      mmio.bgpc[id],
+      size,
+      block_width,
+      map_base,
+      tile_base,
+      (bool)bg.wraparound
+    });
+    return;
+  }
   
   AffineRenderLoop(id, size, size, [&](int line_x, int x, int y) {
     auto tile_number = vram[map_base + (y / 8) * block_width + (x / 8)];
@@ -41,4 +41,84 @@ void PPU::RenderLayerBitmap3() {
   });
 }
 
+/* Lines that show nothing but an untransformed bitmap BG are read from VRAM straight into the output line,
+ * which skips the BG buffer and the compositor. Returns false if the line must be rendered as usual.
+ */
+bool PPU::RenderBitmapLineDirect() {
+  auto const& dispcnt = mmio.dispcnt;
+  auto const& bg = mmio.bgcnt[2];
+
+  if (frame_scale != 1 ||
+      !enable_bg[0][2] || !dispcnt.enable[ENABLE_BG2] ||
+      dispcnt.enable[ENABLE_OBJ] ||
+      dispcnt.enable[ENABLE_WIN0] || dispcnt.enable[ENABLE_WIN1] || dispcnt.enable[ENABLE_OBJWIN] ||
+      mmio.bldcnt.sfx != BlendControl::Effect::SFX_NONE ||
+      bg.mosaic_enable || mmio.bgpa[0] != 0x100 || mmio.bgpc[0] != 0) {
+    return false;
+  }
+
+  // With a step of one pixel along X and none along Y, the line is a row of the bitmap.
+  int height = dispcnt.mode == 5 ? 128 : 160;
+  s32 start_x = mmio.bgx[0]._current >> 8;
+  s32 y = mmio.bgy[0]._current >> 8;
+
+  if (start_x != 0 || y < 0 || y >= height) {
+    return false;
+  }
+
+  auto frame = dispcnt.frame * 0xA000;
+  u16 backdrop = ReadPalette(0, 0);
+  u16 colors[240];
+
+  switch (dispcnt.mode) {
+    case 3: {
+      for (int x = 0; x < 240; x++) {
+        u16 color = read<u16>(vram, y * 480 + x * 2);
+
+        colors[x] = color == s_color_transparent ? backdrop : color;
+      }
+      break;
+    }
+    case 4: {
+      auto row = &vram[frame + y * 240];
+
+      if (output_format == PixelFormat::ARGB8888) {
+        auto line = GetOutputLine<u32>();
+
+        for (int x = 0; x < 240; x++) {
+          line[x] = palette_argb[row[x]];
+        }
+        return true;
+      }
+
+      // Index zero is transparent and shows the backdrop, which is palette entry zero.
+      for (int x = 0; x < 240; x++) {
+        colors[x] = ReadPalette(0, row[x]);
+      }
+      break;
+    }
+    case 5: {
+      for (int x = 0; x < 240; x++) {
+        int u = x;
+
+        if (u >= 160) {
+          if (!bg.wraparound) {
+            colors[x] = backdrop;
+            continue;
+          }
+          u -= 160;
+        }
+
+        u16 color = read<u16>(vram, frame + y * 320 + u * 2);
+
+        colors[x] = color == s_color_transparent ? backdrop : color;
+      }
+      break;
+    }
+  }
+
+  OutputLine(colors);
+  return true;
+}
+
 } // namespace nba::core
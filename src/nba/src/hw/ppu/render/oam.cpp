@@ -5,10 +5,200 @@
  * Refer to the included LICENSE file.
  */
 
+#include <nba/common/cpu_dispatch.hpp>
+
 #include "hw/ppu/ppu.hpp"
 
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+  #define NBA_AFFINE_OBJ_AVX2
+  #include <immintrin.h>
+#endif
+
 namespace nba::core {
 
+namespace {
+
+// Everything needed to render the visible pixels of an affine (non-mosaic) OBJ on one line.
+struct AffineObjectLine {
+  u8 const* vram;
+  u8 const* pram;
+  u16* color;
+  u8* priority;
+  u64* alpha;
+  u64* window;
+  int x_min; // the visible pixels, at least eight
+  int x_max;
+  s32 ref_x; // the texture coordinates of x_min in 1/256 pixels, relative to the center of the OBJ
+  s32 ref_y;
+  s32 pa;
+  s32 pc;
+  int width;
+  int height;
+  int number;      // the tile of the top left corner
+  int tile_stride; // tiles from one row of tiles to the next
+  int tile_step;   // tiles from one tile to the next, two in 256 color mode
+  int palette;     // offset of the palette in PRAM
+  int prio;
+  bool is_256;
+  bool bitmap_mode;
+  bool semi;
+  bool window_mode;
+};
+
+// Sets or clears the bits of eight pixels starting at x in a LineMask, which may straddle two words.
+void ALWAYS_INLINE SetLineMaskBits(u64* mask, int x, u64 bits, bool set) {
+  int word = x >> 6;
+  int shift = x & 63;
+
+  if (set) {
+    mask[word] |= bits << shift;
+  } else {
+    mask[word] &= ~(bits << shift);
+  }
+
+  if (shift > 56) {
+    if (set) {
+      mask[word + 1] |= bits >> (64 - shift);
+    } else {
+      mask[word + 1] &= ~(bits >> (64 - shift));
+    }
+  }
+}
+
+/* Computes the texture coordinates of eight pixels at once and does the bounds, transparency and priority tests
+ * as lane masks, which are applied to the OBJ line with blends. The last step is moved back to end at x_max,
+ * which is fine because drawing a pixel of the same OBJ twice leaves the line as it was after the first time.
+ */
+#if defined(NBA_AFFINE_OBJ_AVX2)
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 auto ALWAYS_INLINE Narrow16AVX2(__m256i v) -> __m128i {
+  return _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+
+AVX2 auto ALWAYS_INLINE GetByteMaskAVX2(__m128i mask16) -> u64 {
+  return u64(_mm_movemask_epi8(_mm_packs_epi16(mask16, _mm_setzero_si128())) & 0xFF);
+}
+
+AVX2 bool RenderAffineObjectAVX2(AffineObjectLine const& line) {
+  auto const lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  auto const lane_x = _mm256_mullo_epi32(lane, _mm256_set1_epi32(line.pa));
+  auto const lane_y = _mm256_mullo_epi32(lane, _mm256_set1_epi32(line.pc));
+  auto const outside_x = _mm256_set1_epi32(~(line.width - 1));
+  auto const outside_y = _mm256_set1_epi32(~(line.height - 1));
+  auto const half_width = _mm256_set1_epi32(line.width / 2);
+  auto const half_height = _mm256_set1_epi32(line.height / 2);
+  auto const number = _mm256_set1_epi32(line.number);
+  auto const tile_stride = _mm256_set1_epi32(line.tile_stride);
+  auto const tile_step = _mm256_set1_epi32(line.tile_step);
+  auto const tile_mask = _mm256_set1_epi32(0x3FF);
+  auto const min_tile = _mm256_set1_epi32(line.bitmap_mode ? 512 : 0);
+  auto const mask_7 = _mm256_set1_epi32(7);
+  auto const zero = _mm256_setzero_si256();
+  auto const transparent = _mm_set1_epi16(s16(0x8000));
+  auto const prio = _mm_set1_epi16(s16(line.prio));
+
+  // The gathers load the word that ends with the wanted byte (or halfword), so that they stay inside VRAM and PRAM.
+  auto const vram_base = _mm256_set1_epi32(0x10000 - 3);
+  auto const pram_base = _mm256_set1_epi32(line.palette - 2);
+
+  auto vram = (int const*)line.vram;
+  auto pram = (int const*)line.pram;
+  bool wrote_semi = false;
+
+  for (int x = line.x_min;; x += 8) {
+    x = std::min(x, line.x_max - 8);
+
+    int offset = x - line.x_min;
+
+    auto tex_x = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(_mm256_set1_epi32(line.ref_x + line.pa * offset), lane_x), 8), half_width);
+    auto tex_y = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(_mm256_set1_epi32(line.ref_y + line.pc * offset), lane_y), 8), half_height);
+
+    // The size is a power of two, so any bit above the mask means that the coordinate is outside.
+    auto visible = _mm256_and_si256(
+      _mm256_cmpeq_epi32(_mm256_and_si256(tex_x, outside_x), zero),
+      _mm256_cmpeq_epi32(_mm256_and_si256(tex_y, outside_y), zero)
+    );
+
+    // Tile numbers are masked to 10 bits, so clipped pixels stay in bounds without masking their coordinates.
+    auto tile = _mm256_and_si256(_mm256_add_epi32(
+      _mm256_add_epi32(number, _mm256_mullo_epi32(_mm256_srai_epi32(tex_y, 3), tile_stride)),
+      _mm256_mullo_epi32(_mm256_srai_epi32(tex_x, 3), tile_step)
+    ), tile_mask);
+
+    visible = _mm256_andnot_si256(_mm256_cmpgt_epi32(min_tile, tile), visible);
+
+    auto tile_x = _mm256_and_si256(tex_x, mask_7);
+    auto tile_y = _mm256_and_si256(tex_y, mask_7);
+    auto address = _mm256_add_epi32(vram_base, _mm256_slli_epi32(tile, 5));
+
+    if (line.is_256) {
+      address = _mm256_add_epi32(address, _mm256_add_epi32(_mm256_slli_epi32(tile_y, 3), tile_x));
+    } else {
+      address = _mm256_add_epi32(address, _mm256_add_epi32(_mm256_slli_epi32(tile_y, 2), _mm256_srli_epi32(tile_x, 1)));
+    }
+
+    auto index = _mm256_srli_epi32(_mm256_i32gather_epi32(vram, address, 1), 24);
+
+    if (!line.is_256) {
+      // Odd pixels are in the upper nibble.
+      index = _mm256_and_si256(_mm256_srlv_epi32(index, _mm256_slli_epi32(_mm256_and_si256(tile_x, _mm256_set1_epi32(1)), 2)), _mm256_set1_epi32(15));
+    }
+
+    auto color = _mm256_srli_epi32(_mm256_i32gather_epi32(pram, _mm256_add_epi32(pram_base, _mm256_slli_epi32(index, 1)), 1), 16);
+    auto opaque = _mm256_andnot_si256(_mm256_cmpeq_epi32(index, zero), visible);
+
+    color = _mm256_and_si256(color, _mm256_set1_epi32(0x7FFF));
+
+    auto opaque16 = Narrow16AVX2(opaque);
+
+    if (line.window_mode) {
+      SetLineMaskBits(line.window, x, GetByteMaskAVX2(opaque16), true);
+    } else {
+      auto old_color = _mm_loadu_si128((__m128i const*)&line.color[x]);
+      auto old_prio = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i const*)&line.priority[x]));
+
+      // Every visible pixel takes the priority if it wins, also a transparent one. Only opaque ones take the color.
+      auto wins = _mm_and_si128(Narrow16AVX2(visible), _mm_or_si128(_mm_cmpgt_epi16(old_prio, prio), _mm_cmpeq_epi16(old_color, transparent)));
+      auto drawn = _mm_and_si128(wins, opaque16);
+      auto new_prio = _mm_blendv_epi8(old_prio, prio, wins);
+
+      _mm_storeu_si128((__m128i*)&line.color[x], _mm_blendv_epi8(old_color, Narrow16AVX2(color), drawn));
+      _mm_storel_epi64((__m128i*)&line.priority[x], _mm_packus_epi16(new_prio, new_prio));
+
+      auto bits = GetByteMaskAVX2(drawn);
+
+      SetLineMaskBits(line.alpha, x, bits, line.semi);
+      wrote_semi |= line.semi && bits != 0;
+    }
+
+    if (x + 8 == line.x_max) {
+      break;
+    }
+  }
+
+  return wrote_semi;
+}
+
+#undef AVX2
+
+#endif
+
+// Returns whether a semi-transparent pixel was drawn. The scalar path is the loop in PPU::RenderObjects(), which also handles mosaic.
+auto SelectAffineObjectRenderer() -> bool (*)(AffineObjectLine const&) {
+  return SelectKernel<bool (*)(AffineObjectLine const&)>("PPU affine OBJ", {
+#if defined(NBA_AFFINE_OBJ_AVX2)
+    { SIMDLevel::AVX2, RenderAffineObjectAVX2 },
+#endif
+    { SIMDLevel::Scalar, nullptr }
+  });
+}
+
+auto const g_render_affine_object = SelectAffineObjectRenderer();
+
+} // namespace
+
 const int PPU::s_obj_size[4][4][2] = {
   /* SQUARE */
   {
@@ -40,22 +230,12 @@ const int PPU::s_obj_size[4][4][2] = {
   }
 };
 
-void PPU::RenderLayerOAM(bool bitmap_mode, int line) {
-  int tile_num;
-  u16 pixel;
-  s16 transform[4];
-  int cycles = mmio.dispcnt.hblank_oam_access ? 954 : 1210;
-
-  line_contains_alpha_obj = false;
+void PPU::RebuildObjectCache() {
+  std::fill(std::begin(obj_line_count), std::end(obj_line_count), 0);
 
-  for (int x = 0; x < 240; x++) {
-    buffer_obj[x].priority = 4;
-    buffer_obj[x].color = s_color_transparent;
-    buffer_obj[x].alpha = 0;
-    buffer_obj[x].window = 0;
-  }
+  for (int index = 0; index < 128; index++) {
+    int offset = index * 8;
 
-  for (s32 offset = 0; offset <= 127 * 8; offset += 8) {
     if ((oam[offset + 1] & 3) == 2) {
       continue;
     }
@@ -64,45 +244,126 @@ void PPU::RenderLayerOAM(bool bitmap_mode, int line) {
     u16 attr1 = (oam[offset + 3] << 8) | oam[offset + 2];
     u16 attr2 = (oam[offset + 5] << 8) | oam[offset + 4];
 
-    int width;
-    int height;
+    auto& object = obj_entries[index];
 
     s32 x = attr1 & 0x1FF;
     s32 y = attr0 & 0x0FF;
-    int shape  =  attr0 >> 14;
-    int size   =  attr1 >> 14;
-    int prio   = (attr2 >> 10) & 3;
-    int mode   = (attr0 >> 10) & 3;
-    int mosaic = (attr0 >> 12) & 1;
+    int shape = attr0 >> 14;
+    int size  = attr1 >> 14;
+
+    object.mode = (attr0 >> 10) & 3;
 
-    if (mode == OBJ_PROHIBITED) {
+    if (object.mode == OBJ_PROHIBITED) {
       continue;
     }
 
     if (x >= 240) x -= 512;
     if (y >= 160) y -= 256;
 
-    int affine  = (attr0 >> 8) & 1;
-    int attr0b9 = (attr0 >> 9) & 1;
+    object.affine = (attr0 >> 8) & 1;
+    object.width  = s_obj_size[shape][size][0];
+    object.height = s_obj_size[shape][size][1];
+    object.half_width  = object.width / 2;
+    object.half_height = object.height / 2;
 
-    width  = s_obj_size[shape][size][0];
-    height = s_obj_size[shape][size][1];
+    if (object.affine) {
+      object.matrix = ((attr1 >> 9) & 0x1F) << 5;
 
-    int half_width  = width / 2;
-    int half_height = height / 2;
+      if ((attr0 >> 9) & 1) {
+        object.half_width  *= 2;
+        object.half_height *= 2;
+      }
+    }
 
-    if (affine) {
-      int group = ((attr1 >> 9) & 0x1F) << 5;
+    object.x = x + object.half_width;
+    object.y = y + object.half_height;
+    object.prio    = (attr2 >> 10) & 3;
+    object.mosaic  = (attr0 >> 12) & 1;
+    object.number  =  attr2 & 0x3FF;
+    object.palette = (attr2 >> 12) + 16;
+    object.flip_h  = !object.affine && (attr1 & (1 << 12));
+    object.flip_v  = !object.affine && (attr1 & (1 << 13));
+    object.is_256  = (attr0 >> 13) & 1;
+
+    int line_min = std::max(y, 0);
+    int line_max = std::min(y + object.half_height * 2, kObjLineCount);
+
+    for (int line = line_min; line < line_max; line++) {
+      obj_line_list[line][obj_line_count[line]++] = u8(index);
+    }
+  }
+
+  obj_cache_dirty = false;
+}
+
+void PPU::RenderLayerOAM(bool bitmap_mode, int line) {
+  obj_line_scaled = RenderObjects(bitmap_mode, line) && frame_scale != 1;
+
+  if (!obj_line_scaled) {
+    return;
+  }
+
+  // Render the line again at every other sub-pixel position.
+  int phases = frame_scale * frame_scale;
+  bool contains_alpha_obj = line_contains_alpha_obj;
+
+  for (int phase = 0; phase < phases; phase++) {
+    if (phase != 0) {
+      subpixel_x = phase % frame_scale;
+      subpixel_y = phase / frame_scale;
+      RenderObjects(bitmap_mode, line);
+      contains_alpha_obj |= line_contains_alpha_obj;
+    }
+
+    buffer_obj_scaled[phase] = buffer_obj;
+  }
+
+  subpixel_x = 0;
+  subpixel_y = 0;
+
+  buffer_obj = buffer_obj_scaled[0];
+  line_contains_alpha_obj = contains_alpha_obj;
+}
+
+// Renders the OBJs of a line at the current sub-pixel position and returns whether any of them depend on it.
+bool PPU::RenderObjects(bool bitmap_mode, int line) {
+  int tile_num;
+  u16 pixel;
+  s16 transform[4];
+  int cycles = mmio.dispcnt.hblank_oam_access ? 954 : 1210;
+  bool subpixel_objects = false;
+
+  line_contains_alpha_obj = false;
+
+  std::fill_n(buffer_obj.color, 240, s_color_transparent);
+  std::fill_n(buffer_obj.priority, 240, u8(4));
+  buffer_obj.alpha = {};
+  buffer_obj.window = {};
+
+  if (obj_cache_dirty) {
+    RebuildObjectCache();
+  }
+
+  // Only the OBJs that intersect the line are visited, in OAM order.
+  for (int i = 0; i < obj_line_count[line]; i++) {
+    auto const& object = obj_entries[obj_line_list[line][i]];
+
+    s32 x = object.x;
+    s32 y = object.y;
+    int width  = object.width;
+    int height = object.height;
+    int half_width  = object.half_width;
+    int mode   = object.mode;
+    int prio   = object.prio;
+    int mosaic = object.mosaic;
+
+    if (object.affine) {
+      int group = object.matrix;
 
       transform[0] = (oam[group + 0x7 ] << 8) | oam[group + 0x6 ];
       transform[1] = (oam[group + 0xF ] << 8) | oam[group + 0xE ];
       transform[2] = (oam[group + 0x17] << 8) | oam[group + 0x16];
       transform[3] = (oam[group + 0x1F] << 8) | oam[group + 0x1E];
-
-      if (attr0b9) {
-        half_width  *= 2;
-        half_height *= 2;
-      }
     } else {
       transform[0] = 0x100;
       transform[1] = 0;
@@ -110,106 +371,156 @@ void PPU::RenderLayerOAM(bool bitmap_mode, int line) {
       transform[3] = 0x100;
     }
 
-    x += half_width;
-    y += half_height;
-
-    if (line < (y - half_height) || line >= (y + half_height)) {
-      continue;
-    }
-
     int local_y = line - y;
-    int number  =  attr2 & 0x3FF;
-    int palette = (attr2 >> 12) + 16;
-    int flip_h  = !affine && (attr1 & (1 << 12));
-    int flip_v  = !affine && (attr1 & (1 << 13));
-    int is_256  = (attr0 >> 13) & 1;
+    int number  = object.number;
+    int palette = object.palette;
+    int flip_h  = object.flip_h;
+    int flip_v  = object.flip_v;
+    int is_256  = object.is_256;
 
     u32 tile_base = 0x10000;
 
     int mosaic_x = 0;
 
+    // Like BGs, mosaic OBJs are rendered at whole pixels only.
+    s32 offset_x = 0;
+    s32 offset_y = 0;
+
+    if (object.affine && !mosaic) {
+      offset_x = GetAffineSubpixelOffset(transform[0], transform[1]);
+      offset_y = GetAffineSubpixelOffset(transform[2], transform[3]);
+      subpixel_objects = true;
+    }
+
     if (mosaic) {
       mosaic_x = (x - half_width) % mmio.mosaic.obj.size_x;
       local_y -= mmio.mosaic.obj._counter_y;
     }
 
-    for (int local_x = -half_width; local_x < half_width; local_x++) {
-      int _local_x = local_x - mosaic_x;
-      int global_x = local_x + x;
+    int x_min = std::max(x - half_width, 0);
+    int x_max = std::min(x + half_width, 240);
 
-      if (mosaic && (++mosaic_x == mmio.mosaic.obj.size_x)) {
-        mosaic_x = 0;
-      }
-
-      if (global_x < 0 || global_x >= 240) {
-        continue;
-      }
-
-      int tex_x = ((transform[0] * _local_x + transform[1] * local_y) >> 8) + (width / 2);
-      int tex_y = ((transform[2] * _local_x + transform[3] * local_y) >> 8) + (height / 2);
+    // The SIMD path needs at least eight visible pixels, OBJs that are cut off by the edge of the screen may have fewer.
+    if (g_render_affine_object != nullptr && object.affine && !mosaic && x_max - x_min >= 8) {
+      int tile_stride;
 
-      if (tex_x >= width || tex_y >= height ||
-        tex_x < 0 || tex_y < 0) {
-        continue;
+      if (mmio.dispcnt.oam_mapping_1d) {
+        tile_stride = width / (is_256 ? 4 : 8);
+      } else {
+        tile_stride = 32;
       }
 
-      if (flip_h) tex_x = width  - tex_x - 1;
-      if (flip_v) tex_y = height - tex_y - 1;
+      line_contains_alpha_obj |= g_render_affine_object({
+        vram,
+        pram,
+        buffer_obj.color,
+        buffer_obj.priority,
+        buffer_obj.alpha.data(),
+        buffer_obj.window.data(),
+        x_min,
+        x_max,
+        transform[0] * (x_min - x) + transform[1] * local_y + offset_x,
+        transform[2] * (x_min - x) + transform[3] * local_y + offset_y,
+        transform[0],
+        transform[2],
+        width,
+        height,
+        (is_256 && !mmio.dispcnt.oam_mapping_1d) ? (number & ~1) : number,
+        tile_stride,
+        is_256 ? 2 : 1,
+        is_256 ? 0x200 : palette * 32,
+        prio,
+        (bool)is_256,
+        bitmap_mode,
+        mode == OBJ_SEMI,
+        mode == OBJ_WINDOW
+      });
+    } else {
+      for (int local_x = -half_width; local_x < half_width; local_x++) {
+        int _local_x = local_x - mosaic_x;
+        int global_x = local_x + x;
 
-      int tile_x  = tex_x % 8;
-      int tile_y  = tex_y % 8;
-      int block_x = tex_x / 8;
-      int block_y = tex_y / 8;
+        if (mosaic && (++mosaic_x == mmio.mosaic.obj.size_x)) {
+          mosaic_x = 0;
+        }
 
-      if (is_256) {
-        if (mmio.dispcnt.oam_mapping_1d) {
-          tile_num = number + block_y * (width / 4);
-        } else {
-          tile_num = (number & ~1) + block_y * 32;
+        if (global_x < 0 || global_x >= 240) {
+          continue;
         }
 
-        tile_num += block_x * 2;
-        tile_num &= 0x3FF;
+        int tex_x = ((transform[0] * _local_x + transform[1] * local_y + offset_x) >> 8) + (width / 2);
+        int tex_y = ((transform[2] * _local_x + transform[3] * local_y + offset_y) >> 8) + (height / 2);
 
-        if (bitmap_mode && tile_num < 512) {
+        if (tex_x >= width || tex_y >= height ||
+          tex_x < 0 || tex_y < 0) {
           continue;
         }
 
-        pixel = DecodeTilePixel8BPP(tile_base + tile_num * 32, tile_x, tile_y, true);
-      } else {
-        if (mmio.dispcnt.oam_mapping_1d) {
-          tile_num = number + block_y * (width / 8);
-        } else {
-          tile_num = number + block_y * 32;
-        }
+        if (flip_h) tex_x = width  - tex_x - 1;
+        if (flip_v) tex_y = height - tex_y - 1;
 
-        tile_num += block_x;
-        tile_num &= 0x3FF;
+        int tile_x  = tex_x % 8;
+        int tile_y  = tex_y % 8;
+        int block_x = tex_x / 8;
+        int block_y = tex_y / 8;
 
-        if (bitmap_mode && tile_num < 512) {
-          continue;
-        }
+        if (is_256) {
+          if (mmio.dispcnt.oam_mapping_1d) {
+            tile_num = number + block_y * (width / 4);
+          } else {
+            tile_num = (number & ~1) + block_y * 32;
+          }
 
-        pixel = DecodeTilePixel4BPP(tile_base + tile_num * 32, palette, tile_x, tile_y);
-      }
+          tile_num += block_x * 2;
+          tile_num &= 0x3FF;
+
+          if (bitmap_mode && tile_num < 512) {
+            continue;
+          }
+
+          pixel = DecodeTilePixel8BPP(tile_base + tile_num * 32, tile_x, tile_y, true);
+        } else {
+          if (mmio.dispcnt.oam_mapping_1d) {
+            tile_num = number + block_y * (width / 8);
+          } else {
+            tile_num = number + block_y * 32;
+          }
 
-      auto& point = buffer_obj[global_x];
-      bool opaque = pixel != s_color_transparent;
+          tile_num += block_x;
+          tile_num &= 0x3FF;
 
-      if (mode == OBJ_WINDOW) {
-        if (opaque) point.window = 1;
-      } else if (prio < point.priority || point.color == s_color_transparent) {
-        if (opaque) {
-          point.color = pixel;
-          point.alpha = (mode == OBJ_SEMI) ? 1 : 0;
-          line_contains_alpha_obj |= point.alpha;
+          if (bitmap_mode && tile_num < 512) {
+            continue;
+          }
+
+          pixel = DecodeTilePixel4BPP(tile_base + tile_num * 32, palette, tile_x, tile_y);
         }
 
-        point.priority = prio;
+        auto& color = buffer_obj.color[global_x];
+        auto& priority = buffer_obj.priority[global_x];
+        bool opaque = pixel != s_color_transparent;
+        u64 bit = 1ULL << (global_x & 63);
+
+        if (mode == OBJ_WINDOW) {
+          if (opaque) buffer_obj.window[global_x >> 6] |= bit;
+        } else if (prio < priority || color == s_color_transparent) {
+          if (opaque) {
+            color = pixel;
+
+            if (mode == OBJ_SEMI) {
+              buffer_obj.alpha[global_x >> 6] |= bit;
+              line_contains_alpha_obj = true;
+            } else {
+              buffer_obj.alpha[global_x >> 6] &= ~bit;
+            }
+          }
+
+          priority = u8(prio);
+        }
       }
     }
 
-    if (affine) {
+    if (object.affine) {
       cycles -= 10 + half_width * 4;
     } else {
       cycles -= half_width * 2;
@@ -219,6 +530,8 @@ void PPU::RenderLayerOAM(bool bitmap_mode, int line) {
       break;
     }
   }
+
+  return subpixel_objects;
 }
 
 } // namespace nba::core
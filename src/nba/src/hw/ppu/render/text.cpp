@@ -10,6 +10,15 @@
 namespace nba::core {
 
 void PPU::RenderLayerText(int id) {
+  if (mmio.bgcnt[id].full_palette) {
+    RenderLayerTextTmpl<true>(id);
+  } else {
+    RenderLayerTextTmpl<false>(id);
+  }
+}
+
+template<bool full_palette>
+void PPU::RenderLayerTextTmpl(int id) {
   auto const& bgcnt  = mmio.bgcnt[id];
   auto const& mosaic = mmio.mosaic.bg;
   
@@ -77,7 +86,7 @@ void PPU::RenderLayerText(int id) {
         bool flip_y = encoder & (1 << 11);
         int _tile_y = flip_y ? (tile_y ^ 7) : tile_y;
 
-        if (!bgcnt.full_palette) {
+        if constexpr (!full_palette) {
           DecodeTileLine4BPP(tile, tile_base, palette, number, _tile_y, flip_x);
         } else {
           DecodeTileLine8BPP(tile, tile_base, number, _tile_y, flip_x);
@@ -24,15 +24,16 @@ void PPU::RenderWindow(int id) {
 
   if (window_scanline_enable[id] && winh._changed) {
     if (winh.min <= winh.max) {
-      for (int x = 0; x < 240; x++) {
-        buffer_win[id][x] = x >= winh.min && x < winh.max;
-      }
+      buffer_win[id] = GetRangeMask(winh.min, winh.max);
     } else {
-      for (int x = 0; x < 240; x++) {
-        buffer_win[id][x] = x >= winh.min || x < winh.max;
+      auto mask_l = GetRangeMask(0, winh.max);
+      auto mask_r = GetRangeMask(winh.min, 240);
+
+      for (int i = 0; i < 4; i++) {
+        buffer_win[id][i] = mask_l[i] | mask_r[i];
       }
     }
-    
+
     winh._changed = false;
   }
 }
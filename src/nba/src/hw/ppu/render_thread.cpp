@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <cstring>
+#include <nba/trace.hpp>
+
+#include "hw/ppu/ppu.hpp"
+
+namespace nba::core {
+
+PPU::PPU(RenderThreadTag, PPU& emulated_ppu)
+    : scheduler(emulated_ppu.scheduler)
+    , irq(emulated_ppu.irq)
+    , dma(emulated_ppu.dma)
+    , config(emulated_ppu.config) {
+  // Never registered with the scheduler, this PPU only ever renders lines.
+  mmio.dispcnt.ppu = this;
+  mmio.dispstat.ppu = this;
+}
+
+void PPU::StartRenderThread() {
+  if (render_thread) {
+    return;
+  }
+
+  render_thread = std::make_unique<RenderThread>();
+  render_thread->ppu = std::unique_ptr<PPU>{new PPU{RenderThreadTag{}, *this}};
+  render_thread->thread = std::thread{&PPU::RenderThreadLoop, this};
+  write_log = &render_thread->jobs[render_thread->head].writes;
+}
+
+void PPU::StopRenderThread() {
+  if (!render_thread) {
+    return;
+  }
+
+  {
+    std::lock_guard lock{render_thread->mutex};
+    render_thread->quit = true;
+  }
+
+  render_thread->cv_submit.notify_one();
+  render_thread->thread.join();
+  render_thread.reset();
+  write_log = nullptr;
+}
+
+void PPU::SyncRenderThread() {
+  auto& ppu = *render_thread->ppu;
+
+  WaitForRenderThread();
+
+  // Writes that were not submitted yet are covered by copying the memory in full.
+  render_thread->jobs[render_thread->head].writes.clear();
+
+  std::memcpy(ppu.pram, pram, sizeof(pram));
+  std::memcpy(ppu.oam,  oam,  sizeof(oam));
+  std::memcpy(ppu.vram, vram, sizeof(vram));
+  ppu.buffer_obj = buffer_obj;
+  ppu.line_contains_alpha_obj = line_contains_alpha_obj;
+  ppu.obj_line_scaled = false;
+
+  ppu.output_format = output_format;
+  ppu.frame_scale = frame_scale;
+  ppu.color_lut = color_lut;
+  ppu.RebuildPaletteCache();
+  ppu.InvalidateTileCache();
+  ppu.obj_cache_dirty = true;
+  ppu.skip_unchanged_lines = skip_unchanged_lines;
+  ppu.InvalidateLines();
+}
+
+void PPU::WaitForRenderThread() {
+  std::unique_lock lock{render_thread->mutex};
+
+  render_thread->cv_done.wait(lock, [this] {
+    return render_thread->tail == render_thread->head;
+  });
+}
+
+void PPU::SubmitRenderJob(bool render_scanline, int obj_line) {
+  auto& rt = *render_thread;
+  auto& job = rt.jobs[rt.head];
+  int next = (rt.head + 1) % RenderThread::kQueueSize;
+
+  job.render_scanline = render_scanline;
+  job.obj_line = obj_line;
+
+  if (render_scanline || obj_line >= 0) {
+    job.mmio = mmio;
+    job.frame_buffer = frame_buffer;
+    std::memcpy(job.enable_bg, enable_bg, sizeof(enable_bg));
+    std::memcpy(job.buffer_win, buffer_win, sizeof(buffer_win));
+    std::memcpy(job.window_scanline_enable, window_scanline_enable, sizeof(window_scanline_enable));
+  }
+
+  {
+    std::unique_lock lock{rt.mutex};
+
+    // The next job slot is only free to record into once the render thread is done with it.
+    rt.cv_done.wait(lock, [&] { return next != rt.tail; });
+    rt.head = next;
+  }
+
+  rt.cv_submit.notify_one();
+  rt.jobs[next].writes.clear();
+  write_log = &rt.jobs[next].writes;
+}
+
+void PPU::RenderThreadLoop() {
+  auto& rt = *render_thread;
+  auto& ppu = *rt.ppu;
+
+  NBA_TRACE_THREAD("Render thread");
+
+  if (config->on_thread_start) {
+    config->on_thread_start("Render thread");
+  }
+
+  while (true) {
+    std::unique_lock lock{rt.mutex};
+
+    rt.cv_submit.wait(lock, [&] { return rt.quit || rt.tail != rt.head; });
+
+    if (rt.tail == rt.head) {
+      break;
+    }
+
+    auto& job = rt.jobs[rt.tail];
+
+    lock.unlock();
+
+    for (auto const& write : job.writes) {
+      ppu.ReplayMemoryWrite(write);
+    }
+
+    if (job.render_scanline || job.obj_line >= 0) {
+      ppu.LoadRenderJob(job);
+      ppu.DrawLine(job.render_scanline, job.obj_line);
+    }
+
+    lock.lock();
+    rt.tail = (rt.tail + 1) % RenderThread::kQueueSize;
+    lock.unlock();
+    rt.cv_done.notify_all();
+  }
+}
+
+void PPU::LoadRenderJob(RenderJob const& job) {
+  // Note that this also copies the register back-pointers to the emulated PPU,
+  // which is harmless since registers are never written on a render thread.
+  mmio = job.mmio;
+  frame_buffer = job.frame_buffer;
+  std::memcpy(enable_bg, job.enable_bg, sizeof(enable_bg));
+  std::memcpy(buffer_win, job.buffer_win, sizeof(buffer_win));
+  std::memcpy(window_scanline_enable, job.window_scanline_enable, sizeof(window_scanline_enable));
+}
+
+void PPU::ReplayMemoryWrite(MemoryWrite const& write) {
+  switch (write.region) {
+    case MemoryWrite::PRAM: {
+      if (write.size == sizeof(u32)) {
+        WritePRAM<u32>(write.address, write.value);
+      } else {
+        WritePRAM<u16>(write.address, u16(write.value));
+      }
+      break;
+    }
+    case MemoryWrite::VRAM: {
+      if (write.size == sizeof(u32)) {
+        WriteVRAM<u32>(write.address, write.value);
+      } else {
+        WriteVRAM<u16>(write.address, u16(write.value));
+      }
+      break;
+    }
+    case MemoryWrite::OAM: {
+      if (write.size == sizeof(u32)) {
+        WriteOAM<u32>(write.address, write.value);
+      } else {
+        WriteOAM<u16>(write.address, u16(write.value));
+      }
+      break;
+    }
+  }
+}
+
+} // namespace nba::core
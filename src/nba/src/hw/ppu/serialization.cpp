@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <cstring>
+
+#include "hw/ppu/ppu.hpp"
+
+namespace nba::core {
+
+void PPU::LoadState(SaveState const& state) {
+  auto& io = state.ppu.io;
+
+  // Lines that were recorded before are rendered from the state they were recorded in.
+  if (frame_renderer) {
+    RenderFrameJobs();
+  }
+
+  std::memcpy(pram, state.ppu.pram, sizeof(pram));
+  std::memcpy(oam,  state.ppu.oam,  sizeof(oam));
+  std::memcpy(vram, state.ppu.vram, sizeof(vram));
+  RebuildPaletteCache();
+  InvalidateTileCache();
+  InvalidateLines();
+  obj_cache_dirty = true;
+
+  mmio.dispcnt.Write(0, u8(io.dispcnt));
+  mmio.dispcnt.Write(1, u8(io.dispcnt >> 8));
+
+  // Writing DISPSTAT would check for a V-count match, so restore its fields directly.
+  mmio.dispstat.vblank_flag = (io.dispstat >> 0) & 1;
+  mmio.dispstat.hblank_flag = (io.dispstat >> 1) & 1;
+  mmio.dispstat.vcount_flag = (io.dispstat >> 2) & 1;
+  mmio.dispstat.vblank_irq_enable = (io.dispstat >> 3) & 1;
+  mmio.dispstat.hblank_irq_enable = (io.dispstat >> 4) & 1;
+  mmio.dispstat.vcount_irq_enable = (io.dispstat >> 5) & 1;
+  mmio.dispstat.vcount_setting = io.dispstat >> 8;
+
+  mmio.vcount = io.vcount;
+
+  for (int i = 0; i < 4; i++) {
+    mmio.bgcnt[i].Write(0, u8(io.bgcnt[i]));
+    mmio.bgcnt[i].Write(1, u8(io.bgcnt[i] >> 8));
+    mmio.bghofs[i] = io.bghofs[i];
+    mmio.bgvofs[i] = io.bgvofs[i];
+  }
+
+  for (int i = 0; i < 2; i++) {
+    mmio.bgx[i].initial = io.bgx[i].initial;
+    mmio.bgx[i]._current = io.bgx[i].current;
+    mmio.bgy[i].initial = io.bgy[i].initial;
+    mmio.bgy[i]._current = io.bgy[i].current;
+    mmio.bgpa[i] = io.bgpa[i];
+    mmio.bgpb[i] = io.bgpb[i];
+    mmio.bgpc[i] = io.bgpc[i];
+    mmio.bgpd[i] = io.bgpd[i];
+
+    mmio.winh[i].min = io.winh[i].min;
+    mmio.winh[i].max = io.winh[i].max;
+    mmio.winh[i]._changed = io.winh[i].changed;
+    mmio.winv[i].min = io.winv[i].min;
+    mmio.winv[i].max = io.winv[i].max;
+    mmio.winv[i]._changed = io.winv[i].changed;
+
+    mmio.winin.Write(i, u8(io.winin >> (i * 8)));
+    mmio.winout.Write(i, u8(io.winout >> (i * 8)));
+  }
+
+  mmio.mosaic.bg.size_x = io.mosaic.bg.size_x;
+  mmio.mosaic.bg.size_y = io.mosaic.bg.size_y;
+  mmio.mosaic.bg._counter_y = io.mosaic.bg.counter_y;
+  mmio.mosaic.obj.size_x = io.mosaic.obj.size_x;
+  mmio.mosaic.obj.size_y = io.mosaic.obj.size_y;
+  mmio.mosaic.obj._counter_y = io.mosaic.obj.counter_y;
+
+  mmio.bldcnt.Write(0, u8(io.bldcnt));
+  mmio.bldcnt.Write(1, u8(io.bldcnt >> 8));
+  mmio.eva = io.eva;
+  mmio.evb = io.evb;
+  mmio.evy = io.evy;
+
+  for (int i = 0; i < 4; i++) {
+    enable_bg[0][i] = state.ppu.enable_bg[0][i];
+    enable_bg[1][i] = state.ppu.enable_bg[1][i];
+  }
+
+  for (int x = 0; x < 240; x++) {
+    auto& pixel = state.ppu.buffer_obj[x];
+
+    buffer_obj.color[x] = pixel.color;
+    buffer_obj.priority[x] = pixel.priority;
+  }
+
+  line_contains_alpha_obj = state.ppu.line_contains_alpha_obj;
+
+  // The OBJs at the other sub-pixel positions are not saved, the next line shows them at whole pixels.
+  obj_line_scaled = false;
+
+  buffer_obj.alpha = {};
+  buffer_obj.window = {};
+  buffer_win[0] = {};
+  buffer_win[1] = {};
+
+  for (int x = 0; x < 240; x++) {
+    u64 bit = 1ULL << (x & 63);
+
+    if (state.ppu.buffer_obj[x].alpha) buffer_obj.alpha[x >> 6] |= bit;
+    if (state.ppu.buffer_obj[x].window) buffer_obj.window[x >> 6] |= bit;
+    if (state.ppu.buffer_win[0][x]) buffer_win[0][x >> 6] |= bit;
+    if (state.ppu.buffer_win[1][x]) buffer_win[1][x >> 6] |= bit;
+  }
+
+  for (int i = 0; i < 2; i++) {
+    window_scanline_enable[i] = state.ppu.window_scanline_enable[i];
+  }
+
+  if (render_thread) {
+    SyncRenderThread();
+  }
+
+  if (frame_renderer) {
+    SyncFrameRenderer();
+  }
+
+  // The state may be loaded in the middle of a frame that is rendered into the internal buffer.
+  if (!ppu_frame && !frame_buffer) {
+    AllocateOutput();
+  }
+}
+
+void PPU::CopyState(SaveState& state) {
+  // The OBJ line buffer is produced by the render thread.
+  if (render_thread) {
+    WaitForRenderThread();
+    buffer_obj = render_thread->ppu->buffer_obj;
+    line_contains_alpha_obj = render_thread->ppu->line_contains_alpha_obj;
+  }
+
+  // With parallel rendering, it is produced by rendering the lines that were recorded so far.
+  if (frame_renderer) {
+    RenderFrameJobs();
+    buffer_obj = frame_renderer->buffer_obj;
+    line_contains_alpha_obj = frame_renderer->line_contains_alpha_obj;
+  }
+
+  std::memcpy(state.ppu.pram, pram, sizeof(pram));
+  std::memcpy(state.ppu.oam,  oam,  sizeof(oam));
+  std::memcpy(state.ppu.vram, vram, sizeof(vram));
+
+  CopyIOState(state);
+
+  for (int i = 0; i < 4; i++) {
+    state.ppu.enable_bg[0][i] = enable_bg[0][i];
+    state.ppu.enable_bg[1][i] = enable_bg[1][i];
+  }
+
+  for (int x = 0; x < 240; x++) {
+    auto& pixel = state.ppu.buffer_obj[x];
+
+    pixel.color = buffer_obj.color[x];
+    pixel.priority = buffer_obj.priority[x];
+    pixel.alpha = TestLineMask(buffer_obj.alpha, x);
+    pixel.window = TestLineMask(buffer_obj.window, x);
+    state.ppu.buffer_win[0][x] = TestLineMask(buffer_win[0], x);
+    state.ppu.buffer_win[1][x] = TestLineMask(buffer_win[1], x);
+  }
+
+  state.ppu.line_contains_alpha_obj = line_contains_alpha_obj;
+
+  for (int i = 0; i < 2; i++) {
+    state.ppu.window_scanline_enable[i] = window_scanline_enable[i];
+  }
+}
+
+void PPU::CopyIOState(SaveState& state) {
+  auto& io = state.ppu.io;
+
+  io.dispcnt = mmio.dispcnt.Read(0) | (mmio.dispcnt.Read(1) << 8);
+  io.dispstat = mmio.dispstat.Read(0) | (mmio.dispstat.Read(1) << 8);
+  io.vcount = mmio.vcount;
+
+  for (int i = 0; i < 4; i++) {
+    io.bgcnt[i] = mmio.bgcnt[i].Read(0) | (mmio.bgcnt[i].Read(1) << 8);
+    io.bghofs[i] = mmio.bghofs[i];
+    io.bgvofs[i] = mmio.bgvofs[i];
+  }
+
+  for (int i = 0; i < 2; i++) {
+    io.bgx[i].initial = mmio.bgx[i].initial;
+    io.bgx[i].current = mmio.bgx[i]._current;
+    io.bgy[i].initial = mmio.bgy[i].initial;
+    io.bgy[i].current = mmio.bgy[i]._current;
+    io.bgpa[i] = mmio.bgpa[i];
+    io.bgpb[i] = mmio.bgpb[i];
+    io.bgpc[i] = mmio.bgpc[i];
+    io.bgpd[i] = mmio.bgpd[i];
+
+    io.winh[i].min = u8(mmio.winh[i].min);
+    io.winh[i].max = u8(mmio.winh[i].max);
+    io.winh[i].changed = mmio.winh[i]._changed;
+    io.winv[i].min = u8(mmio.winv[i].min);
+    io.winv[i].max = u8(mmio.winv[i].max);
+    io.winv[i].changed = mmio.winv[i]._changed;
+  }
+
+  io.winin = mmio.winin.Read(0) | (mmio.winin.Read(1) << 8);
+  io.winout = mmio.winout.Read(0) | (mmio.winout.Read(1) << 8);
+
+  io.mosaic.bg.size_x = u8(mmio.mosaic.bg.size_x);
+  io.mosaic.bg.size_y = u8(mmio.mosaic.bg.size_y);
+  io.mosaic.bg.counter_y = u8(mmio.mosaic.bg._counter_y);
+  io.mosaic.obj.size_x = u8(mmio.mosaic.obj.size_x);
+  io.mosaic.obj.size_y = u8(mmio.mosaic.obj.size_y);
+  io.mosaic.obj.counter_y = u8(mmio.mosaic.obj._counter_y);
+
+  io.bldcnt = mmio.bldcnt.Read(0) | (mmio.bldcnt.Read(1) << 8);
+  io.eva = u8(mmio.eva);
+  io.evb = u8(mmio.evb);
+  io.evy = u8(mmio.evy);
+}
+
+} // namespace nba::core
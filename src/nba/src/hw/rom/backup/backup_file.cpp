@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <nba/rom/backup/backup_file.hpp>
+
+#if defined(_WIN32)
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX
+  #include <windows.h>
+#else
+  #include <sys/mman.h>
+#endif
+
+namespace nba {
+
+bool BackupFile::Map() {
+#if defined(_WIN32)
+  auto file = CreateFileA(
+    path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  auto mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+  if (mapping == nullptr) {
+    CloseHandle(file);
+    return false;
+  }
+
+  // The view keeps the mapping alive, the file handle is kept for flushing it to disk.
+  auto view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, file_size);
+  CloseHandle(mapping);
+  if (view == nullptr) {
+    CloseHandle(file);
+    return false;
+  }
+
+  file_handle = file;
+  memory = (u8*)view;
+#else
+  int fd = open(path.c_str(), O_RDWR);
+  if (fd == -1) {
+    return false;
+  }
+
+  // The mapping keeps the file alive, so the descriptor can be closed right away.
+  auto view = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (view == MAP_FAILED) {
+    return false;
+  }
+
+  memory = (u8*)view;
+#endif
+  mapped = true;
+  return true;
+}
+
+void BackupFile::Unmap() {
+  if (!mapped) {
+    return;
+  }
+#if defined(_WIN32)
+  UnmapViewOfFile(memory);
+  CloseHandle((HANDLE)file_handle);
+#else
+  munmap(memory, file_size);
+#endif
+  mapped = false;
+  memory = nullptr;
+}
+
+void BackupFile::SyncMapping() {
+#if defined(_WIN32)
+  FlushViewOfFile(memory, file_size);
+  FlushFileBuffers((HANDLE)file_handle);
+#else
+  msync(memory, file_size, MS_SYNC);
+#endif
+}
+
+} // namespace nba
@@ -17,22 +17,22 @@ static constexpr int g_save_size[2] = { 512, 8192 };
 EEPROM::EEPROM(std::string const& save_path, Size size_hint)
     : size(size_hint)
     , save_path(save_path) {
-  Reset();
-}
-
-void EEPROM::Reset() {
-  state = STATE_ACCEPT_COMMAND;
-  address = 0;
-  ResetSerialBuffer();
-
   int bytes = g_save_size[size];
-  
+
   file = BackupFile::OpenOrCreate(save_path, { 512, 8192 }, bytes);
   if (bytes == g_save_size[0]) {
     size = SIZE_4K;
   } else {
     size = SIZE_64K;
   }
+
+  Reset();
+}
+
+void EEPROM::Reset() {
+  state = STATE_ACCEPT_COMMAND;
+  address = 0;
+  ResetSerialBuffer();
 }
 
 void EEPROM::ResetSerialBuffer() {
@@ -127,4 +127,38 @@ void EEPROM::Write(u32 address, u8 value) {
   }
 }
 
+void EEPROM::LoadState(SaveState const& state) {
+  auto& eeprom = state.backup.eeprom;
+
+  this->state = eeprom.state;
+  address = eeprom.address;
+  serial_buffer = eeprom.serial_buffer;
+  transmitted_bits = eeprom.transmitted_bits;
+
+  file->MemoryCopy(0, state.backup.data, file->Size());
+}
+
+void EEPROM::CopyState(SaveState& state) {
+  auto& eeprom = state.backup.eeprom;
+
+  eeprom.state = u8(this->state);
+  eeprom.address = u16(address);
+  eeprom.serial_buffer = serial_buffer;
+  eeprom.transmitted_bits = u8(transmitted_bits);
+
+  std::memcpy(state.backup.data, file->Buffer(), file->Size());
+}
+
+auto EEPROM::Clone() -> std::unique_ptr<Backup> {
+  auto clone = std::unique_ptr<EEPROM>{new EEPROM{}};
+
+  clone->size = size;
+  clone->file = file->Clone();
+  clone->state = state;
+  clone->address = address;
+  clone->serial_buffer = serial_buffer;
+  clone->transmitted_bits = transmitted_bits;
+  return clone;
+}
+
 } // namespace nba
@@ -5,6 +5,7 @@
  * Refer to the included LICENSE file.
  */
 
+#include <cstring>
 #include <nba/rom/backup/flash.hpp>
 
 namespace nba {
@@ -14,6 +15,15 @@ static constexpr int g_save_size[2] = { 65536, 131072 };
 FLASH::FLASH(std::string const& save_path, Size size_hint)
     : size(size_hint)
     , save_path(save_path) {
+  int bytes = g_save_size[size];
+
+  file = BackupFile::OpenOrCreate(save_path, { 65536, 131072 }, bytes);
+  if (bytes == g_save_size[0]) {
+    size = SIZE_64K;
+  } else {
+    size = SIZE_128K;
+  }
+
   Reset();
 }
   
@@ -24,15 +34,6 @@ void FLASH::Reset() {
   enable_erase = false;
   enable_write = false;
   enable_select = false;
-  
-  int bytes = g_save_size[size];
-  
-  file = BackupFile::OpenOrCreate(save_path, { 65536, 131072 }, bytes);
-  if (bytes == g_save_size[0]) {
-    size = SIZE_64K;
-  } else {
-    size = SIZE_128K;
-  }
 }
 
 auto FLASH::Read (u32 address) -> u8 {
@@ -140,4 +141,44 @@ void FLASH::HandleExtended(u32 address, u8 value) {
   phase = 0;
 }
 
+void FLASH::LoadState(SaveState const& state) {
+  auto& flash = state.backup.flash;
+
+  current_bank = flash.current_bank;
+  phase = flash.phase;
+  enable_chip_id = flash.enable_chip_id;
+  enable_erase = flash.enable_erase;
+  enable_write = flash.enable_write;
+  enable_select = flash.enable_select;
+
+  file->MemoryCopy(0, state.backup.data, file->Size());
+}
+
+void FLASH::CopyState(SaveState& state) {
+  auto& flash = state.backup.flash;
+
+  flash.current_bank = u8(current_bank);
+  flash.phase = u8(phase);
+  flash.enable_chip_id = enable_chip_id;
+  flash.enable_erase = enable_erase;
+  flash.enable_write = enable_write;
+  flash.enable_select = enable_select;
+
+  std::memcpy(state.backup.data, file->Buffer(), file->Size());
+}
+
+auto FLASH::Clone() -> std::unique_ptr<Backup> {
+  auto clone = std::unique_ptr<FLASH>{new FLASH{}};
+
+  clone->size = size;
+  clone->file = file->Clone();
+  clone->current_bank = current_bank;
+  clone->phase = phase;
+  clone->enable_chip_id = enable_chip_id;
+  clone->enable_erase = enable_erase;
+  clone->enable_write = enable_write;
+  clone->enable_select = enable_select;
+  return clone;
+}
+
 } // namespace nba
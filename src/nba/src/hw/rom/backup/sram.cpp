@@ -5,18 +5,18 @@
  * Refer to the included LICENSE file.
  */
 
+#include <cstring>
 #include <nba/rom/backup/sram.hpp>
 
 namespace nba {
 
 SRAM::SRAM(std::string const& save_path)
     : save_path(save_path) {
-  Reset();
+  int bytes = 32768;
+  file = BackupFile::OpenOrCreate(save_path, { 32768 }, bytes);
 }
 
 void SRAM::Reset() {
-  int bytes = 32768;
-  file = BackupFile::OpenOrCreate(save_path, { 32768 }, bytes);
 }
 
 auto SRAM::Read(u32 address) -> u8 {
@@ -27,4 +27,19 @@ void SRAM::Write(u32 address, u8 value) {
   file->Write(address & 0x7FFF, value);
 }
 
+void SRAM::LoadState(SaveState const& state) {
+  file->MemoryCopy(0, state.backup.data, file->Size());
+}
+
+void SRAM::CopyState(SaveState& state) {
+  std::memcpy(state.backup.data, file->Buffer(), file->Size());
+}
+
+auto SRAM::Clone() -> std::unique_ptr<Backup> {
+  auto clone = std::unique_ptr<SRAM>{new SRAM{}};
+
+  clone->file = file->Clone();
+  return clone;
+}
+
 } // namespace nba
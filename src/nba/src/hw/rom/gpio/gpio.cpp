@@ -72,4 +72,19 @@ void GPIO::Write(u32 address, u8 value) {
   }
 }
 
+void GPIO::LoadState(SaveState const& state) {
+  allow_reads = state.gpio.allow_reads;
+  port_data = state.gpio.port_data;
+  for (int i = 0; i < 4; i++) {
+    direction[i] = (state.gpio.rd_mask & (1 << i)) ? PortDirection::In : PortDirection::Out;
+  }
+  UpdateReadWriteMasks();
+}
+
+void GPIO::CopyState(SaveState& state) {
+  state.gpio.allow_reads = allow_reads;
+  state.gpio.rd_mask = rd_mask;
+  state.gpio.port_data = port_data;
+}
+
 } // namespace nba
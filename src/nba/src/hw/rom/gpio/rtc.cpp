@@ -5,8 +5,9 @@
  * Refer to the included LICENSE file.
  */
 
-#include <nba/log.hpp>
+#include <algorithm>
 #include <ctime>
+#include <nba/log.hpp>
 
 #include "rtc.hpp"
 
@@ -183,28 +184,88 @@ void RTC::ReadRegister() {
       break;
     }
     case Register::DateTime: {
-      auto timestamp = std::time(nullptr);
-      auto time = std::localtime(&timestamp);
-      buffer[0] = ConvertDecimalToBCD(time->tm_year - 100);
-      buffer[1] = ConvertDecimalToBCD(1 + time->tm_mon);
-      buffer[2] = ConvertDecimalToBCD(time->tm_mday);
-      buffer[3] = ConvertDecimalToBCD(time->tm_wday);
-      buffer[4] = ConvertDecimalToBCD(time->tm_hour);
-      buffer[5] = ConvertDecimalToBCD(time->tm_min);
-      buffer[6] = ConvertDecimalToBCD(time->tm_sec);
+      auto time = GetDateTime();
+      buffer[0] = ConvertDecimalToBCD(time.year - 2000);
+      buffer[1] = ConvertDecimalToBCD(time.month);
+      buffer[2] = ConvertDecimalToBCD(time.day);
+      buffer[3] = ConvertDecimalToBCD(time.weekday);
+      buffer[4] = ConvertDecimalToBCD(time.hour);
+      buffer[5] = ConvertDecimalToBCD(time.minute);
+      buffer[6] = ConvertDecimalToBCD(time.second);
       break;
     }
     case Register::Time: {
-      auto timestamp = std::time(nullptr);
-      auto time = std::localtime(&timestamp);
-      buffer[0] = ConvertDecimalToBCD(time->tm_hour);
-      buffer[1] = ConvertDecimalToBCD(time->tm_min);
-      buffer[2] = ConvertDecimalToBCD(time->tm_sec);
+      auto time = GetDateTime();
+      buffer[0] = ConvertDecimalToBCD(time.hour);
+      buffer[1] = ConvertDecimalToBCD(time.minute);
+      buffer[2] = ConvertDecimalToBCD(time.second);
       break;
     }
   }
 }
 
+auto RTC::GetDateTime() -> DateTime {
+  static constexpr u64 kCyclesPerSecond = 16777216;
+  static constexpr s64 kSecondsPerDay = 86400;
+
+  auto timestamp = scheduler.GetTimestampNow();
+  s64 seconds;
+
+  if (config->rtc.source == Config::RTC::Source::Fixed) {
+    seconds = config->rtc.epoch + s64(timestamp / kCyclesPerSecond);
+  } else {
+    if (!host_time_valid || timestamp < host_time_timestamp) {
+      host_time = GetHostTime();
+      host_time_timestamp = timestamp;
+      host_time_valid = true;
+    }
+    seconds = host_time + s64((timestamp - host_time_timestamp) / kCyclesPerSecond);
+  }
+
+  s64 days = seconds / kSecondsPerDay;
+  s64 second_of_day = seconds % kSecondsPerDay;
+
+  if (second_of_day < 0) {
+    days--;
+    second_of_day += kSecondsPerDay;
+  }
+
+  // Converts days since 1970-01-01 to the civil date, see http://howardhinnant.github.io/date_algorithms.html
+  s64 z = days + 719468;
+  s64 era = (z >= 0 ? z : z - 146096) / 146097;
+  s64 day_of_era = z - era * 146097;
+  s64 year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+  s64 day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+  s64 mp = (5 * day_of_year + 2) / 153;
+
+  DateTime time;
+  time.day = int(day_of_year - (153 * mp + 2) / 5 + 1);
+  time.month = int(mp < 10 ? mp + 3 : mp - 9);
+  time.year = std::clamp(int(year_of_era + era * 400 + (time.month <= 2)), 2000, 2099);
+  time.weekday = int(((days % 7) + 11) % 7); // 1970-01-01 was a Thursday
+  time.hour = int(second_of_day / 3600);
+  time.minute = int(second_of_day / 60 % 60);
+  time.second = int(second_of_day % 60);
+  return time;
+}
+
+// The local time of the host, in seconds since 1970-01-01 00:00:00 (in local time as well).
+auto RTC::GetHostTime() -> s64 {
+  auto timestamp = std::time(nullptr);
+  auto time = std::localtime(&timestamp);
+
+  // Converts the civil date to days since 1970-01-01, the inverse of the conversion in GetDateTime().
+  s64 year = time->tm_year + 1900 - (time->tm_mon < 2);
+  s64 month = time->tm_mon + 1;
+  s64 era = (year >= 0 ? year : year - 399) / 400;
+  s64 year_of_era = year - era * 400;
+  s64 day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + time->tm_mday - 1;
+  s64 day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  s64 days = era * 146097 + day_of_era - 719468;
+
+  return days * 86400 + time->tm_hour * 3600 + time->tm_min * 60 + time->tm_sec;
+}
+
 void RTC::WriteRegister() {
   // TODO: is the datetime register writeable?
   switch (reg) {
@@ -229,4 +290,51 @@ void RTC::WriteRegister() {
   }
 }
 
+void RTC::LoadState(SaveState const& state) {
+  auto& rtc = state.gpio.rtc;
+
+  GPIO::LoadState(state);
+
+  // Continue from the current host time, rather than from the time that the state was saved at.
+  host_time_valid = false;
+
+  current_bit = rtc.current_bit;
+  current_byte = rtc.current_byte;
+  reg = (Register)rtc.reg;
+  data = rtc.data;
+  for (int i = 0; i < 7; i++) {
+    buffer[i] = rtc.buffer[i];
+  }
+  port.sck = rtc.port.sck;
+  port.sio = rtc.port.sio;
+  port.cs = rtc.port.cs;
+  this->state = (State)rtc.state;
+  control.unknown = rtc.control.unknown;
+  control.per_minute_irq = rtc.control.per_minute_irq;
+  control.mode_24h = rtc.control.mode_24h;
+  control.poweroff = rtc.control.poweroff;
+}
+
+void RTC::CopyState(SaveState& state) {
+  auto& rtc = state.gpio.rtc;
+
+  GPIO::CopyState(state);
+
+  rtc.current_bit = u8(current_bit);
+  rtc.current_byte = u8(current_byte);
+  rtc.reg = (u8)reg;
+  rtc.data = data;
+  for (int i = 0; i < 7; i++) {
+    rtc.buffer[i] = buffer[i];
+  }
+  rtc.port.sck = u8(port.sck);
+  rtc.port.sio = u8(port.sio);
+  rtc.port.cs = u8(port.cs);
+  rtc.state = (u8)this->state;
+  rtc.control.unknown = control.unknown;
+  rtc.control.per_minute_irq = control.per_minute_irq;
+  rtc.control.mode_24h = control.mode_24h;
+  rtc.control.poweroff = control.poweroff;
+}
+
 } // namespace nba
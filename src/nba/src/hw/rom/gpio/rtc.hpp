@@ -7,9 +7,12 @@
 
 #pragma once
 
+#include <memory>
+#include <nba/config.hpp>
 #include <nba/rom/gpio/gpio.hpp>
 
 #include "hw/irq/irq.hpp"
+#include "scheduler.hpp"
 
 namespace nba {
 
@@ -36,12 +39,18 @@ struct RTC : GPIO {
     Free = 7
   };
 
-  RTC(core::IRQ& irq) : irq(irq) {
+  RTC(core::IRQ& irq, core::Scheduler& scheduler, std::shared_ptr<Config> config)
+      : irq(irq)
+      , scheduler(scheduler)
+      , config(config) {
     Reset();
   }
 
   void Reset();
 
+  void LoadState(SaveState const& state) final;
+  void CopyState(SaveState& state) final;
+
 protected:
   auto ReadPort() -> u8 final;
   void WritePort(u8 value) final;
@@ -54,6 +63,19 @@ private:
   void ReadRegister();
   void WriteRegister();
 
+  struct DateTime {
+    int year; // 2000 to 2099
+    int month;
+    int day;
+    int weekday; // 0 is Sunday
+    int hour;
+    int minute;
+    int second;
+  };
+
+  auto GetDateTime() -> DateTime;
+  static auto GetHostTime() -> s64;
+
   static auto ConvertDecimalToBCD(u8 x) -> u8 {
     u8 y = 0;
     u8 e = 1;
@@ -97,6 +119,15 @@ private:
   } control;
 
   core::IRQ& irq;
+  core::Scheduler& scheduler;
+  std::shared_ptr<Config> config;
+
+  /* The host time (see Config::RTC) is sampled once, at the given scheduler timestamp.
+   * The timestamp starts over when the core is reset, which also takes a new sample.
+   */
+  bool host_time_valid = false;
+  s64 host_time;
+  u64 host_time_timestamp;
 
   static constexpr int s_argument_count[8] = {
     0, // ForceReset
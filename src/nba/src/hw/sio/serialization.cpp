@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+
+#include "hw/sio/sio.hpp"
+
+namespace nba::core {
+
+void SIO::LoadState(SaveState const& state) {
+  siocnt = state.sio.siocnt;
+  send = state.sio.send;
+  rcnt = state.sio.rcnt;
+  std::copy_n(state.sio.data, 4, data);
+
+  transfer_event = scheduler.FindEvent(EventClass::SIO_transfer_done);
+  transfer_mode = GetMode();
+
+  /* The link is not part of the state: transfers in progress complete
+   * as if the other players had gone away and the link time continues
+   * from where the other players are.
+   */
+  sync_event = scheduler.FindEvent(EventClass::SIO_link_sync);
+  if (sync_event && !IsLinked()) {
+    scheduler.Cancel(sync_event);
+    sync_event = nullptr;
+  }
+
+  if (IsLinked()) {
+    JoinLink();
+  }
+}
+
+void SIO::CopyState(SaveState& state) {
+  state.sio.siocnt = siocnt;
+  state.sio.send = send;
+  state.sio.rcnt = rcnt;
+  std::copy_n(data, 4, state.sio.data);
+}
+
+} // namespace nba::core
@@ -0,0 +1,425 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+#include <thread>
+
+#include "hw/sio/sio.hpp"
+
+namespace nba::core {
+
+// One start bit, 16 data bits and one stop bit per player, at 9600, 38400, 57600 and 115200 bps.
+static constexpr int kMultiplayerBitsPerPlayer = 18;
+static constexpr int kMultiplayerCyclesPerBit[4] = { 1748, 437, 291, 146 };
+
+// The internal shift clock runs at either 256 KiHz or 2 MiHz.
+static constexpr int kNormalCyclesPerBit[2] = { 64, 8 };
+
+SIO::SIO(Scheduler& scheduler, IRQ& irq)
+    : scheduler(scheduler)
+    , irq(irq) {
+  scheduler.Register<&SIO::OnTransferDone>(EventClass::SIO_transfer_done, this);
+  scheduler.Register<&SIO::OnLinkSync>(EventClass::SIO_link_sync, this);
+  Reset();
+}
+
+SIO::~SIO() {
+  Disconnect();
+}
+
+void SIO::Reset() {
+  siocnt = 0;
+  send = 0;
+  rcnt = 0;
+  transfer_mode = Mode::Normal8;
+  std::fill_n(data, 4, 0);
+
+  // The scheduler has been reset as well.
+  transfer_event = nullptr;
+  sync_event = nullptr;
+
+  if (IsLinked()) {
+    JoinLink();
+  }
+}
+
+bool SIO::Connect(std::shared_ptr<LinkCable> cable, int player) {
+  Disconnect();
+
+  if (player < 0 || player >= LinkCable::kMaxPlayers) {
+    return false;
+  }
+
+  auto latest_time = cable->GetLatestTime();
+
+  if (!cable->Connect(player)) {
+    return false;
+  }
+
+  cable->Publish(player, latest_time);
+
+  // Drop anything that a previous user of this player number did not pick up.
+  for (int from = 0; from < LinkCable::kMaxPlayers; from++) {
+    Message message;
+    while (from != player && cable->Receive(from, player, message)) {}
+  }
+
+  link.cable = cable;
+  link.player = player;
+  JoinLink();
+  return true;
+}
+
+void SIO::Disconnect() {
+  if (!IsLinked()) {
+    return;
+  }
+
+  link.cable->Disconnect(link.player);
+  link.cable.reset();
+
+  if (sync_event) {
+    scheduler.Cancel(sync_event);
+    sync_event = nullptr;
+  }
+
+  // A transfer in progress completes as if the other players had gone away.
+  std::fill_n(link.awaiting, LinkCable::kMaxPlayers, false);
+}
+
+// Start (or continue) at the link time of the player that is furthest ahead.
+void SIO::JoinLink() {
+  auto& cable = *link.cable;
+  auto latest_time = cable.GetLatestTime();
+
+  link.time_base = s64(scheduler.GetTimestampNow()) - s64(latest_time);
+  cable.Publish(link.player, latest_time);
+
+  std::fill_n(link.awaiting, LinkCable::kMaxPlayers, false);
+  std::fill_n(link.received, LinkCable::kMaxPlayers, 0xFFFF'FFFF);
+
+  if (sync_event == nullptr) {
+    sync_event = scheduler.Add(GetSyncInterval(), EventClass::SIO_link_sync);
+  }
+}
+
+auto SIO::Read(int offset) -> u8 {
+  switch (offset) {
+    case REG_SIODATA32 ... REG_SIODATA32 + 7: {
+      return data[offset >> 1] >> ((offset & 1) * 8);
+    }
+    case REG_SIOCNT | 0: return GetControl() & 0xFF;
+    case REG_SIOCNT | 1: return GetControl() >> 8;
+    case REG_SIODATA8 | 0: return send & 0xFF;
+    case REG_SIODATA8 | 1: return send >> 8;
+    case REG_RCNT | 0: return rcnt & 0xFF;
+    case REG_RCNT | 1: return rcnt >> 8;
+  }
+
+  return 0;
+}
+
+void SIO::Write(int offset, u8 value) {
+  switch (offset) {
+    case REG_SIODATA32 ... REG_SIODATA32 + 7: {
+      auto shift = (offset & 1) * 8;
+      auto& reg = data[offset >> 1];
+
+      reg = (reg & ~(0xFF << shift)) | (value << shift);
+      break;
+    }
+    case REG_SIOCNT | 0: {
+      bool start = !(siocnt & CNT_START) && (value & CNT_START);
+
+      // The start bit doubles as the busy flag while a transfer is in progress.
+      bool busy = transfer_event || (GetMode() == Mode::Multiplayer && IsLinked() && link.player != 0);
+
+      if (busy && (siocnt & CNT_START)) {
+        value |= CNT_START;
+      }
+
+      siocnt = (siocnt & 0xFF00) | value;
+
+      if (start) {
+        StartTransfer();
+      }
+      break;
+    }
+    case REG_SIOCNT | 1: {
+      siocnt = (siocnt & 0x00FF) | ((value & 0x7F) << 8);
+      break;
+    }
+    case REG_SIODATA8 | 0: send = (send & 0xFF00) | value; break;
+    case REG_SIODATA8 | 1: send = (send & 0x00FF) | (value << 8); break;
+    case REG_RCNT | 0: rcnt = (rcnt & 0xFF00) | value; break;
+    case REG_RCNT | 1: rcnt = (rcnt & 0x00FF) | (value << 8); break;
+  }
+}
+
+auto SIO::GetMode() const -> Mode {
+  if (rcnt & 0x8000) {
+    return (rcnt & 0x4000) ? Mode::JOYBus : Mode::GeneralPurpose;
+  }
+
+  return (Mode)((siocnt >> 12) & 3);
+}
+
+// SIOCNT with the bits that reflect the state of the link.
+auto SIO::GetControl() const -> u16 {
+  auto value = siocnt;
+
+  switch (GetMode()) {
+    case Mode::Normal8:
+    case Mode::Normal32: {
+      // SI is pulled high while no other side drives it.
+      value &= ~CNT_SI;
+      if (!IsLinked() || !link.cable->IsConnected(GetPeer())) {
+        value |= CNT_SI;
+      }
+      break;
+    }
+    case Mode::Multiplayer: {
+      // SI is low for the parent only, SD is high once all players are connected.
+      value &= ~0x7C;
+      if (IsLinked()) {
+        value |= link.player << 4;
+        if (link.player != 0) {
+          value |= CNT_SI;
+        }
+        if (link.cable->GetConnectedCount() >= 2) {
+          value |= CNT_SD;
+        }
+      } else {
+        value |= CNT_SI;
+      }
+      break;
+    }
+    default: break;
+  }
+
+  return value;
+}
+
+bool SIO::IsLinked() const {
+  return link.cable != nullptr;
+}
+
+// Normal mode is point-to-point between players 0 and 1 (or 2 and 3).
+auto SIO::GetPeer() const -> int {
+  return link.player ^ 1;
+}
+
+auto SIO::GetLinkTime() const -> u64 {
+  return u64(s64(scheduler.GetTimestampNow()) - link.time_base);
+}
+
+auto SIO::GetSyncInterval() const -> int {
+  return std::max(link.cable->GetQuantum() / 2, 64);
+}
+
+auto SIO::GetNormalData(Mode mode) const -> u32 {
+  if (mode == Mode::Normal8) {
+    return send & 0xFF;
+  }
+  return data[0] | (data[1] << 16);
+}
+
+void SIO::SetNormalData(Mode mode, u32 value) {
+  if (mode == Mode::Normal8) {
+    send = (send & 0xFF00) | (value & 0xFF);
+  } else {
+    data[0] = u16(value);
+    data[1] = u16(value >> 16);
+  }
+}
+
+void SIO::StartTransfer() {
+  auto mode = GetMode();
+  int cycles;
+
+  switch (mode) {
+    case Mode::Normal8:
+    case Mode::Normal32: {
+      // With the external clock, the other side starts the transfer.
+      if (!(siocnt & CNT_INTERNAL_CLOCK)) {
+        return;
+      }
+
+      if (IsLinked() && link.cable->IsConnected(GetPeer())) {
+        link.awaiting[GetPeer()] = true;
+        link.received[GetPeer()] = 0xFFFF'FFFF;
+        Send(GetPeer(), Message::Type::Request, mode, GetNormalData(mode));
+      }
+
+      cycles = (mode == Mode::Normal8 ? 8 : 32) * kNormalCyclesPerBit[(siocnt & CNT_FAST_CLOCK) ? 1 : 0];
+      break;
+    }
+    case Mode::Multiplayer: {
+      // Only the parent can start a transfer, for the children the start bit is read-only.
+      if (!IsLinked() || link.player != 0) {
+        siocnt &= ~CNT_START;
+        return;
+      }
+
+      std::fill_n(data, 4, 0xFFFF);
+
+      for (int i = 1; i < LinkCable::kMaxPlayers; i++) {
+        if (link.cable->IsConnected(i)) {
+          link.awaiting[i] = true;
+          link.received[i] = 0xFFFF;
+          Send(i, Message::Type::Request, mode, send);
+        }
+      }
+
+      cycles = kMultiplayerBitsPerPlayer * kMultiplayerCyclesPerBit[siocnt & 3] * link.cable->GetConnectedCount();
+      break;
+    }
+    default: {
+      // UART and the general purpose and JOY Bus modes are not supported.
+      return;
+    }
+  }
+
+  transfer_mode = mode;
+  transfer_event = scheduler.Add(cycles, EventClass::SIO_transfer_done);
+}
+
+void SIO::OnTransferDone(int cycles_late) {
+  transfer_event = nullptr;
+
+  // The other players may lag behind by up to a quantum, wait for their data.
+  if (IsLinked()) {
+    auto& cable = *link.cable;
+
+    cable.Publish(link.player, GetLinkTime());
+
+    while (std::any_of(link.awaiting, link.awaiting + LinkCable::kMaxPlayers, [](bool x) { return x; }) && !cable.IsClosed()) {
+      ProcessMessages();
+      std::this_thread::yield();
+    }
+  }
+
+  if (transfer_mode == Mode::Multiplayer) {
+    Message message{Message::Type::Complete, u8(Mode::Multiplayer), {send, 0xFFFF, 0xFFFF, 0xFFFF}};
+
+    for (int i = 1; i < LinkCable::kMaxPlayers; i++) {
+      if (IsLinked() && link.cable->IsConnected(i) && !link.awaiting[i]) {
+        message.data[i] = link.received[i] & 0xFFFF;
+      }
+    }
+
+    for (int i = 0; i < LinkCable::kMaxPlayers; i++) {
+      data[i] = u16(message.data[i]);
+    }
+
+    if (IsLinked()) {
+      for (int i = 1; i < LinkCable::kMaxPlayers; i++) {
+        if (link.cable->IsConnected(i)) {
+          link.cable->Send(link.player, i, message);
+        }
+      }
+    }
+  } else {
+    auto received = 0xFFFF'FFFFu;
+
+    if (IsLinked() && !link.awaiting[GetPeer()]) {
+      received = link.received[GetPeer()];
+    }
+
+    SetNormalData(transfer_mode, received);
+  }
+
+  std::fill_n(link.awaiting, LinkCable::kMaxPlayers, false);
+  CompleteTransfer();
+}
+
+void SIO::CompleteTransfer() {
+  siocnt &= ~CNT_START;
+
+  if (siocnt & CNT_IRQ) {
+    irq.Raise(IRQ::Source::Serial);
+  }
+}
+
+/* Runs every half quantum while linked: answers the other players and
+ * waits while this core would get more than a quantum ahead of any of them.
+ */
+void SIO::OnLinkSync(int cycles_late) {
+  auto& cable = *link.cable;
+  auto interval = GetSyncInterval();
+  auto time = GetLinkTime();
+
+  ProcessMessages();
+  cable.Publish(link.player, time);
+
+  while (!cable.MayRunAhead(link.player, time + interval) && !cable.IsClosed()) {
+    ProcessMessages();
+    std::this_thread::yield();
+  }
+
+  sync_event = scheduler.Add(std::max(interval - cycles_late, 1), EventClass::SIO_link_sync);
+}
+
+void SIO::ProcessMessages() {
+  Message message;
+
+  for (int from = 0; from < LinkCable::kMaxPlayers; from++) {
+    while (from != link.player && link.cable->Receive(from, link.player, message)) {
+      HandleMessage(from, message);
+    }
+  }
+}
+
+void SIO::HandleMessage(int from, Message const& message) {
+  auto mode = GetMode();
+
+  switch (message.type) {
+    case Message::Type::Request: {
+      if (message.mode == u8(Mode::Multiplayer)) {
+        if (mode == Mode::Multiplayer && link.player != 0) {
+          Send(from, Message::Type::Response, mode, send);
+          siocnt |= CNT_START;
+        } else {
+          Send(from, Message::Type::Response, Mode::Multiplayer, 0xFFFF);
+        }
+        break;
+      }
+
+      // Normal mode: the data is only exchanged if this side waits for the other side's clock.
+      if (message.mode == u8(mode) && !(siocnt & CNT_INTERNAL_CLOCK) && (siocnt & CNT_START)) {
+        Send(from, Message::Type::Response, mode, GetNormalData(mode));
+        SetNormalData(mode, message.data[0]);
+        CompleteTransfer();
+      } else {
+        Send(from, Message::Type::Response, Mode(message.mode), 0xFFFF'FFFF);
+      }
+      break;
+    }
+    case Message::Type::Response: {
+      if (link.awaiting[from]) {
+        link.received[from] = message.data[0];
+        link.awaiting[from] = false;
+      }
+      break;
+    }
+    case Message::Type::Complete: {
+      if (mode == Mode::Multiplayer && link.player != 0 && (siocnt & CNT_START)) {
+        for (int i = 0; i < 4; i++) {
+          data[i] = u16(message.data[i]);
+        }
+        CompleteTransfer();
+      }
+      break;
+    }
+  }
+}
+
+void SIO::Send(int to, Message::Type type, Mode mode, u32 value) {
+  link.cable->Send(link.player, to, {type, u8(mode), {value, 0, 0, 0}});
+}
+
+} // namespace nba::core
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <memory>
+#include <nba/integer.hpp>
+#include <nba/link_cable.hpp>
+#include <nba/save_state.hpp>
+
+#include "hw/irq/irq.hpp"
+#include "scheduler.hpp"
+
+namespace nba::core {
+
+/* Serial port, supports the normal (8-bit and 32-bit) and the multiplayer mode.
+ * Without a link cable, transfers that this side clocks complete with all bits set
+ * (nothing drives the data line) and transfers clocked by the other side never complete.
+ * With a link cable, see LinkCable for how the cores are kept in sync.
+ */
+struct SIO {
+  SIO(Scheduler& scheduler, IRQ& irq);
+ ~SIO();
+
+  void Reset();
+
+  // Must not be called while the core is running.
+  bool Connect(std::shared_ptr<LinkCable> cable, int player);
+  void Disconnect();
+
+  // 'offset' is relative to SIODATA32 (0x04000120) and includes RCNT.
+  auto Read(int offset) -> u8;
+  void Write(int offset, u8 value);
+
+  void LoadState(SaveState const& state);
+  void CopyState(SaveState& state);
+
+private:
+  using Message = LinkCable::Message;
+
+  enum Registers {
+    REG_SIODATA32 = 0x00,
+    REG_SIOMULTI  = 0x00,
+    REG_SIOCNT    = 0x08,
+    REG_SIODATA8  = 0x0A,
+    REG_RCNT      = 0x14
+  };
+
+  enum class Mode : u8 {
+    Normal8,
+    Normal32,
+    Multiplayer,
+    UART,
+    GeneralPurpose,
+    JOYBus
+  };
+
+  enum Control : u16 {
+    CNT_INTERNAL_CLOCK = 1 << 0,
+    CNT_FAST_CLOCK = 1 << 1,
+    CNT_SI = 1 << 2,
+    CNT_SD = 1 << 3,
+    CNT_START = 1 << 7,
+    CNT_IRQ = 1 << 14
+  };
+
+  auto GetMode() const -> Mode;
+  auto GetControl() const -> u16;
+  bool IsLinked() const;
+  auto GetPeer() const -> int;
+  auto GetLinkTime() const -> u64;
+  auto GetSyncInterval() const -> int;
+  auto GetNormalData(Mode mode) const -> u32;
+  void SetNormalData(Mode mode, u32 value);
+
+  void JoinLink();
+  void StartTransfer();
+  void CompleteTransfer();
+  void OnTransferDone(int cycles_late);
+  void OnLinkSync(int cycles_late);
+  void ProcessMessages();
+  void HandleMessage(int from, Message const& message);
+  void Send(int to, Message::Type type, Mode mode, u32 value);
+
+  u16 siocnt;
+  u16 data[4];
+  u16 send;
+  u16 rcnt;
+  Mode transfer_mode;
+
+  Scheduler& scheduler;
+  IRQ& irq;
+  Scheduler::Event* transfer_event = nullptr;
+  Scheduler::Event* sync_event = nullptr;
+
+  struct Link {
+    std::shared_ptr<LinkCable> cable;
+    int player = 0;
+
+    // Scheduler timestamp at link time zero.
+    s64 time_base = 0;
+
+    // Data received from each player for the current transfer, while waiting for it.
+    bool awaiting[LinkCable::kMaxPlayers] {};
+    u32 received[LinkCable::kMaxPlayers] {};
+  } link;
+};
+
+} // namespace nba::core
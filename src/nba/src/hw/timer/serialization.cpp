@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include "hw/timer/timer.hpp"
+
+namespace nba::core {
+
+bool Timer::ValidateState(SaveState const& state) {
+  for (auto& channel_state : state.timer) {
+    if (channel_state.control.frequency >= 4) {
+      return false;
+    }
+  }
+
+  // The user data of an overflow event is the timer ID.
+  for (int i = 0; i < state.scheduler.event_count; i++) {
+    auto& event = state.scheduler.events[i];
+
+    if (event.event_class == (u16)EventClass::TM_overflow && event.user_data >= 4) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void Timer::LoadState(SaveState const& state) {
+  auto now = scheduler.GetTimestampNow();
+
+  for (int id = 0; id < 4; id++) {
+    auto& channel = channels[id];
+    auto& channel_state = state.timer[id];
+
+    channel.reload = channel_state.reload;
+    channel.counter = channel_state.counter;
+    channel.control.frequency = channel_state.control.frequency;
+    channel.control.cascade = channel_state.control.cascade;
+    channel.control.interrupt = channel_state.control.interrupt;
+    channel.control.enable = channel_state.control.enable;
+    channel.running = channel_state.running;
+    channel.shift = s_ticks_shift[channel.control.frequency];
+    channel.mask = s_ticks_mask[channel.control.frequency];
+    channel.samplerate = channel_state.samplerate;
+    channel.timestamp_started = now + channel_state.timestamp_started;
+    channel.event = scheduler.FindEvent(EventClass::TM_overflow, id);
+  }
+}
+
+void Timer::CopyState(SaveState& state) {
+  auto now = scheduler.GetTimestampNow();
+
+  for (int id = 0; id < 4; id++) {
+    auto& channel = channels[id];
+    auto& channel_state = state.timer[id];
+
+    channel_state.reload = channel.reload;
+    channel_state.counter = channel.counter;
+    channel_state.control.frequency = u8(channel.control.frequency);
+    channel_state.control.cascade = channel.control.cascade;
+    channel_state.control.interrupt = channel.control.interrupt;
+    channel_state.control.enable = channel.control.enable;
+    channel_state.running = channel.running;
+    channel_state.samplerate = u32(channel.samplerate);
+    channel_state.timestamp_started = channel.timestamp_started - now;
+  }
+}
+
+} // namespace nba::core
@@ -11,19 +11,11 @@
 
 namespace nba::core {
 
-static constexpr int g_ticks_shift[4] = { 0, 6, 8, 10 };
-static constexpr int g_ticks_mask[4] = { 0, 0x3F, 0xFF, 0x3FF };
-
 void Timer::Reset() {
   for (int id = 0; id < 4; id++) {
     auto& channel = channels[id];
     channel = {};
     channel.id = id;
-    channel.event_cb = [this, id](int cycles_late) {
-      auto& channel = channels[id];
-      OnOverflow(channel);
-      StartChannel(channel, cycles_late);
-    };
   }
 }
 
@@ -31,14 +23,18 @@ auto Timer::Read(int chan_id, int offset) -> u8 {
   auto const& channel = channels[chan_id];
   auto const& control = channel.control;
 
-  auto counter = channel.counter;
-
   // While the timer is still running we must account for time that has passed
   // since the last counter update (overflow or configuration change).
-  if (channel.running) {
-    counter += GetCounterDeltaSinceLastUpdate(channel);
+  if (offset != REG_TMXCNT_H) {
+    auto head = GetChainHead(chan_id);
+
+    if (head != nullptr) {
+      Sync(*head, scheduler.GetTimestampNow());
+    }
   }
 
+  auto counter = channel.counter;
+
   switch (offset) {
     case REG_TMXCNT_L | 0: {
       return counter & 0xFF;
@@ -60,6 +56,9 @@ void Timer::Write(int chan_id, int offset, u8 value) {
   auto& channel = channels[chan_id];
   auto& control = channel.control;
 
+  // Both the reload value and the control bits affect how often and how visibly a cascade chain overflows.
+  Sync();
+
   switch (offset) {
     case REG_TMXCNT_L | 0: channel.reload = (channel.reload & 0xFF00) | (value << 0); break;
     case REG_TMXCNT_L | 1: channel.reload = (channel.reload & 0x00FF) | (value << 8); break;
@@ -77,8 +76,8 @@ void Timer::Write(int chan_id, int offset, u8 value) {
         control.cascade = value & 4;
       }
 
-      channel.shift = g_ticks_shift[control.frequency];
-      channel.mask  = g_ticks_mask[control.frequency];
+      channel.shift = s_ticks_shift[control.frequency];
+      channel.mask  = s_ticks_mask[control.frequency];
 
       if (control.enable) {
         if (!enable_previous) {
@@ -107,45 +106,163 @@ void Timer::Write(int chan_id, int offset, u8 value) {
       channels[1].samplerate = kCyclesPerSecond / (timer1_duty << channels[1].shift);
     }
   }
+
+  Reschedule();
+}
+
+void Timer::Sync() {
+  auto now = scheduler.GetTimestampNow();
+
+  for (auto& channel : channels) {
+    if (channel.running) {
+      Sync(channel, now);
+    }
+  }
+}
+
+void Timer::Reschedule() {
+  auto now = scheduler.GetTimestampNow();
+
+  for (auto& channel : channels) {
+    if (channel.running) {
+      Sync(channel, now);
+      scheduler.Cancel(channel.event);
+      StartChannel(channel, int(now - channel.timestamp_started));
+    }
+  }
+}
+
+auto Timer::GetChainHead(int chan_id) -> Channel* {
+  while (chan_id > 0 && channels[chan_id].control.enable && channels[chan_id].control.cascade) {
+    chan_id--;
+  }
+
+  auto& channel = channels[chan_id];
+  return channel.running ? &channel : nullptr;
+}
+
+bool Timer::HasVisibleOverflow(Channel const& channel) {
+  if (channel.control.interrupt) {
+    return true;
+  }
+
+  if (channel.id <= 1) {
+    auto const& dma = apu.mmio.soundcnt.dma;
+    return dma[0].timer_id == channel.id || dma[1].timer_id == channel.id;
+  }
+
+  return false;
+}
+
+/* Returns how many times the channel may overflow, before it or a channel further down its cascade chain
+ * overflows in a visible way (i.e. raises an IRQ or feeds a sound FIFO).
+ * Until then the overflows only change the counters, which can be worked out on demand (see Sync()).
+ */
+auto Timer::GetOverflowsUntilVisible(Channel const& head) -> u64 {
+  // Overflows of the head that cause the channel to overflow for the first time.
+  auto get_overflows = [&](int chan_id) {
+    u64 overflows = 1;
+
+    for (int id = chan_id; id > head.id; id--) {
+      auto const& channel = channels[id];
+
+      overflows = (0x10000 - channel.counter) + (overflows - 1) * (0x10000 - channel.reload);
+      if (overflows >= s_max_batch_size) {
+        return s_max_batch_size;
+      }
+    }
+    return overflows;
+  };
+
+  for (int id = head.id; id < 4; id++) {
+    auto const& channel = channels[id];
+
+    if (id != head.id && !(channel.control.enable && channel.control.cascade)) {
+      break;
+    }
+
+    if (HasVisibleOverflow(channel)) {
+      return get_overflows(id);
+    }
+  }
+
+  return s_max_batch_size;
+}
+
+// Adds ticks to the counter and returns how many times it overflowed.
+auto Timer::Increment(Channel& channel, u64 ticks) -> u64 {
+  u64 counter = channel.counter + ticks;
+
+  if (counter < 0x10000) {
+    channel.counter = u32(counter);
+    return 0;
+  }
+
+  u64 period = 0x10000 - channel.reload;
+
+  counter -= 0x10000;
+  channel.counter = channel.reload + u32(counter % period);
+  return 1 + counter / period;
 }
 
-auto Timer::GetCounterDeltaSinceLastUpdate(Channel const& channel) -> u32 {
-  return (scheduler.GetTimestampNow() - channel.timestamp_started) >> channel.shift;
+void Timer::Sync(Channel& channel, u64 timestamp) {
+  // The start of a channel may be delayed slightly into the future (see Write()).
+  if (timestamp <= channel.timestamp_started) {
+    return;
+  }
+
+  auto ticks = (timestamp - channel.timestamp_started) >> channel.shift;
+  auto overflows = Increment(channel, ticks);
+
+  channel.timestamp_started += ticks << channel.shift;
+
+  if (overflows != 0) {
+    OnOverflow(channel, overflows);
+  }
 }
 
 void Timer::StartChannel(Channel& channel, int cycles_late) {
-  int cycles = int((0x10000 - channel.counter) << channel.shift);
+  u64 ticks = 0x10000 - channel.counter;
+
+  ticks += (GetOverflowsUntilVisible(channel) - 1) * (0x10000 - channel.reload);
 
   channel.running = true;
   channel.timestamp_started = scheduler.GetTimestampNow() - cycles_late;
-  channel.event = scheduler.Add(cycles - cycles_late, channel.event_cb);
+  channel.event = scheduler.Add((ticks << channel.shift) - cycles_late, EventClass::TM_overflow, channel.id);
 }
 
 void Timer::StopChannel(Channel& channel) {
-  channel.counter += GetCounterDeltaSinceLastUpdate(channel);
-  if (channel.counter >= 0x10000) {
-    OnOverflow(channel);
-  }
+  Sync(channel, scheduler.GetTimestampNow());
   scheduler.Cancel(channel.event);
   channel.event = nullptr;
   channel.running = false;
 }
 
-void Timer::OnOverflow(Channel& channel) {
-  channel.counter = channel.reload;
+void Timer::OnOverflowEvent(int cycles_late, u64 chan_id) {
+  auto& channel = channels[chan_id];
+  Sync(channel, scheduler.GetTimestampNow() - cycles_late);
+  StartChannel(channel, cycles_late);
+}
 
+// Is called after the counter has been reloaded, with the number of overflows since the last call.
+void Timer::OnOverflow(Channel& channel, u64 times) {
   if (channel.control.interrupt) {
     irq.Raise(IRQ::Source::Timer, channel.id);
   }
 
   if (channel.id <= 1) {
-    apu.OnTimerOverflow(channel.id, 1, channel.samplerate);
+    apu.OnTimerOverflow(channel.id, int(times), channel.samplerate);
   }
 
   if (channel.id != 3) {
     auto& next_channel = channels[channel.id + 1];
-    if (next_channel.control.enable && next_channel.control.cascade && ++next_channel.counter == 0x10000) {
-      OnOverflow(next_channel);
+
+    if (next_channel.control.enable && next_channel.control.cascade) {
+      auto overflows = Increment(next_channel, times);
+
+      if (overflows != 0) {
+        OnOverflow(next_channel, overflows);
+      }
     }
   }
 }
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <nba/integer.hpp>
+#include <nba/save_state.hpp>
 
 #include "hw/apu/apu.hpp"
 #include "hw/irq/irq.hpp"
@@ -20,6 +21,7 @@ struct Timer {
       : scheduler(scheduler)
       , irq(irq)
       , apu(apu) {
+    scheduler.Register<&Timer::OnOverflowEvent>(EventClass::TM_overflow, this);
     Reset();
   }
 
@@ -27,6 +29,16 @@ struct Timer {
   auto Read (int chan_id, int offset) -> u8;
   void Write(int chan_id, int offset, u8 value);
 
+  /* Overflows that are only visible through the counters may be batched (see StartChannel()).
+   * Anything that changes which overflows are visible must be wrapped between Sync() and Reschedule().
+   */
+  void Sync();
+  void Reschedule();
+
+  static bool ValidateState(SaveState const& state);
+  void LoadState(SaveState const& state);
+  void CopyState(SaveState& state);
+
 private:
   enum Registers {
     REG_TMXCNT_L = 0,
@@ -51,17 +63,26 @@ private:
     int samplerate;
     u64 timestamp_started;
     Scheduler::Event* event = nullptr;
-    std::function<void(int)> event_cb;
   } channels[4];
 
   Scheduler& scheduler;
   IRQ& irq;
   APU& apu;
 
-  auto GetCounterDeltaSinceLastUpdate(Channel const& channel) -> u32;
+  static constexpr int s_ticks_shift[4] = { 0, 6, 8, 10 };
+  static constexpr int s_ticks_mask[4] = { 0, 0x3F, 0xFF, 0x3FF };
+
+  static constexpr u64 s_max_batch_size = 1 << 24;
+
+  auto GetChainHead(int chan_id) -> Channel*;
+  bool HasVisibleOverflow(Channel const& channel);
+  auto GetOverflowsUntilVisible(Channel const& channel) -> u64;
+  auto Increment(Channel& channel, u64 ticks) -> u64;
+  void Sync(Channel& channel, u64 timestamp);
   void StartChannel(Channel& channel, int cycles_late);
   void StopChannel(Channel& channel);
-  void OnOverflow(Channel& channel);
+  void OnOverflow(Channel& channel, u64 times);
+  void OnOverflowEvent(int cycles_late, u64 chan_id);
 };
 
 } // namespace nba::core
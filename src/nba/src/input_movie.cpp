@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <fstream>
+#include <nba/input_movie.hpp>
+#include <nba/log.hpp>
+
+namespace nba {
+
+namespace {
+
+struct Header {
+  u32 magic;
+  u32 version;
+  u32 event_count;
+  u32 reserved;
+};
+
+struct EventRecord {
+  u64 timestamp;
+  u32 frame;
+  u16 keys;
+  u16 reserved;
+};
+
+} // namespace
+
+bool InputMovie::Load(std::string const& path) {
+  std::ifstream file{path, std::ios::binary};
+
+  if (!file.good()) {
+    Log<Error>("InputMovie: cannot open {}", path);
+    return false;
+  }
+
+  Header header;
+
+  file.read((char*)&header, sizeof(header));
+
+  if (!file.good() || header.magic != kMagicNumber || header.version != kCurrentVersion) {
+    Log<Error>("InputMovie: {} is not a valid movie file or was created by an incompatible version.", path);
+    return false;
+  }
+
+  events.resize(header.event_count);
+
+  for (auto& event : events) {
+    EventRecord record;
+
+    file.read((char*)&record, sizeof(record));
+
+    if (!file.good()) {
+      Log<Error>("InputMovie: unexpected end of file in {}", path);
+      events.clear();
+      return false;
+    }
+
+    event = { record.timestamp, record.frame, record.keys };
+  }
+
+  return true;
+}
+
+bool InputMovie::Save(std::string const& path) const {
+  std::ofstream file{path, std::ios::binary};
+
+  if (!file.good()) {
+    Log<Error>("InputMovie: cannot create {}", path);
+    return false;
+  }
+
+  Header header{kMagicNumber, kCurrentVersion, u32(events.size()), 0};
+
+  file.write((char const*)&header, sizeof(header));
+
+  for (auto const& event : events) {
+    EventRecord record{event.timestamp, event.frame, event.keys, 0};
+
+    file.write((char const*)&record, sizeof(record));
+  }
+
+  return file.good();
+}
+
+} // namespace nba
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <nba/common/crc32.hpp>
+#include <nba/latency_probe.hpp>
+
+namespace nba {
+
+LatencyProbe::LatencyProbe(bool presents) : presents(presents) {
+  for (auto& stage : samples) {
+    stage.reserve(kMaxSamples);
+  }
+}
+
+void LatencyProbe::OnInput() {
+  auto now = Clock::now();
+
+  std::lock_guard lock{mutex};
+
+  if (active) {
+    if (now - input_time < kTimeout) {
+      return;
+    }
+    timed_out++;
+  }
+
+  active = true;
+  next_stage = (int)Stage::Latched;
+  input_time = now;
+  baseline = last_frame;
+}
+
+void LatencyProbe::OnKeysLatched() {
+  auto now = Clock::now();
+
+  std::lock_guard lock{mutex};
+
+  if (active && next_stage == (int)Stage::Latched) {
+    stage_time[next_stage++] = now;
+  }
+}
+
+void LatencyProbe::OnFrameRendered(void const* frame, size_t size) {
+  auto now = Clock::now();
+  auto checksum = crc32((u8 const*)frame, size);
+
+  std::lock_guard lock{mutex};
+
+  if (active && next_stage == (int)Stage::Rendered && have_frame && checksum != baseline) {
+    stage_time[next_stage++] = now;
+  }
+
+  last_frame = checksum;
+  have_frame = true;
+}
+
+void LatencyProbe::OnFrameDrawn() {
+  auto now = Clock::now();
+
+  std::lock_guard lock{mutex};
+
+  if (active && next_stage == (int)Stage::Drawn) {
+    stage_time[next_stage++] = now;
+
+    if (!presents) {
+      Complete();
+    }
+  }
+}
+
+void LatencyProbe::OnPresented(Clock::time_point render_start) {
+  auto now = Clock::now();
+
+  std::lock_guard lock{mutex};
+
+  if (active && next_stage == (int)Stage::Presented && render_start >= stage_time[(int)Stage::Drawn]) {
+    stage_time[next_stage++] = now;
+    Complete();
+  }
+}
+
+void LatencyProbe::Complete() {
+  for (int stage = 0; stage < next_stage; stage++) {
+    auto milliseconds = std::chrono::duration<float, std::milli>(stage_time[stage] - input_time).count();
+    auto& stage_samples = samples[stage];
+
+    if ((int)stage_samples.size() < kMaxSamples) {
+      stage_samples.push_back(milliseconds);
+    } else {
+      stage_samples[sample_index] = milliseconds;
+    }
+  }
+
+  sample_index = (sample_index + 1) % kMaxSamples;
+  completed++;
+  active = false;
+}
+
+auto LatencyProbe::GetStats() -> Stats {
+  auto stats = Stats{};
+  auto sorted = std::vector<float>{};
+
+  std::lock_guard lock{mutex};
+
+  for (int stage = 0; stage < (int)Stage::Count; stage++) {
+    auto& distribution = stats.stages[stage];
+
+    sorted = samples[stage];
+    if (sorted.empty()) {
+      continue;
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    auto percentile = [&](double p) -> double {
+      return sorted[std::min(size_t(p * sorted.size()), sorted.size() - 1)];
+    };
+
+    double sum = 0;
+    for (auto sample : sorted) {
+      sum += sample;
+    }
+
+    distribution.count = (int)sorted.size();
+    distribution.min = sorted.front();
+    distribution.mean = sum / sorted.size();
+    distribution.p50 = percentile(0.50);
+    distribution.p90 = percentile(0.90);
+    distribution.p99 = percentile(0.99);
+    distribution.max = sorted.back();
+  }
+
+  stats.completed = completed;
+  stats.timed_out = timed_out;
+  return stats;
+}
+
+auto LatencyProbe::FormatStats() -> std::string {
+  auto stats = GetStats();
+  auto text = fmt::format("{} presses, {} timed out (ms from input)\n", stats.completed, stats.timed_out);
+
+  text += fmt::format("{:<10} {:>8} {:>8} {:>8} {:>8} {:>8} {:>8}\n", "stage", "min", "mean", "p50", "p90", "p99", "max");
+
+  for (int stage = 0; stage < (int)Stage::Count; stage++) {
+    auto const& distribution = stats.stages[stage];
+
+    if (distribution.count == 0) {
+      continue;
+    }
+
+    text += fmt::format(
+      "{:<10} {:>8.2f} {:>8.2f} {:>8.2f} {:>8.2f} {:>8.2f} {:>8.2f}\n",
+      GetName((Stage)stage),
+      distribution.min, distribution.mean, distribution.p50, distribution.p90, distribution.p99, distribution.max);
+  }
+
+  return text;
+}
+
+void LatencyProbe::Reset() {
+  std::lock_guard lock{mutex};
+
+  for (auto& stage : samples) {
+    stage.clear();
+  }
+  active = false;
+  sample_index = 0;
+  completed = 0;
+  timed_out = 0;
+}
+
+} // namespace nba
@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <nba/common/dsp/spsc_ring_buffer.hpp>
+#include <nba/log.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nba {
+
+namespace detail {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kMessageLength = 240;
+constexpr int kQueueSize = 256;
+
+// At most this many messages from one call site are logged per second.
+constexpr int kRateLimit = 20;
+constexpr auto kRateWindow = std::chrono::seconds{1};
+
+struct Message {
+  u64 sequence;
+  Level level;
+  u16 length;
+  char text[kMessageLength];
+};
+
+// Messages of one thread. The thread writes, the logger reads while holding its mutex.
+struct MessageQueue {
+  SPSCRingBuffer<Message> messages{kQueueSize};
+  std::atomic<u32> dropped{0};
+  std::atomic_bool closed{false};
+};
+
+struct Logger {
+  Logger() {
+    thread = std::thread{&Logger::Run, this};
+  }
+
+ ~Logger() {
+    {
+      std::lock_guard lock{mutex};
+      quit = true;
+    }
+    cv.notify_one();
+    thread.join();
+  }
+
+  void Register(std::shared_ptr<MessageQueue> queue) {
+    std::lock_guard lock{mutex};
+    queues.push_back(std::move(queue));
+  }
+
+  void Flush() {
+    std::lock_guard lock{mutex};
+    Drain();
+  }
+
+  void Run() {
+    std::unique_lock lock{mutex};
+
+    while (!quit) {
+      cv.wait_for(lock, std::chrono::milliseconds{10});
+      Drain();
+    }
+
+    Drain();
+  }
+
+  // Writes the queued messages of all threads in the order they were logged. Must be called with the mutex held.
+  void Drain() {
+    u32 dropped = 0;
+
+    pending.clear();
+    pending.reserve(queues.size() * kQueueSize);
+
+    for (auto& queue : queues) {
+      auto& messages = queue->messages;
+
+      while (messages.Available() > 0) {
+        pending.push_back(messages.Read());
+      }
+      dropped += queue->dropped.exchange(0);
+    }
+
+    // The queues of threads that exited are released once they are empty.
+    queues.erase(std::remove_if(queues.begin(), queues.end(), [](auto const& queue) {
+      return queue->closed && queue->messages.Available() == 0;
+    }), queues.end());
+
+    std::sort(pending.begin(), pending.end(), [](Message const& a, Message const& b) {
+      return a.sequence < b.sequence;
+    });
+
+    for (auto const& message : pending) {
+      fmt::print("{} {}\n", GetPrefix(message.level), std::string_view{message.text, message.length});
+    }
+
+    if (dropped != 0) {
+      fmt::print("{} Log: dropped {} messages.\n", GetPrefix(Warn), dropped);
+    }
+
+    if (!pending.empty() || dropped != 0) {
+      std::fflush(stdout);
+    }
+  }
+
+  static auto GetPrefix(Level level) -> char const* {
+    switch (level) {
+      case Trace: return "\e[36m[T]";
+      case Debug: return "\e[34m[D]";
+      case Info:  return "\e[37m[I]";
+      case Warn:  return "\e[33m[W]";
+      case Error: return "\e[35m[E]";
+      case Fatal: return "\e[31m[F]";
+      default:    return "[?]";
+    }
+  }
+
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool quit = false;
+  std::vector<std::shared_ptr<MessageQueue>> queues;
+  std::vector<Message> pending;
+  std::atomic<u64> sequence{0};
+
+  // Runtime filters, subsystem masks are rarely set, so they are simply looked up under a lock.
+  std::atomic_int mask{kLogMask};
+  std::atomic_bool has_subsystem_masks{false};
+  std::mutex filter_mutex;
+  std::vector<std::pair<std::string, int>> subsystem_masks;
+};
+
+auto GetLogger() -> Logger& {
+  static Logger logger;
+  return logger;
+}
+
+struct ThreadState {
+ ~ThreadState() {
+    if (queue) {
+      queue->closed = true;
+    }
+  }
+
+  std::shared_ptr<MessageQueue> queue;
+
+  // Direct-mapped by the address of the format string, which identifies the call site.
+  struct RateLimit {
+    std::string_view format;
+    Clock::time_point window_start;
+    int count = 0;
+    int suppressed = 0;
+  } rate_limits[64];
+};
+
+thread_local ThreadState t_state;
+
+void Enqueue(Logger& logger, Level level, std::string_view format, fmt::format_args args) {
+  auto& queue = *t_state.queue;
+
+  if (queue.messages.Pending() == queue.messages.Capacity()) {
+    queue.dropped++;
+    return;
+  }
+
+  Message message;
+
+  auto result = fmt::vformat_to_n(message.text, kMessageLength, format, args);
+
+  message.level = level;
+  message.length = u16(std::min(result.size, kMessageLength));
+  message.sequence = logger.sequence.fetch_add(1, std::memory_order_relaxed);
+  queue.messages.Write(message);
+}
+
+} // namespace nba::detail::(anonymous)
+
+bool IsLogEnabled(Level level, std::string_view format) {
+  auto& logger = GetLogger();
+
+  if (logger.has_subsystem_masks.load(std::memory_order_relaxed)) {
+    auto subsystem = format.substr(0, format.find(':'));
+
+    std::lock_guard lock{logger.filter_mutex};
+
+    for (auto const& [name, mask] : logger.subsystem_masks) {
+      if (name == subsystem) {
+        return (mask & level) != 0;
+      }
+    }
+  }
+
+  return (logger.mask.load(std::memory_order_relaxed) & level) != 0;
+}
+
+void PushLog(Level level, std::string_view format, fmt::format_args args) {
+  auto& logger = GetLogger();
+
+  if (!t_state.queue) {
+    t_state.queue = std::make_shared<MessageQueue>();
+    logger.Register(t_state.queue);
+  }
+
+  if (level != Fatal) {
+    auto now = Clock::now();
+    auto& limit = t_state.rate_limits[(reinterpret_cast<uintptr_t>(format.data()) >> 3) % 64];
+
+    if (limit.format.data() != format.data() || now - limit.window_start >= kRateWindow) {
+      if (limit.suppressed != 0) {
+        Enqueue(logger, Warn, "Log: suppressed {} more messages like \"{}\"", fmt::make_format_args(limit.suppressed, limit.format));
+      }
+      limit = {format, now, 0, 0};
+    }
+
+    if (++limit.count > kRateLimit) {
+      limit.suppressed++;
+      return;
+    }
+  }
+
+  // Make sure that there is room for a fatal message, since the process exits right after it.
+  if (level == Fatal) {
+    logger.Flush();
+  }
+
+  Enqueue(logger, level, format, args);
+
+  if (level == Fatal) {
+    logger.Flush();
+  } else if (level == Error) {
+    logger.cv.notify_one();
+  }
+}
+
+} // namespace nba::detail
+
+void SetLogMask(int mask) {
+  detail::GetLogger().mask = mask;
+}
+
+void SetLogMask(std::string_view subsystem, int mask) {
+  auto& logger = detail::GetLogger();
+
+  std::lock_guard lock{logger.filter_mutex};
+
+  auto& masks = logger.subsystem_masks;
+  auto match = std::find_if(masks.begin(), masks.end(), [&](auto const& entry) {
+    return entry.first == subsystem;
+  });
+
+  if (match != masks.end()) {
+    match->second = mask;
+  } else {
+    masks.emplace_back(subsystem, mask);
+  }
+
+  logger.has_subsystem_masks = true;
+}
+
+void FlushLog() {
+  detail::GetLogger().Flush();
+}
+
+} // namespace nba
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <nba/core.hpp>
+#include <nba/log.hpp>
+#include <nba/profile.hpp>
+#include <nba/save_state.hpp>
+
+namespace nba::core {
+
+/* Attributes wall time and emulated cycles to whichever section is on top of a small stack.
+ * Entering a section pauses the one below it, so that nested sections
+ * (i.e. an event that fires in the middle of an instruction) are never counted twice.
+ * Only compiled in with NBA_PROFILER, see NBA_PROFILE_SCOPE() in scheduler.hpp.
+ */
+struct Profiler {
+  using Section = ProfileStats::Section;
+  using Clock = std::chrono::steady_clock;
+
+  Profiler() {
+    Reset(0);
+  }
+
+  void Reset(u64 timestamp) {
+    depth = 0;
+    stack[0] = Section::Other;
+    current = {};
+    frame = 0;
+    frame_start = timestamp;
+    timestamp_last = timestamp;
+    time_last = Clock::now();
+
+    std::lock_guard lock{mutex};
+    published = {};
+    published.enabled = true;
+  }
+
+  void Enter(Section section, u64 timestamp) {
+    Assert(depth + 1 < kMaxDepth, "Profiler: sections are nested too deeply.");
+
+    Charge(timestamp);
+    stack[++depth] = section;
+    current.sections[(int)section].calls++;
+  }
+
+  void Leave(u64 timestamp) {
+    Charge(timestamp);
+    depth--;
+  }
+
+  void OnEvent(int event_class, u64 cycles_late) {
+    auto& entry = current.events[event_class];
+    int bucket = 0;
+
+    if (cycles_late != 0) {
+      bucket = std::min(64 - __builtin_clzll(cycles_late), ProfileStats::kLateBucketCount - 1);
+    }
+
+    entry.count++;
+    entry.cycles_late += cycles_late;
+    current.events_late[bucket]++;
+  }
+
+  void OnEventAdded(int queue_size) {
+    current.event_queue_peak = std::max(current.event_queue_peak, queue_size);
+  }
+
+  // Publishes the statistics of the current frame once it is complete.
+  void Update(u64 timestamp) {
+    if (timestamp - frame_start < CoreBase::kCyclesPerFrame) {
+      return;
+    }
+
+    Charge(timestamp);
+
+    {
+      std::lock_guard lock{mutex};
+      published = current;
+      published.enabled = true;
+      published.frame = ++frame;
+      published.event_queue_capacity = SaveState::Scheduler::kMaxEvents;
+    }
+
+    current = {};
+    frame_start = timestamp - (timestamp - frame_start) % CoreBase::kCyclesPerFrame;
+  }
+
+  // May be called from any thread.
+  auto GetStats() -> ProfileStats {
+    std::lock_guard lock{mutex};
+    return published;
+  }
+
+private:
+  static constexpr int kMaxDepth = 16;
+
+  void Charge(u64 timestamp) {
+    auto now = Clock::now();
+    auto& entry = current.sections[(int)stack[depth]];
+
+    entry.cycles += timestamp - timestamp_last;
+    entry.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(now - time_last).count();
+    timestamp_last = timestamp;
+    time_last = now;
+  }
+
+  int depth;
+  Section stack[kMaxDepth];
+  ProfileStats current;
+  u64 frame;
+  u64 frame_start;
+  u64 timestamp_last;
+  Clock::time_point time_last;
+
+  std::mutex mutex;
+  ProfileStats published;
+};
+
+} // namespace nba::core
@@ -10,43 +10,104 @@
 #include <nba/log.hpp>
 #include <nba/common/compiler.hpp>
 #include <nba/integer.hpp>
-#include <functional>
+#include <nba/save_state.hpp>
 #include <limits>
+#include <type_traits>
+
+#if defined(NBA_HOTSPOT_SAMPLER)
+  #include <atomic>
+#endif
+
+#if defined(NBA_PROFILER)
+  #include "profiler.hpp"
+#endif
 
 namespace nba::core {
 
-struct Scheduler {  
-  template<class T>
-  using EventMethod = void (T::*)(int);
+/* Every kind of event that can be scheduled.
+ * Each class is bound to exactly one object and method via Scheduler::Register(),
+ * which lets us dispatch events through a plain table instead of storing
+ * a type-erased callback per event.
+ */
+enum class EventClass : u16 {
+  EndOfQueue,
+
+  // PPU
+  PPU_scanline_complete,
+  PPU_hblank_complete,
+  PPU_vblank_scanline_complete,
+  PPU_vblank_hblank_complete,
+
+  // APU
+  APU_mixer,
+
+  // IRQ controller
+  IRQ_update_line,
 
+  // DMA
+  DMA_activated,
+
+  // Timers
+  TM_overflow,
+
+  // CPU
+  ARM_ldm_usermode_conflict,
+
+  // Keypad
+  KeyPad_movie_input,
+
+  // Serial port
+  SIO_transfer_done,
+  SIO_link_sync,
+
+  Count
+};
+
+struct Scheduler {
   struct Event {
-    std::function<void(int)> callback;
+    u64 timestamp;
+    u64 user_data;
+    EventClass event_class;
   private:
     friend class Scheduler;
     int handle;
-    u64 timestamp;
   };
 
   Scheduler() {
-    for (int i = 0; i < kMaxEvents; i++) {
-      heap[i] = new Event();
-      heap[i]->handle = i;
-    }
+    Register<&Scheduler::OnEndOfQueue>(EventClass::EndOfQueue, this);
     Reset();
   }
 
- ~Scheduler() {
+  void Reset() {
     for (int i = 0; i < kMaxEvents; i++) {
-      delete heap[i];
+      heap_event[i] = u8(i);
+      events[i].handle = i;
     }
-  }
-
-  void Reset() {
     heap_size = 0;
     timestamp_now = 0;
-    Add(std::numeric_limits<u64>::max(), [](int) {
-      Assert(false, "Scheduler: reached end of the event queue.");
-    });
+    Add(std::numeric_limits<u64>::max(), EventClass::EndOfQueue);
+
+#if defined(NBA_PROFILER)
+    profiler.Reset(timestamp_now);
+#endif
+  }
+
+  /* Bind an event class to a method of an object.
+   * The method may either accept (int cycles_late) or (int cycles_late, u64 user_data).
+   * Registrations persist across Reset().
+   */
+  template<auto method, class T>
+  void Register(EventClass event_class, T* object) {
+    auto& callback = callbacks[(int)event_class];
+
+    callback.object = object;
+    callback.invoke = [](void* object, int cycles_late, u64 user_data) {
+      if constexpr (std::is_invocable_v<decltype(method), T*, int, u64>) {
+        (((T*)object)->*method)(cycles_late, user_data);
+      } else {
+        (((T*)object)->*method)(cycles_late);
+      }
+    };
   }
 
   auto GetTimestampNow() const -> u64 {
@@ -54,7 +115,7 @@ struct Scheduler {
   }
 
   auto GetTimestampTarget() const -> u64 {
-    return heap[0]->timestamp;
+    return timestamp_target;
   }
 
   auto GetRemainingCycleCount() const -> int {
@@ -63,11 +124,13 @@ struct Scheduler {
 
   void AddCycles(int cycles) {
     auto timestamp_next = timestamp_now + cycles;
-    Step(timestamp_next);
+    if (unlikely(timestamp_next >= timestamp_target)) {
+      Step(timestamp_next);
+    }
     timestamp_now = timestamp_next;
   }
 
-  auto Add(u64 delay, std::function<void(int)> callback) -> Event* {
+  auto Add(u64 delay, EventClass event_class, u64 user_data = 0) -> Event* {
     int n = heap_size++;
     int p = Parent(n);
 
@@ -76,87 +139,292 @@ struct Scheduler {
       "Scheduler: reached maximum number of events."
     );
 
-    auto event = heap[n];
+    auto event = &events[heap_event[n]];
     event->timestamp = GetTimestampNow() + delay;
-    event->callback = callback;
+    event->user_data = user_data;
+    event->event_class = event_class;
+    heap_key[n] = event->timestamp;
 
-    while (n != 0 && heap[p]->timestamp > heap[n]->timestamp) {
+    while (n != 0 && heap_key[p] > heap_key[n]) {
       Swap(n, p);
       n = p;
       p = Parent(n);
     }
 
-    return event;
-  }
+    timestamp_target = heap_key[0];
+
+#if defined(NBA_PROFILER)
+    profiler.OnEventAdded(heap_size);
+#endif
 
-  template<class T>
-  auto Add(u64 delay, T* object, EventMethod<T> method) -> Event* {
-    return Add(delay, [object, method](int cycles_late) {
-      (object->*method)(cycles_late);
-    });
+    return event;
   }
 
   void Cancel(Event* event) {
     Remove(event->handle);
   }
 
+  // Returns the pending event of the given class and user data, or nullptr if there is none.
+  auto FindEvent(EventClass event_class, u64 user_data = 0) -> Event* {
+    for (int n = 0; n < heap_size; n++) {
+      auto event = &events[heap_event[n]];
+      if (event->event_class == event_class && event->user_data == user_data) {
+        return event;
+      }
+    }
+    return nullptr;
+  }
+
+  // Checks the fields that LoadState() relies on, so that a bad state is rejected before anything is changed.
+  bool ValidateState(SaveState const& state) const {
+    // One slot is taken by the end of the queue.
+    if (state.scheduler.event_count >= kMaxEvents) {
+      return false;
+    }
+
+    for (int i = 0; i < state.scheduler.event_count; i++) {
+      auto event_class = state.scheduler.events[i].event_class;
+
+      if (event_class == (u16)EventClass::EndOfQueue ||
+          event_class >= (u16)EventClass::Count ||
+          callbacks[event_class].invoke == nullptr) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  void LoadState(SaveState const& state) {
+    heap_size = 0;
+    timestamp_now = state.timestamp;
+    Add(std::numeric_limits<u64>::max() - timestamp_now, EventClass::EndOfQueue);
+
+    for (int i = 0; i < state.scheduler.event_count; i++) {
+      auto& event = state.scheduler.events[i];
+      Add(event.delay, (EventClass)event.event_class, event.user_data);
+    }
+
+#if defined(NBA_PROFILER)
+    profiler.Reset(timestamp_now);
+#endif
+  }
+
+  void CopyState(SaveState& state) {
+    int count = 0;
+
+    state.timestamp = timestamp_now;
+
+    // The end of the queue is re-added by Reset() and is not part of the state.
+    for (int n = 0; n < heap_size; n++) {
+      auto& event = events[heap_event[n]];
+
+      if (event.event_class != EventClass::EndOfQueue) {
+        // Stored field by field, so that the padding is left alone (see Core::GetStateHash()).
+        auto& entry = state.scheduler.events[count++];
+
+        entry.delay = event.timestamp - timestamp_now;
+        entry.user_data = event.user_data;
+        entry.event_class = (u16)event.event_class;
+      }
+    }
+
+    state.scheduler.event_count = u8(count);
+  }
+
+#if defined(NBA_PROFILER)
+  auto GetProfiler() -> Profiler& {
+    return profiler;
+  }
+#endif
+
+#if defined(NBA_HOTSPOT_SAMPLER)
+  /* Bind the method that samples the guest program counter.
+   * It is called after every interval-th event (see SetSampleInterval()), before the event is dispatched.
+   */
+  template<auto method, class T>
+  void RegisterSampler(T* object) {
+    sampler.object = object;
+    sampler.invoke = [](void* object) {
+      (((T*)object)->*method)();
+    };
+  }
+
+  // An interval of zero stops sampling. May be called from any thread.
+  void SetSampleInterval(int interval) {
+    sampler.interval.store(interval, std::memory_order_relaxed);
+  }
+#endif
+
 private:
-  static constexpr int kMaxEvents = 64;
+  static constexpr int kMaxEvents = SaveState::Scheduler::kMaxEvents;
+
+  struct Callback {
+    void* object = nullptr;
+    void (*invoke)(void* object, int cycles_late, u64 user_data) = nullptr;
+  };
 
   constexpr int Parent(int n) { return (n - 1) / 2; }
   constexpr int LeftChild(int n) { return n * 2 + 1; }
   constexpr int RightChild(int n) { return n * 2 + 2; }
 
   void Step(u64 timestamp_next) {
-    while (heap[0]->timestamp <= timestamp_next && heap_size > 0) {
-      auto event = heap[0];
+    while (heap_key[0] <= timestamp_next && heap_size > 0) {
+      auto event = &events[heap_event[0]];
+      auto& callback = callbacks[(int)event->event_class];
+      auto user_data = event->user_data;
+
       timestamp_now = event->timestamp;
-      event->callback(0);
+
+#if defined(NBA_HOTSPOT_SAMPLER)
+      if (unlikely(--sampler.countdown <= 0)) {
+        Sample();
+      }
+#endif
+
+      // The event must leave the heap before its callback runs,
+      // since the callback is free to reuse the slot for a new event.
       Remove(event->handle);
+
+#if defined(NBA_PROFILER)
+      profiler.OnEvent((int)event->event_class, timestamp_next - timestamp_now);
+      profiler.Enter(GetProfileSection(event->event_class), timestamp_now);
+      callback.invoke(callback.object, 0, user_data);
+      profiler.Leave(timestamp_now);
+#else
+      callback.invoke(callback.object, 0, user_data);
+#endif
     }
   }
 
+#if defined(NBA_PROFILER)
+  static_assert((int)EventClass::Count == ProfileStats::kEventClassCount);
+
+  static constexpr auto GetProfileSection(EventClass event_class) -> ProfileStats::Section {
+    switch (event_class) {
+      case EventClass::PPU_scanline_complete:
+      case EventClass::PPU_hblank_complete:
+      case EventClass::PPU_vblank_scanline_complete:
+      case EventClass::PPU_vblank_hblank_complete: return ProfileStats::Section::PPU;
+      case EventClass::APU_mixer: return ProfileStats::Section::APU;
+      case EventClass::IRQ_update_line: return ProfileStats::Section::IRQ;
+      case EventClass::DMA_activated: return ProfileStats::Section::DMA;
+      case EventClass::TM_overflow: return ProfileStats::Section::Timer;
+      default: return ProfileStats::Section::Other;
+    }
+  }
+#endif
+
+#if defined(NBA_HOTSPOT_SAMPLER)
+  void Sample() {
+    // While sampling is stopped, only check every so often if it has been started.
+    static constexpr int kPollInterval = 4096;
+
+    auto interval = sampler.interval.load(std::memory_order_relaxed);
+
+    if (interval > 0 && sampler.invoke != nullptr) {
+      sampler.invoke(sampler.object);
+      sampler.countdown = interval;
+    } else {
+      sampler.countdown = kPollInterval;
+    }
+  }
+#endif
+
   void Remove(int n) {
     Swap(n, --heap_size);
 
     int p = Parent(n);
-    if (n != 0 && heap[p]->timestamp > heap[n]->timestamp) {
+    if (n != 0 && heap_key[p] > heap_key[n]) {
       do {
         Swap(n, p);
         n = p;
         p = Parent(n);
-      } while (n != 0 && heap[p]->timestamp > heap[n]->timestamp);
+      } while (n != 0 && heap_key[p] > heap_key[n]);
     } else {
       Heapify(n);
     }
+
+    timestamp_target = heap_key[0];
   }
 
   void Swap(int i, int j) {
-    auto tmp = heap[i];
-    heap[i] = heap[j];
-    heap[j] = tmp;
-    heap[i]->handle = i;
-    heap[j]->handle = j;
+    auto key = heap_key[i];
+    auto slot = heap_event[i];
+
+    heap_key[i] = heap_key[j];
+    heap_key[j] = key;
+    heap_event[i] = heap_event[j];
+    heap_event[j] = slot;
+    events[heap_event[i]].handle = i;
+    events[heap_event[j]].handle = j;
   }
 
   void Heapify(int n) {
-    int l = LeftChild(n);
-    int r = RightChild(n);
+    while (true) {
+      int l = LeftChild(n);
+      int r = RightChild(n);
+      int min = n;
 
-    if (l < heap_size && heap[l]->timestamp < heap[n]->timestamp) {
-      Swap(l, n);
-      Heapify(l);
-    }
+      if (l < heap_size && heap_key[l] < heap_key[min]) min = l;
+      if (r < heap_size && heap_key[r] < heap_key[min]) min = r;
+      if (min == n) break;
 
-    if (r < heap_size && heap[r]->timestamp < heap[n]->timestamp) {
-      Swap(r, n);
-      Heapify(r);
+      Swap(n, min);
+      n = min;
     }
   }
 
-  Event* heap[kMaxEvents];
+  void OnEndOfQueue(int cycles_late) {
+    Assert(false, "Scheduler: reached end of the event queue.");
+  }
+
+  /* The heap only holds the timestamps (keys) and the index of each event in the event pool.
+   * Keeping the keys densely packed means that sift operations rarely touch more than a few cache lines.
+   * The pool itself is never reordered, so Event pointers handed out by Add() remain stable.
+   */
+  u64 heap_key[kMaxEvents];
+  u8  heap_event[kMaxEvents];
+  Event events[kMaxEvents];
   int heap_size;
   u64 timestamp_now;
+  u64 timestamp_target;
+  Callback callbacks[(int)EventClass::Count];
+
+#if defined(NBA_PROFILER)
+  Profiler profiler;
+#endif
+
+#if defined(NBA_HOTSPOT_SAMPLER)
+  struct Sampler {
+    void* object = nullptr;
+    void (*invoke)(void* object) = nullptr;
+    std::atomic<int> interval{0};
+    int countdown = 0;
+  } sampler;
+#endif
 };
 
+/* Attributes everything until the end of the enclosing block to a profiler section.
+ * Compiles to nothing unless NBA_PROFILER is defined.
+ */
+#if defined(NBA_PROFILER)
+  struct ProfileScope {
+    ProfileScope(Scheduler& scheduler, ProfileStats::Section section) : scheduler(scheduler) {
+      scheduler.GetProfiler().Enter(section, scheduler.GetTimestampNow());
+    }
+
+   ~ProfileScope() {
+      scheduler.GetProfiler().Leave(scheduler.GetTimestampNow());
+    }
+
+    Scheduler& scheduler;
+  };
+
+  #define NBA_PROFILE_SCOPE(scheduler, section) \
+    nba::core::ProfileScope profile_scope{scheduler, nba::ProfileStats::Section::section}
+#else
+  #define NBA_PROFILE_SCOPE(scheduler, section)
+#endif
+
 } // namespace nba::core
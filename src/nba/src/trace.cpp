@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#if defined(NBA_TRACE)
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <iterator>
+#include <mutex>
+#include <nba/trace.hpp>
+#include <string>
+
+namespace nba::trace {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/* Events are written as a JSON array, one object per line.
+ * The viewers accept an array without the closing bracket,
+ * so a trace of a process that crashed can still be opened.
+ */
+struct TraceFile {
+  TraceFile() : origin(Clock::now()) {
+    auto path = std::getenv("NBA_TRACE_FILE");
+
+    file = std::fopen(path ? path : "nba_trace.json", "wb");
+    if (file) {
+      std::fputs("[\n", file);
+    }
+  }
+
+ ~TraceFile() {
+    if (file) {
+      std::fputs("{}]\n", file);
+      std::fclose(file);
+    }
+  }
+
+  void Write(std::string const& data) {
+    std::lock_guard lock{mutex};
+
+    if (file) {
+      std::fwrite(data.data(), 1, data.size(), file);
+    }
+  }
+
+  Clock::time_point origin;
+  std::FILE* file;
+  std::mutex mutex;
+  std::atomic_int next_thread_id = 1;
+};
+
+auto GetTraceFile() -> TraceFile& {
+  static TraceFile trace_file;
+  return trace_file;
+}
+
+// Zones are collected per thread and written in chunks, so that threads rarely contend for the file.
+struct ThreadBuffer {
+  static constexpr size_t kFlushThreshold = 64 * 1024;
+
+  ThreadBuffer() : thread_id(GetTraceFile().next_thread_id++) {
+    data.reserve(kFlushThreshold + 256);
+  }
+
+ ~ThreadBuffer() {
+    Flush();
+  }
+
+  void Flush() {
+    GetTraceFile().Write(data);
+    data.clear();
+  }
+
+  int thread_id;
+  std::string data;
+};
+
+thread_local ThreadBuffer thread_buffer;
+
+} // namespace
+
+auto Now() -> u64 {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - GetTraceFile().origin).count();
+}
+
+void WriteZone(char const* name, u64 begin, u64 end) {
+  fmt::format_to(
+    std::back_inserter(thread_buffer.data),
+    "{{\"name\":\"{}\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":1,\"tid\":{}}},\n",
+    name, begin / 1000.0, (end - begin) / 1000.0, thread_buffer.thread_id
+  );
+
+  if (thread_buffer.data.size() >= ThreadBuffer::kFlushThreshold) {
+    thread_buffer.Flush();
+  }
+}
+
+void SetThreadName(char const* name) {
+  fmt::format_to(
+    std::back_inserter(thread_buffer.data),
+    "{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}},\n",
+    thread_buffer.thread_id, name
+  );
+}
+
+} // namespace nba::trace
+
+#endif
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <nba/vector_env.hpp>
+
+namespace nba {
+
+using Observation = VectorEnv::Observation;
+
+// Holds the action of the current step, the keypad picks it up once per RunSlice().
+struct ActionInputDevice final : InputDevice {
+  auto Poll(Key key) -> bool override {
+    // Bit of each key (in the order of InputDevice::Key) in KEYINPUT.
+    static constexpr int kKeyBit[kKeyCount] { 6, 7, 5, 4, 3, 2, 0, 1, 9, 8 };
+
+    return keys & (1 << kKeyBit[(int)key]);
+  }
+
+  void SetOnChangeCallback(std::function<void(void)> callback) override {
+    this->callback = callback;
+  }
+
+  void SetKeys(u16 keys) {
+    if (keys != this->keys) {
+      this->keys = keys;
+      if (callback) {
+        callback();
+      }
+    }
+  }
+
+private:
+  u16 keys = 0;
+  std::function<void(void)> callback;
+};
+
+// Writes frames to the observation of the current step.
+struct ObservationVideoDevice final : VideoDevice {
+  ObservationVideoDevice(Observation observation) : observation(observation) {}
+
+  auto GetPixelFormat() -> PixelFormat override {
+    return observation == Observation::ARGB8888 ? PixelFormat::ARGB8888 : PixelFormat::BGR555;
+  }
+
+  auto AcquireFrame() -> void* override {
+    return observation == Observation::ARGB8888 ? target : nullptr;
+  }
+
+  void Draw(u32* buffer) override {
+    // The first frame after a reset, or with skip_unchanged_lines, is not rendered into the observation.
+    if (target != nullptr && (void*)buffer != target) {
+      std::memcpy(target, buffer, sizeof(u32) * kFrameWidth * kFrameHeight);
+    }
+  }
+
+  void Draw(u16* buffer) override {
+    static auto const gray = CreateGrayTable();
+
+    auto dst = (u8*)target;
+
+    if (dst == nullptr) {
+      return;
+    }
+
+    if (observation == Observation::Gray8) {
+      for (int i = 0; i < kFrameWidth * kFrameHeight; i++) {
+        dst[i] = gray[buffer[i] & 0x7FFF];
+      }
+    } else {
+      for (int y = 0; y < kFrameHeight; y += 2) {
+        u16 const* row0 = &buffer[y * kFrameWidth];
+        u16 const* row1 = row0 + kFrameWidth;
+
+        for (int x = 0; x < kFrameWidth; x += 2) {
+          int sum = gray[row0[x] & 0x7FFF] + gray[row0[x + 1] & 0x7FFF] +
+                    gray[row1[x] & 0x7FFF] + gray[row1[x + 1] & 0x7FFF];
+
+          *dst++ = (u8)((sum + 2) >> 2);
+        }
+      }
+    }
+  }
+
+  Observation observation;
+  void* target = nullptr;
+
+private:
+  // Luma (BT.601) of each BGR555 color.
+  static auto CreateGrayTable() -> std::array<u8, 32768> {
+    std::array<u8, 32768> table;
+
+    for (int color = 0; color < 32768; color++) {
+      int r = (color >>  0) & 31;
+      int g = (color >>  5) & 31;
+      int b = (color >> 10) & 31;
+
+      table[color] = (u8)(((r * 77 + g * 150 + b * 29) * 255 + 31 * 128) / (31 * 256));
+    }
+
+    return table;
+  }
+};
+
+struct VectorEnv::Env {
+  std::unique_ptr<CoreBase> core;
+  std::shared_ptr<ActionInputDevice> input_dev;
+  std::shared_ptr<ObservationVideoDevice> video_dev;
+};
+
+VectorEnv::VectorEnv(int env_count, Observation observation, CoreFactory const& factory, int thread_count)
+    : observation(observation) {
+  for (int i = 0; i < env_count; i++) {
+    auto env = std::make_unique<Env>();
+    auto config = std::make_shared<Config>();
+
+    env->input_dev = std::make_shared<ActionInputDevice>();
+    env->video_dev = std::make_shared<ObservationVideoDevice>(observation);
+    config->input_dev = env->input_dev;
+    config->video_dev = env->video_dev;
+
+    env->core = factory(config);
+    env->core->SetAudioOutputEnabled(false);
+    envs.push_back(std::move(env));
+  }
+
+  if (thread_count <= 0) {
+    thread_count = std::max(int(std::thread::hardware_concurrency()), 1);
+  }
+
+  // The thread that calls Step() works on the environments as well.
+  thread_count = std::clamp(thread_count, 1, std::max(env_count, 1));
+
+  for (int i = 1; i < thread_count; i++) {
+    threads.emplace_back(&VectorEnv::RunWorker, this);
+  }
+}
+
+VectorEnv::~VectorEnv() {
+  {
+    std::lock_guard guard{mutex};
+    quit = true;
+  }
+  step_started.notify_all();
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+auto VectorEnv::GetEnvCount() const -> int {
+  return int(envs.size());
+}
+
+auto VectorEnv::GetThreadCount() const -> int {
+  return int(threads.size() + 1);
+}
+
+auto VectorEnv::GetCore(int env) -> CoreBase& {
+  return *envs.at(env)->core;
+}
+
+auto VectorEnv::GetObservationWidth() const -> int {
+  return observation == Observation::Gray8Half ? VideoDevice::kFrameWidth / 2 : VideoDevice::kFrameWidth;
+}
+
+auto VectorEnv::GetObservationHeight() const -> int {
+  return observation == Observation::Gray8Half ? VideoDevice::kFrameHeight / 2 : VideoDevice::kFrameHeight;
+}
+
+auto VectorEnv::GetObservationSize() const -> size_t {
+  size_t pixel_size = observation == Observation::ARGB8888 ? sizeof(u32) : sizeof(u8);
+
+  return GetObservationWidth() * GetObservationHeight() * pixel_size;
+}
+
+void VectorEnv::Step(u16 const* actions, void* observations, int frames) {
+  this->actions = actions;
+  this->observations = (u8*)observations;
+  this->frames = std::max(frames, 1);
+  next_env = 0;
+
+  {
+    std::lock_guard guard{mutex};
+    workers_busy = int(threads.size());
+    step++;
+  }
+  step_started.notify_all();
+
+  RunEnvs();
+
+  std::unique_lock lock{mutex};
+  step_done.wait(lock, [this] { return workers_busy == 0; });
+}
+
+void VectorEnv::RunWorker() {
+  u64 last_step = 0;
+
+  while (true) {
+    {
+      std::unique_lock lock{mutex};
+      step_started.wait(lock, [&] { return quit || step != last_step; });
+      if (quit) {
+        return;
+      }
+      last_step = step;
+    }
+
+    RunEnvs();
+
+    std::lock_guard guard{mutex};
+    if (--workers_busy == 0) {
+      step_done.notify_one();
+    }
+  }
+}
+
+void VectorEnv::RunEnvs() {
+  int env_count = GetEnvCount();
+  int env;
+
+  while ((env = next_env++) < env_count) {
+    StepEnv(env);
+  }
+}
+
+void VectorEnv::StepEnv(int env_id) {
+  auto& env = *envs[env_id];
+  auto& core = *env.core;
+
+  CoreBase::RunLimits limits;
+  limits.max_cycles = CoreBase::kCyclesPerFrame * 2;
+  limits.stop_at_frame_end = true;
+
+  env.input_dev->SetKeys(actions[env_id]);
+  env.video_dev->target = observations + env_id * GetObservationSize();
+
+  /* Each call runs up to the start of the next V-blank, where the frame was just handed to the video device.
+   * Only the last frame is wanted, the ones before are not passed to the video device at all.
+   */
+  for (int frame = 0; frame < frames; frame++) {
+    core.SetVideoOutputEnabled(frame == frames - 1);
+    core.RunSlice(limits);
+  }
+
+  env.video_dev->target = nullptr;
+}
+
+} // namespace nba
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <nba/common/dsp/spsc_ring_buffer.hpp>
+#include <nba/device/audio_sink.hpp>
+#include <string>
+#include <thread>
+
+namespace nba {
+
+/* Audio sink that writes the streams it is created for to 32-bit float WAV files:
+ * <path>.wav for the mix and <path>.psg.wav, <path>.fifo_a.wav and <path>.fifo_b.wav for the channels.
+ * Blocks are copied into a queue, which a background thread writes out, so the emulation thread
+ * never waits for the disk. If the queue is full, blocks are dropped and counted.
+ * Install it as Config::audio_sink before the core is reset.
+ */
+struct AudioRecorder final : AudioSink {
+  AudioRecorder(std::string const& path, int streams = Mix);
+ ~AudioRecorder();
+
+  bool IsOpen() const;
+  auto GetDroppedBlocks() const -> u32 { return dropped_blocks; }
+
+  auto GetStreams() -> int override { return streams; }
+  void Write(Stream stream, int sample_rate, StereoSample<float> const* samples, int count) override;
+
+private:
+  static constexpr int kStreamCount = 4;
+  static constexpr int kBlockSize = 512;
+  static constexpr int kQueueSize = 256;
+
+  struct Block {
+    int stream;
+    int sample_rate;
+    int count;
+    StereoSample<float> samples[kBlockSize];
+  };
+
+  struct File {
+    std::FILE* file = nullptr;
+    int sample_rate = 0;
+    u32 data_bytes = 0;
+  };
+
+  void Run();
+  void WriteBlock(Block const& block);
+  void WriteHeader(File& file);
+
+  int streams;
+  File files[kStreamCount];
+  SPSCRingBuffer<Block> queue{kQueueSize};
+  std::atomic<u32> dropped_blocks{0};
+
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool quit = false;
+};
+
+} // namespace nba
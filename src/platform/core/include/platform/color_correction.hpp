@@ -0,0 +1,26 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <memory>
+#include <nba/config.hpp>
+
+namespace nba {
+
+enum class ColorCorrection {
+  higan,
+  AGB
+};
+
+/* Bakes the color correction of the color_higan and color_agb shaders into
+ * a lookup table for the core, for frontends that do not present through OpenGL,
+ * such as headless video capture.
+ */
+auto CreateColorLUT(ColorCorrection type) -> std::shared_ptr<ColorLUT const>;
+
+} // namespace nba
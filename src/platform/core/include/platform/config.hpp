@@ -8,6 +8,7 @@
 #pragma once
 
 #include <nba/config.hpp>
+#include <platform/thread_policy.hpp>
 #include <string>
 #include <toml.hpp>
 
@@ -22,6 +23,25 @@ struct PlatformConfig : Config {
   
   bool force_rtc = false;
 
+  // Number of frames to emulate ahead of the displayed frame, to hide input lag.
+  int run_ahead = 0;
+
+  /* Start emulating each frame this many milliseconds late, to cut input lag (see FrameLimiter::SetFrameDelay()).
+   * Best combined with late_input_latching.
+   */
+  int frame_delay = 0;
+
+  // Sleep while the game can only be woken by input, instead of emulating identical frames (see EmulatorThread::SetPowerSaving()).
+  bool power_saving = false;
+
+  // Save the state of the game on exit and continue from there the next time it is opened (see ResumeState).
+  bool resume = false;
+
+  /* Measure the time from key presses to the frames that show the response (see LatencyProbe),
+   * and log the distributions on exit. Needs a test ROM that flashes the screen on every press.
+   */
+  bool measure_latency = false;
+
   struct Video {
     bool fullscreen = false;
     int scale = 2;
@@ -40,12 +60,65 @@ struct PlatformConfig : Config {
 
     bool lcd_ghosting = true;
 
+    // Keep compiled shader programs on disk, so that they do not have to be rebuilt on the next start.
+    bool shader_cache = true;
+
+    /* Run as many cycles per display refresh as the refresh interval covers and present the latest frame,
+     * instead of running whole frames. Avoids judder on displays that do not refresh at ~59.73 Hz.
+     */
+    bool lock_to_vsync = false;
+
+    /* Render frames on the GPU from the PPU state of each line, instead of in the emulator.
+     * Only supported by the OpenGL video device. Writes to VRAM and OAM during the visible lines are delayed by a frame.
+     */
+    bool gpu_renderer = false;
+
+    /* Render affine BGs and OBJs (e.g. Mode 7 style racing games) at this multiple of the native resolution, from 1 to 4.
+     * All other layers are scaled up. The xBRZ filter still works on the native resolution.
+     */
+    int affine_scale = 1;
+
+    /* Draw graphs of the recent frame times, emulation times and the audio buffer level over the screen (see FrameStats).
+     * Only supported by the OpenGL video device.
+     */
+    bool frame_stats_overlay = false;
+
     struct Shader {
       std::string path_vs = "";
       std::string path_fs = "";
     } shader;
   } video;
 
+  // The device that plays the audio, see CreateAudioDevice().
+  struct AudioOutput {
+    /* SDL, or the native API of the host: ALSA on Linux (which reaches PipeWire and PulseAudio through their ALSA plugins),
+     * WASAPI on Windows and Core Audio on macOS. The native backends allow much smaller periods, which cuts the latency.
+     * WASAPI and Core Audio are only built with PLATFORM_AUDIO_WASAPI and PLATFORM_AUDIO_COREAUDIO, otherwise SDL is used.
+     */
+    enum class Backend {
+      SDL,
+      Native
+    } backend = Backend::SDL;
+
+    std::string device = "";    // the ALSA device, empty for the default one
+    int sample_rate = 48000;
+    int block_size = 0;         // sample frames per period, zero for the default of the backend (2048 for SDL, 256 otherwise)
+    bool exclusive = false;     // take exclusive control of the device with WASAPI, which skips the mixer of the system
+  } audio_output;
+
+  struct Rewind {
+    bool enable = false;
+    int interval = 2; // in frames
+    int memory_budget = 64; // in MiB
+  } rewind;
+
+  // Scheduling of the emulator thread, the audio callback and the threads that the core spawns (see ThreadPolicy).
+  struct Threads {
+    ThreadPolicy emulation;
+    ThreadPolicy audio;
+    ThreadPolicy workers;
+  } threads;
+
   void Load(std::string const& path);
   void Save(std::string const& path);
 
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <nba/device/audio_device.hpp>
+#include <platform/thread_policy.hpp>
+#include <string>
+#include <thread>
+
+typedef struct _snd_pcm snd_pcm_t;
+
+namespace nba {
+
+/* Plays through ALSA with small periods, from a thread of its own that writes a period whenever the device has room for one.
+ * PipeWire and PulseAudio are reached through their ALSA plugins (the "default" device on most desktops),
+ * while a hardware device (i.e. "hw:0") bypasses the sound server and its buffering.
+ */
+struct ALSA_AudioDevice : AudioDevice {
+ ~ALSA_AudioDevice() override;
+
+  void SetDeviceName(std::string const& name);
+  void SetSampleRate(int sample_rate);
+  void SetBlockSize(int block_size); // the period to ask for, which the device may round
+  void SetThreadPolicy(ThreadPolicy const& policy);
+
+  auto GetSampleRate() -> int final;
+  auto GetBlockSize() -> int final;
+  auto GetLatency() -> int final;
+  bool Open(void* userdata, Callback callback) final;
+  void SetPause(bool value) final;
+  void Close() final;
+
+private:
+  // The device buffer holds this many periods, one being played while the next one is written.
+  static constexpr int kPeriodCount = 2;
+
+  void ThreadMain();
+
+  Callback callback;
+  void* callback_userdata;
+  snd_pcm_t* pcm = nullptr;
+  std::string device_name = "default";
+  int want_sample_rate = 48000;
+  int want_block_size = 256;
+  int sample_rate = 0;
+  int block_size = 0;
+  int buffer_size = 0;
+  std::atomic<int> latency{0}; // the delay that ALSA reported after the last write
+  std::thread thread;
+  std::atomic_bool running{false};
+  std::atomic_bool paused{false};
+  ThreadPolicy thread_policy;
+};
+
+} // namespace nba
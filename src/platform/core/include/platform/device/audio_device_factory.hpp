@@ -0,0 +1,21 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <memory>
+#include <nba/device/audio_device.hpp>
+#include <platform/config.hpp>
+
+namespace nba {
+
+/* Creates the audio device that PlatformConfig::audio_output asks for, set up with the audio thread policy.
+ * Falls back to SDL if the platform has no native backend or it was not built in.
+ */
+auto CreateAudioDevice(PlatformConfig const& config) -> std::shared_ptr<AudioDevice>;
+
+} // namespace nba
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <AudioUnit/AudioUnit.h>
+#include <nba/device/audio_device.hpp>
+#include <platform/thread_policy.hpp>
+
+namespace nba {
+
+/* Plays through the default output unit of Core Audio, with the I/O buffer of the device shrunk to the requested period.
+ * The unit converts the samples to the format and sample rate of the device.
+ */
+struct CoreAudio_AudioDevice : AudioDevice {
+ ~CoreAudio_AudioDevice() override;
+
+  void SetSampleRate(int sample_rate);
+  void SetBlockSize(int block_size); // the I/O buffer size to ask for, which the device clamps to its range
+  void SetThreadPolicy(ThreadPolicy const& policy);
+
+  auto GetSampleRate() -> int final;
+  auto GetBlockSize() -> int final;
+  auto GetLatency() -> int final;
+  bool Open(void* userdata, Callback callback) final;
+  void SetPause(bool value) final;
+  void Close() final;
+
+private:
+  static auto RenderCallback(
+    void* userdata,
+    AudioUnitRenderActionFlags* flags,
+    AudioTimeStamp const* timestamp,
+    UInt32 bus,
+    UInt32 frames,
+    AudioBufferList* data
+  ) -> OSStatus;
+
+  void SetupDevice();
+
+  Callback callback;
+  void* callback_userdata;
+  AudioUnit unit = nullptr;
+  int want_sample_rate = 48000;
+  int want_block_size = 256;
+  int sample_rate = 0;
+  int block_size = 0;
+  int latency = 0;
+  bool paused = false;
+  ThreadPolicy thread_policy;
+  bool thread_policy_applied = false;
+};
+
+} // namespace nba
@@ -10,7 +10,9 @@
 #include <nba/device/video_device.hpp>
 #include <GL/glew.h>
 #include <platform/config.hpp>
+#include <platform/frame_stats.hpp>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -23,12 +25,59 @@ struct OGLVideoDevice : VideoDevice {
   void Initialize();
   void SetViewport(int x, int y, int width, int height);
   void SetDefaultFBO(GLuint fbo);
+  void SetDirtyLines(std::bitset<VideoDevice::kFrameHeight> const& lines) override;
   void Draw(u32* buffer) override;
+  void Draw(PPUFrame const& frame) override;
   void ReloadConfig();
 
+  // Sets the scale of the frames that are passed to Draw() (see VideoDevice::GetFrameScale()), GPU rendered frames use it as well.
+  void SetFrameScale(int scale);
+
+  // Whether captured frames can be rendered on the GPU, i.e. passed to Draw(PPUFrame const&). Valid after Initialize().
+  bool HasPPURenderer() const {
+    return ppu_program != 0;
+  }
+
+  // Returns the GPU time spent on uploading and post-processing a frame in milliseconds (averaged).
+  auto GetGPUFrameTime() const -> float;
+
+  // Optional, the statistics that the overlay shows (see PlatformConfig::Video::frame_stats_overlay).
+  void SetFrameStats(std::shared_ptr<FrameStats> frame_stats);
+
 private:
+  static constexpr int kFrameWidth = 240;
+  static constexpr int kFrameHeight = 160;
+  static constexpr int kPixelBufferCount = 3;
+  static constexpr auto kProgramCachePath = "shader_cache";
+  static constexpr int kTimerQueryCount = 3;
+
+  // Highlight the audio bar for this long after an underrun.
+  static constexpr auto kOverlayUnderrunTime = std::chrono::seconds{1};
+
+  // Pixel unpack buffer that a frame is staged in for upload to the LCD screen texture.
+  struct PixelBuffer {
+    GLuint buffer = 0;
+    void* mapping = nullptr; // only for persistently mapped buffers
+    GLsync fence = nullptr;  // signalled once the GPU is done reading the buffer
+  };
+
+  auto GetFrameSize() const -> size_t {
+    return kFrameWidth * kFrameHeight * frame_scale * frame_scale * sizeof(u32);
+  }
+
+  void CreatePixelBuffers();
+  void ReleasePixelBuffers();
+  void UploadFrame(u32 const* buffer, int line_min, int line_max);
+  void CreatePPURenderer();
+  void ReleasePPURenderer();
+  void RenderPPUFrame(PPUFrame const& frame);
+  void BeginTimerQuery();
+  void PostProcess();
+  void DrawOverlay();
+  void UpdateOutputSizeUniforms();
   void CreateShaderPrograms();
   void ReleaseShaderPrograms();
+  void ReleaseProgramCache();
 
   auto CompileShader(
     GLenum type,
@@ -40,6 +89,11 @@ private:
     char const* fragment_src
   ) -> std::pair<bool, GLuint>;
 
+  auto GetProgramKey(char const* vertex_src, char const* fragment_src) -> u64;
+  auto GetProgramBinaryPath(u64 key) -> std::string;
+  auto LoadProgramBinary(u64 key) -> GLuint;
+  void SaveProgramBinary(u64 key, GLuint program);
+
   int view_x = 0;
   int view_y = 0;
   int view_width  = 1;
@@ -50,7 +104,67 @@ private:
   GLuint quad_vbo;
   GLuint fbo;
   GLuint texture[4];
+  int frame_scale = 1;
+
+  /* Only the lines of a frame that changed (see SetDirtyLines()) are uploaded to the LCD screen texture,
+   * as long as it still holds the previous frame, i.e. it was not reallocated or rendered to by the GPU renderer.
+   */
+  std::bitset<kFrameHeight> dirty_lines;
+  bool screen_texture_valid = false;
+
+  // The first xBRZ pass produces one texel of blend info per source pixel, so it is rendered at source resolution.
+  bool xbrz_enabled = false;
+  GLuint xbrz_info_texture;
+
+  // Timer queries are read back a few frames later, so that reading them never stalls.
+  GLuint timer_queries[kTimerQueryCount];
+  bool timer_query_pending[kTimerQueryCount] {};
+  int timer_query_index = 0;
+  float gpu_frame_time = 0;
+
+  /* GPU renderer: draws captured frames into the LCD screen texture, which is then post-processed as usual.
+   * Memory and registers are passed in integer textures, the registers as one row of words per line.
+   */
+  static constexpr int kPPULineWords = 38;
+
+  enum PPUTexture {
+    kPPUTextureVRAM,
+    kPPUTexturePRAM,
+    kPPUTextureOAM,
+    kPPUTextureLines,
+    kPPUTextureCount
+  };
+
+  GLuint ppu_program = 0;
+  GLuint ppu_textures[kPPUTextureCount] {};
+  s32 ppu_lines[kFrameHeight][kPPULineWords];
+
+  // Frame stats overlay, created when it is first drawn.
+  std::shared_ptr<FrameStats> frame_stats;
+  bool overlay_enabled = false;
+  std::unique_ptr<FrameStats::Snapshot> overlay_snapshot;
+  GLuint overlay_program = 0;
+  GLuint overlay_texture = 0;
+  float overlay_history[2][FrameStats::kHistoryLength];
+  u64 overlay_underruns = 0;
+  FrameStats::Clock::time_point overlay_underrun_time;
+
+  PixelBuffer pixel_buffers[kPixelBufferCount];
+  int pixel_buffer_index = 0;
+  bool pixel_buffers_persistent = false;
   std::vector<GLuint> programs;
+
+  /* Linked programs by the hash of their sources, these are never released before the device.
+   * On drivers that support it, program binaries are also kept on disk across runs.
+   */
+  std::unordered_map<u64, GLuint> program_cache;
+  bool program_binary_supported = false;
+
+  // The video settings that the current programs were created for.
+  bool programs_valid = false;
+  PlatformConfig::Video::Filter programs_filter;
+  PlatformConfig::Video::Color programs_color;
+  bool programs_lcd_ghosting;
   GLenum texture_filter = GL_NEAREST;
   bool texture_filter_invalid = false;
 
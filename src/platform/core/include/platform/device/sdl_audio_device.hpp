@@ -9,6 +9,7 @@
 
 #include <nba/log.hpp>
 #include <nba/device/audio_device.hpp>
+#include <platform/thread_policy.hpp>
 #include <SDL.h>
 
 namespace nba {
@@ -19,6 +20,9 @@ struct SDL2_AudioDevice : AudioDevice {
   void SetPassthrough(SDL_AudioCallback passthrough);
   void InvokeCallback(s16* stream, int byte_len);
 
+  // Applied to SDL's audio thread on the first callback after opening the device.
+  void SetThreadPolicy(ThreadPolicy const& policy);
+
   auto GetSampleRate() -> int final;
   auto GetBlockSize() -> int final;
   bool Open(void* userdata, Callback callback) final;
@@ -26,6 +30,8 @@ struct SDL2_AudioDevice : AudioDevice {
   void Close() final;
 
 private:
+  static void SDLCALL AudioCallback(void* userdata, Uint8* stream, int byte_len);
+
   Callback callback;
   void* callback_userdata;
   SDL_AudioCallback passthrough = nullptr;
@@ -35,6 +41,8 @@ private:
   int want_block_size = 2048;
   bool opened = false;
   bool paused = false;
+  ThreadPolicy thread_policy;
+  bool thread_policy_applied = false;
 };
 
 } // namespace nba
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <nba/device/audio_device.hpp>
+#include <platform/thread_policy.hpp>
+#include <thread>
+
+struct IAudioClient;
+struct IAudioRenderClient;
+
+namespace nba {
+
+/* Plays through WASAPI, event-driven from a thread of its own, which also owns every COM object of the stream.
+ * In exclusive mode the samples go straight to the device at its smallest period, skipping the mixer of the shared mode.
+ * If the device does not accept exclusive mode or the format, the shared mode is used instead.
+ */
+struct WASAPI_AudioDevice : AudioDevice {
+ ~WASAPI_AudioDevice() override;
+
+  void SetSampleRate(int sample_rate);
+  void SetBlockSize(int block_size); // the period to ask for in exclusive mode, which is raised to the minimum of the device
+  void SetExclusive(bool exclusive);
+  void SetThreadPolicy(ThreadPolicy const& policy);
+
+  auto GetSampleRate() -> int final;
+  auto GetBlockSize() -> int final;
+  auto GetLatency() -> int final;
+  bool Open(void* userdata, Callback callback) final;
+  void SetPause(bool value) final;
+  void Close() final;
+
+private:
+  void ThreadMain(std::promise<bool>& opened);
+  bool InitializeStream();
+  void ReleaseStream();
+
+  Callback callback;
+  void* callback_userdata;
+  int want_sample_rate = 48000;
+  int want_block_size = 256;
+  bool want_exclusive = false;
+  int sample_rate = 0;
+  int block_size = 0;
+  int latency = 0;
+  bool exclusive = false;
+
+  // Only used by the thread of the stream.
+  IAudioClient* client = nullptr;
+  IAudioRenderClient* render_client = nullptr;
+  void* event = nullptr;
+  unsigned int buffer_frames = 0;
+
+  std::thread thread;
+  std::atomic_bool running{false};
+  std::atomic_bool paused{false};
+  ThreadPolicy thread_policy;
+};
+
+} // namespace nba
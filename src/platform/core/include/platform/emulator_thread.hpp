@@ -8,10 +8,17 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <functional>
 #include <nba/core.hpp>
+#include <memory>
+#include <mutex>
 #include <platform/frame_limiter.hpp>
+#include <platform/frame_stats.hpp>
+#include <platform/rewind_buffer.hpp>
+#include <platform/thread_policy.hpp>
 #include <thread> 
+#include <vector>
 
 namespace nba {
 
@@ -26,17 +33,79 @@ struct EmulatorThread {
   void SetFastForward(bool enabled);
   void SetFrameRateCallback(std::function<void(float)> callback);
   void SetPerFrameCallback(std::function<void()> callback);
+
+  // Must only be called while the thread is not running.
+  void EnableRewind(int interval, size_t memory_budget);
+  void DisableRewind();
+  bool IsRewinding() const;
+  void SetRewinding(bool value);
+
+  // Must only be called while the thread is not running.
+  void SetRunAhead(int frames);
+
+  // Must only be called while the thread is not running.
+  void SetSyncToAudio(bool enabled);
+
+  // Must only be called while the thread is not running. See FrameLimiter::SetFrameDelay().
+  void SetFrameDelay(std::chrono::microseconds delay);
+
+  /* Must only be called while the thread is not running. While the game can only be woken by input
+   * (see CoreBase::Activity::WaitingForInput), sleep until input arrives instead of emulating identical frames.
+   * Emulated time stands still meanwhile, so the audio goes quiet and timers do not advance.
+   */
+  void SetPowerSaving(bool enabled);
+
+  // Must only be called while the thread is not running. Applied each time the thread starts.
+  void SetThreadPolicy(ThreadPolicy const& policy);
+
+  // Must only be called while the thread is not running. Optional, receives the time and audio state of every emulated frame.
+  void SetFrameStats(std::shared_ptr<FrameStats> frame_stats);
+
   void Start();
   void Stop();
 
+  /* Runs a task on the emulator thread between two frames, i.e. to attach the next ROM without stopping the thread.
+   * Tasks run on the calling thread instead if the thread is not running, or from Stop() if it is stopped before.
+   * The task may replace the emulated state, so the rewind history is dropped afterwards.
+   */
+  void Post(std::function<void()> task);
+
 private:
+  static constexpr int kFastForwardFrameSkip = 3;
+
+  // Audio buffer level below which the next frame is emulated, when synchronizing to audio.
+  static constexpr float kAudioSyncLevel = 0.5;
+  static constexpr auto kAudioSyncTimeout = std::chrono::milliseconds{50};
+
+  // Longest time to sleep while waiting for input, so that per-frame callbacks (i.e. gamepad polling) still run.
+  static constexpr auto kPowerSavingTimeout = std::chrono::milliseconds{50};
+
+  void RunFrame();
+  void UpdateFastForward();
+  void WaitForAudio();
+  void RunTasks();
+
   std::unique_ptr<CoreBase>& core;
   FrameLimiter frame_limiter;
   std::thread thread;
   std::atomic_bool running = false;
   bool paused = false;
+  std::unique_ptr<RewindBuffer> rewind_buffer;
+  std::atomic_bool rewinding = false;
+  int run_ahead = 0;
+  bool sync_to_audio = false;
+  bool power_saving = false;
+  ThreadPolicy thread_policy;
+  std::shared_ptr<FrameStats> frame_stats;
+  bool frame_skip_fast_forward = false;
+  int frame_skip_saved = 0;
+  std::unique_ptr<SaveState> run_ahead_state;
   std::function<void(float)> frame_rate_cb;
   std::function<void()> per_frame_cb;
+
+  std::mutex tasks_mutex;
+  std::vector<std::function<void()>> tasks;
+  std::atomic_bool tasks_pending = false;
 };
 
 } // namespace nba
@@ -8,20 +8,46 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
 #include <functional>
 #include <thread>
 
 namespace nba {
 
 struct FrameLimiter {
-  FrameLimiter(float fps = 60.0) {
+  enum class Mode {
+    // Sleep until the deadline and let the OS scheduler decide how late we wake up.
+    Sleep,
+    // Sleep until shortly before the deadline, then spin for the remaining time.
+    SleepAndSpin,
+    // Do not wait at all, because the caller paces frames by other means (i.e. the audio device).
+    None
+  };
+
+  // How far frames started from their deadline, over the last FPS update interval.
+  struct JitterStatistics {
+    float average_us = 0;
+    float maximum_us = 0;
+  };
+
+  FrameLimiter(double fps = 60.0) {
     Reset(fps);
   }
 
   void Reset();
-  void Reset(float fps);
+  void Reset(double fps);
   auto GetFastForward() const -> bool;
   void SetFastForward(bool value);
+  auto GetMode() const -> Mode;
+  void SetMode(Mode mode);
+  auto GetJitterStatistics() const -> JitterStatistics;
+
+  /* Starts every frame this much later than its deadline, so that the frame is emulated (and the input polled,
+   * see Config::late_input_latching) as shortly before it is presented as possible. Shortens the input lag
+   * by up to the delay, but the frame must still be emulated in the time that is left. Clamped to 90% of a frame.
+   */
+  auto GetFrameDelay() const -> double; // in microseconds
+  void SetFrameDelay(double delay_us);
 
   void Run(
     std::function<void(void)> frame_advance,
@@ -29,16 +55,41 @@ struct FrameLimiter {
   );
 
 private:
+  using Clock = std::chrono::steady_clock;
+  using Duration = std::chrono::duration<double, std::micro>;
+
   static constexpr int kMillisecondsPerSecond = 1000;
-  static constexpr int kMicrosecondsPerSecond = 1000000;
+  static constexpr double kMicrosecondsPerSecond = 1000000.0;
+
+  // Initial and lower bound of the time that is spun instead of slept.
+  static constexpr double kMinSpinTimeUs = 1000.0;
+  static constexpr double kMaxSpinTimeUs = 4000.0;
+
+  static constexpr double kMaxFrameDelay = 0.9; // in frames
+
+  void Resync();
+  void WaitUntil(Clock::time_point timestamp);
 
   int frame_count = 0;
-  int frame_duration;
-  float frames_per_second;
+  double frame_duration;
+  double frames_per_second;
   bool fast_forward = false;
+  double frame_delay_us = 0;
+  Mode mode = Mode::SleepAndSpin;
+
+  /* Deadlines are computed from the frame index, rather than by adding up frame durations,
+   * so that rounding errors do not pile up into drift.
+   */
+  Clock::time_point timestamp_origin;
+  Clock::time_point timestamp_target;
+  Clock::time_point timestamp_fps_update;
+  std::uint64_t frame_index = 0;
+
+  double spin_time_us = kMinSpinTimeUs;
 
-  std::chrono::time_point<std::chrono::steady_clock> timestamp_target;
-  std::chrono::time_point<std::chrono::steady_clock> timestamp_fps_update;
+  double jitter_sum_us = 0;
+  double jitter_max_us = 0;
+  JitterStatistics jitter_statistics;
 };
 
 } // namespace nba
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <nba/core.hpp>
+#include <nba/integer.hpp>
+#include <string>
+
+namespace nba {
+
+/* Rolling per-frame statistics of the frame pacing and the audio output, so that late frames,
+ * frames that are never shown or shown twice and audio underruns can be spotted while the emulator runs.
+ * The emulator thread reports each emulated frame (see EmulatorThread::SetFrameStats())
+ * and the frontend each frame that it presents. All methods may be called from any thread.
+ */
+struct FrameStats {
+  using Clock = std::chrono::steady_clock;
+
+  // Frames that are kept for the graphs and the histogram, about four seconds.
+  static constexpr int kHistoryLength = 256;
+
+  // Frame times in buckets of 1 ms, the last bucket counts all longer ones.
+  static constexpr int kHistogramBuckets = 50;
+
+  struct Snapshot {
+    // Per emulated frame, oldest first.
+    int emulated_count;
+    float emulation_ms[kHistoryLength]; // wall time spent emulating the frame, including run-ahead
+    float audio_levels[kHistoryLength]; // audio buffer level after the frame
+
+    // Per presented frame, oldest first. Presents that show the previous frame again are not included.
+    int presented_count;
+    float frame_ms[kHistoryLength];   // time since the previous frame was presented
+    float present_ms[kHistoryLength]; // time that the frontend spent rendering and presenting the frame
+
+    u32 histogram[kHistogramBuckets]; // of frame_ms
+
+    // Totals since Reset(), not counted while fast-forwarding.
+    u64 dropped;    // frames that were drawn, but replaced by the next one before they were presented
+    u64 duplicated; // frame periods in which no new frame was presented, so the previous one stayed on screen
+    u64 underruns;  // see CoreBase::AudioStats
+
+    float audio_level;     // latest, see CoreBase::AudioStats
+    float rate_adjustment;
+    float audio_latency_ms;
+    float frame_period_ms; // the nominal frame time
+  };
+
+  explicit FrameStats(double frame_rate = 16777216.0 / 280896.0);
+
+  // Emulator thread: a frame was emulated, which took 'emulation_time'.
+  void OnFrameEmulated(Clock::duration emulation_time, CoreBase::AudioStats const& audio, bool fast_forward);
+
+  /* Frontend: a present that started at 'start' completed at 'end' and showed 'new_frames' frames
+   * that were not presented before, i.e. one normally, more if frames were replaced before they were presented
+   * and zero if it showed the previous frame again.
+   */
+  void OnFramePresented(Clock::time_point start, Clock::time_point end, int new_frames);
+
+  // Copies the statistics into 'snapshot', which is large enough that it should not be kept on the stack.
+  void GetSnapshot(Snapshot& snapshot);
+
+  // Returns the statistics in one line, i.e. for the log or a window title.
+  static auto FormatSummary(Snapshot const& snapshot) -> std::string;
+
+  void Reset();
+
+private:
+  // Longer gaps between two presents (i.e. while paused) are not counted as duplicated frames.
+  static constexpr auto kMaxFrameGap = std::chrono::seconds{1};
+
+  // Fixed size ring of the most recent values, never allocates.
+  template<typename T>
+  struct History {
+    void Push(T const& value) {
+      values[(start + count) % kHistoryLength] = value;
+      if (count < kHistoryLength) {
+        count++;
+      } else {
+        start = (start + 1) % kHistoryLength;
+      }
+    }
+
+    template<typename Functor>
+    void ForEach(Functor functor) const {
+      for (int i = 0; i < count; i++) {
+        functor(i, values[(start + i) % kHistoryLength]);
+      }
+    }
+
+    std::array<T, kHistoryLength> values;
+    int start = 0;
+    int count = 0;
+  };
+
+  struct Emulated {
+    float emulation_ms;
+    float audio_level;
+  };
+
+  struct Presented {
+    float frame_ms;
+    float present_ms;
+  };
+
+  std::mutex mutex;
+  double frame_period_ms;
+
+  History<Emulated> emulated;
+  History<Presented> presented;
+
+  bool fast_forward = false;
+  bool have_present = false;
+  Clock::time_point last_present;
+
+  u64 dropped = 0;
+  u64 duplicated = 0;
+
+  u64 underruns = 0;
+  u64 core_underruns = 0; // the counter of the core at the last frame
+  bool have_core_underruns = false;
+  float audio_level = 0;
+  float rate_adjustment = 0;
+  float audio_latency = 0;
+};
+
+} // namespace nba
@@ -8,7 +8,9 @@
 #pragma once
 
 #include <nba/config.hpp>
-#include <map>
+#include <nba/game_hints.hpp>
+#include <nba/integer.hpp>
+#include <string>
 
 namespace nba {
 
@@ -21,8 +23,43 @@ struct GameInfo {
   Config::BackupType backup_type = Config::BackupType::Detect;
   GPIODeviceType gpio = GPIODeviceType::None;
   bool mirror = false;
+  GameHints hints;
 };
 
-extern const std::map<std::string, GameInfo> g_game_db;
+// Packs a four character game code the way it is stored in the ROM header (first character in the lowest byte).
+constexpr auto GameCode(char const (&code)[5]) -> u32 {
+  return u8(code[0]) | (u8(code[1]) << 8) | (u8(code[2]) << 16) | (u32(u8(code[3])) << 24);
+}
+
+/* The game database is a perfect hash table that is built at compile time,
+ * so a lookup is a single probe and no memory is allocated at startup.
+ * Games that need different settings for different ROM revisions are additionally
+ * listed by the CRC32 of the ROM, which only has to be computed for those games.
+ */
+struct GameDB {
+  // Returns nullptr if the game is not in the database.
+  static auto Find(u32 game_code) -> GameInfo const*;
+
+  // True if the settings depend on the ROM revision, see FindRevision().
+  static bool HasRevisions(u32 game_code);
+
+  // Returns the settings for the revision with the given ROM CRC32, or the ones from Find().
+  static auto FindRevision(u32 game_code, u32 crc32) -> GameInfo const*;
+
+  /* Performance hints can also be read from a TOML file, so that games can be tuned without a rebuild.
+   * The file is read again whenever it was modified, so changes apply the next time a ROM is loaded.
+   * Each table is named after a game code, for example:
+   *
+   *   [ABCE]
+   *   idle_loops = [0x08000F2C]
+   *   mp2k_sound_main_ram = 0x03003C50
+   *   hle_bios_functions = [0x06, 0x0B, 0x0C]
+   *   cpu_backend = "cached_interpreter"
+   */
+  static void SetHintsFile(std::string const& path);
+
+  // Replaces the hints with the ones from the hints file, if it lists the game. Returns whether it did.
+  static bool FindHints(u32 game_code, GameHints& hints);
+};
 
 } // namespace nba
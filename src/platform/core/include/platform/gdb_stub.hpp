@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <nba/core.hpp>
+#include <string>
+#include <vector>
+
+namespace nba {
+
+/* Serves the GDB remote serial protocol over TCP ("target remote localhost:port" in GDB), one debugger at a time:
+ * registers, memory, breakpoints (software and hardware ones are both CoreBase breakpoints), watchpoints,
+ * single-stepping and interrupting the running target with Ctrl-C.
+ * The registers are sent in the layout that GDB assumes for ARM without a target description (r0-r15, f0-f7, fps, cpsr).
+ * Runs the core on the calling thread, which must not run it otherwise while a debugger is attached.
+ */
+struct GDBStub {
+  GDBStub(CoreBase& core);
+ ~GDBStub();
+
+  // Listens on the given port of the loopback interface. Returns false if the port cannot be opened.
+  bool Listen(u16 port);
+
+  /* Waits for a debugger to connect and serves it until it detaches or the connection is closed.
+   * The core only runs while the debugger lets it. Breakpoints and watchpoints are removed when the debugger leaves.
+   * Returns false if the debugger killed the target or the connection failed, true if it detached.
+   */
+  bool Serve();
+
+private:
+  // The value of an invalid socket on every platform (INVALID_SOCKET on Windows).
+  static constexpr std::intptr_t kNoSocket = -1;
+
+  struct Watch {
+    int id;
+    int type; // 2 (write), 3 (read) or 4 (access), as in the Z packet
+    u32 address;
+    u32 size;
+  };
+
+  bool ReadPacket(std::string& packet);
+  void SendPacket(std::string const& data);
+  auto ReadByte() -> int;
+  bool PollInterrupt();
+
+  auto HandlePacket(std::string const& packet) -> std::string;
+  auto HandleQuery(std::string const& packet) -> std::string;
+  auto HandleBreakpoint(std::string const& packet) -> std::string;
+  auto Continue() -> std::string;
+  auto GetStopReply() -> std::string;
+  void Detach();
+
+  void WriteRegister(int index, u32 value);
+
+  CoreBase& core;
+
+  std::intptr_t listen_socket = kNoSocket;
+  std::intptr_t client_socket = kNoSocket;
+  char receive_buffer[4096];
+  int receive_size = 0;
+  int receive_offset = 0;
+  bool no_ack = false;
+
+  enum class Session {
+    Attached,
+    Detached,
+    Killed
+  } session;
+
+  // The signal of the last stop (SIGTRAP or SIGINT) and the watchpoint that caused it, if any.
+  int stop_signal;
+  bool watch_hit;
+  Watchpoint::Hit last_watch_hit;
+
+  std::vector<u32> breakpoints;
+  std::vector<Watch> watches;
+};
+
+} // namespace nba
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/core.hpp>
+#include <string>
+
+namespace nba {
+
+/* Boots through the real BIOS, but only runs the BIOS intro once per BIOS image and ROM header.
+ * The state at the moment the BIOS jumps to the ROM is cached as a save state in 'directory',
+ * later boots load that state instead, which gives the accurate post-BIOS state at the speed of
+ * Config::skip_bios. The save data of the ROM and the RTC are not taken from the cached state.
+ *
+ * Use Boot() in place of CoreBase::Reset(), after the BIOS and the ROM have been loaded.
+ * Config::skip_bios must be off. Boot() replaces the watchpoint callback of the core.
+ */
+struct BootCache {
+  enum class Result {
+    // The cached state has been loaded.
+    Loaded,
+    // The BIOS has run to the ROM and its state has been cached.
+    Created,
+    // The BIOS has run to the ROM, but the state could not be cached.
+    CannotWriteFile,
+    // The BIOS has not reached the ROM (i.e. due to a bad header) and the core is left where the BIOS is.
+    Timeout
+  };
+
+  static auto Boot(
+    CoreBase& core,
+    std::string const& directory
+  ) -> Result;
+};
+
+} // namespace nba
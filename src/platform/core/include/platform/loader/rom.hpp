@@ -9,6 +9,7 @@
 
 #include <nba/core.hpp>
 #include <nba/rom/backup/backup.hpp>
+#include <nba/rom/rom.hpp>
 #include <platform/game_db.hpp>
 #include <string>
 
@@ -37,13 +38,53 @@ struct ROMLoader {
     bool force_rtc = true
   ) -> Result;
 
+  // A ROM that was read from disk but is not attached to a core yet.
+  struct PreparedROM {
+    ROM::Image image;
+    std::unique_ptr<Backup> backup;
+    bool rtc = false;
+    u32 rom_mask = 0;
+    GameHints hints;
+  };
+
+  /* Reads a ROM and its save file without touching the core, so that the next game can be loaded
+   * on a background thread while the current one keeps running. See Attach().
+   */
+  static auto Prepare(
+    std::string rom_path,
+    std::string save_path,
+    Config::BackupType backup_type,
+    bool force_rtc,
+    PreparedROM& rom
+  ) -> Result;
+
+  // Attaches a prepared ROM to a core, which must not be running. Takes effect on the next Reset().
+  static void Attach(
+    std::unique_ptr<CoreBase>& core,
+    PreparedROM&& rom
+  );
+
+  // The save file is kept next to the ROM (game.sav).
+  static auto GetSavePath(std::string const& rom_path) -> std::string;
+
+  // Returns an empty image if the file cannot be memory-mapped. Also used for other read-only files (i.e. save states).
+  static auto MapFile(
+    std::string const& path,
+    size_t size
+  ) -> ROM::Image;
+
 private:
+  // Returns the path of an IPS, UPS or BPS patch next to the ROM, or an empty string if there is none.
+  static auto GetPatchPath(
+    std::string const& rom_path
+  ) -> std::string;
+
   static auto GetGameInfo(
-    std::vector<u8>& file_data
+    ROMImage const& file_data
   ) -> GameInfo;
 
   static auto GetBackupType(
-    std::vector<u8>& file_data
+    ROMImage const& file_data
   ) -> Config::BackupType;
 
   static auto CreateBackup(
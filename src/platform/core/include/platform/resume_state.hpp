@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/core.hpp>
+#include <string>
+#include <thread>
+
+namespace nba {
+
+/* Keeps a game running across restarts of the frontend: the state of the core is written when the game is
+ * closed and restored the next time the same ROM is opened, instead of booting it again.
+ * The state is compressed and written on a background thread, so that closing the game does not wait for it.
+ *
+ * The file is removed once it has been restored. Otherwise, after a crash, an old state (with old save data)
+ * would be restored over the progress that the game has saved since.
+ */
+struct ResumeState {
+ ~ResumeState();
+
+  // The resume file is kept next to the save file (game.resume).
+  static auto GetPath(std::string const& rom_path) -> std::string;
+
+  /* Restores the state written for a ROM, after the ROM has been loaded and the core was reset.
+   * Returns false if there is no such state or it cannot be restored, the game then boots normally.
+   * The file is deleted once it was read, so a damaged state is only tried once.
+   */
+  bool Load(CoreBase& core, std::string const& path);
+
+  // Copies the state of the core right away, compression and writing happen in the background.
+  void Save(CoreBase& core, std::string const& path);
+
+  // Waits for the last call to Save() to complete.
+  void Wait();
+
+private:
+  std::thread writer;
+};
+
+} // namespace nba
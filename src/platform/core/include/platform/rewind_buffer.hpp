@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <nba/core.hpp>
+#include <vector>
+
+namespace nba {
+
+/* Keeps a history of save states that can be stepped back through.
+ * Only the most recent snapshot is kept in full. Every older snapshot
+ * is stored as the run-length encoded XOR delta to its successor,
+ * since most of the system memory does not change from one snapshot to the next.
+ * When the memory budget is exceeded, the oldest snapshots are dropped first.
+ */
+struct RewindBuffer {
+  RewindBuffer(int interval, size_t memory_budget);
+
+  void Reset();
+
+  // Call once per emulated frame. Takes a snapshot every `interval` frames.
+  void Capture(CoreBase& core);
+
+  // Restores the most recent snapshot and removes it from the buffer.
+  // Returns false if the buffer is empty.
+  bool Rewind(CoreBase& core);
+
+  auto GetSnapshotCount() const -> int;
+  auto GetMemoryUsage() const -> size_t;
+
+private:
+  // The 64-bit words [first, last) of a SaveState, see CollectUnchanged().
+  struct Range {
+    uint first;
+    uint last;
+  };
+
+  void CollectUnchanged(CoreBase& core);
+
+  static void Encode(SaveState const& state_a, SaveState const& state_b, std::vector<Range> const& unchanged, std::vector<u8>& delta);
+  static void Decode(std::vector<u8> const& delta, SaveState& state);
+
+  int interval;
+  int frame_counter = 0;
+  size_t memory_budget;
+  size_t memory_usage = 0;
+
+  bool have_head = false;
+  std::unique_ptr<SaveState> head;
+  std::unique_ptr<SaveState> scratch;
+
+  // The pages of guest RAM that were not written since the head was captured need not be compared.
+  u64 dirty_token = 0;
+  DirtyPages dirty_pages;
+  std::vector<Range> unchanged;
+
+  // deltas[i] turns snapshot i + 1 into snapshot i. The newest delta is at the back.
+  std::deque<std::vector<u8>> deltas;
+};
+
+} // namespace nba
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <nba/core.hpp>
+#include <vector>
+
+namespace nba {
+
+/* Rollback netplay for two players, independent of the transport.
+ * Every frame is emulated right away, with the input of the remote player predicted
+ * (the last input that was received is repeated). When the real input of an already
+ * emulated frame arrives and differs from the prediction, the session restores the
+ * snapshot taken at the start of that frame and re-emulates up to the present,
+ * with rendering and audio output suppressed, before the next frame runs.
+ *
+ * The session drives the keypad through its own input device, which must be set as
+ * Config::input_dev before the core is reset. How the inputs of both players map to
+ * the keypad is up to the merge function (by default, either player can press any key).
+ * Keys are KEYINPUT bits (set means pressed), see InputMovie.
+ * For games with an RTC, both peers must use Config::RTC::Source::Fixed with the same epoch.
+ */
+struct RollbackSession {
+  using MergeFunction = std::function<u16(u16 local_keys, u16 remote_keys)>;
+
+  // Upper bound for max_rollback + input_delay.
+  static constexpr int kMaxFrames = 30;
+
+  RollbackSession(int max_rollback, int input_delay);
+
+  auto GetInputDevice() -> std::shared_ptr<InputDevice>;
+  void SetMergeFunction(MergeFunction merge);
+
+  // Starts a new session at frame zero. Call after the core was reset, on both peers.
+  void Reset();
+
+  /* Queues the local input, which takes effect 'input_delay' frames from now.
+   * Returns the frame the input belongs to, which the caller must send to the peer.
+   */
+  auto AddLocalInput(u16 keys) -> int;
+
+  /* Records the input of the remote player for a frame (in any order, duplicates are ignored).
+   * If the frame was already emulated with a different prediction, the next call to
+   * AdvanceFrame() rolls back to it.
+   */
+  void AddRemoteInput(int frame, u16 keys);
+
+  /* False while the local input for the current frame is missing or while too many frames
+   * are still waiting for the remote input. The caller should then wait for the peer (or drop the session).
+   */
+  bool CanAdvanceFrame() const;
+
+  // Rolls back if needed and emulates one frame. Must only be called if CanAdvanceFrame() is true.
+  void AdvanceFrame(CoreBase& core);
+
+  // The frame that AdvanceFrame() emulates next.
+  auto GetFrame() const -> int { return frame; }
+
+  // The last frame for which the input of both players is known.
+  auto GetConfirmedFrame() const -> int { return confirmed_frame; }
+
+  auto GetRollbackCount() const -> int { return rollback_count; }
+  auto GetResimulatedFrameCount() const -> int { return resimulated_frame_count; }
+
+private:
+  struct KeyInputDevice;
+
+  struct Slot {
+    int frame = -1;
+    bool have_local = false;
+    bool have_remote = false;
+    u16 local_keys = 0;
+    u16 remote_keys = 0;
+
+    // The remote input that the frame was emulated with.
+    u16 predicted_keys = 0;
+  };
+
+  auto GetSlot(int frame) -> Slot& {
+    return slots[frame % kSlotCount];
+  }
+
+  auto GetSlot(int frame) const -> Slot const& {
+    return slots[frame % kSlotCount];
+  }
+
+  // Snapshot at the start of the frame, kept for the last max_rollback + 1 frames.
+  auto GetState(int frame) -> SaveState& {
+    return *states[frame % states.size()];
+  }
+
+  void ClaimSlot(int frame);
+  auto PredictRemoteKeys(int frame) const -> u16;
+  void RunFrame(CoreBase& core, int frame);
+  void UpdateConfirmedFrame();
+
+  /* The peer runs up to max_rollback frames ahead of the last frame that it has our input for,
+   * and both sides add their input up to input_delay frames ahead of that. So the inputs
+   * that arrive span at most two times (max_rollback + input_delay) frames past the oldest
+   * snapshot that may still be needed.
+   */
+  static constexpr int kSlotCount = 2 * kMaxFrames + 2;
+
+  int max_rollback;
+  int input_delay;
+  int frame = 0;
+  int local_frame = 0;
+  int confirmed_frame = -1;
+  int rollback_frame = -1;
+  int rollback_count = 0;
+  int resimulated_frame_count = 0;
+  MergeFunction merge;
+  std::shared_ptr<KeyInputDevice> input_device;
+  std::array<Slot, kSlotCount> slots;
+  std::vector<std::unique_ptr<SaveState>> states;
+};
+
+} // namespace nba
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/rom/image.hpp>
+#include <nba/save_state.hpp>
+#include <memory>
+#include <string>
+
+namespace nba {
+
+/* Save state file, made of sections (metadata, thumbnail, CPU, work RAM, video memory, ...)
+ * that are listed in a table at the start of the file.
+ * The sections are stored uncompressed and aligned to 4 KiB, so that an opened file is only memory-mapped:
+ * reading the metadata or thumbnail (i.e. for a state browser) never touches the rest of the file,
+ * the large memory blocks are paged in only when they are loaded, and two states compare section by section.
+ */
+struct SaveStateFile {
+  enum class Section : u32 {
+    Info,
+    Thumbnail,
+    CPU,
+    EWRAM,
+    IWRAM,
+    Bus,
+    IRQ,
+    PPU,
+    VideoMemory,
+    PPULine,
+    APU,
+    DMA,
+    Timer,
+    KeyPad,
+    SIO,
+    Backup,
+    GPIO,
+    Scheduler,
+    Count
+  };
+
+  struct Info {
+    u32 version;
+    u64 timestamp;
+    // Seconds since the Unix epoch.
+    s64 created;
+  };
+
+  static constexpr int kThumbnailWidth = 240;
+  static constexpr int kThumbnailHeight = 160;
+
+  static auto GetName(Section section) -> char const*;
+
+  /* Writes a state, and optionally a thumbnail of 240x160 ARGB8888 pixels.
+   * The file is replaced only once it was written completely.
+   */
+  static bool Write(std::string const& path, SaveState const& state, u32 const* thumbnail = nullptr);
+
+  // Returns false if the file cannot be mapped or is not a save state file of the current version.
+  bool Open(std::string const& path);
+
+  // Returns nullptr if the section is not in the file. 'size' is set to the size of the section.
+  auto GetSection(Section section, size_t& size) const -> u8 const*;
+
+  auto GetInfo() const -> Info const*;
+  auto GetThumbnail() const -> u32 const*;
+
+  /* Copies all sections into a state. Returns false if a section is missing or has a different size.
+   * Only the container is checked: the fields of the state are validated by CoreBase::LoadState(),
+   * so its result must be checked as well.
+   */
+  bool Read(SaveState& state) const;
+
+private:
+  std::shared_ptr<ROMImage const> file;
+};
+
+} // namespace nba
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/integer.hpp>
+
+namespace nba {
+
+/* How the host schedules a thread, i.e. to keep the emulator and the audio callback from being preempted on busy hosts.
+ * Elevated priorities may need privileges (CAP_SYS_NICE or an rtprio limit on Linux). Whatever cannot be applied
+ * is logged and skipped, the thread then keeps running with the defaults of the host.
+ */
+struct ThreadPolicy {
+  enum class Role {
+    Emulation,
+    Audio,
+    Worker // threads that the core spawns, i.e. for rendering (see Config::on_thread_start)
+  };
+
+  enum class Priority {
+    Normal,
+    High,     // above other threads of normal priority
+    RealTime  // SCHED_FIFO on Linux, MMCSS on Windows. Audio ranks above emulation, which ranks above workers.
+  } priority = Priority::Normal;
+
+  // Bit n allows the thread to run on CPU n, zero allows all CPUs. Not supported on macOS.
+  u64 affinity = 0;
+
+  // Applies the policy to the calling thread. Returns false if any part of it could not be applied.
+  bool ApplyToCurrentThread(Role role) const;
+};
+
+} // namespace nba
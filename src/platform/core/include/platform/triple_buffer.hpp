@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <nba/integer.hpp>
+
+namespace nba {
+
+/* Hands values (e.g. video frames) from a single producer thread to a single consumer thread.
+ * The producer writes into the back slot and publishes it, which swaps it with the middle slot.
+ * The consumer swaps the middle slot with the front slot to get the newest published value.
+ * Each side only ever touches its own slot, so neither thread blocks or allocates,
+ * and frames that the consumer was too slow to pick up are simply overwritten.
+ */
+template<typename T>
+struct TripleBuffer {
+  // Producer: the slot to write the next value into.
+  auto GetWriteBuffer() -> T& {
+    return slots[back];
+  }
+
+  // Producer: makes the write slot visible to the consumer and starts writing into a new slot.
+  void Publish() {
+    back = middle.exchange(back | kFreshBit, std::memory_order_acq_rel) & kIndexMask;
+  }
+
+  // Consumer: moves the newest published value to the read slot.
+  // Returns false if nothing was published since the last call.
+  bool Consume() {
+    if ((middle.load(std::memory_order_relaxed) & kFreshBit) == 0) {
+      return false;
+    }
+    front = middle.exchange(front, std::memory_order_acq_rel) & kIndexMask;
+    return true;
+  }
+
+  // Consumer: the most recently consumed value.
+  auto GetReadBuffer() const -> T const& {
+    return slots[front];
+  }
+
+private:
+  static constexpr u8 kIndexMask = 3;
+  static constexpr u8 kFreshBit = 4;
+
+  T slots[3] {};
+
+  u8 back = 0;
+  std::atomic<u8> middle{1};
+  u8 front = 2;
+};
+
+} // namespace nba
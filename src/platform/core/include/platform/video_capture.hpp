@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <bitset>
+#include <memory>
+#include <nba/device/audio_device.hpp>
+#include <nba/device/video_device.hpp>
+#include <string>
+
+namespace nba {
+
+/* Records the frames and audio that the emulator outputs, to <path>.y4m (YUV 4:4:4, full range)
+ * and <path>.wav (16-bit stereo), e.g. for encoding with FFmpeg afterwards.
+ * Frames and samples are copied into bounded queues, which a background thread converts and writes.
+ * The emulation and audio threads never wait for it: if it falls behind, frames are dropped and counted.
+ * Only the lines that changed since the previous frame (see VideoDevice::SetDirtyLines()) are copied
+ * and converted, so an unchanged frame costs next to nothing.
+ */
+struct VideoCapture {
+ ~VideoCapture();
+
+  bool Start(std::string const& path, int sample_rate);
+  void Stop();
+  bool IsRecording() const;
+
+  // The number of frames of the current (or last) recording that were dropped.
+  auto GetDroppedFrames() const -> u32;
+
+  // Emulation thread: frames in ARGB8888 of (240 * scale) x (160 * scale) pixels.
+  void SetDirtyLines(std::bitset<VideoDevice::kFrameHeight> const& lines);
+  void PushFrame(u32 const* buffer, int scale);
+
+  // Audio thread: interleaved stereo samples.
+  void PushAudio(s16 const* samples, int count);
+
+private:
+  struct Session;
+
+  // Accessed through std::atomic_load() and std::atomic_store(), since it is shared by three threads.
+  std::shared_ptr<Session> session;
+
+  std::bitset<VideoDevice::kFrameHeight> dirty_lines;
+  std::atomic<u32> dropped_frames{0};
+};
+
+// Passes everything on to another video device and records the frames that are drawn.
+struct CaptureVideoDevice : VideoDevice {
+  CaptureVideoDevice(std::shared_ptr<VideoDevice> device, std::shared_ptr<VideoCapture> capture)
+      : device(device)
+      , capture(capture) {
+  }
+
+  auto GetPixelFormat() -> PixelFormat override {
+    return device->GetPixelFormat();
+  }
+
+  auto GetFrameScale() -> int override {
+    scale = device->GetFrameScale();
+    return scale;
+  }
+
+  auto AcquireFrame() -> void* override {
+    return device->AcquireFrame();
+  }
+
+  void SetDirtyLines(std::bitset<kFrameHeight> const& lines) override {
+    capture->SetDirtyLines(lines);
+    device->SetDirtyLines(lines);
+  }
+
+  void Draw(u32* buffer) override {
+    capture->PushFrame(buffer, scale);
+    device->Draw(buffer);
+  }
+
+  void Draw(u16* buffer) override {
+    device->Draw(buffer);
+  }
+
+  // Frames rendered on the GPU cannot be recorded, so they are rendered by the emulator while recording.
+  auto AcquirePPUFrame() -> PPUFrame* override {
+    return capture->IsRecording() ? nullptr : device->AcquirePPUFrame();
+  }
+
+  void Draw(PPUFrame const& frame) override {
+    device->Draw(frame);
+  }
+
+private:
+  std::shared_ptr<VideoDevice> device;
+  std::shared_ptr<VideoCapture> capture;
+  int scale = 1;
+};
+
+// Passes everything on to another audio device and records the samples that it plays.
+struct CaptureAudioDevice : AudioDevice {
+  CaptureAudioDevice(std::shared_ptr<AudioDevice> device, std::shared_ptr<VideoCapture> capture)
+      : device(device)
+      , capture(capture) {
+  }
+
+  auto GetSampleRate() -> int override {
+    return device->GetSampleRate();
+  }
+
+  auto GetBlockSize() -> int override {
+    return device->GetBlockSize();
+  }
+
+  auto GetLatency() -> int override {
+    return device->GetLatency();
+  }
+
+  bool Open(void* userdata, Callback callback) override {
+    this->userdata = userdata;
+    this->callback = callback;
+    return device->Open(this, &CaptureAudioDevice::OnCallback);
+  }
+
+  void SetPause(bool value) override {
+    device->SetPause(value);
+  }
+
+  void Close() override {
+    device->Close();
+  }
+
+private:
+  static void OnCallback(void* userdata, s16* stream, int byte_len) {
+    auto self = (CaptureAudioDevice*)userdata;
+
+    self->callback(self->userdata, stream, byte_len);
+    self->capture->PushAudio(stream, byte_len / sizeof(s16) / 2);
+  }
+
+  std::shared_ptr<AudioDevice> device;
+  std::shared_ptr<VideoCapture> capture;
+  void* userdata = nullptr;
+  Callback callback = nullptr;
+};
+
+} // namespace nba
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <nba/log.hpp>
+#include <platform/audio_recorder.hpp>
+
+namespace nba {
+
+AudioRecorder::AudioRecorder(std::string const& path, int streams) : streams(streams) {
+  static constexpr char const* kSuffix[kStreamCount] {
+    ".wav", ".psg.wav", ".fifo_a.wav", ".fifo_b.wav"
+  };
+
+  for (int i = 0; i < kStreamCount; i++) {
+    if (streams & (1 << i)) {
+      auto filename = path + kSuffix[i];
+
+      files[i].file = std::fopen(filename.c_str(), "wb");
+
+      if (files[i].file == nullptr) {
+        Log<Error>("AudioRecorder: cannot create {}", filename);
+      }
+    }
+  }
+
+  thread = std::thread{&AudioRecorder::Run, this};
+}
+
+AudioRecorder::~AudioRecorder() {
+  {
+    std::lock_guard lock{mutex};
+    quit = true;
+  }
+  cv.notify_one();
+  thread.join();
+
+  for (auto& file : files) {
+    if (file.file) {
+      WriteHeader(file);
+      std::fclose(file.file);
+    }
+  }
+
+  if (dropped_blocks != 0) {
+    Log<Warn>("AudioRecorder: dropped {} blocks of samples.", dropped_blocks.load());
+  }
+}
+
+bool AudioRecorder::IsOpen() const {
+  for (int i = 0; i < kStreamCount; i++) {
+    if ((streams & (1 << i)) && files[i].file == nullptr) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void AudioRecorder::Write(Stream stream, int sample_rate, StereoSample<float> const* samples, int count) {
+  while (count > 0) {
+    if (queue.Pending() == queue.Capacity()) {
+      dropped_blocks++;
+      return;
+    }
+
+    Block block;
+
+    block.stream = stream;
+    block.sample_rate = sample_rate;
+    block.count = std::min(count, kBlockSize);
+    std::copy_n(samples, block.count, block.samples);
+    queue.Write(block);
+
+    samples += block.count;
+    count -= block.count;
+  }
+}
+
+void AudioRecorder::Run() {
+  std::unique_lock lock{mutex};
+
+  while (true) {
+    // The emulation thread does not notify, so that writing a block never involves a system call.
+    cv.wait_for(lock, std::chrono::milliseconds{20}, [this]() { return quit; });
+
+    while (queue.Available() > 0) {
+      WriteBlock(queue.Read());
+    }
+
+    if (quit) {
+      break;
+    }
+  }
+}
+
+void AudioRecorder::WriteBlock(Block const& block) {
+  int index = 0;
+
+  while ((1 << index) != block.stream) {
+    index++;
+  }
+
+  auto& file = files[index];
+
+  if (file.file == nullptr) {
+    return;
+  }
+
+  if (file.sample_rate == 0) {
+    file.sample_rate = block.sample_rate;
+    WriteHeader(file);
+  } else if (file.sample_rate != block.sample_rate) {
+    // A WAV file has a single sample rate, the samples are written regardless, but will play at the wrong speed.
+    Log<Warn>("AudioRecorder: sample rate of stream {} changed from {} to {} Hz.", index, file.sample_rate, block.sample_rate);
+  }
+
+  file.data_bytes += std::fwrite(block.samples, sizeof(StereoSample<float>), block.count, file.file) * sizeof(StereoSample<float>);
+}
+
+void AudioRecorder::WriteHeader(File& file) {
+  auto f = file.file;
+
+  auto write32 = [&](u32 value) { std::fwrite(&value, 4, 1, f); };
+  auto write16 = [&](u16 value) { std::fwrite(&value, 2, 1, f); };
+
+  std::fseek(f, 0, SEEK_SET);
+  std::fputs("RIFF", f);
+  write32(36 + file.data_bytes);
+  std::fputs("WAVEfmt ", f);
+  write32(16);
+  write16(3); // IEEE float
+  write16(2);
+  write32(file.sample_rate);
+  write32(file.sample_rate * 8);
+  write16(8);
+  write16(32);
+  std::fputs("data", f);
+  write32(file.data_bytes);
+  std::fseek(f, 0, SEEK_END);
+}
+
+} // namespace nba
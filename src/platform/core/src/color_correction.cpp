@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <platform/color_correction.hpp>
+
+namespace nba {
+
+namespace {
+
+struct RGB {
+  float r;
+  float g;
+  float b;
+};
+
+// Same math as src/device/shader/color_higan.glsl.hpp
+auto CorrectHigan(RGB in) -> RGB {
+  in.r = std::pow(in.r, 4.0f);
+  in.g = std::pow(in.g, 4.0f);
+  in.b = std::pow(in.b, 4.0f);
+
+  return {
+    1.000f * in.r + 0.196f * in.g,
+    0.039f * in.r + 0.901f * in.g + 0.117f * in.b,
+    0.196f * in.r + 0.039f * in.g + 0.862f * in.b
+  };
+}
+
+// Same math as src/device/shader/color_agb.glsl.hpp (with the saturation and contrast of 1.0 folded in)
+auto CorrectAGB(RGB in) -> RGB {
+  constexpr float kGamma = 2.2f + 1.0f;
+  constexpr float kLuminance = 0.94f;
+
+  in.r = std::clamp(std::pow(in.r, kGamma) * kLuminance, 0.0f, 1.0f);
+  in.g = std::clamp(std::pow(in.g, kGamma) * kLuminance, 0.0f, 1.0f);
+  in.b = std::clamp(std::pow(in.b, kGamma) * kLuminance, 0.0f, 1.0f);
+
+  return {
+    0.820f * in.r + 0.240f * in.g - 0.060f * in.b,
+    0.125f * in.r + 0.665f * in.g + 0.210f * in.b,
+    0.195f * in.r + 0.075f * in.g + 0.730f * in.b
+  };
+}
+
+auto Quantize(float value) -> u32 {
+  value = std::pow(std::clamp(value, 0.0f, 1.0f), 1.0f / 2.2f);
+
+  return u32(std::lround(value * 255.0f));
+}
+
+} // namespace
+
+auto CreateColorLUT(ColorCorrection type) -> std::shared_ptr<ColorLUT const> {
+  auto lut = std::make_shared<ColorLUT>();
+
+  for (int color = 0; color < 32768; color++) {
+    // The shaders sample the plain 8-bit expansion of the BGR555 color.
+    RGB rgb = {
+      float(((color >>  0) & 0x1F) << 3) / 255.0f,
+      float(((color >>  5) & 0x1F) << 3) / 255.0f,
+      float(((color >> 10) & 0x1F) << 3) / 255.0f
+    };
+
+    if (type == ColorCorrection::higan) {
+      rgb = CorrectHigan(rgb);
+    } else {
+      rgb = CorrectAGB(rgb);
+    }
+
+    (*lut)[color] = Quantize(rgb.r) << 16 |
+                    Quantize(rgb.g) <<  8 |
+                    Quantize(rgb.b) <<  0 |
+                    0xFF000000;
+  }
+
+  return lut;
+}
+
+} // namespace nba
@@ -10,9 +10,63 @@
 #include <fstream>
 #include <map>
 #include <platform/config.hpp>
+#include <vector>
 
 namespace nba {
 
+// Reads <name>_priority and <name>_affinity (a list of CPU indices) from the [threads] table.
+static auto LoadThreadPolicy(toml::value const& threads, std::string const& name) -> ThreadPolicy {
+  auto policy = ThreadPolicy{};
+  auto priority = toml::find_or<std::string>(threads, name + "_priority", "normal");
+
+  const std::map<std::string, ThreadPolicy::Priority> priorities{
+    { "normal",   ThreadPolicy::Priority::Normal   },
+    { "high",     ThreadPolicy::Priority::High     },
+    { "realtime", ThreadPolicy::Priority::RealTime }
+  };
+
+  auto match = priorities.find(priority);
+
+  if (match == priorities.end()) {
+    Log<Warn>("Config: thread priority '{0}' is not valid, defaulting to normal.", priority);
+  } else {
+    policy.priority = match->second;
+  }
+
+  for (auto cpu : toml::find_or<std::vector<int>>(threads, name + "_affinity", {})) {
+    if (cpu >= 0 && cpu < 64) {
+      policy.affinity |= 1ULL << cpu;
+    } else {
+      Log<Warn>("Config: CPU {0} in {1}_affinity is out of range.", cpu, name);
+    }
+  }
+
+  return policy;
+}
+
+static void SaveThreadPolicy(
+  toml::basic_value<toml::preserve_comments>& data,
+  std::string const& name,
+  ThreadPolicy const& policy
+) {
+  std::string priority;
+  switch (policy.priority) {
+    case ThreadPolicy::Priority::Normal:   priority = "normal"; break;
+    case ThreadPolicy::Priority::High:     priority = "high"; break;
+    case ThreadPolicy::Priority::RealTime: priority = "realtime"; break;
+  }
+
+  std::vector<int> affinity;
+  for (int cpu = 0; cpu < 64; cpu++) {
+    if (policy.affinity & (1ULL << cpu)) {
+      affinity.push_back(cpu);
+    }
+  }
+
+  data["threads"][name + "_priority"] = priority;
+  data["threads"][name + "_affinity"] = affinity;
+}
+
 void PlatformConfig::Load(std::string const& path) {
   if (!std::filesystem::exists(path)) {
     Save(path);
@@ -36,6 +90,55 @@ void PlatformConfig::Load(std::string const& path) {
       this->bios_path = toml::find_or<std::string>(general, "bios_path", "bios.bin");
       this->skip_bios = toml::find_or<toml::boolean>(general, "bios_skip", false);
       this->sync_to_audio = toml::find_or<toml::boolean>(general, "sync_to_audio", true);
+      this->run_ahead = toml::find_or<int>(general, "run_ahead", 0);
+      this->frame_delay = toml::find_or<int>(general, "frame_delay", 0);
+      this->late_input_latching = toml::find_or<toml::boolean>(general, "late_input_latching", false);
+      this->power_saving = toml::find_or<toml::boolean>(general, "power_saving", false);
+      this->huge_pages = toml::find_or<toml::boolean>(general, "huge_pages", false);
+      this->resume = toml::find_or<toml::boolean>(general, "resume", false);
+      this->measure_latency = toml::find_or<toml::boolean>(general, "measure_latency", false);
+    }
+  }
+
+  if (data.contains("cpu")) {
+    auto cpu_result = toml::expect<toml::value>(data.at("cpu"));
+
+    if (cpu_result.is_ok()) {
+      auto cpu = cpu_result.unwrap();
+      auto backend = toml::find_or<std::string>(cpu, "backend", "interpreter");
+
+      const std::map<std::string, Config::CPU::Backend> backends{
+        { "interpreter",        Config::CPU::Backend::Interpreter       },
+        { "cached_interpreter", Config::CPU::Backend::CachedInterpreter }
+      };
+
+      auto match = backends.find(backend);
+
+      if (match == backends.end()) {
+        Log<Warn>("Config: unknown CPU backend: {} (defaulting to interpreter).", backend);
+        this->cpu.backend = Config::CPU::Backend::Interpreter;
+      } else {
+        this->cpu.backend = match->second;
+      }
+
+      this->cpu.idle_loop_skip = toml::find_or<toml::boolean>(cpu, "idle_loop_skip", false);
+      this->cpu.hle_bios = toml::find_or<toml::boolean>(cpu, "hle_bios", false);
+
+      auto accuracy_profile = toml::find_or<std::string>(cpu, "accuracy_profile", "accurate");
+
+      const std::map<std::string, Config::CPU::AccuracyProfile> accuracy_profiles{
+        { "accurate", Config::CPU::AccuracyProfile::Accurate },
+        { "fast",     Config::CPU::AccuracyProfile::Fast     }
+      };
+
+      auto accuracy_match = accuracy_profiles.find(accuracy_profile);
+
+      if (accuracy_match == accuracy_profiles.end()) {
+        Log<Warn>("Config: unknown accuracy profile: {} (defaulting to accurate).", accuracy_profile);
+        this->cpu.accuracy_profile = Config::CPU::AccuracyProfile::Accurate;
+      } else {
+        this->cpu.accuracy_profile = accuracy_match->second;
+      }
     }
   }
 
@@ -66,6 +169,19 @@ void PlatformConfig::Load(std::string const& path) {
       }
 
       this->force_rtc = toml::find_or<toml::boolean>(cartridge, "force_rtc", false);
+
+      auto rtc_source = toml::find_or<std::string>(cartridge, "rtc_source", "host");
+
+      if (rtc_source == "fixed") {
+        this->rtc.source = Config::RTC::Source::Fixed;
+      } else {
+        if (rtc_source != "host") {
+          Log<Warn>("Config: RTC source '{0}' is not valid, defaulting to host.", rtc_source);
+        }
+        this->rtc.source = Config::RTC::Source::Host;
+      }
+
+      this->rtc.epoch = toml::find_or<s64>(cartridge, "rtc_epoch", 946684800);
     }
   }
 
@@ -105,6 +221,15 @@ void PlatformConfig::Load(std::string const& path) {
       }
 
       this->video.lcd_ghosting = toml::find_or<bool>(video, "lcd_ghosting", true);
+      this->video.shader_cache = toml::find_or<bool>(video, "shader_cache", true);
+      this->video.lock_to_vsync = toml::find_or<bool>(video, "lock_to_vsync", false);
+      this->video.gpu_renderer = toml::find_or<bool>(video, "gpu_renderer", false);
+      this->video.affine_scale = toml::find_or<int>(video, "affine_scale", 1);
+      this->video.frame_stats_overlay = toml::find_or<bool>(video, "frame_stats_overlay", false);
+      this->frame_skip = toml::find_or<int>(video, "frame_skip", 0);
+      this->threaded_rendering = toml::find_or<bool>(video, "threaded_rendering", false);
+      this->parallel_rendering = toml::find_or<bool>(video, "parallel_rendering", false);
+      this->skip_unchanged_lines = toml::find_or<bool>(video, "skip_unchanged_lines", false);
     }
   }
 
@@ -133,11 +258,68 @@ void PlatformConfig::Load(std::string const& path) {
       }
 
       this->audio.interpolate_fifo = toml::find_or<toml::boolean>(audio, "interpolate_fifo", true);
+      this->audio.single_stage_mixing = toml::find_or<toml::boolean>(audio, "single_stage_mixing", false);
       this->audio.mp2k_hle_enable = toml::find_or<toml::boolean>(audio, "mp2k_hle_enable", false);
       this->audio.mp2k_hle_cubic = toml::find_or<toml::boolean>(audio, "mp2k_hle_cubic", false);
+      this->audio.mp2k_hle_threaded = toml::find_or<toml::boolean>(audio, "mp2k_hle_threaded", false);
+      this->audio.batch_mixing = toml::find_or<toml::boolean>(audio, "batch_mixing", false);
+      this->audio.threaded_mixing = toml::find_or<toml::boolean>(audio, "threaded_mixing", false);
+      this->audio.sync_to_audio = toml::find_or<toml::boolean>(audio, "sync_to_audio", false);
+    }
+  }
+
+  if (data.contains("audio_output")) {
+    auto output_result = toml::expect<toml::value>(data.at("audio_output"));
+
+    if (output_result.is_ok()) {
+      auto output = output_result.unwrap();
+      auto backend = toml::find_or<std::string>(output, "backend", "sdl");
+
+      if (backend == "native") {
+        this->audio_output.backend = AudioOutput::Backend::Native;
+      } else {
+        if (backend != "sdl") {
+          Log<Warn>("Config: unknown audio backend: {} (defaulting to sdl).", backend);
+        }
+        this->audio_output.backend = AudioOutput::Backend::SDL;
+      }
+
+      this->audio_output.device = toml::find_or<std::string>(output, "device", "");
+      this->audio_output.sample_rate = toml::find_or<int>(output, "sample_rate", 48000);
+      this->audio_output.block_size = toml::find_or<int>(output, "block_size", 0);
+      this->audio_output.exclusive = toml::find_or<toml::boolean>(output, "exclusive", false);
+    }
+  }
+
+  if (data.contains("rewind")) {
+    auto rewind_result = toml::expect<toml::value>(data.at("rewind"));
+
+    if (rewind_result.is_ok()) {
+      auto rewind = rewind_result.unwrap();
+
+      this->rewind.enable = toml::find_or<toml::boolean>(rewind, "enable", false);
+      this->rewind.interval = toml::find_or<int>(rewind, "interval", 2);
+      this->rewind.memory_budget = toml::find_or<int>(rewind, "memory_budget", 64);
     }
   }
 
+  if (data.contains("threads")) {
+    auto threads_result = toml::expect<toml::value>(data.at("threads"));
+
+    if (threads_result.is_ok()) {
+      auto threads = threads_result.unwrap();
+
+      this->threads.emulation = LoadThreadPolicy(threads, "emulation");
+      this->threads.audio = LoadThreadPolicy(threads, "audio");
+      this->threads.workers = LoadThreadPolicy(threads, "workers");
+    }
+  }
+
+  // The core spawns its worker threads by itself, so it applies the policy through this hook.
+  on_thread_start = [policy = this->threads.workers](char const* name) {
+    policy.ApplyToCurrentThread(ThreadPolicy::Role::Worker);
+  };
+
   LoadCustomData(data);
 }
 
@@ -157,6 +339,30 @@ void PlatformConfig::Save(std::string const& path) {
   data["general"]["bios_path"] = this->bios_path;
   data["general"]["bios_skip"] = this->skip_bios;
   data["general"]["sync_to_audio"] = this->sync_to_audio;
+  data["general"]["run_ahead"] = this->run_ahead;
+  data["general"]["frame_delay"] = this->frame_delay;
+  data["general"]["late_input_latching"] = this->late_input_latching;
+  data["general"]["power_saving"] = this->power_saving;
+  data["general"]["huge_pages"] = this->huge_pages;
+  data["general"]["resume"] = this->resume;
+  data["general"]["measure_latency"] = this->measure_latency;
+
+  // CPU
+  std::string backend;
+  switch (this->cpu.backend) {
+    case Config::CPU::Backend::Interpreter:       backend = "interpreter"; break;
+    case Config::CPU::Backend::CachedInterpreter: backend = "cached_interpreter"; break;
+  }
+  data["cpu"]["backend"] = backend;
+  data["cpu"]["idle_loop_skip"] = this->cpu.idle_loop_skip;
+  data["cpu"]["hle_bios"] = this->cpu.hle_bios;
+
+  std::string accuracy_profile;
+  switch (this->cpu.accuracy_profile) {
+    case Config::CPU::AccuracyProfile::Accurate: accuracy_profile = "accurate"; break;
+    case Config::CPU::AccuracyProfile::Fast:     accuracy_profile = "fast"; break;
+  }
+  data["cpu"]["accuracy_profile"] = accuracy_profile;
 
   // Cartridge
   std::string save_type;
@@ -171,6 +377,8 @@ void PlatformConfig::Save(std::string const& path) {
   }
   data["cartridge"]["save_type"] = save_type;
   data["cartridge"]["force_rtc"] = this->force_rtc;
+  data["cartridge"]["rtc_source"] = this->rtc.source == Config::RTC::Source::Fixed ? "fixed" : "host";
+  data["cartridge"]["rtc_epoch"] = this->rtc.epoch;
 
   // Video
   std::string filter;
@@ -195,6 +403,15 @@ void PlatformConfig::Save(std::string const& path) {
   data["video"]["filter"] = filter;
   data["video"]["color_correction"] = color_correction;
   data["video"]["lcd_ghosting"] = this->video.lcd_ghosting;
+  data["video"]["shader_cache"] = this->video.shader_cache;
+  data["video"]["lock_to_vsync"] = this->video.lock_to_vsync;
+  data["video"]["gpu_renderer"] = this->video.gpu_renderer;
+  data["video"]["affine_scale"] = this->video.affine_scale;
+  data["video"]["frame_stats_overlay"] = this->video.frame_stats_overlay;
+  data["video"]["frame_skip"] = this->frame_skip;
+  data["video"]["threaded_rendering"] = this->threaded_rendering;
+  data["video"]["parallel_rendering"] = this->parallel_rendering;
+  data["video"]["skip_unchanged_lines"] = this->skip_unchanged_lines;
 
   // Audio
   std::string resampler;
@@ -207,8 +424,30 @@ void PlatformConfig::Save(std::string const& path) {
   }
   data["audio"]["resampler"] = resampler;
   data["audio"]["interpolate_fifo"] = this->audio.interpolate_fifo;
+  data["audio"]["single_stage_mixing"] = this->audio.single_stage_mixing;
   data["audio"]["mp2k_hle_enable"] = this->audio.mp2k_hle_enable;
   data["audio"]["mp2k_hle_cubic"] = this->audio.mp2k_hle_cubic;
+  data["audio"]["mp2k_hle_threaded"] = this->audio.mp2k_hle_threaded;
+  data["audio"]["batch_mixing"] = this->audio.batch_mixing;
+  data["audio"]["threaded_mixing"] = this->audio.threaded_mixing;
+  data["audio"]["sync_to_audio"] = this->audio.sync_to_audio;
+
+  // Audio output
+  data["audio_output"]["backend"] = this->audio_output.backend == AudioOutput::Backend::Native ? "native" : "sdl";
+  data["audio_output"]["device"] = this->audio_output.device;
+  data["audio_output"]["sample_rate"] = this->audio_output.sample_rate;
+  data["audio_output"]["block_size"] = this->audio_output.block_size;
+  data["audio_output"]["exclusive"] = this->audio_output.exclusive;
+
+  // Rewind
+  data["rewind"]["enable"] = this->rewind.enable;
+  data["rewind"]["interval"] = this->rewind.interval;
+  data["rewind"]["memory_budget"] = this->rewind.memory_budget;
+
+  // Threads
+  SaveThreadPolicy(data, "emulation", this->threads.emulation);
+  SaveThreadPolicy(data, "audio", this->threads.audio);
+  SaveThreadPolicy(data, "workers", this->threads.workers);
 
   SaveCustomData(data);
 
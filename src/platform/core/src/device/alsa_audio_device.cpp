@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <alsa/asoundlib.h>
+#include <nba/log.hpp>
+#include <platform/device/alsa_audio_device.hpp>
+#include <vector>
+
+namespace nba {
+
+ALSA_AudioDevice::~ALSA_AudioDevice() {
+  Close();
+}
+
+void ALSA_AudioDevice::SetDeviceName(std::string const& name) {
+  device_name = name;
+}
+
+void ALSA_AudioDevice::SetSampleRate(int sample_rate) {
+  want_sample_rate = sample_rate;
+}
+
+void ALSA_AudioDevice::SetBlockSize(int block_size) {
+  want_block_size = block_size;
+}
+
+void ALSA_AudioDevice::SetThreadPolicy(ThreadPolicy const& policy) {
+  thread_policy = policy;
+}
+
+auto ALSA_AudioDevice::GetSampleRate() -> int {
+  return sample_rate;
+}
+
+auto ALSA_AudioDevice::GetBlockSize() -> int {
+  return block_size;
+}
+
+auto ALSA_AudioDevice::GetLatency() -> int {
+  return latency.load(std::memory_order_relaxed);
+}
+
+bool ALSA_AudioDevice::Open(void* userdata, Callback callback) {
+  snd_pcm_hw_params_t* hw_params;
+  snd_pcm_sw_params_t* sw_params;
+
+  int error = snd_pcm_open(&pcm, device_name.c_str(), SND_PCM_STREAM_PLAYBACK, 0);
+
+  if (error < 0) {
+    Log<Error>("Audio: ALSA: failed to open device '{}': {}", device_name, snd_strerror(error));
+    pcm = nullptr;
+    return false;
+  }
+
+  auto fail = [&](char const* what) {
+    Log<Error>("Audio: ALSA: {} failed: {}", what, snd_strerror(error));
+    snd_pcm_close(pcm);
+    pcm = nullptr;
+    return false;
+  };
+
+  unsigned int rate = want_sample_rate;
+  snd_pcm_uframes_t period = want_block_size;
+  snd_pcm_uframes_t buffer = want_block_size * kPeriodCount;
+
+  snd_pcm_hw_params_alloca(&hw_params);
+  snd_pcm_hw_params_any(pcm, hw_params);
+
+  if ((error = snd_pcm_hw_params_set_access(pcm, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
+    return fail("snd_pcm_hw_params_set_access()");
+  }
+
+  if ((error = snd_pcm_hw_params_set_format(pcm, hw_params, SND_PCM_FORMAT_S16)) < 0) {
+    return fail("snd_pcm_hw_params_set_format()");
+  }
+
+  if ((error = snd_pcm_hw_params_set_channels(pcm, hw_params, 2)) < 0) {
+    return fail("snd_pcm_hw_params_set_channels()");
+  }
+
+  if ((error = snd_pcm_hw_params_set_rate_near(pcm, hw_params, &rate, nullptr)) < 0) {
+    return fail("snd_pcm_hw_params_set_rate_near()");
+  }
+
+  if ((error = snd_pcm_hw_params_set_period_size_near(pcm, hw_params, &period, nullptr)) < 0) {
+    return fail("snd_pcm_hw_params_set_period_size_near()");
+  }
+
+  if ((error = snd_pcm_hw_params_set_buffer_size_near(pcm, hw_params, &buffer)) < 0) {
+    return fail("snd_pcm_hw_params_set_buffer_size_near()");
+  }
+
+  if ((error = snd_pcm_hw_params(pcm, hw_params)) < 0) {
+    return fail("snd_pcm_hw_params()");
+  }
+
+  // The device may have rounded the period and buffer size to what it supports.
+  snd_pcm_hw_params_get_rate(hw_params, &rate, nullptr);
+  snd_pcm_hw_params_get_period_size(hw_params, &period, nullptr);
+  snd_pcm_hw_params_get_buffer_size(hw_params, &buffer);
+
+  // Start playback once the buffer is full but for one period and wake the writer whenever a period is free.
+  snd_pcm_sw_params_alloca(&sw_params);
+  snd_pcm_sw_params_current(pcm, sw_params);
+  snd_pcm_sw_params_set_start_threshold(pcm, sw_params, buffer - period);
+  snd_pcm_sw_params_set_avail_min(pcm, sw_params, period);
+
+  if ((error = snd_pcm_sw_params(pcm, sw_params)) < 0) {
+    return fail("snd_pcm_sw_params()");
+  }
+
+  if ((error = snd_pcm_prepare(pcm)) < 0) {
+    return fail("snd_pcm_prepare()");
+  }
+
+  sample_rate = int(rate);
+  block_size = int(period);
+  buffer_size = int(buffer);
+  latency = buffer_size;
+
+  Log<Info>("Audio: ALSA: opened '{}' at {} Hz, period of {} frames, buffer of {} frames.",
+    device_name, sample_rate, block_size, buffer_size);
+
+  this->callback = callback;
+  callback_userdata = userdata;
+
+  running = true;
+  thread = std::thread{[this]() { ThreadMain(); }};
+  return true;
+}
+
+void ALSA_AudioDevice::ThreadMain() {
+  thread_policy.ApplyToCurrentThread(ThreadPolicy::Role::Audio);
+
+  auto samples = std::vector<s16>(block_size * 2);
+
+  while (running.load(std::memory_order_relaxed)) {
+    // While paused the device keeps playing silence, so that its latency stays the same once it resumes.
+    if (paused.load(std::memory_order_relaxed)) {
+      std::fill(samples.begin(), samples.end(), s16(0));
+    } else {
+      callback(callback_userdata, samples.data(), block_size * 2 * sizeof(s16));
+    }
+
+    auto data = samples.data();
+    auto remaining = snd_pcm_uframes_t(block_size);
+
+    // Blocks until the device has room for the period.
+    while (remaining > 0 && running.load(std::memory_order_relaxed)) {
+      auto frames = snd_pcm_writei(pcm, data, remaining);
+
+      if (frames < 0) {
+        // Recovers from underruns (and suspends), after which the device starts over once the buffer is filled again.
+        frames = snd_pcm_recover(pcm, int(frames), 1);
+
+        if (frames < 0) {
+          Log<Error>("Audio: ALSA: snd_pcm_writei() failed: {}", snd_strerror(int(frames)));
+          running = false;
+          break;
+        }
+        continue;
+      }
+
+      data += frames * 2;
+      remaining -= frames;
+    }
+
+    snd_pcm_sframes_t delay;
+
+    if (snd_pcm_delay(pcm, &delay) == 0 && delay >= 0) {
+      latency.store(int(delay), std::memory_order_relaxed);
+    }
+  }
+}
+
+void ALSA_AudioDevice::SetPause(bool value) {
+  paused = value;
+}
+
+void ALSA_AudioDevice::Close() {
+  if (pcm == nullptr) {
+    return;
+  }
+
+  running = false;
+
+  if (thread.joinable()) {
+    thread.join();
+  }
+
+  snd_pcm_drop(pcm);
+  snd_pcm_close(pcm);
+  pcm = nullptr;
+}
+
+} // namespace nba
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <nba/log.hpp>
+#include <platform/device/audio_device_factory.hpp>
+#include <platform/device/sdl_audio_device.hpp>
+
+#if defined(NBA_AUDIO_ALSA)
+  #include <platform/device/alsa_audio_device.hpp>
+#elif defined(NBA_AUDIO_WASAPI)
+  #include <platform/device/wasapi_audio_device.hpp>
+#elif defined(NBA_AUDIO_COREAUDIO)
+  #include <platform/device/coreaudio_audio_device.hpp>
+#endif
+
+namespace nba {
+
+namespace {
+
+// Every backend takes the sample rate, the period and the thread policy, the rest is specific to each of them.
+template<typename T>
+auto Configure(std::shared_ptr<T> device, PlatformConfig const& config) -> std::shared_ptr<AudioDevice> {
+  auto const& output = config.audio_output;
+
+  device->SetSampleRate(output.sample_rate);
+  if (output.block_size > 0) {
+    device->SetBlockSize(output.block_size);
+  }
+  device->SetThreadPolicy(config.threads.audio);
+  return device;
+}
+
+auto CreateNativeAudioDevice(PlatformConfig const& config) -> std::shared_ptr<AudioDevice> {
+#if defined(NBA_AUDIO_ALSA)
+  auto device = std::make_shared<ALSA_AudioDevice>();
+
+  if (!config.audio_output.device.empty()) {
+    device->SetDeviceName(config.audio_output.device);
+  }
+  return Configure(device, config);
+#elif defined(NBA_AUDIO_WASAPI)
+  auto device = std::make_shared<WASAPI_AudioDevice>();
+
+  device->SetExclusive(config.audio_output.exclusive);
+  return Configure(device, config);
+#elif defined(NBA_AUDIO_COREAUDIO)
+  return Configure(std::make_shared<CoreAudio_AudioDevice>(), config);
+#else
+  return nullptr;
+#endif
+}
+
+} // namespace nba::(anonymous)
+
+auto CreateAudioDevice(PlatformConfig const& config) -> std::shared_ptr<AudioDevice> {
+  if (config.audio_output.backend == PlatformConfig::AudioOutput::Backend::Native) {
+    if (auto device = CreateNativeAudioDevice(config)) {
+      return device;
+    }
+    Log<Warn>("Audio: no native audio backend was built in, using SDL.");
+  }
+
+  return Configure(std::make_shared<SDL2_AudioDevice>(), config);
+}
+
+} // namespace nba
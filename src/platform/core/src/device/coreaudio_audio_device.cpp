@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <CoreAudio/CoreAudio.h>
+#include <nba/log.hpp>
+#include <platform/device/coreaudio_audio_device.hpp>
+
+namespace nba {
+
+namespace {
+
+// kAudioObjectPropertyElementMain, which SDKs before macOS 12 call kAudioObjectPropertyElementMaster.
+constexpr AudioObjectPropertyElement kElementMain = 0;
+
+auto GetDeviceProperty(AudioDeviceID device, AudioObjectPropertySelector selector, UInt32& value) -> bool {
+  auto address = AudioObjectPropertyAddress{selector, kAudioObjectPropertyScopeOutput, kElementMain};
+  auto size = UInt32(sizeof(value));
+
+  return AudioObjectGetPropertyData(device, &address, 0, nullptr, &size, &value) == noErr;
+}
+
+} // namespace nba::(anonymous)
+
+CoreAudio_AudioDevice::~CoreAudio_AudioDevice() {
+  Close();
+}
+
+void CoreAudio_AudioDevice::SetSampleRate(int sample_rate) {
+  want_sample_rate = sample_rate;
+}
+
+void CoreAudio_AudioDevice::SetBlockSize(int block_size) {
+  want_block_size = block_size;
+}
+
+void CoreAudio_AudioDevice::SetThreadPolicy(ThreadPolicy const& policy) {
+  thread_policy = policy;
+}
+
+auto CoreAudio_AudioDevice::GetSampleRate() -> int {
+  return sample_rate;
+}
+
+auto CoreAudio_AudioDevice::GetBlockSize() -> int {
+  return block_size;
+}
+
+auto CoreAudio_AudioDevice::GetLatency() -> int {
+  return latency;
+}
+
+auto CoreAudio_AudioDevice::RenderCallback(
+  void* userdata,
+  AudioUnitRenderActionFlags* flags,
+  AudioTimeStamp const* timestamp,
+  UInt32 bus,
+  UInt32 frames,
+  AudioBufferList* data
+) -> OSStatus {
+  auto device = (CoreAudio_AudioDevice*)userdata;
+  auto& buffer = data->mBuffers[0];
+
+  // Core Audio creates the I/O thread itself, so the policy can only be applied from within it.
+  if (!device->thread_policy_applied) {
+    device->thread_policy.ApplyToCurrentThread(ThreadPolicy::Role::Audio);
+    device->thread_policy_applied = true;
+  }
+
+  device->callback(device->callback_userdata, (s16*)buffer.mData, int(buffer.mDataByteSize));
+  return noErr;
+}
+
+bool CoreAudio_AudioDevice::Open(void* userdata, Callback callback) {
+  auto description = AudioComponentDescription{};
+
+  description.componentType = kAudioUnitType_Output;
+  description.componentSubType = kAudioUnitSubType_DefaultOutput;
+  description.componentManufacturer = kAudioUnitManufacturer_Apple;
+
+  auto component = AudioComponentFindNext(nullptr, &description);
+
+  if (component == nullptr || AudioComponentInstanceNew(component, &unit) != noErr) {
+    Log<Error>("Audio: Core Audio: cannot create the default output unit.");
+    unit = nullptr;
+    return false;
+  }
+
+  auto fail = [&](char const* what, OSStatus status) {
+    Log<Error>("Audio: Core Audio: {} failed ({}).", what, int(status));
+    AudioComponentInstanceDispose(unit);
+    unit = nullptr;
+    return false;
+  };
+
+  auto format = AudioStreamBasicDescription{};
+
+  format.mSampleRate = want_sample_rate;
+  format.mFormatID = kAudioFormatLinearPCM;
+  format.mFormatFlags = kLinearPCMFormatFlagIsSignedInteger | kLinearPCMFormatFlagIsPacked;
+  format.mChannelsPerFrame = 2;
+  format.mBitsPerChannel = 16;
+  format.mFramesPerPacket = 1;
+  format.mBytesPerFrame = format.mChannelsPerFrame * sizeof(s16);
+  format.mBytesPerPacket = format.mBytesPerFrame;
+
+  auto status = AudioUnitSetProperty(unit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &format, sizeof(format));
+
+  if (status != noErr) {
+    return fail("setting the stream format", status);
+  }
+
+  auto render_callback = AURenderCallbackStruct{RenderCallback, this};
+
+  status = AudioUnitSetProperty(unit, kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, 0, &render_callback, sizeof(render_callback));
+
+  if (status != noErr) {
+    return fail("setting the render callback", status);
+  }
+
+  this->callback = callback;
+  callback_userdata = userdata;
+  thread_policy_applied = false;
+  sample_rate = want_sample_rate;
+
+  if ((status = AudioUnitInitialize(unit)) != noErr) {
+    return fail("AudioUnitInitialize()", status);
+  }
+
+  SetupDevice();
+
+  if (!paused && (status = AudioOutputUnitStart(unit)) != noErr) {
+    AudioUnitUninitialize(unit);
+    return fail("AudioOutputUnitStart()", status);
+  }
+  return true;
+}
+
+/* Shrinks the I/O buffer of the device (by default 512 frames) and works out the latency from what the device reports.
+ * Both are counted in frames at the sample rate of the device, which may differ from ours.
+ */
+void CoreAudio_AudioDevice::SetupDevice() {
+  AudioDeviceID device;
+  UInt32 size = sizeof(device);
+
+  block_size = want_block_size;
+  latency = want_block_size * 2;
+
+  if (AudioUnitGetProperty(unit, kAudioOutputUnitProperty_CurrentDevice, kAudioUnitScope_Global, 0, &device, &size) != noErr) {
+    Log<Warn>("Audio: Core Audio: cannot query the output device, assuming a period of {} frames.", block_size);
+    return;
+  }
+
+  auto address = AudioObjectPropertyAddress{kAudioDevicePropertyNominalSampleRate, kAudioObjectPropertyScopeGlobal, kElementMain};
+  Float64 device_rate = sample_rate;
+
+  size = sizeof(device_rate);
+  AudioObjectGetPropertyData(device, &address, 0, nullptr, &size, &device_rate);
+
+  auto frame_count = UInt32(want_block_size * device_rate / sample_rate);
+
+  address = {kAudioDevicePropertyBufferFrameSize, kAudioObjectPropertyScopeGlobal, kElementMain};
+
+  if (AudioObjectSetPropertyData(device, &address, 0, nullptr, sizeof(frame_count), &frame_count) != noErr) {
+    Log<Warn>("Audio: Core Audio: cannot set the I/O buffer size to {} frames.", frame_count);
+  }
+
+  UInt32 buffer_frames = frame_count;
+  UInt32 device_latency = 0;
+  UInt32 safety_offset = 0;
+
+  GetDeviceProperty(device, kAudioDevicePropertyBufferFrameSize, buffer_frames);
+  GetDeviceProperty(device, kAudioDevicePropertyLatency, device_latency);
+  GetDeviceProperty(device, kAudioDevicePropertySafetyOffset, safety_offset);
+
+  // A period is rendered one I/O cycle ahead of being played.
+  auto to_frames = [&](UInt32 device_frames) {
+    return int(device_frames * sample_rate / device_rate);
+  };
+
+  block_size = to_frames(buffer_frames);
+  latency = to_frames(buffer_frames * 2 + device_latency + safety_offset);
+
+  Log<Info>("Audio: Core Audio: period of {} frames, latency of {} frames at {} Hz.", block_size, latency, sample_rate);
+}
+
+void CoreAudio_AudioDevice::SetPause(bool value) {
+  if (unit != nullptr && value != paused) {
+    if (value) {
+      AudioOutputUnitStop(unit);
+    } else {
+      AudioOutputUnitStart(unit);
+    }
+  }
+  paused = value;
+}
+
+void CoreAudio_AudioDevice::Close() {
+  if (unit == nullptr) {
+    return;
+  }
+
+  AudioOutputUnitStop(unit);
+  AudioUnitUninitialize(unit);
+  AudioComponentInstanceDispose(unit);
+  unit = nullptr;
+}
+
+} // namespace nba
@@ -5,10 +5,13 @@
  * Refer to the included LICENSE file.
  */
 
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
 #include <fmt/format.h>
 #include <fstream>
 #include <nba/log.hpp>
+#include <nba/trace.hpp>
 #include <platform/device/ogl_video_device.hpp>
 #include <memory>
 
@@ -16,6 +19,8 @@
 #include "device/shader/color_agb.glsl.hpp"
 #include "device/shader/lcd_ghosting.glsl.hpp"
 #include "device/shader/output.glsl.hpp"
+#include "device/shader/overlay.glsl.hpp"
+#include "device/shader/ppu.glsl.hpp"
 #include "device/shader/xbrz.glsl.hpp"
 
 using Video = nba::PlatformConfig::Video;
@@ -37,10 +42,16 @@ OGLVideoDevice::OGLVideoDevice(std::shared_ptr<PlatformConfig> config) : config(
 
 OGLVideoDevice::~OGLVideoDevice() {
   ReleaseShaderPrograms();
+  ReleasePPURenderer();
+  ReleaseProgramCache();
+  ReleasePixelBuffers();
   glDeleteVertexArrays(1, &quad_vao);
   glDeleteBuffers(1, &quad_vbo);
   glDeleteFramebuffers(1, &fbo);
   glDeleteTextures(4, texture);
+  glDeleteTextures(1, &xbrz_info_texture);
+  glDeleteTextures(1, &overlay_texture);
+  glDeleteQueries(kTimerQueryCount, timer_queries);
 }
 
 void OGLVideoDevice::Initialize() {
@@ -67,14 +78,243 @@ void OGLVideoDevice::Initialize() {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   }
 
+  // The LCD screen texture is only ever updated in place.
+  glBindTexture(GL_TEXTURE_2D, texture[3]);
+  glTexImage2D(
+    GL_TEXTURE_2D, 0, GL_RGBA, kFrameWidth * frame_scale, kFrameHeight * frame_scale, 0, GL_BGRA, GL_UNSIGNED_BYTE, nullptr
+  );
+
+  CreatePixelBuffers();
+
+  glGenTextures(1, &xbrz_info_texture);
+  glBindTexture(GL_TEXTURE_2D, xbrz_info_texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexImage2D(
+    GL_TEXTURE_2D, 0, GL_RGBA, kFrameWidth, kFrameHeight, 0, GL_BGRA, GL_UNSIGNED_BYTE, nullptr
+  );
+
+  glGenQueries(kTimerQueryCount, timer_queries);
+
+  if (GLEW_ARB_get_program_binary) {
+    GLint format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+    program_binary_supported = format_count > 0;
+  }
+
+  CreatePPURenderer();
+
   glClearColor(0, 0, 0, 1);
   glClear(GL_COLOR_BUFFER_BIT);
 
   ReloadConfig();
 }
 
+/* Frames are uploaded through a ring of pixel buffers, so that copying a frame
+ * into one buffer does not have to wait for the GPU to finish reading the previous one.
+ * The buffers are persistently mapped if ARB_buffer_storage (GL 4.4) is available,
+ * otherwise they are orphaned and mapped again for each frame.
+ */
+void OGLVideoDevice::CreatePixelBuffers() {
+  pixel_buffers_persistent = GLEW_ARB_buffer_storage;
+  pixel_buffer_index = 0;
+
+  for (auto& pixel_buffer : pixel_buffers) {
+    glGenBuffers(1, &pixel_buffer.buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer.buffer);
+
+    if (pixel_buffers_persistent) {
+      auto flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+      glBufferStorage(GL_PIXEL_UNPACK_BUFFER, GetFrameSize(), nullptr, flags);
+      pixel_buffer.mapping = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GetFrameSize(), flags);
+
+      if (pixel_buffer.mapping == nullptr) {
+        Log<Warn>("OGLVideoDevice: failed to map pixel buffer persistently.");
+      }
+    } else {
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, GetFrameSize(), nullptr, GL_STREAM_DRAW);
+    }
+  }
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void OGLVideoDevice::ReleasePixelBuffers() {
+  for (auto& pixel_buffer : pixel_buffers) {
+    if (pixel_buffer.fence != nullptr) {
+      glDeleteSync(pixel_buffer.fence);
+    }
+
+    if (pixel_buffer.mapping != nullptr) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer.buffer);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    glDeleteBuffers(1, &pixel_buffer.buffer);
+    pixel_buffer = {};
+  }
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+// Uploads the lines [line_min, line_max) of the frame, which are frame_scale rows each.
+void OGLVideoDevice::UploadFrame(u32 const* buffer, int line_min, int line_max) {
+  auto& pixel_buffer = pixel_buffers[pixel_buffer_index];
+
+  pixel_buffer_index = (pixel_buffer_index + 1) % kPixelBufferCount;
+
+  int width = kFrameWidth * frame_scale;
+  int row = line_min * frame_scale;
+  int rows = (line_max - line_min) * frame_scale;
+  size_t offset = row * width * sizeof(u32);
+  size_t size = rows * width * sizeof(u32);
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer.buffer);
+
+  void* data = pixel_buffer.mapping;
+
+  if (data != nullptr) {
+    // The buffer was last used kPixelBufferCount frames ago, so this is unlikely to wait.
+    if (pixel_buffer.fence != nullptr) {
+      glClientWaitSync(pixel_buffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+      glDeleteSync(pixel_buffer.fence);
+      pixel_buffer.fence = nullptr;
+    }
+  } else {
+    data = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GetFrameSize(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  }
+
+  if (data != nullptr) {
+    std::memcpy((u8*)data + offset, (u8 const*)buffer + offset, size);
+
+    if (pixel_buffer.mapping == nullptr) {
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    // Source the texture update from the same offset of the bound pixel buffer.
+    glTexSubImage2D(
+      GL_TEXTURE_2D, 0, 0, row, width, rows, GL_BGRA, GL_UNSIGNED_BYTE, (void*)offset
+    );
+
+    if (pixel_buffer.mapping != nullptr) {
+      pixel_buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  } else {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glTexSubImage2D(
+      GL_TEXTURE_2D, 0, 0, row, width, rows, GL_BGRA, GL_UNSIGNED_BYTE, buffer + row * width
+    );
+  }
+}
+
+void OGLVideoDevice::CreatePPURenderer() {
+  auto [success, program] = CompileProgram(ppu_vert, ppu_frag);
+
+  if (!success) {
+    Log<Warn>("OGLVideoDevice: GPU renderer is unavailable.");
+    return;
+  }
+
+  ppu_program = program;
+
+  glGenTextures(kPPUTextureCount, ppu_textures);
+
+  for (auto texture : ppu_textures) {
+    // Integer textures are incomplete with any filter other than GL_NEAREST.
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  }
+
+  // VRAM is 0x18000 bytes, which are laid out as 96 rows of 1024 bytes.
+  glBindTexture(GL_TEXTURE_2D, ppu_textures[kPPUTextureVRAM]);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, 1024, 96, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+
+  glBindTexture(GL_TEXTURE_2D, ppu_textures[kPPUTexturePRAM]);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, 0x200, kFrameHeight, 0, GL_RED_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+
+  glBindTexture(GL_TEXTURE_2D, ppu_textures[kPPUTextureOAM]);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, 0x200, 1, 0, GL_RED_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+
+  glBindTexture(GL_TEXTURE_2D, ppu_textures[kPPUTextureLines]);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R32I, kPPULineWords, kFrameHeight, 0, GL_RED_INTEGER, GL_INT, nullptr);
+
+  glUseProgram(ppu_program);
+  glUniform1i(glGetUniformLocation(ppu_program, "u_vram"), kPPUTextureVRAM);
+  glUniform1i(glGetUniformLocation(ppu_program, "u_pram"), kPPUTexturePRAM);
+  glUniform1i(glGetUniformLocation(ppu_program, "u_oam"), kPPUTextureOAM);
+  glUniform1i(glGetUniformLocation(ppu_program, "u_lines"), kPPUTextureLines);
+}
+
+void OGLVideoDevice::ReleasePPURenderer() {
+  // The program itself is owned by the program cache.
+  glDeleteTextures(kPPUTextureCount, ppu_textures);
+  ppu_program = 0;
+}
+
+void OGLVideoDevice::RenderPPUFrame(PPUFrame const& frame) {
+  NBA_TRACE_ZONE("OGLVideoDevice::RenderPPUFrame");
+
+  // Must match the LINE_* offsets in the shader.
+  for (int y = 0; y < kFrameHeight; y++) {
+    auto const& line = frame.lines[y];
+    auto words = ppu_lines[y];
+
+    words[0] = line.dispcnt;
+
+    for (int i = 0; i < 4; i++) {
+      words[1 + i] = line.bgcnt[i];
+      words[5 + i] = line.bghofs[i];
+      words[9 + i] = line.bgvofs[i];
+    }
+
+    for (int i = 0; i < 2; i++) {
+      words[13 + i] = line.bgx[i];
+      words[15 + i] = line.bgy[i];
+      words[17 + i] = line.bgpa[i];
+      words[19 + i] = line.bgpc[i];
+      words[21 + i] = line.winh[i];
+      words[26 + i] = line.mosaic_bg[i];
+      words[28 + i] = line.mosaic_obj[i];
+      words[34 + i] = line.bgpb[i];
+      words[36 + i] = line.bgpd[i];
+    }
+
+    words[23] = line.win_active;
+    words[24] = line.winin;
+    words[25] = line.winout;
+    words[30] = line.bldcnt;
+    words[31] = line.eva;
+    words[32] = line.evb;
+    words[33] = line.evy;
+  }
+
+  auto upload = [&](PPUTexture id, int width, int height, GLenum type, void const* data) {
+    glActiveTexture(GL_TEXTURE0 + id);
+    glBindTexture(GL_TEXTURE_2D, ppu_textures[id]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RED_INTEGER, type, data);
+  };
+
+  upload(kPPUTextureVRAM, 1024, 96, GL_UNSIGNED_BYTE, frame.vram);
+  upload(kPPUTexturePRAM, 0x200, kFrameHeight, GL_UNSIGNED_SHORT, frame.pram);
+  upload(kPPUTextureOAM, 0x200, 1, GL_UNSIGNED_SHORT, frame.oam);
+  upload(kPPUTextureLines, kPPULineWords, kFrameHeight, GL_INT, ppu_lines);
+
+  glUseProgram(ppu_program);
+  glUniform1i(glGetUniformLocation(ppu_program, "u_scale"), frame_scale);
+  glViewport(0, 0, kFrameWidth * frame_scale, kFrameHeight * frame_scale);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture[3], 0);
+  glBindVertexArray(quad_vao);
+  glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
 void OGLVideoDevice::ReloadConfig() {
   texture_filter_invalid = true;
+  overlay_enabled = config->video.frame_stats_overlay;
 
   if (config->video.filter == Video::Filter::Linear) {
     texture_filter = GL_LINEAR;
@@ -88,8 +328,21 @@ void OGLVideoDevice::ReloadConfig() {
 void OGLVideoDevice::CreateShaderPrograms() {
   auto const& video = config->video;
 
+  if (programs_valid &&
+      programs_filter == video.filter &&
+      programs_color == video.color &&
+      programs_lcd_ghosting == video.lcd_ghosting) {
+    return;
+  }
+
   ReleaseShaderPrograms();
 
+  xbrz_enabled = false;
+  programs_valid = true;
+  programs_filter = video.filter;
+  programs_color = video.color;
+  programs_lcd_ghosting = video.lcd_ghosting;
+
   // xBRZ freescale upsampling filter (two passes)
   if (video.filter == Video::Filter::xBRZ) {
     auto [success0, program0] = CompileProgram(xbrz0_vert, xbrz0_frag);
@@ -98,9 +351,7 @@ void OGLVideoDevice::CreateShaderPrograms() {
     if (success0 && success1) {
       programs.push_back(program0);
       programs.push_back(program1);
-    } else {
-      if (success0) glDeleteProgram(program0);
-      if (success1) glDeleteProgram(program1);
+      xbrz_enabled = true;
     }
   }
 
@@ -155,13 +406,39 @@ void OGLVideoDevice::CreateShaderPrograms() {
       glUniform1i(source_map, 2);
     }
   }
+
+  UpdateOutputSizeUniforms();
+}
+
+void OGLVideoDevice::UpdateOutputSizeUniforms() {
+  for (auto program : programs) {
+    auto output_size = glGetUniformLocation(program, "u_output_size");
+    if (output_size != -1) {
+      glUseProgram(program);
+      glUniform2f(output_size, (float)view_width, (float)view_height);
+    }
+  }
+}
+
+auto OGLVideoDevice::GetGPUFrameTime() const -> float {
+  return gpu_frame_time;
+}
+
+void OGLVideoDevice::SetFrameStats(std::shared_ptr<FrameStats> frame_stats) {
+  this->frame_stats = frame_stats;
 }
 
 void OGLVideoDevice::ReleaseShaderPrograms() {
-  for (auto program : programs) {   
+  // The programs themselves are owned by the program cache.
+  programs.clear();
+  programs_valid = false;
+}
+
+void OGLVideoDevice::ReleaseProgramCache() {
+  for (auto [key, program] : program_cache) {
     glDeleteProgram(program);
   }
-  programs.clear();
+  program_cache.clear();
 }
 
 auto OGLVideoDevice::CompileShader(
@@ -194,6 +471,18 @@ auto OGLVideoDevice::CompileProgram(
   char const* vertex_src,
   char const* fragment_src
 ) -> std::pair<bool, GLuint> {
+  auto key = GetProgramKey(vertex_src, fragment_src);
+  auto match = program_cache.find(key);
+
+  if (match != program_cache.end()) {
+    return std::make_pair(true, match->second);
+  }
+
+  if (auto prog_id = LoadProgramBinary(key); prog_id != 0) {
+    program_cache[key] = prog_id;
+    return std::make_pair(true, prog_id);
+  }
+
   auto [vert_success, vert_id] = CompileShader(GL_VERTEX_SHADER, vertex_src);
   auto [frag_success, frag_id] = CompileShader(GL_FRAGMENT_SHADER, fragment_src);
   
@@ -202,16 +491,124 @@ auto OGLVideoDevice::CompileProgram(
   } else {
     auto prog_id = glCreateProgram();
 
+    if (program_binary_supported) {
+      glProgramParameteri(prog_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
     glAttachShader(prog_id, vert_id);
     glAttachShader(prog_id, frag_id);
     glLinkProgram(prog_id);
     glDeleteShader(vert_id);
     glDeleteShader(frag_id);
 
+    program_cache[key] = prog_id;
+    SaveProgramBinary(key, prog_id);
+
     return std::make_pair(true, prog_id);
   }
 }
 
+// Program binaries are only valid for the driver that created them, so the driver is part of the key.
+auto OGLVideoDevice::GetProgramKey(char const* vertex_src, char const* fragment_src) -> u64 {
+  u64 hash = 0xCBF29CE484222325;
+
+  auto update = [&](char const* string) {
+    if (string != nullptr) {
+      while (*string != '\0') {
+        hash = (hash ^ u8(*string++)) * 0x100000001B3;
+      }
+    }
+    // Separate the strings, so that moving characters between them changes the hash.
+    hash = (hash ^ 0xFF) * 0x100000001B3;
+  };
+
+  update(vertex_src);
+  update(fragment_src);
+  update((char const*)glGetString(GL_VENDOR));
+  update((char const*)glGetString(GL_RENDERER));
+  update((char const*)glGetString(GL_VERSION));
+
+  return hash;
+}
+
+auto OGLVideoDevice::GetProgramBinaryPath(u64 key) -> std::string {
+  return fmt::format("{}/{:016X}.bin", kProgramCachePath, key);
+}
+
+auto OGLVideoDevice::LoadProgramBinary(u64 key) -> GLuint {
+  if (!program_binary_supported || !config->video.shader_cache) {
+    return 0;
+  }
+
+  std::ifstream file{GetProgramBinaryPath(key), std::ios::binary | std::ios::ate};
+
+  if (!file.good()) {
+    return 0;
+  }
+
+  auto size = (size_t)file.tellg();
+
+  if (size <= sizeof(GLenum)) {
+    return 0;
+  }
+
+  GLenum format;
+  std::vector<char> binary(size - sizeof(GLenum));
+
+  file.seekg(0);
+  file.read((char*)&format, sizeof(GLenum));
+  file.read(binary.data(), binary.size());
+
+  if (!file.good()) {
+    return 0;
+  }
+
+  auto prog_id = glCreateProgram();
+  GLint linked = GL_FALSE;
+
+  glProgramBinary(prog_id, format, binary.data(), (GLsizei)binary.size());
+  glGetProgramiv(prog_id, GL_LINK_STATUS, &linked);
+
+  // The binary is rejected if e.g. the driver was updated, in which case the program is built from source.
+  if (linked == GL_FALSE) {
+    glDeleteProgram(prog_id);
+    return 0;
+  }
+
+  return prog_id;
+}
+
+void OGLVideoDevice::SaveProgramBinary(u64 key, GLuint program) {
+  if (!program_binary_supported || !config->video.shader_cache) {
+    return;
+  }
+
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+  if (length <= 0) {
+    return;
+  }
+
+  GLenum format;
+  std::vector<char> binary(length);
+
+  glGetProgramBinary(program, length, &length, &format, binary.data());
+
+  std::error_code error;
+  std::filesystem::create_directories(kProgramCachePath, error);
+
+  std::ofstream file{GetProgramBinaryPath(key), std::ios::binary};
+
+  if (!file.good()) {
+    Log<Warn>("OGLVideoDevice: failed to write program binary to {}.", GetProgramBinaryPath(key));
+    return;
+  }
+
+  file.write((char const*)&format, sizeof(GLenum));
+  file.write(binary.data(), length);
+}
+
 void OGLVideoDevice::SetViewport(int x, int y, int width, int height) {
   view_x = x;
   view_y = y;
@@ -232,21 +629,114 @@ void OGLVideoDevice::SetViewport(int x, int y, int width, int height) {
       nullptr
     );
   }
+
+  UpdateOutputSizeUniforms();
+}
+
+void OGLVideoDevice::SetFrameScale(int scale) {
+  scale = std::clamp(scale, 1, kMaxFrameScale);
+
+  if (scale == frame_scale) {
+    return;
+  }
+
+  frame_scale = scale;
+  screen_texture_valid = false;
+
+  ReleasePixelBuffers();
+  CreatePixelBuffers();
+
+  glBindTexture(GL_TEXTURE_2D, texture[3]);
+  glTexImage2D(
+    GL_TEXTURE_2D, 0, GL_RGBA, kFrameWidth * frame_scale, kFrameHeight * frame_scale, 0, GL_BGRA, GL_UNSIGNED_BYTE, nullptr
+  );
 }
 
 void OGLVideoDevice::SetDefaultFBO(GLuint fbo) {
   default_fbo = fbo;
 }
 
+void OGLVideoDevice::SetDirtyLines(std::bitset<VideoDevice::kFrameHeight> const& lines) {
+  dirty_lines = lines;
+}
+
 void OGLVideoDevice::Draw(u32* buffer) {
+  NBA_TRACE_ZONE("OGLVideoDevice::Draw");
+
+  BeginTimerQuery();
+
+  if (!screen_texture_valid) {
+    dirty_lines.set();
+  }
+
+  // Upload the range from the first to the last changed line, if any.
+  int line_min = 0;
+  int line_max = kFrameHeight;
+
+  while (line_min < line_max && !dirty_lines[line_min]) {
+    line_min++;
+  }
+
+  while (line_max > line_min && !dirty_lines[line_max - 1]) {
+    line_max--;
+  }
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, texture[3]);
+
+  if (line_min < line_max) {
+    UploadFrame(buffer, line_min, line_max);
+  }
+
+  // Callers that do not track changed lines upload every frame in full.
+  dirty_lines.set();
+  screen_texture_valid = true;
+
+  PostProcess();
+  glEndQuery(GL_TIME_ELAPSED);
+  DrawOverlay();
+}
+
+void OGLVideoDevice::Draw(PPUFrame const& frame) {
+  NBA_TRACE_ZONE("OGLVideoDevice::Draw");
+
+  BeginTimerQuery();
+  RenderPPUFrame(frame);
+  screen_texture_valid = false;
+  PostProcess();
+  glEndQuery(GL_TIME_ELAPSED);
+  DrawOverlay();
+}
+
+void OGLVideoDevice::BeginTimerQuery() {
+  auto query = timer_queries[timer_query_index];
+  auto& query_pending = timer_query_pending[timer_query_index];
+
+  timer_query_index = (timer_query_index + 1) % kTimerQueryCount;
+
+  if (query_pending) {
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+    if (available) {
+      GLuint64 nanoseconds = 0;
+      glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+      gpu_frame_time = gpu_frame_time * 0.9f + (nanoseconds / 1e6f) * 0.1f;
+    }
+  }
+
+  // If the result did not arrive in time, reusing the query simply drops that sample.
+  glBeginQuery(GL_TIME_ELAPSED, query);
+  query_pending = true;
+}
+
+// Runs the post-processing passes on the LCD screen texture and outputs the result to the viewport.
+void OGLVideoDevice::PostProcess() {
   int target = 0;
 
-  // Update and bind LCD screen texture
+  // Bind LCD screen texture
   glActiveTexture(GL_TEXTURE0);
   glBindTexture(GL_TEXTURE_2D, texture[3]);
-  glTexImage2D(
-    GL_TEXTURE_2D, 0, GL_RGBA, 240, 160, 0, GL_BGRA, GL_UNSIGNED_BYTE, buffer
-  );
   if (texture_filter_invalid) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture_filter);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, texture_filter);
@@ -273,9 +763,15 @@ void OGLVideoDevice::Draw(u32* buffer) {
   for (int i = 0; i < program_count; i++) {
     glUseProgram(programs[i]);
 
+    bool xbrz_info_pass = xbrz_enabled && i == 0;
+
     if (i == program_count - 1) {
       glViewport(view_x, view_y, view_width, view_height);
       glBindFramebuffer(GL_FRAMEBUFFER, default_fbo);
+    } else if (xbrz_info_pass) {
+      glViewport(0, 0, kFrameWidth, kFrameHeight);
+      glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, xbrz_info_texture, 0);
     } else {
       glBindFramebuffer(GL_FRAMEBUFFER, fbo);
       glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture[target], 0);
@@ -285,7 +781,13 @@ void OGLVideoDevice::Draw(u32* buffer) {
 
     // Output of the current pass is the input for the next pass.
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture[target]);
+
+    if (xbrz_info_pass) {
+      glViewport(0, 0, view_width, view_height);
+      glBindTexture(GL_TEXTURE_2D, xbrz_info_texture);
+    } else {
+      glBindTexture(GL_TEXTURE_2D, texture[target]);
+    }
 
     if (i == program_count - 3) {
       /* The next pass is the next-to-last pass, before we render to screen.
@@ -299,4 +801,74 @@ void OGLVideoDevice::Draw(u32* buffer) {
   }
 }
 
+/* Draws the frame stats overlay over the top left quarter of the viewport, in a single pass
+ * that reads the recent frame and emulation times from a small float texture. Not included in the GPU frame time.
+ */
+void OGLVideoDevice::DrawOverlay() {
+  if (!overlay_enabled || !frame_stats) {
+    return;
+  }
+
+  NBA_TRACE_ZONE("OGLVideoDevice::DrawOverlay");
+
+  if (overlay_program == 0) {
+    auto [success, program] = CompileProgram(overlay_vert, overlay_frag);
+
+    if (!success) {
+      Log<Warn>("OGLVideoDevice: frame stats overlay is unavailable.");
+      overlay_enabled = false;
+      return;
+    }
+
+    overlay_program = program;
+    overlay_snapshot = std::make_unique<FrameStats::Snapshot>();
+
+    glGenTextures(1, &overlay_texture);
+    glBindTexture(GL_TEXTURE_2D, overlay_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, FrameStats::kHistoryLength, 2, 0, GL_RED, GL_FLOAT, nullptr);
+
+    glUseProgram(overlay_program);
+    glUniform1i(glGetUniformLocation(overlay_program, "u_history"), 0);
+  }
+
+  auto& snapshot = *overlay_snapshot;
+
+  frame_stats->GetSnapshot(snapshot);
+
+  std::copy_n(snapshot.frame_ms, snapshot.presented_count, overlay_history[0]);
+  std::copy_n(snapshot.emulation_ms, snapshot.emulated_count, overlay_history[1]);
+
+  auto now = FrameStats::Clock::now();
+
+  if (snapshot.underruns != overlay_underruns) {
+    overlay_underruns = snapshot.underruns;
+    overlay_underrun_time = now;
+  }
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, overlay_texture);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, FrameStats::kHistoryLength, 2, GL_RED, GL_FLOAT, overlay_history);
+
+  glUseProgram(overlay_program);
+  glUniform1i(glGetUniformLocation(overlay_program, "u_frame_count"), snapshot.presented_count);
+  glUniform1i(glGetUniformLocation(overlay_program, "u_emulated_count"), snapshot.emulated_count);
+  glUniform1f(glGetUniformLocation(overlay_program, "u_frame_period"), snapshot.frame_period_ms);
+  glUniform1f(glGetUniformLocation(overlay_program, "u_audio_level"), snapshot.audio_level);
+  glUniform1i(glGetUniformLocation(overlay_program, "u_underrun"), now - overlay_underrun_time < kOverlayUnderrunTime);
+
+  int width = view_width / 2;
+  int height = view_height / 4;
+
+  glBindFramebuffer(GL_FRAMEBUFFER, default_fbo);
+  glViewport(view_x, view_y + view_height - height, width, height);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glBindVertexArray(quad_vao);
+  glDrawArrays(GL_TRIANGLES, 0, 6);
+  glDisable(GL_BLEND);
+  glViewport(view_x, view_y, view_width, view_height);
+}
+
 } // namespace nba
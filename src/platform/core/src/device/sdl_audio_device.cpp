@@ -28,6 +28,26 @@ void SDL2_AudioDevice::InvokeCallback(s16* stream, int byte_len) {
   }
 }
 
+void SDL2_AudioDevice::SetThreadPolicy(ThreadPolicy const& policy) {
+  thread_policy = policy;
+}
+
+void SDLCALL SDL2_AudioDevice::AudioCallback(void* userdata, Uint8* stream, int byte_len) {
+  auto device = (SDL2_AudioDevice*)userdata;
+
+  // SDL creates the audio thread itself, so the policy can only be applied from within it.
+  if (!device->thread_policy_applied) {
+    device->thread_policy.ApplyToCurrentThread(ThreadPolicy::Role::Audio);
+    device->thread_policy_applied = true;
+  }
+
+  if (device->passthrough != nullptr) {
+    device->passthrough(device, stream, byte_len);
+  } else {
+    device->callback(device->callback_userdata, (s16*)stream, byte_len);
+  }
+}
+
 auto SDL2_AudioDevice::GetSampleRate() -> int {
   return have.freq;
 }
@@ -49,16 +69,12 @@ bool SDL2_AudioDevice::Open(void* userdata, Callback callback) {
   want.format = AUDIO_S16;
   want.channels = 2;
 
-  if (passthrough != nullptr) {
-    want.callback = passthrough;
-    want.userdata = this;
-  } else {
-    want.callback = (SDL_AudioCallback)callback;
-    want.userdata = userdata;
-  }
+  want.callback = AudioCallback;
+  want.userdata = this;
 
   this->callback = callback;
   callback_userdata = userdata;
+  thread_policy_applied = false;
 
   device = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
 
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include "device/shader/common.glsl.hpp"
+
+constexpr auto overlay_vert = common_vert;
+
+/* Frame stats overlay: the frame times in the upper graph, the emulation times in the lower graph
+ * and the audio buffer level in the bar on the right. The newest frame is on the right edge.
+ * u_history holds the frame times in row 0 and the emulation times in row 1, in milliseconds and oldest first.
+ */
+constexpr auto overlay_frag = R"(
+  #version 330 core
+
+  layout(location = 0) out vec4 frag_color;
+
+  in vec2 v_uv;
+
+  uniform sampler2D u_history;
+  uniform int u_frame_count;
+  uniform int u_emulated_count;
+  uniform float u_frame_period;
+  uniform float u_audio_level;
+  uniform bool u_underrun;
+
+  // The height of a graph covers this many frame periods.
+  const float kGraphRange = 2.5;
+  const float kAudioBarWidth = 0.04;
+
+  const vec4 kBackground = vec4(0.0, 0.0, 0.0, 0.6);
+  const vec4 kGood = vec4(0.2, 0.9, 0.2, 0.9);
+  const vec4 kLate = vec4(0.9, 0.8, 0.1, 0.9);
+  const vec4 kBad = vec4(0.9, 0.2, 0.2, 0.9);
+  const vec4 kEmulation = vec4(0.2, 0.7, 0.9, 0.9);
+  const vec4 kTarget = vec4(1.0, 1.0, 1.0, 0.6);
+
+  void main() {
+    if (v_uv.x >= 1.0 - kAudioBarWidth) {
+      if (v_uv.y < u_audio_level) {
+        frag_color = u_underrun ? kBad : kEmulation;
+      } else {
+        frag_color = kBackground;
+      }
+      return;
+    }
+
+    bool frame_graph = v_uv.y >= 0.5;
+    float y = fract(v_uv.y * 2.0) * kGraphRange;
+    int length = textureSize(u_history, 0).x;
+    int count = frame_graph ? u_frame_count : u_emulated_count;
+    int index = int(v_uv.x / (1.0 - kAudioBarWidth) * float(length)) - (length - count);
+
+    frag_color = kBackground;
+
+    if (index >= 0) {
+      float frames = texelFetch(u_history, ivec2(index, frame_graph ? 0 : 1), 0).r / u_frame_period;
+
+      if (y < frames) {
+        if (frame_graph) {
+          frag_color = frames < 1.25 ? kGood : (frames < 1.75 ? kLate : kBad);
+        } else {
+          frag_color = frames < 1.0 ? kEmulation : kBad;
+        }
+      }
+    }
+
+    // Mark the nominal frame time.
+    if (abs(y - 1.0) < fwidth(y)) {
+      frag_color = kTarget;
+    }
+  }
+)";
@@ -0,0 +1,504 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include "device/shader/common.glsl.hpp"
+
+constexpr auto ppu_vert = common_vert;
+
+/* Renders a captured PPUFrame at u_scale times the native resolution, one fragment per pixel.
+ * Like in the software renderer, affine BGs and OBJs are sampled at the sub-pixel position of each fragment.
+ * This follows the software renderer of the core, including its quirks, so that both produce the same image.
+ * The exceptions are the OBJ cycle limit, which is not emulated, and the palette of OBJs,
+ * which is read on the line that they are displayed on rather than on the line before.
+ */
+constexpr auto ppu_frag = R"(
+  #version 330 core
+
+  layout(location = 0) out vec4 frag_color;
+
+  uniform usampler2D u_vram;
+  uniform usampler2D u_pram;
+  uniform usampler2D u_oam;
+  uniform isampler2D u_lines;
+  uniform int u_scale;
+
+  // Layout of a line in u_lines, see OGLVideoDevice::RenderPPUFrame().
+  #define LINE_DISPCNT 0
+  #define LINE_BGCNT 1
+  #define LINE_BGHOFS 5
+  #define LINE_BGVOFS 9
+  #define LINE_BGX 13
+  #define LINE_BGY 15
+  #define LINE_BGPA 17
+  #define LINE_BGPC 19
+  #define LINE_WINH 21
+  #define LINE_WIN_ACTIVE 23
+  #define LINE_WININ 24
+  #define LINE_WINOUT 25
+  #define LINE_MOSAIC_BG 26
+  #define LINE_MOSAIC_OBJ 28
+  #define LINE_BLDCNT 30
+  #define LINE_EVA 31
+  #define LINE_EVB 32
+  #define LINE_EVY 33
+  #define LINE_BGPB 34
+  #define LINE_BGPD 36
+
+  #define TRANSPARENT -1
+
+  #define LAYER_OBJ 4
+  #define LAYER_BD 5
+
+  #define SFX_NONE 0
+  #define SFX_BLEND 1
+  #define SFX_BRIGHTEN 2
+  #define SFX_DARKEN 3
+
+  const ivec2 kObjSize[16] = ivec2[16](
+    ivec2( 8,  8), ivec2(16, 16), ivec2(32, 32), ivec2(64, 64),
+    ivec2(16,  8), ivec2(32,  8), ivec2(32, 16), ivec2(64, 32),
+    ivec2( 8, 16), ivec2( 8, 32), ivec2(16, 32), ivec2(32, 64),
+    ivec2( 0,  0), ivec2( 0,  0), ivec2( 0,  0), ivec2( 0,  0)
+  );
+
+  struct ObjPixel {
+    int color;
+    int priority;
+    bool alpha;
+    bool window;
+  };
+
+  int line = 0;
+  ivec2 subpixel = ivec2(0);
+
+  int Reg(int word) {
+    return texelFetch(u_lines, ivec2(word, line), 0).r;
+  }
+
+  int Signed16(int value) {
+    return (value << 16) >> 16;
+  }
+
+  int ReadVRAM8(int address) {
+    address &= 0x1FFFF;
+    if (address >= 0x18000) {
+      address &= ~0x8000;
+    }
+    return int(texelFetch(u_vram, ivec2(address & 1023, address >> 10), 0).r);
+  }
+
+  int ReadVRAM16(int address) {
+    return ReadVRAM8(address) | (ReadVRAM8(address + 1) << 8);
+  }
+
+  int ReadOAM16(int index) {
+    return int(texelFetch(u_oam, ivec2(index, 0), 0).r);
+  }
+
+  int ReadPalette(int index) {
+    return int(texelFetch(u_pram, ivec2(index, line), 0).r) & 0x7FFF;
+  }
+
+  // Matches the wraparound of the software renderer, which maps negative multiples of the size to the size itself.
+  int Wrap(int value, int size) {
+    if (value >= size) {
+      return value % size;
+    }
+    if (value < 0) {
+      return size - ((-value) % size);
+    }
+    return value;
+  }
+
+  int RenderText(int id, int x) {
+    int bgcnt = Reg(LINE_BGCNT + id);
+    int y = Reg(LINE_BGVOFS + id) + line;
+
+    if ((bgcnt & 0x40) != 0) {
+      x -= x % Reg(LINE_MOSAIC_BG);
+      y -= Reg(LINE_MOSAIC_BG + 1);
+    }
+
+    int tex_x = (x + Reg(LINE_BGHOFS + id)) & 511;
+    int tex_y = y & 511;
+    int size = bgcnt >> 14;
+    int screen = 0;
+
+    if ((size & 1) != 0) {
+      screen += tex_x >> 8;
+    }
+
+    if ((size & 2) != 0) {
+      screen += (tex_y >> 8) << (size & 1);
+    }
+
+    int map_address = ((bgcnt >> 8) & 31) * 2048 + screen * 2048 + ((tex_y >> 3) & 31) * 64 + ((tex_x >> 3) & 31) * 2;
+    int encoder = ReadVRAM16(map_address);
+    int tile_base = ((bgcnt >> 2) & 3) * 16384;
+    int number = encoder & 0x3FF;
+    int tile_x = tex_x & 7;
+    int tile_y = tex_y & 7;
+
+    if ((encoder & 0x400) != 0) tile_x ^= 7;
+    if ((encoder & 0x800) != 0) tile_y ^= 7;
+
+    if ((bgcnt & 0x80) != 0) {
+      int index = ReadVRAM8(tile_base + number * 64 + tile_y * 8 + tile_x);
+      return index == 0 ? TRANSPARENT : ReadPalette(index);
+    }
+
+    int index = (ReadVRAM8(tile_base + number * 32 + tile_y * 4 + (tile_x >> 1)) >> ((tile_x & 1) * 4)) & 15;
+    return index == 0 ? TRANSPARENT : ReadPalette((encoder >> 12) * 16 + index);
+  }
+
+  // Offset of the sub-pixel position along the given affine parameters in 1/256 pixels, rounded towards zero.
+  int GetSubpixelOffset(int dx, int dy) {
+    int offset = dx * subpixel.x + dy * subpixel.y;
+
+    return offset < 0 ? -(-offset / u_scale) : offset / u_scale;
+  }
+
+  // Returns the texture coordinate of an affine BG (or bitmap), or -1 if the pixel is outside of the BG.
+  ivec2 GetAffineCoord(int id, int x, ivec2 size) {
+    int bgcnt = Reg(LINE_BGCNT + 2 + id);
+    int ref_x = Reg(LINE_BGX + id);
+    int ref_y = Reg(LINE_BGY + id);
+
+    if ((bgcnt & 0x40) != 0) {
+      x -= x % Reg(LINE_MOSAIC_BG);
+    } else {
+      ref_x += GetSubpixelOffset(Reg(LINE_BGPA + id), Reg(LINE_BGPB + id));
+      ref_y += GetSubpixelOffset(Reg(LINE_BGPC + id), Reg(LINE_BGPD + id));
+    }
+
+    int tex_x = (ref_x + Reg(LINE_BGPA + id) * x) >> 8;
+    int tex_y = (ref_y + Reg(LINE_BGPC + id) * x) >> 8;
+
+    if ((bgcnt & 0x2000) != 0) {
+      return ivec2(Wrap(tex_x, size.x), Wrap(tex_y, size.y));
+    }
+
+    if (tex_x < 0 || tex_y < 0 || tex_x >= size.x || tex_y >= size.y) {
+      return ivec2(-1);
+    }
+    return ivec2(tex_x, tex_y);
+  }
+
+  int RenderAffine(int id, int x) {
+    int bgcnt = Reg(LINE_BGCNT + 2 + id);
+    int size = 128 << (bgcnt >> 14);
+    ivec2 tex = GetAffineCoord(id, x, ivec2(size));
+
+    if (tex.x == -1) {
+      return TRANSPARENT;
+    }
+
+    int number = ReadVRAM8(((bgcnt >> 8) & 31) * 2048 + (tex.y >> 3) * (size >> 3) + (tex.x >> 3));
+    int index = ReadVRAM8(((bgcnt >> 2) & 3) * 16384 + number * 64 + (tex.y & 7) * 8 + (tex.x & 7));
+
+    return index == 0 ? TRANSPARENT : ReadPalette(index);
+  }
+
+  int RenderBitmap(int mode, int frame, int x) {
+    ivec2 size = mode == 5 ? ivec2(160, 128) : ivec2(240, 160);
+    ivec2 tex = GetAffineCoord(0, x, size);
+
+    if (tex.x == -1) {
+      return TRANSPARENT;
+    }
+
+    int color;
+
+    if (mode == 4) {
+      int index = ReadVRAM8(frame + tex.y * 240 + tex.x);
+      return index == 0 ? TRANSPARENT : ReadPalette(index);
+    } else if (mode == 5) {
+      color = ReadVRAM16(frame + tex.y * 320 + tex.x * 2);
+    } else {
+      color = ReadVRAM16(tex.y * 480 + tex.x * 2);
+    }
+
+    return color == 0x8000 ? TRANSPARENT : (color & 0x7FFF);
+  }
+
+  ObjPixel RenderOBJ(int dispcnt, int x) {
+    ObjPixel result = ObjPixel(TRANSPARENT, 4, false, false);
+
+    bool bitmap_mode = (dispcnt & 7) >= 3;
+    bool mapping_1d = (dispcnt & 0x40) != 0;
+    int mosaic_x = x - x % Reg(LINE_MOSAIC_OBJ);
+    int mosaic_y = Reg(LINE_MOSAIC_OBJ + 1);
+
+    for (int i = 0; i < 128; i++) {
+      int attr0 = ReadOAM16(i * 4 + 0);
+      int attr1 = ReadOAM16(i * 4 + 1);
+      int attr2 = ReadOAM16(i * 4 + 2);
+      int mode = (attr0 >> 10) & 3;
+      int shape = attr0 >> 14;
+
+      if ((attr0 & 0x300) == 0x200 || mode == 3 || shape == 3) {
+        continue;
+      }
+
+      ivec2 size = kObjSize[shape * 4 + (attr1 >> 14)];
+      ivec2 half_size = size >> 1;
+      bool affine = (attr0 & 0x100) != 0;
+
+      if (affine && (attr0 & 0x200) != 0) {
+        half_size *= 2;
+      }
+
+      int obj_x = attr1 & 0x1FF;
+      int obj_y = attr0 & 0xFF;
+
+      if (obj_x >= 240) obj_x -= 512;
+      if (obj_y >= 160) obj_y -= 256;
+
+      int local_x = x - obj_x - half_size.x;
+      int local_y = line - obj_y - half_size.y;
+
+      if (local_x < -half_size.x || local_x >= half_size.x ||
+          local_y < -half_size.y || local_y >= half_size.y) {
+        continue;
+      }
+
+      if ((attr0 & 0x1000) != 0) {
+        local_x = mosaic_x - obj_x - half_size.x;
+        local_y -= mosaic_y;
+      }
+
+      int pa = 0x100;
+      int pb = 0;
+      int pc = 0;
+      int pd = 0x100;
+      ivec2 offset = ivec2(0);
+
+      if (affine) {
+        int group = ((attr1 >> 9) & 31) * 16;
+
+        pa = Signed16(ReadOAM16(group +  3));
+        pb = Signed16(ReadOAM16(group +  7));
+        pc = Signed16(ReadOAM16(group + 11));
+        pd = Signed16(ReadOAM16(group + 15));
+
+        if ((attr0 & 0x1000) == 0) {
+          offset = ivec2(GetSubpixelOffset(pa, pb), GetSubpixelOffset(pc, pd));
+        }
+      }
+
+      int tex_x = ((pa * local_x + pb * local_y + offset.x) >> 8) + (size.x >> 1);
+      int tex_y = ((pc * local_x + pd * local_y + offset.y) >> 8) + (size.y >> 1);
+
+      if (tex_x < 0 || tex_y < 0 || tex_x >= size.x || tex_y >= size.y) {
+        continue;
+      }
+
+      if (!affine) {
+        if ((attr1 & 0x1000) != 0) tex_x = size.x - tex_x - 1;
+        if ((attr1 & 0x2000) != 0) tex_y = size.y - tex_y - 1;
+      }
+
+      int number = attr2 & 0x3FF;
+      int tile;
+      int color;
+
+      if ((attr0 & 0x2000) != 0) {
+        if (mapping_1d) {
+          tile = number + (tex_y >> 3) * (size.x >> 2);
+        } else {
+          tile = (number & ~1) + (tex_y >> 3) * 32;
+        }
+
+        tile = (tile + (tex_x >> 3) * 2) & 0x3FF;
+
+        if (bitmap_mode && tile < 512) {
+          continue;
+        }
+
+        int index = ReadVRAM8(0x10000 + tile * 32 + (tex_y & 7) * 8 + (tex_x & 7));
+        color = index == 0 ? TRANSPARENT : ReadPalette(256 + index);
+      } else {
+        if (mapping_1d) {
+          tile = number + (tex_y >> 3) * (size.x >> 3);
+        } else {
+          tile = number + (tex_y >> 3) * 32;
+        }
+
+        tile = (tile + (tex_x >> 3)) & 0x3FF;
+
+        if (bitmap_mode && tile < 512) {
+          continue;
+        }
+
+        int index = (ReadVRAM8(0x10000 + tile * 32 + (tex_y & 7) * 4 + ((tex_x & 7) >> 1)) >> ((tex_x & 1) * 4)) & 15;
+        color = index == 0 ? TRANSPARENT : ReadPalette(256 + (attr2 >> 12) * 16 + index);
+      }
+
+      int priority = (attr2 >> 10) & 3;
+
+      if (mode == 2) {
+        result.window = result.window || color != TRANSPARENT;
+      } else if (priority < result.priority || result.color == TRANSPARENT) {
+        if (color != TRANSPARENT) {
+          result.color = color;
+          result.alpha = mode == 1;
+        }
+        result.priority = priority;
+      }
+    }
+
+    return result;
+  }
+
+  bool InsideWindow(int winh, int x) {
+    int min = winh >> 8;
+    int max = winh & 0xFF;
+
+    if (min <= max) {
+      return x >= min && x < max;
+    }
+    return x < max || x >= min;
+  }
+
+  int Blend(int color1, int color2, int effect) {
+    ivec3 rgb1 = ivec3(color1, color1 >> 5, color1 >> 10) & 31;
+    ivec3 rgb2 = ivec3(color2, color2 >> 5, color2 >> 10) & 31;
+    int evy = min(16, Reg(LINE_EVY));
+
+    if (effect == SFX_BLEND) {
+      rgb1 = min((rgb1 * min(16, Reg(LINE_EVA)) + rgb2 * min(16, Reg(LINE_EVB))) >> 4, ivec3(31));
+    } else if (effect == SFX_BRIGHTEN) {
+      rgb1 += ((31 - rgb1) * evy) >> 4;
+    } else if (effect == SFX_DARKEN) {
+      rgb1 -= (rgb1 * evy) >> 4;
+    }
+
+    return rgb1.r | (rgb1.g << 5) | (rgb1.b << 10);
+  }
+
+  vec4 Output(int color) {
+    return vec4(vec3(ivec3(color, color >> 5, color >> 10) & 31) * (8.0 / 255.0), 1.0);
+  }
+
+  void main() {
+    ivec2 position = ivec2(gl_FragCoord.xy);
+    int x = position.x / u_scale;
+
+    line = position.y / u_scale;
+    subpixel = position % u_scale;
+
+    int dispcnt = Reg(LINE_DISPCNT);
+    int mode = dispcnt & 7;
+
+    if ((dispcnt & 0x80) != 0) {
+      frag_color = Output(0x7FFF);
+      return;
+    }
+
+    if (mode >= 6) {
+      frag_color = Output(ReadPalette(0));
+      return;
+    }
+
+    int bg_color[4] = int[4](TRANSPARENT, TRANSPARENT, TRANSPARENT, TRANSPARENT);
+
+    for (int id = 0; id < 4; id++) {
+      if ((dispcnt & (0x100 << id)) == 0) {
+        continue;
+      }
+
+      if (mode == 0 || (mode == 1 && id < 2)) {
+        bg_color[id] = RenderText(id, x);
+      } else if ((mode == 1 && id == 2) || (mode == 2 && id >= 2)) {
+        bg_color[id] = RenderAffine(id - 2, x);
+      } else if (mode >= 3 && id == 2) {
+        bg_color[id] = RenderBitmap(mode, ((dispcnt >> 4) & 1) * 0xA000, x);
+      }
+    }
+
+    ObjPixel obj = ObjPixel(TRANSPARENT, 4, false, false);
+
+    if ((dispcnt & 0x1000) != 0) {
+      obj = RenderOBJ(dispcnt, x);
+    }
+
+    // The layers and the color effects enabled by the window that covers this pixel, WIN0 goes first.
+    int layer_mask = 0x3F;
+
+    if ((dispcnt & 0xE000) != 0) {
+      int win_active = Reg(LINE_WIN_ACTIVE);
+
+      if ((dispcnt & 0x2000) != 0 && (win_active & 1) != 0 && InsideWindow(Reg(LINE_WINH + 0), x)) {
+        layer_mask = Reg(LINE_WININ);
+      } else if ((dispcnt & 0x4000) != 0 && (win_active & 2) != 0 && InsideWindow(Reg(LINE_WINH + 1), x)) {
+        layer_mask = Reg(LINE_WININ) >> 8;
+      } else if ((dispcnt & 0x8000) != 0 && obj.window) {
+        layer_mask = Reg(LINE_WINOUT) >> 8;
+      } else {
+        layer_mask = Reg(LINE_WINOUT);
+      }
+    }
+
+    // Find the two top-most layers, lower priorities and lower BG numbers go first.
+    int layer[2] = int[2](LAYER_BD, LAYER_BD);
+    int priority[2] = int[2](4, 4);
+
+    for (int p = 3; p >= 0; p--) {
+      for (int id = 3; id >= 0; id--) {
+        if (bg_color[id] != TRANSPARENT && ((layer_mask >> id) & 1) != 0 && (Reg(LINE_BGCNT + id) & 3) == p) {
+          layer[1] = layer[0];
+          layer[0] = id;
+          priority[1] = priority[0];
+          priority[0] = p;
+        }
+      }
+    }
+
+    bool is_alpha_obj = false;
+
+    if (obj.color != TRANSPARENT && ((layer_mask >> LAYER_OBJ) & 1) != 0) {
+      if (obj.priority <= priority[0]) {
+        layer[1] = layer[0];
+        layer[0] = LAYER_OBJ;
+        is_alpha_obj = obj.alpha;
+      } else if (obj.priority <= priority[1]) {
+        layer[1] = LAYER_OBJ;
+      }
+    }
+
+    int color[2];
+
+    for (int i = 0; i < 2; i++) {
+      if (layer[i] == LAYER_OBJ) {
+        color[i] = obj.color;
+      } else if (layer[i] == LAYER_BD) {
+        color[i] = ReadPalette(0);
+      } else {
+        color[i] = bg_color[layer[i]];
+      }
+    }
+
+    int effect = SFX_NONE;
+
+    if (((layer_mask >> 5) & 1) != 0 || is_alpha_obj) {
+      int bldcnt = Reg(LINE_BLDCNT);
+      int sfx = (bldcnt >> 6) & 3;
+      bool have_dst = ((bldcnt >> layer[0]) & 1) != 0;
+      bool have_src = ((bldcnt >> (8 + layer[1])) & 1) != 0;
+
+      if (is_alpha_obj && have_src) {
+        effect = SFX_BLEND;
+      } else if (have_dst && sfx != SFX_NONE && (have_src || sfx != SFX_BLEND)) {
+        effect = sfx;
+      }
+    }
+
+    frag_color = Output(Blend(color[0], color[1], effect));
+  }
+)";
@@ -277,12 +277,13 @@ constexpr auto xbrz1_vert = R"(\
   out vec2 v_uv;
   out vec4 u_screen_size;
 
-  uniform sampler2D u_screen_map;
+  // The info texture only has one texel per source pixel, so the output size is passed separately.
+  uniform vec2 u_output_size;
 
   void main() {
     v_uv = uv;
-    u_screen_size.xy = textureSize(u_screen_map, 0);
-    u_screen_size.zw = 1.0 / textureSize(u_screen_map, 0);
+    u_screen_size.xy = u_output_size;
+    u_screen_size.zw = 1.0 / u_output_size;
     gl_Position = vec4(position, 0.0, 1.0);
   }
 )";
@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <audioclient.h>
+#include <mmdeviceapi.h>
+
+#include <algorithm>
+#include <nba/log.hpp>
+#include <platform/device/wasapi_audio_device.hpp>
+
+namespace nba {
+
+namespace {
+
+// WASAPI counts time in units of 100 ns.
+constexpr REFERENCE_TIME kTimePerSecond = 10'000'000;
+
+template<typename T>
+void SafeRelease(T*& object) {
+  if (object != nullptr) {
+    object->Release();
+    object = nullptr;
+  }
+}
+
+} // namespace nba::(anonymous)
+
+WASAPI_AudioDevice::~WASAPI_AudioDevice() {
+  Close();
+}
+
+void WASAPI_AudioDevice::SetSampleRate(int sample_rate) {
+  want_sample_rate = sample_rate;
+}
+
+void WASAPI_AudioDevice::SetBlockSize(int block_size) {
+  want_block_size = block_size;
+}
+
+void WASAPI_AudioDevice::SetExclusive(bool exclusive) {
+  want_exclusive = exclusive;
+}
+
+void WASAPI_AudioDevice::SetThreadPolicy(ThreadPolicy const& policy) {
+  thread_policy = policy;
+}
+
+auto WASAPI_AudioDevice::GetSampleRate() -> int {
+  return sample_rate;
+}
+
+auto WASAPI_AudioDevice::GetBlockSize() -> int {
+  return block_size;
+}
+
+auto WASAPI_AudioDevice::GetLatency() -> int {
+  return latency;
+}
+
+bool WASAPI_AudioDevice::Open(void* userdata, Callback callback) {
+  this->callback = callback;
+  callback_userdata = userdata;
+
+  // The stream is created on its own thread, so that COM is initialized there rather than on a thread of the frontend.
+  auto opened = std::promise<bool>{};
+  auto result = opened.get_future();
+
+  running = true;
+  thread = std::thread{[this, opened = std::move(opened)]() mutable {
+    ThreadMain(opened);
+  }};
+
+  if (!result.get()) {
+    thread.join();
+    running = false;
+    return false;
+  }
+  return true;
+}
+
+void WASAPI_AudioDevice::ThreadMain(std::promise<bool>& opened) {
+  bool com_initialized = SUCCEEDED(CoInitializeEx(nullptr, COINIT_MULTITHREADED));
+
+  if (!InitializeStream()) {
+    ReleaseStream();
+
+    if (com_initialized) {
+      CoUninitialize();
+    }
+    opened.set_value(false);
+    return;
+  }
+
+  thread_policy.ApplyToCurrentThread(ThreadPolicy::Role::Audio);
+  opened.set_value(true);
+
+  while (running.load(std::memory_order_relaxed)) {
+    // Wakes up once per period. The timeout only lets the loop notice that the device is being closed.
+    if (WaitForSingleObject(event, 200) != WAIT_OBJECT_0) {
+      continue;
+    }
+
+    UINT32 frames = buffer_frames;
+
+    // In shared mode the buffer is a queue, in exclusive mode each event asks for a whole period.
+    if (!exclusive) {
+      UINT32 padding;
+
+      if (FAILED(client->GetCurrentPadding(&padding))) {
+        break;
+      }
+      frames -= padding;
+    }
+
+    BYTE* data;
+
+    if (frames == 0 || FAILED(render_client->GetBuffer(frames, &data))) {
+      continue;
+    }
+
+    if (paused.load(std::memory_order_relaxed)) {
+      render_client->ReleaseBuffer(frames, AUDCLNT_BUFFERFLAGS_SILENT);
+    } else {
+      callback(callback_userdata, (s16*)data, frames * 2 * sizeof(s16));
+      render_client->ReleaseBuffer(frames, 0);
+    }
+  }
+
+  client->Stop();
+  ReleaseStream();
+
+  if (com_initialized) {
+    CoUninitialize();
+  }
+}
+
+bool WASAPI_AudioDevice::InitializeStream() {
+  IMMDeviceEnumerator* enumerator = nullptr;
+  IMMDevice* device = nullptr;
+  HRESULT result;
+
+  auto fail = [&](char const* what) {
+    Log<Error>("Audio: WASAPI: {} failed (0x{:08X}).", what, u32(result));
+    SafeRelease(device);
+    SafeRelease(enumerator);
+    return false;
+  };
+
+  result = CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator), (void**)&enumerator);
+
+  if (FAILED(result)) {
+    return fail("CoCreateInstance(MMDeviceEnumerator)");
+  }
+
+  result = enumerator->GetDefaultAudioEndpoint(eRender, eConsole, &device);
+
+  if (FAILED(result)) {
+    return fail("GetDefaultAudioEndpoint()");
+  }
+
+  auto activate = [&]() {
+    SafeRelease(client);
+    result = device->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr, (void**)&client);
+    return SUCCEEDED(result);
+  };
+
+  if (!activate()) {
+    return fail("IMMDevice::Activate()");
+  }
+
+  auto format = WAVEFORMATEX{};
+
+  format.wFormatTag = WAVE_FORMAT_PCM;
+  format.nChannels = 2;
+  format.nSamplesPerSec = want_sample_rate;
+  format.wBitsPerSample = 16;
+  format.nBlockAlign = format.nChannels * format.wBitsPerSample / 8;
+  format.nAvgBytesPerSec = format.nSamplesPerSec * format.nBlockAlign;
+
+  REFERENCE_TIME default_period;
+  REFERENCE_TIME min_period;
+
+  result = client->GetDevicePeriod(&default_period, &min_period);
+
+  if (FAILED(result)) {
+    return fail("IAudioClient::GetDevicePeriod()");
+  }
+
+  exclusive = false;
+
+  if (want_exclusive) {
+    auto period = std::max(min_period, REFERENCE_TIME(want_block_size) * kTimePerSecond / want_sample_rate);
+
+    result = client->Initialize(AUDCLNT_SHAREMODE_EXCLUSIVE, AUDCLNT_STREAMFLAGS_EVENTCALLBACK, period, period, &format, nullptr);
+
+    // The period must match the alignment of the device, which tells the nearest buffer size that does.
+    if (result == AUDCLNT_E_BUFFER_SIZE_NOT_ALIGNED) {
+      UINT32 aligned_frames;
+
+      client->GetBufferSize(&aligned_frames);
+      period = REFERENCE_TIME(aligned_frames) * kTimePerSecond / want_sample_rate;
+
+      if (activate()) {
+        result = client->Initialize(AUDCLNT_SHAREMODE_EXCLUSIVE, AUDCLNT_STREAMFLAGS_EVENTCALLBACK, period, period, &format, nullptr);
+      }
+    }
+
+    if (SUCCEEDED(result)) {
+      exclusive = true;
+    } else {
+      Log<Warn>("Audio: WASAPI: exclusive mode unavailable (0x{:08X}), using shared mode.", u32(result));
+
+      // A client that failed to initialize cannot be initialized again.
+      if (!activate()) {
+        return fail("IMMDevice::Activate()");
+      }
+    }
+  }
+
+  if (!exclusive) {
+    // The mixer of the shared mode converts the format to its own, so any sample rate works.
+    auto flags = AUDCLNT_STREAMFLAGS_EVENTCALLBACK | AUDCLNT_STREAMFLAGS_AUTOCONVERTPCM | AUDCLNT_STREAMFLAGS_SRC_DEFAULT_QUALITY;
+
+    result = client->Initialize(AUDCLNT_SHAREMODE_SHARED, flags, 0, 0, &format, nullptr);
+
+    if (FAILED(result)) {
+      return fail("IAudioClient::Initialize()");
+    }
+  }
+
+  event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+
+  if (event == nullptr || FAILED(result = client->SetEventHandle(event))) {
+    return fail("IAudioClient::SetEventHandle()");
+  }
+
+  if (FAILED(result = client->GetBufferSize(&buffer_frames))) {
+    return fail("IAudioClient::GetBufferSize()");
+  }
+
+  if (FAILED(result = client->GetService(__uuidof(IAudioRenderClient), (void**)&render_client))) {
+    return fail("IAudioClient::GetService()");
+  }
+
+  REFERENCE_TIME stream_latency = 0;
+
+  client->GetStreamLatency(&stream_latency);
+
+  sample_rate = want_sample_rate;
+
+  if (exclusive) {
+    block_size = int(buffer_frames);
+  } else {
+    block_size = int(default_period * sample_rate / kTimePerSecond);
+  }
+
+  // The samples wait for at most the buffer, then for the latency of the stream itself.
+  latency = int(buffer_frames + stream_latency * sample_rate / kTimePerSecond);
+
+  // Start with a buffer of silence, so that the first event asks for the next period.
+  BYTE* data;
+
+  if (SUCCEEDED(render_client->GetBuffer(buffer_frames, &data))) {
+    render_client->ReleaseBuffer(buffer_frames, AUDCLNT_BUFFERFLAGS_SILENT);
+  }
+
+  if (FAILED(result = client->Start())) {
+    return fail("IAudioClient::Start()");
+  }
+
+  Log<Info>("Audio: WASAPI: opened the default device in {} mode at {} Hz, period of {} frames, latency of {} frames.",
+    exclusive ? "exclusive" : "shared", sample_rate, block_size, latency);
+
+  SafeRelease(device);
+  SafeRelease(enumerator);
+  return true;
+}
+
+void WASAPI_AudioDevice::ReleaseStream() {
+  SafeRelease(render_client);
+  SafeRelease(client);
+
+  if (event != nullptr) {
+    CloseHandle(event);
+    event = nullptr;
+  }
+}
+
+void WASAPI_AudioDevice::SetPause(bool value) {
+  paused = value;
+}
+
+void WASAPI_AudioDevice::Close() {
+  running = false;
+
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+} // namespace nba
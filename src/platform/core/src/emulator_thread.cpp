@@ -5,6 +5,8 @@
  * Refer to the included LICENSE file.
  */
 
+#include <algorithm>
+#include <nba/trace.hpp>
 #include <platform/emulator_thread.hpp>
 
 namespace nba {
@@ -12,7 +14,8 @@ namespace nba {
 EmulatorThread::EmulatorThread(
   std::unique_ptr<CoreBase>& core
 )   : core(core) {
-  frame_limiter.Reset(59.7275);
+  // The GBA renders exactly 280896 cycles per frame at 2^24 Hz (~59.7275 FPS).
+  frame_limiter.Reset(16777216.0 / 280896.0);
 }
 
 EmulatorThread::~EmulatorThread() {
@@ -47,17 +50,112 @@ void EmulatorThread::SetPerFrameCallback(std::function<void()> callback) {
   per_frame_cb = callback;
 }
 
+void EmulatorThread::EnableRewind(int interval, size_t memory_budget) {
+  rewind_buffer = std::make_unique<RewindBuffer>(interval, memory_budget);
+}
+
+void EmulatorThread::DisableRewind() {
+  rewind_buffer.reset();
+  rewinding = false;
+}
+
+bool EmulatorThread::IsRewinding() const {
+  return rewinding;
+}
+
+void EmulatorThread::SetRewinding(bool value) {
+  rewinding = value;
+  core->CancelWaitForInput();
+}
+
+void EmulatorThread::SetRunAhead(int frames) {
+  run_ahead = std::max(frames, 0);
+
+  if (run_ahead > 0 && !run_ahead_state) {
+    run_ahead_state = std::make_unique<SaveState>();
+  }
+}
+
+void EmulatorThread::SetSyncToAudio(bool enabled) {
+  sync_to_audio = enabled;
+  frame_limiter.SetMode(enabled ? FrameLimiter::Mode::None : FrameLimiter::Mode::SleepAndSpin);
+}
+
+void EmulatorThread::SetFrameDelay(std::chrono::microseconds delay) {
+  frame_limiter.SetFrameDelay(double(delay.count()));
+}
+
+void EmulatorThread::SetPowerSaving(bool enabled) {
+  power_saving = enabled;
+}
+
+void EmulatorThread::SetThreadPolicy(ThreadPolicy const& policy) {
+  thread_policy = policy;
+}
+
+void EmulatorThread::SetFrameStats(std::shared_ptr<FrameStats> frame_stats) {
+  this->frame_stats = frame_stats;
+}
+
 void EmulatorThread::Start() {
   if (!running) {
     running = true;
     thread = std::thread{[this]() {
+      NBA_TRACE_THREAD("Emulator thread");
+
+      thread_policy.ApplyToCurrentThread(ThreadPolicy::Role::Emulation);
+
       frame_limiter.Reset();
 
+      // Resetting the frame limiter also ends fast-forward.
+      UpdateFastForward();
+
+      if (rewind_buffer) {
+        rewind_buffer->Reset();
+      }
+
       while (running) {
         frame_limiter.Run([this]() {
+          if (tasks_pending) {
+            RunTasks();
+          }
+
           if (!paused) {
+            if (sync_to_audio && !frame_limiter.GetFastForward()) {
+              WaitForAudio();
+            }
+
             per_frame_cb();
-            core->RunForOneFrame();
+            UpdateFastForward();
+
+            // Every frame would look the same until input arrives, so skip them. The frame limiter resyncs once it does.
+            if (power_saving && !rewinding && core->GetActivity() == CoreBase::Activity::WaitingForInput) {
+              if (!core->WaitForInput(std::chrono::steady_clock::now() + kPowerSavingTimeout)) {
+                return;
+              }
+            }
+
+            auto frame_start = std::chrono::steady_clock::now();
+
+            if (rewind_buffer) {
+              if (rewinding) {
+                // Run one frame from the restored snapshot, so that there is something to display.
+                // Once the buffer runs dry, hold the oldest frame until rewinding stops.
+                if (rewind_buffer->Rewind(*core)) {
+                  core->RunForOneFrame();
+                }
+              } else {
+                RunFrame();
+                rewind_buffer->Capture(*core);
+              }
+            } else {
+              RunFrame();
+            }
+
+            if (frame_stats) {
+              frame_stats->OnFrameEmulated(
+                std::chrono::steady_clock::now() - frame_start, core->GetAudioStats(), frame_limiter.GetFastForward());
+            }
           }
         }, [this](float fps) {
           if (paused) {
@@ -70,10 +168,107 @@ void EmulatorThread::Start() {
   }
 }
 
+/* Emulates the next frame. Run-ahead hides the input lag of the emulated game:
+ * the frame that is actually shown is `run_ahead` frames into the future,
+ * but it is always re-emulated from the true state with the latest input.
+ */
+void EmulatorThread::RunFrame() {
+  if (run_ahead == 0) {
+    core->RunForOneFrame();
+    return;
+  }
+
+  // The true frame only contributes audio.
+  core->SetVideoOutputEnabled(false);
+  core->RunForOneFrame();
+  core->CopyState(*run_ahead_state);
+
+  // The speculative frames only contribute the final image.
+  core->SetAudioOutputEnabled(false);
+  for (int i = 1; i < run_ahead; i++) {
+    core->RunForOneFrame();
+  }
+  core->SetVideoOutputEnabled(true);
+  core->RunForOneFrame();
+  core->SetAudioOutputEnabled(true);
+
+  core->LoadState(*run_ahead_state);
+}
+
+/* Waits until the audio device has consumed enough samples to make room for the next frame.
+ * Gives up after a while, so that a stalled or paused audio device cannot stall emulation.
+ */
+void EmulatorThread::WaitForAudio() {
+  auto timeout = std::chrono::steady_clock::now() + kAudioSyncTimeout;
+
+  while (running && core->GetAudioBufferLevel() > kAudioSyncLevel &&
+         std::chrono::steady_clock::now() < timeout) {
+    std::this_thread::sleep_for(std::chrono::microseconds{250});
+  }
+}
+
+/* Most frames are never seen while fast-forwarding, so don't bother rendering them.
+ * The core also switches to its fastest settings that do not change the emulated state.
+ */
+void EmulatorThread::UpdateFastForward() {
+  bool fast_forward = frame_limiter.GetFastForward();
+
+  if (fast_forward != frame_skip_fast_forward) {
+    if (fast_forward) {
+      frame_skip_saved = core->GetFrameSkip();
+      core->SetFrameSkip(std::max(frame_skip_saved, kFastForwardFrameSkip));
+    } else {
+      core->SetFrameSkip(frame_skip_saved);
+    }
+    core->SetTurbo(fast_forward);
+    frame_skip_fast_forward = fast_forward;
+  }
+}
+
 void EmulatorThread::Stop() {
   if (IsRunning()) {
     running = false;
+    core->CancelWaitForInput();
     thread.join();
+    RunTasks();
+  }
+}
+
+void EmulatorThread::Post(std::function<void()> task) {
+  {
+    std::lock_guard guard{tasks_mutex};
+
+    if (running) {
+      tasks.push_back(std::move(task));
+      tasks_pending = true;
+      core->CancelWaitForInput();
+      return;
+    }
+  }
+
+  task();
+}
+
+void EmulatorThread::RunTasks() {
+  std::vector<std::function<void()>> tasks;
+
+  {
+    std::lock_guard guard{tasks_mutex};
+    std::swap(tasks, this->tasks);
+    tasks_pending = false;
+  }
+
+  if (tasks.empty()) {
+    return;
+  }
+
+  for (auto& task : tasks) {
+    task();
+  }
+
+  if (rewind_buffer) {
+    rewind_buffer->Reset();
+    rewinding = false;
   }
 }
 
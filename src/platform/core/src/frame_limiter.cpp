@@ -5,6 +5,9 @@
  * Refer to the included LICENSE file.
  */
 
+#include <algorithm>
+#include <cmath>
+#include <nba/trace.hpp>
 #include <platform/frame_limiter.hpp>
 
 namespace nba {
@@ -13,13 +16,18 @@ void FrameLimiter::Reset() {
   Reset(frames_per_second);
 }
 
-void FrameLimiter::Reset(float fps) {
+void FrameLimiter::Reset(double fps) {
   frame_count = 0;
-  frame_duration = int(kMicrosecondsPerSecond / fps);
+  frame_duration = kMicrosecondsPerSecond / fps;
   frames_per_second = fps;
+  frame_delay_us = std::min(frame_delay_us, frame_duration * kMaxFrameDelay);
   fast_forward = false;
-  timestamp_target = std::chrono::steady_clock::now();
-  timestamp_fps_update = std::chrono::steady_clock::now();
+  spin_time_us = kMinSpinTimeUs;
+  jitter_sum_us = 0;
+  jitter_max_us = 0;
+  jitter_statistics = {};
+  timestamp_fps_update = Clock::now();
+  Resync();
 }
 
 auto FrameLimiter::GetFastForward() const -> bool {
@@ -30,32 +38,117 @@ void FrameLimiter::SetFastForward(bool value) {
   if (fast_forward != value) {
     fast_forward = value;
     if (!fast_forward) {
-      timestamp_target = std::chrono::steady_clock::now();
+      Resync();
     }
   }
 }
 
+auto FrameLimiter::GetMode() const -> Mode {
+  return mode;
+}
+
+void FrameLimiter::SetMode(Mode mode) {
+  this->mode = mode;
+}
+
+auto FrameLimiter::GetJitterStatistics() const -> JitterStatistics {
+  return jitter_statistics;
+}
+
+auto FrameLimiter::GetFrameDelay() const -> double {
+  return frame_delay_us;
+}
+
+void FrameLimiter::SetFrameDelay(double delay_us) {
+  frame_delay_us = std::clamp(delay_us, 0.0, frame_duration * kMaxFrameDelay);
+}
+
 void FrameLimiter::Run(
   std::function<void(void)> frame_advance,
   std::function<void(float)> update_fps
 ) {
-  timestamp_target += std::chrono::microseconds(frame_duration);
+  NBA_TRACE_ZONE("FrameLimiter::Run");
+
+  auto now = Clock::now();
+  auto frame_delay = std::chrono::duration_cast<Clock::duration>(Duration{frame_delay_us});
+
+  if (!fast_forward && mode != Mode::None) {
+    auto jitter_us = std::abs(Duration{now - (timestamp_target + frame_delay)}.count());
+
+    jitter_sum_us += jitter_us;
+    jitter_max_us = std::max(jitter_max_us, jitter_us);
+
+    /* If we fell behind by more than a frame (i.e. the host stalled or a frame took too long),
+     * continue from now, rather than running frames back-to-back until we have caught up.
+     */
+    if (now - (timestamp_target + frame_delay) > Duration{frame_duration}) {
+      Resync();
+    }
+  }
+
+  timestamp_target = timestamp_origin + std::chrono::duration_cast<Clock::duration>(
+    Duration{frame_duration * double(++frame_index)});
 
   frame_advance();
   frame_count++;
-    
-  auto now = std::chrono::steady_clock::now(); 
+
+  now = Clock::now();
+
   auto fps_update_delta = std::chrono::duration_cast<std::chrono::milliseconds>(
     now - timestamp_fps_update).count();
 
   if (fps_update_delta >= kMillisecondsPerSecond) {
     update_fps(frame_count * float(kMillisecondsPerSecond) / fps_update_delta);
+    jitter_statistics.average_us = float(jitter_sum_us / frame_count);
+    jitter_statistics.maximum_us = float(jitter_max_us);
+    jitter_sum_us = 0;
+    jitter_max_us = 0;
     frame_count = 0;
-    timestamp_fps_update = std::chrono::steady_clock::now();
+    timestamp_fps_update = now;
   }
 
   if (!fast_forward) {
-    std::this_thread::sleep_until(timestamp_target);
+    WaitUntil(timestamp_target + frame_delay);
+  }
+}
+
+void FrameLimiter::Resync() {
+  timestamp_origin = Clock::now();
+  timestamp_target = timestamp_origin;
+  frame_index = 0;
+}
+
+void FrameLimiter::WaitUntil(Clock::time_point timestamp) {
+  NBA_TRACE_ZONE("FrameLimiter::WaitUntil");
+
+  if (mode == Mode::None) {
+    return;
+  }
+
+  if (mode == Mode::Sleep) {
+    std::this_thread::sleep_until(timestamp);
+    return;
+  }
+
+  auto sleep_until = timestamp - std::chrono::duration_cast<Clock::duration>(Duration{spin_time_us});
+
+  if (Clock::now() < sleep_until) {
+    std::this_thread::sleep_until(sleep_until);
+
+    /* Calibrate the spin time to how much the OS overslept: grow it quickly when the sleep
+     * overshot into the spin window, and let it decay slowly back to the minimum otherwise.
+     */
+    auto overslept_us = Duration{Clock::now() - sleep_until}.count();
+
+    if (overslept_us > spin_time_us * 0.5) {
+      spin_time_us = std::min(std::max(spin_time_us, overslept_us * 2.0), kMaxSpinTimeUs);
+    } else {
+      spin_time_us = std::max(spin_time_us * 0.99, kMinSpinTimeUs);
+    }
+  }
+
+  while (Clock::now() < timestamp) {
+    std::this_thread::yield();
   }
 }
 
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <fmt/format.h>
+#include <platform/frame_stats.hpp>
+
+namespace nba {
+
+using Milliseconds = std::chrono::duration<float, std::milli>;
+
+FrameStats::FrameStats(double frame_rate) : frame_period_ms(1000.0 / frame_rate) {
+}
+
+void FrameStats::OnFrameEmulated(Clock::duration emulation_time, CoreBase::AudioStats const& audio, bool fast_forward) {
+  std::lock_guard lock{mutex};
+
+  emulated.Push({Milliseconds{emulation_time}.count(), audio.buffer_level});
+
+  // The core counts underruns since it was created, so the counter starts over if the core is replaced.
+  if (have_core_underruns && !fast_forward) {
+    underruns += audio.underruns >= core_underruns ? audio.underruns - core_underruns : audio.underruns;
+  }
+  core_underruns = audio.underruns;
+  have_core_underruns = true;
+
+  this->fast_forward = fast_forward;
+  audio_level = audio.buffer_level;
+  rate_adjustment = audio.rate_adjustment;
+  audio_latency = audio.latency;
+}
+
+void FrameStats::OnFramePresented(Clock::time_point start, Clock::time_point end, int new_frames) {
+  // The previous frame stays on screen, which is counted once the next frame is presented.
+  if (new_frames <= 0) {
+    return;
+  }
+
+  std::lock_guard lock{mutex};
+
+  if (have_present) {
+    auto gap = end - last_present;
+    auto frame_ms = Milliseconds{gap}.count();
+
+    presented.Push({frame_ms, Milliseconds{end - start}.count()});
+
+    if (!fast_forward) {
+      dropped += new_frames - 1;
+
+      if (gap < kMaxFrameGap) {
+        duplicated += std::max(0L, std::lround(frame_ms / frame_period_ms) - 1);
+      }
+    }
+  }
+
+  have_present = true;
+  last_present = end;
+}
+
+void FrameStats::GetSnapshot(Snapshot& snapshot) {
+  std::lock_guard lock{mutex};
+
+  snapshot.emulated_count = emulated.count;
+  emulated.ForEach([&](int i, Emulated const& frame) {
+    snapshot.emulation_ms[i] = frame.emulation_ms;
+    snapshot.audio_levels[i] = frame.audio_level;
+  });
+
+  std::fill_n(snapshot.histogram, kHistogramBuckets, 0);
+
+  snapshot.presented_count = presented.count;
+  presented.ForEach([&](int i, Presented const& frame) {
+    snapshot.frame_ms[i] = frame.frame_ms;
+    snapshot.present_ms[i] = frame.present_ms;
+    snapshot.histogram[std::min(int(frame.frame_ms), kHistogramBuckets - 1)]++;
+  });
+
+  snapshot.dropped = dropped;
+  snapshot.duplicated = duplicated;
+  snapshot.underruns = underruns;
+  snapshot.audio_level = audio_level;
+  snapshot.rate_adjustment = rate_adjustment;
+  snapshot.audio_latency_ms = audio_latency * 1000;
+  snapshot.frame_period_ms = float(frame_period_ms);
+}
+
+auto FrameStats::FormatSummary(Snapshot const& snapshot) -> std::string {
+  auto mean_max = [](float const* values, int count) -> std::pair<float, float> {
+    if (count == 0) {
+      return {0, 0};
+    }
+
+    float sum = 0;
+    float max = 0;
+
+    for (int i = 0; i < count; i++) {
+      sum += values[i];
+      max = std::max(max, values[i]);
+    }
+    return {sum / count, max};
+  };
+
+  auto [emulation_mean, emulation_max] = mean_max(snapshot.emulation_ms, snapshot.emulated_count);
+  auto [frame_mean, frame_max] = mean_max(snapshot.frame_ms, snapshot.presented_count);
+  auto [present_mean, present_max] = mean_max(snapshot.present_ms, snapshot.presented_count);
+
+  return fmt::format(
+    "emulation {:.1f} ms (max {:.1f}) | frame {:.1f} ms (max {:.1f}) | present {:.1f} ms (max {:.1f}) | "
+    "{} dropped, {} duplicated | "
+    "audio {:.0f}%, {:.0f} ms latency, {} underruns, rate {:+.2f}%",
+    emulation_mean, emulation_max,
+    frame_mean, frame_max,
+    present_mean, present_max,
+    snapshot.dropped, snapshot.duplicated,
+    snapshot.audio_level * 100, snapshot.audio_latency_ms, snapshot.underruns, snapshot.rate_adjustment * 100);
+}
+
+void FrameStats::Reset() {
+  std::lock_guard lock{mutex};
+
+  emulated = {};
+  presented = {};
+  have_present = false;
+  dropped = 0;
+  duplicated = 0;
+  underruns = 0;
+  audio_level = 0;
+  rate_adjustment = 0;
+  audio_latency = 0;
+}
+
+} // namespace nba
@@ -5,10 +5,30 @@
  * Refer to the included LICENSE file.
  */
 
+#include <array>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <nba/log.hpp>
 #include <platform/game_db.hpp>
+#include <toml.hpp>
+#include <unordered_map>
 
 namespace nba {
 
+namespace {
+
+struct Entry {
+  u32 game_code;
+  GameInfo info;
+};
+
+struct Revision {
+  u32 game_code;
+  u32 crc32;
+  GameInfo info;
+};
+
 /*
  * Adapted from VisualBoyAdvance-M's vba-over.ini:
  * https://github.com/visualboyadvance-m/visualboyadvance-m/blob/master/src/vba-over.ini
@@ -16,119 +36,315 @@ namespace nba {
  * TODO: it is unclear how accurate the EEPROM sizes are.
  * Since VBA guesses EEPROM sizes, the vba-over.ini did not contain the sizes.
  */
-const std::map<std::string, GameInfo> g_game_db {
-  { "ALFP", { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball Z - The Legacy of Goku II (Europe)(En,Fr,De,Es,It) */
-  { "ALGP", { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball Z - The Legacy of Goku (Europe)(En,Fr,De,Es,It) */
-  { "AROP", { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Rocky (Europe)(En,Fr,De,Es,It) */
-  { "AR8e", { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Rocky (USA)(En,Fr,De,Es,It) */
-  { "AXVE", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Ruby Version (USA, Europe) */
-  { "AXPE", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Sapphire Version (USA, Europe) */
-  { "AX4P", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Super Mario Advance 4 - Super Mario Bros. 3 (Europe)(En,Fr,De,Es,It) */
-  { "A2YE", { Config::BackupType::None, GPIODeviceType::None, false } },      /* Top Gun - Combat Zones (USA)(En,Fr,De,Es,It) */
-  { "BDBP", { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball Z - Taiketsu (Europe)(En,Fr,De,Es,It) */
-  { "BM5P", { Config::BackupType::FLASH_64, GPIODeviceType::None, false } },  /* Mario vs. Donkey Kong (Europe) */
-  { "BPEE", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Emerald Version (USA, Europe) */
-  { "BY6P", { Config::BackupType::SRAM, GPIODeviceType::None, false } },      /* Yu-Gi-Oh! - Ultimate Masters - World Championship Tournament 2006 (Europe)(En,Jp,Fr,De,Es,It) */
-  { "B24E", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon Mystery Dungeon - Red Rescue Team (USA, Australia) */
-  { "FADE", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Castlevania (USA, Europe) */
-  { "FBME", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Bomberman (USA, Europe) */
-  { "FDKE", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Donkey Kong (USA, Europe) */
-  { "FDME", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Dr. Mario (USA, Europe) */
-  { "FEBE", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Excitebike (USA, Europe) */
-  { "FICE", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Ice Climber (USA, Europe) */
-  { "FLBE", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Zelda II - The Adventure of Link (USA, Europe) */
-  { "FMRE", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Metroid (USA, Europe) */
-  { "FP7E", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Pac-Man (USA, Europe) */
-  { "FSME", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Super Mario Bros. (USA, Europe) */
-  { "FXVE", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Xevious (USA, Europe) */
-  { "FZLE", { Config::BackupType::EEPROM_64, GPIODeviceType::None, true } },   /* Classic NES Series - Legend of Zelda (USA, Europe) */
-  { "KYGP", { Config::BackupType::EEPROM_64/*_SENSOR*/, GPIODeviceType::None, false } }, /* Yoshi's Universal Gravitation (Europe)(En,Fr,De,Es,It) */
-  { "U3IP", { Config::BackupType::Detect, GPIODeviceType::RTC, false } },     /* Boktai - The Sun Is in Your Hand (Europe)(En,Fr,De,Es,It) */
-  { "U32P", { Config::BackupType::Detect, GPIODeviceType::RTC, false } },     /* Boktai 2 - Solar Boy Django (Europe)(En,Fr,De,Es,It) */
-  { "AGFE", { Config::BackupType::FLASH_64, GPIODeviceType::RTC, false } },   /* Golden Sun - The Lost Age (USA) */
-  { "AGSE", { Config::BackupType::FLASH_64, GPIODeviceType::RTC, false } },   /* Golden Sun (USA) */
-  { "ALFE", { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball Z - The Legacy of Goku II (USA) */
-  { "ALGE", { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball Z - The Legacy of Goku (USA) */
-  { "AX4E", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Super Mario Advance 4 - Super Mario Bros 3 - Super Mario Advance 4 v1.1 (USA) */
-  { "BDBE", { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball Z - Taiketsu (USA) */
-  { "BG3E", { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball Z - Buu's Fury (USA) */
-  { "BLFE", { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* 2 Games in 1 - Dragon Ball Z - The Legacy of Goku I & II (USA) */
-  { "BPRE", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Fire Red Version (USA, Europe) */
-  { "BPGE", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Leaf Green Version (USA, Europe) */
-  { "BT4E", { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball GT - Transformation (USA) */
-  { "BUFE", { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* 2 Games in 1 - Dragon Ball Z - Buu's Fury + Dragon Ball GT - Transformation (USA) */
-  { "BYGE", { Config::BackupType::SRAM, GPIODeviceType::None, false } },      /* Yu-Gi-Oh! GX - Duel Academy (USA) */
-  { "KYGE", { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Yoshi - Topsy-Turvy (USA) */
-  { "PSAE", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* e-Reader (USA) */
-  { "U3IE", { Config::BackupType::Detect, GPIODeviceType::RTC, false } },     /* Boktai - The Sun Is in Your Hand (USA) */
-  { "U32E", { Config::BackupType::Detect, GPIODeviceType::RTC, false } },     /* Boktai 2 - Solar Boy Django (USA) */
-  { "ALFJ", { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball Z - The Legacy of Goku II International (Japan) */
-  { "AXPJ", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pocket Monsters - Sapphire (Japan) */
-  { "AXVJ", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pocket Monsters - Ruby (Japan) */
-  { "AX4J", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Super Mario Advance 4 (Japan) */
-  { "BFTJ", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* F-Zero - Climax (Japan) */
-  { "BGWJ", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Game Boy Wars Advance 1+2 (Japan) */
-  { "BKAJ", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Sennen Kazoku (Japan) */
-  { "BPEJ", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pocket Monsters - Emerald (Japan) */
-  { "BPGJ", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pocket Monsters - Leaf Green (Japan) */
-  { "BPRJ", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pocket Monsters - Fire Red (Japan) */
-  { "BDKJ", { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Digi Communication 2 - Datou! Black Gemagema Dan (Japan) */
-  { "BR4J", { Config::BackupType::Detect, GPIODeviceType::RTC, false } },     /* Rockman EXE 4.5 - Real Operation (Japan) */
-  { "FMBJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 01 - Super Mario Bros. (Japan) */
-  { "FCLJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 12 - Clu Clu Land (Japan) */
-  { "FBFJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 13 - Balloon Fight (Japan) */
-  { "FWCJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 14 - Wrecking Crew (Japan) */
-  { "FDMJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 15 - Dr. Mario (Japan) */
-  { "FDDJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 16 - Dig Dug (Japan) */
-  { "FTBJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 17 - Takahashi Meijin no Boukenjima (Japan) */
-  { "FMKJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 18 - Makaimura (Japan) */
-  { "FTWJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 19 - Twin Bee (Japan) */
-  { "FGGJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 20 - Ganbare Goemon! Karakuri Douchuu (Japan) */
-  { "FM2J", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 21 - Super Mario Bros. 2 (Japan) */
-  { "FNMJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 22 - Nazo no Murasame Jou (Japan) */
-  { "FMRJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 23 - Metroid (Japan) */
-  { "FPTJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 24 - Hikari Shinwa - Palthena no Kagami (Japan) */
-  { "FLBJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 25 - The Legend of Zelda 2 - Link no Bouken (Japan) */
-  { "FFMJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 26 - Famicom Mukashi Banashi - Shin Onigashima - Zen Kou Hen (Japan) */
-  { "FTKJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 27 - Famicom Tantei Club - Kieta Koukeisha - Zen Kou Hen (Japan) */
-  { "FTUJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 28 - Famicom Tantei Club Part II - Ushiro ni Tatsu Shoujo - Zen Kou Hen (Japan) */
-  { "FADJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 29 - Akumajou Dracula (Japan) */
-  { "FSDJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 30 - SD Gundam World - Gachapon Senshi Scramble Wars (Japan) */
-  { "KHPJ", { Config::BackupType::EEPROM_64/*_SENSOR*/, GPIODeviceType::None, false } }, /* Koro Koro Puzzle - Happy Panechu! (Japan) */
-  { "KYGJ", { Config::BackupType::EEPROM_64/*_SENSOR*/, GPIODeviceType::None, false } }, /* Yoshi no Banyuuinryoku (Japan) */
-  { "PSAJ", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Card e-Reader+ (Japan) */
-  { "U3IJ", { Config::BackupType::Detect, GPIODeviceType::RTC, false } },     /* Bokura no Taiyou - Taiyou Action RPG (Japan) */
-  { "U32J", { Config::BackupType::Detect, GPIODeviceType::RTC, false } },     /* Zoku Bokura no Taiyou - Taiyou Shounen Django (Japan) */
-  { "U33J", { Config::BackupType::Detect, GPIODeviceType::RTC, false } },     /* Shin Bokura no Taiyou - Gyakushuu no Sabata (Japan) */
-  { "AXPF", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Version Saphir (France) */
-  { "AXVF", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Version Rubis (France) */
-  { "BPEF", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Version Emeraude (France) */
-  { "BPGF", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Version Vert Feuille (France) */
-  { "BPRF", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Version Rouge Feu (France) */
-  { "AXPI", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Versione Zaffiro (Italy) */
-  { "AXVI", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Versione Rubino (Italy) */
-  { "BPEI", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Versione Smeraldo (Italy) */
-  { "BPGI", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Versione Verde Foglia (Italy) */
-  { "BPRI", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Versione Rosso Fuoco (Italy) */
-  { "AXPD", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Saphir-Edition (Germany) */
-  { "AXVD", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Rubin-Edition (Germany) */
-  { "BPED", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Smaragd-Edition (Germany) */
-  { "BPGD", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Blattgruene Edition (Germany) */
-  { "BPRD", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Feuerrote Edition (Germany) */
-  { "AXPS", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Edicion Zafiro (Spain) */
-  { "AXVS", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Edicion Rubi (Spain) */
-  { "BPES", { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Edicion Esmeralda (Spain) */
-  { "BPGS", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Edicion Verde Hoja (Spain) */
-  { "BPRS", { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }  /* Pokemon - Edicion Rojo Fuego (Spain) */,
-  { "A9DP", { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } },  /* DOOM II */
-  { "AAOJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } },  /* Acrobat Kid (Japan) */
-  { "BGDP", { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } },  /* Baldur's Gate - Dark Alliance (Europe) */
-  { "BGDE", { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } },  /* Baldur's Gate - Dark Alliance (USA) */
-  { "BJBE", { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } },  /* 007 - Everything or Nothing (USA, Europe) (En,Fr,De) */
-  { "BJBJ", { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } },  /* 007 - Everything or Nothing (Japan) */
-  { "ALUP", { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } },  /* 0937 - Super Monkey Ball Jr. (Europe) */
-  { "ALUE", { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } },  /* 0763 - Super Monkey Ball Jr. (USA) */
-  { "BL8E", { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } }   /* 2561 - Tomb Raider - Legend  */
+constexpr Entry kEntries[] {
+  { GameCode("ALFP"), { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball Z - The Legacy of Goku II (Europe)(En,Fr,De,Es,It) */
+  { GameCode("ALGP"), { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball Z - The Legacy of Goku (Europe)(En,Fr,De,Es,It) */
+  { GameCode("AROP"), { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Rocky (Europe)(En,Fr,De,Es,It) */
+  { GameCode("AR8e"), { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Rocky (USA)(En,Fr,De,Es,It) */
+  { GameCode("AXVE"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Ruby Version (USA, Europe) */
+  { GameCode("AXPE"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Sapphire Version (USA, Europe) */
+  { GameCode("AX4P"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Super Mario Advance 4 - Super Mario Bros. 3 (Europe)(En,Fr,De,Es,It) */
+  { GameCode("A2YE"), { Config::BackupType::None, GPIODeviceType::None, false } },      /* Top Gun - Combat Zones (USA)(En,Fr,De,Es,It) */
+  { GameCode("BDBP"), { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball Z - Taiketsu (Europe)(En,Fr,De,Es,It) */
+  { GameCode("BM5P"), { Config::BackupType::FLASH_64, GPIODeviceType::None, false } },  /* Mario vs. Donkey Kong (Europe) */
+  { GameCode("BPEE"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Emerald Version (USA, Europe) */
+  { GameCode("BY6P"), { Config::BackupType::SRAM, GPIODeviceType::None, false } },      /* Yu-Gi-Oh! - Ultimate Masters - World Championship Tournament 2006 (Europe)(En,Jp,Fr,De,Es,It) */
+  { GameCode("B24E"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon Mystery Dungeon - Red Rescue Team (USA, Australia) */
+  { GameCode("FADE"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Castlevania (USA, Europe) */
+  { GameCode("FBME"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Bomberman (USA, Europe) */
+  { GameCode("FDKE"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Donkey Kong (USA, Europe) */
+  { GameCode("FDME"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Dr. Mario (USA, Europe) */
+  { GameCode("FEBE"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Excitebike (USA, Europe) */
+  { GameCode("FICE"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Ice Climber (USA, Europe) */
+  { GameCode("FLBE"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Zelda II - The Adventure of Link (USA, Europe) */
+  { GameCode("FMRE"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Metroid (USA, Europe) */
+  { GameCode("FP7E"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Pac-Man (USA, Europe) */
+  { GameCode("FSME"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Super Mario Bros. (USA, Europe) */
+  { GameCode("FXVE"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Classic NES Series - Xevious (USA, Europe) */
+  { GameCode("FZLE"), { Config::BackupType::EEPROM_64, GPIODeviceType::None, true } },  /* Classic NES Series - Legend of Zelda (USA, Europe) */
+  { GameCode("KYGP"), { Config::BackupType::EEPROM_64/*_SENSOR*/, GPIODeviceType::None, false } }, /* Yoshi's Universal Gravitation (Europe)(En,Fr,De,Es,It) */
+  { GameCode("U3IP"), { Config::BackupType::Detect, GPIODeviceType::RTC, false } },     /* Boktai - The Sun Is in Your Hand (Europe)(En,Fr,De,Es,It) */
+  { GameCode("U32P"), { Config::BackupType::Detect, GPIODeviceType::RTC, false } },     /* Boktai 2 - Solar Boy Django (Europe)(En,Fr,De,Es,It) */
+  { GameCode("AGFE"), { Config::BackupType::FLASH_64, GPIODeviceType::RTC, false } },   /* Golden Sun - The Lost Age (USA) */
+  { GameCode("AGSE"), { Config::BackupType::FLASH_64, GPIODeviceType::RTC, false } },   /* Golden Sun (USA) */
+  { GameCode("ALFE"), { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball Z - The Legacy of Goku II (USA) */
+  { GameCode("ALGE"), { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball Z - The Legacy of Goku (USA) */
+  { GameCode("AX4E"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Super Mario Advance 4 - Super Mario Bros 3 - Super Mario Advance 4 v1.1 (USA) */
+  { GameCode("BDBE"), { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball Z - Taiketsu (USA) */
+  { GameCode("BG3E"), { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball Z - Buu's Fury (USA) */
+  { GameCode("BLFE"), { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* 2 Games in 1 - Dragon Ball Z - The Legacy of Goku I & II (USA) */
+  { GameCode("BPRE"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Fire Red Version (USA, Europe) */
+  { GameCode("BPGE"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Leaf Green Version (USA, Europe) */
+  { GameCode("BT4E"), { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball GT - Transformation (USA) */
+  { GameCode("BUFE"), { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* 2 Games in 1 - Dragon Ball Z - Buu's Fury + Dragon Ball GT - Transformation (USA) */
+  { GameCode("BYGE"), { Config::BackupType::SRAM, GPIODeviceType::None, false } },      /* Yu-Gi-Oh! GX - Duel Academy (USA) */
+  { GameCode("KYGE"), { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Yoshi - Topsy-Turvy (USA) */
+  { GameCode("PSAE"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* e-Reader (USA) */
+  { GameCode("U3IE"), { Config::BackupType::Detect, GPIODeviceType::RTC, false } },     /* Boktai - The Sun Is in Your Hand (USA) */
+  { GameCode("U32E"), { Config::BackupType::Detect, GPIODeviceType::RTC, false } },     /* Boktai 2 - Solar Boy Django (USA) */
+  { GameCode("ALFJ"), { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Dragon Ball Z - The Legacy of Goku II International (Japan) */
+  { GameCode("AXPJ"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pocket Monsters - Sapphire (Japan) */
+  { GameCode("AXVJ"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pocket Monsters - Ruby (Japan) */
+  { GameCode("AX4J"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Super Mario Advance 4 (Japan) */
+  { GameCode("BFTJ"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* F-Zero - Climax (Japan) */
+  { GameCode("BGWJ"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Game Boy Wars Advance 1+2 (Japan) */
+  { GameCode("BKAJ"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Sennen Kazoku (Japan) */
+  { GameCode("BPEJ"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pocket Monsters - Emerald (Japan) */
+  { GameCode("BPGJ"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pocket Monsters - Leaf Green (Japan) */
+  { GameCode("BPRJ"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pocket Monsters - Fire Red (Japan) */
+  { GameCode("BDKJ"), { Config::BackupType::EEPROM_64, GPIODeviceType::None, false } }, /* Digi Communication 2 - Datou! Black Gemagema Dan (Japan) */
+  { GameCode("BR4J"), { Config::BackupType::Detect, GPIODeviceType::RTC, false } },     /* Rockman EXE 4.5 - Real Operation (Japan) */
+  { GameCode("FMBJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 01 - Super Mario Bros. (Japan) */
+  { GameCode("FCLJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 12 - Clu Clu Land (Japan) */
+  { GameCode("FBFJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 13 - Balloon Fight (Japan) */
+  { GameCode("FWCJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 14 - Wrecking Crew (Japan) */
+  { GameCode("FDMJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 15 - Dr. Mario (Japan) */
+  { GameCode("FDDJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 16 - Dig Dug (Japan) */
+  { GameCode("FTBJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 17 - Takahashi Meijin no Boukenjima (Japan) */
+  { GameCode("FMKJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 18 - Makaimura (Japan) */
+  { GameCode("FTWJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 19 - Twin Bee (Japan) */
+  { GameCode("FGGJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 20 - Ganbare Goemon! Karakuri Douchuu (Japan) */
+  { GameCode("FM2J"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 21 - Super Mario Bros. 2 (Japan) */
+  { GameCode("FNMJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 22 - Nazo no Murasame Jou (Japan) */
+  { GameCode("FMRJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 23 - Metroid (Japan) */
+  { GameCode("FPTJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 24 - Hikari Shinwa - Palthena no Kagami (Japan) */
+  { GameCode("FLBJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 25 - The Legend of Zelda 2 - Link no Bouken (Japan) */
+  { GameCode("FFMJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 26 - Famicom Mukashi Banashi - Shin Onigashima - Zen Kou Hen (Japan) */
+  { GameCode("FTKJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 27 - Famicom Tantei Club - Kieta Koukeisha - Zen Kou Hen (Japan) */
+  { GameCode("FTUJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 28 - Famicom Tantei Club Part II - Ushiro ni Tatsu Shoujo - Zen Kou Hen (Japan) */
+  { GameCode("FADJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 29 - Akumajou Dracula (Japan) */
+  { GameCode("FSDJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, true } },   /* Famicom Mini Vol. 30 - SD Gundam World - Gachapon Senshi Scramble Wars (Japan) */
+  { GameCode("KHPJ"), { Config::BackupType::EEPROM_64/*_SENSOR*/, GPIODeviceType::None, false } }, /* Koro Koro Puzzle - Happy Panechu! (Japan) */
+  { GameCode("KYGJ"), { Config::BackupType::EEPROM_64/*_SENSOR*/, GPIODeviceType::None, false } }, /* Yoshi no Banyuuinryoku (Japan) */
+  { GameCode("PSAJ"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Card e-Reader+ (Japan) */
+  { GameCode("U3IJ"), { Config::BackupType::Detect, GPIODeviceType::RTC, false } },     /* Bokura no Taiyou - Taiyou Action RPG (Japan) */
+  { GameCode("U32J"), { Config::BackupType::Detect, GPIODeviceType::RTC, false } },     /* Zoku Bokura no Taiyou - Taiyou Shounen Django (Japan) */
+  { GameCode("U33J"), { Config::BackupType::Detect, GPIODeviceType::RTC, false } },     /* Shin Bokura no Taiyou - Gyakushuu no Sabata (Japan) */
+  { GameCode("AXPF"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Version Saphir (France) */
+  { GameCode("AXVF"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Version Rubis (France) */
+  { GameCode("BPEF"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Version Emeraude (France) */
+  { GameCode("BPGF"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Version Vert Feuille (France) */
+  { GameCode("BPRF"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Version Rouge Feu (France) */
+  { GameCode("AXPI"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Versione Zaffiro (Italy) */
+  { GameCode("AXVI"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Versione Rubino (Italy) */
+  { GameCode("BPEI"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Versione Smeraldo (Italy) */
+  { GameCode("BPGI"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Versione Verde Foglia (Italy) */
+  { GameCode("BPRI"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Versione Rosso Fuoco (Italy) */
+  { GameCode("AXPD"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Saphir-Edition (Germany) */
+  { GameCode("AXVD"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Rubin-Edition (Germany) */
+  { GameCode("BPED"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Smaragd-Edition (Germany) */
+  { GameCode("BPGD"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Blattgruene Edition (Germany) */
+  { GameCode("BPRD"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Feuerrote Edition (Germany) */
+  { GameCode("AXPS"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Edicion Zafiro (Spain) */
+  { GameCode("AXVS"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Edicion Rubi (Spain) */
+  { GameCode("BPES"), { Config::BackupType::FLASH_128, GPIODeviceType::RTC, false } },  /* Pokemon - Edicion Esmeralda (Spain) */
+  { GameCode("BPGS"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Edicion Verde Hoja (Spain) */
+  { GameCode("BPRS"), { Config::BackupType::FLASH_128, GPIODeviceType::None, false } }, /* Pokemon - Edicion Rojo Fuego (Spain) */
+  { GameCode("A9DP"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } },  /* DOOM II */
+  { GameCode("AAOJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } },  /* Acrobat Kid (Japan) */
+  { GameCode("BGDP"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } },  /* Baldur's Gate - Dark Alliance (Europe) */
+  { GameCode("BGDE"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } },  /* Baldur's Gate - Dark Alliance (USA) */
+  { GameCode("BJBE"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } },  /* 007 - Everything or Nothing (USA, Europe) (En,Fr,De) */
+  { GameCode("BJBJ"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } },  /* 007 - Everything or Nothing (Japan) */
+  { GameCode("ALUP"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } },  /* 0937 - Super Monkey Ball Jr. (Europe) */
+  { GameCode("ALUE"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } },  /* 0763 - Super Monkey Ball Jr. (USA) */
+  { GameCode("BL8E"), { Config::BackupType::EEPROM_4, GPIODeviceType::None, false } },  /* 2561 - Tomb Raider - Legend  */
 };
 
+// Settings that only apply to one revision of a game, keyed by the CRC32 of the ROM.
+constexpr std::array<Revision, 0> kRevisions {};
+
+// A perfect hash is found quickly while the table has more than about n^2 / 4 slots (n entries).
+constexpr int kTableBits = 12;
+constexpr int kTableSize = 1 << kTableBits;
+
+static_assert(std::size(kEntries) < 256, "GameDB: the table index needs to be widened");
+
+constexpr auto Hash(u32 game_code, u32 seed) -> int {
+  return int((game_code * seed) >> (32 - kTableBits));
+}
+
+// Finds a multiplier for which no two game codes hash to the same slot.
+constexpr auto kSeed = []() -> u32 {
+  for (u32 seed = 0x9E3779B1; seed < 0x9E3779B1 + 2 * 65536; seed += 2) {
+    std::array<bool, kTableSize> used{};
+    bool perfect = true;
+
+    for (auto& entry : kEntries) {
+      auto& slot = used[Hash(entry.game_code, seed)];
+      if (slot) {
+        perfect = false;
+        break;
+      }
+      slot = true;
+    }
+
+    if (perfect) {
+      return seed;
+    }
+  }
+  return 0;
+}();
+
+static_assert(kSeed != 0, "GameDB: no perfect hash found, the hash table needs to be grown");
+
+// Index into kEntries plus one for every slot, zero for empty slots.
+constexpr auto kTable = []() {
+  std::array<u8, kTableSize> table{};
+
+  for (size_t i = 0; i < std::size(kEntries); i++) {
+    table[Hash(kEntries[i].game_code, kSeed)] = u8(i + 1);
+  }
+  return table;
+}();
+
+// The hints file is shared by all threads that load ROMs.
+struct HintsFile {
+  std::mutex mutex;
+  std::string path;
+  std::filesystem::file_time_type write_time;
+  std::unordered_map<u32, GameHints> games;
+};
+
+auto GetHintsFile() -> HintsFile& {
+  static HintsFile file;
+  return file;
+}
+
+auto ParseHints(toml::value const& table) -> GameHints {
+  GameHints hints;
+
+  auto idle_loops = toml::find_or<std::vector<u32>>(table, "idle_loops", {});
+
+  if (idle_loops.size() > GameHints::kMaxIdleLoops) {
+    Log<Warn>("GameDB: only the first {} idle loops are used.", GameHints::kMaxIdleLoops);
+  }
+
+  for (size_t i = 0; i < idle_loops.size() && i < GameHints::kMaxIdleLoops; i++) {
+    hints.idle_loops[i] = idle_loops[i];
+  }
+
+  hints.mp2k_sound_main_ram = toml::find_or<u32>(table, "mp2k_sound_main_ram", 0);
+
+  for (auto function : toml::find_or<std::vector<int>>(table, "hle_bios_functions", {})) {
+    if (function >= 0 && function < 64) {
+      hints.hle_bios_functions |= 1ULL << function;
+    }
+  }
+
+  if (table.contains("cpu_backend")) {
+    auto backend = toml::find<std::string>(table, "cpu_backend");
+
+    const std::map<std::string, Config::CPU::Backend> backends{
+      { "interpreter",        Config::CPU::Backend::Interpreter       },
+      { "cached_interpreter", Config::CPU::Backend::CachedInterpreter }
+    };
+
+    auto match = backends.find(backend);
+
+    if (match != backends.end()) {
+      hints.cpu_backend = match->second;
+    } else {
+      Log<Warn>("GameDB: unknown CPU backend: {}", backend);
+    }
+  }
+
+  return hints;
+}
+
+// Reads the hints file again if it was modified. Must be called with the mutex held.
+void UpdateHintsFile(HintsFile& file) {
+  std::error_code error;
+
+  auto write_time = std::filesystem::last_write_time(file.path, error);
+
+  if (error || write_time == file.write_time) {
+    return;
+  }
+
+  file.write_time = write_time;
+
+  std::unordered_map<u32, GameHints> games;
+
+  try {
+    auto data = toml::parse(file.path);
+
+    for (auto const& [key, table] : data.as_table()) {
+      if (key.size() != 4 || !table.is_table()) {
+        Log<Warn>("GameDB: {} is not a game code.", key);
+        continue;
+      }
+
+      games[u8(key[0]) | (u8(key[1]) << 8) | (u8(key[2]) << 16) | (u32(u8(key[3])) << 24)] = ParseHints(table);
+    }
+  } catch (std::exception& ex) {
+    // Keep the hints from before, the file may be in the middle of being edited.
+    Log<Error>("GameDB: error while parsing the hints file: {}", ex.what());
+    return;
+  }
+
+  file.games = std::move(games);
+  Log<Info>("GameDB: loaded hints for {} games from {}", file.games.size(), file.path);
+}
+
+} // namespace
+
+auto GameDB::Find(u32 game_code) -> GameInfo const* {
+  auto index = kTable[Hash(game_code, kSeed)];
+
+  if (index != 0 && kEntries[index - 1].game_code == game_code) {
+    return &kEntries[index - 1].info;
+  }
+  return nullptr;
+}
+
+bool GameDB::HasRevisions(u32 game_code) {
+  for (auto& revision : kRevisions) {
+    if (revision.game_code == game_code) {
+      return true;
+    }
+  }
+  return false;
+}
+
+auto GameDB::FindRevision(u32 game_code, u32 crc32) -> GameInfo const* {
+  for (auto& revision : kRevisions) {
+    if (revision.game_code == game_code && revision.crc32 == crc32) {
+      return &revision.info;
+    }
+  }
+  return Find(game_code);
+}
+
+void GameDB::SetHintsFile(std::string const& path) {
+  auto& file = GetHintsFile();
+
+  std::lock_guard lock{file.mutex};
+
+  file.path = path;
+  file.write_time = {};
+  file.games.clear();
+}
+
+bool GameDB::FindHints(u32 game_code, GameHints& hints) {
+  auto& file = GetHintsFile();
+
+  std::lock_guard lock{file.mutex};
+
+  if (file.path.empty()) {
+    return false;
+  }
+
+  UpdateHintsFile(file);
+
+  auto match = file.games.find(game_code);
+
+  if (match == file.games.end()) {
+    return false;
+  }
+
+  hints = match->second;
+  return true;
+}
+
 } // namespace nba
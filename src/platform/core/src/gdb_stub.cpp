@@ -0,0 +1,614 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <fmt/format.h>
+#include <nba/log.hpp>
+#include <platform/gdb_stub.hpp>
+
+#if defined(_WIN32)
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX
+  #include <winsock2.h>
+  #include <ws2tcpip.h>
+#else
+  #include <arpa/inet.h>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <sys/select.h>
+  #include <sys/socket.h>
+  #include <unistd.h>
+#endif
+
+namespace nba {
+
+namespace {
+
+#if defined(_WIN32)
+  using SocketHandle = SOCKET;
+
+  void CloseSocket(std::intptr_t socket) {
+    closesocket((SocketHandle)socket);
+  }
+#else
+  using SocketHandle = int;
+
+  void CloseSocket(std::intptr_t socket) {
+    close((SocketHandle)socket);
+  }
+#endif
+
+#if defined(MSG_NOSIGNAL)
+  // Do not raise SIGPIPE if the debugger went away.
+  constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+  constexpr int kSendFlags = 0;
+#endif
+
+constexpr int kSignalInterrupt = 2; // SIGINT
+constexpr int kSignalTrap = 5;      // SIGTRAP
+
+// The register numbers of GDB for ARM without a target description: r0-r15, then the FPA registers f0-f7 (12 bytes each), fps and cpsr.
+constexpr int kRegisterF0 = 16;
+constexpr int kRegisterFPS = 24;
+constexpr int kRegisterCPSR = 25;
+constexpr int kRegisterCount = 26;
+
+// The largest packet that the client may send (advertised in qSupported), which also bounds the size of replies.
+constexpr size_t kPacketSize = 0x1000;
+
+// Registers are sent as little-endian hex.
+auto ToHex(u32 value, int bytes = 4) -> std::string {
+  auto hex = std::string{};
+
+  for (int i = 0; i < bytes; i++) {
+    hex += fmt::format("{:02x}", (value >> (i * 8)) & 0xFF);
+  }
+  return hex;
+}
+
+auto HexDigit(char digit) -> u32 {
+  if (digit >= 'a') return digit - 'a' + 10;
+  if (digit >= 'A') return digit - 'A' + 10;
+  return digit - '0';
+}
+
+// Addresses, lengths and register numbers are big-endian hex of any length.
+auto ParseHex(std::string const& text, size_t& position) -> u32 {
+  u32 value = 0;
+
+  while (position < text.size() && std::isxdigit((unsigned char)text[position])) {
+    value = (value << 4) | HexDigit(text[position++]);
+  }
+  return value;
+}
+
+auto ParseHexLE(std::string const& text, size_t position) -> u32 {
+  u32 value = 0;
+
+  for (int i = 0; i < 4 && position + i * 2 + 1 < text.size(); i++) {
+    value |= (HexDigit(text[position + i * 2]) << 4 | HexDigit(text[position + i * 2 + 1])) << (i * 8);
+  }
+  return value;
+}
+
+auto ReadRegister(CoreBase::CPURegisters const& registers, int index) -> std::string {
+  if (index < kRegisterF0) {
+    return ToHex(registers.reg[index]);
+  }
+
+  if (index < kRegisterFPS) {
+    return std::string(24, '0');
+  }
+
+  if (index == kRegisterCPSR) {
+    return ToHex(registers.cpsr);
+  }
+
+  return std::string(8, '0');
+}
+
+} // namespace
+
+GDBStub::GDBStub(CoreBase& core) : core(core) {
+#if defined(_WIN32)
+  WSADATA data;
+  WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+}
+
+GDBStub::~GDBStub() {
+  if (client_socket != kNoSocket) {
+    CloseSocket(client_socket);
+  }
+
+  if (listen_socket != kNoSocket) {
+    CloseSocket(listen_socket);
+  }
+
+#if defined(_WIN32)
+  WSACleanup();
+#endif
+}
+
+bool GDBStub::Listen(u16 port) {
+  auto fd = std::intptr_t(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+
+  if (fd == kNoSocket) {
+    return false;
+  }
+
+  int reuse = 1;
+  setsockopt((SocketHandle)fd, SOL_SOCKET, SO_REUSEADDR, (char const*)&reuse, sizeof(reuse));
+
+  // The debugger can read and write all of the guest, so it is only reachable from this machine.
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+
+  if (bind((SocketHandle)fd, (sockaddr*)&address, sizeof(address)) != 0 || listen((SocketHandle)fd, 1) != 0) {
+    CloseSocket(fd);
+    return false;
+  }
+
+  listen_socket = fd;
+  return true;
+}
+
+bool GDBStub::Serve() {
+  auto fd = std::intptr_t(accept((SocketHandle)listen_socket, nullptr, nullptr));
+
+  if (fd == kNoSocket) {
+    return false;
+  }
+
+  // Packets are small and answered one at a time.
+  int no_delay = 1;
+  setsockopt((SocketHandle)fd, IPPROTO_TCP, TCP_NODELAY, (char const*)&no_delay, sizeof(no_delay));
+
+  client_socket = fd;
+  receive_size = 0;
+  receive_offset = 0;
+  no_ack = false;
+  session = Session::Attached;
+  stop_signal = kSignalTrap;
+  watch_hit = false;
+
+  core.SetWatchpointCallback([this](Watchpoint::Hit const& hit) {
+    watch_hit = true;
+    last_watch_hit = hit;
+    return true;
+  });
+
+  Log<Info>("GDBStub: debugger connected.");
+
+  auto packet = std::string{};
+
+  while (session == Session::Attached && ReadPacket(packet)) {
+    auto reply = HandlePacket(packet);
+
+    // Killing the target is the only request without a reply.
+    if (packet != "k") {
+      SendPacket(reply);
+    }
+  }
+
+  Detach();
+  CloseSocket(client_socket);
+  client_socket = kNoSocket;
+
+  Log<Info>("GDBStub: debugger disconnected.");
+  return session == Session::Detached;
+}
+
+auto GDBStub::ReadByte() -> int {
+  if (receive_offset == receive_size) {
+    auto size = recv((SocketHandle)client_socket, receive_buffer, sizeof(receive_buffer), 0);
+
+    if (size <= 0) {
+      return -1;
+    }
+
+    receive_size = int(size);
+    receive_offset = 0;
+  }
+
+  return (u8)receive_buffer[receive_offset++];
+}
+
+bool GDBStub::ReadPacket(std::string& packet) {
+  while (true) {
+    int byte;
+
+    // Skip acknowledgements and interrupts that arrive while the target is stopped anyway.
+    do {
+      byte = ReadByte();
+      if (byte == -1) return false;
+    } while (byte != '$');
+
+    u8 checksum = 0;
+
+    packet.clear();
+
+    while ((byte = ReadByte()) != '#') {
+      if (byte == -1) return false;
+      packet += char(byte);
+      checksum += u8(byte);
+    }
+
+    auto high = ReadByte();
+    auto low = ReadByte();
+
+    if (high == -1 || low == -1) {
+      return false;
+    }
+
+    bool valid = std::isxdigit(high) && std::isxdigit(low) && (HexDigit(char(high)) << 4 | HexDigit(char(low))) == checksum;
+
+    if (!no_ack) {
+      send((SocketHandle)client_socket, valid ? "+" : "-", 1, kSendFlags);
+    }
+
+    if (valid) {
+      return true;
+    }
+  }
+}
+
+void GDBStub::SendPacket(std::string const& data) {
+  u8 checksum = 0;
+
+  for (auto c : data) {
+    checksum += u8(c);
+  }
+
+  // Only hex and plain text is sent, which never needs to be escaped.
+  auto packet = fmt::format("${}#{:02x}", data, checksum);
+  size_t sent = 0;
+
+  while (sent < packet.size()) {
+    auto size = send((SocketHandle)client_socket, packet.data() + sent, int(packet.size() - sent), kSendFlags);
+
+    if (size <= 0) {
+      return;
+    }
+    sent += size_t(size);
+  }
+}
+
+// Returns true if the debugger asked to stop the target (Ctrl-C) or went away, without waiting for it.
+bool GDBStub::PollInterrupt() {
+  while (true) {
+    if (receive_offset == receive_size) {
+      fd_set set;
+      timeval timeout{};
+
+      FD_ZERO(&set);
+      FD_SET((SocketHandle)client_socket, &set);
+
+      if (select(int(client_socket + 1), &set, nullptr, nullptr, &timeout) <= 0) {
+        return false;
+      }
+    }
+
+    auto byte = ReadByte();
+
+    if (byte == -1) {
+      session = Session::Killed;
+      return true;
+    }
+
+    if (byte == 0x03) {
+      return true;
+    }
+  }
+}
+
+auto GDBStub::HandlePacket(std::string const& packet) -> std::string {
+  if (packet.empty()) {
+    return "";
+  }
+
+  size_t position = 1;
+
+  switch (packet[0]) {
+    case '?': {
+      return GetStopReply();
+    }
+    case 'g': {
+      auto registers = core.GetCPURegisters();
+      auto reply = std::string{};
+
+      for (int i = 0; i < kRegisterCount; i++) {
+        reply += ReadRegister(registers, i);
+      }
+      return reply;
+    }
+    case 'G': {
+      auto registers = core.GetCPURegisters();
+      size_t offset = 1;
+
+      for (int i = 0; i < kRegisterCount; i++) {
+        auto size = ReadRegister(registers, i).size();
+
+        if (offset + size > packet.size()) {
+          return "E01";
+        }
+
+        if (i < kRegisterF0) {
+          registers.reg[i] = ParseHexLE(packet, offset);
+        } else if (i == kRegisterCPSR) {
+          registers.cpsr = ParseHexLE(packet, offset);
+        }
+        offset += size;
+      }
+
+      core.SetCPURegisters(registers);
+      return "OK";
+    }
+    case 'p': {
+      auto index = ParseHex(packet, position);
+
+      if (index >= u32(kRegisterCount)) {
+        return "E01";
+      }
+      return ReadRegister(core.GetCPURegisters(), int(index));
+    }
+    case 'P': {
+      auto index = ParseHex(packet, position);
+
+      if (index >= u32(kRegisterCount) || position == packet.size() || packet[position] != '=') {
+        return "E01";
+      }
+
+      WriteRegister(int(index), ParseHexLE(packet, position + 1));
+      return "OK";
+    }
+    case 'm': {
+      auto address = ParseHex(packet, position);
+      auto reply = std::string{};
+
+      if (position == packet.size() || packet[position] != ',') {
+        return "E01";
+      }
+
+      auto length = ParseHex(packet, ++position);
+
+      if (length > kPacketSize / 2) {
+        return "E01";
+      }
+
+      for (u32 i = 0; i < length; i++) {
+        reply += ToHex(core.DebugRead(address + i), 1);
+      }
+      return reply;
+    }
+    case 'M': {
+      auto address = ParseHex(packet, position);
+
+      if (position == packet.size() || packet[position] != ',') {
+        return "E01";
+      }
+
+      auto length = size_t(ParseHex(packet, ++position));
+
+      if (position == packet.size() || packet[position] != ':' || length > (packet.size() - position - 1) / 2) {
+        return "E01";
+      }
+
+      for (size_t i = 0; i < length; i++) {
+        auto offset = position + 1 + i * 2;
+
+        core.DebugWrite(address + i, u8(HexDigit(packet[offset]) << 4 | HexDigit(packet[offset + 1])));
+      }
+      return "OK";
+    }
+    case 'c':
+    case 's': {
+      // Optionally resume at another address.
+      if (packet.size() > 1) {
+        WriteRegister(15, ParseHex(packet, position));
+      }
+
+      if (packet[0] == 'c') {
+        return Continue();
+      }
+
+      core.StepInstruction();
+      stop_signal = kSignalTrap;
+      watch_hit = false;
+      return GetStopReply();
+    }
+    case 'Z':
+    case 'z': {
+      return HandleBreakpoint(packet);
+    }
+    case 'q':
+    case 'Q': {
+      return HandleQuery(packet);
+    }
+    case 'v': {
+      if (packet.rfind("vKill", 0) == 0) {
+        session = Session::Killed;
+        return "OK";
+      }
+      return "";
+    }
+    // There is a single thread, so selecting a thread or asking whether it is alive always succeeds.
+    case 'H':
+    case 'T': {
+      return "OK";
+    }
+    case 'D': {
+      session = Session::Detached;
+      return "OK";
+    }
+    case 'k': {
+      session = Session::Killed;
+      return "";
+    }
+  }
+
+  return "";
+}
+
+auto GDBStub::HandleQuery(std::string const& packet) -> std::string {
+  if (packet.rfind("qSupported", 0) == 0) {
+    return fmt::format("PacketSize={:X};QStartNoAckMode+", kPacketSize);
+  }
+
+  if (packet == "QStartNoAckMode") {
+    no_ack = true;
+    return "OK";
+  }
+
+  if (packet == "qAttached") return "1";
+  if (packet == "qC") return "QC1";
+  if (packet == "qfThreadInfo") return "m1";
+  if (packet == "qsThreadInfo") return "l";
+
+  return "";
+}
+
+// Z<type>,<address>,<kind> inserts and z<type>,<address>,<kind> removes a breakpoint or watchpoint.
+auto GDBStub::HandleBreakpoint(std::string const& packet) -> std::string {
+  bool insert = packet[0] == 'Z';
+  size_t position = 1;
+
+  auto type = ParseHex(packet, position);
+
+  if (position == packet.size() || packet[position] != ',') {
+    return "E01";
+  }
+
+  auto address = ParseHex(packet, ++position);
+
+  if (position == packet.size() || packet[position] != ',') {
+    return "E01";
+  }
+
+  auto kind = ParseHex(packet, ++position);
+
+  switch (type) {
+    // Software and hardware breakpoints, the kind is the size of the instruction.
+    case 0:
+    case 1: {
+      if (insert) {
+        breakpoints.push_back(address);
+        core.AddBreakpoint(address);
+      } else {
+        auto match = std::find(breakpoints.begin(), breakpoints.end(), address);
+
+        if (match == breakpoints.end()) {
+          return "E01";
+        }
+
+        breakpoints.erase(match);
+
+        // Both kinds may be set at the same address.
+        if (std::find(breakpoints.begin(), breakpoints.end(), address) == breakpoints.end()) {
+          core.RemoveBreakpoint(address);
+        }
+      }
+      return "OK";
+    }
+    // Write, read and access watchpoints, the kind is the size of the watched range.
+    case 2:
+    case 3:
+    case 4: {
+      if (insert) {
+        static constexpr int kKinds[3] { Watchpoint::Write, Watchpoint::Read, Watchpoint::Read | Watchpoint::Write };
+
+        watches.push_back({core.AddWatchpoint(address, kind, kKinds[type - 2]), int(type), address, kind});
+      } else {
+        auto match = std::find_if(watches.begin(), watches.end(), [&](Watch const& watch) {
+          return watch.type == int(type) && watch.address == address && watch.size == kind;
+        });
+
+        if (match == watches.end()) {
+          return "E01";
+        }
+
+        core.RemoveWatchpoint(match->id);
+        watches.erase(match);
+      }
+      return "OK";
+    }
+  }
+
+  return "";
+}
+
+auto GDBStub::Continue() -> std::string {
+  watch_hit = false;
+
+  while (true) {
+    auto result = core.RunSlice({});
+
+    if (result.stop == CoreBase::RunResult::Stop::Breakpoint || result.stop == CoreBase::RunResult::Stop::Watchpoint) {
+      stop_signal = kSignalTrap;
+      break;
+    }
+
+    // The socket is polled once per emulated frame.
+    if (PollInterrupt()) {
+      stop_signal = kSignalInterrupt;
+      break;
+    }
+  }
+
+  return GetStopReply();
+}
+
+auto GDBStub::GetStopReply() -> std::string {
+  if (watch_hit) {
+    auto match = std::find_if(watches.begin(), watches.end(), [&](Watch const& watch) {
+      return watch.id == last_watch_hit.id;
+    });
+
+    if (match != watches.end()) {
+      static constexpr char const* kNames[3] { "watch", "rwatch", "awatch" };
+
+      return fmt::format("T{:02x}{}:{:08x};", stop_signal, kNames[match->type - 2], last_watch_hit.address);
+    }
+  }
+
+  return fmt::format("S{:02x}", stop_signal);
+}
+
+void GDBStub::WriteRegister(int index, u32 value) {
+  auto registers = core.GetCPURegisters();
+
+  if (index < kRegisterF0) {
+    registers.reg[index] = value;
+  } else if (index == kRegisterCPSR) {
+    registers.cpsr = value;
+  } else {
+    return;
+  }
+
+  core.SetCPURegisters(registers);
+}
+
+// Removes everything that the debugger has set, the core keeps running without it.
+void GDBStub::Detach() {
+  for (auto address : breakpoints) {
+    core.RemoveBreakpoint(address);
+  }
+
+  for (auto const& watch : watches) {
+    core.RemoveWatchpoint(watch.id);
+  }
+
+  breakpoints.clear();
+  watches.clear();
+  core.SetWatchpointCallback({});
+}
+
+} // namespace nba
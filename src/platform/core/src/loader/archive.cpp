@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstring>
+#include <limits>
+#include <nba/common/punning.hpp>
+#include <nba/log.hpp>
+#include <string_view>
+#include <zlib.h>
+
+#include "loader/archive.hpp"
+
+namespace nba {
+
+static constexpr size_t kChunkSize = 64 * 1024;
+
+auto ArchiveLoader::Load(
+  std::string const& path,
+  size_t max_size,
+  std::vector<u8>& data
+) -> Result {
+  auto stream = std::ifstream{path, std::ios::binary};
+  if (!stream.good()) {
+    return Result::CannotOpenFile;
+  }
+
+  u8 magic[6] {};
+  stream.read((char*)magic, sizeof(magic));
+  stream.clear();
+  stream.seekg(0);
+
+  if (std::memcmp(magic, "PK\x03\x04", 4) == 0) {
+    return LoadZIP(stream, max_size, data);
+  }
+
+  if (magic[0] == 0x1F && magic[1] == 0x8B) {
+    return LoadGZip(stream, max_size, data);
+  }
+
+  if (std::memcmp(magic, "7z\xBC\xAF\x27\x1C", 6) == 0) {
+    Log<Error>("ArchiveLoader: 7z archives are not supported.");
+    return Result::Unsupported;
+  }
+
+  return Result::NotAnArchive;
+}
+
+auto ArchiveLoader::LoadZIP(
+  std::ifstream& stream,
+  size_t max_size,
+  std::vector<u8>& data
+) -> Result {
+  static constexpr size_t kEndRecordSize = 22;
+  static constexpr size_t kMaxCommentSize = 0xFFFF;
+
+  /* Locate the end of central directory record. It is followed only by the archive comment,
+   * so it must be within the last (kEndRecordSize + kMaxCommentSize) bytes of the file.
+   */
+  stream.seekg(0, std::ios::end);
+  auto file_size = size_t(stream.tellg());
+
+  if (file_size < kEndRecordSize) {
+    return Result::BadArchive;
+  }
+
+  auto tail_size = std::min(file_size, kEndRecordSize + kMaxCommentSize);
+  auto tail = std::vector<u8>(tail_size);
+
+  stream.seekg(file_size - tail_size);
+  stream.read((char*)tail.data(), tail_size);
+
+  auto end_record = -1;
+
+  for (int i = int(tail_size - kEndRecordSize); i >= 0; i--) {
+    if (read<u32>(tail.data(), i) == 0x06054B50) {
+      end_record = i;
+      break;
+    }
+  }
+
+  if (end_record == -1) {
+    return Result::BadArchive;
+  }
+
+  auto entry_count = read<u16>(tail.data(), end_record + 10);
+  auto directory_size = read<u32>(tail.data(), end_record + 12);
+  auto directory_offset = read<u32>(tail.data(), end_record + 16);
+
+  if (size_t(directory_offset) + directory_size > file_size) {
+    return Result::BadArchive;
+  }
+
+  auto directory = std::vector<u8>(directory_size);
+
+  stream.seekg(directory_offset);
+  stream.read((char*)directory.data(), directory_size);
+
+  // Pick the first entry that looks like a GBA ROM image.
+  auto is_rom_name = [](std::string_view name) {
+    static constexpr std::string_view extensions[] { ".gba", ".agb", ".bin" };
+
+    for (auto extension : extensions) {
+      if (name.size() >= extension.size() &&
+          std::equal(extension.begin(), extension.end(), name.end() - extension.size(),
+            [](char a, char b) { return a == std::tolower((unsigned char)b); })) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  size_t offset = 0;
+
+  for (int i = 0; i < entry_count; i++) {
+    if (offset + 46 > directory_size || read<u32>(directory.data(), offset) != 0x02014B50) {
+      return Result::BadArchive;
+    }
+
+    auto method = read<u16>(directory.data(), offset + 10);
+    auto crc = read<u32>(directory.data(), offset + 16);
+    auto compressed_size = read<u32>(directory.data(), offset + 20);
+    auto uncompressed_size = read<u32>(directory.data(), offset + 24);
+    auto name_length = read<u16>(directory.data(), offset + 28);
+    auto extra_length = read<u16>(directory.data(), offset + 30);
+    auto comment_length = read<u16>(directory.data(), offset + 32);
+    auto local_header_offset = read<u32>(directory.data(), offset + 42);
+
+    if (offset + 46 + name_length > directory_size) {
+      return Result::BadArchive;
+    }
+
+    auto name = std::string_view{(char const*)&directory[offset + 46], name_length};
+
+    offset += 46 + name_length + extra_length + comment_length;
+
+    if (!is_rom_name(name)) {
+      continue;
+    }
+
+    if (uncompressed_size > max_size) {
+      return Result::TooBig;
+    }
+
+    // The local header may have a different amount of extra data than the central directory.
+    u8 local_header[30];
+
+    stream.seekg(local_header_offset);
+    stream.read((char*)local_header, sizeof(local_header));
+
+    if (!stream.good() || read<u32>(local_header, 0) != 0x04034B50) {
+      return Result::BadArchive;
+    }
+
+    stream.seekg(local_header_offset + 30 + read<u16>(local_header, 26) + read<u16>(local_header, 28));
+
+    Result result;
+
+    switch (method) {
+      // Stored
+      case 0: {
+        if (compressed_size != uncompressed_size) {
+          return Result::BadArchive;
+        }
+        data.resize(uncompressed_size);
+        stream.read((char*)data.data(), uncompressed_size);
+        result = stream.good() ? Result::Success : Result::BadArchive;
+        break;
+      }
+      // Deflate
+      case 8: {
+        data.reserve(uncompressed_size);
+        result = Inflate(stream, -MAX_WBITS, compressed_size, max_size, data);
+        break;
+      }
+      default: {
+        Log<Error>("ArchiveLoader: unsupported ZIP compression method: {}", method);
+        return Result::Unsupported;
+      }
+    }
+
+    if (result == Result::Success &&
+        ::crc32(0, data.data(), uInt(data.size())) != crc) {
+      Log<Error>("ArchiveLoader: CRC32 mismatch in ZIP entry '{}'", name);
+      return Result::BadArchive;
+    }
+
+    return result;
+  }
+
+  Log<Error>("ArchiveLoader: ZIP archive does not contain a ROM image.");
+  return Result::BadArchive;
+}
+
+auto ArchiveLoader::LoadGZip(
+  std::ifstream& stream,
+  size_t max_size,
+  std::vector<u8>& data
+) -> Result {
+  // The gzip trailer holds the uncompressed size (modulo 2^32), which lets us size the buffer up front.
+  stream.seekg(-4, std::ios::end);
+
+  u8 trailer[4];
+  stream.read((char*)trailer, sizeof(trailer));
+
+  if (stream.good()) {
+    auto uncompressed_size = read<u32>(trailer, 0);
+
+    if (uncompressed_size > max_size) {
+      return Result::TooBig;
+    }
+    data.reserve(uncompressed_size);
+  }
+
+  stream.clear();
+  stream.seekg(0);
+
+  // zlib parses the gzip header and checks the CRC32 in the trailer.
+  return Inflate(stream, 16 + MAX_WBITS, std::numeric_limits<size_t>::max(), max_size, data);
+}
+
+auto ArchiveLoader::Inflate(
+  std::ifstream& stream,
+  int window_bits,
+  size_t input_size,
+  size_t max_size,
+  std::vector<u8>& data
+) -> Result {
+  z_stream z{};
+
+  if (inflateInit2(&z, window_bits) != Z_OK) {
+    return Result::BadArchive;
+  }
+
+  auto input = std::array<u8, kChunkSize>{};
+  int status = Z_OK;
+  size_t written = 0;
+  u8 overflow;
+
+  // Decompress into the output buffer directly, which was presized by the caller when possible.
+  data.resize(std::min(data.capacity(), max_size));
+
+  while (status != Z_STREAM_END) {
+    if (z.avail_in == 0) {
+      stream.read((char*)input.data(), std::streamsize(std::min(kChunkSize, input_size)));
+
+      auto count = size_t(stream.gcount());
+      if (count == 0) {
+        break;
+      }
+
+      input_size -= count;
+      z.next_in = input.data();
+      z.avail_in = uInt(count);
+    }
+
+    /* Once the buffer is full, let zlib write to a scratch byte first.
+     * The stream may well end without producing any more output,
+     * in which case growing the buffer would have been a waste.
+     */
+    if (written < data.size()) {
+      z.next_out = data.data() + written;
+      z.avail_out = uInt(data.size() - written);
+    } else {
+      z.next_out = &overflow;
+      z.avail_out = 1;
+    }
+
+    status = inflate(&z, Z_NO_FLUSH);
+
+    if (status != Z_OK && status != Z_STREAM_END) {
+      break;
+    }
+
+    if (z.next_out == &overflow + 1) {
+      if (data.size() >= max_size) {
+        inflateEnd(&z);
+        return Result::TooBig;
+      }
+      data.resize(std::min(std::max(data.size() * 2, kChunkSize), max_size));
+      data[written++] = overflow;
+    } else if (z.next_out != &overflow) {
+      written = z.next_out - data.data();
+    }
+  }
+
+  data.resize(written);
+
+  inflateEnd(&z);
+
+  if (status != Z_STREAM_END) {
+    Log<Error>("ArchiveLoader: compressed data is truncated or corrupted.");
+    return Result::BadArchive;
+  }
+
+  return Result::Success;
+}
+
+} // namespace nba
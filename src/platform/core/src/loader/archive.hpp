@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <fstream>
+#include <nba/integer.hpp>
+#include <string>
+#include <vector>
+
+namespace nba {
+
+/* Extracts a ROM image from a ZIP or gzip archive.
+ * The file is read in chunks and decompressed straight into the output buffer,
+ * so that no temporary file is needed and the archive is only read once.
+ */
+struct ArchiveLoader {
+  enum class Result {
+    NotAnArchive,
+    CannotOpenFile,
+    Unsupported,
+    BadArchive,
+    TooBig,
+    Success
+  };
+
+  static auto Load(
+    std::string const& path,
+    size_t max_size,
+    std::vector<u8>& data
+  ) -> Result;
+
+private:
+  static auto LoadZIP(
+    std::ifstream& stream,
+    size_t max_size,
+    std::vector<u8>& data
+  ) -> Result;
+
+  static auto LoadGZip(
+    std::ifstream& stream,
+    size_t max_size,
+    std::vector<u8>& data
+  ) -> Result;
+
+  static auto Inflate(
+    std::ifstream& stream,
+    int window_bits,
+    size_t input_size,
+    size_t max_size,
+    std::vector<u8>& data
+  ) -> Result;
+};
+
+} // namespace nba
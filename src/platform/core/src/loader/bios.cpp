@@ -7,7 +7,9 @@
 
 #include <filesystem>
 #include <fstream>
+#include <mutex>
 #include <platform/loader/bios.hpp>
+#include <string>
 #include <vector>
 
 namespace fs = std::filesystem;
@@ -16,6 +18,16 @@ namespace nba {
 
 static constexpr size_t kBIOSSize = 0x4000;
 
+/* The last BIOS image that was read, so that opening the next game does not go to the disk for it again.
+ * The file is read again if it was modified since.
+ */
+static struct {
+  std::mutex mutex;
+  std::string path;
+  fs::file_time_type write_time;
+  std::vector<u8> data;
+} s_bios_cache;
+
 auto BIOSLoader::Load(
   std::unique_ptr<CoreBase>& core,
   std::string path
@@ -33,17 +45,27 @@ auto BIOSLoader::Load(
     return Result::BadImage;
   }
 
-  auto file_stream = std::ifstream{path, std::ios::binary};
-  if (!file_stream.good()) {
-    return Result::CannotOpenFile;
-  }
+  std::lock_guard guard{s_bios_cache.mutex};
 
-  std::vector<u8> file_data;
-  file_data.resize(size);
-  file_stream.read((char*)file_data.data(), size);
-  file_stream.close();
+  auto write_time = fs::last_write_time(path);
+
+  if (path != s_bios_cache.path || write_time != s_bios_cache.write_time) {
+    auto file_stream = std::ifstream{path, std::ios::binary};
+    if (!file_stream.good()) {
+      return Result::CannotOpenFile;
+    }
+
+    std::vector<u8> file_data;
+    file_data.resize(size);
+    file_stream.read((char*)file_data.data(), size);
+    file_stream.close();
+
+    s_bios_cache.path = path;
+    s_bios_cache.write_time = write_time;
+    s_bios_cache.data = std::move(file_data);
+  }
 
-  core->Attach(file_data);
+  core->Attach(s_bios_cache.data);
   return Result::Success;
 }
 
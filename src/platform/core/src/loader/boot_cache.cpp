@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <cstdio>
+#include <filesystem>
+#include <fmt/format.h>
+#include <memory>
+#include <platform/loader/boot_cache.hpp>
+
+namespace fs = std::filesystem;
+
+namespace nba {
+
+// The real intro takes about 2.5 seconds, the BIOS is given twice as long.
+static constexpr int kMaxBootFrames = 300;
+
+auto BootCache::Boot(
+  CoreBase& core,
+  std::string const& directory
+) -> Result {
+  auto path = (fs::path{directory} / fmt::format("{:016X}.boot", core.GetBootID())).string();
+  auto state = std::make_unique<SaveState>();
+
+  core.Reset();
+
+  // The save data and the RTC belong to the ROM and are taken from the core that was just reset.
+  auto current = std::make_unique<SaveState>();
+  core.CopyState(*current);
+
+  if (auto file = std::fopen(path.c_str(), "rb"); file != nullptr) {
+    bool good = std::fread(state.get(), sizeof(SaveState), 1, file) == 1;
+    std::fclose(file);
+
+    if (good) {
+      state->backup = current->backup;
+      state->gpio = current->gpio;
+
+      // States from older versions are rejected and created anew.
+      if (core.LoadState(*state)) {
+        return Result::Loaded;
+      }
+      core.Reset();
+    }
+  }
+
+  bool done = false;
+  auto id = core.AddWatchpoint(0x08000000, sizeof(u32), Watchpoint::Execute);
+
+  // The opcode is fetched by the BIOS branch to the ROM, so this stops right before the ROM runs.
+  core.SetWatchpointCallback([&](Watchpoint::Hit const&) {
+    done = true;
+    return true;
+  });
+
+  for (int frame = 0; frame < kMaxBootFrames && !done; frame++) {
+    core.RunForOneFrame();
+  }
+
+  core.RemoveWatchpoint(id);
+  core.SetWatchpointCallback({});
+
+  if (!done) {
+    return Result::Timeout;
+  }
+
+  core.CopyState(*state);
+
+  // Do not keep a copy of the save data around.
+  state->backup = {};
+  state->gpio = {};
+
+  auto error = std::error_code{};
+  fs::create_directories(directory, error);
+
+  auto file = std::fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    return Result::CannotWriteFile;
+  }
+  bool good = std::fwrite(state.get(), sizeof(SaveState), 1, file) == 1;
+  std::fclose(file);
+  return good ? Result::Created : Result::CannotWriteFile;
+}
+
+} // namespace nba
@@ -0,0 +1,329 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <nba/common/crc32.hpp>
+#include <nba/common/punning.hpp>
+
+#include "loader/patch.hpp"
+
+namespace fs = std::filesystem;
+
+namespace nba {
+
+namespace {
+
+// Reads the variable-length integers used by UPS and BPS.
+struct PatchReader {
+  PatchReader(std::vector<u8> const& patch, size_t end) : patch(patch), end(end) {}
+
+  bool ReadNumber(u64& value) {
+    u64 shift = 1;
+
+    value = 0;
+
+    while (offset < end) {
+      auto byte = patch[offset++];
+
+      value += (byte & 0x7F) * shift;
+      if (byte & 0x80) {
+        return true;
+      }
+      shift <<= 7;
+      value += shift;
+
+      if (shift > (u64(1) << 56)) {
+        return false;
+      }
+    }
+
+    return false;
+  }
+
+  std::vector<u8> const& patch;
+  size_t end;
+  size_t offset = 0;
+};
+
+auto GetChecksums(std::vector<u8> const& patch, u32& source_crc, u32& target_crc) -> bool {
+  auto size = patch.size();
+
+  source_crc = read<u32>(patch.data(), size - 12);
+  target_crc = read<u32>(patch.data(), size - 8);
+
+  return read<u32>(patch.data(), size - 4) == crc32(patch.data(), int(size - 4));
+}
+
+} // namespace
+
+auto PatchLoader::Apply(
+  std::string const& patch_path,
+  size_t max_size,
+  std::vector<u8>& data
+) -> Result {
+  auto stream = std::ifstream{patch_path, std::ios::binary};
+  if (!stream.good()) {
+    return Result::CannotOpenFile;
+  }
+
+  auto patch = std::vector<u8>(fs::file_size(patch_path));
+  stream.read((char*)patch.data(), patch.size());
+
+  if (!stream.good()) {
+    return Result::CannotOpenFile;
+  }
+
+  if (patch.size() >= 8 && std::memcmp(patch.data(), "PATCH", 5) == 0) {
+    return ApplyIPS(patch, max_size, data);
+  }
+
+  if (patch.size() >= 16 && std::memcmp(patch.data(), "UPS1", 4) == 0) {
+    return ApplyUPS(patch, max_size, data);
+  }
+
+  if (patch.size() >= 16 && std::memcmp(patch.data(), "BPS1", 4) == 0) {
+    return ApplyBPS(patch, max_size, data);
+  }
+
+  return Result::BadPatch;
+}
+
+auto PatchLoader::ApplyIPS(
+  std::vector<u8> const& patch,
+  size_t max_size,
+  std::vector<u8>& data
+) -> Result {
+  auto size = patch.size();
+  size_t offset = 5;
+
+  // IPS records are (offset: u24, length: u16, data) or (offset: u24, 0, length: u16, value: u8), all big-endian.
+  while (offset + 3 <= size) {
+    auto address = (patch[offset] << 16) | (patch[offset + 1] << 8) | patch[offset + 2];
+
+    offset += 3;
+
+    if (address == 0x454F46) { // 'EOF'
+      // The end marker may be followed by the size to truncate the output to.
+      if (offset + 3 <= size) {
+        data.resize((patch[offset] << 16) | (patch[offset + 1] << 8) | patch[offset + 2]);
+      }
+      return Result::Success;
+    }
+
+    if (offset + 2 > size) {
+      return Result::BadPatch;
+    }
+
+    size_t length = (patch[offset] << 8) | patch[offset + 1];
+    bool rle = length == 0;
+
+    offset += 2;
+
+    if (rle) {
+      if (offset + 3 > size) {
+        return Result::BadPatch;
+      }
+      length = (patch[offset] << 8) | patch[offset + 1];
+      offset += 2;
+    } else if (offset + length > size) {
+      return Result::BadPatch;
+    }
+
+    if (address + length > max_size) {
+      return Result::TooBig;
+    }
+
+    if (address + length > data.size()) {
+      data.resize(address + length);
+    }
+
+    if (rle) {
+      std::memset(&data[address], patch[offset++], length);
+    } else {
+      std::memcpy(&data[address], &patch[offset], length);
+      offset += length;
+    }
+  }
+
+  return Result::BadPatch;
+}
+
+auto PatchLoader::ApplyUPS(
+  std::vector<u8> const& patch,
+  size_t max_size,
+  std::vector<u8>& data
+) -> Result {
+  auto reader = PatchReader{patch, patch.size() - 12};
+  u64 source_size;
+  u64 target_size;
+  u32 source_crc;
+  u32 target_crc;
+
+  reader.offset = 4;
+
+  if (!GetChecksums(patch, source_crc, target_crc) ||
+      !reader.ReadNumber(source_size) || !reader.ReadNumber(target_size)) {
+    return Result::BadPatch;
+  }
+
+  if (source_size != data.size() || crc32(data.data(), int(data.size())) != source_crc) {
+    return Result::BadPatch;
+  }
+
+  if (target_size > max_size) {
+    return Result::TooBig;
+  }
+
+  // Bytes past the end of the source read as zero.
+  data.resize(target_size);
+
+  u64 address = 0;
+
+  // Each record skips some bytes and then XORs the following bytes until a zero byte.
+  while (reader.offset < reader.end) {
+    u64 skip;
+
+    if (!reader.ReadNumber(skip)) {
+      return Result::BadPatch;
+    }
+
+    address += skip;
+
+    while (reader.offset < reader.end) {
+      auto byte = patch[reader.offset++];
+
+      if (byte == 0) {
+        break;
+      }
+      if (address < target_size) {
+        data[address] ^= byte;
+      }
+      address++;
+    }
+
+    address++;
+  }
+
+  if (crc32(data.data(), int(data.size())) != target_crc) {
+    return Result::BadPatch;
+  }
+
+  return Result::Success;
+}
+
+auto PatchLoader::ApplyBPS(
+  std::vector<u8> const& patch,
+  size_t max_size,
+  std::vector<u8>& data
+) -> Result {
+  auto reader = PatchReader{patch, patch.size() - 12};
+  u64 source_size;
+  u64 target_size;
+  u64 metadata_size;
+  u32 source_crc;
+  u32 target_crc;
+
+  reader.offset = 4;
+
+  if (!GetChecksums(patch, source_crc, target_crc) || !reader.ReadNumber(source_size) ||
+      !reader.ReadNumber(target_size) || !reader.ReadNumber(metadata_size)) {
+    return Result::BadPatch;
+  }
+
+  if (source_size != data.size() || crc32(data.data(), int(data.size())) != source_crc) {
+    return Result::BadPatch;
+  }
+
+  if (target_size > max_size) {
+    return Result::TooBig;
+  }
+
+  reader.offset += metadata_size;
+
+  auto const& source = data;
+  auto target = std::vector<u8>(target_size);
+  u64 output_offset = 0;
+  s64 source_relative = 0;
+  s64 target_relative = 0;
+
+  auto read_relative = [&](s64& relative) {
+    u64 value;
+
+    if (!reader.ReadNumber(value)) {
+      return false;
+    }
+    relative += (value & 1) ? -s64(value >> 1) : s64(value >> 1);
+    return true;
+  };
+
+  while (reader.offset < reader.end) {
+    u64 command;
+
+    if (!reader.ReadNumber(command)) {
+      return Result::BadPatch;
+    }
+
+    auto length = (command >> 2) + 1;
+
+    if (output_offset + length > target_size) {
+      return Result::BadPatch;
+    }
+
+    switch (command & 3) {
+      // SourceRead
+      case 0: {
+        if (output_offset + length > source_size) {
+          return Result::BadPatch;
+        }
+        std::memcpy(&target[output_offset], &source[output_offset], length);
+        break;
+      }
+      // TargetRead
+      case 1: {
+        if (reader.offset + length > reader.end) {
+          return Result::BadPatch;
+        }
+        std::memcpy(&target[output_offset], &patch[reader.offset], length);
+        reader.offset += length;
+        break;
+      }
+      // SourceCopy
+      case 2: {
+        if (!read_relative(source_relative) || source_relative < 0 || u64(source_relative) + length > source_size) {
+          return Result::BadPatch;
+        }
+        std::memcpy(&target[output_offset], &source[source_relative], length);
+        source_relative += length;
+        break;
+      }
+      // TargetCopy
+      case 3: {
+        if (!read_relative(target_relative) || target_relative < 0 || u64(target_relative) >= output_offset) {
+          return Result::BadPatch;
+        }
+        // The copy may overlap its own output (i.e. to repeat a pattern), so it must go byte by byte.
+        for (u64 i = 0; i < length; i++) {
+          target[output_offset + i] = target[target_relative++];
+        }
+        break;
+      }
+    }
+
+    output_offset += length;
+  }
+
+  if (output_offset != target_size || crc32(target.data(), int(target.size())) != target_crc) {
+    return Result::BadPatch;
+  }
+
+  data = std::move(target);
+  return Result::Success;
+}
+
+} // namespace nba
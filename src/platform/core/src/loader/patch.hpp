@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/integer.hpp>
+#include <string>
+#include <vector>
+
+namespace nba {
+
+// Applies IPS, UPS or BPS patches to a ROM image in memory.
+struct PatchLoader {
+  enum class Result {
+    CannotOpenFile,
+    BadPatch,
+    TooBig,
+    Success
+  };
+
+  static auto Apply(
+    std::string const& patch_path,
+    size_t max_size,
+    std::vector<u8>& data
+  ) -> Result;
+
+private:
+  static auto ApplyIPS(
+    std::vector<u8> const& patch,
+    size_t max_size,
+    std::vector<u8>& data
+  ) -> Result;
+
+  static auto ApplyUPS(
+    std::vector<u8> const& patch,
+    size_t max_size,
+    std::vector<u8>& data
+  ) -> Result;
+
+  static auto ApplyBPS(
+    std::vector<u8> const& patch,
+    size_t max_size,
+    std::vector<u8>& data
+  ) -> Result;
+};
+
+} // namespace nba
@@ -5,6 +5,8 @@
  * Refer to the included LICENSE file.
  */
 
+#include <array>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <platform/loader/rom.hpp>
@@ -13,10 +15,27 @@
 #include <nba/rom/backup/sram.hpp>
 #include <nba/rom/header.hpp>
 #include <nba/rom/rom.hpp>
+#include <nba/common/compiler.hpp>
+#include <nba/common/crc32.hpp>
+#include <nba/common/parallel_search.hpp>
+#include <nba/common/punning.hpp>
 #include <nba/log.hpp>
 #include <string_view>
 #include <utility>
 
+#include "loader/archive.hpp"
+#include "loader/patch.hpp"
+
+#if defined(_WIN32)
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <unistd.h>
+#endif
+
 namespace fs = std::filesystem;
 
 namespace nba {
@@ -31,9 +50,7 @@ auto ROMLoader::Load(
   Config::BackupType backup_type,
   bool force_rtc
 ) -> Result {
-  auto save_path = path.substr(0, path.find_last_of(".")) + ".sav";
-
-  return Load(core, path, save_path, backup_type, force_rtc);
+  return Load(core, path, GetSavePath(path), backup_type, force_rtc);
 }
 
 auto ROMLoader::Load(
@@ -42,6 +59,22 @@ auto ROMLoader::Load(
   std::string save_path,
   BackupType backup_type,
   bool force_rtc
+) -> Result {
+  auto rom = PreparedROM{};
+  auto result = Prepare(rom_path, save_path, backup_type, force_rtc, rom);
+
+  if (result == Result::Success) {
+    Attach(core, std::move(rom));
+  }
+  return result;
+}
+
+auto ROMLoader::Prepare(
+  std::string rom_path,
+  std::string save_path,
+  BackupType backup_type,
+  bool force_rtc,
+  PreparedROM& rom
 ) -> Result {
   if (!fs::exists(rom_path)) {
     return Result::CannotFindFile;
@@ -51,26 +84,67 @@ auto ROMLoader::Load(
     return Result::CannotOpenFile;
   }
 
-  auto size = fs::file_size(rom_path);
-  if (size < sizeof(Header) || size > kMaxROMSize) {
-    return Result::BadImage;
+  auto patch_path = GetPatchPath(rom_path);
+  auto file_data = ROM::Image{};
+  auto buffer = std::vector<u8>{};
+
+  // Compressed images are decompressed straight into memory, without a temporary file.
+  switch (ArchiveLoader::Load(rom_path, kMaxROMSize, buffer)) {
+    case ArchiveLoader::Result::NotAnArchive: {
+      auto size = fs::file_size(rom_path);
+      if (size < sizeof(Header) || size > kMaxROMSize) {
+        return Result::BadImage;
+      }
+
+      // A patched image needs a copy of the ROM that can be written to.
+      if (patch_path.empty()) {
+        file_data = MapFile(rom_path, size);
+      }
+
+      if (!file_data) {
+        auto file_stream = std::ifstream{rom_path, std::ios::binary};
+        if (!file_stream.good()) {
+          return Result::CannotOpenFile;
+        }
+        buffer.resize(size);
+        file_stream.read((char*)buffer.data(), size);
+      }
+      break;
+    }
+    case ArchiveLoader::Result::CannotOpenFile: {
+      return Result::CannotOpenFile;
+    }
+    case ArchiveLoader::Result::Success: {
+      break;
+    }
+    default: {
+      return Result::BadImage;
+    }
+  }
+
+  if (!patch_path.empty()) {
+    if (PatchLoader::Apply(patch_path, kMaxROMSize, buffer) != PatchLoader::Result::Success) {
+      Log<Error>("ROMLoader: failed to apply patch: {}", patch_path);
+      return Result::BadImage;
+    }
+    Log<Info>("ROMLoader: applied patch: {}", patch_path);
   }
 
-  auto file_stream = std::ifstream{rom_path, std::ios::binary};
-  auto file_data = std::vector<u8>{};
-  if (!file_stream.good()) {
-    return Result::CannotOpenFile;
+  if (!file_data) {
+    if (buffer.size() < sizeof(Header)) {
+      return Result::BadImage;
+    }
+    file_data = std::make_shared<ROMImage const>(std::move(buffer));
   }
-  file_data.resize(size);
-  file_stream.read((char*)file_data.data(), size);
 
-  auto game_info = GetGameInfo(file_data);
+  auto size = file_data->size();
+  auto game_info = GetGameInfo(*file_data);
 
   if (backup_type == BackupType::Detect) {
     if (game_info.backup_type != BackupType::Detect) {
       backup_type = game_info.backup_type;
     } else {
-      backup_type = GetBackupType(file_data);
+      backup_type = GetBackupType(*file_data);
       if (backup_type == BackupType::Detect) {
         Log<Warn>("ROMLoader: failed to detect backup type!");
         backup_type = BackupType::SRAM;
@@ -78,44 +152,130 @@ auto ROMLoader::Load(
     }
   }
 
-  auto backup = CreateBackup(save_path, backup_type);
-
-  auto gpio = std::unique_ptr<GPIO>{};
-  if (game_info.gpio == GPIODeviceType::RTC || force_rtc) {
-    gpio = core->CreateRTC();
-  }
-
   u32 rom_mask = u32(kMaxROMSize - 1);
   if (game_info.mirror) {
     rom_mask = u32(RoundSizeToPowerOfTwo(size) - 1);
   }
 
+  rom.image = std::move(file_data);
+  rom.backup = CreateBackup(save_path, backup_type);
+  rom.rtc = game_info.gpio == GPIODeviceType::RTC || force_rtc;
+  rom.rom_mask = rom_mask;
+  rom.hints = game_info.hints;
+  return Result::Success;
+}
+
+void ROMLoader::Attach(
+  std::unique_ptr<CoreBase>& core,
+  PreparedROM&& rom
+) {
+  auto gpio = std::unique_ptr<GPIO>{};
+  if (rom.rtc) {
+    gpio = core->CreateRTC();
+  }
+
+  // An unpatched ROM file is read directly from the mapping, so only the pages that are touched get loaded.
   core->Attach(ROM{
-    std::move(file_data),
-    std::move(backup),
+    std::move(rom.image),
+    std::move(rom.backup),
     std::move(gpio),
-    rom_mask
+    rom.rom_mask
   });
-  return Result::Success;
+  core->SetGameHints(rom.hints);
+}
+
+auto ROMLoader::GetSavePath(
+  std::string const& rom_path
+) -> std::string {
+  return rom_path.substr(0, rom_path.find_last_of(".")) + ".sav";
+}
+
+auto ROMLoader::GetPatchPath(
+  std::string const& rom_path
+) -> std::string {
+  static constexpr char const* extensions[] { ".ips", ".ups", ".bps" };
+
+  auto base_path = rom_path.substr(0, rom_path.find_last_of("."));
+
+  for (auto extension : extensions) {
+    auto patch_path = base_path + extension;
+
+    if (fs::is_regular_file(patch_path)) {
+      return patch_path;
+    }
+  }
+
+  return {};
+}
+
+auto ROMLoader::MapFile(
+  std::string const& path,
+  size_t size
+) -> ROM::Image {
+#if defined(_WIN32)
+  auto file = CreateFileW(
+    fs::path{path}.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return {};
+  }
+
+  auto mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (mapping == nullptr) {
+    return {};
+  }
+
+  // The view keeps the mapping alive, so the handle can be closed right away.
+  auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+  CloseHandle(mapping);
+  if (view == nullptr) {
+    return {};
+  }
+
+  return std::make_shared<ROMImage const>((u8 const*)view, size, [view]() {
+    UnmapViewOfFile(view);
+  });
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return {};
+  }
+
+  // The mapping keeps the file alive, so the descriptor can be closed right away.
+  auto view = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (view == MAP_FAILED) {
+    return {};
+  }
+
+  return std::make_shared<ROMImage const>((u8 const*)view, size, [view, size]() {
+    munmap(view, size);
+  });
+#endif
 }
 
 auto ROMLoader::GetGameInfo(
-  std::vector<u8>& file_data
+  ROMImage const& file_data
 ) -> GameInfo {
-  auto header = reinterpret_cast<Header*>(file_data.data());
-  auto game_code = std::string{};
-  game_code.assign(header->game.code, 4);
+  auto header = reinterpret_cast<Header const*>(file_data.data());
+  auto game_code = read<u32>(header->game.code, 0);
+  auto game_info = (GameInfo const*)nullptr;
 
-  auto db_entry = g_game_db.find(game_code);
-  if (db_entry != g_game_db.end()) {
-    return db_entry->second;
+  // The CRC32 of the whole ROM is only computed for the few games that need it.
+  if (GameDB::HasRevisions(game_code)) {
+    game_info = GameDB::FindRevision(game_code, crc32(file_data.data(), file_data.size()));
+  } else {
+    game_info = GameDB::Find(game_code);
   }
 
-  return GameInfo{};
+  auto result = game_info ? *game_info : GameInfo{};
+
+  GameDB::FindHints(game_code, result.hints);
+  return result;
 }
 
 auto ROMLoader::GetBackupType(
-  std::vector<u8>& file_data
+  ROMImage const& file_data
 ) -> BackupType {
   static constexpr std::pair<std::string_view, BackupType> signatures[6] {
     { "EEPROM_V",   BackupType::EEPROM_64 },
@@ -126,15 +286,45 @@ auto ROMLoader::GetBackupType(
     { "FLASH1M_V",  BackupType::FLASH_128 }
   };
 
+  /* Signatures can only start at 'E', 'S' or 'F', so the first byte of each
+   * 4-byte aligned word decides which signatures (if any) need to be compared.
+   * This way the ROM is scanned in a single pass with one table lookup per word.
+   */
+  static constexpr auto first_byte_lut = []() {
+    std::array<u8, 256> lut{};
+
+    for (int i = 0; i < 6; i++) {
+      lut[u8(signatures[i].first[0])] |= 1 << i;
+    }
+    return lut;
+  }();
+
   const auto size = file_data.size();
+  const auto data = file_data.data();
 
-  for (int i = 0; i < size; i += sizeof(u32)) {
-    for (auto const& [signature, type] : signatures) {
-      if ((i + signature.size()) <= size &&
-          std::memcmp(&file_data[i], signature.data(), signature.size()) == 0) {
-        return type;
+  // Encodes the match as (offset << 3) | signature, so that the first match in the ROM is also the lowest result.
+  auto match = ParallelSearch(size, [&](size_t begin, size_t end) -> s64 {
+    for (size_t i = begin; i < end; i += sizeof(u32)) {
+      auto candidates = first_byte_lut[data[i]];
+
+      if (likely(candidates == 0)) {
+        continue;
+      }
+
+      for (int j = 0; j < 6; j++) {
+        auto const& signature = signatures[j].first;
+
+        if ((candidates & (1 << j)) != 0 && (i + signature.size()) <= size &&
+            std::memcmp(&data[i], signature.data(), signature.size()) == 0) {
+          return s64(i << 3) | j;
+        }
       }
     }
+    return -1;
+  });
+
+  if (match != -1) {
+    return signatures[match & 7].second;
   }
 
   return BackupType::Detect;
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <nba/log.hpp>
+#include <platform/resume_state.hpp>
+#include <vector>
+#include <zlib.h>
+
+namespace fs = std::filesystem;
+
+namespace nba {
+
+static constexpr u32 kMagicNumber = 0x5245424E; // 'NBER'
+
+struct Header {
+  u32 magic;
+  u32 compressed_size;
+};
+
+ResumeState::~ResumeState() {
+  Wait();
+}
+
+auto ResumeState::GetPath(std::string const& rom_path) -> std::string {
+  return rom_path.substr(0, rom_path.find_last_of(".")) + ".resume";
+}
+
+bool ResumeState::Load(CoreBase& core, std::string const& path) {
+  // A state that is still being written, i.e. when reopening the same game, must be complete first.
+  Wait();
+
+  auto file = std::fopen(path.c_str(), "rb");
+
+  if (file == nullptr) {
+    return false;
+  }
+
+  auto header = Header{};
+  auto compressed = std::vector<u8>{};
+  auto state = std::make_unique<SaveState>();
+  bool good = std::fread(&header, sizeof(Header), 1, file) == 1 && header.magic == kMagicNumber;
+
+  if (good) {
+    compressed.resize(header.compressed_size);
+    good = std::fread(compressed.data(), compressed.size(), 1, file) == 1;
+  }
+  std::fclose(file);
+
+  auto error = std::error_code{};
+  fs::remove(path, error);
+
+  if (good) {
+    uLongf size = sizeof(SaveState);
+    good = uncompress((Bytef*)state.get(), &size, compressed.data(), compressed.size()) == Z_OK &&
+           size == sizeof(SaveState);
+  }
+
+  if (!good) {
+    Log<Error>("ResumeState: {} is damaged.", path);
+    return false;
+  }
+
+  // The file is gone already, so a state that the core rejects is not tried again on the next boot.
+  if (!core.LoadState(*state)) {
+    Log<Error>("ResumeState: {} cannot be restored, starting the game normally.", path);
+    core.Reset();
+    return false;
+  }
+  return true;
+}
+
+void ResumeState::Save(CoreBase& core, std::string const& path) {
+  Wait();
+
+  auto state = std::make_shared<SaveState>();
+
+  core.CopyState(*state);
+
+  writer = std::thread{[state, path]() {
+    auto compressed = std::vector<u8>(compressBound(sizeof(SaveState)));
+    auto size = uLongf(compressed.size());
+
+    // Most of the state is zeroes or repeated data, so fast compression already goes a long way.
+    if (compress2(compressed.data(), &size, (Bytef const*)state.get(), sizeof(SaveState), Z_BEST_SPEED) != Z_OK) {
+      Log<Error>("ResumeState: failed to compress the state.");
+      return;
+    }
+
+    // Write to a temporary file first, so that an interrupted write does not leave a damaged file behind.
+    auto temporary_path = path + ".tmp";
+    auto file = std::fopen(temporary_path.c_str(), "wb");
+
+    if (file == nullptr) {
+      Log<Error>("ResumeState: cannot write {}.", temporary_path);
+      return;
+    }
+
+    auto header = Header{kMagicNumber, u32(size)};
+    bool good = std::fwrite(&header, sizeof(Header), 1, file) == 1 &&
+                std::fwrite(compressed.data(), size, 1, file) == 1;
+
+    good = std::fclose(file) == 0 && good;
+
+    auto error = std::error_code{};
+    if (good) {
+      fs::rename(temporary_path, path, error);
+    } else {
+      fs::remove(temporary_path, error);
+    }
+  }};
+}
+
+void ResumeState::Wait() {
+  if (writer.joinable()) {
+    writer.join();
+  }
+}
+
+} // namespace nba
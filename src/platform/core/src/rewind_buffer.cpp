@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+#include <nba/common/punning.hpp>
+#include <platform/rewind_buffer.hpp>
+#include <utility>
+
+namespace nba {
+
+static_assert(sizeof(SaveState) % sizeof(u64) == 0);
+
+RewindBuffer::RewindBuffer(int interval, size_t memory_budget)
+    : interval(std::max(interval, 1))
+    , memory_budget(memory_budget)
+    , head(new SaveState{})
+    , scratch(new SaveState{}) {
+}
+
+void RewindBuffer::Reset() {
+  deltas.clear();
+  have_head = false;
+  dirty_token = 0;
+  frame_counter = 0;
+  memory_usage = 0;
+}
+
+void RewindBuffer::Capture(CoreBase& core) {
+  if (++frame_counter < interval) {
+    return;
+  }
+  frame_counter = 0;
+
+  CollectUnchanged(core);
+  core.CopyState(*scratch);
+
+  if (have_head) {
+    auto& delta = deltas.emplace_back();
+    Encode(*scratch, *head, unchanged, delta);
+    memory_usage += delta.size();
+  }
+
+  std::swap(head, scratch);
+  have_head = true;
+
+  while (!deltas.empty() && memory_usage + sizeof(SaveState) > memory_budget) {
+    memory_usage -= deltas.front().size();
+    deltas.pop_front();
+  }
+}
+
+bool RewindBuffer::Rewind(CoreBase& core) {
+  if (!have_head) {
+    return false;
+  }
+
+  core.LoadState(*head);
+
+  if (deltas.empty()) {
+    have_head = false;
+  } else {
+    auto& delta = deltas.back();
+    Decode(delta, *head);
+    memory_usage -= delta.size();
+    deltas.pop_back();
+  }
+
+  frame_counter = 0;
+  return true;
+}
+
+auto RewindBuffer::GetSnapshotCount() const -> int {
+  return have_head ? int(deltas.size() + 1) : 0;
+}
+
+auto RewindBuffer::GetMemoryUsage() const -> size_t {
+  return memory_usage + sizeof(SaveState);
+}
+
+/* Collects the words of guest RAM in SaveState that cannot differ from the head,
+ * because their pages were not written since the head was captured. Loading a state
+ * (i.e. rewinding) dirties all pages, so the next snapshot is compared in full.
+ */
+void RewindBuffer::CollectUnchanged(CoreBase& core) {
+  using Region = DirtyPages::Region;
+
+  dirty_token = core.GetDirtyPages(dirty_token, dirty_pages);
+  unchanged.clear();
+
+  // The regions in the order in which they are laid out in SaveState.
+  struct {
+    Region region;
+    u8 const* data;
+  } const regions[] {
+    {Region::EWRAM, head->bus.memory.wram},
+    {Region::IWRAM, head->bus.memory.iram},
+    {Region::PRAM,  head->ppu.pram},
+    {Region::OAM,   head->ppu.oam},
+    {Region::VRAM,  head->ppu.vram}
+  };
+
+  for (auto& region : regions) {
+    auto base = uint(region.data - (u8 const*)head.get());
+    auto pages = DirtyPages::kRegionSize[(int)region.region] / DirtyPages::kPageSize;
+
+    for (uint page = 0; page < pages; page++) {
+      if (dirty_pages.Test(region.region, page * DirtyPages::kPageSize)) {
+        continue;
+      }
+
+      // Only words that lie in the page entirely.
+      auto first = (base + page * DirtyPages::kPageSize + 7) / 8;
+      auto last = (base + (page + 1) * DirtyPages::kPageSize) / 8;
+
+      if (!unchanged.empty() && unchanged.back().last == first) {
+        unchanged.back().last = last;
+      } else {
+        unchanged.push_back({first, last});
+      }
+    }
+  }
+}
+
+/* The delta is a sequence of (u32 skip, u32 count, u64 data[count]) records,
+ * where `skip` is the number of unchanged 64-bit words that precede `data`.
+ */
+void RewindBuffer::Encode(SaveState const& state_a, SaveState const& state_b, std::vector<Range> const& unchanged, std::vector<u8>& delta) {
+  static constexpr uint kWordCount = sizeof(SaveState) / sizeof(u64);
+
+  auto data_a = (u8 const*)&state_a;
+  auto data_b = (u8 const*)&state_b;
+  auto range = unchanged.begin();
+
+  uint i = 0;
+
+  delta.clear();
+
+  while (i < kWordCount) {
+    uint skip = 0;
+
+    while (i < kWordCount) {
+      while (range != unchanged.end() && range->first < i) {
+        range++;
+      }
+
+      if (range != unchanged.end() && range->first == i) {
+        skip += range->last - i;
+        i = range->last;
+        continue;
+      }
+
+      if (read<u64>(data_a, i * 8) != read<u64>(data_b, i * 8)) {
+        break;
+      }
+      skip++;
+      i++;
+    }
+
+    if (i == kWordCount) {
+      break;
+    }
+
+    auto header = delta.size();
+    uint count = 0;
+
+    delta.resize(header + sizeof(u32) * 2);
+
+    while (i < kWordCount) {
+      auto word = read<u64>(data_a, i * 8) ^ read<u64>(data_b, i * 8);
+      if (word == 0) {
+        break;
+      }
+      auto offset = delta.size();
+      delta.resize(offset + sizeof(u64));
+      write<u64>(delta.data(), offset, word);
+      count++;
+      i++;
+    }
+
+    write<u32>(delta.data(), header + 0, skip);
+    write<u32>(delta.data(), header + 4, count);
+  }
+
+  delta.shrink_to_fit();
+}
+
+void RewindBuffer::Decode(std::vector<u8> const& delta, SaveState& state) {
+  auto data = (u8*)&state;
+  uint offset = 0;
+  uint i = 0;
+
+  while (offset < delta.size()) {
+    auto skip = read<u32>(delta.data(), offset + 0);
+    auto count = read<u32>(delta.data(), offset + 4);
+
+    offset += sizeof(u32) * 2;
+    i += skip;
+
+    for (uint j = 0; j < count; j++) {
+      write<u64>(data, i * 8, read<u64>(data, i * 8) ^ read<u64>(delta.data(), offset));
+      offset += sizeof(u64);
+      i++;
+    }
+  }
+}
+
+} // namespace nba
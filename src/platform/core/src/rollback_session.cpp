@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+#include <platform/rollback_session.hpp>
+
+namespace nba {
+
+// Presents the merged keys of both players to the keypad.
+struct RollbackSession::KeyInputDevice : nba::InputDevice {
+  auto Poll(Key key) -> bool final {
+    static constexpr int kKeyBits[kKeyCount] = {
+      6, // Up
+      7, // Down
+      5, // Left
+      4, // Right
+      3, // Start
+      2, // Select
+      0, // A
+      1, // B
+      9, // L
+      8  // R
+    };
+
+    return keys & (1 << kKeyBits[static_cast<int>(key)]);
+  }
+
+  void SetOnChangeCallback(std::function<void(void)> callback) final {
+    keypress_callback = callback;
+  }
+
+  void SetKeys(u16 value) {
+    keys = value;
+    if (keypress_callback) {
+      keypress_callback();
+    }
+  }
+
+  std::function<void(void)> keypress_callback;
+  u16 keys = 0;
+};
+
+RollbackSession::RollbackSession(int max_rollback, int input_delay)
+    : max_rollback(std::clamp(max_rollback, 0, kMaxFrames))
+    , input_delay(std::clamp(input_delay, 0, kMaxFrames - this->max_rollback))
+    , input_device(std::make_shared<KeyInputDevice>()) {
+  merge = [](u16 local_keys, u16 remote_keys) -> u16 {
+    return local_keys | remote_keys;
+  };
+
+  // Allocate all snapshots up front, so that saving a state is a plain copy.
+  for (int i = 0; i <= this->max_rollback; i++) {
+    states.push_back(std::make_unique<SaveState>());
+  }
+
+  Reset();
+}
+
+auto RollbackSession::GetInputDevice() -> std::shared_ptr<InputDevice> {
+  return input_device;
+}
+
+void RollbackSession::SetMergeFunction(MergeFunction merge) {
+  this->merge = merge;
+}
+
+void RollbackSession::Reset() {
+  frame = 0;
+  local_frame = input_delay;
+  confirmed_frame = -1;
+  rollback_frame = -1;
+  rollback_count = 0;
+  resimulated_frame_count = 0;
+
+  for (auto& slot : slots) {
+    slot.frame = -1;
+  }
+
+  // Nobody can have input for the frames within the input delay.
+  for (int i = 0; i < input_delay; i++) {
+    ClaimSlot(i);
+    GetSlot(i).have_local = true;
+    GetSlot(i).have_remote = true;
+  }
+
+  UpdateConfirmedFrame();
+  input_device->SetKeys(0);
+}
+
+auto RollbackSession::AddLocalInput(u16 keys) -> int {
+  ClaimSlot(local_frame);
+
+  auto& slot = GetSlot(local_frame);
+  slot.local_keys = keys;
+  slot.have_local = true;
+
+  UpdateConfirmedFrame();
+  return local_frame++;
+}
+
+void RollbackSession::AddRemoteInput(int frame, u16 keys) {
+  // The oldest frame that may still be re-emulated, its input must not be overwritten.
+  auto oldest_frame = std::min(confirmed_frame + 1, this->frame - max_rollback);
+
+  // Drop inputs that were already confirmed or that are too far ahead to be legit.
+  if (frame <= confirmed_frame || frame >= oldest_frame + kSlotCount) {
+    return;
+  }
+
+  ClaimSlot(frame);
+
+  auto& slot = GetSlot(frame);
+
+  if (slot.have_remote) {
+    return;
+  }
+
+  slot.remote_keys = keys;
+  slot.have_remote = true;
+
+  if (frame < this->frame && slot.predicted_keys != keys) {
+    rollback_frame = rollback_frame == -1 ? frame : std::min(rollback_frame, frame);
+  }
+
+  UpdateConfirmedFrame();
+}
+
+bool RollbackSession::CanAdvanceFrame() const {
+  auto& slot = GetSlot(frame);
+
+  return slot.frame == frame && slot.have_local && frame - confirmed_frame <= max_rollback;
+}
+
+void RollbackSession::AdvanceFrame(CoreBase& core) {
+  if (rollback_frame != -1) {
+    core.LoadState(GetState(rollback_frame));
+    core.SetVideoOutputEnabled(false);
+    core.SetAudioOutputEnabled(false);
+
+    for (int i = rollback_frame; i < frame; i++) {
+      if (i != rollback_frame) {
+        core.CopyState(GetState(i));
+      }
+      RunFrame(core, i);
+    }
+
+    core.SetVideoOutputEnabled(true);
+    core.SetAudioOutputEnabled(true);
+
+    rollback_count++;
+    resimulated_frame_count += frame - rollback_frame;
+    rollback_frame = -1;
+  }
+
+  core.CopyState(GetState(frame));
+  RunFrame(core, frame);
+  frame++;
+}
+
+void RollbackSession::ClaimSlot(int frame) {
+  auto& slot = GetSlot(frame);
+
+  if (slot.frame != frame) {
+    slot = {};
+    slot.frame = frame;
+  }
+}
+
+// Players tend to hold keys for many frames, so repeat the latest known input.
+auto RollbackSession::PredictRemoteKeys(int frame) const -> u16 {
+  for (int i = frame - 1; i > frame - kSlotCount && i >= 0; i--) {
+    auto& slot = GetSlot(i);
+
+    if (slot.frame == i && slot.have_remote) {
+      return slot.remote_keys;
+    }
+  }
+
+  return 0;
+}
+
+void RollbackSession::RunFrame(CoreBase& core, int frame) {
+  auto& slot = GetSlot(frame);
+  auto remote_keys = slot.have_remote ? slot.remote_keys : PredictRemoteKeys(frame);
+
+  slot.predicted_keys = remote_keys;
+  input_device->SetKeys(merge(slot.local_keys, remote_keys));
+  core.RunForOneFrame();
+}
+
+void RollbackSession::UpdateConfirmedFrame() {
+  while (true) {
+    auto& slot = GetSlot(confirmed_frame + 1);
+
+    if (slot.frame != confirmed_frame + 1 || !slot.have_local || !slot.have_remote) {
+      break;
+    }
+
+    confirmed_frame++;
+  }
+}
+
+} // namespace nba
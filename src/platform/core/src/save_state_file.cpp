@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <nba/log.hpp>
+#include <platform/loader/rom.hpp>
+#include <platform/save_state_file.hpp>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace nba {
+
+static constexpr u32 kMagicNumber = 0x4653424E; // 'NBSF'
+static constexpr u64 kAlignment = 4096;
+static constexpr int kSectionCount = (int)SaveStateFile::Section::Count;
+
+struct Header {
+  u32 magic;
+  u32 version;
+  u32 section_count;
+  u32 reserved;
+};
+
+struct SectionEntry {
+  u32 section;
+  u32 reserved;
+  u64 offset;
+  u64 size;
+};
+
+static constexpr int kFirstStateSection = (int)SaveStateFile::Section::CPU;
+
+/* Returns where each section of the state starts in SaveState, the sections follow each other in this order.
+ * Metadata and the thumbnail are not part of SaveState.
+ */
+static auto GetStateStart(SaveState const& state, int section) -> size_t {
+  u8 const* start[kSectionCount] {
+    nullptr,
+    nullptr,
+    (u8 const*)&state.arm,
+    (u8 const*)&state.bus.memory.wram,
+    (u8 const*)&state.bus.memory.iram,
+    (u8 const*)&state.bus.memory.latch,
+    (u8 const*)&state.irq,
+    (u8 const*)&state.ppu,
+    (u8 const*)&state.ppu.pram,
+    (u8 const*)&state.ppu.enable_bg,
+    (u8 const*)&state.apu,
+    (u8 const*)&state.dma,
+    (u8 const*)&state.timer,
+    (u8 const*)&state.keypad,
+    (u8 const*)&state.sio,
+    (u8 const*)&state.backup,
+    (u8 const*)&state.gpio,
+    (u8 const*)&state.scheduler
+  };
+
+  return start[section] - (u8 const*)&state;
+}
+
+static auto GetStateSize(SaveState const& state, int section) -> size_t {
+  if (section == kSectionCount - 1) {
+    return sizeof(SaveState) - GetStateStart(state, section);
+  }
+  return GetStateStart(state, section + 1) - GetStateStart(state, section);
+}
+
+static auto AlignUp(u64 offset) -> u64 {
+  return (offset + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+auto SaveStateFile::GetName(Section section) -> char const* {
+  constexpr char const* names[kSectionCount] {
+    "Info", "Thumbnail", "CPU", "EWRAM", "IWRAM", "Bus", "IRQ", "PPU", "Video memory", "PPU line",
+    "APU", "DMA", "Timer", "KeyPad", "SIO", "Backup", "GPIO", "Scheduler"
+  };
+
+  return names[(int)section];
+}
+
+bool SaveStateFile::Write(std::string const& path, SaveState const& state, u32 const* thumbnail) {
+  struct Payload {
+    Section section;
+    void const* data;
+    size_t size;
+  };
+
+  auto info = Info{state.version, state.timestamp, (s64)std::time(nullptr)};
+  auto payloads = std::vector<Payload>{};
+
+  payloads.push_back({Section::Info, &info, sizeof(info)});
+
+  if (thumbnail != nullptr) {
+    payloads.push_back({Section::Thumbnail, thumbnail, sizeof(u32) * kThumbnailWidth * kThumbnailHeight});
+  }
+
+  for (int i = kFirstStateSection; i < kSectionCount; i++) {
+    payloads.push_back({(Section)i, (u8 const*)&state + GetStateStart(state, i), GetStateSize(state, i)});
+  }
+
+  auto header = Header{kMagicNumber, SaveState::kCurrentVersion, (u32)payloads.size(), 0};
+  auto table = std::vector<SectionEntry>{};
+  auto offset = AlignUp(sizeof(Header) + sizeof(SectionEntry) * payloads.size());
+
+  for (auto& payload : payloads) {
+    table.push_back({(u32)payload.section, 0, offset, payload.size});
+    offset = AlignUp(offset + payload.size);
+  }
+
+  // Write to a temporary file first, so that an interrupted write does not leave a damaged file behind.
+  auto temporary_path = path + ".tmp";
+  auto file = std::fopen(temporary_path.c_str(), "wb");
+
+  if (file == nullptr) {
+    Log<Error>("SaveStateFile: cannot write {}.", temporary_path);
+    return false;
+  }
+
+  bool good = std::fwrite(&header, sizeof(Header), 1, file) == 1 &&
+              std::fwrite(table.data(), sizeof(SectionEntry), table.size(), file) == table.size();
+
+  for (size_t i = 0; good && i < payloads.size(); i++) {
+    good = std::fseek(file, (long)table[i].offset, SEEK_SET) == 0 &&
+           std::fwrite(payloads[i].data, payloads[i].size, 1, file) == 1;
+  }
+
+  // Pad the last section, so that every section can be mapped in whole pages.
+  if (good && std::ftell(file) != (long)offset) {
+    good = std::fseek(file, (long)offset - 1, SEEK_SET) == 0 && std::fputc(0, file) == 0;
+  }
+
+  good = std::fclose(file) == 0 && good;
+
+  auto error = std::error_code{};
+  if (good) {
+    fs::rename(temporary_path, path, error);
+    good = !error;
+  } else {
+    fs::remove(temporary_path, error);
+  }
+
+  if (!good) {
+    Log<Error>("SaveStateFile: failed to write {}.", path);
+  }
+  return good;
+}
+
+bool SaveStateFile::Open(std::string const& path) {
+  auto error = std::error_code{};
+  auto size = fs::file_size(path, error);
+
+  file = {};
+
+  if (error || size < sizeof(Header)) {
+    return false;
+  }
+
+  auto image = ROMLoader::MapFile(path, size);
+
+  if (!image) {
+    return false;
+  }
+
+  auto& header = *(Header const*)image->data();
+
+  if (header.magic != kMagicNumber || header.version != SaveState::kCurrentVersion ||
+      header.section_count > kSectionCount ||
+      sizeof(Header) + sizeof(SectionEntry) * header.section_count > size) {
+    return false;
+  }
+
+  auto table = (SectionEntry const*)(image->data() + sizeof(Header));
+
+  for (u32 i = 0; i < header.section_count; i++) {
+    if (table[i].offset > size || table[i].size > size - table[i].offset) {
+      return false;
+    }
+  }
+
+  file = std::move(image);
+  return true;
+}
+
+auto SaveStateFile::GetSection(Section section, size_t& size) const -> u8 const* {
+  if (!file) {
+    return nullptr;
+  }
+
+  auto& header = *(Header const*)file->data();
+  auto table = (SectionEntry const*)(file->data() + sizeof(Header));
+
+  for (u32 i = 0; i < header.section_count; i++) {
+    if (table[i].section == (u32)section) {
+      size = table[i].size;
+      return file->data() + table[i].offset;
+    }
+  }
+
+  return nullptr;
+}
+
+auto SaveStateFile::GetInfo() const -> Info const* {
+  size_t size;
+  auto data = GetSection(Section::Info, size);
+
+  if (data == nullptr || size != sizeof(Info)) {
+    return nullptr;
+  }
+  return (Info const*)data;
+}
+
+auto SaveStateFile::GetThumbnail() const -> u32 const* {
+  size_t size;
+  auto data = GetSection(Section::Thumbnail, size);
+
+  if (data == nullptr || size != sizeof(u32) * kThumbnailWidth * kThumbnailHeight) {
+    return nullptr;
+  }
+  return (u32 const*)data;
+}
+
+bool SaveStateFile::Read(SaveState& state) const {
+  auto info = GetInfo();
+
+  if (info == nullptr) {
+    return false;
+  }
+
+  for (int i = kFirstStateSection; i < kSectionCount; i++) {
+    size_t size;
+    auto data = GetSection((Section)i, size);
+
+    if (data == nullptr || size != GetStateSize(state, i)) {
+      Log<Error>("SaveStateFile: the {} section is missing or damaged.", GetName((Section)i));
+      return false;
+    }
+
+    std::memcpy((u8*)&state + GetStateStart(state, i), data, size);
+  }
+
+  state.magic = SaveState::kMagicNumber;
+  state.version = info->version;
+  state.timestamp = info->timestamp;
+  return true;
+}
+
+} // namespace nba
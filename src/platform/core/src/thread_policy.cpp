@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <nba/log.hpp>
+#include <platform/thread_policy.hpp>
+
+#if defined(_WIN32)
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX
+  #include <windows.h>
+  #include <avrt.h>
+#else
+  #include <cerrno>
+  #include <cstring>
+  #include <pthread.h>
+  #include <sched.h>
+  #if defined(__APPLE__)
+    #include <pthread/qos.h>
+  #elif defined(__linux__)
+    #include <sys/resource.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+  #endif
+#endif
+
+namespace nba {
+
+namespace {
+
+using Role = ThreadPolicy::Role;
+using Priority = ThreadPolicy::Priority;
+
+auto GetRoleName(Role role) -> char const* {
+  switch (role) {
+    case Role::Emulation: return "emulation";
+    case Role::Audio: return "audio";
+    default: return "worker";
+  }
+}
+
+bool ApplyAffinity(u64 affinity, Role role) {
+#if defined(_WIN32)
+  if (SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)affinity) == 0) {
+    Log<Warn>("ThreadPolicy: failed to set the CPU affinity of the {} thread (error {}).", GetRoleName(role), GetLastError());
+    return false;
+  }
+  return true;
+#elif defined(__linux__)
+  cpu_set_t set;
+
+  CPU_ZERO(&set);
+  for (int cpu = 0; cpu < 64; cpu++) {
+    if (affinity & (1ULL << cpu)) {
+      CPU_SET(cpu, &set);
+    }
+  }
+
+  int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (error != 0) {
+    Log<Warn>("ThreadPolicy: failed to set the CPU affinity of the {} thread: {}", GetRoleName(role), std::strerror(error));
+    return false;
+  }
+  return true;
+#else
+  Log<Warn>("ThreadPolicy: CPU affinity is not supported on this platform.");
+  return false;
+#endif
+}
+
+bool ApplyPriority(Priority priority, Role role) {
+#if defined(_WIN32)
+  if (priority == Priority::High) {
+    if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST)) {
+      Log<Warn>("ThreadPolicy: failed to raise the priority of the {} thread (error {}).", GetRoleName(role), GetLastError());
+      return false;
+    }
+    return true;
+  }
+
+  // The Multimedia Class Scheduler Service boosts the thread for as long as it exists.
+  DWORD task_index = 0;
+  auto task = AvSetMmThreadCharacteristicsW(role == Role::Audio ? L"Pro Audio" : L"Games", &task_index);
+
+  if (task == nullptr) {
+    Log<Warn>("ThreadPolicy: failed to register the {} thread with MMCSS (error {}).", GetRoleName(role), GetLastError());
+    return false;
+  }
+
+  AvSetMmThreadPriority(task, role == Role::Audio ? AVRT_PRIORITY_CRITICAL :
+                              role == Role::Emulation ? AVRT_PRIORITY_HIGH : AVRT_PRIORITY_NORMAL);
+  return true;
+#elif defined(__APPLE__)
+  // macOS has no unprivileged real-time class without a time constraint, so both map to the highest QoS class.
+  int error = pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE, 0);
+  if (error != 0) {
+    Log<Warn>("ThreadPolicy: failed to set the QoS class of the {} thread: {}", GetRoleName(role), std::strerror(error));
+    return false;
+  }
+  return true;
+#else
+  if (priority == Priority::High) {
+  #if defined(__linux__)
+    // On Linux the nice value belongs to the thread, not the process.
+    static constexpr int kHighNiceValue = -10;
+
+    if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), kHighNiceValue) != 0) {
+      Log<Warn>("ThreadPolicy: failed to raise the priority of the {} thread: {}", GetRoleName(role), std::strerror(errno));
+      return false;
+    }
+    return true;
+  #else
+    Log<Warn>("ThreadPolicy: high priority is not supported on this platform.");
+    return false;
+  #endif
+  }
+
+  // Leave the range above to the audio server and the kernel's own real-time threads.
+  static constexpr int kRealTimePriority[] { 20, 30, 10 }; // Emulation, Audio, Worker
+
+  auto param = sched_param{};
+  param.sched_priority = kRealTimePriority[(int)role];
+
+  int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  if (error != 0) {
+    Log<Warn>("ThreadPolicy: failed to make the {} thread real-time: {}", GetRoleName(role), std::strerror(error));
+    return false;
+  }
+  return true;
+#endif
+}
+
+} // namespace
+
+bool ThreadPolicy::ApplyToCurrentThread(Role role) const {
+  bool success = true;
+
+  if (affinity != 0) {
+    success &= ApplyAffinity(affinity, role);
+  }
+
+  if (priority != Priority::Normal) {
+    success &= ApplyPriority(priority, role);
+  }
+
+  return success;
+}
+
+} // namespace nba
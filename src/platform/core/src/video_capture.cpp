@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+#include <nba/common/dsp/spsc_ring_buffer.hpp>
+#include <nba/log.hpp>
+#include <platform/video_capture.hpp>
+#include <thread>
+#include <vector>
+
+namespace nba {
+
+static constexpr int kFrameWidth = VideoDevice::kFrameWidth;
+static constexpr int kFrameHeight = VideoDevice::kFrameHeight;
+
+struct VideoCapture::Session {
+  // Frames are handed over in a fixed set of slots, which circulate between the two threads.
+  static constexpr int kFrameSlots = 8;
+  static constexpr int kAudioCapacity = 65536;
+
+  struct Frame {
+    int scale;
+    int repeats; // frames that were dropped right before this one, written as copies of the previous frame
+    std::bitset<kFrameHeight> lines; // the lines that were copied, the others are unchanged
+    std::vector<u32> pixels;
+  };
+
+  Session(std::FILE* video, std::FILE* audio, int sample_rate, std::atomic<u32>& dropped_frames)
+      : video(video)
+      , audio(audio)
+      , sample_rate(sample_rate)
+      , dropped_frames(dropped_frames) {
+    for (int i = 0; i < kFrameSlots; i++) {
+      free_frames.Write(i);
+    }
+
+    WriteWaveHeader(0);
+    thread = std::thread{&Session::Run, this};
+  }
+
+ ~Session() {
+    quit = true;
+    thread.join();
+
+    WriteWaveHeader(audio_bytes);
+    std::fclose(video);
+    std::fclose(audio);
+  }
+
+  void PushFrame(u32 const* buffer, int scale, std::bitset<kFrameHeight> const& lines) {
+    if (video_scale == 0) {
+      video_scale = scale;
+    }
+
+    changed_lines |= lines;
+
+    // The size of the video cannot change, frames of another size are left out.
+    if (scale != video_scale || free_frames.Available() == 0) {
+      dropped_frames++;
+      repeats++;
+      return;
+    }
+
+    auto& frame = frames[free_frames.Read()];
+    int width = kFrameWidth * scale;
+
+    if (first_frame) {
+      changed_lines.set();
+      repeats = 0;
+      first_frame = false;
+    }
+
+    frame.scale = scale;
+    frame.repeats = repeats;
+    frame.lines = changed_lines;
+    frame.pixels.resize(width * kFrameHeight * scale * scale);
+
+    for (int y = 0; y < kFrameHeight; y++) {
+      if (changed_lines[y]) {
+        int offset = y * scale * width;
+
+        std::copy_n(buffer + offset, width * scale, frame.pixels.data() + offset);
+      }
+    }
+
+    changed_lines.reset();
+    repeats = 0;
+    filled_frames.Write(int(&frame - frames));
+  }
+
+  void PushAudio(s16 const* samples, int count) {
+    for (int i = 0; i < count * 2; i++) {
+      audio_samples.Write(samples[i]);
+    }
+  }
+
+  void Run() {
+    while (true) {
+      bool done = quit;
+      bool idle = true;
+
+      while (filled_frames.Available() > 0) {
+        int index = filled_frames.Read();
+
+        WriteFrame(frames[index]);
+        free_frames.Write(index);
+        idle = false;
+      }
+
+      if (WriteAudio()) {
+        idle = false;
+      }
+
+      // Everything that was queued before the session was stopped has been written.
+      if (done) {
+        break;
+      }
+
+      if (idle) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{2});
+      }
+    }
+  }
+
+  void WriteFrame(Frame const& frame) {
+    int width = kFrameWidth * frame.scale;
+    int height = kFrameHeight * frame.scale;
+    int plane = width * height;
+
+    if (yuv.empty()) {
+      std::fprintf(video, "YUV4MPEG2 W%d H%d F16777216:280896 Ip A1:1 C444 XCOLORRANGE=FULL\n", width, height);
+      yuv.resize(plane * 3);
+    }
+
+    for (int i = 0; i < frame.repeats; i++) {
+      WriteYUVFrame();
+    }
+
+    // Full range BT.601, in 8-bit fixed point.
+    for (int y = 0; y < kFrameHeight; y++) {
+      if (!frame.lines[y]) {
+        continue;
+      }
+
+      int begin = y * frame.scale * width;
+      int end = begin + frame.scale * width;
+
+      for (int i = begin; i < end; i++) {
+        u32 argb = frame.pixels[i];
+        int r = (argb >> 16) & 0xFF;
+        int g = (argb >>  8) & 0xFF;
+        int b = (argb >>  0) & 0xFF;
+
+        yuv[i] = u8((77 * r + 150 * g + 29 * b + 128) >> 8);
+        yuv[plane + i] = u8(((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128);
+        yuv[plane * 2 + i] = u8(((128 * r - 107 * g - 21 * b + 128) >> 8) + 128);
+      }
+    }
+
+    WriteYUVFrame();
+  }
+
+  void WriteYUVFrame() {
+    std::fputs("FRAME\n", video);
+    std::fwrite(yuv.data(), 1, yuv.size(), video);
+  }
+
+  // Returns whether any samples were written.
+  bool WriteAudio() {
+    s16 chunk[4096];
+    int count = std::min(audio_samples.Available(), int(std::size(chunk)));
+
+    if (count == 0) {
+      return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+      chunk[i] = audio_samples.Read();
+    }
+
+    audio_bytes += std::fwrite(chunk, sizeof(s16), count, audio) * sizeof(s16);
+    return true;
+  }
+
+  void WriteWaveHeader(u32 data_bytes) {
+    auto write32 = [&](u32 value) { std::fwrite(&value, 4, 1, audio); };
+    auto write16 = [&](u16 value) { std::fwrite(&value, 2, 1, audio); };
+
+    std::fseek(audio, 0, SEEK_SET);
+    std::fputs("RIFF", audio);
+    write32(36 + data_bytes);
+    std::fputs("WAVEfmt ", audio);
+    write32(16);
+    write16(1); // PCM
+    write16(2);
+    write32(sample_rate);
+    write32(sample_rate * 4);
+    write16(4);
+    write16(16);
+    std::fputs("data", audio);
+    write32(data_bytes);
+    std::fseek(audio, 0, SEEK_END);
+  }
+
+  std::FILE* video;
+  std::FILE* audio;
+  int sample_rate;
+  std::thread thread;
+  std::atomic_bool quit{false};
+
+  Frame frames[kFrameSlots];
+  SPSCRingBuffer<int> free_frames{kFrameSlots};
+  SPSCRingBuffer<int> filled_frames{kFrameSlots};
+  SPSCRingBuffer<s16> audio_samples{kAudioCapacity};
+  std::atomic<u32>& dropped_frames;
+
+  // Emulation thread
+  int video_scale = 0;
+  bool first_frame = true;
+  int repeats = 0;
+  std::bitset<kFrameHeight> changed_lines;
+
+  // Writer thread
+  std::vector<u8> yuv;
+  u32 audio_bytes = 0;
+};
+
+VideoCapture::~VideoCapture() {
+  Stop();
+}
+
+bool VideoCapture::Start(std::string const& path, int sample_rate) {
+  Stop();
+
+  auto video = std::fopen((path + ".y4m").c_str(), "wb");
+  auto audio = std::fopen((path + ".wav").c_str(), "wb");
+
+  if (video == nullptr || audio == nullptr) {
+    Log<Error>("VideoCapture: cannot create {}.y4m or {}.wav", path, path);
+
+    if (video) std::fclose(video);
+    if (audio) std::fclose(audio);
+    return false;
+  }
+
+  dropped_frames = 0;
+  std::atomic_store(&session, std::make_shared<Session>(video, audio, sample_rate, dropped_frames));
+  return true;
+}
+
+void VideoCapture::Stop() {
+  auto session = std::atomic_exchange(&this->session, std::shared_ptr<Session>{});
+
+  if (session) {
+    Log<Info>("VideoCapture: stopped recording, {} frames were dropped.", dropped_frames.load());
+  }
+
+  // The emulation or audio thread may still hold on to the session for a moment, whichever releases it last closes the files.
+}
+
+bool VideoCapture::IsRecording() const {
+  return std::atomic_load(&session) != nullptr;
+}
+
+auto VideoCapture::GetDroppedFrames() const -> u32 {
+  return dropped_frames;
+}
+
+void VideoCapture::SetDirtyLines(std::bitset<kFrameHeight> const& lines) {
+  dirty_lines = lines;
+}
+
+void VideoCapture::PushFrame(u32 const* buffer, int scale) {
+  auto session = std::atomic_load(&this->session);
+
+  if (session) {
+    session->PushFrame(buffer, scale, dirty_lines);
+  }
+
+  // Frames that are drawn without a preceding SetDirtyLines() call are copied in full.
+  dirty_lines.set();
+}
+
+void VideoCapture::PushAudio(s16 const* samples, int count) {
+  auto session = std::atomic_load(&this->session);
+
+  if (session) {
+    session->PushAudio(samples, count);
+  }
+}
+
+} // namespace nba
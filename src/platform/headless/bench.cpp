@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <nba/common/cpu_dispatch.hpp>
+#include <nba/core.hpp>
+#include <platform/loader/bios.hpp>
+#include <platform/loader/rom.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/format.h>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#endif
+
+using namespace nba;
+
+namespace fs = std::filesystem;
+
+/* Every workload is a ROM in the suite directory that stresses one part of the emulator.
+ * The suite is not part of the repository, since the ROMs are built separately.
+ * Workloads whose ROM is missing are skipped.
+ */
+struct Workload {
+  char const* name;
+  char const* file;
+  std::function<void(Config&)> configure;
+};
+
+static const std::vector<Workload> kWorkloads {
+  { "arm",          "arm.gba",          {} },
+  { "thumb",        "thumb.gba",        {} },
+  { "thumb_fast",   "thumb.gba",        [](Config& config) { config.cpu.accuracy_profile = Config::CPU::AccuracyProfile::Fast; } },
+  { "affine",       "affine.gba",       {} },
+  { "sprites",      "sprites.gba",      {} },
+  { "dma",          "dma.gba",          {} },
+  { "direct_sound", "direct_sound.gba", {} },
+  { "direct_sound_threaded", "direct_sound.gba", [](Config& config) { config.audio.threaded_mixing = true; } },
+  { "mp2k_hle",     "mp2k.gba",         [](Config& config) { config.audio.mp2k_hle_enable = true; } },
+  { "mp2k_hle_threaded", "mp2k.gba", [](Config& config) {
+    config.audio.mp2k_hle_enable = true;
+    config.audio.mp2k_hle_threaded = true;
+  } }
+};
+
+static auto g_frames = 3600;
+static auto g_warmup_frames = 60;
+static auto g_bios_path = std::string{"bios.bin"};
+static auto g_suite_path = std::string{"bench"};
+static auto g_output_path = std::string{};
+static auto g_only = std::string{};
+
+// A timestamp in host cycles, if the host has a cycle counter that can be read cheaply.
+static auto ReadHostCycles() -> std::optional<u64> {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::nullopt;
+#endif
+}
+
+struct Result {
+  std::string name;
+  int frames;
+  double elapsed_ms;
+  double slowest_frame_ms;
+  std::optional<u64> host_cycles;
+  ProfileStats profile;
+};
+
+void usage(char* app_name) {
+  fmt::print("Usage: {0} [--bios bios_path] [--suite suite_path] [--frames count] [--warmup count] [--only workload] [--output json_path]\n", app_name);
+  fmt::print("Workloads:");
+  for (auto const& workload : kWorkloads) {
+    fmt::print(" {} ({})", workload.name, workload.file);
+  }
+  fmt::print("\n");
+  std::exit(-1);
+}
+
+void parse_arguments(int argc, char** argv) {
+  auto i = 1;
+
+  while (i < argc) {
+    auto key = std::string{argv[i++]};
+
+    if (i == argc) {
+      usage(argv[0]);
+    }
+
+    auto value = std::string{argv[i++]};
+
+    if (key == "--bios") {
+      g_bios_path = value;
+    } else if (key == "--suite") {
+      g_suite_path = value;
+    } else if (key == "--frames") {
+      g_frames = std::atoi(value.c_str());
+      if (g_frames <= 0) {
+        usage(argv[0]);
+      }
+    } else if (key == "--warmup") {
+      g_warmup_frames = std::atoi(value.c_str());
+      if (g_warmup_frames < 0) {
+        usage(argv[0]);
+      }
+    } else if (key == "--only") {
+      g_only = value;
+    } else if (key == "--output") {
+      g_output_path = value;
+    } else {
+      usage(argv[0]);
+    }
+  }
+}
+
+auto run_workload(Workload const& workload, std::string const& rom_path) -> std::optional<Result> {
+  using Clock = std::chrono::steady_clock;
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+
+  auto config = std::make_shared<Config>();
+
+  config->skip_bios = true;
+  if (workload.configure) {
+    workload.configure(*config);
+  }
+
+  auto core = CreateCore(config);
+
+  if (BIOSLoader::Load(core, g_bios_path) != BIOSLoader::Result::Success) {
+    fmt::print(stderr, "Cannot load BIOS: {}\n", g_bios_path);
+    std::exit(-1);
+  }
+
+  if (ROMLoader::Load(core, rom_path, Config::BackupType::Detect, false) != ROMLoader::Result::Success) {
+    fmt::print(stderr, "{}: cannot load ROM: {}\n", workload.name, rom_path);
+    return std::nullopt;
+  }
+
+  core->Reset();
+
+  // Let the game get past its start-up, so that only the workload itself is measured.
+  for (int frame = 0; frame < g_warmup_frames; frame++) {
+    core->RunForOneFrame();
+  }
+
+  auto result = Result{workload.name, g_frames};
+  auto last_profile_frame = core->GetProfileStats().frame;
+
+  result.slowest_frame_ms = 0;
+  result.profile.enabled = core->GetProfileStats().enabled;
+
+  auto host_cycles_t0 = ReadHostCycles();
+  auto t0 = Clock::now();
+
+  for (int frame = 0; frame < g_frames; frame++) {
+    auto frame_t0 = Clock::now();
+    core->RunForOneFrame();
+    result.slowest_frame_ms = std::max(result.slowest_frame_ms, Milliseconds{Clock::now() - frame_t0}.count());
+
+    // The profiler publishes a complete frame at a time, accumulate every new one.
+    auto profile = core->GetProfileStats();
+
+    if (profile.enabled && profile.frame != last_profile_frame) {
+      last_profile_frame = profile.frame;
+      result.profile.frame++;
+
+      for (int i = 0; i < (int)ProfileStats::Section::Count; i++) {
+        result.profile.sections[i].cycles += profile.sections[i].cycles;
+        result.profile.sections[i].nanoseconds += profile.sections[i].nanoseconds;
+        result.profile.sections[i].calls += profile.sections[i].calls;
+      }
+
+      for (int i = 0; i < ProfileStats::kEventClassCount; i++) {
+        result.profile.events[i].count += profile.events[i].count;
+        result.profile.events[i].cycles_late += profile.events[i].cycles_late;
+      }
+
+      for (int i = 0; i < ProfileStats::kLateBucketCount; i++) {
+        result.profile.events_late[i] += profile.events_late[i];
+      }
+
+      result.profile.event_queue_peak = std::max(result.profile.event_queue_peak, profile.event_queue_peak);
+      result.profile.event_queue_capacity = profile.event_queue_capacity;
+    }
+  }
+
+  result.elapsed_ms = Milliseconds{Clock::now() - t0}.count();
+
+  auto host_cycles_t1 = ReadHostCycles();
+  if (host_cycles_t0 && host_cycles_t1) {
+    result.host_cycles = host_cycles_t1.value() - host_cycles_t0.value();
+  }
+
+  return result;
+}
+
+auto to_json(std::vector<Result> const& results) -> std::string {
+  auto json = std::string{};
+
+  json += "{\n";
+  json += fmt::format("  \"frames\": {},\n", g_frames);
+  json += fmt::format("  \"warmup_frames\": {},\n", g_warmup_frames);
+  json += "  \"simd_kernels\": {";
+
+  // The variant of each SIMD kernel that was selected for this host, see SelectKernel().
+  auto kernels = GetSIMDKernels();
+
+  for (size_t i = 0; i < kernels.size(); i++) {
+    json += fmt::format("{}\"{}\": \"{}\"", i == 0 ? " " : ", ", kernels[i].name, GetSIMDLevelName(kernels[i].level));
+  }
+
+  json += " },\n";
+  json += "  \"workloads\": [";
+
+  for (size_t i = 0; i < results.size(); i++) {
+    auto const& result = results[i];
+    auto emulated_cycles = double(result.frames) * CoreBase::kCyclesPerFrame;
+
+    json += i == 0 ? "\n" : ",\n";
+    json += "    {\n";
+    json += fmt::format("      \"name\": \"{}\",\n", result.name);
+    json += fmt::format("      \"elapsed_ms\": {:.3f},\n", result.elapsed_ms);
+    json += fmt::format("      \"slowest_frame_ms\": {:.3f},\n", result.slowest_frame_ms);
+    json += fmt::format("      \"fps\": {:.2f},\n", result.frames * 1000.0 / result.elapsed_ms);
+    json += fmt::format("      \"host_ns_per_emulated_cycle\": {:.4f},\n", result.elapsed_ms * 1e6 / emulated_cycles);
+
+    if (result.host_cycles) {
+      json += fmt::format("      \"host_cycles_per_emulated_cycle\": {:.4f},\n", result.host_cycles.value() / emulated_cycles);
+    } else {
+      json += "      \"host_cycles_per_emulated_cycle\": null,\n";
+    }
+
+    // Only available when the core is built with NBA_PROFILER.
+    if (result.profile.enabled) {
+      json += fmt::format("      \"profiled_frames\": {},\n", result.profile.frame);
+      json += "      \"sections\": {";
+
+      for (int j = 0; j < (int)ProfileStats::Section::Count; j++) {
+        auto section = (ProfileStats::Section)j;
+        auto const& entry = result.profile[section];
+
+        json += j == 0 ? "\n" : ",\n";
+        json += fmt::format(
+          "        \"{}\": {{ \"cycles\": {}, \"ns\": {}, \"calls\": {} }}",
+          ProfileStats::GetName(section), entry.cycles, entry.nanoseconds, entry.calls);
+      }
+
+      json += "\n      },\n";
+      json += "      \"events\": {";
+
+      // Only the event classes that fired at all, the end of the queue never does.
+      auto first_event = true;
+
+      for (int j = 0; j < ProfileStats::kEventClassCount; j++) {
+        auto const& entry = result.profile.events[j];
+
+        if (entry.count == 0) {
+          continue;
+        }
+
+        json += first_event ? "\n" : ",\n";
+        json += fmt::format(
+          "        \"{}\": {{ \"count\": {}, \"cycles_late\": {} }}",
+          ProfileStats::GetEventName(j), entry.count, entry.cycles_late);
+        first_event = false;
+      }
+
+      json += "\n      },\n";
+      json += "      \"events_late_log2\": [";
+
+      for (int j = 0; j < ProfileStats::kLateBucketCount; j++) {
+        json += fmt::format("{}{}", j == 0 ? "" : ", ", result.profile.events_late[j]);
+      }
+
+      json += "],\n";
+      json += fmt::format("      \"event_queue_peak\": {},\n", result.profile.event_queue_peak);
+      json += fmt::format("      \"event_queue_capacity\": {}\n", result.profile.event_queue_capacity);
+    } else {
+      json += "      \"sections\": null\n";
+    }
+
+    json += "    }";
+  }
+
+  json += "\n  ]\n}\n";
+  return json;
+}
+
+int main(int argc, char** argv) {
+  parse_arguments(argc, argv);
+
+  auto results = std::vector<Result>{};
+
+  for (auto const& workload : kWorkloads) {
+    if (!g_only.empty() && g_only != workload.name) {
+      continue;
+    }
+
+    auto rom_path = (fs::path{g_suite_path} / workload.file).string();
+
+    if (!fs::exists(rom_path)) {
+      fmt::print(stderr, "{}: skipped, {} not found\n", workload.name, rom_path);
+      continue;
+    }
+
+    fmt::print(stderr, "{}: running {} frames...\n", workload.name, g_frames);
+
+    if (auto result = run_workload(workload, rom_path)) {
+      results.push_back(std::move(result.value()));
+    }
+  }
+
+  auto json = to_json(results);
+
+  if (g_output_path.empty()) {
+    fmt::print("{}", json);
+  } else {
+    auto file = std::fopen(g_output_path.c_str(), "wb");
+    if (file == nullptr) {
+      fmt::print(stderr, "Cannot write results to: {}\n", g_output_path);
+      return -1;
+    }
+    std::fputs(json.c_str(), file);
+    std::fclose(file);
+  }
+
+  return results.empty() ? -1 : 0;
+}
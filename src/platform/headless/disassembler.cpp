@@ -0,0 +1,355 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <fmt/format.h>
+
+#include "disassembler.hpp"
+
+namespace nba {
+
+static constexpr char const* kConditions[16] = {
+  "eq", "ne", "cs", "cc", "mi", "pl", "vs", "vc",
+  "hi", "ls", "ge", "lt", "gt", "le", "", "nv"
+};
+
+static constexpr char const* kRegisters[16] = {
+  "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7",
+  "r8", "r9", "r10", "r11", "r12", "sp", "lr", "pc"
+};
+
+static constexpr char const* kDataProcessing[16] = {
+  "and", "eor", "sub", "rsb", "add", "adc", "sbc", "rsc",
+  "tst", "teq", "cmp", "cmn", "orr", "mov", "bic", "mvn"
+};
+
+static constexpr char const* kShifts[4] = { "lsl", "lsr", "asr", "ror" };
+
+static auto RegisterList(u32 list) -> std::string {
+  auto result = std::string{"{"};
+
+  for (int i = 0; i < 16; i++) {
+    if (list & (1 << i)) {
+      if (result.size() > 1) {
+        result += ", ";
+      }
+      result += kRegisters[i];
+    }
+  }
+
+  return result + "}";
+}
+
+// Operand 2 of a data processing instruction or the offset of a single data transfer (I = 0).
+static auto ShiftedRegister(u32 opcode) -> std::string {
+  auto rm = kRegisters[opcode & 15];
+  auto type = (opcode >> 5) & 3;
+
+  if (opcode & (1 << 4)) {
+    return fmt::format("{}, {} {}", rm, kShifts[type], kRegisters[(opcode >> 8) & 15]);
+  }
+
+  auto amount = (opcode >> 7) & 31;
+
+  if (amount == 0) {
+    switch (type) {
+      case 0: return rm;
+      case 3: return fmt::format("{}, rrx", rm);
+      default: amount = 32;
+    }
+  }
+
+  return fmt::format("{}, {} #{}", rm, kShifts[type], amount);
+}
+
+auto DisassembleARM(u32 address, u32 opcode) -> std::string {
+  auto cond = kConditions[opcode >> 28];
+  auto rn = kRegisters[(opcode >> 16) & 15];
+  auto rd = kRegisters[(opcode >> 12) & 15];
+  auto rs = kRegisters[(opcode >> 8) & 15];
+  auto rm = kRegisters[opcode & 15];
+
+  // Branch and Exchange
+  if ((opcode & 0x0FFFFFF0) == 0x012FFF10) {
+    return fmt::format("bx{} {}", cond, rm);
+  }
+
+  // Branch and Branch with Link
+  if ((opcode & 0x0E000000) == 0x0A000000) {
+    auto offset = s32(opcode << 8) >> 6;
+    return fmt::format("b{}{} 0x{:08X}", (opcode & (1 << 24)) ? "l" : "", cond, address + 8 + offset);
+  }
+
+  // Software Interrupt
+  if ((opcode & 0x0F000000) == 0x0F000000) {
+    return fmt::format("swi{} 0x{:06X}", cond, opcode & 0xFFFFFF);
+  }
+
+  // Coprocessor instructions (undefined on the GBA)
+  if ((opcode & 0x0C000000) == 0x0C000000) {
+    return fmt::format("cdp{} <0x{:08X}>", cond, opcode);
+  }
+
+  // Multiply and Multiply-Accumulate
+  if ((opcode & 0x0FC000F0) == 0x00000090) {
+    auto s = (opcode & (1 << 20)) ? "s" : "";
+    if (opcode & (1 << 21)) {
+      return fmt::format("mla{}{} {}, {}, {}, {}", cond, s, rn, rm, rs, rd);
+    }
+    return fmt::format("mul{}{} {}, {}, {}", cond, s, rn, rm, rs);
+  }
+
+  // Multiply Long and Multiply-Accumulate Long
+  if ((opcode & 0x0F8000F0) == 0x00800090) {
+    static constexpr char const* kNames[4] = { "umull", "umlal", "smull", "smlal" };
+    auto s = (opcode & (1 << 20)) ? "s" : "";
+    return fmt::format("{}{}{} {}, {}, {}, {}", kNames[(opcode >> 21) & 3], cond, s, rd, rn, rm, rs);
+  }
+
+  // Single Data Swap
+  if ((opcode & 0x0FB00FF0) == 0x01000090) {
+    return fmt::format("swp{}{} {}, {}, [{}]", cond, (opcode & (1 << 22)) ? "b" : "", rd, rm, rn);
+  }
+
+  // Halfword and Signed Data Transfer
+  if ((opcode & 0x0E000090) == 0x00000090 && (opcode & 0x60) != 0) {
+    static constexpr char const* kTypes[4] = { "", "h", "sb", "sh" };
+    auto load = opcode & (1 << 20);
+    auto pre = opcode & (1 << 24);
+    auto sign = (opcode & (1 << 23)) ? "" : "-";
+    auto offset = std::string{};
+
+    if (opcode & (1 << 22)) {
+      offset = fmt::format("#{}{}", sign, ((opcode >> 4) & 0xF0) | (opcode & 15));
+    } else {
+      offset = fmt::format("{}{}", sign, rm);
+    }
+
+    auto mnemonic = fmt::format("{}{}{}", load ? "ldr" : "str", cond, kTypes[(opcode >> 5) & 3]);
+
+    if (pre) {
+      return fmt::format("{} {}, [{}, {}]{}", mnemonic, rd, rn, offset, (opcode & (1 << 21)) ? "!" : "");
+    }
+    return fmt::format("{} {}, [{}], {}", mnemonic, rd, rn, offset);
+  }
+
+  // PSR Transfer (MRS)
+  if ((opcode & 0x0FBF0FFF) == 0x010F0000) {
+    return fmt::format("mrs{} {}, {}", cond, rd, (opcode & (1 << 22)) ? "spsr" : "cpsr");
+  }
+
+  // PSR Transfer (MSR)
+  if ((opcode & 0x0DB0F000) == 0x0120F000) {
+    auto psr = (opcode & (1 << 22)) ? "spsr" : "cpsr";
+    auto fields = std::string{"_"};
+
+    if (opcode & (1 << 16)) fields += 'c';
+    if (opcode & (1 << 17)) fields += 'x';
+    if (opcode & (1 << 18)) fields += 's';
+    if (opcode & (1 << 19)) fields += 'f';
+
+    if (opcode & (1 << 25)) {
+      auto imm = opcode & 0xFF;
+      auto shift = ((opcode >> 8) & 15) * 2;
+      return fmt::format("msr{} {}{}, #0x{:X}", cond, psr, fields, (imm >> shift) | (imm << ((32 - shift) & 31)));
+    }
+    return fmt::format("msr{} {}{}, {}", cond, psr, fields, rm);
+  }
+
+  // Data Processing
+  if ((opcode & 0x0C000000) == 0x00000000) {
+    auto op = (opcode >> 21) & 15;
+    auto s = (opcode & (1 << 20)) && (op < 8 || op > 11) ? "s" : "";
+    auto operand = std::string{};
+
+    if (opcode & (1 << 25)) {
+      auto imm = opcode & 0xFF;
+      auto shift = ((opcode >> 8) & 15) * 2;
+      operand = fmt::format("#0x{:X}", (imm >> shift) | (imm << ((32 - shift) & 31)));
+    } else {
+      operand = ShiftedRegister(opcode);
+    }
+
+    switch (op) {
+      case 8 ... 11: return fmt::format("{}{} {}, {}", kDataProcessing[op], cond, rn, operand);
+      case 13:
+      case 15: return fmt::format("{}{}{} {}, {}", kDataProcessing[op], cond, s, rd, operand);
+      default: return fmt::format("{}{}{} {}, {}, {}", kDataProcessing[op], cond, s, rd, rn, operand);
+    }
+  }
+
+  // Undefined
+  if ((opcode & 0x0E000010) == 0x06000010) {
+    return fmt::format("undefined <0x{:08X}>", opcode);
+  }
+
+  // Single Data Transfer
+  if ((opcode & 0x0C000000) == 0x04000000) {
+    auto load = opcode & (1 << 20);
+    auto pre = opcode & (1 << 24);
+    auto sign = (opcode & (1 << 23)) ? "" : "-";
+    auto offset = std::string{};
+
+    if (opcode & (1 << 25)) {
+      offset = fmt::format("{}{}", sign, ShiftedRegister(opcode & ~(1 << 4)));
+    } else {
+      offset = fmt::format("#{}{}", sign, opcode & 0xFFF);
+    }
+
+    auto mnemonic = fmt::format("{}{}{}{}", load ? "ldr" : "str", cond,
+      (opcode & (1 << 22)) ? "b" : "", !pre && (opcode & (1 << 21)) ? "t" : "");
+
+    if (pre) {
+      return fmt::format("{} {}, [{}, {}]{}", mnemonic, rd, rn, offset, (opcode & (1 << 21)) ? "!" : "");
+    }
+    return fmt::format("{} {}, [{}], {}", mnemonic, rd, rn, offset);
+  }
+
+  // Block Data Transfer
+  static constexpr char const* kModes[4] = { "da", "ia", "db", "ib" };
+
+  return fmt::format("{}{}{} {}{}, {}{}",
+    (opcode & (1 << 20)) ? "ldm" : "stm", cond, kModes[(opcode >> 23) & 3], rn,
+    (opcode & (1 << 21)) ? "!" : "", RegisterList(opcode & 0xFFFF), (opcode & (1 << 22)) ? "^" : "");
+}
+
+auto DisassembleThumb(u32 address, u16 opcode) -> std::string {
+  auto rd = kRegisters[opcode & 7];
+  auto rs = kRegisters[(opcode >> 3) & 7];
+  auto rn = kRegisters[(opcode >> 6) & 7];
+
+  // THUMB.2 Add/subtract
+  if ((opcode & 0xF800) == 0x1800) {
+    auto op = (opcode & (1 << 9)) ? "sub" : "add";
+    if (opcode & (1 << 10)) {
+      return fmt::format("{}s {}, {}, #{}", op, rd, rs, (opcode >> 6) & 7);
+    }
+    return fmt::format("{}s {}, {}, {}", op, rd, rs, rn);
+  }
+
+  // THUMB.1 Move shifted register
+  if ((opcode & 0xE000) == 0x0000) {
+    auto amount = (opcode >> 6) & 31;
+    auto type = (opcode >> 11) & 3;
+    if (amount == 0 && type != 0) {
+      amount = 32;
+    }
+    return fmt::format("{}s {}, {}, #{}", kShifts[type], rd, rs, amount);
+  }
+
+  // THUMB.3 Move/compare/add/subtract immediate
+  if ((opcode & 0xE000) == 0x2000) {
+    static constexpr char const* kNames[4] = { "movs", "cmp", "adds", "subs" };
+    return fmt::format("{} {}, #{}", kNames[(opcode >> 11) & 3], kRegisters[(opcode >> 8) & 7], opcode & 0xFF);
+  }
+
+  // THUMB.4 ALU operations
+  if ((opcode & 0xFC00) == 0x4000) {
+    static constexpr char const* kNames[16] = {
+      "ands", "eors", "lsls", "lsrs", "asrs", "adcs", "sbcs", "rors",
+      "tst", "negs", "cmp", "cmn", "orrs", "muls", "bics", "mvns"
+    };
+    return fmt::format("{} {}, {}", kNames[(opcode >> 6) & 15], rd, rs);
+  }
+
+  // THUMB.5 Hi register operations/branch exchange
+  if ((opcode & 0xFC00) == 0x4400) {
+    static constexpr char const* kNames[3] = { "add", "cmp", "mov" };
+    auto op = (opcode >> 8) & 3;
+    auto dst = kRegisters[(opcode & 7) | ((opcode >> 4) & 8)];
+    auto src = kRegisters[(opcode >> 3) & 15];
+    if (op == 3) {
+      return fmt::format("bx {}", src);
+    }
+    return fmt::format("{} {}, {}", kNames[op], dst, src);
+  }
+
+  // THUMB.6 PC-relative load
+  if ((opcode & 0xF800) == 0x4800) {
+    auto target = ((address + 4) & ~3) + (opcode & 0xFF) * 4;
+    return fmt::format("ldr {}, [pc, #{}] ; =0x{:08X}", kRegisters[(opcode >> 8) & 7], (opcode & 0xFF) * 4, target);
+  }
+
+  // THUMB.7/8 Load/store with register offset
+  if ((opcode & 0xF000) == 0x5000) {
+    static constexpr char const* kNames[8] = { "str", "strh", "strb", "ldrsb", "ldr", "ldrh", "ldrb", "ldrsh" };
+    return fmt::format("{} {}, [{}, {}]", kNames[(opcode >> 9) & 7], rd, rs, rn);
+  }
+
+  // THUMB.9 Load/store with immediate offset
+  if ((opcode & 0xE000) == 0x6000) {
+    auto load = opcode & (1 << 11);
+    auto byte = opcode & (1 << 12);
+    auto offset = ((opcode >> 6) & 31) * (byte ? 1 : 4);
+    return fmt::format("{}{} {}, [{}, #{}]", load ? "ldr" : "str", byte ? "b" : "", rd, rs, offset);
+  }
+
+  // THUMB.10 Load/store halfword
+  if ((opcode & 0xF000) == 0x8000) {
+    return fmt::format("{} {}, [{}, #{}]", (opcode & (1 << 11)) ? "ldrh" : "strh", rd, rs, ((opcode >> 6) & 31) * 2);
+  }
+
+  // THUMB.11 SP-relative load/store
+  if ((opcode & 0xF000) == 0x9000) {
+    return fmt::format("{} {}, [sp, #{}]", (opcode & (1 << 11)) ? "ldr" : "str", kRegisters[(opcode >> 8) & 7], (opcode & 0xFF) * 4);
+  }
+
+  // THUMB.12 Load address
+  if ((opcode & 0xF000) == 0xA000) {
+    return fmt::format("add {}, {}, #{}", kRegisters[(opcode >> 8) & 7], (opcode & (1 << 11)) ? "sp" : "pc", (opcode & 0xFF) * 4);
+  }
+
+  // THUMB.13 Add offset to stack pointer
+  if ((opcode & 0xFF00) == 0xB000) {
+    return fmt::format("{} sp, #{}", (opcode & (1 << 7)) ? "sub" : "add", (opcode & 0x7F) * 4);
+  }
+
+  // THUMB.14 Push/pop registers
+  if ((opcode & 0xF600) == 0xB400) {
+    auto pop = opcode & (1 << 11);
+    auto list = u32(opcode & 0xFF);
+    if (opcode & (1 << 8)) {
+      list |= pop ? 0x8000 : 0x4000;
+    }
+    return fmt::format("{} {}", pop ? "pop" : "push", RegisterList(list));
+  }
+
+  // THUMB.15 Multiple load/store
+  if ((opcode & 0xF000) == 0xC000) {
+    return fmt::format("{} {}!, {}", (opcode & (1 << 11)) ? "ldmia" : "stmia", kRegisters[(opcode >> 8) & 7], RegisterList(opcode & 0xFF));
+  }
+
+  // THUMB.17 Software Interrupt
+  if ((opcode & 0xFF00) == 0xDF00) {
+    return fmt::format("swi 0x{:02X}", opcode & 0xFF);
+  }
+
+  // THUMB.16 Conditional branch
+  if ((opcode & 0xF000) == 0xD000) {
+    auto offset = s32(s8(opcode & 0xFF)) * 2;
+    return fmt::format("b{} 0x{:08X}", kConditions[(opcode >> 8) & 15], address + 4 + offset);
+  }
+
+  // THUMB.18 Unconditional branch
+  if ((opcode & 0xF800) == 0xE000) {
+    auto offset = (s32(opcode << 21) >> 20);
+    return fmt::format("b 0x{:08X}", address + 4 + offset);
+  }
+
+  // THUMB.19 Long branch with link
+  if ((opcode & 0xF800) == 0xF000) {
+    auto offset = (s32(opcode << 21) >> 9);
+    return fmt::format("bl (prefix) lr = 0x{:08X}", address + 4 + offset);
+  }
+
+  if ((opcode & 0xF800) == 0xF800) {
+    return fmt::format("bl (suffix) lr + #0x{:X}", (opcode & 0x7FF) * 2);
+  }
+
+  return fmt::format("undefined <0x{:04X}>", opcode);
+}
+
+} // namespace nba
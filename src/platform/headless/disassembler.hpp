@@ -0,0 +1,22 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/integer.hpp>
+#include <string>
+
+namespace nba {
+
+/* Minimal ARMv4T disassembler for the debugging tools (GNU syntax, without symbols).
+ * 'address' is the address of the instruction and is used to resolve branch targets.
+ * The second halfword of a Thumb BL pair is shown on its own, as the decoder sees one halfword at a time.
+ */
+auto DisassembleARM(u32 address, u32 opcode) -> std::string;
+auto DisassembleThumb(u32 address, u16 opcode) -> std::string;
+
+} // namespace nba
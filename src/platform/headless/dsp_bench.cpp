@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <nba/common/dsp/resampler/blep.hpp>
+#include <nba/common/dsp/resampler/cosine.hpp>
+#include <nba/common/dsp/resampler/cubic.hpp>
+#include <nba/common/dsp/resampler/nearest.hpp>
+#include <nba/common/dsp/resampler/sinc.hpp>
+#include <nba/common/dsp/ring_buffer.hpp>
+#include <nba/common/dsp/spsc_ring_buffer.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace nba;
+
+using Clock = std::chrono::steady_clock;
+
+/* Measures the speed, memory footprint and quality of the resamplers that
+ * Config::Audio::Interpolation selects between (and of the FIFO resampler),
+ * for the conversions that the APU actually does.
+ */
+
+static auto g_min_time = std::chrono::milliseconds{250};
+
+static auto Mono(float sample) -> float { return sample; }
+static auto Mono(StereoSample<float> const& sample) -> float { return sample.left; }
+
+template<typename T>
+static auto MakeSample(float value) -> T {
+  if constexpr (std::is_same_v<T, float>) {
+    return value;
+  } else {
+    return { value, value };
+  }
+}
+
+// Collects the resampler output without any further processing.
+template<typename T>
+struct CaptureStream : WriteStream<T> {
+  void Write(T const& value) final {
+    samples.push_back(value);
+  }
+
+  std::vector<T> samples;
+};
+
+template<typename T>
+struct ResamplerInfo {
+  std::string name;
+  std::function<std::unique_ptr<Resampler<T>>(std::shared_ptr<WriteStream<T>>)> create;
+
+  // Size of the lookup tables that are shared between instances.
+  size_t table_bytes;
+  size_t state_bytes;
+};
+
+template<typename T>
+static auto GetResamplers() -> std::vector<ResamplerInfo<T>> {
+  auto info = [](std::string name, auto tag, size_t table_bytes) {
+    using R = typename decltype(tag)::type;
+
+    return ResamplerInfo<T>{name, [](auto output) -> std::unique_ptr<Resampler<T>> {
+      return std::make_unique<R>(output);
+    }, table_bytes, sizeof(R)};
+  };
+
+  auto sinc_table_bytes = [](int points) {
+    return size_t(513 * points * sizeof(float));
+  };
+
+  return {
+    info("Nearest",  std::common_type<NearestResampler<T>>{}, 0),
+    info("Cosine",   std::common_type<CosineResampler<T>>{}, 0),
+    info("Cubic",    std::common_type<CubicResampler<T>>{}, 0),
+    info("Blep",     std::common_type<BlepResampler<T>>{}, 512 * sizeof(float)),
+    info("Sinc32",   std::common_type<SincResampler<T, 32>>{}, sinc_table_bytes(32)),
+    info("Sinc64",   std::common_type<SincResampler<T, 64>>{}, sinc_table_bytes(64)),
+    info("Sinc128",  std::common_type<SincResampler<T, 128>>{}, sinc_table_bytes(128)),
+    info("Sinc256",  std::common_type<SincResampler<T, 256>>{}, sinc_table_bytes(256))
+  };
+}
+
+/* Resamples one second of a sine wave and returns the output,
+ * without the first samples during which the filter is still filling up.
+ */
+template<typename T>
+static auto ResampleSine(ResamplerInfo<T> const& info, int rate_in, int rate_out, double frequency) -> std::vector<float> {
+  static constexpr int kSettleSamples = 1024;
+
+  auto capture = std::make_shared<CaptureStream<T>>();
+  auto resampler = info.create(capture);
+
+  resampler->SetSampleRates(float(rate_in), float(rate_out));
+
+  for (int i = 0; capture->samples.size() < size_t(kSettleSamples + rate_out); i++) {
+    resampler->Write(MakeSample<T>(0.5f * float(std::sin(2.0 * M_PI * frequency * i / rate_in))));
+  }
+
+  auto output = std::vector<float>{};
+
+  for (int i = kSettleSamples; i < kSettleSamples + rate_out; i++) {
+    output.push_back(Mono(capture->samples[i]));
+  }
+
+  return output;
+}
+
+/* Signal-to-noise (and distortion) ratio of a resampled sine wave in dB.
+ * The analysis window is exactly one second long, so with integer frequencies the sine
+ * completes a whole number of cycles and a plain projection finds its amplitude and phase.
+ */
+static auto GetSNR(std::vector<float> const& output, int rate_out, double frequency) -> double {
+  auto n = double(output.size());
+  double a = 0, b = 0, c = 0, power = 0;
+
+  for (size_t i = 0; i < output.size(); i++) {
+    auto x = double(output[i]);
+    auto w = 2.0 * M_PI * frequency * i / rate_out;
+
+    a += x * std::sin(w);
+    b += x * std::cos(w);
+    c += x;
+    power += x * x;
+  }
+
+  a *= 2.0 / n;
+  b *= 2.0 / n;
+  c /= n;
+  power /= n;
+
+  auto signal = (a * a + b * b) / 2.0;
+  auto noise = std::max(power - signal - c * c, 1e-20);
+
+  return 10.0 * std::log10(signal / noise);
+}
+
+// How much a tone above the output Nyquist frequency is attenuated, in dB.
+static auto GetAliasRejection(std::vector<float> const& output) -> double {
+  double power = 0;
+
+  for (auto x : output) {
+    power += double(x) * x;
+  }
+
+  power = std::max(power / output.size(), 1e-20);
+
+  return 10.0 * std::log10(0.125 / power);
+}
+
+template<typename T>
+static auto GetNanosecondsPerSample(ResamplerInfo<T> const& info, int rate_in, int rate_out) -> double {
+  auto capture = std::make_shared<CaptureStream<T>>();
+  auto resampler = info.create(capture);
+  auto input = std::vector<T>{};
+
+  resampler->SetSampleRates(float(rate_in), float(rate_out));
+
+  for (int i = 0; i < rate_in; i++) {
+    input.push_back(MakeSample<T>(float(std::rand()) / RAND_MAX - 0.5f));
+  }
+
+  capture->samples.reserve(size_t(rate_out) + 16);
+
+  size_t samples = 0;
+  auto t0 = Clock::now();
+  auto elapsed = Clock::duration{};
+
+  do {
+    capture->samples.clear();
+
+    for (auto const& sample : input) {
+      resampler->Write(sample);
+    }
+
+    samples += capture->samples.size();
+    elapsed = Clock::now() - t0;
+  } while (elapsed < g_min_time);
+
+  return std::chrono::duration<double, std::nano>{elapsed}.count() / samples;
+}
+
+template<typename T>
+static void RunResamplerBenchmarks(int rate_in, int rate_out) {
+  fmt::print("\n{} Hz -> {} Hz ({})\n", rate_in, rate_out, std::is_same_v<T, float> ? "mono" : "stereo");
+  fmt::print("{:<10} {:>10} {:>12} {:>12} {:>12} {:>12} {:>14}\n",
+    "Resampler", "ns/sample", "state (B)", "table (KiB)", "SNR 1k (dB)", "SNR hi (dB)", "alias rej (dB)");
+
+  // A tone just below both Nyquist frequencies shows imaging and passband errors best.
+  auto high_frequency = std::floor(std::min(rate_in, rate_out) * 0.4);
+
+  for (auto const& info : GetResamplers<T>()) {
+    auto ns_per_sample = GetNanosecondsPerSample(info, rate_in, rate_out);
+    auto snr_1k = GetSNR(ResampleSine(info, rate_in, rate_out, 1000.0), rate_out, 1000.0);
+    auto snr_high = GetSNR(ResampleSine(info, rate_in, rate_out, high_frequency), rate_out, high_frequency);
+    auto alias = std::string{"-"};
+
+    // Only a downsampler can alias, using a tone that must not make it to the output at all.
+    if (rate_in > rate_out) {
+      auto frequency = std::floor((rate_in * 0.5 + rate_out * 0.5) * 0.5);
+      alias = fmt::format("{:.1f}", GetAliasRejection(ResampleSine(info, rate_in, rate_out, frequency)));
+    }
+
+    fmt::print("{:<10} {:>10.2f} {:>12} {:>12.1f} {:>12.1f} {:>12.1f} {:>14}\n",
+      info.name, ns_per_sample, info.state_bytes, info.table_bytes / 1024.0, snr_1k, snr_high, alias);
+  }
+}
+
+template<typename Buffer>
+static void RunRingBufferBenchmark(std::string const& name, Buffer& buffer) {
+  static constexpr int kBatchSize = 1024;
+
+  size_t operations = 0;
+  float sum = 0;
+  auto t0 = Clock::now();
+  auto elapsed = Clock::duration{};
+
+  do {
+    for (int i = 0; i < kBatchSize; i++) {
+      buffer.Write({float(i), float(i)});
+    }
+    for (int i = 0; i < kBatchSize; i++) {
+      sum += buffer.Read().left;
+    }
+
+    operations += kBatchSize;
+    elapsed = Clock::now() - t0;
+  } while (elapsed < g_min_time);
+
+  fmt::print("{:<22} {:>10.2f} ns per write+read (checksum {})\n",
+    name, std::chrono::duration<double, std::nano>{elapsed}.count() / operations, sum);
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    auto min_time_ms = std::atoi(argv[1]);
+
+    if (min_time_ms <= 0) {
+      fmt::print("Usage: {} [min_time_ms]\n", argv[0]);
+      return -1;
+    }
+    g_min_time = std::chrono::milliseconds{min_time_ms};
+  }
+
+  // The mixer output at the default (32 KiHz) and the MP2K HLE (64 KiHz) resolution.
+  RunResamplerBenchmarks<StereoSample<float>>(32768, 48000);
+  RunResamplerBenchmarks<StereoSample<float>>(65536, 48000);
+
+  // Direct Sound FIFOs at typical timer-driven rates, into the mixer (see APU::fifo_samplerate).
+  for (auto rate : { 13379, 18157, 21024, 31536 }) {
+    RunResamplerBenchmarks<float>(rate, 32768);
+  }
+
+  fmt::print("\n");
+
+  auto ring_buffer = StereoRingBuffer<float>{2048};
+  auto spsc_ring_buffer = StereoSPSCRingBuffer<float>{2048};
+
+  RunRingBufferBenchmark("StereoRingBuffer", ring_buffer);
+  RunRingBufferBenchmark("StereoSPSCRingBuffer", spsc_ring_buffer);
+  return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <nba/core.hpp>
+#include <platform/gdb_stub.hpp>
+#include <platform/loader/bios.hpp>
+#include <platform/loader/rom.hpp>
+
+#include <cstdlib>
+#include <fmt/format.h>
+#include <string>
+
+using namespace nba;
+
+/* Runs a ROM under the control of GDB (or any other client of the GDB remote serial protocol),
+ * starting at the entry point of the ROM. The core only runs while the debugger lets it
+ * and waits for the next debugger once one detaches.
+ */
+
+static auto g_port = 2345;
+static auto g_bios_path = std::string{"bios.bin"};
+static auto g_rom_path = std::string{};
+
+void usage(char* app_name) {
+  fmt::print("Usage: {} [--bios bios_path] [--port port] rom_path\n", app_name);
+  std::exit(-1);
+}
+
+void parse_arguments(int argc, char** argv) {
+  auto i = 1;
+
+  while (i < argc) {
+    auto key = std::string{argv[i++]};
+
+    if (i == argc) {
+      g_rom_path = key;
+      return;
+    }
+
+    auto value = std::string{argv[i++]};
+
+    if (key == "--bios") {
+      g_bios_path = value;
+    } else if (key == "--port") {
+      g_port = std::atoi(value.c_str());
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  usage(argv[0]);
+}
+
+int main(int argc, char** argv) {
+  parse_arguments(argc, argv);
+
+  if (g_port <= 0 || g_port > 65535) {
+    usage(argv[0]);
+  }
+
+  auto config = std::make_shared<Config>();
+  config->skip_bios = true;
+
+  auto core = CreateCore(config);
+
+  if (BIOSLoader::Load(core, g_bios_path) != BIOSLoader::Result::Success) {
+    fmt::print(stderr, "Cannot load BIOS: {}\n", g_bios_path);
+    return -1;
+  }
+
+  if (ROMLoader::Load(core, g_rom_path, Config::BackupType::Detect, false) != ROMLoader::Result::Success) {
+    fmt::print(stderr, "Cannot load ROM: {}\n", g_rom_path);
+    return -1;
+  }
+
+  core->Reset();
+
+  auto stub = GDBStub{*core};
+
+  if (!stub.Listen(u16(g_port))) {
+    fmt::print(stderr, "Cannot listen on port {}\n", g_port);
+    return -1;
+  }
+
+  do {
+    fmt::print("Waiting for GDB on localhost:{} (target remote localhost:{})\n", g_port, g_port);
+  } while (stub.Serve());
+
+  return 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/device/video_device.hpp>
+#include <nba/integer.hpp>
+
+namespace nba {
+
+/* Hashes every frame that the core presents (64-bit FNV-1a),
+ * so that runs can be compared against a known-good reference.
+ * Frames are rendered directly into one of two device-owned buffers.
+ */
+struct HashVideoDevice : VideoDevice {
+  static constexpr int kWidth = 240;
+  static constexpr int kHeight = 160;
+
+  auto GetPixelFormat() -> PixelFormat final {
+    return format;
+  }
+
+  auto AcquireFrame() -> void* final {
+    current = (current + 1) % 2;
+    return buffers[current];
+  }
+
+  void Draw(u32* buffer) final {
+    Hash(buffer);
+  }
+
+  void Draw(u16* buffer) final {
+    Hash(buffer);
+  }
+
+  template<typename T>
+  void Hash(T const* buffer) {
+    u64 value = 0xCBF29CE484222325;
+
+    for (int i = 0; i < kWidth * kHeight; i++) {
+      value = (value ^ buffer[i]) * 0x100000001B3;
+    }
+
+    hash = value;
+  }
+
+  PixelFormat format = PixelFormat::ARGB8888;
+  u32 buffers[2][kWidth * kHeight];
+  int current = 0;
+  u64 hash = 0;
+};
+
+} // namespace nba
@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <nba/common/punning.hpp>
+#include <nba/core.hpp>
+#include <platform/loader/bios.hpp>
+#include <platform/loader/rom.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/format.h>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace nba;
+
+/* Runs a ROM with the hot spot sampler enabled and prints where the guest spends its time,
+ * by function if a symbol file is given (ELF or a linker map), otherwise by code block.
+ * Requires a core built with NBA_HOTSPOT_SAMPLER.
+ */
+
+static auto g_frames = 600;
+static auto g_interval = 16;
+static auto g_top = 30;
+static auto g_bios_path = std::string{"bios.bin"};
+static auto g_rom_path = std::string{};
+static auto g_symbols_path = std::string{};
+
+// Same size as the blocks of the cached interpreter, which makes the output useful for sizing the block cache.
+static constexpr u32 kBlockSize = 64;
+
+struct Symbol {
+  u32 address;
+  u32 size;
+  std::string name;
+};
+
+void usage(char* app_name) {
+  fmt::print("Usage: {} [--bios bios_path] [--frames count] [--interval events] [--top count] [--symbols elf_or_map_path] rom_path\n", app_name);
+  std::exit(-1);
+}
+
+void parse_arguments(int argc, char** argv) {
+  auto i = 1;
+
+  while (i < argc) {
+    auto key = std::string{argv[i++]};
+
+    if (i == argc) {
+      g_rom_path = key;
+      return;
+    }
+
+    auto value = std::string{argv[i++]};
+
+    if (key == "--bios") {
+      g_bios_path = value;
+    } else if (key == "--frames") {
+      g_frames = std::atoi(value.c_str());
+    } else if (key == "--interval") {
+      g_interval = std::atoi(value.c_str());
+    } else if (key == "--top") {
+      g_top = std::atoi(value.c_str());
+    } else if (key == "--symbols") {
+      g_symbols_path = value;
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  usage(argv[0]);
+}
+
+// Function and label symbols from the symbol table of a 32-bit little-endian ELF file.
+auto load_elf_symbols(std::vector<u8> const& elf) -> std::vector<Symbol> {
+  static constexpr u32 kSectionSymbolTable = 2;
+  static constexpr int kSymbolNoType = 0;
+  static constexpr int kSymbolFunction = 2;
+
+  auto symbols = std::vector<Symbol>{};
+
+  auto in_bounds = [&](size_t offset, size_t size) {
+    return offset + size <= elf.size();
+  };
+
+  // EI_CLASS must be ELFCLASS32 and EI_DATA must be ELFDATA2LSB.
+  if (!in_bounds(0, 0x34) || elf[4] != 1 || elf[5] != 1) {
+    fmt::print(stderr, "Not a 32-bit little-endian ELF file: {}\n", g_symbols_path);
+    return symbols;
+  }
+
+  auto section_offset = read<u32>(elf.data(), 0x20);
+  auto section_size = read<u16>(elf.data(), 0x2E);
+  auto section_count = read<u16>(elf.data(), 0x30);
+
+  for (int i = 0; i < section_count; i++) {
+    auto header = section_offset + i * section_size;
+
+    if (!in_bounds(header, 40) || read<u32>(elf.data(), header + 4) != kSectionSymbolTable) {
+      continue;
+    }
+
+    auto table_offset = read<u32>(elf.data(), header + 16);
+    auto table_size = read<u32>(elf.data(), header + 20);
+    auto strings_header = section_offset + read<u32>(elf.data(), header + 24) * section_size;
+
+    if (!in_bounds(strings_header, 40)) {
+      continue;
+    }
+
+    auto strings_offset = read<u32>(elf.data(), strings_header + 16);
+
+    for (u32 entry = table_offset; entry + 16 <= table_offset + table_size && in_bounds(entry, 16); entry += 16) {
+      auto name_offset = strings_offset + read<u32>(elf.data(), entry);
+      auto type = elf[entry + 12] & 15;
+      auto section = read<u16>(elf.data(), entry + 14);
+
+      if ((type != kSymbolFunction && type != kSymbolNoType) || section == 0 || !in_bounds(name_offset, 1)) {
+        continue;
+      }
+
+      auto name = std::string{(char const*)elf.data() + name_offset, strnlen((char const*)elf.data() + name_offset, elf.size() - name_offset)};
+
+      // Skip the ARM mapping symbols ($a, $t, $d) and local labels.
+      if (name.empty() || name[0] == '$' || name[0] == '.') {
+        continue;
+      }
+
+      // Thumb functions have bit 0 of their address set.
+      symbols.push_back({read<u32>(elf.data(), entry + 4) & ~1, read<u32>(elf.data(), entry + 8), name});
+    }
+  }
+
+  return symbols;
+}
+
+/* Any line of the form "address name", which covers the symbol lines of GNU ld map files
+ * ("0x08000234    main") as well as no$gba style symbol files ("08000234 main").
+ */
+auto load_map_symbols(std::vector<u8> const& map) -> std::vector<Symbol> {
+  auto symbols = std::vector<Symbol>{};
+  auto stream = std::istringstream{std::string{map.begin(), map.end()}};
+  auto line = std::string{};
+
+  while (std::getline(stream, line)) {
+    auto tokens = std::istringstream{line};
+    auto address = std::string{};
+    auto name = std::string{};
+    auto rest = std::string{};
+
+    if (!(tokens >> address >> name) || (tokens >> rest)) {
+      continue;
+    }
+
+    if (address.rfind("0x", 0) == 0) {
+      address = address.substr(2);
+    }
+
+    if (address.empty() || address.size() > 16 || address.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+      continue;
+    }
+
+    if (name.find_first_of("=()*") != std::string::npos) {
+      continue;
+    }
+
+    symbols.push_back({u32(std::strtoull(address.c_str(), nullptr, 16)), 0, name});
+  }
+
+  return symbols;
+}
+
+auto load_symbols() -> std::vector<Symbol> {
+  auto file = std::ifstream{g_symbols_path, std::ios::binary};
+
+  if (!file.good()) {
+    fmt::print(stderr, "Cannot open symbol file: {}\n", g_symbols_path);
+    std::exit(-1);
+  }
+
+  auto data = std::vector<u8>{std::istreambuf_iterator<char>{file}, {}};
+  auto symbols = std::vector<Symbol>{};
+
+  if (data.size() >= 4 && data[0] == 0x7F && data[1] == 'E' && data[2] == 'L' && data[3] == 'F') {
+    symbols = load_elf_symbols(data);
+  } else {
+    symbols = load_map_symbols(data);
+  }
+
+  std::sort(symbols.begin(), symbols.end(), [](Symbol const& a, Symbol const& b) {
+    return a.address < b.address;
+  });
+
+  fmt::print(stderr, "Loaded {} symbols from {}\n", symbols.size(), g_symbols_path);
+  return symbols;
+}
+
+// The symbol that covers the address, symbols without a size extend to the next symbol.
+auto find_symbol(std::vector<Symbol> const& symbols, u32 address) -> Symbol const* {
+  auto match = std::upper_bound(symbols.begin(), symbols.end(), address, [](u32 address, Symbol const& symbol) {
+    return address < symbol.address;
+  });
+
+  if (match == symbols.begin()) {
+    return nullptr;
+  }
+
+  auto& symbol = *std::prev(match);
+
+  if (symbol.size != 0 && address >= symbol.address + symbol.size) {
+    return nullptr;
+  }
+
+  return &symbol;
+}
+
+auto get_region_name(u32 address) -> char const* {
+  switch (address >> 24) {
+    case 0x00: return "BIOS";
+    case 0x02: return "EWRAM";
+    case 0x03: return "IWRAM";
+    case 0x08 ... 0x0D: return "ROM";
+    default: return "other";
+  }
+}
+
+template<typename Key>
+void print_histogram(char const* title, std::unordered_map<Key, u64> const& histogram, u64 total, int top, std::function<std::string(Key const&)> format) {
+  auto entries = std::vector<std::pair<Key, u64>>{histogram.begin(), histogram.end()};
+
+  std::sort(entries.begin(), entries.end(), [](auto const& a, auto const& b) {
+    return a.second > b.second;
+  });
+
+  fmt::print("\n{}\n", title);
+
+  for (int i = 0; i < std::min(top, (int)entries.size()); i++) {
+    fmt::print("{:>7.2f}% {:>10}  {}\n", entries[i].second * 100.0 / total, entries[i].second, format(entries[i].first));
+  }
+}
+
+int main(int argc, char** argv) {
+  parse_arguments(argc, argv);
+
+  if (g_frames <= 0 || g_interval <= 0 || g_top <= 0) {
+    usage(argv[0]);
+  }
+
+  auto config = std::make_shared<Config>();
+  config->skip_bios = true;
+
+  auto core = CreateCore(config);
+
+  if (BIOSLoader::Load(core, g_bios_path) != BIOSLoader::Result::Success) {
+    fmt::print(stderr, "Cannot load BIOS: {}\n", g_bios_path);
+    return -1;
+  }
+
+  if (ROMLoader::Load(core, g_rom_path, Config::BackupType::Detect, false) != ROMLoader::Result::Success) {
+    fmt::print(stderr, "Cannot load ROM: {}\n", g_rom_path);
+    return -1;
+  }
+
+  auto symbols = g_symbols_path.empty() ? std::vector<Symbol>{} : load_symbols();
+  auto samples = std::vector<HotspotSample>{};
+
+  std::unordered_map<u32, u64> by_address;
+  std::unordered_map<std::string, u64> by_function;
+  std::unordered_map<std::string, u64> by_region;
+  u64 total = 0;
+  u64 halted = 0;
+  u64 thumb = 0;
+
+  core->Reset();
+  core->SetHotspotSampling(g_interval);
+
+  for (int frame = 0; frame < g_frames; frame++) {
+    core->RunForOneFrame();
+
+    // The ring holds far more samples than one frame produces, so none are dropped.
+    samples.clear();
+    core->ReadHotspotSamples(samples);
+
+    for (auto const& sample : samples) {
+      total++;
+
+      if (sample.halted) {
+        halted++;
+        continue;
+      }
+
+      if (sample.thumb) {
+        thumb++;
+      }
+
+      by_address[sample.address]++;
+      by_region[get_region_name(sample.address)]++;
+
+      if (!symbols.empty()) {
+        auto symbol = find_symbol(symbols, sample.address);
+        by_function[symbol ? symbol->name : fmt::format("<unknown in {}>", get_region_name(sample.address))]++;
+      }
+    }
+  }
+
+  if (total == 0) {
+    fmt::print(stderr, "No samples were taken, the core must be built with NBA_HOTSPOT_SAMPLER.\n");
+    return -1;
+  }
+
+  auto running = total - halted;
+
+  fmt::print("{} samples over {} frames, {:.2f}% halted, {:.2f}% of the rest in Thumb state\n",
+    total, g_frames, halted * 100.0 / total, running ? thumb * 100.0 / running : 0.0);
+
+  if (running == 0) {
+    return 0;
+  }
+
+  print_histogram<std::string>("Regions:", by_region, running, g_top, [](std::string const& name) { return name; });
+
+  if (!symbols.empty()) {
+    print_histogram<std::string>("Functions:", by_function, running, g_top, [](std::string const& name) { return name; });
+  }
+
+  std::unordered_map<u32, u64> by_block;
+
+  for (auto const& [address, count] : by_address) {
+    by_block[address & ~(kBlockSize - 1)] += count;
+  }
+
+  print_histogram<u32>("Blocks:", by_block, running, g_top, [&](u32 const& address) {
+    auto symbol = find_symbol(symbols, address);
+    return fmt::format("0x{:08X} {}", address, symbol ? symbol->name : "");
+  });
+
+  print_histogram<u32>("Instructions:", by_address, running, g_top, [&](u32 const& address) {
+    auto symbol = find_symbol(symbols, address);
+    if (symbol) {
+      return fmt::format("0x{:08X} {}+0x{:X}", address, symbol->name, address - symbol->address);
+    }
+    return fmt::format("0x{:08X}", address);
+  });
+
+  return 0;
+}
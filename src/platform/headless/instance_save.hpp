@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+namespace nba {
+
+/* Save files are memory-mapped, so cores that run the same ROM at the same time would share
+ * the save data if they used the same file. Gives every instance a copy of the save next to
+ * the ROM instead (e.g. game.a.sav), which starts out as a copy of the regular save if there is one.
+ */
+inline auto CreateInstanceSave(std::string const& rom_path, std::string const& instance) -> std::string {
+  namespace fs = std::filesystem;
+
+  auto base_path = rom_path.substr(0, rom_path.find_last_of("."));
+  auto save_path = base_path + ".sav";
+  auto instance_path = base_path + "." + instance + ".sav";
+  auto error = std::error_code{};
+
+  if (fs::is_regular_file(save_path)) {
+    fs::copy_file(save_path, instance_path, fs::copy_options::overwrite_existing, error);
+  } else {
+    fs::remove(instance_path, error);
+  }
+  return instance_path;
+}
+
+} // namespace nba
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <nba/core.hpp>
+#include <nba/latency_probe.hpp>
+#include <platform/frame_limiter.hpp>
+#include <platform/loader/bios.hpp>
+#include <platform/loader/rom.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/format.h>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace nba;
+
+/* Presses A at random points in time while a ROM runs at full speed, and reports how long it took
+ * until the key was latched and until the first frame that shows the response was rendered and drawn
+ * (see LatencyProbe). Without a ROM, a built-in one is used that shows a white screen while A is held.
+ */
+
+static auto g_presses = 200;
+static auto g_frame_delay_ms = 0.0;
+static auto g_late_latching = false;
+static auto g_rendering = std::string{"serial"};
+static auto g_bios_path = std::string{};
+static auto g_rom_path = std::string{};
+
+// Sets the backdrop color to white while A is held and to black otherwise, in a tight loop.
+static constexpr u32 kTestROM[] {
+  0xE3A00301, // mov r0, #0x04000000
+  0xE3A01000, // mov r1, #0
+  0xE1C010B0, // strh r1, [r0]          (DISPCNT: mode 0, all layers off)
+  0xE3A02405, // mov r2, #0x05000000
+  0xE2803E13, // add r3, r0, #0x130
+  0xE1D340B0, // loop: ldrh r4, [r3]    (KEYINPUT)
+  0xE3140001, // tst r4, #1
+  0x03A05C7F, // moveq r5, #0x7F00
+  0x038550FF, // orreq r5, r5, #0xFF
+  0x13A05000, // movne r5, #0
+  0xE1C250B0, // strh r5, [r2]          (backdrop color)
+  0xEAFFFFF8  // b loop
+};
+
+void usage(char* app_name) {
+  fmt::print(
+    "Usage: {} [--rom rom_path] [--bios bios_path] [--presses count] [--frame-delay ms] [--late-latching 0|1] "
+    "[--rendering serial|threaded|parallel]\n", app_name);
+  std::exit(-1);
+}
+
+void parse_arguments(int argc, char** argv) {
+  auto i = 1;
+
+  while (i < argc) {
+    auto key = std::string{argv[i++]};
+
+    if (i == argc) {
+      usage(argv[0]);
+    }
+
+    auto value = std::string{argv[i++]};
+
+    if (key == "--rom") {
+      g_rom_path = value;
+    } else if (key == "--bios") {
+      g_bios_path = value;
+    } else if (key == "--presses") {
+      g_presses = std::atoi(value.c_str());
+    } else if (key == "--frame-delay") {
+      g_frame_delay_ms = std::atof(value.c_str());
+    } else if (key == "--late-latching") {
+      g_late_latching = value == "1";
+    } else if (key == "--rendering") {
+      g_rendering = value;
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  if (g_presses <= 0 || (g_rendering != "serial" && g_rendering != "threaded" && g_rendering != "parallel")) {
+    usage(argv[0]);
+  }
+}
+
+auto load(std::unique_ptr<CoreBase>& core) -> bool {
+  // The built-in ROM does not need the BIOS, since it does not use interrupts or system calls.
+  if (g_rom_path.empty() && g_bios_path.empty()) {
+    auto rom = std::vector<u8>(0x1000);
+
+    std::memcpy(rom.data(), kTestROM, sizeof(kTestROM));
+    core->Attach(std::vector<u8>(0x4000));
+    core->Attach(ROM{std::move(rom), nullptr, nullptr});
+    return true;
+  }
+
+  if (BIOSLoader::Load(core, g_bios_path.empty() ? "bios.bin" : g_bios_path) != BIOSLoader::Result::Success) {
+    fmt::print(stderr, "Cannot load BIOS: {}\n", g_bios_path);
+    return false;
+  }
+
+  if (ROMLoader::Load(core, g_rom_path, Config::BackupType::Detect, false) != ROMLoader::Result::Success) {
+    fmt::print(stderr, "Cannot load ROM: {}\n", g_rom_path);
+    return false;
+  }
+
+  return true;
+}
+
+int main(int argc, char** argv) {
+  parse_arguments(argc, argv);
+
+  auto input_device = std::make_shared<BasicInputDevice>();
+  auto latency_probe = std::make_shared<LatencyProbe>(false);
+  auto config = std::make_shared<Config>();
+
+  config->skip_bios = true;
+  config->input_dev = input_device;
+  config->latency_probe = latency_probe;
+  config->late_input_latching = g_late_latching;
+  config->threaded_rendering = g_rendering == "threaded";
+  config->parallel_rendering = g_rendering == "parallel";
+
+  auto core = CreateCore(config);
+
+  if (!load(core)) {
+    return -1;
+  }
+
+  core->Reset();
+
+  auto done = std::atomic_bool{false};
+
+  // Random intervals, so that the presses land at every point of the frame.
+  auto input_thread = std::thread{[&]() {
+    auto rng = std::mt19937{1};
+    auto delay = [&](int min_ms, int max_ms) {
+      return std::chrono::microseconds{std::uniform_int_distribution<int>{min_ms * 1000, max_ms * 1000}(rng)};
+    };
+
+    for (int i = 0; i < g_presses; i++) {
+      std::this_thread::sleep_for(delay(150, 350));
+      latency_probe->OnInput();
+      input_device->SetKeyStatus(InputDevice::Key::A, true);
+      std::this_thread::sleep_for(delay(80, 120));
+      input_device->SetKeyStatus(InputDevice::Key::A, false);
+    }
+
+    // Give the last press time to show up.
+    std::this_thread::sleep_for(std::chrono::milliseconds{200});
+    done = true;
+  }};
+
+  auto frame_limiter = FrameLimiter{59.7275};
+
+  frame_limiter.SetFrameDelay(g_frame_delay_ms * 1000.0);
+
+  while (!done) {
+    frame_limiter.Run([&]() {
+      core->RunForOneFrame();
+    }, [](float fps) {});
+  }
+
+  input_thread.join();
+
+  fmt::print("rendering: {}, late input latching: {}, frame delay: {} ms\n",
+    g_rendering, g_late_latching ? "on" : "off", g_frame_delay_ms);
+  fmt::print("{}", latency_probe->FormatStats());
+  return 0;
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <nba/core.hpp>
+#include <platform/loader/bios.hpp>
+#include <platform/loader/rom.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hash_video_device.hpp"
+#include "instance_save.hpp"
+
+using namespace nba;
+
+/* Runs two to four instances of a ROM connected by a link cable, each on its own thread,
+ * and reports the speed and the final frame of every player. Each player can play back
+ * its own input movie, which is how multiplayer sessions are reproduced.
+ */
+
+static auto g_players = 2;
+static auto g_frames = 3600;
+static auto g_quantum = 4096;
+static auto g_bios_path = std::string{"bios.bin"};
+static auto g_rom_path = std::string{};
+static auto g_movie_paths = std::vector<std::string>{};
+
+void usage(char* app_name) {
+  fmt::print("Usage: {} [--bios bios_path] [--players count] [--frames count] [--quantum cycles] [--movie movie_path]... rom_path\n", app_name);
+  fmt::print("The n-th --movie is played back by player n.\n");
+  std::exit(-1);
+}
+
+void parse_arguments(int argc, char** argv) {
+  auto i = 1;
+  auto limit = argc - 1;
+
+  while (i < limit) {
+    auto key = std::string{argv[i++]};
+
+    if (i == limit) {
+      usage(argv[0]);
+    }
+
+    auto value = std::string{argv[i++]};
+
+    if (key == "--bios") {
+      g_bios_path = value;
+    } else if (key == "--players") {
+      g_players = std::atoi(value.c_str());
+    } else if (key == "--frames") {
+      g_frames = std::atoi(value.c_str());
+    } else if (key == "--quantum") {
+      g_quantum = std::atoi(value.c_str());
+    } else if (key == "--movie") {
+      g_movie_paths.push_back(value);
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  if (i != limit || g_players < 2 || g_players > LinkCable::kMaxPlayers || g_frames <= 0 || g_quantum <= 0 ||
+      (int)g_movie_paths.size() > g_players) {
+    usage(argv[0]);
+  }
+  g_rom_path = argv[i];
+}
+
+struct Player {
+  std::shared_ptr<Config> config = std::make_shared<Config>();
+  std::shared_ptr<HashVideoDevice> video_device = std::make_shared<HashVideoDevice>();
+  std::unique_ptr<CoreBase> core;
+};
+
+int main(int argc, char** argv) {
+  using Clock = std::chrono::steady_clock;
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+
+  parse_arguments(argc, argv);
+
+  auto cable = std::make_shared<LinkCable>(g_quantum);
+  auto players = std::vector<Player>(g_players);
+
+  for (int i = 0; i < g_players; i++) {
+    auto& player = players[i];
+
+    player.config->skip_bios = true;
+    player.config->video_dev = player.video_device;
+    player.core = CreateCore(player.config);
+
+    if (BIOSLoader::Load(player.core, g_bios_path) != BIOSLoader::Result::Success) {
+      fmt::print(stderr, "Cannot load BIOS: {}\n", g_bios_path);
+      return -1;
+    }
+
+    auto save_path = CreateInstanceSave(g_rom_path, fmt::format("player{}", i));
+
+    if (ROMLoader::Load(player.core, g_rom_path, save_path, Config::BackupType::Detect, false) != ROMLoader::Result::Success) {
+      fmt::print(stderr, "Cannot load ROM: {}\n", g_rom_path);
+      return -1;
+    }
+
+    player.core->Reset();
+    player.core->ConnectLinkCable(cable, i);
+
+    if (i < (int)g_movie_paths.size()) {
+      auto movie = std::make_shared<InputMovie>();
+      if (!movie->Load(g_movie_paths[i])) {
+        fmt::print(stderr, "Cannot load input movie: {}\n", g_movie_paths[i]);
+        return -1;
+      }
+      player.core->StartMoviePlayback(movie);
+    }
+  }
+
+  auto threads = std::vector<std::thread>{};
+  auto t0 = Clock::now();
+
+  for (auto& player : players) {
+    threads.emplace_back([&player]() {
+      for (int frame = 0; frame < g_frames; frame++) {
+        player.core->RunForOneFrame();
+      }
+    });
+  }
+
+  /* A player that is done must not hold back the others, which may still
+   * be a few cycles short of the last frame. Disconnecting it from another
+   * thread is not allowed, so the cable is closed once the first one is done.
+   */
+  threads[0].join();
+  cable->Close();
+
+  for (size_t i = 1; i < threads.size(); i++) {
+    threads[i].join();
+  }
+
+  auto elapsed = Milliseconds{Clock::now() - t0}.count();
+
+  for (int i = 0; i < g_players; i++) {
+    fmt::print("player {} final hash: {:016X}\n", i, players[i].video_device->hash);
+  }
+  fmt::print("elapsed: {:.1f} ms\n", elapsed);
+  fmt::print("speed: {:.1f} fps per player ({:.1f}%)\n", g_frames * 1000.0 / elapsed, g_frames * 1000.0 / elapsed / 59.7275 * 100.0);
+  return 0;
+}
@@ -0,0 +1,396 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <nba/core.hpp>
+#include <platform/loader/bios.hpp>
+#include <platform/loader/rom.hpp>
+#include <platform/save_state_file.hpp>
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/format.h>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "hash_video_device.hpp"
+#include "instance_save.hpp"
+
+using namespace nba;
+
+/* Runs the same ROM (and input movie) on two differently configured cores side by side
+ * and stops at the first point where they disagree. Used to validate that the performance
+ * options (cached interpreter, BIOS HLE, batched audio mixing, ...) match the reference.
+ *
+ * Each core runs on its own thread, both are compared at every frame boundary:
+ * registers, work RAM, video memory, the save memory and the presented frame.
+ * When a frame differs, both cores go back to the start of the frame and replay it
+ * in short slices to find (and dump) the first slice after which the state differs.
+ */
+
+static auto g_frames = 3600;
+static auto g_slice = 64;
+static auto g_bios_path = std::string{"bios.bin"};
+static auto g_movie_path = std::string{};
+static auto g_dump_path = std::string{};
+static auto g_rom_path = std::string{};
+static auto g_skip_bios = false;
+
+struct Side {
+  char const* name;
+  std::shared_ptr<Config> config = std::make_shared<Config>();
+  std::shared_ptr<HashVideoDevice> video_device = std::make_shared<HashVideoDevice>();
+  std::unique_ptr<CoreBase> core;
+
+  // The state at the end of the current and at the end of the previous frame.
+  std::unique_ptr<SaveState> state = std::make_unique<SaveState>();
+  std::unique_ptr<SaveState> previous = std::make_unique<SaveState>();
+};
+
+/* Runs a piece of work on its own thread whenever Start() is called,
+ * Wait() blocks until that work is done.
+ */
+struct Worker {
+  explicit Worker(std::function<void()> work) : work(std::move(work)) {
+    thread = std::thread{[this]() { Loop(); }};
+  }
+
+ ~Worker() {
+    {
+      std::lock_guard lock{mutex};
+      quit = true;
+      pending = true;
+    }
+    condition.notify_all();
+    thread.join();
+  }
+
+  void Start() {
+    std::lock_guard lock{mutex};
+    pending = true;
+    condition.notify_all();
+  }
+
+  void Wait() {
+    std::unique_lock lock{mutex};
+    condition.wait(lock, [this]() { return !pending; });
+  }
+
+private:
+  void Loop() {
+    std::unique_lock lock{mutex};
+
+    while (true) {
+      condition.wait(lock, [this]() { return pending; });
+
+      if (quit) {
+        return;
+      }
+
+      lock.unlock();
+      work();
+      lock.lock();
+
+      pending = false;
+      condition.notify_all();
+    }
+  }
+
+  std::function<void()> work;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool pending = false;
+  bool quit = false;
+  std::thread thread;
+};
+
+void usage(char* app_name) {
+  fmt::print(
+    "Usage: {} [--bios bios_path] [--skip-bios] [--frames count] [--slice cycles] [--movie movie_path] [--dump path_prefix]\n"
+    "          [--a option] [--b option] rom_path\n"
+    "Options: backend=interpreter/cached, idle-loop-skip=yes/no, hle-bios=yes/no, batch-mixing=yes/no\n"
+    "By default core A is the plain interpreter and core B the cached interpreter.\n", app_name);
+  std::exit(-1);
+}
+
+bool apply_option(Config& config, std::string const& option) {
+  auto separator = option.find('=');
+
+  if (separator == std::string::npos) {
+    return false;
+  }
+
+  auto key = option.substr(0, separator);
+  auto value = option.substr(separator + 1);
+
+  if (key == "backend") {
+    if (value == "interpreter") {
+      config.cpu.backend = Config::CPU::Backend::Interpreter;
+    } else if (value == "cached") {
+      config.cpu.backend = Config::CPU::Backend::CachedInterpreter;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  if (value != "yes" && value != "no") {
+    return false;
+  }
+
+  auto enable = value == "yes";
+
+  if (key == "idle-loop-skip") {
+    config.cpu.idle_loop_skip = enable;
+  } else if (key == "hle-bios") {
+    config.cpu.hle_bios = enable;
+  } else if (key == "batch-mixing") {
+    config.audio.batch_mixing = enable;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+void parse_arguments(int argc, char** argv, Side& a, Side& b) {
+  auto i = 1;
+  auto limit = argc - 1;
+
+  while (i < limit) {
+    auto key = std::string{argv[i++]};
+
+    if (key == "--skip-bios") {
+      g_skip_bios = true;
+      continue;
+    }
+
+    if (i == limit) {
+      usage(argv[0]);
+    }
+
+    auto value = std::string{argv[i++]};
+
+    if (key == "--bios") {
+      g_bios_path = value;
+    } else if (key == "--frames") {
+      g_frames = std::atoi(value.c_str());
+    } else if (key == "--slice") {
+      g_slice = std::atoi(value.c_str());
+    } else if (key == "--movie") {
+      g_movie_path = value;
+    } else if (key == "--dump") {
+      g_dump_path = value;
+    } else if (key == "--a" || key == "--b") {
+      if (!apply_option(*(key == "--a" ? a : b).config, value)) {
+        usage(argv[0]);
+      }
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  if (i != limit || g_frames <= 0 || g_slice <= 0) {
+    usage(argv[0]);
+  }
+  g_rom_path = argv[i];
+}
+
+void setup(Side& side, std::shared_ptr<InputMovie const> movie) {
+  side.config->skip_bios = g_skip_bios;
+  side.config->video_dev = side.video_device;
+  side.config->rtc.source = Config::RTC::Source::Fixed;
+  side.core = CreateCore(side.config);
+
+  if (BIOSLoader::Load(side.core, g_bios_path) != BIOSLoader::Result::Success) {
+    fmt::print(stderr, "Cannot load BIOS: {}\n", g_bios_path);
+    std::exit(-1);
+  }
+
+  auto save_path = CreateInstanceSave(g_rom_path, fmt::format("lockstep-{}", side.name));
+
+  if (ROMLoader::Load(side.core, g_rom_path, save_path, Config::BackupType::Detect, false) != ROMLoader::Result::Success) {
+    fmt::print(stderr, "Cannot load ROM: {}\n", g_rom_path);
+    std::exit(-1);
+  }
+
+  side.core->Reset();
+
+  if (movie) {
+    side.core->StartMoviePlayback(movie);
+  }
+
+  side.core->CopyState(*side.state);
+}
+
+template<size_t n>
+auto compare_memory(char const* name, u8 const (&a)[n], u8 const (&b)[n], u32 base) -> std::string {
+  for (size_t i = 0; i < n; i++) {
+    if (a[i] != b[i]) {
+      return fmt::format("{} differs at 0x{:08X} ({:02X} vs {:02X})", name, base + i, a[i], b[i]);
+    }
+  }
+  return {};
+}
+
+/* Describes the first difference between two states, or returns an empty string.
+ * Only the architectural state is compared: the scheduler queue, the audio mixer and
+ * other internal bookkeeping legitimately differ between configurations.
+ */
+auto compare(SaveState const& a, SaveState const& b) -> std::string {
+  static constexpr char const* kBankNames[6] = { "sys", "fiq", "svc", "abt", "irq", "und" };
+
+  if (a.timestamp != b.timestamp) {
+    return fmt::format("timestamp differs ({} vs {})", a.timestamp, b.timestamp);
+  }
+
+  for (int i = 0; i < 16; i++) {
+    if (a.arm.regs.reg[i] != b.arm.regs.reg[i]) {
+      return fmt::format("r{} differs ({:08X} vs {:08X})", i, a.arm.regs.reg[i], b.arm.regs.reg[i]);
+    }
+  }
+
+  if (a.arm.regs.cpsr != b.arm.regs.cpsr) {
+    return fmt::format("cpsr differs ({:08X} vs {:08X})", a.arm.regs.cpsr, b.arm.regs.cpsr);
+  }
+
+  for (int bank = 0; bank < 6; bank++) {
+    for (int i = 0; i < 7; i++) {
+      if (a.arm.regs.bank[bank][i] != b.arm.regs.bank[bank][i]) {
+        return fmt::format("banked register {} of {} differs", i, kBankNames[bank]);
+      }
+    }
+
+    if (a.arm.regs.spsr[bank] != b.arm.regs.spsr[bank]) {
+      return fmt::format("spsr_{} differs ({:08X} vs {:08X})", kBankNames[bank], a.arm.regs.spsr[bank], b.arm.regs.spsr[bank]);
+    }
+  }
+
+  for (auto& difference : {
+    compare_memory("EWRAM", a.bus.memory.wram, b.bus.memory.wram, 0x02000000),
+    compare_memory("IWRAM", a.bus.memory.iram, b.bus.memory.iram, 0x03000000),
+    compare_memory("PRAM",  a.ppu.pram, b.ppu.pram, 0x05000000),
+    compare_memory("VRAM",  a.ppu.vram, b.ppu.vram, 0x06000000),
+    compare_memory("OAM",   a.ppu.oam,  b.ppu.oam,  0x07000000),
+    compare_memory("save memory", a.backup.data, b.backup.data, 0)
+  }) {
+    if (!difference.empty()) {
+      return difference;
+    }
+  }
+
+  return {};
+}
+
+void print_registers(Side const& side) {
+  auto& regs = side.state->arm.regs;
+
+  fmt::print("{}:", side.name);
+  for (int i = 0; i < 16; i++) {
+    fmt::print("{} r{}={:08X}", i % 4 == 0 ? "\n " : "", i, regs.reg[i]);
+  }
+  fmt::print("\n cpsr={:08X} timestamp={}\n", regs.cpsr, side.state->timestamp);
+}
+
+void dump(Side const& side) {
+  if (g_dump_path.empty()) {
+    return;
+  }
+
+  auto path = fmt::format("{}.{}.state", g_dump_path, side.name);
+
+  if (SaveStateFile::Write(path, *side.state)) {
+    fmt::print("Wrote {}\n", path);
+  } else {
+    fmt::print(stderr, "Cannot write state: {}\n", path);
+  }
+}
+
+/* Replays a frame that ended with different states from its (matching) start,
+ * comparing both cores after every slice. This runs on the main thread only,
+ * the states are large and the slices are short.
+ */
+auto bisect_frame(Side& a, Side& b) -> std::string {
+  for (auto side : { &a, &b }) {
+    side->core->LoadState(*side->previous);
+  }
+
+  for (int cycles = 0; cycles < CoreBase::kCyclesPerFrame; cycles += g_slice) {
+    for (auto side : { &a, &b }) {
+      side->core->Run(std::min(g_slice, CoreBase::kCyclesPerFrame - cycles));
+      side->core->CopyState(*side->state);
+    }
+
+    auto difference = compare(*a.state, *b.state);
+
+    if (!difference.empty()) {
+      return fmt::format("{} after {} cycles into the frame", difference, cycles + g_slice);
+    }
+  }
+
+  // Only the presented frame differed.
+  return fmt::format("frame hash differs ({:016X} vs {:016X})", a.video_device->hash, b.video_device->hash);
+}
+
+int main(int argc, char** argv) {
+  Side a{"a"};
+  Side b{"b"};
+
+  a.config->cpu.backend = Config::CPU::Backend::Interpreter;
+  a.config->cpu.idle_loop_skip = false;
+  b.config->cpu.backend = Config::CPU::Backend::CachedInterpreter;
+  b.config->cpu.idle_loop_skip = false;
+
+  parse_arguments(argc, argv, a, b);
+
+  auto movie = std::shared_ptr<InputMovie>{};
+
+  if (!g_movie_path.empty()) {
+    movie = std::make_shared<InputMovie>();
+    if (!movie->Load(g_movie_path)) {
+      fmt::print(stderr, "Cannot load input movie: {}\n", g_movie_path);
+      return -1;
+    }
+  }
+
+  setup(a, movie);
+  setup(b, movie);
+
+  auto run_frame = [](Side& side) {
+    std::swap(side.state, side.previous);
+    side.core->RunForOneFrame();
+    side.core->CopyState(*side.state);
+  };
+
+  // Core A runs on the main thread, core B on the worker.
+  auto worker = Worker{[&]() { run_frame(b); }};
+
+  for (int frame = 0; frame < g_frames; frame++) {
+    worker.Start();
+    run_frame(a);
+    worker.Wait();
+
+    auto difference = compare(*a.state, *b.state);
+
+    if (difference.empty() && a.video_device->hash == b.video_device->hash) {
+      continue;
+    }
+
+    fmt::print("Divergence in frame {}: {}\n", frame, bisect_frame(a, b));
+    print_registers(a);
+    print_registers(b);
+    dump(a);
+    dump(b);
+    return 1;
+  }
+
+  fmt::print("No divergence in {} frames (final hash {:016X})\n", g_frames, a.video_device->hash);
+  return 0;
+}
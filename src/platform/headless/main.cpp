@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <nba/core.hpp>
+#include <platform/color_correction.hpp>
+#include <platform/loader/bios.hpp>
+#include <platform/loader/boot_cache.hpp>
+#include <platform/loader/rom.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <string>
+#include <unordered_map>
+
+#include "hash_video_device.hpp"
+
+using namespace nba;
+
+static auto g_frames = 3600;
+static auto g_print_hashes = false;
+static auto g_print_frame_times = false;
+static auto g_bios_path = std::string{"bios.bin"};
+static auto g_backup_type = Config::BackupType::Detect;
+static auto g_force_rtc = false;
+static auto g_movie_path = std::string{};
+static auto g_boot_cache_path = std::string{};
+static auto g_trace_count = 0;
+static auto g_trace_path = std::string{};
+
+static auto g_config = std::make_shared<Config>();
+static auto g_core = std::unique_ptr<CoreBase>{};
+
+static auto g_video_device = std::make_shared<HashVideoDevice>();
+
+void load_game(std::string const& rom_path);
+
+void usage(char* app_name) {
+  fmt::print("Usage: {0} [--bios bios_path] [--skip-bios] [--boot-cache directory] [--force-rtc] [--save-type type] [--backend type] [--idle-loop-skip yes/no] [--frames count] [--frame-skip count] [--color type] [--pixel-format type] [--threaded-ppu] [--parallel-ppu] [--movie movie_path] [--trace count trace_path] [--hashes] [--frame-times] rom_path\n", app_name);
+  std::exit(-1);
+}
+
+void parse_arguments(int argc, char** argv) {
+  auto i = 1;
+  auto limit = argc - 1;
+  while (i < limit) {
+    auto key = std::string{argv[i++]};
+    if (key == "--bios") {
+      if (i == limit) {
+        usage(argv[0]);
+      }
+      g_bios_path = std::string{argv[i++]};
+    } else if (key == "--skip-bios") {
+      g_config->skip_bios = true;
+    } else if (key == "--force-rtc") {
+      g_force_rtc = true;
+    } else if (key == "--save-type") {
+      const std::unordered_map<std::string, Config::BackupType> save_types{
+        { "detect",     Config::BackupType::Detect    },
+        { "none",       Config::BackupType::None      },
+        { "sram",       Config::BackupType::SRAM      },
+        { "flash64",    Config::BackupType::FLASH_64  },
+        { "flash128",   Config::BackupType::FLASH_128 },
+        { "eeprom512",  Config::BackupType::EEPROM_4  },
+        { "eeprom8192", Config::BackupType::EEPROM_64 }
+      };
+      if (i == limit) {
+        usage(argv[0]);
+      }
+      auto match = save_types.find(argv[i++]);
+      if (match != save_types.end()) {
+        g_backup_type = match->second;
+      } else {
+        fmt::print("Bad save type, refer to config.toml for documentation.\n\n");
+        usage(argv[0]);
+      }
+    } else if (key == "--backend") {
+      const std::unordered_map<std::string, Config::CPU::Backend> backends{
+        { "interpreter",        Config::CPU::Backend::Interpreter       },
+        { "cached_interpreter", Config::CPU::Backend::CachedInterpreter }
+      };
+      if (i == limit) {
+        usage(argv[0]);
+      }
+      auto match = backends.find(argv[i++]);
+      if (match != backends.end()) {
+        g_config->cpu.backend = match->second;
+      } else {
+        fmt::print("Bad CPU backend, refer to config.toml for documentation.\n\n");
+        usage(argv[0]);
+      }
+    } else if (key == "--idle-loop-skip") {
+      if (i == limit) {
+        usage(argv[0]);
+      }
+      auto value = std::string{argv[i++]};
+      if (value == "yes") {
+        g_config->cpu.idle_loop_skip = true;
+      } else if (value == "no") {
+        g_config->cpu.idle_loop_skip = false;
+      } else {
+        usage(argv[0]);
+      }
+    } else if (key == "--frames") {
+      if (i == limit) {
+        usage(argv[0]);
+      }
+      g_frames = std::atoi(argv[i++]);
+      if (g_frames <= 0) {
+        usage(argv[0]);
+      }
+    } else if (key == "--frame-skip") {
+      if (i == limit) {
+        usage(argv[0]);
+      }
+      g_config->frame_skip = std::atoi(argv[i++]);
+      if (g_config->frame_skip < 0) {
+        usage(argv[0]);
+      }
+    } else if (key == "--color") {
+      if (i == limit) {
+        usage(argv[0]);
+      }
+      auto value = std::string{argv[i++]};
+      if (value == "higan") {
+        g_config->color_lut = CreateColorLUT(ColorCorrection::higan);
+      } else if (value == "agb") {
+        g_config->color_lut = CreateColorLUT(ColorCorrection::AGB);
+      } else if (value != "none") {
+        fmt::print("Bad color correction, must be either none, higan or agb.\n\n");
+        usage(argv[0]);
+      }
+    } else if (key == "--pixel-format") {
+      const std::unordered_map<std::string, PixelFormat> formats{
+        { "argb8888", PixelFormat::ARGB8888 },
+        { "rgb565",   PixelFormat::RGB565   },
+        { "bgr555",   PixelFormat::BGR555   }
+      };
+      if (i == limit) {
+        usage(argv[0]);
+      }
+      auto match = formats.find(argv[i++]);
+      if (match != formats.end()) {
+        g_video_device->format = match->second;
+      } else {
+        fmt::print("Bad pixel format, must be either argb8888, rgb565 or bgr555.\n\n");
+        usage(argv[0]);
+      }
+    } else if (key == "--threaded-ppu") {
+      g_config->threaded_rendering = true;
+    } else if (key == "--parallel-ppu") {
+      g_config->parallel_rendering = true;
+    } else if (key == "--movie") {
+      if (i == limit) {
+        usage(argv[0]);
+      }
+      g_movie_path = std::string{argv[i++]};
+    } else if (key == "--boot-cache") {
+      if (i == limit) {
+        usage(argv[0]);
+      }
+      g_boot_cache_path = std::string{argv[i++]};
+    } else if (key == "--trace") {
+      if (limit - i < 2) {
+        usage(argv[0]);
+      }
+      g_trace_count = std::atoi(argv[i++]);
+      g_trace_path = std::string{argv[i++]};
+      if (g_trace_count <= 0) {
+        usage(argv[0]);
+      }
+    } else if (key == "--hashes") {
+      g_print_hashes = true;
+    } else if (key == "--frame-times") {
+      g_print_frame_times = true;
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (i == argc) {
+    usage(argv[0]);
+  }
+  load_game(argv[i]);
+}
+
+void load_game(std::string const& rom_path) {
+  switch (BIOSLoader::Load(g_core, g_bios_path)) {
+    case BIOSLoader::Result::CannotFindFile:
+    case BIOSLoader::Result::CannotOpenFile: {
+      fmt::print("Cannot open BIOS: {}\n", g_bios_path);
+      std::exit(-1);
+      break;
+    }
+    case BIOSLoader::Result::BadImage: {
+      fmt::print("Bad BIOS image: {}\n", g_bios_path);
+      std::exit(-1);
+      break;
+    }
+  }
+
+  switch (ROMLoader::Load(g_core, rom_path, g_backup_type, g_force_rtc)) {
+    case ROMLoader::Result::CannotFindFile:
+    case ROMLoader::Result::CannotOpenFile: {
+      fmt::print("Cannot open ROM: {}\n", rom_path);
+      std::exit(-1);
+      break;
+    }
+    case ROMLoader::Result::BadImage: {
+      fmt::print("Bad ROM image: {}\n", rom_path);
+      std::exit(-1);
+      break;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  using Clock = std::chrono::steady_clock;
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+
+  g_config->video_dev = g_video_device;
+  // Runs must be reproducible, also for games with an RTC.
+  g_config->rtc.source = Config::RTC::Source::Fixed;
+  g_core = CreateCore(g_config);
+
+  parse_arguments(argc, argv);
+
+  if (!g_boot_cache_path.empty() && !g_config->skip_bios) {
+    if (BootCache::Boot(*g_core, g_boot_cache_path) == BootCache::Result::Timeout) {
+      fmt::print("The BIOS did not reach the ROM.\n");
+    }
+  } else {
+    g_core->Reset();
+  }
+
+  if (!g_movie_path.empty()) {
+    auto movie = std::make_shared<InputMovie>();
+    if (!movie->Load(g_movie_path)) {
+      fmt::print("Cannot load input movie: {}\n", g_movie_path);
+      std::exit(-1);
+    }
+    g_core->StartMoviePlayback(movie);
+  }
+
+  g_core->SetInstructionTrace(g_trace_count);
+
+  auto slowest_frame = 0.0;
+  auto t0 = Clock::now();
+
+  for (int frame = 0; frame < g_frames; frame++) {
+    auto frame_t0 = Clock::now();
+    g_core->RunForOneFrame();
+    auto frame_time = Milliseconds{Clock::now() - frame_t0}.count();
+
+    slowest_frame = std::max(slowest_frame, frame_time);
+
+    if (g_print_hashes && g_print_frame_times) {
+      fmt::print("frame {} hash {:016X} time {:.3f} ms\n", frame, g_video_device->hash, frame_time);
+    } else if (g_print_hashes) {
+      fmt::print("frame {} hash {:016X}\n", frame, g_video_device->hash);
+    } else if (g_print_frame_times) {
+      fmt::print("frame {} time {:.3f} ms\n", frame, frame_time);
+    }
+  }
+
+  auto elapsed = Milliseconds{Clock::now() - t0}.count();
+
+  // The trace covers the last instructions before the run ended, i.e. up to a hang or crash.
+  if (!g_trace_path.empty() && !g_core->DumpInstructionTrace(g_trace_path)) {
+    fmt::print("Cannot write instruction trace (core built without NBA_INSTRUCTION_TRACE?): {}\n", g_trace_path);
+  }
+
+  fmt::print("frames: {}\n", g_frames);
+  fmt::print("final hash: {:016X}\n", g_video_device->hash);
+  fmt::print("final state hash: {:016X}\n", g_core->GetStateHash());
+  fmt::print("elapsed: {:.1f} ms (slowest frame: {:.3f} ms)\n", elapsed, slowest_frame);
+  fmt::print("speed: {:.1f} fps ({:.1f}%)\n", g_frames * 1000.0 / elapsed, g_frames * 1000.0 / elapsed / 59.7275 * 100.0);
+  return 0;
+}
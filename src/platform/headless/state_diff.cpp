@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <platform/save_state_file.hpp>
+
+#include <cstring>
+#include <fmt/format.h>
+
+using namespace nba;
+
+/* Compares two save state files section by section and prints the sections that differ,
+ * with the offset of the first differing byte. Since the files are only mapped,
+ * this is cheap even for large numbers of states (i.e. the dumps of nba-lockstep).
+ */
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    fmt::print("Usage: {} a.state b.state\n", argv[0]);
+    return -1;
+  }
+
+  SaveStateFile files[2];
+
+  for (int i = 0; i < 2; i++) {
+    if (!files[i].Open(argv[1 + i])) {
+      fmt::print(stderr, "Cannot open save state: {}\n", argv[1 + i]);
+      return -1;
+    }
+  }
+
+  int differences = 0;
+
+  for (int i = 0; i < (int)SaveStateFile::Section::Count; i++) {
+    auto section = (SaveStateFile::Section)i;
+    auto name = SaveStateFile::GetName(section);
+    size_t size[2];
+    u8 const* data[2];
+
+    for (int j = 0; j < 2; j++) {
+      data[j] = files[j].GetSection(section, size[j]);
+    }
+
+    if (data[0] == nullptr && data[1] == nullptr) {
+      continue;
+    }
+
+    if (data[0] == nullptr || data[1] == nullptr || size[0] != size[1]) {
+      fmt::print("{}: only in one of the files or of different size\n", name);
+      differences++;
+      continue;
+    }
+
+    if (std::memcmp(data[0], data[1], size[0]) != 0) {
+      size_t offset = 0;
+
+      while (data[0][offset] == data[1][offset]) {
+        offset++;
+      }
+
+      fmt::print("{}: differs at offset 0x{:X} ({:02X} vs {:02X})\n", name, offset, data[0][offset], data[1][offset]);
+      differences++;
+    }
+  }
+
+  return differences == 0 ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <nba/instruction_trace.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <fmt/format.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "disassembler.hpp"
+
+using namespace nba;
+
+/* Turns a binary instruction trace (see InstructionTrace and nba-headless --trace)
+ * into a listing with the disassembly, the cycles and the registers each instruction wrote.
+ */
+
+static auto g_last = 0;
+static auto g_trace_path = std::string{};
+
+void usage(char* app_name) {
+  fmt::print("Usage: {} [--last count] trace_path\n", app_name);
+  std::exit(-1);
+}
+
+void parse_arguments(int argc, char** argv) {
+  auto i = 1;
+
+  while (i < argc - 1) {
+    auto key = std::string{argv[i++]};
+
+    if (key == "--last" && i < argc - 1) {
+      g_last = std::atoi(argv[i++]);
+      if (g_last <= 0) {
+        usage(argv[0]);
+      }
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  if (i != argc - 1) {
+    usage(argv[0]);
+  }
+  g_trace_path = argv[i];
+}
+
+template<typename T>
+bool read(std::ifstream& file, T* data, size_t count = 1) {
+  return (bool)file.read((char*)data, sizeof(T) * count);
+}
+
+int main(int argc, char** argv) {
+  parse_arguments(argc, argv);
+
+  auto file = std::ifstream{g_trace_path, std::ios::binary};
+  auto header = InstructionTrace::Header{};
+
+  if (!file.good()) {
+    fmt::print(stderr, "Cannot open trace: {}\n", g_trace_path);
+    return -1;
+  }
+
+  if (!read(file, &header) || std::memcmp(header.magic, InstructionTrace::kMagic, sizeof(header.magic)) != 0) {
+    fmt::print(stderr, "Not an instruction trace: {}\n", g_trace_path);
+    return -1;
+  }
+
+  if (header.version != InstructionTrace::kVersion) {
+    fmt::print(stderr, "Unsupported trace version {} (expected {})\n", header.version, InstructionTrace::kVersion);
+    return -1;
+  }
+
+  auto records = std::vector<InstructionTrace::Record>{header.record_count};
+  auto values = std::vector<u32>{};
+
+  values.resize(header.value_count);
+
+  if (!read(file, records.data(), records.size()) || !read(file, values.data(), values.size())) {
+    fmt::print(stderr, "Truncated trace: {}\n", g_trace_path);
+    return -1;
+  }
+
+  auto first = size_t(0);
+
+  if (g_last > 0 && records.size() > size_t(g_last)) {
+    first = records.size() - g_last;
+  }
+
+  for (auto i = first; i < records.size(); i++) {
+    auto const& record = records[i];
+    auto thumb = record.pc & 1;
+    auto address = record.pc & ~1;
+    auto line = std::string{};
+
+    if (thumb) {
+      line = fmt::format("{:08X}: {:04X}      {:<36}", address, record.opcode & 0xFFFF, DisassembleThumb(address, u16(record.opcode)));
+    } else {
+      line = fmt::format("{:08X}: {:08X}  {:<36}", address, record.opcode, DisassembleARM(address, record.opcode));
+    }
+
+    line += fmt::format(" {:>5}", record.cycles);
+
+    // The indices wrap around at 32 bits, values before the start of the stream were overwritten.
+    auto index = u32(record.value_index - header.first_value_index);
+
+    for (int reg = 0; reg < 16; reg++) {
+      if (~record.written & (1 << reg)) {
+        continue;
+      }
+
+      auto name = reg == 15 ? std::string{"cpsr"} : fmt::format("r{}", reg);
+
+      if (index >= values.size()) {
+        line += fmt::format(" {}=?", name);
+      } else {
+        line += fmt::format(" {}={:08X}", name, values[index]);
+      }
+
+      index++;
+    }
+
+    fmt::print("{}\n", line);
+  }
+
+  return 0;
+}
@@ -16,6 +16,7 @@ void QtConfig::LoadCustomData(toml::value const& data) {
 
       input.fast_forward = toml::find_or<int>(input_, "fast_forward", Qt::Key_Space);
       input.hold_fast_forward = toml::find_or<bool>(input_, "hold_fast_forward", true);
+      input.rewind = toml::find_or<int>(input_, "rewind", Qt::Key_Backslash);
     
       if (input_.contains("gba")) {
         auto gba_result = toml::expect<toml::value>(input_.at("gba"));
@@ -43,6 +44,7 @@ void QtConfig::SaveCustomData(
 ) {
   data["input"]["fast_forward"] = input.fast_forward;
   data["input"]["hold_fast_forward"] = input.hold_fast_forward;
+  data["input"]["rewind"] = input.rewind;
 
   data["input"]["gba"]["up"] = input.gba[0];
   data["input"]["gba"]["down"] = input.gba[1];
@@ -27,6 +27,7 @@ struct QtConfig final : nba::PlatformConfig {
 
     int fast_forward = Qt::Key_Space;
     bool hold_fast_forward = true;
+    int rewind = Qt::Key_Backslash;
   } input;
 
 protected:
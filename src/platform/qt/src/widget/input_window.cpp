@@ -27,6 +27,7 @@ InputWindow::InputWindow(
   CreateKeyMapEntry(layout, "Left", &config->input.gba[int(Key::Left)]);
   CreateKeyMapEntry(layout, "Right", &config->input.gba[int(Key::Right)]);
   CreateKeyMapEntry(layout, "Fast Forward", &config->input.fast_forward);
+  CreateKeyMapEntry(layout, "Rewind", &config->input.rewind);
 
   app->installEventFilter(this);
 
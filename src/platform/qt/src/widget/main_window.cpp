@@ -5,9 +5,10 @@
  * Refer to the included LICENSE file.
  */
 
-#include <platform/device/sdl_audio_device.hpp>
+#include <platform/device/audio_device_factory.hpp>
 #include <platform/loader/bios.hpp>
 #include <platform/loader/rom.hpp>
+#include <platform/video_capture.hpp>
 #include <QApplication>
 #include <QMenuBar>
 #include <QFileDialog>
@@ -28,6 +29,7 @@ MainWindow::MainWindow(
   setCentralWidget(screen.get());
 
   config->Load(kConfigPath);
+  nba::GameDB::SetHintsFile(kGameHintsPath);
 
   auto menu_bar = new QMenuBar(this);
   setMenuBar(menu_bar);
@@ -36,9 +38,12 @@ MainWindow::MainWindow(
   CreateConfigMenu(menu_bar);
   CreateHelpMenu(menu_bar);
 
-  config->video_dev = screen;
-  config->audio_dev = std::make_shared<nba::SDL2_AudioDevice>();
+  config->video_dev = std::make_shared<nba::CaptureVideoDevice>(screen, capture);
+  config->audio_dev = std::make_shared<nba::CaptureAudioDevice>(nba::CreateAudioDevice(*config), capture);
   config->input_dev = input_device;
+  if (config->measure_latency) {
+    config->latency_probe = std::make_shared<nba::LatencyProbe>();
+  }
   core = nba::CreateCore(config);
   emu_thread = std::make_unique<nba::EmulatorThread>(core);
 
@@ -53,9 +58,20 @@ MainWindow::MainWindow(
   });
   connect(this, &MainWindow::UpdateFrameRate, this, [this](int fps) {
     auto percent = fps / 59.7275 * 100;
-    setWindowTitle(QString::fromStdString(fmt::format("NanoBoyAdvance 1.4 [{} fps | {:.2f}%]", fps, percent)));;
+    auto gpu_time = screen->GetGPUFrameTime();
+    setWindowTitle(QString::fromStdString(fmt::format("NanoBoyAdvance 1.4 [{} fps | {:.2f}% | GPU {:.2f} ms]", fps, percent, gpu_time)));
+
+    // The overlay only draws graphs, so the totals go to the status bar.
+    if (config->video.frame_stats_overlay) {
+      auto snapshot = std::make_unique<nba::FrameStats::Snapshot>();
+
+      screen->GetFrameStats()->GetSnapshot(*snapshot);
+      statusBar()->showMessage(QString::fromStdString(nba::FrameStats::FormatSummary(*snapshot)));
+    }
   }, Qt::BlockingQueuedConnection);
 
+  statusBar()->setVisible(config->video.frame_stats_overlay);
+
   UpdateWindowSize();
 }
 
@@ -64,8 +80,14 @@ MainWindow::~MainWindow() {
   // shared_ptr right now. This is slightly cursed but oh well.
   (new QMainWindow{})->setCentralWidget(screen.get());
 
+  WaitForROMLoader();
+  SaveResumeState();
   emu_thread->Stop();
 
+  if (config->latency_probe) {
+    nba::Log<nba::Info>("Qt: input latency:\n{}", config->latency_probe->FormatStats());
+  }
+
   if (game_controller != nullptr) {
     SDL_GameControllerClose(game_controller);
   }
@@ -117,6 +139,28 @@ void MainWindow::CreateFileMenu(QMenuBar* menu_bar) {
 
   file_menu->addSeparator();
 
+  auto record_action = file_menu->addAction(tr("Record video"));
+  record_action->setCheckable(true);
+  record_action->setChecked(false);
+  connect(
+    record_action,
+    &QAction::triggered,
+    [=](bool record) {
+      if (!record) {
+        capture->Stop();
+        return;
+      }
+
+      auto path = QFileDialog::getSaveFileName(this, tr("Record video"), {}, tr("Y4M video and WAV audio (*)"));
+
+      if (path.isEmpty() || !capture->Start(path.toStdString(), config->audio_dev->GetSampleRate())) {
+        record_action->setChecked(false);
+      }
+    }
+  );
+
+  file_menu->addSeparator();
+
   connect(
     file_menu->addAction(tr("&Close")),
     &QAction::triggered,
@@ -172,6 +216,19 @@ void MainWindow::CreateVideoMenu(QMenu* parent) {
   }, &config->video.color, false, reload_config);
 
   CreateBooleanOption(menu, "LCD ghosting", &config->video.lcd_ghosting, false, reload_config);
+  CreateBooleanOption(menu, "Show frame stats", &config->video.frame_stats_overlay, false, [this]() {
+    statusBar()->clearMessage();
+    statusBar()->setVisible(config->video.frame_stats_overlay);
+    screen->GetFrameStats()->Reset();
+    screen->ReloadConfig();
+  });
+
+  CreateSelectionOption(menu->addMenu(tr("Affine resolution")), {
+    { "1x", 1 },
+    { "2x", 2 },
+    { "3x", 3 },
+    { "4x", 4 }
+  }, &config->video.affine_scale, true);
 }
 
 void MainWindow::CreateAudioMenu(QMenu* parent) {
@@ -188,6 +245,12 @@ void MainWindow::CreateAudioMenu(QMenu* parent) {
   auto hq_menu = menu->addMenu("MP2K HQ mixer");
   CreateBooleanOption(hq_menu, "Enable", &config->audio.mp2k_hle_enable, true);
   CreateBooleanOption(hq_menu, "Cubic interpolation", &config->audio.mp2k_hle_cubic, true);
+  CreateBooleanOption(hq_menu, "Mix on a separate thread", &config->audio.mp2k_hle_threaded, true);
+
+  CreateBooleanOption(menu, "Single-stage mixing", &config->audio.single_stage_mixing, true);
+  CreateBooleanOption(menu, "Batch mixing", &config->audio.batch_mixing, true);
+  CreateBooleanOption(menu, "Threaded mixing", &config->audio.threaded_mixing, true);
+  CreateBooleanOption(menu, "Sync to audio", &config->audio.sync_to_audio, true);
 }
 
 void MainWindow::CreateInputMenu(QMenu* parent) {
@@ -211,6 +274,12 @@ void MainWindow::CreateSystemMenu(QMenu* parent) {
   });
 
   CreateBooleanOption(menu, "Skip BIOS", &config->skip_bios);
+  CreateBooleanOption(menu, "Resume game on next start", &config->resume);
+
+  CreateSelectionOption(menu->addMenu(tr("Accuracy")), {
+    { "Accurate", nba::Config::CPU::AccuracyProfile::Accurate },
+    { "Fast",     nba::Config::CPU::AccuracyProfile::Fast     }
+  }, &config->cpu.accuracy_profile, true);
 
   menu->addSeparator();
 
@@ -326,6 +395,10 @@ bool MainWindow::eventFilter(QObject* obj, QEvent* event) {
         emu_thread->SetFastForward(!emu_thread->GetFastForward());
       }
     }
+
+    if (key == input.rewind) {
+      emu_thread->SetRewinding(pressed);
+    }
   }
 
   return QObject::eventFilter(obj, event);
@@ -339,9 +412,18 @@ void MainWindow::FileOpen() {
 
   if (dialog.exec()) {
     bool retry;
-    auto file = dialog.selectedFiles().at(0);
+    auto file = dialog.selectedFiles().at(0).toStdString();
 
+    // Keep the thread, audio device and BIOS and only switch the ROM, while the current game keeps running.
+    if (emu_thread->IsRunning()) {
+      SwitchROM(file);
+      return;
+    }
+
+    WaitForROMLoader();
+    SaveResumeState();
     emu_thread->Stop();
+    resume_path.clear();
     config->Load(kConfigPath);
 
     do {
@@ -376,31 +458,97 @@ void MainWindow::FileOpen() {
       }
     } while (retry);
 
-    switch (nba::ROMLoader::Load(core, file.toStdString(), config->backup_type, config->force_rtc)) {
-      case nba::ROMLoader::Result::CannotFindFile: {
-        QMessageBox box {this};
-        box.setText(tr("Sorry, the specified ROM file cannot be located."));
-        box.setIcon(QMessageBox::Critical);
-        box.setWindowTitle(tr("ROM not found"));
-        box.exec();
-        return;
-      }
-      case nba::ROMLoader::Result::CannotOpenFile:
-      case nba::ROMLoader::Result::BadImage: {
-        QMessageBox box {this};
-        box.setIcon(QMessageBox::Critical);
-        box.setText(tr("Sorry, the ROM file could not be loaded.\n\nMake sure that the ROM image is valid and has correct file permissions."));
-        box.setWindowTitle(tr("Cannot open ROM"));
-        box.exec();
-        return;
-      }
+    auto result = nba::ROMLoader::Load(core, file, config->backup_type, config->force_rtc);
+    if (result != nba::ROMLoader::Result::Success) {
+      ShowROMError(result);
+      return;
     }
 
     core->Reset();
+
+    resume_path = nba::ResumeState::GetPath(file);
+    if (config->resume) {
+      resume_state.Load(*core, resume_path);
+    }
+
+    if (config->rewind.enable) {
+      emu_thread->EnableRewind(config->rewind.interval, size_t(config->rewind.memory_budget) << 20);
+    } else {
+      emu_thread->DisableRewind();
+    }
+
+    emu_thread->SetRunAhead(config->run_ahead);
+    emu_thread->SetFrameDelay(std::chrono::milliseconds{config->frame_delay});
+    emu_thread->SetPowerSaving(config->power_saving);
+    emu_thread->SetThreadPolicy(config->threads.emulation);
+    emu_thread->SetSyncToAudio(config->audio.sync_to_audio);
+    emu_thread->SetFrameStats(screen->GetFrameStats());
+
     emu_thread->Start();
   }
 }
 
+void MainWindow::SwitchROM(std::string const& path) {
+  WaitForROMLoader();
+
+  rom_loader = std::thread{[this, path]() {
+    auto rom = std::make_shared<nba::ROMLoader::PreparedROM>();
+    auto result = nba::ROMLoader::Prepare(
+      path, nba::ROMLoader::GetSavePath(path), config->backup_type, config->force_rtc, *rom);
+
+    if (result != nba::ROMLoader::Result::Success) {
+      QMetaObject::invokeMethod(this, [this, result]() { ShowROMError(result); }, Qt::QueuedConnection);
+      return;
+    }
+
+    // The only handoff: the emulator thread swaps the ROM in between two frames.
+    emu_thread->Post([this, rom, path]() {
+      if (config->resume && !resume_path.empty()) {
+        resume_state.Save(*core, resume_path);
+      }
+
+      nba::ROMLoader::Attach(core, std::move(*rom));
+      core->Reset();
+
+      resume_path = nba::ResumeState::GetPath(path);
+      if (config->resume) {
+        resume_state.Load(*core, resume_path);
+      }
+    });
+  }};
+}
+
+void MainWindow::WaitForROMLoader() {
+  if (rom_loader.joinable()) {
+    rom_loader.join();
+  }
+}
+
+void MainWindow::ShowROMError(nba::ROMLoader::Result result) {
+  switch (result) {
+    case nba::ROMLoader::Result::CannotFindFile: {
+      QMessageBox box {this};
+      box.setText(tr("Sorry, the specified ROM file cannot be located."));
+      box.setIcon(QMessageBox::Critical);
+      box.setWindowTitle(tr("ROM not found"));
+      box.exec();
+      break;
+    }
+    case nba::ROMLoader::Result::CannotOpenFile:
+    case nba::ROMLoader::Result::BadImage: {
+      QMessageBox box {this};
+      box.setIcon(QMessageBox::Critical);
+      box.setText(tr("Sorry, the ROM file could not be loaded.\n\nMake sure that the ROM image is valid and has correct file permissions."));
+      box.setWindowTitle(tr("Cannot open ROM"));
+      box.exec();
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+}
+
 void MainWindow::Reset() {
   bool was_running = emu_thread->IsRunning();
 
@@ -418,7 +566,10 @@ void MainWindow::SetPause(bool value) {
 }
 
 void MainWindow::Stop() {
+  WaitForROMLoader();
+
   if (emu_thread->IsRunning()) {
+    SaveResumeState();
     emu_thread->Stop();
     config->audio_dev->Close();
     screen->Clear();
@@ -427,9 +578,30 @@ void MainWindow::Stop() {
   }
 }
 
+void MainWindow::SaveResumeState() {
+  if (config->resume && emu_thread->IsRunning()) {
+    // The state must be copied while the emulator thread is not running, but writing it does not block.
+    // Stopping also completes a pending ROM switch, which changes the resume path.
+    emu_thread->Stop();
+    if (!resume_path.empty()) {
+      resume_state.Save(*core, resume_path);
+    }
+  }
+}
+
 void MainWindow::SetKeyStatus(int channel, nba::InputDevice::Key key, bool pressed) {
+  // The keyboard reports on the GUI thread, the game controller on the emulator thread.
+  std::lock_guard guard{key_input_mutex};
+
+  bool was_pressed = key_input[0][int(key)] || key_input[1][int(key)];
+
   key_input[channel][int(key)] = pressed;
 
+  // Timestamped before the key is handed over, so that the emulator thread cannot latch it first.
+  if (pressed && !was_pressed && config->latency_probe) {
+    config->latency_probe->OnInput();
+  }
+
   input_device->SetKeyStatus(key, 
     key_input[0][int(key)] || key_input[1][int(key)]);
 }
@@ -11,12 +11,18 @@
 #include <functional>
 #include <nba/core.hpp>
 #include <platform/emulator_thread.hpp>
+#include <platform/loader/rom.hpp>
+#include <platform/resume_state.hpp>
+#include <platform/video_capture.hpp>
 #include <memory>
+#include <mutex>
 #include <QMainWindow>
 #include <QActionGroup>
 #include <QMenu>
 #include <QTimer>
 #include <SDL.h>
+#include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -43,6 +49,7 @@ protected:
 
 private:
   static constexpr auto kConfigPath = "config.toml";
+  static constexpr auto kGameHintsPath = "game_hints.toml";
 
   void CreateFileMenu(QMenuBar* menu_bar);
   void CreateVideoMenu(QMenu* parent);
@@ -94,9 +101,17 @@ private:
     menu->addActions(group->actions());
   }
 
+  /* Loads the ROM on a background thread and hands it to the running emulator thread at a frame boundary.
+   * The thread, the audio device, the screen and the BIOS are kept.
+   */
+  void SwitchROM(std::string const& path);
+  void WaitForROMLoader();
+  void ShowROMError(nba::ROMLoader::Result result);
+
   void Reset();
   void SetPause(bool value);
   void Stop();
+  void SaveResumeState();
 
   void SetKeyStatus(int channel, nba::InputDevice::Key key, bool pressed);
   void InitGameController();
@@ -107,9 +122,14 @@ private:
   std::shared_ptr<Screen> screen;
   std::shared_ptr<nba::BasicInputDevice> input_device = std::make_shared<nba::BasicInputDevice>();
   std::shared_ptr<QtConfig> config = std::make_shared<QtConfig>();
+  std::shared_ptr<nba::VideoCapture> capture = std::make_shared<nba::VideoCapture>();
   std::unique_ptr<nba::CoreBase> core;
   std::unique_ptr<nba::EmulatorThread> emu_thread;
+  nba::ResumeState resume_state;
+  std::string resume_path;
+  std::thread rom_loader;
   bool key_input[2][nba::InputDevice::kKeyCount] {false};
+  std::mutex key_input_mutex;
 
   QAction* pause_action;
   InputWindow* input_window;
@@ -5,65 +5,287 @@
  * Refer to the included LICENSE file.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <GL/glew.h>
+#include <nba/log.hpp>
+#include <nba/trace.hpp>
+#include <QCoreApplication>
+#include <QHBoxLayout>
+#include <utility>
 
 #include "widget/screen.hpp"
 
 Screen::Screen(
   QWidget* parent,
   std::shared_ptr<nba::PlatformConfig> config
-)   : QOpenGLWidget(parent)
-    , ogl_video_device(config) {
+)   : QWidget(parent)
+    , config(config) {
   QSurfaceFormat format;
   format.setProfile(QSurfaceFormat::CoreProfile);
   format.setMajorVersion(3);
   format.setMinorVersion(3);
-  format.setSwapInterval(0);
-  setFormat(format);
-  connect(this, &Screen::RequestDraw, this, &Screen::OnRequestDraw);
+  // The render thread is paced by the display, swapping blocks until the next vertical blank.
+  format.setSwapInterval(1);
+
+  surface = new QWindow{};
+  surface->setSurfaceType(QSurface::OpenGLSurface);
+  surface->setFormat(format);
+  surface->installEventFilter(this);
+  surface->create();
+
+  auto container = QWidget::createWindowContainer(surface, this);
+  auto layout = new QHBoxLayout{this};
+  container->setFocusPolicy(Qt::NoFocus);
+  layout->setContentsMargins(0, 0, 0, 0);
+  layout->addWidget(container);
+
+  context = std::make_unique<QOpenGLContext>();
+  context->setFormat(format);
+  if (!context->create()) {
+    nba::Log<nba::Error>("Qt: failed to create the OpenGL context");
+  } else if (!QOpenGLContext::supportsThreadedOpenGL()) {
+    nba::Log<nba::Warn>("Qt: the platform does not support rendering with OpenGL on a separate thread");
+  }
+
+  render_thread.reset(QThread::create([this] { RenderThreadMain(); }));
+  context->moveToThread(render_thread.get());
+  render_thread->start();
+}
+
+Screen::~Screen() {
+  Notify([this] { quit = true; });
+  render_thread->wait();
+}
+
+auto Screen::GetFrameScale() -> int {
+  frame_scale = std::clamp(config->video.affine_scale, 1, kMaxFrameScale);
+  return frame_scale;
+}
+
+auto Screen::AcquireFrame() -> void* {
+  auto& frame = frames.GetWriteBuffer();
+
+  frame.scale = frame_scale;
+  frame.pixels.resize(kGBANativeWidth * kGBANativeHeight * frame.scale * frame.scale);
+  return frame.pixels.data();
+}
+
+void Screen::SetDirtyLines(std::bitset<kFrameHeight> const& lines) {
+  frames.GetWriteBuffer().dirty_lines = lines;
 }
 
 void Screen::Draw(u32* buffer) {
-  should_clear = false;
-  emit RequestDraw(buffer);
+  auto& frame = frames.GetWriteBuffer();
+
+  // The emulator falls back to its own buffer if it could not render into ours.
+  if (buffer != frame.pixels.data()) {
+    frame.scale = frame_scale;
+    frame.pixels.resize(kGBANativeWidth * kGBANativeHeight * frame.scale * frame.scale);
+    std::copy_n(buffer, frame.pixels.size(), frame.pixels.begin());
+  }
+
+  frame.sequence = ++frame_sequence;
+  frames.Publish();
+
+  Notify([this] {
+    frame_pending = true;
+    should_clear = false;
+  });
+}
+
+auto Screen::AcquirePPUFrame() -> nba::PPUFrame* {
+  if (config->video.gpu_renderer && gpu_renderer_available) {
+    return &ppu_frames.GetWriteBuffer();
+  }
+  return nullptr;
+}
+
+void Screen::Draw(nba::PPUFrame const& frame) {
+  ppu_frames.Publish();
+
+  Notify([this] {
+    frame_pending = true;
+    should_clear = false;
+  });
 }
 
 void Screen::Clear() {
-  should_clear = true;
-  update();
+  Notify([this] { should_clear = true; });
 }
 
 void Screen::ReloadConfig() {
-  ogl_video_device.ReloadConfig();
+  // The shader programs belong to the context, so they are rebuilt on the render thread.
+  Notify([this] { reload_config = true; });
 }
 
-void Screen::OnRequestDraw(u32* buffer) {
-  this->buffer = buffer;
-  update();
+bool Screen::eventFilter(QObject* object, QEvent* event) {
+  if (object == surface) {
+    switch (event->type()) {
+      case QEvent::Expose: {
+        Notify([this] {
+          exposed = surface->isExposed();
+          redraw = true;
+        });
+        break;
+      }
+      case QEvent::Resize: {
+        auto dpr = surface->devicePixelRatio();
+        int width  = std::max(static_cast<int>(surface->width()  * dpr), 1);
+        int height = std::max(static_cast<int>(surface->height() * dpr), 1);
+
+        Notify([&] {
+          surface_width = width;
+          surface_height = height;
+          redraw = true;
+        });
+        break;
+      }
+      default: {
+        break;
+      }
+    }
+  }
+
+  return QWidget::eventFilter(object, event);
 }
 
-void Screen::initializeGL() {
-  makeCurrent();
-  ogl_video_device.Initialize();
+void Screen::RenderThreadMain() {
+  NBA_TRACE_THREAD("Screen render thread");
+
+  std::unique_lock lock{render_mutex};
+
+  while (true) {
+    render_cv.wait(lock, [this] {
+      return quit || (exposed && (frame_pending || redraw || should_clear || reload_config));
+    });
+
+    if (quit) {
+      break;
+    }
+
+    bool clear = std::exchange(should_clear, false);
+    bool reload = std::exchange(reload_config, false);
+    int width = surface_width;
+    int height = surface_height;
+
+    frame_pending = false;
+    redraw = false;
+    // Any frame that was published before this point is presented by the swap below.
+    auto render_start = std::chrono::steady_clock::now();
+    lock.unlock();
+
+    context->makeCurrent(surface);
+
+    // The device is created once the window can be drawn to, since that is when the context first becomes current.
+    if (!ogl_video_device) {
+      ogl_video_device = std::make_unique<nba::OGLVideoDevice>(config);
+      ogl_video_device->SetFrameStats(frame_stats);
+      ogl_video_device->Initialize();
+      gpu_renderer_available = ogl_video_device->HasPPURenderer();
+    } else if (reload) {
+      ogl_video_device->ReloadConfig();
+    }
+
+    if (clear) {
+      frames.Consume();
+      ppu_frames.Consume();
+      have_frame = false;
+    }
+
+    UpdateViewport(width, height);
+    int new_frames = Render();
+
+    // Blocks until the next vertical blank, frames that are published in the meantime replace each other.
+    context->swapBuffers(surface);
+
+    // Wait for the swap to complete, since the driver may return before the frame is on screen.
+    if (auto const& latency_probe = config->latency_probe) {
+      glFinish();
+      latency_probe->OnPresented(render_start);
+    }
+
+    frame_stats->OnFramePresented(render_start, std::chrono::steady_clock::now(), new_frames);
+
+    lock.lock();
+  }
+
+  lock.unlock();
+
+  if (ogl_video_device) {
+    context->makeCurrent(surface);
+    ogl_video_device.reset();
+    context->doneCurrent();
+  }
+
+  // Hand the context back, so that it is destroyed on the GUI thread.
+  context->moveToThread(QCoreApplication::instance()->thread());
 }
 
-void Screen::paintGL() {
-  if (buffer != nullptr) {
-    ogl_video_device.SetDefaultFBO(defaultFramebufferObject());
-    ogl_video_device.Draw(buffer);
+// Returns how many frames were published since the last render, which are all replaced by the newest one.
+auto Screen::Render() -> int {
+  NBA_TRACE_ZONE("Screen::Render");
+
+  bool new_frame = false;
+  int new_frames = 0;
+
+  if (frames.Consume()) {
+    have_frame = true;
+    show_ppu_frame = false;
+    new_frame = true;
   }
 
-  if (should_clear) {
-    glClearColor(0.0, 0.0, 0.0, 0.0);
-    glClear(GL_COLOR_BUFFER_BIT);
-    should_clear = false;
+  if (ppu_frames.Consume()) {
+    have_frame = true;
+    show_ppu_frame = true;
+    new_frames = 1;
   }
+
+  // The contents of the back buffer are undefined after a swap, including the borders around the viewport.
+  glBindFramebuffer(GL_FRAMEBUFFER, context->defaultFramebufferObject());
+  glViewport(0, 0, drawable_width, drawable_height);
+  glClearColor(0.0, 0.0, 0.0, 1.0);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  if (have_frame) {
+    ogl_video_device->SetDefaultFBO(context->defaultFramebufferObject());
+    if (show_ppu_frame) {
+      ogl_video_device->SetFrameScale(frame_scale);
+      ogl_video_device->Draw(ppu_frames.GetReadBuffer());
+    } else {
+      auto& frame = frames.GetReadBuffer();
+
+      ogl_video_device->SetFrameScale(frame.scale);
+
+      if (!new_frame) {
+        ogl_video_device->SetDirtyLines({});
+      } else if (frame.sequence == drawn_sequence + 1) {
+        ogl_video_device->SetDirtyLines(frame.dirty_lines);
+      } else {
+        ogl_video_device->SetDirtyLines(std::bitset<kFrameHeight>{}.set());
+      }
+
+      if (new_frame) {
+        new_frames = int(frame.sequence - drawn_sequence);
+      }
+
+      drawn_sequence = frame.sequence;
+      ogl_video_device->Draw((u32*)frame.pixels.data());
+    }
+
+    gpu_frame_time = ogl_video_device->GetGPUFrameTime();
+  }
+
+  return new_frames;
 }
 
-void Screen::resizeGL(int width, int height) {
-  auto dpr = devicePixelRatio();
-  width  *= dpr;
-  height *= dpr;
+void Screen::UpdateViewport(int width, int height) {
+  if (width == drawable_width && height == drawable_height) {
+    return;
+  }
+
+  drawable_width = width;
+  drawable_height = height;
 
   int viewport_width;
   int viewport_height;
@@ -84,5 +306,5 @@ void Screen::resizeGL(int width, int height) {
     viewport_y = (height - viewport_height) / 2;
   }
 
-  ogl_video_device.SetViewport(viewport_x, viewport_y, viewport_width, viewport_height);
+  ogl_video_device->SetViewport(viewport_x, viewport_y, viewport_width, viewport_height);
 }
@@ -7,39 +7,121 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <platform/device/ogl_video_device.hpp>
-#include <QGLWidget>
-#include <QOpenGLWidget>
+#include <platform/frame_stats.hpp>
+#include <platform/triple_buffer.hpp>
+#include <QOpenGLContext>
+#include <QThread>
+#include <QWidget>
+#include <QWindow>
+#include <vector>
 
-struct Screen : QOpenGLWidget, nba::VideoDevice {
+/* Presents frames on a dedicated render thread, which owns the OpenGL context and draws into a native child window.
+ * The emulator thread publishes frames and wakes the render thread, which uploads the newest one and swaps with vsync.
+ * The GUI thread only forwards resize, expose and config changes, so menus and layout never delay a frame
+ * and a blocking swap never stalls the UI.
+ */
+struct Screen : QWidget, nba::VideoDevice {
   Screen(
     QWidget* parent,
     std::shared_ptr<nba::PlatformConfig> config
   );
+ ~Screen() override;
 
+  auto GetFrameScale() -> int final;
+  auto AcquireFrame() -> void* final;
+  void SetDirtyLines(std::bitset<kFrameHeight> const& lines) final;
   void Draw(u32* buffer) final;
+  auto AcquirePPUFrame() -> nba::PPUFrame* final;
+  void Draw(nba::PPUFrame const& frame) final;
   void Clear();
   void ReloadConfig();
 
-signals:
-  void RequestDraw(u32* buffer);
+  auto GetGPUFrameTime() const -> float {
+    return gpu_frame_time;
+  }
 
-private slots:
-  void OnRequestDraw(u32* buffer);
+  // Every presented frame is reported here, for the emulator thread to add the emulated frames.
+  auto GetFrameStats() const -> std::shared_ptr<nba::FrameStats> const& {
+    return frame_stats;
+  }
 
 protected:
-  void initializeGL() override;
-  void paintGL() override;
-  void resizeGL(int width, int height) override;
+  bool eventFilter(QObject* object, QEvent* event) override;
 
 private:
   static constexpr int kGBANativeWidth = 240;
   static constexpr int kGBANativeHeight = 160;
   static constexpr float kGBANativeAR = static_cast<float>(kGBANativeWidth) / static_cast<float>(kGBANativeHeight);
 
-  u32* buffer = nullptr;
+  void RenderThreadMain();
+  auto Render() -> int;
+  void UpdateViewport(int width, int height);
+
+  // Wakes the render thread after 'update' set what it has to do.
+  template<typename Functor>
+  void Notify(Functor update) {
+    {
+      std::lock_guard guard{render_mutex};
+      update();
+    }
+    render_cv.notify_one();
+  }
+
+  /* The emulator thread renders directly into the write slot and publishes it once the frame is complete.
+   * The render thread always displays the newest complete frame and never sees a partially rendered one.
+   */
+  struct Frame {
+    int scale = 1;
+    std::vector<u32> pixels;
+    u64 sequence = 0;
+    std::bitset<kFrameHeight> dirty_lines; // relative to the frame with the previous sequence number
+  };
+
+  nba::TripleBuffer<Frame> frames;
+  bool have_frame = false;
+
+  // Frames that were published but never displayed are missed, in that case all lines are uploaded.
+  u64 frame_sequence = 0;
+  u64 drawn_sequence = 0;
+
+  // The frame scale that the emulator was last reset with, GPU rendered frames use it as well.
+  std::atomic_int frame_scale{1};
+
+  // Frames for the GPU renderer are handed over the same way, in place of rendered frames.
+  nba::TripleBuffer<nba::PPUFrame> ppu_frames;
+  bool show_ppu_frame = false;
+  std::atomic_bool gpu_renderer_available{false};
+
+  QWindow* surface;
+  std::unique_ptr<QOpenGLContext> context;
+  std::unique_ptr<QThread> render_thread;
+
+  /* Requests for the render thread, guarded by render_mutex.
+   * Anything but a new frame redraws the current frame, since the window contents may have been lost.
+   */
+  std::mutex render_mutex;
+  std::condition_variable render_cv;
+  bool quit = false;
+  bool exposed = false;
+  bool frame_pending = false;
+  bool redraw = false;
   bool should_clear = false;
-  nba::OGLVideoDevice ogl_video_device;
+  bool reload_config = false;
+  int surface_width = 1;   // in device pixels
+  int surface_height = 1;
+
+  // Only used on the render thread, which creates and destroys it with the context current.
+  std::unique_ptr<nba::OGLVideoDevice> ogl_video_device;
+  int drawable_width = 0; // the surface size that the viewport was last set for
+  int drawable_height = 0;
+  std::atomic<float> gpu_frame_time{0};
+  std::shared_ptr<nba::FrameStats> frame_stats = std::make_shared<nba::FrameStats>();
+  std::shared_ptr<nba::PlatformConfig> config;
 
   Q_OBJECT
 };
@@ -7,12 +7,19 @@
 
 
 #include <nba/core.hpp>
-#include <platform/device/sdl_audio_device.hpp>
+#include <platform/device/audio_device_factory.hpp>
 #include <platform/loader/bios.hpp>
 #include <platform/loader/rom.hpp>
 #include <platform/config.hpp>
+#include <platform/emulator_thread.hpp>
+#include <platform/frame_stats.hpp>
+#include <platform/resume_state.hpp>
+#include <platform/triple_buffer.hpp>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <cmath>
 #include <cstdlib>
 #include <cstring>
 #include <filesystem>
@@ -22,7 +29,6 @@
 #include <string>
 #include <toml.hpp>
 #include <unordered_map>
-#include <mutex>
 
 #include <GL/glew.h>
 
@@ -36,12 +42,23 @@ static constexpr auto kNativeHeight = 160;
 static SDL_Window* g_window;
 static SDL_GLContext g_gl_context;
 static GLuint g_gl_texture;
-static u32 g_framebuffer[kNativeWidth * kNativeHeight];
-static auto g_frame_counter = 0;
 static auto g_swap_interval = 1;
 
-static std::atomic_bool g_sync_to_audio = true;
-static int g_cycles_per_audio_frame = 0;
+/* Frames are rendered on the emulator thread and presented on the main thread.
+ * Only the newest complete frame is presented, so that neither thread waits for the other.
+ */
+static TripleBuffer<std::array<u32, kNativeWidth * kNativeHeight>> g_frames;
+static std::atomic_int g_frame_counter = 0;
+static std::atomic<u64> g_frame_sequence = 0;
+
+/* There is no overlay in this frontend, the statistics are shown in the window title
+ * if PlatformConfig::Video::frame_stats_overlay is set.
+ */
+static auto g_frame_stats = std::make_shared<FrameStats>();
+
+static auto g_lock_to_vsync = false;
+static double g_cycles_per_refresh = 0;
+static double g_cycles_pending = 0;
 
 static auto g_keyboard_input_device = BasicInputDevice{};
 static auto g_controller_input_device = BasicInputDevice{};
@@ -51,7 +68,14 @@ static auto g_fastforward = false;
 
 static auto g_config = std::make_shared<PlatformConfig>();
 static auto g_core = nba::CreateCore(g_config);
-static auto g_core_lock = std::mutex{};
+
+/* Runs the emulation, unless it is locked to the display refresh (see update_vsync_lock()).
+ * Then the main thread emulates the cycles of each refresh right before presenting it.
+ */
+static EmulatorThread g_emu_thread{g_core};
+
+static auto g_resume_state = ResumeState{};
+static auto g_resume_path = std::string{};
 
 struct KeyMap {
   SDL_Keycode fastforward = SDLK_SPACE;
@@ -72,21 +96,32 @@ struct CombinedInputDevice : public InputDevice {
 };
 
 struct SDL2_VideoDevice : public VideoDevice {
+  auto AcquireFrame() -> void* final {
+    return g_frames.GetWriteBuffer().data();
+  }
+
   void Draw(u32* buffer) final {
-    std::memcpy(g_framebuffer, buffer, sizeof(u32) * kNativeWidth * kNativeHeight);
+    auto& frame = g_frames.GetWriteBuffer();
+
+    // The frame was not rendered into the write slot if it only updated the changed lines.
+    if (buffer != frame.data()) {
+      std::memcpy(frame.data(), buffer, sizeof(u32) * kNativeWidth * kNativeHeight);
+    }
+    g_frames.Publish();
     g_frame_counter++;
+    g_frame_sequence++;
   }
 };
 
 void load_game(std::string const& rom_path);
+void update_vsync_lock(int refresh_rate);
 void update_fullscreen();
 void update_viewport();
 void update_key(SDL_KeyboardEvent* event);
 void update_controller();
-void audio_passthrough(SDL2_AudioDevice* audio_device, s16* stream, int byte_len);
 
 void usage(char* app_name) {
-  fmt::print("Usage: {0} [--bios bios_path] [--force-rtc] [--save-type type] [--fullscreen] [--scale factor] [--resampler type] [--sync-to-audio yes/no] rom_path\n", app_name);
+  fmt::print("Usage: {0} [--bios bios_path] [--force-rtc] [--save-type type] [--fullscreen] [--scale factor] [--resampler type] [--sync-to-audio yes/no] [--lock-to-vsync yes/no] rom_path\n", app_name);
   std::exit(-1);
 }
 
@@ -122,6 +157,18 @@ void parse_arguments(int argc, char** argv) {
       } else {
         usage(argv[0]);
       }
+    } else if (key == "--lock-to-vsync") {
+      if (i == limit) {
+        usage(argv[0]);
+      }
+      auto value = std::string{argv[i++]};
+      if (value == "yes") {
+        g_config->video.lock_to_vsync = true;
+      } else if (value == "no") {
+        g_config->video.lock_to_vsync = false;
+      } else {
+        usage(argv[0]);
+      }
     } else if (key == "--force-rtc") {
       g_config->force_rtc = true;
     } else if (key == "--save-type") {
@@ -177,6 +224,8 @@ void parse_arguments(int argc, char** argv) {
 void load_game(std::string const& rom_path) {
   auto& bios_path = g_config->bios_path;
 
+  g_resume_path = ResumeState::GetPath(rom_path);
+
   switch (nba::BIOSLoader::Load(g_core, g_config->bios_path)) {
     case nba::BIOSLoader::Result::CannotFindFile:
     case nba::BIOSLoader::Result::CannotOpenFile: {
@@ -285,6 +334,7 @@ void init(int argc, char** argv) {
     fs::current_path(fs::absolute(argv[0]).replace_filename(fs::path{ }));
   }
   g_config->Load("config.toml");
+  nba::GameDB::SetHintsFile("game_hints.toml");
   parse_arguments(argc, argv);
   load_keymap();
   SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_GAMECONTROLLER);
@@ -303,8 +353,14 @@ void init(int argc, char** argv) {
 
   SDL_DisplayMode mode;
   SDL_GetCurrentDisplayMode(0, &mode);
-  if (mode.refresh_rate % 60 == 0) {
-    g_swap_interval = mode.refresh_rate / 60;
+  g_lock_to_vsync = g_config->video.lock_to_vsync;
+  if (g_lock_to_vsync) {
+    // Every refresh runs the emulator, pacing by the audio device would fight with that.
+    g_config->sync_to_audio = false;
+    g_config->audio.sync_to_audio = true;
+  } else if (g_config->sync_to_audio) {
+    // The emulator thread waits for the audio device, whose clock drift the core then makes up for.
+    g_config->audio.sync_to_audio = true;
   }
   SDL_GL_SetSwapInterval(g_swap_interval);
 
@@ -334,7 +390,6 @@ void init(int argc, char** argv) {
   }
   glClearColor(0, 0, 0, 1);
   glClear(GL_COLOR_BUFFER_BIT);
-  g_sync_to_audio = g_config->sync_to_audio;
   update_fullscreen();
   update_viewport();
   for (int i = 0; i < SDL_NumJoysticks(); i++) {
@@ -346,41 +401,100 @@ void init(int argc, char** argv) {
       }
     }
   }
-  auto audio_device = std::make_shared<nba::SDL2_AudioDevice>();
-  audio_device->SetPassthrough((SDL_AudioCallback)audio_passthrough);
-  g_config->audio_dev = audio_device;
+  g_config->audio_dev = nba::CreateAudioDevice(*g_config);
   g_config->input_dev = std::make_shared<CombinedInputDevice>();
   g_config->video_dev = std::make_shared<SDL2_VideoDevice>();
   g_core->Reset();
-  g_cycles_per_audio_frame = 16777216ULL * audio_device->GetBlockSize() / audio_device->GetSampleRate();
+  if (g_config->resume) {
+    g_resume_state.Load(*g_core, g_resume_path);
+  }
+  if (g_lock_to_vsync) {
+    // The core runs on the main thread in this mode.
+    g_config->threads.emulation.ApplyToCurrentThread(nba::ThreadPolicy::Role::Emulation);
+    update_vsync_lock(mode.refresh_rate);
+  } else {
+    g_emu_thread.SetFrameRateCallback([](float fps) {});
+    g_emu_thread.SetPerFrameCallback([]() {});
+    g_emu_thread.SetRunAhead(g_config->run_ahead);
+    g_emu_thread.SetFrameDelay(std::chrono::milliseconds{g_config->frame_delay});
+    g_emu_thread.SetPowerSaving(g_config->power_saving);
+    g_emu_thread.SetThreadPolicy(g_config->threads.emulation);
+    g_emu_thread.SetSyncToAudio(g_config->sync_to_audio);
+    g_emu_thread.SetFrameStats(g_frame_stats);
+    g_emu_thread.Start();
+  }
+}
+
+/* Decides how many cycles to run per display refresh.
+ * If the refresh rate is within 0.5% of a multiple of the GBA frame rate, every GBA frame is shown for
+ * exactly that many refreshes, and the slight change in speed is made up for when resampling the audio.
+ * Otherwise emulation runs in real time and every refresh presents the most recent frame.
+ */
+void update_vsync_lock(int refresh_rate) {
+  static constexpr double kCyclesPerSecond = 16777216.0;
+  static constexpr double kCyclesPerFrame = 280896.0;
+  static constexpr double kFrameRate = kCyclesPerSecond / kCyclesPerFrame;
+
+  if (refresh_rate <= 0) {
+    refresh_rate = 60;
+  }
+
+  auto refreshes_per_frame = std::max(1, int(std::round(refresh_rate / kFrameRate)));
+  auto speed = refresh_rate / (kFrameRate * refreshes_per_frame);
+
+  if (std::abs(speed - 1.0) <= 0.005) {
+    g_cycles_per_refresh = kCyclesPerFrame / refreshes_per_frame;
+  } else {
+    g_cycles_per_refresh = kCyclesPerSecond / refresh_rate;
+    speed = 1.0;
+  }
+
+  g_cycles_pending = 0;
+  g_core->SetEmulationSpeed(float(speed));
 }
 
 void loop() {
   auto event = SDL_Event{};
 
   auto ticks_start = SDL_GetTicks();
+  auto presented_sequence = u64{0};
+  auto snapshot = std::make_unique<FrameStats::Snapshot>();
 
   for (;;) {
     update_controller();
-    if (!g_sync_to_audio) {
-      g_core_lock.lock();
-      g_core->RunForOneFrame();
-      g_core_lock.unlock();
+    if (g_lock_to_vsync) {
+      auto emulation_start = std::chrono::steady_clock::now();
+      if (g_fastforward) {
+        g_core->RunForOneFrame();
+      } else {
+        g_cycles_pending += g_cycles_per_refresh;
+        auto cycles = int(g_cycles_pending);
+        g_cycles_pending -= cycles;
+        g_core->Run(cycles);
+      }
+      // One refresh worth of cycles counts as a frame here.
+      g_frame_stats->OnFrameEmulated(
+        std::chrono::steady_clock::now() - emulation_start, g_core->GetAudioStats(), g_fastforward);
     }
+    auto present_start = std::chrono::steady_clock::now();
     update_viewport();
     glClear(GL_COLOR_BUFFER_BIT);
     glBindTexture(GL_TEXTURE_2D, g_gl_texture);
-    glTexImage2D(
-      GL_TEXTURE_2D,
-      0,
-      GL_RGBA,
-      kNativeWidth,
-      kNativeHeight,
-      0,
-      GL_BGRA,
-      GL_UNSIGNED_BYTE,
-      g_framebuffer
-    );
+    // Read before consuming, so that every frame that is counted is also the newest one or replaced by it.
+    auto sequence = g_frame_sequence.load();
+    if (g_frames.Consume()) {
+      glTexImage2D(
+        GL_TEXTURE_2D,
+        0,
+        GL_RGBA,
+        kNativeWidth,
+        kNativeHeight,
+        0,
+        GL_BGRA,
+        GL_UNSIGNED_BYTE,
+        g_frames.GetReadBuffer().data()
+      );
+    }
     glBegin(GL_QUADS);
     glTexCoord2f(0, 0);
     glVertex2f(-1.0f, 1.0f);
@@ -392,11 +506,17 @@ void loop() {
     glVertex2f(-1.0f, -1.0f);
     glEnd();
     SDL_GL_SwapWindow(g_window);
+    g_frame_stats->OnFramePresented(present_start, std::chrono::steady_clock::now(), int(sequence - presented_sequence));
+    presented_sequence = sequence;
     auto ticks_end = SDL_GetTicks();
     if ((ticks_end - ticks_start) >= 1000) {
-      auto title = fmt::format("NanoBoyAdvance [{0} fps | {1}%]", g_frame_counter, int(g_frame_counter / 60.0 * 100.0));
+      auto frames = g_frame_counter.exchange(0);
+      auto title = fmt::format("NanoBoyAdvance [{0} fps | {1}%]", frames, int(frames / 60.0 * 100.0));
+      if (g_config->video.frame_stats_overlay) {
+        g_frame_stats->GetSnapshot(*snapshot);
+        title += fmt::format(" [{}]", FrameStats::FormatSummary(*snapshot));
+      }
       SDL_SetWindowTitle(g_window, title.c_str());
-      g_frame_counter = 0;
       ticks_start = ticks_end;
     }
     while (SDL_PollEvent(&event)) {
@@ -409,23 +529,18 @@ void loop() {
 }
 
 void destroy() {
-  // Make sure that the audio thread no longer accesses the emulator.
-  g_core_lock.lock();
+  g_emu_thread.Stop();
+  if (g_config->resume) {
+    g_resume_state.Save(*g_core, g_resume_path);
+  }
   if (g_game_controller != nullptr) {
     SDL_GameControllerClose(g_game_controller);
   }
   SDL_GL_DeleteContext(g_gl_context);
   SDL_DestroyWindow(g_window);
   SDL_QuitSubSystem(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_GAMECONTROLLER);
-}
-
-void audio_passthrough(SDL2_AudioDevice* audio_device, s16* stream, int byte_len) {
-  if (g_sync_to_audio) {
-    g_core_lock.lock();
-    g_core->Run(g_cycles_per_audio_frame);
-    g_core_lock.unlock();
-  }
-  audio_device->InvokeCallback(stream, byte_len);
+  // The window is gone already, so the user does not have to wait for the state to be written.
+  g_resume_state.Wait();
 }
 
 void update_fullscreen() {
@@ -443,7 +558,7 @@ void update_viewport() {
 
 void update_fastforward(bool fastforward) {
   g_fastforward = fastforward;
-  g_sync_to_audio = !fastforward && g_config->sync_to_audio;
+  g_emu_thread.SetFastForward(fastforward);
   if (fastforward) {
     SDL_GL_SetSwapInterval(0);
   } else {
@@ -460,9 +575,13 @@ void update_key(SDL_KeyboardEvent* event) {
   }
 
   if (key == keymap.reset && !pressed) {
-    g_core_lock.lock();
+    bool was_running = g_emu_thread.IsRunning();
+
+    g_emu_thread.Stop();
     g_core->Reset();
-    g_core_lock.unlock();
+    if (was_running) {
+      g_emu_thread.Start();
+    }
   }
 
   if (key == keymap.fullscreen && !pressed) {
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <nba/core.hpp>
+#include <platform/frame_limiter.hpp>
+#include <platform/loader/bios.hpp>
+#include <platform/loader/rom.hpp>
+
+#include <cstdlib>
+#include <fmt/format.h>
+#include <string>
+
+#include "stream_server.hpp"
+
+using namespace nba;
+using namespace nba::stream;
+
+// Passes every frame on to the server along with the lines that changed, which it uses to skip unchanged slices.
+struct StreamVideoDevice : VideoDevice {
+  StreamVideoDevice(StreamServer& server) : server(server) {}
+
+  auto GetPixelFormat() -> PixelFormat final {
+    return PixelFormat::RGB565;
+  }
+
+  void SetDirtyLines(std::bitset<kFrameHeight> const& lines) final {
+    dirty_lines = lines;
+  }
+
+  void Draw(u16* buffer) final {
+    server.SendFrame(buffer, dirty_lines);
+    dirty_lines.set();
+  }
+
+  void Draw(u32* buffer) final { }
+
+private:
+  StreamServer& server;
+  std::bitset<kFrameHeight> dirty_lines;
+};
+
+// The server pulls the samples of every frame, so the audio follows the emulated clock exactly.
+struct StreamAudioDevice : AudioDevice {
+  auto GetSampleRate() -> int final { return kAudioSampleRate; }
+  auto GetBlockSize() -> int final { return 1024; }
+
+  bool Open(void* userdata, Callback callback) final {
+    this->userdata = userdata;
+    this->callback = callback;
+    return true;
+  }
+
+  void SetPause(bool value) final { }
+
+  void Close() final {
+    callback = nullptr;
+  }
+
+  // Returns the samples of one emulated frame (280896 cycles at 16.78 MHz).
+  auto PullFrame() -> std::vector<s16> const& {
+    samples_due += u64(280896) * kAudioSampleRate;
+
+    int count = int(samples_due >> 24);
+
+    samples_due &= 0xFFFFFF;
+    samples.resize(count * 2);
+
+    if (callback) {
+      callback(userdata, samples.data(), count * sizeof(s16) * 2);
+    }
+    return samples;
+  }
+
+private:
+  void* userdata = nullptr;
+  Callback callback = nullptr;
+  u64 samples_due = 0;
+  std::vector<s16> samples;
+};
+
+static void usage(char* app_name) {
+  fmt::print("Usage: {0} [--bios bios_path] [--skip-bios] [--port port] rom_path\n", app_name);
+  std::exit(-1);
+}
+
+int main(int argc, char** argv) {
+  auto bios_path = std::string{"bios.bin"};
+  auto port = kDefaultPort;
+  auto config = std::make_shared<Config>();
+
+  int i = 1;
+
+  while (i < argc - 1) {
+    auto key = std::string{argv[i++]};
+
+    if (key == "--bios") {
+      bios_path = argv[i++];
+    } else if (key == "--skip-bios") {
+      config->skip_bios = true;
+    } else if (key == "--port") {
+      port = u16(std::atoi(argv[i++]));
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  if (i != argc - 1) {
+    usage(argv[0]);
+  }
+
+  StreamServer server;
+
+  if (!server.Open(port)) {
+    fmt::print("Cannot listen on UDP port {}\n", port);
+    return -1;
+  }
+
+  auto input_device = std::make_shared<BasicInputDevice>();
+  auto audio_device = std::make_shared<StreamAudioDevice>();
+
+  config->video_dev = std::make_shared<StreamVideoDevice>(server);
+  config->audio_dev = audio_device;
+  config->input_dev = input_device;
+
+  // Lets the server send only the slices that changed.
+  config->skip_unchanged_lines = true;
+
+  auto core = CreateCore(config);
+
+  if (BIOSLoader::Load(core, bios_path) != BIOSLoader::Result::Success) {
+    fmt::print("Cannot load BIOS: {}\n", bios_path);
+    return -1;
+  }
+
+  if (ROMLoader::Load(core, argv[i]) != ROMLoader::Result::Success) {
+    fmt::print("Cannot load ROM: {}\n", argv[i]);
+    return -1;
+  }
+
+  core->Reset();
+
+  fmt::print("Waiting for a client on UDP port {}\n", port);
+
+  /* Input is applied right before a frame starts and the frame is sent as soon as it was drawn,
+   * so input reaches the client within the frame that it arrived before.
+   */
+  FrameLimiter frame_limiter{59.7275};
+
+  while (true) {
+    frame_limiter.Run([&]() {
+      server.PollInput(*input_device);
+
+      // Emulation is paused while nobody watches.
+      if (!server.HasClient()) {
+        return;
+      }
+
+      core->RunForOneFrame();
+
+      auto const& samples = audio_device->PullFrame();
+
+      server.SendAudio(samples.data(), int(samples.size() / 2));
+    }, [](float fps) { });
+  }
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <nba/integer.hpp>
+
+/* UDP protocol between the streaming server (nba-stream) and its client.
+ * All values are little-endian. Every packet starts with a PacketHeader.
+ *
+ * The client sends an InputPacket whenever its keys change, and at least every kKeepAliveMs,
+ * the server streams to the address that the most recent input packet came from.
+ *
+ * Frames are split into slices of kSliceLines lines, each compressed with zlib (RGB565 pixels),
+ * so that a lost packet only loses its own slice. Only the slices that changed are sent,
+ * except for keyframes, which the client requests after it lost packets.
+ * The last packet of every frame has kEndOfFrame set (and may carry no slice), so the client
+ * can present the frame right away. Audio is sent once per frame as 16-bit stereo PCM.
+ */
+
+namespace nba::stream {
+
+constexpr u32 kMagic = 0x5341424E; // "NBAS"
+constexpr u16 kDefaultPort = 7860;
+constexpr int kKeepAliveMs = 500;
+constexpr int kSliceLines = 4;
+constexpr int kAudioSampleRate = 32768;
+constexpr int kMaxAudioSamplesPerPacket = 256;
+
+enum class PacketType : u8 {
+  Input = 0,
+  Video = 1,
+  Audio = 2
+};
+
+enum PacketFlags : u8 {
+  kRequestKeyframe = 1, // Input: send all slices of the next frame
+  kKeyframe = 2,        // Video: all slices of this frame are sent
+  kEndOfFrame = 4       // Video: the last packet of this frame
+};
+
+struct PacketHeader {
+  u32 magic;
+  PacketType type;
+  u8  flags;
+  u16 reserved;
+  u32 sequence; // Input: counts up per packet, Video: the frame number, Audio: the number of frames sent before it
+};
+
+struct InputPacket {
+  PacketHeader header;
+  u16 keys; // bit n is set if InputDevice::Key n is pressed
+  u16 reserved;
+};
+
+struct VideoPacket {
+  PacketHeader header;
+  u8  first_line;
+  u8  line_count;
+  u16 size; // followed by this many bytes of compressed pixel data
+};
+
+struct AudioPacket {
+  PacketHeader header;
+  u16 count; // followed by this many stereo samples
+  u16 reserved;
+};
+
+static_assert(sizeof(PacketHeader) == 12);
+static_assert(sizeof(InputPacket) == 16);
+static_assert(sizeof(VideoPacket) == 16);
+static_assert(sizeof(AudioPacket) == 16);
+
+} // namespace nba::stream
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#include <arpa/inet.h>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "stream_server.hpp"
+
+namespace nba::stream {
+
+StreamServer::~StreamServer() {
+  if (socket_fd != -1) {
+    close(socket_fd);
+  }
+}
+
+bool StreamServer::Open(u16 port) {
+  socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+  if (socket_fd == -1) {
+    return false;
+  }
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+
+  if (bind(socket_fd, (sockaddr*)&address, sizeof(address)) == -1) {
+    return false;
+  }
+
+  // Input is polled once per frame, the emulation thread never waits for the network.
+  fcntl(socket_fd, F_SETFL, fcntl(socket_fd, F_GETFL) | O_NONBLOCK);
+
+  packet.resize(sizeof(VideoPacket) + compressBound(kFrameWidth * kSliceLines * sizeof(u16)));
+  return true;
+}
+
+void StreamServer::PollInput(BasicInputDevice& input_device) {
+  InputPacket input;
+  sockaddr_in address;
+  socklen_t address_length = sizeof(address);
+
+  while (true) {
+    auto size = recvfrom(socket_fd, &input, sizeof(input), 0, (sockaddr*)&address, &address_length);
+
+    if (size == -1) {
+      break;
+    }
+
+    if (size != sizeof(input) || input.header.magic != kMagic || input.header.type != PacketType::Input) {
+      continue;
+    }
+
+    bool new_client = !has_client ||
+      address.sin_addr.s_addr != client_address.sin_addr.s_addr ||
+      address.sin_port != client_address.sin_port;
+
+    if (new_client) {
+      fmt::print("Streaming to {}:{}\n", inet_ntoa(address.sin_addr), ntohs(address.sin_port));
+      client_address = address;
+      has_client = true;
+      keyframe_requested = true;
+    } else if (s32(input.header.sequence - input_sequence) <= 0) {
+      // Reordered, the keys of a newer packet were applied already.
+      continue;
+    }
+
+    if (input.header.flags & kRequestKeyframe) {
+      keyframe_requested = true;
+    }
+
+    input_sequence = input.header.sequence;
+    keys = input.keys;
+    last_input = Clock::now();
+  }
+
+  if (has_client && Clock::now() - last_input > std::chrono::milliseconds{kKeepAliveMs * 4}) {
+    fmt::print("Client timed out\n");
+    has_client = false;
+    keys = 0;
+  }
+
+  for (int key = 0; key < InputDevice::kKeyCount; key++) {
+    bool pressed = keys & (1 << key);
+
+    if (input_device.Poll((InputDevice::Key)key) != pressed) {
+      input_device.SetKeyStatus((InputDevice::Key)key, pressed);
+    }
+  }
+}
+
+void StreamServer::SendFrame(u16 const* buffer, std::bitset<kFrameHeight> const& lines) {
+  if (!has_client) {
+    return;
+  }
+
+  bool keyframe = keyframe_requested || ++frames_since_keyframe >= kKeyframeInterval;
+
+  if (keyframe) {
+    keyframe_requested = false;
+    frames_since_keyframe = 0;
+  }
+
+  VideoPacket header{};
+  header.header.magic = kMagic;
+  header.header.type = PacketType::Video;
+  header.header.flags = keyframe ? kKeyframe : 0;
+  header.header.sequence = frame;
+
+  auto send_slice = [&](int first_line, int line_count, bool last) {
+    uLongf size = 0;
+
+    if (line_count != 0) {
+      size = uLongf(packet.size() - sizeof(VideoPacket));
+
+      // Level 1, because the latency matters much more than the last few percent of bandwidth.
+      compress2(&packet[sizeof(VideoPacket)], &size,
+        (Bytef const*)&buffer[first_line * kFrameWidth], kFrameWidth * line_count * sizeof(u16), 1);
+    }
+
+    if (last) {
+      header.header.flags |= kEndOfFrame;
+    }
+
+    header.first_line = u8(first_line);
+    header.line_count = u8(line_count);
+    header.size = u16(size);
+    std::memcpy(packet.data(), &header, sizeof(header));
+    Send(packet.data(), sizeof(VideoPacket) + size);
+  };
+
+  int last_slice = -1;
+
+  for (int line = 0; line < kFrameHeight; line += kSliceLines) {
+    bool changed = keyframe;
+
+    for (int i = 0; i < kSliceLines && !changed; i++) {
+      changed = lines[line + i];
+    }
+
+    if (changed) {
+      if (last_slice != -1) {
+        send_slice(last_slice, kSliceLines, false);
+      }
+      last_slice = line;
+    }
+  }
+
+  // The last slice that is sent carries the end of frame flag, an unchanged frame is just that flag.
+  if (last_slice != -1) {
+    send_slice(last_slice, kSliceLines, true);
+  } else {
+    send_slice(0, 0, true);
+  }
+
+  frame++;
+}
+
+void StreamServer::SendAudio(s16 const* samples, int count) {
+  if (!has_client) {
+    return;
+  }
+
+  u8 data[sizeof(AudioPacket) + kMaxAudioSamplesPerPacket * sizeof(s16) * 2];
+
+  AudioPacket header{};
+  header.header.magic = kMagic;
+  header.header.type = PacketType::Audio;
+  header.header.sequence = frame;
+
+  while (count > 0) {
+    int length = std::min(count, kMaxAudioSamplesPerPacket);
+
+    header.count = u16(length);
+    std::memcpy(data, &header, sizeof(header));
+    std::memcpy(&data[sizeof(header)], samples, length * sizeof(s16) * 2);
+    Send(data, sizeof(header) + length * sizeof(s16) * 2);
+
+    samples += length * 2;
+    count -= length;
+  }
+}
+
+void StreamServer::Send(void const* data, size_t size) {
+  // A full socket buffer loses the packet like the network would, the client asks for a keyframe then.
+  sendto(socket_fd, data, size, 0, (sockaddr const*)&client_address, sizeof(client_address));
+}
+
+} // namespace nba::stream
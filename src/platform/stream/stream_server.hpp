@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2021 fleroviux
+ *
+ * Licensed under GPLv3 or any later version.
+ * Refer to the included LICENSE file.
+ */
+
+#pragma once
+
+#include <bitset>
+#include <chrono>
+#include <netinet/in.h>
+#include <nba/device/input_device.hpp>
+#include <nba/device/video_device.hpp>
+#include <vector>
+
+#include "protocol.hpp"
+
+namespace nba::stream {
+
+// Sends frames and audio to one client over UDP and receives its input (see protocol.hpp).
+struct StreamServer {
+  static constexpr int kFrameWidth = VideoDevice::kFrameWidth;
+  static constexpr int kFrameHeight = VideoDevice::kFrameHeight;
+
+ ~StreamServer();
+
+  bool Open(u16 port);
+  auto HasClient() const -> bool { return has_client; }
+
+  // Receives all pending input packets and applies the keys of the newest one.
+  void PollInput(BasicInputDevice& input_device);
+
+  // Compresses and sends the slices that contain changed lines, or all slices for a keyframe.
+  void SendFrame(u16 const* buffer, std::bitset<kFrameHeight> const& lines);
+
+  void SendAudio(s16 const* samples, int count);
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  // A full frame is sent every so often, so that the client recovers from lost packets even without asking.
+  static constexpr int kKeyframeInterval = 300;
+
+  void Send(void const* data, size_t size);
+
+  int socket_fd = -1;
+  bool has_client = false;
+  sockaddr_in client_address;
+  Clock::time_point last_input;
+  u32 input_sequence = 0;
+  u16 keys = 0;
+
+  u32 frame = 0;
+  bool keyframe_requested = true;
+  int frames_since_keyframe = 0;
+
+  std::vector<u8> packet;
+};
+
+} // namespace nba::stream